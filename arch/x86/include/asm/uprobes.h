@@ -44,6 +44,15 @@ struct arch_uprobe {
 			u8	reg_offset;	/* to the start of pt_regs */
 			u8	ilen;
 		}			push;
+		struct {
+			s32	imm;		/* lea displacement or immediate */
+			u8	ilen;
+			u8	opc1;
+			u8	dst;		/* pt_regs offsets, see push */
+			u8	src;		/* or the lea base */
+			u8	index;
+			u8	flags;
+		}			emul;
 	};
 };
 
@@ -829,6 +829,229 @@ static const struct uprobe_xol_ops push_xol_ops = {
 	.emulate  = push_emulate_op,
 };
 
+#ifdef CONFIG_X86_64
+/*
+ * Register forms of mov, add/sub with an immediate and lea, the common
+ * function prologue insns after push.  Emulating them saves the trap and
+ * the XOL slot of the single step.
+ */
+#define EMUL_W		0x01	/* 64-bit operand size */
+#define EMUL_RIP	0x02	/* lea: rip-relative */
+#define EMUL_BASE	0x04	/* lea: has a base register */
+#define EMUL_INDEX	0x08	/* lea: has an index register */
+#define EMUL_SCALE(f)	((f) >> 4)
+
+#define EMUL_FLAGS_MASK	(X86_EFLAGS_CF | X86_EFLAGS_PF | X86_EFLAGS_AF | \
+			 X86_EFLAGS_ZF | X86_EFLAGS_SF | X86_EFLAGS_OF)
+
+static const u8 emul_reg_offset[16] = {
+	offsetof(struct pt_regs, ax),	offsetof(struct pt_regs, cx),
+	offsetof(struct pt_regs, dx),	offsetof(struct pt_regs, bx),
+	offsetof(struct pt_regs, sp),	offsetof(struct pt_regs, bp),
+	offsetof(struct pt_regs, si),	offsetof(struct pt_regs, di),
+	offsetof(struct pt_regs, r8),	offsetof(struct pt_regs, r9),
+	offsetof(struct pt_regs, r10),	offsetof(struct pt_regs, r11),
+	offsetof(struct pt_regs, r12),	offsetof(struct pt_regs, r13),
+	offsetof(struct pt_regs, r14),	offsetof(struct pt_regs, r15),
+};
+
+static inline unsigned long *emul_reg(struct pt_regs *regs, u8 offset)
+{
+	return (void *)regs + offset;
+}
+
+static void emul_set_reg(struct arch_uprobe *auprobe, struct pt_regs *regs,
+			 unsigned long val)
+{
+	/* 32-bit results are zero extended */
+	if (!(auprobe->emul.flags & EMUL_W))
+		val = (u32)val;
+	*emul_reg(regs, auprobe->emul.dst) = val;
+	regs->ip += auprobe->emul.ilen;
+}
+
+static bool mov_emulate_op(struct arch_uprobe *auprobe, struct pt_regs *regs)
+{
+	emul_set_reg(auprobe, regs, *emul_reg(regs, auprobe->emul.src));
+	return true;
+}
+
+static bool alu_emulate_op(struct arch_uprobe *auprobe, struct pt_regs *regs)
+{
+	unsigned long val = *emul_reg(regs, auprobe->emul.dst);
+	unsigned long imm = (long)auprobe->emul.imm;
+	unsigned long flags;
+
+	/* let the CPU compute the arithmetic flags */
+	if (auprobe->emul.opc1 == 0x2d)
+		asm ("subq %[imm], %[val]\n\t"
+		     "pushfq\n\t"
+		     "popq %[flags]"
+		     : [val] "+r" (val), [flags] "=r" (flags)
+		     : [imm] "r" (imm) : "cc");
+	else
+		asm ("addq %[imm], %[val]\n\t"
+		     "pushfq\n\t"
+		     "popq %[flags]"
+		     : [val] "+r" (val), [flags] "=r" (flags)
+		     : [imm] "r" (imm) : "cc");
+
+	regs->flags = (regs->flags & ~EMUL_FLAGS_MASK) | (flags & EMUL_FLAGS_MASK);
+	emul_set_reg(auprobe, regs, val);
+	return true;
+}
+
+static bool lea_emulate_op(struct arch_uprobe *auprobe, struct pt_regs *regs)
+{
+	unsigned long addr = (long)auprobe->emul.imm;
+	u8 flags = auprobe->emul.flags;
+
+	if (flags & EMUL_RIP)
+		addr += regs->ip + auprobe->emul.ilen;
+	if (flags & EMUL_BASE)
+		addr += *emul_reg(regs, auprobe->emul.src);
+	if (flags & EMUL_INDEX)
+		addr += *emul_reg(regs, auprobe->emul.index) << EMUL_SCALE(flags);
+
+	emul_set_reg(auprobe, regs, addr);
+	return true;
+}
+
+static const struct uprobe_xol_ops mov_xol_ops = {
+	.emulate  = mov_emulate_op,
+};
+
+static const struct uprobe_xol_ops alu_xol_ops = {
+	.emulate  = alu_emulate_op,
+};
+
+static const struct uprobe_xol_ops lea_xol_ops = {
+	.emulate  = lea_emulate_op,
+};
+
+static int lea_setup_modrm(struct arch_uprobe *auprobe, struct insn *insn,
+			   u8 rex)
+{
+	u8 modrm = insn->modrm.bytes[0], sib = insn->sib.bytes[0];
+	u8 mod = X86_MODRM_MOD(modrm), rm = X86_MODRM_RM(modrm);
+	u8 base, index;
+
+	auprobe->emul.imm = insn->displacement.value;
+
+	if (rm != 4) {
+		if (mod == 0 && rm == 5) {
+			auprobe->emul.flags |= EMUL_RIP;
+			return 0;
+		}
+		auprobe->emul.src = emul_reg_offset[rm | (X86_REX_B(rex) ? 8 : 0)];
+		auprobe->emul.flags |= EMUL_BASE;
+		return 0;
+	}
+
+	base = X86_SIB_BASE(sib) | (X86_REX_B(rex) ? 8 : 0);
+	index = X86_SIB_INDEX(sib) | (X86_REX_X(rex) ? 8 : 0);
+
+	/* no base, only disp32 */
+	if (!(mod == 0 && (base & 7) == 5)) {
+		auprobe->emul.src = emul_reg_offset[base];
+		auprobe->emul.flags |= EMUL_BASE;
+	}
+	/* %rsp can not be an index */
+	if (index != 4) {
+		auprobe->emul.index = emul_reg_offset[index];
+		auprobe->emul.flags |= EMUL_INDEX | (X86_SIB_SCALE(sib) << 4);
+	}
+	return 0;
+}
+
+/* Returns -ENOSYS if none of the emul xol_ops handles this insn */
+static int emul_setup_xol_ops(struct arch_uprobe *auprobe, struct insn *insn)
+{
+	u8 opc1 = OPCODE1(insn), modrm, rex = 0;
+	u8 reg, rm;
+
+	/* no legacy prefixes (segments, operand or address size) or REX2 */
+	if (insn->prefixes.nbytes || insn->x86_64 != 1 ||
+	    insn->rex_prefix.nbytes > 1 || insn->opcode.nbytes != 1 ||
+	    !insn->modrm.nbytes)
+		return -ENOSYS;
+
+	if (insn->rex_prefix.nbytes)
+		rex = insn->rex_prefix.bytes[0];
+
+	modrm = insn->modrm.bytes[0];
+	reg = X86_MODRM_REG(modrm) | (X86_REX_R(rex) ? 8 : 0);
+	rm = X86_MODRM_RM(modrm) | (X86_REX_B(rex) ? 8 : 0);
+
+	memset(&auprobe->emul, 0, sizeof(auprobe->emul));
+	if (X86_REX_W(rex))
+		auprobe->emul.flags = EMUL_W;
+
+	switch (opc1) {
+	case 0x89:	/* mov reg, reg/mem */
+	case 0x8b:	/* mov reg/mem, reg */
+		if (X86_MODRM_MOD(modrm) != 3)
+			return -ENOSYS;
+		auprobe->emul.dst = emul_reg_offset[opc1 == 0x89 ? rm : reg];
+		auprobe->emul.src = emul_reg_offset[opc1 == 0x89 ? reg : rm];
+		auprobe->ops = &mov_xol_ops;
+		break;
+
+	case 0x81:	/* add/sub $imm32, reg */
+	case 0x83:	/* add/sub $imm8, reg */
+		if (X86_MODRM_MOD(modrm) != 3 || !X86_REX_W(rex))
+			return -ENOSYS;
+		if (X86_MODRM_REG(modrm) == 0)
+			auprobe->emul.opc1 = 0x05;
+		else if (X86_MODRM_REG(modrm) == 5)
+			auprobe->emul.opc1 = 0x2d;
+		else
+			return -ENOSYS;
+		auprobe->emul.dst = emul_reg_offset[rm];
+		auprobe->emul.imm = insn->immediate.value;
+		auprobe->ops = &alu_xol_ops;
+		break;
+
+	case 0x8d:	/* lea mem, reg */
+		if (X86_MODRM_MOD(modrm) == 3)
+			return -ENOSYS;
+		auprobe->emul.dst = emul_reg_offset[reg];
+		lea_setup_modrm(auprobe, insn, rex);
+		auprobe->ops = &lea_xol_ops;
+		break;
+
+	default:
+		return -ENOSYS;
+	}
+
+	auprobe->emul.ilen = insn->length;
+	return 0;
+}
+#else
+static int emul_setup_xol_ops(struct arch_uprobe *auprobe, struct insn *insn)
+{
+	return -ENOSYS;
+}
+#endif /* CONFIG_X86_64 */
+
+static bool insn_is_nop(struct insn *insn)
+{
+	static const u8 endbr64[] = { 0xf3, 0x0f, 0x1e, 0xfa };
+	static const u8 endbr32[] = { 0xf3, 0x0f, 0x1e, 0xfb };
+
+	if (insn->opcode.nbytes != 2 || OPCODE1(insn) != 0x0f)
+		return false;
+
+	/* nopw/nopl, the multi-byte nops compilers pad functions with */
+	if (OPCODE2(insn) == 0x1f)
+		return true;
+
+	/* with user IBT unsupported the endbr landing pads are nops too */
+	return insn->length == 4 &&
+	       (!memcmp(insn->kaddr, endbr64, 4) ||
+		!memcmp(insn->kaddr, endbr32, 4));
+}
+
 /* Returns -ENOSYS if branch_xol_ops doesn't handle this insn */
 static int branch_setup_xol_ops(struct arch_uprobe *auprobe, struct insn *insn)
 {
@@ -848,6 +1071,11 @@ static int branch_setup_xol_ops(struct arch_uprobe *auprobe, struct insn *insn)
 		break;
 
 	case 0x0f:
+		/* prefix* + multi-byte nop, like 0x90 */
+		if (insn_is_nop(insn)) {
+			opc1 = 0x90;
+			goto setup;
+		}
 		if (insn->opcode.nbytes != 2)
 			return -ENOSYS;
 		/*
@@ -986,6 +1214,10 @@ int arch_uprobe_analyze_insn(struct arch_uprobe *auprobe, struct mm_struct *mm,
 	if (ret != -ENOSYS)
 		return ret;
 
+	ret = emul_setup_xol_ops(auprobe, &insn);
+	if (ret != -ENOSYS)
+		return ret;
+
 	/*
 	 * Figure out which fixups default_post_xol_op() will need to perform,
 	 * and annotate defparam->fixups accordingly.
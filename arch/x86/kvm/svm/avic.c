@@ -340,6 +340,20 @@ void avic_ring_doorbell(struct kvm_vcpu *vcpu)
 static void avic_kick_vcpu(struct kvm_vcpu *vcpu, u32 icrl)
 {
 	vcpu->arch.apic->irr_pending = true;
+
+	/*
+	 * Hardware has already set the IRR bit in the target's backing page
+	 * and rung the doorbell for targets that were running.  A target
+	 * that is in the guest now either was one of those, or entered the
+	 * guest after the IRR was set and picked the IRQ up at VMRUN, so
+	 * ringing its doorbell again would only send a spurious IPI to its
+	 * pCPU, e.g. for every running target of a multicast IPI.  Only
+	 * targets that are not in the guest need to be woken.
+	 */
+	if (READ_ONCE(vcpu->arch.apic->apicv_active) &&
+	    smp_load_acquire(&vcpu->mode) == IN_GUEST_MODE)
+		return;
+
 	svm_complete_interrupt_delivery(vcpu,
 					icrl & APIC_MODE_MASK,
 					icrl & APIC_INT_LEVELTRIG,
@@ -79,6 +79,9 @@
 #include "blk-cgroup.h"
 #include "blk.h"
 
+#define CREATE_TRACE_POINTS
+#include <trace/events/iolatency.h>
+
 #define DEFAULT_SCALE_COOKIE 1000000U
 
 static struct blkcg_policy blkcg_policy_iolatency;
@@ -136,9 +139,20 @@ struct latency_stat {
 	};
 };
 
+/*
+ * Log2 histogram of bio latencies, only maintained while the
+ * iolatency_window_hist tracepoint is enabled. The per-cpu copies only ever
+ * count up; each window reports the difference to the previous snapshot.
+ */
+struct iolatency_hist {
+	u32 buckets[BLKG_IOSTAT_NR][IOLATENCY_HIST_BUCKETS];
+};
+
 struct iolatency_grp {
 	struct blkg_policy_data pd;
 	struct latency_stat __percpu *stats;
+	struct iolatency_hist __percpu *hist;
+	struct iolatency_hist hist_last;
 	struct latency_stat cur_stat;
 	struct blk_iolatency *blkiolat;
 	unsigned int max_depth;
@@ -229,6 +243,72 @@ static inline void latency_stat_record_time(struct iolatency_grp *iolat,
 	put_cpu_ptr(stat);
 }
 
+static inline void iolatency_hist_record(struct iolatency_grp *iolat,
+					 blk_opf_t opf, u64 req_time)
+{
+	int rwd, bucket;
+
+	if (!trace_iolatency_window_hist_enabled())
+		return;
+
+	if (op_is_discard(opf))
+		rwd = BLKG_IOSTAT_DISCARD;
+	else if (op_is_write(opf))
+		rwd = BLKG_IOSTAT_WRITE;
+	else
+		rwd = BLKG_IOSTAT_READ;
+
+	bucket = min_t(int, fls64(div_u64(req_time, NSEC_PER_USEC)),
+		       IOLATENCY_HIST_BUCKETS - 1);
+
+	this_cpu_inc(iolat->hist->buckets[rwd][bucket]);
+}
+
+/*
+ * Sum the per-cpu histograms and report what was added since the last
+ * window. Remote counters are only read, never reset, so concurrent
+ * increments are not lost, and offline cpus keep contributing what they
+ * counted before going down.
+ */
+static void iolatency_hist_flush(struct iolatency_grp *iolat)
+{
+	struct blkcg_gq *blkg = lat_to_blkg(iolat);
+	struct iolatency_hist sum = {};
+	int cpu, rwd, i;
+	bool empty;
+
+	if (!trace_iolatency_window_hist_enabled())
+		return;
+
+	for_each_possible_cpu(cpu) {
+		struct iolatency_hist *hist = per_cpu_ptr(iolat->hist, cpu);
+
+		for (rwd = 0; rwd < BLKG_IOSTAT_NR; rwd++)
+			for (i = 0; i < IOLATENCY_HIST_BUCKETS; i++)
+				sum.buckets[rwd][i] +=
+					READ_ONCE(hist->buckets[rwd][i]);
+	}
+
+	for (rwd = 0; rwd < BLKG_IOSTAT_NR; rwd++) {
+		empty = true;
+		for (i = 0; i < IOLATENCY_HIST_BUCKETS; i++) {
+			u32 cur = sum.buckets[rwd][i];
+
+			/* u32 arithmetic, so wrapping counters still work */
+			sum.buckets[rwd][i] = cur - iolat->hist_last.buckets[rwd][i];
+			iolat->hist_last.buckets[rwd][i] = cur;
+			if (sum.buckets[rwd][i])
+				empty = false;
+		}
+		if (empty)
+			continue;
+
+		trace_iolatency_window_hist(blkg->q->disk->disk_name,
+				cgroup_id(blkg->blkcg->css.cgroup), rwd,
+				iolat->cur_win_nsec, sum.buckets[rwd]);
+	}
+}
+
 static inline bool latency_sum_ok(struct iolatency_grp *iolat,
 				  struct latency_stat *stat)
 {
@@ -486,8 +566,8 @@ static void blkcg_iolatency_throttle(struct rq_qos *rqos, struct bio *bio)
 }
 
 static void iolatency_record_time(struct iolatency_grp *iolat,
-				  struct bio_issue *issue, u64 now,
-				  bool issue_as_root)
+				  struct bio_issue *issue, blk_opf_t opf,
+				  u64 now, bool issue_as_root)
 {
 	u64 start = bio_issue_time(issue);
 	u64 req_time;
@@ -515,6 +595,7 @@ static void iolatency_record_time(struct iolatency_grp *iolat,
 	}
 
 	latency_stat_record_time(iolat, req_time);
+	iolatency_hist_record(iolat, opf, req_time);
 }
 
 #define BLKIOLATENCY_MIN_ADJUST_TIME (500 * NSEC_PER_MSEC)
@@ -539,6 +620,8 @@ static void iolatency_check_latencies(struct iolatency_grp *iolat, u64 now)
 	}
 	preempt_enable();
 
+	iolatency_hist_flush(iolat);
+
 	parent = blkg_to_lat(blkg->parent);
 	if (!parent)
 		return;
@@ -625,7 +708,8 @@ static void blkcg_iolatency_done_bio(struct rq_qos *rqos, struct bio *bio)
 		 * submitted, so do not account for it.
 		 */
 		if (iolat->min_lat_nsec && bio->bi_status != BLK_STS_AGAIN) {
-			iolatency_record_time(iolat, &bio->bi_issue, now,
+			iolatency_record_time(iolat, &bio->bi_issue,
+					      bio->bi_opf, now,
 					      issue_as_root);
 			window_start = atomic64_read(&iolat->window_start);
 			if (now > window_start &&
@@ -972,11 +1056,19 @@ static struct blkg_policy_data *iolatency_pd_alloc(struct gendisk *disk,
 		return NULL;
 	iolat->stats = __alloc_percpu_gfp(sizeof(struct latency_stat),
 				       __alignof__(struct latency_stat), gfp);
-	if (!iolat->stats) {
-		kfree(iolat);
-		return NULL;
-	}
+	if (!iolat->stats)
+		goto err_free;
+	iolat->hist = __alloc_percpu_gfp(sizeof(struct iolatency_hist),
+				       __alignof__(struct iolatency_hist), gfp);
+	if (!iolat->hist)
+		goto err_free_stats;
 	return &iolat->pd;
+
+err_free_stats:
+	free_percpu(iolat->stats);
+err_free:
+	kfree(iolat);
+	return NULL;
 }
 
 static void iolatency_pd_init(struct blkg_policy_data *pd)
@@ -1035,6 +1127,7 @@ static void iolatency_pd_free(struct blkg_policy_data *pd)
 {
 	struct iolatency_grp *iolat = pd_to_lat(pd);
 	free_percpu(iolat->stats);
+	free_percpu(iolat->hist);
 	kfree(iolat);
 }
 
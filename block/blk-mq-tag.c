@@ -242,6 +242,122 @@ void blk_mq_put_tags(struct blk_mq_tags *tags, int *tag_array, int nr_tags)
 					tag_array, nr_tags);
 }
 
+/*
+ * Never keep more than a quarter of the tag space in the per-ctx caches, so an
+ * allocation that has to wait in blk_mq_get_tag() always has enough requests
+ * in flight to wake it up.
+ */
+static unsigned int blk_mq_tag_cache_limit(struct blk_mq_hw_ctx *hctx)
+{
+	unsigned int depth = READ_ONCE(hctx->tags->bitmap_tags.sb.depth);
+
+	return min_t(unsigned int, BLK_MQ_TAG_CACHE_SIZE,
+		     depth / (4 * max_t(unsigned int, hctx->nr_ctx, 1)));
+}
+
+unsigned int blk_mq_tag_cache_get(struct blk_mq_alloc_data *data)
+{
+	struct blk_mq_hw_ctx *hctx = data->hctx;
+	struct blk_mq_tag_cache *cache = &data->ctx->tag_cache[hctx->type];
+	unsigned int tag = BLK_MQ_NO_TAG;
+	unsigned long flags;
+
+	if ((data->flags & BLK_MQ_REQ_RESERVED) ||
+	    (data->rq_flags & RQF_SCHED_TAGS) || !READ_ONCE(cache->nr))
+		return BLK_MQ_NO_TAG;
+
+	spin_lock_irqsave(&cache->lock, flags);
+	if (cache->nr && cache->hctx == hctx)
+		tag = cache->tags[--cache->nr];
+	spin_unlock_irqrestore(&cache->lock, flags);
+
+	/* Same as blk_mq_get_tag(), the caller will retry on an active hctx. */
+	if (tag != BLK_MQ_NO_TAG &&
+	    unlikely(test_bit(BLK_MQ_S_INACTIVE, &hctx->state))) {
+		blk_mq_put_tag(hctx->tags, data->ctx, tag);
+		return BLK_MQ_NO_TAG;
+	}
+	return tag;
+}
+
+/*
+ * Try to stash a freed driver tag in the software queue it was allocated from.
+ * Returns false if the caller has to release it to the sbitmap instead.
+ */
+bool blk_mq_tag_cache_put(struct blk_mq_hw_ctx *hctx, struct blk_mq_ctx *ctx,
+		unsigned int tag)
+{
+	struct request_queue *q = hctx->queue;
+	struct blk_mq_tags *tags = hctx->tags;
+	struct blk_mq_tag_cache *cache = &ctx->tag_cache[hctx->type];
+	unsigned long flags;
+	bool cached = false;
+
+	if (q->elevator || blk_mq_tag_is_reserved(tags, tag) ||
+	    (hctx->flags & (BLK_MQ_F_TAG_QUEUE_SHARED |
+			    BLK_MQ_F_TAG_HCTX_SHARED)))
+		return false;
+
+	/*
+	 * Hand the tag straight to any waiter, and stop caching once a freeze
+	 * has started so that the caches stay empty until it is released.
+	 */
+	if (atomic_read(&tags->bitmap_tags.ws_active) ||
+	    percpu_ref_is_dying(&q->q_usage_counter))
+		return false;
+
+	spin_lock_irqsave(&cache->lock, flags);
+	if (cache->nr < blk_mq_tag_cache_limit(hctx) &&
+	    (!cache->nr || cache->hctx == hctx)) {
+		cache->hctx = hctx;
+		cache->tags[cache->nr++] = tag;
+		cached = true;
+	}
+	spin_unlock_irqrestore(&cache->lock, flags);
+
+	return cached;
+}
+
+void blk_mq_tag_cache_drain(struct blk_mq_ctx *ctx, enum hctx_type type)
+{
+	struct blk_mq_tag_cache *cache = &ctx->tag_cache[type];
+	unsigned int tags[BLK_MQ_TAG_CACHE_SIZE];
+	struct blk_mq_hw_ctx *hctx;
+	unsigned long flags;
+	unsigned int i, nr;
+
+	spin_lock_irqsave(&cache->lock, flags);
+	nr = cache->nr;
+	hctx = cache->hctx;
+	memcpy(tags, cache->tags, nr * sizeof(tags[0]));
+	cache->nr = 0;
+	spin_unlock_irqrestore(&cache->lock, flags);
+
+	for (i = 0; i < nr; i++)
+		blk_mq_put_tag(hctx->tags, ctx, tags[i]);
+}
+
+/*
+ * Return all cached tags to the sbitmaps. Called once the queue is frozen, as
+ * the tags, the hctx mappings or the elevator may change before it thaws.
+ */
+void blk_mq_tag_cache_drain_queue(struct request_queue *q)
+{
+	enum hctx_type type;
+	int cpu;
+
+	if (!queue_is_mq(q))
+		return;
+
+	for_each_possible_cpu(cpu) {
+		struct blk_mq_ctx *ctx = per_cpu_ptr(q->queue_ctx, cpu);
+
+		for (type = HCTX_TYPE_DEFAULT; type < HCTX_MAX_TYPES; type++)
+			if (READ_ONCE(ctx->tag_cache[type].nr))
+				blk_mq_tag_cache_drain(ctx, type);
+	}
+}
+
 struct bt_iter_data {
 	struct blk_mq_hw_ctx *hctx;
 	struct request_queue *q;
@@ -196,15 +196,21 @@ EXPORT_SYMBOL_GPL(blk_freeze_queue_start);
 void blk_mq_freeze_queue_wait(struct request_queue *q)
 {
 	wait_event(q->mq_freeze_wq, percpu_ref_is_zero(&q->q_usage_counter));
+	blk_mq_tag_cache_drain_queue(q);
 }
 EXPORT_SYMBOL_GPL(blk_mq_freeze_queue_wait);
 
 int blk_mq_freeze_queue_wait_timeout(struct request_queue *q,
 				     unsigned long timeout)
 {
-	return wait_event_timeout(q->mq_freeze_wq,
-					percpu_ref_is_zero(&q->q_usage_counter),
-					timeout);
+	long ret;
+
+	ret = wait_event_timeout(q->mq_freeze_wq,
+				 percpu_ref_is_zero(&q->q_usage_counter),
+				 timeout);
+	if (ret)
+		blk_mq_tag_cache_drain_queue(q);
+	return ret;
 }
 EXPORT_SYMBOL_GPL(blk_mq_freeze_queue_wait_timeout);
 
@@ -553,7 +559,9 @@ static struct request *__blk_mq_alloc_requests(struct blk_mq_alloc_data *data)
 	 * case just retry the hctx assignment and tag allocation as CPU hotplug
 	 * should have migrated us to an online CPU by now.
 	 */
-	tag = blk_mq_get_tag(data);
+	tag = blk_mq_tag_cache_get(data);
+	if (tag == BLK_MQ_NO_TAG)
+		tag = blk_mq_get_tag(data);
 	if (tag == BLK_MQ_NO_TAG) {
 		if (data->flags & BLK_MQ_REQ_NOWAIT)
 			return NULL;
@@ -773,7 +781,8 @@ static void __blk_mq_free_request(struct request *rq)
 
 	if (rq->tag != BLK_MQ_NO_TAG) {
 		blk_mq_dec_active_requests(hctx);
-		blk_mq_put_tag(hctx->tags, ctx, rq->tag);
+		if (!blk_mq_tag_cache_put(hctx, ctx, rq->tag))
+			blk_mq_put_tag(hctx->tags, ctx, rq->tag);
 	}
 	if (sched_tag != BLK_MQ_NO_TAG)
 		blk_mq_put_tag(hctx->sched_tags, ctx, sched_tag);
@@ -3720,6 +3729,8 @@ static int blk_mq_hctx_notify_dead(unsigned int cpu, struct hlist_node *node)
 	ctx = __blk_mq_get_ctx(hctx->queue, cpu);
 	type = hctx->type;
 
+	blk_mq_tag_cache_drain(ctx, type);
+
 	spin_lock(&ctx->lock);
 	if (!list_empty(&ctx->rq_lists[type])) {
 		list_splice_init(&ctx->rq_lists[type], &tmp);
@@ -4005,8 +4016,10 @@ static void blk_mq_init_cpu_queues(struct request_queue *q,
 
 		__ctx->cpu = i;
 		spin_lock_init(&__ctx->lock);
-		for (k = HCTX_TYPE_DEFAULT; k < HCTX_MAX_TYPES; k++)
+		for (k = HCTX_TYPE_DEFAULT; k < HCTX_MAX_TYPES; k++) {
 			INIT_LIST_HEAD(&__ctx->rq_lists[k]);
+			spin_lock_init(&__ctx->tag_cache[k].lock);
+		}
 
 		__ctx->queue = q;
 
@@ -12,6 +12,20 @@ struct blk_mq_ctxs {
 	struct blk_mq_ctx __percpu	*queue_ctx;
 };
 
+#define BLK_MQ_TAG_CACHE_SIZE	8
+
+/*
+ * Driver tags freed by requests submitted from a software queue, kept around
+ * for the next allocation from the same CPU instead of going back through the
+ * shared sbitmap words.
+ */
+struct blk_mq_tag_cache {
+	spinlock_t		lock;
+	unsigned int		nr;
+	struct blk_mq_hw_ctx	*hctx;
+	unsigned int		tags[BLK_MQ_TAG_CACHE_SIZE];
+};
+
 /**
  * struct blk_mq_ctx - State for a software queue facing the submitting CPUs
  */
@@ -21,6 +35,8 @@ struct blk_mq_ctx {
 		struct list_head	rq_lists[HCTX_MAX_TYPES];
 	} ____cacheline_aligned_in_smp;
 
+	struct blk_mq_tag_cache	tag_cache[HCTX_MAX_TYPES];
+
 	unsigned int		cpu;
 	unsigned short		index_hw[HCTX_MAX_TYPES];
 	struct blk_mq_hw_ctx 	*hctxs[HCTX_MAX_TYPES];
@@ -175,6 +191,11 @@ unsigned long blk_mq_get_tags(struct blk_mq_alloc_data *data, int nr_tags,
 void blk_mq_put_tag(struct blk_mq_tags *tags, struct blk_mq_ctx *ctx,
 		unsigned int tag);
 void blk_mq_put_tags(struct blk_mq_tags *tags, int *tag_array, int nr_tags);
+unsigned int blk_mq_tag_cache_get(struct blk_mq_alloc_data *data);
+bool blk_mq_tag_cache_put(struct blk_mq_hw_ctx *hctx, struct blk_mq_ctx *ctx,
+		unsigned int tag);
+void blk_mq_tag_cache_drain(struct blk_mq_ctx *ctx, enum hctx_type type);
+void blk_mq_tag_cache_drain_queue(struct request_queue *q);
 int blk_mq_tag_update_depth(struct blk_mq_hw_ctx *hctx,
 		struct blk_mq_tags **tags, unsigned int depth, bool can_grow);
 void blk_mq_tag_resize_shared_tags(struct blk_mq_tag_set *set,
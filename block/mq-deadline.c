@@ -15,6 +15,8 @@
 #include <linux/compiler.h>
 #include <linux/rbtree.h>
 #include <linux/sbitmap.h>
+#include <linux/llist.h>
+#include <linux/percpu.h>
 
 #include <trace/events/block.h>
 
@@ -100,8 +102,17 @@ struct deadline_data {
 	int front_merges;
 	u32 async_depth;
 	int prio_aging_expire;
+	int insert_staging;
 
 	spinlock_t lock;
+
+	/*
+	 * Requests inserted without dd->lock when insert_staging is set. They
+	 * are moved into the sort and FIFO lists by the next dispatch or bio
+	 * merge attempt. @staged is nonzero while some list may be non-empty.
+	 */
+	struct llist_head __percpu *staged_rqs;
+	atomic_t staged;
 };
 
 /* Maps an I/O priority class to a deadline scheduler priority. */
@@ -160,6 +171,25 @@ deadline_add_rq_rb(struct dd_per_prio *per_prio, struct request *rq)
 	elv_rb_add(root, rq);
 }
 
+/*
+ * Staged requests from different CPUs can reach the FIFO slightly out of
+ * order, so insert from the tail while keeping the list sorted by expiry
+ * time. deadline_check_fifo() only looks at the first entry.
+ */
+static void
+deadline_add_rq_fifo(struct dd_per_prio *per_prio, struct request *rq,
+		     enum dd_data_dir data_dir)
+{
+	struct list_head *head = &per_prio->fifo_list[data_dir];
+	struct list_head *pos = head->prev;
+
+	while (pos != head &&
+	       time_after((unsigned long)rq_entry_fifo(pos)->fifo_time,
+			  (unsigned long)rq->fifo_time))
+		pos = pos->prev;
+	list_add(&rq->queuelist, pos);
+}
+
 static inline void
 deadline_del_rq_rb(struct dd_per_prio *per_prio, struct request *rq)
 {
@@ -451,6 +481,8 @@ static struct request *dd_dispatch_prio_aged_requests(struct deadline_data *dd,
 	return NULL;
 }
 
+static void dd_insert_staged(struct deadline_data *dd, struct list_head *free);
+
 /*
  * Called from blk_mq_run_hw_queue() -> __blk_mq_sched_dispatch_requests().
  *
@@ -465,8 +497,10 @@ static struct request *dd_dispatch_request(struct blk_mq_hw_ctx *hctx)
 	const unsigned long now = jiffies;
 	struct request *rq;
 	enum dd_prio prio;
+	LIST_HEAD(free);
 
 	spin_lock(&dd->lock);
+	dd_insert_staged(dd, &free);
 	rq = dd_dispatch_prio_aged_requests(dd, now);
 	if (rq)
 		goto unlock;
@@ -484,6 +518,8 @@ static struct request *dd_dispatch_request(struct blk_mq_hw_ctx *hctx)
 unlock:
 	spin_unlock(&dd->lock);
 
+	blk_mq_free_requests(&free);
+
 	return rq;
 }
 
@@ -562,6 +598,7 @@ static void dd_exit_sched(struct elevator_queue *e)
 			  stats->dispatched, atomic_read(&stats->completed));
 	}
 
+	free_percpu(dd->staged_rqs);
 	kfree(dd);
 }
 
@@ -583,6 +620,10 @@ static int dd_init_sched(struct request_queue *q, struct elevator_type *e)
 	if (!dd)
 		goto put_eq;
 
+	dd->staged_rqs = alloc_percpu(struct llist_head);
+	if (!dd->staged_rqs)
+		goto free_dd;
+
 	eq->elevator_data = dd;
 
 	for (prio = 0; prio <= DD_PRIO_MAX; prio++) {
@@ -609,6 +650,8 @@ static int dd_init_sched(struct request_queue *q, struct elevator_type *e)
 	q->elevator = eq;
 	return 0;
 
+free_dd:
+	kfree(dd);
 put_eq:
 	kobject_put(&eq->kobj);
 	return ret;
@@ -655,14 +698,17 @@ static bool dd_bio_merge(struct request_queue *q, struct bio *bio,
 {
 	struct deadline_data *dd = q->elevator->elevator_data;
 	struct request *free = NULL;
+	LIST_HEAD(staged_free);
 	bool ret;
 
 	spin_lock(&dd->lock);
+	dd_insert_staged(dd, &staged_free);
 	ret = blk_mq_sched_try_merge(q, bio, nr_segs, &free);
 	spin_unlock(&dd->lock);
 
 	if (free)
 		blk_mq_free_request(free);
+	blk_mq_free_requests(&staged_free);
 
 	return ret;
 }
@@ -671,7 +717,8 @@ static bool dd_bio_merge(struct request_queue *q, struct bio *bio,
  * add rq to rbtree and fifo
  */
 static void dd_insert_request(struct blk_mq_hw_ctx *hctx, struct request *rq,
-			      blk_insert_t flags, struct list_head *free)
+			      blk_insert_t flags, struct list_head *free,
+			      unsigned long arrival)
 {
 	struct request_queue *q = hctx->queue;
 	struct deadline_data *dd = q->elevator->elevator_data;
@@ -696,7 +743,7 @@ static void dd_insert_request(struct blk_mq_hw_ctx *hctx, struct request *rq,
 
 	if (flags & BLK_MQ_INSERT_AT_HEAD) {
 		list_add(&rq->queuelist, &per_prio->dispatch);
-		rq->fifo_time = jiffies;
+		rq->fifo_time = arrival;
 	} else {
 		deadline_add_rq_rb(per_prio, rq);
 
@@ -709,11 +756,69 @@ static void dd_insert_request(struct blk_mq_hw_ctx *hctx, struct request *rq,
 		/*
 		 * set expire time and add to fifo list
 		 */
-		rq->fifo_time = jiffies + dd->fifo_expire[data_dir];
-		list_add_tail(&rq->queuelist, &per_prio->fifo_list[data_dir]);
+		rq->fifo_time = arrival + dd->fifo_expire[data_dir];
+		deadline_add_rq_fifo(per_prio, rq, data_dir);
 	}
 }
 
+/*
+ * Move the requests staged by dd_insert_requests() into the sort and FIFO
+ * lists. Their arrival time was saved in fifo_time and the elevator hash node
+ * was borrowed for the staging list.
+ */
+static void dd_insert_staged(struct deadline_data *dd, struct list_head *free)
+{
+	struct request *rq, *next;
+	struct llist_node *node;
+	int cpu;
+
+	lockdep_assert_held(&dd->lock);
+
+	/* Pairs with the barrier implied by llist_add_batch(). */
+	if (!atomic_read(&dd->staged) || !atomic_xchg(&dd->staged, 0))
+		return;
+
+	for_each_possible_cpu(cpu) {
+		node = llist_del_all(per_cpu_ptr(dd->staged_rqs, cpu));
+		if (!node)
+			continue;
+
+		node = llist_reverse_order(node);
+		llist_for_each_entry_safe(rq, next, node, ipi_list) {
+			INIT_HLIST_NODE(&rq->hash);
+			dd_insert_request(rq->mq_hctx, rq, 0, free,
+					  (unsigned long)rq->fifo_time);
+		}
+	}
+}
+
+/*
+ * Queue requests without taking dd->lock. Only used for tail insertions, head
+ * insertions need to be visible to the very next dispatch.
+ */
+static void dd_stage_requests(struct deadline_data *dd, struct list_head *list)
+{
+	struct llist_node *first = NULL, *last = NULL;
+	const unsigned long now = jiffies;
+	struct request *rq, *tmp;
+
+	/* Build the chain newest first, as if each request was llist_add()ed. */
+	list_for_each_entry_safe(rq, tmp, list, queuelist) {
+		list_del_init(&rq->queuelist);
+		rq->fifo_time = now;
+		rq->ipi_list.next = first;
+		first = &rq->ipi_list;
+		if (!last)
+			last = first;
+	}
+	if (!first)
+		return;
+
+	llist_add_batch(first, last, raw_cpu_ptr(dd->staged_rqs));
+	if (!atomic_read(&dd->staged))
+		atomic_set(&dd->staged, 1);
+}
+
 /*
  * Called from blk_mq_insert_request() or blk_mq_dispatch_plug_list().
  */
@@ -725,13 +830,18 @@ static void dd_insert_requests(struct blk_mq_hw_ctx *hctx,
 	struct deadline_data *dd = q->elevator->elevator_data;
 	LIST_HEAD(free);
 
+	if (READ_ONCE(dd->insert_staging) && !(flags & BLK_MQ_INSERT_AT_HEAD)) {
+		dd_stage_requests(dd, list);
+		return;
+	}
+
 	spin_lock(&dd->lock);
 	while (!list_empty(list)) {
 		struct request *rq;
 
 		rq = list_first_entry(list, struct request, queuelist);
 		list_del_init(&rq->queuelist);
-		dd_insert_request(hctx, rq, flags, &free);
+		dd_insert_request(hctx, rq, flags, &free, jiffies);
 	}
 	spin_unlock(&dd->lock);
 
@@ -772,6 +882,9 @@ static bool dd_has_work(struct blk_mq_hw_ctx *hctx)
 	struct deadline_data *dd = hctx->queue->elevator->elevator_data;
 	enum dd_prio prio;
 
+	if (atomic_read(&dd->staged))
+		return true;
+
 	for (prio = 0; prio <= DD_PRIO_MAX; prio++)
 		if (dd_has_work_for_prio(&dd->per_prio[prio]))
 			return true;
@@ -797,6 +910,7 @@ SHOW_INT(deadline_writes_starved_show, dd->writes_starved);
 SHOW_INT(deadline_front_merges_show, dd->front_merges);
 SHOW_INT(deadline_async_depth_show, dd->async_depth);
 SHOW_INT(deadline_fifo_batch_show, dd->fifo_batch);
+SHOW_INT(deadline_insert_staging_show, dd->insert_staging);
 #undef SHOW_INT
 #undef SHOW_JIFFIES
 
@@ -827,6 +941,7 @@ STORE_INT(deadline_writes_starved_store, &dd->writes_starved, INT_MIN, INT_MAX);
 STORE_INT(deadline_front_merges_store, &dd->front_merges, 0, 1);
 STORE_INT(deadline_async_depth_store, &dd->async_depth, 1, INT_MAX);
 STORE_INT(deadline_fifo_batch_store, &dd->fifo_batch, 0, INT_MAX);
+STORE_INT(deadline_insert_staging_store, &dd->insert_staging, 0, 1);
 #undef STORE_FUNCTION
 #undef STORE_INT
 #undef STORE_JIFFIES
@@ -842,6 +957,7 @@ static struct elv_fs_entry deadline_attrs[] = {
 	DD_ATTR(async_depth),
 	DD_ATTR(fifo_batch),
 	DD_ATTR(prio_aging_expire),
+	DD_ATTR(insert_staging),
 	__ATTR_NULL
 };
 
@@ -58,12 +58,27 @@ int crypto_sha256_finup(struct shash_desc *desc, const u8 *data,
 }
 EXPORT_SYMBOL(crypto_sha256_finup);
 
+static int crypto_sha256_finup_mb(struct shash_desc *desc,
+				  const u8 * const data[], unsigned int len,
+				  u8 * const outs[], unsigned int num_msgs)
+{
+	if (crypto_shash_digestsize(desc->tfm) == SHA224_DIGEST_SIZE)
+		sha224_finup_2x(shash_desc_ctx(desc), data[0], data[1], len,
+				outs[0], outs[1]);
+	else
+		sha256_finup_2x(shash_desc_ctx(desc), data[0], data[1], len,
+				outs[0], outs[1]);
+	return 0;
+}
+
 static struct shash_alg sha256_algs[2] = { {
 	.digestsize	=	SHA256_DIGEST_SIZE,
 	.init		=	sha256_base_init,
 	.update		=	crypto_sha256_update,
 	.final		=	crypto_sha256_final,
 	.finup		=	crypto_sha256_finup,
+	.finup_mb	=	crypto_sha256_finup_mb,
+	.mb_max_msgs	=	2,
 	.descsize	=	sizeof(struct sha256_state),
 	.base		=	{
 		.cra_name	=	"sha256",
@@ -78,6 +93,8 @@ static struct shash_alg sha256_algs[2] = { {
 	.update		=	crypto_sha256_update,
 	.final		=	crypto_sha256_final,
 	.finup		=	crypto_sha256_finup,
+	.finup_mb	=	crypto_sha256_finup_mb,
+	.mb_max_msgs	=	2,
 	.descsize	=	sizeof(struct sha256_state),
 	.base		=	{
 		.cra_name	=	"sha224",
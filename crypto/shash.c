@@ -75,6 +75,35 @@ int crypto_shash_finup(struct shash_desc *desc, const u8 *data,
 }
 EXPORT_SYMBOL_GPL(crypto_shash_finup);
 
+int crypto_shash_finup_mb(struct shash_desc *desc, const u8 * const data[],
+			  unsigned int len, u8 * const outs[],
+			  unsigned int num_msgs)
+{
+	struct crypto_shash *tfm = desc->tfm;
+	struct shash_alg *alg = crypto_shash_alg(tfm);
+	SHASH_DESC_ON_STACK(desc2, tfm);
+	unsigned int i;
+	int err;
+
+	if (num_msgs > 1 && num_msgs <= alg->mb_max_msgs)
+		return alg->finup_mb(desc, data, len, outs, num_msgs);
+
+	/* Hash all but the last message from copies of the state */
+	desc2->tfm = tfm;
+	for (i = 0; i + 1 < num_msgs; i++) {
+		memcpy(shash_desc_ctx(desc2), shash_desc_ctx(desc),
+		       crypto_shash_descsize(tfm));
+		err = alg->finup(desc2, data[i], len, outs[i]);
+		if (err)
+			goto out;
+	}
+	err = num_msgs ? alg->finup(desc, data[i], len, outs[i]) : 0;
+out:
+	shash_desc_zero(desc2);
+	return err;
+}
+EXPORT_SYMBOL_GPL(crypto_shash_finup_mb);
+
 static int shash_default_digest(struct shash_desc *desc, const u8 *data,
 				unsigned int len, u8 *out)
 {
@@ -314,6 +343,13 @@ static int shash_prepare_alg(struct shash_alg *alg)
 	if ((alg->export && !alg->import) || (alg->import && !alg->export))
 		return -EINVAL;
 
+	if (alg->finup_mb) {
+		if (alg->mb_max_msgs < 2 || alg->mb_max_msgs > HASH_MAX_MB_MSGS)
+			return -EINVAL;
+	} else {
+		alg->mb_max_msgs = 1;
+	}
+
 	err = hash_prepare_alg(&alg->halg);
 	if (err)
 		return err;
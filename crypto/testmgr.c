@@ -1891,6 +1891,85 @@ static int test_hash_vs_generic_impl(const char *generic_driver,
 }
 #endif /* !CONFIG_CRYPTO_MANAGER_EXTRA_TESTS */
 
+/*
+ * Test crypto_shash_finup_mb() against one crypto_shash_finup() per message.
+ * The messages continue a common state that has no or a partial block
+ * buffered, and all lengths up to three blocks are tried, so that the final
+ * padding takes one or two blocks.
+ */
+static int test_shash_finup_mb(struct shash_desc *desc, u8 *hashstate)
+{
+	struct crypto_shash *tfm = desc->tfm;
+	const unsigned int num_msgs = crypto_shash_mb_max_msgs(tfm);
+	const unsigned int digestsize = crypto_shash_digestsize(tfm);
+	const unsigned int bs = crypto_shash_blocksize(tfm);
+	const char *driver = crypto_shash_driver_name(tfm);
+	const unsigned int prefix_lens[] = { 0, 1, bs - 1, bs, bs + 1 };
+	const unsigned int max_len = 3 * bs;
+	u8 expected[HASH_MAX_MB_MSGS][HASH_MAX_DIGESTSIZE];
+	u8 actual[HASH_MAX_MB_MSGS][HASH_MAX_DIGESTSIZE];
+	const u8 *data[HASH_MAX_MB_MSGS];
+	u8 *outs[HASH_MAX_MB_MSGS];
+	unsigned int p, len, i;
+	u8 *buf;
+	int err = 0;
+
+	/* Keyed algorithms would need a key, the unkeyed ones cover finup_mb */
+	if (crypto_shash_get_flags(tfm) & CRYPTO_TFM_NEED_KEY)
+		return 0;
+
+	buf = kmalloc(bs + 1 + num_msgs * max_len, GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+	for (i = 0; i < bs + 1 + num_msgs * max_len; i++)
+		buf[i] = i * 0x9d + (i >> 8);
+	for (i = 0; i < num_msgs; i++) {
+		data[i] = &buf[bs + 1 + i * max_len];
+		outs[i] = actual[i];
+	}
+
+	for (p = 0; p < ARRAY_SIZE(prefix_lens); p++) {
+		for (len = 0; len <= max_len; len++) {
+			err = crypto_shash_init(desc);
+			if (!err)
+				err = crypto_shash_update(desc, buf,
+							  prefix_lens[p]);
+			if (!err)
+				err = crypto_shash_export(desc, hashstate);
+			for (i = 0; i < num_msgs && !err; i++) {
+				err = crypto_shash_import(desc, hashstate);
+				if (!err)
+					err = crypto_shash_finup(desc, data[i],
+								 len,
+								 expected[i]);
+			}
+			if (!err)
+				err = crypto_shash_import(desc, hashstate);
+			if (!err)
+				err = crypto_shash_finup_mb(desc, data, len,
+							    outs, num_msgs);
+			if (err) {
+				pr_err("alg: shash: %s finup_mb test failed with err %d; prefixlen=%u len=%u\n",
+				       driver, err, prefix_lens[p], len);
+				goto out;
+			}
+			for (i = 0; i < num_msgs; i++) {
+				if (memcmp(actual[i], expected[i],
+					   digestsize) != 0) {
+					pr_err("alg: shash: %s finup_mb test failed (wrong result) on message %u; prefixlen=%u len=%u\n",
+					       driver, i, prefix_lens[p], len);
+					err = -EINVAL;
+					goto out;
+				}
+			}
+		}
+		cond_resched();
+	}
+out:
+	kfree(buf);
+	return err;
+}
+
 static int alloc_shash(const char *driver, u32 type, u32 mask,
 		       struct crypto_shash **tfm_ret,
 		       struct shash_desc **desc_ret)
@@ -2000,6 +2079,11 @@ static int __alg_test_hash(const struct hash_testvec *vecs,
 			goto out;
 		cond_resched();
 	}
+	if (stfm && crypto_shash_mb_max_msgs(stfm) > 1) {
+		err = test_shash_finup_mb(desc, hashstate);
+		if (err)
+			goto out;
+	}
 	err = test_hash_vs_generic_impl(generic_driver, maxkeysize, req,
 					desc, tsgl, hashstate);
 out:
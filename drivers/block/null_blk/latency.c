@@ -0,0 +1,303 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Latency model for timer completion mode (irqmode=2).
+ *
+ * The completion time of a command is the sum of:
+ *  - a sample of the latency distribution, given as points of its
+ *    cumulative distribution function and interpolated linearly between
+ *    them, starting at completion_nsec for the 0th percentile,
+ *  - the extra latency of all hotspot ranges the command touches,
+ *  - latency_qd_nsec for each command in flight above latency_qd_knee,
+ *  - the remainder of a garbage collection stall if one is in progress.
+ *    Stalls of gc_stall_ms start every gc_period_ms.
+ */
+#include <linux/ctype.h>
+#include <linux/random.h>
+#include "null_blk.h"
+
+/* Percentiles are kept as parts per million */
+#define NULL_LAT_PPM		1000000U
+#define NULL_LAT_PPM_PCT	(NULL_LAT_PPM / 100)
+
+/* Parse a percentile like "99" or "99.99" into parts per million */
+static int null_lat_parse_ppm(char *s, u32 *ppm)
+{
+	unsigned int scale = NULL_LAT_PPM_PCT, frac = 0, whole;
+	char *dot = strchr(s, '.');
+	int ret;
+
+	if (dot) {
+		*dot = '\0';
+		for (dot++; *dot; dot++) {
+			if (!isdigit(*dot) || scale == 1)
+				return -EINVAL;
+			scale /= 10;
+			frac += (*dot - '0') * scale;
+		}
+	}
+
+	ret = kstrtouint(s, 10, &whole);
+	if (ret)
+		return ret;
+	if (whole > 100 || (whole == 100 && frac))
+		return -EINVAL;
+
+	*ppm = whole * NULL_LAT_PPM_PCT + frac;
+	return 0;
+}
+
+static int null_lat_print_ppm(char *page, size_t size, u32 ppm)
+{
+	u32 frac = ppm % NULL_LAT_PPM_PCT;
+	int digits = 4;
+
+	if (!frac)
+		return scnprintf(page, size, "%u", ppm / NULL_LAT_PPM_PCT);
+
+	while (!(frac % 10)) {
+		frac /= 10;
+		digits--;
+	}
+	return scnprintf(page, size, "%u.%0*u", ppm / NULL_LAT_PPM_PCT,
+			 digits, frac);
+}
+
+/*
+ * The distribution is written as a space separated list of
+ * "<percentile>:<nsec>" points, e.g. "50:80000 99:400000 99.9:3000000".
+ * Both percentiles and latencies have to be increasing. An empty string
+ * restores a fixed latency of completion_nsec.
+ */
+ssize_t null_latency_dist_store(struct nullb_device *dev, const char *page,
+				size_t count)
+{
+	struct nullb_lat_point *points = NULL;
+	unsigned int nr = 0;
+	char *orig, *buf, *tok;
+	ssize_t ret;
+
+	if (test_bit(NULLB_DEV_FL_CONFIGURED, &dev->flags))
+		return -EBUSY;
+
+	orig = kstrndup(page, count, GFP_KERNEL);
+	if (!orig)
+		return -ENOMEM;
+
+	ret = -EINVAL;
+	buf = strim(orig);
+	while ((tok = strsep(&buf, " \t\n")) != NULL) {
+		struct nullb_lat_point *p;
+		char *val;
+
+		if (!*tok)
+			continue;
+		if (nr == NULL_LAT_MAX_POINTS)
+			goto out;
+		if (!points) {
+			points = kcalloc(NULL_LAT_MAX_POINTS, sizeof(*points),
+					 GFP_KERNEL);
+			if (!points) {
+				ret = -ENOMEM;
+				goto out;
+			}
+		}
+
+		val = strchr(tok, ':');
+		if (!val)
+			goto out;
+		*val++ = '\0';
+
+		p = &points[nr];
+		if (null_lat_parse_ppm(tok, &p->ppm) ||
+		    kstrtou64(val, 0, &p->nsec))
+			goto out;
+		if (nr && (p->ppm <= points[nr - 1].ppm ||
+			   p->nsec < points[nr - 1].nsec))
+			goto out;
+		nr++;
+	}
+
+	kfree(dev->lat_points);
+	dev->lat_points = points;
+	dev->lat_nr_points = nr;
+	points = NULL;
+	ret = count;
+out:
+	kfree(points);
+	kfree(orig);
+	return ret;
+}
+
+ssize_t null_latency_dist_show(struct nullb_device *dev, char *page)
+{
+	ssize_t len = 0;
+	unsigned int i;
+
+	for (i = 0; i < dev->lat_nr_points; i++) {
+		struct nullb_lat_point *p = &dev->lat_points[i];
+
+		if (i)
+			len += scnprintf(page + len, PAGE_SIZE - len, " ");
+		len += null_lat_print_ppm(page + len, PAGE_SIZE - len, p->ppm);
+		len += scnprintf(page + len, PAGE_SIZE - len, ":%llu", p->nsec);
+	}
+	len += scnprintf(page + len, PAGE_SIZE - len, "\n");
+	return len;
+}
+
+/*
+ * Hotspots are written as a space separated list of
+ * "<start sector>-<end sector>:<nsec>" ranges, which replaces the previous
+ * list. An empty string removes all hotspots.
+ */
+ssize_t null_latency_hotspots_store(struct nullb_device *dev, const char *page,
+				    size_t count)
+{
+	struct nullb_lat_hotspot *spots = NULL;
+	unsigned int nr = 0;
+	char *orig, *buf, *tok;
+	ssize_t ret;
+
+	if (test_bit(NULLB_DEV_FL_CONFIGURED, &dev->flags))
+		return -EBUSY;
+
+	orig = kstrndup(page, count, GFP_KERNEL);
+	if (!orig)
+		return -ENOMEM;
+
+	ret = -EINVAL;
+	buf = strim(orig);
+	while ((tok = strsep(&buf, " \t\n")) != NULL) {
+		struct nullb_lat_hotspot *h;
+		char *end, *val;
+		u64 start, last;
+
+		if (!*tok)
+			continue;
+		if (nr == NULL_LAT_MAX_HOTSPOTS)
+			goto out;
+		if (!spots) {
+			spots = kcalloc(NULL_LAT_MAX_HOTSPOTS, sizeof(*spots),
+					GFP_KERNEL);
+			if (!spots) {
+				ret = -ENOMEM;
+				goto out;
+			}
+		}
+
+		end = strchr(tok, '-');
+		val = strchr(tok, ':');
+		if (!end || !val || val < end)
+			goto out;
+		*end++ = '\0';
+		*val++ = '\0';
+
+		h = &spots[nr];
+		if (kstrtou64(tok, 0, &start) || kstrtou64(end, 0, &last) ||
+		    kstrtou64(val, 0, &h->nsec) || start > last)
+			goto out;
+		h->start = start;
+		h->end = last;
+		nr++;
+	}
+
+	kfree(dev->lat_hotspots);
+	dev->lat_hotspots = spots;
+	dev->lat_nr_hotspots = nr;
+	spots = NULL;
+	ret = count;
+out:
+	kfree(spots);
+	kfree(orig);
+	return ret;
+}
+
+ssize_t null_latency_hotspots_show(struct nullb_device *dev, char *page)
+{
+	ssize_t len = 0;
+	unsigned int i;
+
+	for (i = 0; i < dev->lat_nr_hotspots; i++) {
+		struct nullb_lat_hotspot *h = &dev->lat_hotspots[i];
+
+		len += scnprintf(page + len, PAGE_SIZE - len, "%s%llu-%llu:%llu",
+				 i ? " " : "", (u64)h->start, (u64)h->end,
+				 h->nsec);
+	}
+	len += scnprintf(page + len, PAGE_SIZE - len, "\n");
+	return len;
+}
+
+void null_latency_free(struct nullb_device *dev)
+{
+	kfree(dev->lat_points);
+	dev->lat_points = NULL;
+	dev->lat_nr_points = 0;
+	kfree(dev->lat_hotspots);
+	dev->lat_hotspots = NULL;
+	dev->lat_nr_hotspots = 0;
+}
+
+static u64 null_latency_sample(struct nullb_device *dev)
+{
+	struct nullb_lat_point *p = dev->lat_points;
+	u64 lo_nsec = dev->completion_nsec;
+	u32 lo_ppm = 0, u;
+	unsigned int i;
+
+	if (!dev->lat_nr_points)
+		return lo_nsec;
+
+	u = get_random_u32_below(NULL_LAT_PPM);
+	for (i = 0; i < dev->lat_nr_points; i++) {
+		if (u < p[i].ppm) {
+			if (p[i].nsec <= lo_nsec)
+				return lo_nsec;
+			return lo_nsec + div_u64((p[i].nsec - lo_nsec) *
+						 (u - lo_ppm),
+						 p[i].ppm - lo_ppm);
+		}
+		lo_ppm = p[i].ppm;
+		lo_nsec = max(lo_nsec, p[i].nsec);
+	}
+	return lo_nsec;
+}
+
+/* Completion time of @cmd in nanoseconds, which is now counted in flight */
+u64 null_latency(struct nullb_cmd *cmd)
+{
+	struct nullb_device *dev = cmd->nq->dev;
+	struct request *rq = blk_mq_rq_from_pdu(cmd);
+	unsigned int inflight = atomic_inc_return(&dev->lat_inflight);
+	u64 nsec = null_latency_sample(dev);
+	unsigned int i;
+
+	if (dev->lat_nr_hotspots && blk_rq_sectors(rq)) {
+		sector_t start = blk_rq_pos(rq);
+		sector_t end = start + blk_rq_sectors(rq) - 1;
+
+		for (i = 0; i < dev->lat_nr_hotspots; i++) {
+			struct nullb_lat_hotspot *h = &dev->lat_hotspots[i];
+
+			if (start <= h->end && end >= h->start)
+				nsec += h->nsec;
+		}
+	}
+
+	if (dev->latency_qd_nsec && inflight > dev->latency_qd_knee)
+		nsec += (u64)dev->latency_qd_nsec *
+			(inflight - dev->latency_qd_knee);
+
+	if (dev->gc_period_ms && dev->gc_stall_ms) {
+		u64 period = (u64)dev->gc_period_ms * NSEC_PER_MSEC;
+		u64 stall = (u64)min(dev->gc_stall_ms, dev->gc_period_ms) *
+			    NSEC_PER_MSEC;
+		u64 phase;
+
+		div64_u64_rem(ktime_get_ns(), period, &phase);
+		if (phase < stall)
+			nsec += stall - phase;
+	}
+
+	return nsec;
+}
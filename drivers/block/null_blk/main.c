@@ -468,6 +468,10 @@ NULLB_DEVICE_ATTR(no_sched, bool, NULL);
 NULLB_DEVICE_ATTR(shared_tags, bool, NULL);
 NULLB_DEVICE_ATTR(shared_tag_bitmap, bool, NULL);
 NULLB_DEVICE_ATTR(fua, bool, NULL);
+NULLB_DEVICE_ATTR(latency_qd_knee, uint, NULL);
+NULLB_DEVICE_ATTR(latency_qd_nsec, ulong, NULL);
+NULLB_DEVICE_ATTR(gc_period_ms, uint, NULL);
+NULLB_DEVICE_ATTR(gc_stall_ms, uint, NULL);
 
 static ssize_t nullb_device_power_show(struct config_item *item, char *page)
 {
@@ -586,6 +590,33 @@ static ssize_t nullb_device_zone_offline_store(struct config_item *item,
 }
 CONFIGFS_ATTR_WO(nullb_device_, zone_offline);
 
+static ssize_t nullb_device_latency_dist_show(struct config_item *item,
+					      char *page)
+{
+	return null_latency_dist_show(to_nullb_device(item), page);
+}
+
+static ssize_t nullb_device_latency_dist_store(struct config_item *item,
+					       const char *page, size_t count)
+{
+	return null_latency_dist_store(to_nullb_device(item), page, count);
+}
+CONFIGFS_ATTR(nullb_device_, latency_dist);
+
+static ssize_t nullb_device_latency_hotspots_show(struct config_item *item,
+						  char *page)
+{
+	return null_latency_hotspots_show(to_nullb_device(item), page);
+}
+
+static ssize_t nullb_device_latency_hotspots_store(struct config_item *item,
+						   const char *page,
+						   size_t count)
+{
+	return null_latency_hotspots_store(to_nullb_device(item), page, count);
+}
+CONFIGFS_ATTR(nullb_device_, latency_hotspots);
+
 static struct configfs_attribute *nullb_device_attrs[] = {
 	&nullb_device_attr_size,
 	&nullb_device_attr_completion_nsec,
@@ -621,6 +652,12 @@ static struct configfs_attribute *nullb_device_attrs[] = {
 	&nullb_device_attr_shared_tags,
 	&nullb_device_attr_shared_tag_bitmap,
 	&nullb_device_attr_fua,
+	&nullb_device_attr_latency_dist,
+	&nullb_device_attr_latency_hotspots,
+	&nullb_device_attr_latency_qd_knee,
+	&nullb_device_attr_latency_qd_nsec,
+	&nullb_device_attr_gc_period_ms,
+	&nullb_device_attr_gc_stall_ms,
 	NULL,
 };
 
@@ -700,8 +737,10 @@ static ssize_t memb_group_features_show(struct config_item *item, char *page)
 {
 	return snprintf(page, PAGE_SIZE,
 			"badblocks,blocking,blocksize,cache_size,fua,"
-			"completion_nsec,discard,home_node,hw_queue_depth,"
-			"irqmode,max_sectors,mbps,memory_backed,no_sched,"
+			"completion_nsec,discard,gc_period_ms,gc_stall_ms,"
+			"home_node,hw_queue_depth,irqmode,latency_dist,"
+			"latency_hotspots,latency_qd_knee,latency_qd_nsec,"
+			"max_sectors,mbps,memory_backed,no_sched,"
 			"poll_queues,power,queue_mode,shared_tag_bitmap,"
 			"shared_tags,size,submit_queues,use_per_node_hctx,"
 			"virt_boundary,zoned,zone_capacity,zone_max_active,"
@@ -803,6 +842,7 @@ static void null_free_dev(struct nullb_device *dev)
 		return;
 
 	null_free_zoned_dev(dev);
+	null_latency_free(dev);
 	badblocks_exit(&dev->badblocks);
 	kfree(dev);
 }
@@ -811,13 +851,14 @@ static enum hrtimer_restart null_cmd_timer_expired(struct hrtimer *timer)
 {
 	struct nullb_cmd *cmd = container_of(timer, struct nullb_cmd, timer);
 
+	atomic_dec(&cmd->nq->dev->lat_inflight);
 	blk_mq_end_request(blk_mq_rq_from_pdu(cmd), cmd->error);
 	return HRTIMER_NORESTART;
 }
 
 static void null_cmd_end_timer(struct nullb_cmd *cmd)
 {
-	ktime_t kt = cmd->nq->dev->completion_nsec;
+	ktime_t kt = null_latency(cmd);
 
 	hrtimer_start(&cmd->timer, kt, HRTIMER_MODE_REL);
 }
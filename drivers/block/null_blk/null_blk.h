@@ -50,6 +50,21 @@ struct nullb_zone {
 	unsigned int capacity;
 };
 
+/* Latency model limits, see latency.c */
+#define NULL_LAT_MAX_POINTS	32
+#define NULL_LAT_MAX_HOTSPOTS	16
+
+struct nullb_lat_point {
+	u32 ppm; /* percentile in parts per million */
+	u64 nsec;
+};
+
+struct nullb_lat_hotspot {
+	sector_t start;
+	sector_t end; /* inclusive */
+	u64 nsec; /* added latency */
+};
+
 struct nullb_device {
 	struct nullb *nullb;
 	struct config_group group;
@@ -74,6 +89,12 @@ struct nullb_device {
 	bool need_zone_res_mgmt;
 	spinlock_t zone_res_lock;
 
+	struct nullb_lat_point *lat_points;
+	unsigned int lat_nr_points;
+	struct nullb_lat_hotspot *lat_hotspots;
+	unsigned int lat_nr_hotspots;
+	atomic_t lat_inflight; /* commands waiting for their timer */
+
 	unsigned long size; /* device size in MB */
 	unsigned long completion_nsec; /* time in ns to complete a request */
 	unsigned long cache_size; /* disk cache size in MB */
@@ -95,6 +116,10 @@ struct nullb_device {
 	unsigned int hw_queue_depth; /* queue depth */
 	unsigned int index; /* index of the disk, only valid with a disk */
 	unsigned int mbps; /* Bandwidth throttle cap (in MB/s) */
+	unsigned int latency_qd_knee; /* queue depth where latency starts growing */
+	unsigned long latency_qd_nsec; /* added latency per command above the knee */
+	unsigned int gc_period_ms; /* period of simulated GC stalls */
+	unsigned int gc_stall_ms; /* duration of simulated GC stalls */
 	bool blocking; /* blocking blk-mq device */
 	bool use_per_node_hctx; /* use per-node allocation for hardware context */
 	bool power; /* power on/off the device */
@@ -126,6 +151,15 @@ struct nullb {
 	char disk_name[DISK_NAME_LEN];
 };
 
+ssize_t null_latency_dist_store(struct nullb_device *dev, const char *page,
+				size_t count);
+ssize_t null_latency_dist_show(struct nullb_device *dev, char *page);
+ssize_t null_latency_hotspots_store(struct nullb_device *dev, const char *page,
+				    size_t count);
+ssize_t null_latency_hotspots_show(struct nullb_device *dev, char *page);
+void null_latency_free(struct nullb_device *dev);
+u64 null_latency(struct nullb_cmd *cmd);
+
 blk_status_t null_handle_discard(struct nullb_device *dev, sector_t sector,
 				 sector_t nr_sectors);
 blk_status_t null_process_cmd(struct nullb_cmd *cmd, enum req_op op,
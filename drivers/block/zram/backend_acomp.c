@@ -0,0 +1,174 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Compression through the crypto acompress API, so that engines registering
+ * acomp algorithms can take the work off the CPU.
+ *
+ * zram calls into its backends with the per-CPU stream held and sometimes
+ * with a slot lock held as well, so requests can neither sleep nor wait an
+ * unbounded time for an asynchronous engine. An asynchronous request also
+ * cannot be cancelled once submitted, so giving up on it would leave the
+ * engine writing into buffers that are already reused. Only synchronous
+ * implementations are therefore used, which complete the request before
+ * returning.
+ */
+
+#include <crypto/acompress.h>
+#include <linux/kernel.h>
+#include <linux/mm.h>
+#include <linux/scatterlist.h>
+#include <linux/slab.h>
+
+#include "backend_acomp.h"
+
+struct acomp_ctx {
+	struct crypto_acomp *tfm;
+	struct acomp_req *req;
+	/* linear bounce buffers for callers passing vmalloc or kmap memory */
+	void *src_buf;
+	void *dst_buf;
+};
+
+static void acomp_release_params(struct zcomp_params *params)
+{
+}
+
+static int acomp_setup_params(struct zcomp_params *params)
+{
+	/* The acomp API has neither compression levels nor dictionaries */
+	if (params->dict_sz)
+		return -EINVAL;
+	return 0;
+}
+
+static void acomp_destroy(struct zcomp_ctx *ctx)
+{
+	struct acomp_ctx *zctx = ctx->context;
+
+	if (!zctx)
+		return;
+
+	if (zctx->req)
+		acomp_request_free(zctx->req);
+	if (!IS_ERR_OR_NULL(zctx->tfm))
+		crypto_free_acomp(zctx->tfm);
+	kfree(zctx->dst_buf);
+	kfree(zctx->src_buf);
+	kfree(zctx);
+	ctx->context = NULL;
+}
+
+static int acomp_create_alg(struct zcomp_ctx *ctx, const char *alg)
+{
+	struct acomp_ctx *zctx;
+
+	zctx = kzalloc(sizeof(*zctx), GFP_KERNEL);
+	if (!zctx)
+		return -ENOMEM;
+	ctx->context = zctx;
+
+	zctx->src_buf = kmalloc(PAGE_SIZE, GFP_KERNEL);
+	zctx->dst_buf = kmalloc(2 * PAGE_SIZE, GFP_KERNEL);
+	if (!zctx->src_buf || !zctx->dst_buf)
+		goto error;
+
+	/* The highest priority implementation without CRYPTO_ALG_ASYNC */
+	zctx->tfm = crypto_alloc_acomp(alg, 0, CRYPTO_ALG_ASYNC);
+	if (IS_ERR(zctx->tfm))
+		goto error;
+	zctx->req = acomp_request_alloc(zctx->tfm);
+	if (!zctx->req)
+		goto error;
+	acomp_request_set_callback(zctx->req, 0, NULL, NULL);
+	return 0;
+
+error:
+	acomp_destroy(ctx);
+	return -ENOMEM;
+}
+
+static int acomp_run(struct acomp_ctx *zctx, bool compress,
+		     struct scatterlist *src, unsigned int slen,
+		     struct scatterlist *dst, unsigned int *dlen)
+{
+	struct acomp_req *req = zctx->req;
+	int ret;
+
+	acomp_request_set_params(req, src, dst, slen, *dlen);
+	ret = compress ? crypto_acomp_compress(req) :
+			 crypto_acomp_decompress(req);
+	if (!ret)
+		*dlen = req->dlen;
+	return ret;
+}
+
+static int acomp_compress(struct zcomp_params *params, struct zcomp_ctx *ctx,
+			  struct zcomp_req *req)
+{
+	struct acomp_ctx *zctx = ctx->context;
+	struct scatterlist src, dst;
+	unsigned int dlen = min_t(size_t, req->dst_len, 2 * PAGE_SIZE);
+	const void *in = req->src;
+	int ret;
+
+	if (!virt_addr_valid(in)) {
+		memcpy(zctx->src_buf, in, req->src_len);
+		in = zctx->src_buf;
+	}
+	sg_init_one(&src, in, req->src_len);
+	/* The stream buffer is vmalloc memory */
+	sg_init_one(&dst, zctx->dst_buf, dlen);
+
+	ret = acomp_run(zctx, true, &src, req->src_len, &dst, &dlen);
+	if (ret)
+		return ret;
+
+	memcpy(req->dst, zctx->dst_buf, dlen);
+	req->dst_len = dlen;
+	return 0;
+}
+
+static int acomp_decompress(struct zcomp_params *params, struct zcomp_ctx *ctx,
+			    struct zcomp_req *req)
+{
+	struct acomp_ctx *zctx = ctx->context;
+	struct scatterlist src, dst;
+	unsigned int dlen = req->dst_len;
+	const void *in = req->src;
+	void *out = req->dst;
+	int ret;
+
+	if (!virt_addr_valid(in)) {
+		memcpy(zctx->src_buf, in, req->src_len);
+		in = zctx->src_buf;
+	}
+	if (!virt_addr_valid(out))
+		out = zctx->dst_buf;
+	sg_init_one(&src, in, req->src_len);
+	sg_init_one(&dst, out, dlen);
+
+	ret = acomp_run(zctx, false, &src, req->src_len, &dst, &dlen);
+	if (ret)
+		return ret;
+	if (dlen != req->dst_len)
+		return -EINVAL;
+
+	if (out != req->dst)
+		memcpy(req->dst, out, dlen);
+	return 0;
+}
+
+static int deflate_acomp_create(struct zcomp_params *params,
+				struct zcomp_ctx *ctx)
+{
+	return acomp_create_alg(ctx, "deflate");
+}
+
+const struct zcomp_ops backend_deflate_acomp = {
+	.compress	= acomp_compress,
+	.decompress	= acomp_decompress,
+	.create_ctx	= deflate_acomp_create,
+	.destroy_ctx	= acomp_destroy,
+	.setup_params	= acomp_setup_params,
+	.release_params	= acomp_release_params,
+	.name		= "deflate-acomp",
+};
@@ -0,0 +1,10 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef __BACKEND_ACOMP_H__
+#define __BACKEND_ACOMP_H__
+
+#include "zcomp.h"
+
+extern const struct zcomp_ops backend_deflate_acomp;
+
+#endif /* __BACKEND_ACOMP_H__ */
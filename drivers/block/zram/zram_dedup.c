@@ -0,0 +1,186 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Deduplication of identical compressed pages.
+ *
+ * Stored objects are indexed by the xxhash of their uncompressed page in a
+ * hash table of rbtrees, one entry per checksum. A page whose checksum
+ * matches an existing entry is compressed as usual and then compared with
+ * that entry's object; as compression is deterministic, equal objects mean
+ * equal pages and the slot just takes a reference on the entry instead of
+ * allocating a new object.
+ *
+ * Every object stored while dedup is enabled is such an entry, and a shared
+ * object would have to be recompressed for all of its users at once, so
+ * recompression skips all of them.
+ */
+
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/xxhash.h>
+
+#include "zram_drv.h"
+
+static struct zram_dedup_bucket *zram_dedup_bucket(struct zram *zram,
+						   u64 checksum)
+{
+	return &zram->dedup_buckets[checksum & zram->dedup_mask];
+}
+
+u64 zram_dedup_checksum(const void *mem)
+{
+	return xxh64(mem, PAGE_SIZE, 0);
+}
+
+static bool zram_dedup_match(struct zram *zram, struct zram_entry *entry,
+			     const void *obj, unsigned int len)
+{
+	void *mem;
+	bool match;
+
+	if (entry->len != len)
+		return false;
+
+	mem = zs_map_object(zram->mem_pool, entry->handle, ZS_MM_RO);
+	match = !memcmp(mem, obj, len);
+	zs_unmap_object(zram->mem_pool, entry->handle);
+	return match;
+}
+
+/*
+ * Look up an entry holding the compressed object @obj and take a reference
+ * on it. Called with the compression stream held, so nothing here sleeps.
+ */
+struct zram_entry *zram_dedup_find(struct zram *zram, u64 checksum,
+				   const void *obj, unsigned int len)
+{
+	struct zram_dedup_bucket *bucket = zram_dedup_bucket(zram, checksum);
+	struct zram_entry *entry, *found = NULL;
+	struct rb_node *node;
+
+	spin_lock(&bucket->lock);
+	node = bucket->root.rb_node;
+	while (node) {
+		entry = rb_entry(node, struct zram_entry, node);
+		if (checksum < entry->checksum) {
+			node = node->rb_left;
+		} else if (checksum > entry->checksum) {
+			node = node->rb_right;
+		} else {
+			if (zram_dedup_match(zram, entry, obj, len)) {
+				found = entry;
+				found->refcount++;
+			}
+			break;
+		}
+	}
+	spin_unlock(&bucket->lock);
+
+	if (found) {
+		atomic64_inc(&zram->stats.dedup_pages);
+		atomic64_add(len, &zram->stats.dedup_data_size);
+	}
+	return found;
+}
+
+/*
+ * Index a freshly stored object. Returns NULL if no memory is available or
+ * another object already has the same checksum, in which case the slot
+ * keeps owning the object directly.
+ */
+struct zram_entry *zram_dedup_add(struct zram *zram, u64 checksum,
+				  unsigned long handle, unsigned int len)
+{
+	struct zram_dedup_bucket *bucket = zram_dedup_bucket(zram, checksum);
+	struct rb_node **link, *parent = NULL;
+	struct zram_entry *entry;
+
+	entry = kmalloc(sizeof(*entry), GFP_NOIO | __GFP_NOWARN);
+	if (!entry)
+		return NULL;
+
+	entry->checksum = checksum;
+	entry->handle = handle;
+	entry->len = len;
+	entry->refcount = 1;
+
+	spin_lock(&bucket->lock);
+	link = &bucket->root.rb_node;
+	while (*link) {
+		u64 cur;
+
+		parent = *link;
+		cur = rb_entry(parent, struct zram_entry, node)->checksum;
+		if (checksum < cur) {
+			link = &parent->rb_left;
+		} else if (checksum > cur) {
+			link = &parent->rb_right;
+		} else {
+			spin_unlock(&bucket->lock);
+			kfree(entry);
+			return NULL;
+		}
+	}
+	rb_link_node(&entry->node, parent, link);
+	rb_insert_color(&entry->node, &bucket->root);
+	spin_unlock(&bucket->lock);
+
+	return entry;
+}
+
+/* Drop a slot's reference, the object is freed with the last one */
+void zram_dedup_put(struct zram *zram, struct zram_entry *entry)
+{
+	struct zram_dedup_bucket *bucket;
+	bool last;
+
+	bucket = zram_dedup_bucket(zram, entry->checksum);
+	spin_lock(&bucket->lock);
+	last = !--entry->refcount;
+	if (last)
+		rb_erase(&entry->node, &bucket->root);
+	spin_unlock(&bucket->lock);
+
+	if (!last) {
+		atomic64_dec(&zram->stats.dedup_pages);
+		atomic64_sub(entry->len, &zram->stats.dedup_data_size);
+		return;
+	}
+
+	zs_free(zram->mem_pool, entry->handle);
+	atomic64_sub(entry->len, &zram->stats.compr_data_size);
+	kfree(entry);
+}
+
+bool zram_dedup_enabled(struct zram *zram)
+{
+	return zram->dedup_buckets;
+}
+
+bool zram_dedup_init(struct zram *zram, size_t num_pages)
+{
+	unsigned int i, nr;
+
+	if (!zram->dedup_enable)
+		return true;
+
+	/* Roughly one bucket per 64 pages keeps the trees shallow */
+	nr = roundup_pow_of_two(clamp_t(size_t, num_pages >> 6, 64, 1 << 20));
+	zram->dedup_buckets = vmalloc_array(nr, sizeof(*zram->dedup_buckets));
+	if (!zram->dedup_buckets)
+		return false;
+
+	for (i = 0; i < nr; i++) {
+		spin_lock_init(&zram->dedup_buckets[i].lock);
+		zram->dedup_buckets[i].root = RB_ROOT;
+	}
+	zram->dedup_mask = nr - 1;
+	return true;
+}
+
+/* Called once all slots have been freed */
+void zram_dedup_fini(struct zram *zram)
+{
+	vfree(zram->dedup_buckets);
+	zram->dedup_buckets = NULL;
+}
@@ -0,0 +1,78 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+#ifndef _ZRAM_DEDUP_H_
+#define _ZRAM_DEDUP_H_
+
+#include <linux/rbtree.h>
+#include <linux/spinlock.h>
+
+struct zram;
+
+/*
+ * A compressed object shared by all slots holding the same page content.
+ * Slots referencing an entry have ZRAM_DEDUP set and the entry in their
+ * handle field.
+ */
+struct zram_entry {
+	struct rb_node node;
+	u64 checksum;
+	unsigned long handle;
+	unsigned int len;
+	/* number of slots, protected by the bucket lock */
+	unsigned long refcount;
+};
+
+struct zram_dedup_bucket {
+	spinlock_t lock;
+	struct rb_root root;
+};
+
+#ifdef CONFIG_ZRAM_DEDUP
+u64 zram_dedup_checksum(const void *mem);
+struct zram_entry *zram_dedup_find(struct zram *zram, u64 checksum,
+				   const void *obj, unsigned int len);
+struct zram_entry *zram_dedup_add(struct zram *zram, u64 checksum,
+				  unsigned long handle, unsigned int len);
+void zram_dedup_put(struct zram *zram, struct zram_entry *entry);
+
+bool zram_dedup_init(struct zram *zram, size_t num_pages);
+void zram_dedup_fini(struct zram *zram);
+bool zram_dedup_enabled(struct zram *zram);
+#else
+static inline u64 zram_dedup_checksum(const void *mem)
+{
+	return 0;
+}
+
+static inline struct zram_entry *zram_dedup_find(struct zram *zram,
+		u64 checksum, const void *obj, unsigned int len)
+{
+	return NULL;
+}
+
+static inline struct zram_entry *zram_dedup_add(struct zram *zram,
+		u64 checksum, unsigned long handle, unsigned int len)
+{
+	return NULL;
+}
+
+static inline void zram_dedup_put(struct zram *zram, struct zram_entry *entry)
+{
+}
+
+static inline bool zram_dedup_init(struct zram *zram, size_t num_pages)
+{
+	return true;
+}
+
+static inline void zram_dedup_fini(struct zram *zram)
+{
+}
+
+static inline bool zram_dedup_enabled(struct zram *zram)
+{
+	return false;
+}
+#endif
+
+#endif /* _ZRAM_DEDUP_H_ */
@@ -34,6 +34,7 @@
 #include <linux/cpuhotplug.h>
 #include <linux/part_stat.h>
 #include <linux/kernel_read_file.h>
+#include <linux/workqueue.h>
 
 #include "zram_drv.h"
 
@@ -51,6 +52,7 @@ static unsigned int num_devices = 1;
  * uncompressed in memory.
  */
 static size_t huge_class_size;
+static struct workqueue_struct *zram_write_wq;
 
 static const struct block_device_operations zram_devops;
 
@@ -112,6 +114,16 @@ static void zram_clear_flag(struct zram *zram, u32 index,
 	zram->table[index].flags &= ~BIT(flag);
 }
 
+/* zsmalloc handle of the slot's object, which may be shared with others */
+static unsigned long zram_get_obj_handle(struct zram *zram, u32 index)
+{
+	unsigned long handle = zram_get_handle(zram, index);
+
+	if (handle && zram_test_flag(zram, index, ZRAM_DEDUP))
+		return ((struct zram_entry *)handle)->handle;
+	return handle;
+}
+
 static inline void zram_set_element(struct zram *zram, u32 index,
 			unsigned long element)
 {
@@ -652,19 +664,36 @@ static ssize_t backing_dev_store(struct device *dev,
 	return err;
 }
 
-static unsigned long alloc_block_bdev(struct zram *zram)
+/*
+ * Allocate a run of up to @want contiguous blocks, preferably a full one.
+ * Returns the first block and the length of the run in @nr, or 0 if the
+ * device is full.
+ */
+static unsigned long alloc_block_bdev_run(struct zram *zram,
+					  unsigned int want, unsigned int *nr)
 {
-	unsigned long blk_idx = 1;
-retry:
+	unsigned long blk_idx;
+	unsigned int n;
+
 	/* skip 0 bit to confuse zram.handle = 0 */
+	blk_idx = bitmap_find_next_zero_area(zram->bitmap, zram->nr_pages, 1,
+					     want, 0);
+	if (blk_idx >= zram->nr_pages)
+		blk_idx = 1;
+retry:
 	blk_idx = find_next_zero_bit(zram->bitmap, zram->nr_pages, blk_idx);
 	if (blk_idx == zram->nr_pages)
 		return 0;
 
-	if (test_and_set_bit(blk_idx, zram->bitmap))
+	for (n = 0; n < want && blk_idx + n < zram->nr_pages; n++) {
+		if (test_and_set_bit(blk_idx + n, zram->bitmap))
+			break;
+	}
+	if (!n)
 		goto retry;
 
-	atomic64_inc(&zram->stats.bd_count);
+	atomic64_add(n, &zram->stats.bd_count);
+	*nr = n;
 	return blk_idx;
 }
 
@@ -740,20 +769,257 @@ static int scan_slots_for_writeback(struct zram *zram, u32 mode,
 	return 0;
 }
 
+/* Slots per writeback bio and number of such bios in flight */
+#define ZRAM_WB_BATCH		32
+#define ZRAM_WB_INFLIGHT	4
+
+struct zram_wb_req {
+	struct bio bio;
+	struct bio_vec bvecs[ZRAM_WB_BATCH];
+	struct page *pages[ZRAM_WB_BATCH];
+	struct zram_pp_slot *pps[ZRAM_WB_BATCH];
+	struct completion done;
+	unsigned long blk_idx;
+	unsigned int nr;
+	bool wb_limited;
+};
+
+static void zram_wb_end_io(struct bio *bio)
+{
+	struct zram_wb_req *req = container_of(bio, struct zram_wb_req, bio);
+
+	complete(&req->done);
+}
+
+/*
+ * Take up to a batch of pages off the writeback limit before reading the
+ * slots, so that the batches in flight together never exceed it. Pages
+ * which end up not being written are given back with zram_wb_unreserve().
+ */
+static unsigned int zram_wb_reserve(struct zram *zram, struct zram_wb_req *req)
+{
+	unsigned int nr = ZRAM_WB_BATCH;
+
+	spin_lock(&zram->wb_limit_lock);
+	req->wb_limited = zram->wb_limit_enable;
+	if (req->wb_limited) {
+		nr = min_t(u64, zram->bd_wb_limit >> (PAGE_SHIFT - 12), nr);
+		zram->bd_wb_limit -= (u64)nr << (PAGE_SHIFT - 12);
+	}
+	spin_unlock(&zram->wb_limit_lock);
+	return nr;
+}
+
+static void zram_wb_unreserve(struct zram *zram, struct zram_wb_req *req,
+			      unsigned int nr)
+{
+	if (!req->wb_limited || !nr)
+		return;
+
+	spin_lock(&zram->wb_limit_lock);
+	zram->bd_wb_limit += (u64)nr << (PAGE_SHIFT - 12);
+	spin_unlock(&zram->wb_limit_lock);
+}
+
+/* Put a slot that did not fit into a batch back for a later one */
+static void zram_wb_requeue(struct zram *zram, struct zram_pp_ctl *ctl,
+			    struct zram_pp_slot *pps)
+{
+	bool queued = false;
+
+	zram_slot_lock(zram, pps->index);
+	/* Slots which were accessed or freed meanwhile are dropped */
+	if (zram_test_flag(zram, pps->index, ZRAM_PP_SLOT)) {
+		place_pp_slot(zram, ctl, pps);
+		queued = true;
+	}
+	zram_slot_unlock(zram, pps->index);
+
+	if (!queued)
+		kfree(pps);
+}
+
+/*
+ * Read the next batch of selected slots into @req and submit them as a
+ * single write to a contiguous run of backing blocks. Slots are sorted by
+ * index first, so neighbouring slots land in neighbouring blocks and reads
+ * of them (e.g. from swap readahead) merge on the backing device.
+ *
+ * Returns the number of slots submitted, 0 if there are none left, or a
+ * negative error code.
+ */
+static int zram_wb_submit(struct zram *zram, struct zram_pp_ctl *ctl,
+			  struct zram_wb_req *req)
+{
+	unsigned int i, nr = 0, max, got;
+	struct zram_pp_slot *pps;
+	unsigned long blk_idx;
+
+	max = zram_wb_reserve(zram, req);
+	if (!max)
+		return -EIO;
+
+	while (nr < max && (pps = select_pp_slot(ctl))) {
+		list_del_init(&pps->entry);
+
+		zram_slot_lock(zram, pps->index);
+		/*
+		 * scan_slots() sets ZRAM_PP_SLOT and relases slot lock, so
+		 * slots can change in the meantime. If slots are accessed or
+		 * freed they lose ZRAM_PP_SLOT flag and hence we don't
+		 * post-process them.
+		 */
+		if (!zram_test_flag(zram, pps->index, ZRAM_PP_SLOT)) {
+			zram_slot_unlock(zram, pps->index);
+			release_pp_slot(zram, pps);
+			continue;
+		}
+		zram_slot_unlock(zram, pps->index);
+
+		if (zram_read_page(zram, req->pages[nr], pps->index, NULL)) {
+			release_pp_slot(zram, pps);
+			continue;
+		}
+
+		/* Insert sorted by index, the batch is small */
+		for (i = nr; i > 0 && req->pps[i - 1]->index > pps->index; i--) {
+			req->pps[i] = req->pps[i - 1];
+			swap(req->pages[i], req->pages[i - 1]);
+		}
+		req->pps[i] = pps;
+		nr++;
+	}
+
+	blk_idx = nr ? alloc_block_bdev_run(zram, nr, &got) : 0;
+	if (!blk_idx)
+		got = 0;
+	zram_wb_unreserve(zram, req, max - got);
+	if (!nr)
+		return 0;
+
+	/* Whatever does not fit into the run is left for later batches */
+	for (i = got; i < nr; i++)
+		zram_wb_requeue(zram, ctl, req->pps[i]);
+	if (!got)
+		return -ENOSPC;
+
+	req->blk_idx = blk_idx;
+	req->nr = got;
+	bio_init(&req->bio, zram->bdev, req->bvecs, ZRAM_WB_BATCH,
+		 REQ_OP_WRITE | REQ_SYNC);
+	req->bio.bi_iter.bi_sector = blk_idx * (PAGE_SIZE >> 9);
+	req->bio.bi_end_io = zram_wb_end_io;
+	for (i = 0; i < got; i++)
+		__bio_add_page(&req->bio, req->pages[i], PAGE_SIZE, 0);
+	reinit_completion(&req->done);
+	submit_bio(&req->bio);
+	return got;
+}
+
+/* Wait for the writeback of @req and switch the written slots over */
+static int zram_wb_complete(struct zram *zram, struct zram_wb_req *req)
+{
+	int err, i;
+
+	if (!req->nr)
+		return 0;
+
+	wait_for_completion(&req->done);
+	err = blk_status_to_errno(req->bio.bi_status);
+	bio_uninit(&req->bio);
+
+	for (i = 0; i < req->nr; i++) {
+		struct zram_pp_slot *pps = req->pps[i];
+		u32 index = pps->index;
+
+		/*
+		 * BIO errors are not fatal, the slots simply stay in memory.
+		 * The caller reports the error to user-space.
+		 */
+		if (err) {
+			free_block_bdev(zram, req->blk_idx + i);
+			zram_wb_unreserve(zram, req, 1);
+			release_pp_slot(zram, pps);
+			continue;
+		}
+
+		zram_slot_lock(zram, index);
+		/*
+		 * Same as above, we release slot lock during writeback so
+		 * slot can change under us: slot_free() or slot_free() and
+		 * reallocation (zram_write_page()). In both cases slot loses
+		 * ZRAM_PP_SLOT flag. No concurrent post-processing can set
+		 * ZRAM_PP_SLOT on such slots until current post-processing
+		 * finishes.
+		 */
+		if (!zram_test_flag(zram, index, ZRAM_PP_SLOT)) {
+			free_block_bdev(zram, req->blk_idx + i);
+			zram_wb_unreserve(zram, req, 1);
+			goto next;
+		}
+
+		zram_free_page(zram, index);
+		zram_set_flag(zram, index, ZRAM_WB);
+		zram_set_element(zram, index, req->blk_idx + i);
+		atomic64_inc(&zram->stats.pages_stored);
+		atomic64_inc(&zram->stats.bd_writes);
+next:
+		zram_slot_unlock(zram, index);
+		release_pp_slot(zram, pps);
+	}
+
+	req->nr = 0;
+	return err;
+}
+
+static void zram_wb_free_reqs(struct zram_wb_req *reqs)
+{
+	int i, j;
+
+	if (!reqs)
+		return;
+
+	for (i = 0; i < ZRAM_WB_INFLIGHT; i++) {
+		for (j = 0; j < ZRAM_WB_BATCH; j++) {
+			if (reqs[i].pages[j])
+				__free_page(reqs[i].pages[j]);
+		}
+	}
+	kvfree(reqs);
+}
+
+static struct zram_wb_req *zram_wb_alloc_reqs(void)
+{
+	struct zram_wb_req *reqs;
+	int i, j;
+
+	reqs = kvcalloc(ZRAM_WB_INFLIGHT, sizeof(*reqs), GFP_KERNEL);
+	if (!reqs)
+		return NULL;
+
+	for (i = 0; i < ZRAM_WB_INFLIGHT; i++) {
+		init_completion(&reqs[i].done);
+		for (j = 0; j < ZRAM_WB_BATCH; j++) {
+			reqs[i].pages[j] = alloc_page(GFP_KERNEL);
+			if (!reqs[i].pages[j]) {
+				zram_wb_free_reqs(reqs);
+				return NULL;
+			}
+		}
+	}
+	return reqs;
+}
+
 static ssize_t writeback_store(struct device *dev,
 		struct device_attribute *attr, const char *buf, size_t len)
 {
 	struct zram *zram = dev_to_zram(dev);
 	unsigned long nr_pages = zram->disksize >> PAGE_SHIFT;
 	struct zram_pp_ctl *ctl = NULL;
-	struct zram_pp_slot *pps;
+	struct zram_wb_req *reqs = NULL;
 	unsigned long index = 0;
-	struct bio bio;
-	struct bio_vec bio_vec;
-	struct page *page;
 	ssize_t ret = len;
-	int mode, err;
-	unsigned long blk_idx = 0;
+	int mode, err, i;
 
 	if (sysfs_streq(buf, "idle"))
 		mode = IDLE_WRITEBACK;
@@ -792,8 +1058,8 @@ static ssize_t writeback_store(struct device *dev,
 		goto release_init_lock;
 	}
 
-	page = alloc_page(GFP_KERNEL);
-	if (!page) {
+	reqs = zram_wb_alloc_reqs();
+	if (!reqs) {
 		ret = -ENOMEM;
 		goto release_init_lock;
 	}
@@ -806,95 +1072,31 @@ static ssize_t writeback_store(struct device *dev,
 
 	scan_slots_for_writeback(zram, mode, nr_pages, index, ctl);
 
-	while ((pps = select_pp_slot(ctl))) {
-		spin_lock(&zram->wb_limit_lock);
-		if (zram->wb_limit_enable && !zram->bd_wb_limit) {
-			spin_unlock(&zram->wb_limit_lock);
-			ret = -EIO;
-			break;
-		}
-		spin_unlock(&zram->wb_limit_lock);
-
-		if (!blk_idx) {
-			blk_idx = alloc_block_bdev(zram);
-			if (!blk_idx) {
-				ret = -ENOSPC;
-				break;
-			}
-		}
-
-		index = pps->index;
-		zram_slot_lock(zram, index);
-		/*
-		 * scan_slots() sets ZRAM_PP_SLOT and relases slot lock, so
-		 * slots can change in the meantime. If slots are accessed or
-		 * freed they lose ZRAM_PP_SLOT flag and hence we don't
-		 * post-process them.
-		 */
-		if (!zram_test_flag(zram, index, ZRAM_PP_SLOT))
-			goto next;
-		zram_slot_unlock(zram, index);
+	/*
+	 * Keep up to ZRAM_WB_INFLIGHT batches in flight, reusing the oldest
+	 * one once it completed.
+	 */
+	for (i = 0; ; i = (i + 1) % ZRAM_WB_INFLIGHT) {
+		err = zram_wb_complete(zram, &reqs[i]);
+		if (err)
+			ret = err;
 
-		if (zram_read_page(zram, page, index, NULL)) {
-			release_pp_slot(zram, pps);
-			continue;
+		err = zram_wb_submit(zram, ctl, &reqs[i]);
+		if (err <= 0) {
+			if (err)
+				ret = err;
+			break;
 		}
+	}
 
-		bio_init(&bio, zram->bdev, &bio_vec, 1,
-			 REQ_OP_WRITE | REQ_SYNC);
-		bio.bi_iter.bi_sector = blk_idx * (PAGE_SIZE >> 9);
-		__bio_add_page(&bio, page, PAGE_SIZE, 0);
-
-		/*
-		 * XXX: A single page IO would be inefficient for write
-		 * but it would be not bad as starter.
-		 */
-		err = submit_bio_wait(&bio);
-		if (err) {
-			release_pp_slot(zram, pps);
-			/*
-			 * BIO errors are not fatal, we continue and simply
-			 * attempt to writeback the remaining objects (pages).
-			 * At the same time we need to signal user-space that
-			 * some writes (at least one, but also could be all of
-			 * them) were not successful and we do so by returning
-			 * the most recent BIO error.
-			 */
+	for (i = 0; i < ZRAM_WB_INFLIGHT; i++) {
+		err = zram_wb_complete(zram, &reqs[i]);
+		if (err)
 			ret = err;
-			continue;
-		}
-
-		atomic64_inc(&zram->stats.bd_writes);
-		zram_slot_lock(zram, index);
-		/*
-		 * Same as above, we release slot lock during writeback so
-		 * slot can change under us: slot_free() or slot_free() and
-		 * reallocation (zram_write_page()). In both cases slot loses
-		 * ZRAM_PP_SLOT flag. No concurrent post-processing can set
-		 * ZRAM_PP_SLOT on such slots until current post-processing
-		 * finishes.
-		 */
-		if (!zram_test_flag(zram, index, ZRAM_PP_SLOT))
-			goto next;
-
-		zram_free_page(zram, index);
-		zram_set_flag(zram, index, ZRAM_WB);
-		zram_set_element(zram, index, blk_idx);
-		blk_idx = 0;
-		atomic64_inc(&zram->stats.pages_stored);
-		spin_lock(&zram->wb_limit_lock);
-		if (zram->wb_limit_enable && zram->bd_wb_limit > 0)
-			zram->bd_wb_limit -=  1UL << (PAGE_SHIFT - 12);
-		spin_unlock(&zram->wb_limit_lock);
-next:
-		zram_slot_unlock(zram, index);
-		release_pp_slot(zram, pps);
 	}
 
-	if (blk_idx)
-		free_block_bdev(zram, blk_idx);
-	__free_page(page);
 release_init_lock:
+	zram_wb_free_reqs(reqs);
 	release_pp_ctl(zram, ctl);
 	atomic_set(&zram->pp_in_progress, 0);
 	up_read(&zram->init_lock);
@@ -1379,7 +1581,7 @@ static ssize_t mm_stat_show(struct device *dev,
 	max_used = atomic_long_read(&zram->stats.max_used_pages);
 
 	ret = scnprintf(buf, PAGE_SIZE,
-			"%8llu %8llu %8llu %8lu %8ld %8llu %8lu %8llu %8llu\n",
+			"%8llu %8llu %8llu %8lu %8ld %8llu %8lu %8llu %8llu %8llu %8llu\n",
 			orig_size << PAGE_SHIFT,
 			(u64)atomic64_read(&zram->stats.compr_data_size),
 			mem_used << PAGE_SHIFT,
@@ -1388,11 +1590,50 @@ static ssize_t mm_stat_show(struct device *dev,
 			(u64)atomic64_read(&zram->stats.same_pages),
 			atomic_long_read(&pool_stats.pages_compacted),
 			(u64)atomic64_read(&zram->stats.huge_pages),
-			(u64)atomic64_read(&zram->stats.huge_pages_since));
+			(u64)atomic64_read(&zram->stats.huge_pages_since),
+			(u64)atomic64_read(&zram->stats.dedup_pages),
+			(u64)atomic64_read(&zram->stats.dedup_data_size));
+	up_read(&zram->init_lock);
+
+	return ret;
+}
+
+#ifdef CONFIG_ZRAM_DEDUP
+static ssize_t dedup_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+	bool val;
+
+	down_read(&zram->init_lock);
+	val = zram->dedup_enable;
 	up_read(&zram->init_lock);
 
+	return scnprintf(buf, PAGE_SIZE, "%d\n", val);
+}
+
+static ssize_t dedup_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	bool val;
+	ssize_t ret = len;
+
+	if (kstrtobool(buf, &val))
+		return -EINVAL;
+
+	down_write(&zram->init_lock);
+	if (init_done(zram)) {
+		pr_info("Can't change dedup for initialized device\n");
+		ret = -EBUSY;
+	} else {
+		zram->dedup_enable = val;
+	}
+	up_write(&zram->init_lock);
+
 	return ret;
 }
+#endif
 
 #ifdef CONFIG_ZRAM_WRITEBACK
 #define FOUR_K(x) ((x) * (1 << (PAGE_SHIFT - 12)))
@@ -1451,6 +1692,7 @@ static void zram_meta_free(struct zram *zram, u64 disksize)
 	for (index = 0; index < num_pages; index++)
 		zram_free_page(zram, index);
 
+	zram_dedup_fini(zram);
 	zs_destroy_pool(zram->mem_pool);
 	vfree(zram->table);
 	zram->table = NULL;
@@ -1472,6 +1714,13 @@ static bool zram_meta_alloc(struct zram *zram, u64 disksize)
 		return false;
 	}
 
+	if (!zram_dedup_init(zram, num_pages)) {
+		zs_destroy_pool(zram->mem_pool);
+		vfree(zram->table);
+		zram->table = NULL;
+		return false;
+	}
+
 	if (!huge_class_size)
 		huge_class_size = zs_huge_class_size(zram->mem_pool);
 
@@ -1523,6 +1772,12 @@ static void zram_free_page(struct zram *zram, size_t index)
 	if (!handle)
 		return;
 
+	if (zram_test_flag(zram, index, ZRAM_DEDUP)) {
+		zram_clear_flag(zram, index, ZRAM_DEDUP);
+		zram_dedup_put(zram, (struct zram_entry *)handle);
+		goto out;
+	}
+
 	zs_free(zram->mem_pool, handle);
 
 	atomic64_sub(zram_get_obj_size(zram, index),
@@ -1547,7 +1802,7 @@ static int zram_read_from_zspool(struct zram *zram, struct page *page,
 	u32 prio;
 	int ret;
 
-	handle = zram_get_handle(zram, index);
+	handle = zram_get_obj_handle(zram, index);
 	if (!handle || zram_test_flag(zram, index, ZRAM_SAME)) {
 		unsigned long value;
 		void *mem;
@@ -1638,7 +1893,23 @@ static int zram_bvec_read(struct zram *zram, struct bio_vec *bvec,
 	return zram_read_page(zram, bvec->bv_page, index, bio);
 }
 
-static int zram_write_page(struct zram *zram, struct page *page, u32 index)
+/* Result of compressing a page, before it is installed into its slot */
+struct zram_write_slot {
+	struct page *page;
+	unsigned long handle;
+	unsigned long element;
+	unsigned int comp_len;
+	enum zram_pageflags flags;
+	bool dedup;
+	int ret;
+};
+
+/*
+ * Compress @page and store the result in a new zsmalloc object. Nothing is
+ * done to the slot the page belongs to, see zram_commit_page().
+ */
+static int zram_compress_page(struct zram *zram, struct page *page,
+			      struct zram_write_slot *ws)
 {
 	int ret = 0;
 	unsigned long alloced_pages;
@@ -1647,16 +1918,25 @@ static int zram_write_page(struct zram *zram, struct page *page, u32 index)
 	void *src, *dst, *mem;
 	struct zcomp_strm *zstrm;
 	unsigned long element = 0;
-	enum zram_pageflags flags = 0;
+	struct zram_entry *entry;
+	bool dedup = zram_dedup_enabled(zram);
+	u64 checksum = 0;
+
+	ws->flags = 0;
+	ws->comp_len = 0;
+	ws->dedup = false;
 
 	mem = kmap_local_page(page);
 	if (page_same_filled(mem, &element)) {
 		kunmap_local(mem);
 		/* Free memory associated with this sector now. */
-		flags = ZRAM_SAME;
+		ws->flags = ZRAM_SAME;
+		ws->element = element;
 		atomic64_inc(&zram->stats.same_pages);
-		goto out;
+		return 0;
 	}
+	if (dedup)
+		checksum = zram_dedup_checksum(mem);
 	kunmap_local(mem);
 
 compress_again:
@@ -1675,6 +1955,26 @@ static int zram_write_page(struct zram *zram, struct page *page, u32 index)
 
 	if (comp_len >= huge_class_size)
 		comp_len = PAGE_SIZE;
+
+	if (dedup) {
+		src = zstrm->buffer;
+		if (comp_len == PAGE_SIZE)
+			src = kmap_local_page(page);
+		entry = zram_dedup_find(zram, checksum, src, comp_len);
+		if (comp_len == PAGE_SIZE)
+			kunmap_local(src);
+		if (entry) {
+			zcomp_stream_put(zram->comps[ZRAM_PRIMARY_COMP]);
+			/* Allocated by the slow path below, not needed now */
+			if (!IS_ERR_VALUE(handle))
+				zs_free(zram->mem_pool, handle);
+			ws->handle = (unsigned long)entry;
+			ws->comp_len = comp_len;
+			ws->dedup = true;
+			return 0;
+		}
+	}
+
 	/*
 	 * handle allocation has 2 paths:
 	 * a) fast path is executed with preemption disabled (for
@@ -1736,7 +2036,23 @@ static int zram_write_page(struct zram *zram, struct page *page, u32 index)
 	zcomp_stream_put(zram->comps[ZRAM_PRIMARY_COMP]);
 	zs_unmap_object(zram->mem_pool, handle);
 	atomic64_add(comp_len, &zram->stats.compr_data_size);
-out:
+
+	ws->handle = handle;
+	ws->comp_len = comp_len;
+	if (dedup) {
+		entry = zram_dedup_add(zram, checksum, handle, comp_len);
+		if (entry) {
+			ws->handle = (unsigned long)entry;
+			ws->dedup = true;
+		}
+	}
+	return 0;
+}
+
+/* Install the page compressed by zram_compress_page() into its slot */
+static void zram_commit_page(struct zram *zram, u32 index,
+			     struct zram_write_slot *ws)
+{
 	/*
 	 * Free memory associated with this sector
 	 * before overwriting unused sectors.
@@ -1744,23 +2060,35 @@ static int zram_write_page(struct zram *zram, struct page *page, u32 index)
 	zram_slot_lock(zram, index);
 	zram_free_page(zram, index);
 
-	if (comp_len == PAGE_SIZE) {
+	if (ws->comp_len == PAGE_SIZE) {
 		zram_set_flag(zram, index, ZRAM_HUGE);
 		atomic64_inc(&zram->stats.huge_pages);
 		atomic64_inc(&zram->stats.huge_pages_since);
 	}
 
-	if (flags) {
-		zram_set_flag(zram, index, flags);
-		zram_set_element(zram, index, element);
+	if (ws->flags) {
+		zram_set_flag(zram, index, ws->flags);
+		zram_set_element(zram, index, ws->element);
 	}  else {
-		zram_set_handle(zram, index, handle);
-		zram_set_obj_size(zram, index, comp_len);
+		if (ws->dedup)
+			zram_set_flag(zram, index, ZRAM_DEDUP);
+		zram_set_handle(zram, index, ws->handle);
+		zram_set_obj_size(zram, index, ws->comp_len);
 	}
 	zram_slot_unlock(zram, index);
 
 	/* Update stats */
 	atomic64_inc(&zram->stats.pages_stored);
+}
+
+static int zram_write_page(struct zram *zram, struct page *page, u32 index)
+{
+	struct zram_write_slot ws;
+	int ret;
+
+	ret = zram_compress_page(zram, page, &ws);
+	if (!ret)
+		zram_commit_page(zram, index, &ws);
 	return ret;
 }
 
@@ -1824,8 +2152,10 @@ static int scan_slots_for_recompress(struct zram *zram, u32 mode,
 		    !zram_test_flag(zram, index, ZRAM_HUGE))
 			goto next;
 
+		/* Shared objects would have to be recompressed for all users */
 		if (zram_test_flag(zram, index, ZRAM_WB) ||
 		    zram_test_flag(zram, index, ZRAM_SAME) ||
+		    zram_test_flag(zram, index, ZRAM_DEDUP) ||
 		    zram_test_flag(zram, index, ZRAM_INCOMPRESSIBLE))
 			goto next;
 
@@ -2221,11 +2551,134 @@ static void zram_bio_read(struct zram *zram, struct bio *bio)
 	bio_endio(bio);
 }
 
+/*
+ * Large writes are compressed by several workers, each claiming batches of
+ * ZRAM_WRITE_BATCH pages. Every worker uses the compression stream of the
+ * CPU it runs on, the slots are then updated in bio order by the submitter.
+ */
+#define ZRAM_WRITE_BATCH	8
+
+struct zram_write_ctx {
+	struct zram *zram;
+	unsigned int nr;
+	atomic_t next;
+	atomic_t pending;
+	struct completion done;
+	struct zram_write_slot slots[];
+};
+
+struct zram_write_work {
+	struct work_struct work;
+	struct zram_write_ctx *ctx;
+};
+
+static void zram_write_claim(struct zram_write_ctx *ctx)
+{
+	unsigned int i, end;
+
+	while ((i = atomic_fetch_add(ZRAM_WRITE_BATCH, &ctx->next)) < ctx->nr) {
+		end = min(i + ZRAM_WRITE_BATCH, ctx->nr);
+		for (; i < end; i++) {
+			struct zram_write_slot *ws = &ctx->slots[i];
+
+			ws->ret = zram_compress_page(ctx->zram, ws->page, ws);
+		}
+	}
+}
+
+static void zram_write_workfn(struct work_struct *work)
+{
+	struct zram_write_ctx *ctx =
+		container_of(work, struct zram_write_work, work)->ctx;
+
+	zram_write_claim(ctx);
+	if (atomic_dec_and_test(&ctx->pending))
+		complete(&ctx->done);
+}
+
+/*
+ * Returns false if @bio is not a large page aligned write, or if memory for
+ * the parallel path is not available; the caller then writes it page by page.
+ */
+static bool zram_bio_write_parallel(struct zram *zram, struct bio *bio)
+{
+	unsigned int nr = bio->bi_iter.bi_size >> PAGE_SHIFT;
+	u32 index = bio->bi_iter.bi_sector >> SECTORS_PER_PAGE_SHIFT;
+	struct zram_write_work *works = NULL;
+	struct zram_write_ctx *ctx;
+	unsigned int i, nr_works;
+	struct bvec_iter iter;
+	struct bio_vec bv;
+
+	if (nr < 2 * ZRAM_WRITE_BATCH || num_online_cpus() < 2)
+		return false;
+	if ((bio->bi_iter.bi_sector & (SECTORS_PER_PAGE - 1)) ||
+	    (bio->bi_iter.bi_size & ~PAGE_MASK))
+		return false;
+
+	nr_works = min(DIV_ROUND_UP(nr, ZRAM_WRITE_BATCH),
+		       num_online_cpus()) - 1;
+	ctx = kmalloc(struct_size(ctx, slots, nr), GFP_NOIO | __GFP_NOWARN);
+	if (nr_works)
+		works = kmalloc_array(nr_works, sizeof(*works),
+				      GFP_NOIO | __GFP_NOWARN);
+	if (!ctx || (nr_works && !works))
+		goto fallback;
+
+	i = 0;
+	bio_for_each_segment(bv, bio, iter) {
+		if (bv.bv_offset || bv.bv_len != PAGE_SIZE)
+			goto fallback;
+		ctx->slots[i++].page = bv.bv_page;
+	}
+
+	ctx->zram = zram;
+	ctx->nr = nr;
+	atomic_set(&ctx->next, 0);
+	atomic_set(&ctx->pending, nr_works);
+	init_completion(&ctx->done);
+
+	for (i = 0; i < nr_works; i++) {
+		INIT_WORK(&works[i].work, zram_write_workfn);
+		works[i].ctx = ctx;
+		queue_work(zram_write_wq, &works[i].work);
+	}
+
+	zram_write_claim(ctx);
+	if (nr_works)
+		wait_for_completion(&ctx->done);
+
+	for (i = 0; i < nr; i++) {
+		if (ctx->slots[i].ret) {
+			atomic64_inc(&zram->stats.failed_writes);
+			bio->bi_status = BLK_STS_IOERR;
+			continue;
+		}
+
+		zram_commit_page(zram, index + i, &ctx->slots[i]);
+		zram_slot_lock(zram, index + i);
+		zram_accessed(zram, index + i);
+		zram_slot_unlock(zram, index + i);
+	}
+
+	kfree(works);
+	kfree(ctx);
+	return true;
+
+fallback:
+	kfree(works);
+	kfree(ctx);
+	return false;
+}
+
 static void zram_bio_write(struct zram *zram, struct bio *bio)
 {
 	unsigned long start_time = bio_start_io_acct(bio);
 	struct bvec_iter iter = bio->bi_iter;
 
+	if (zram_bio_write_parallel(zram, bio))
+		goto out;
+
 	do {
 		u32 index = iter.bi_sector >> SECTORS_PER_PAGE_SHIFT;
 		u32 offset = (iter.bi_sector & (SECTORS_PER_PAGE - 1)) <<
@@ -2247,6 +2700,7 @@ static void zram_bio_write(struct zram *zram, struct bio *bio)
 		bio_advance_iter_single(bio, &iter, bv.bv_len);
 	} while (iter.bi_size);
 
+out:
 	bio_end_io_acct(bio, start_time);
 	bio_endio(bio);
 }
@@ -2480,6 +2934,9 @@ static DEVICE_ATTR_RW(writeback_limit_enable);
 static DEVICE_ATTR_RW(recomp_algorithm);
 static DEVICE_ATTR_WO(recompress);
 #endif
+#ifdef CONFIG_ZRAM_DEDUP
+static DEVICE_ATTR_RW(dedup);
+#endif
 static DEVICE_ATTR_WO(algorithm_params);
 
 static struct attribute *zram_disk_attrs[] = {
@@ -2507,6 +2964,9 @@ static struct attribute *zram_disk_attrs[] = {
 #ifdef CONFIG_ZRAM_MULTI_COMP
 	&dev_attr_recomp_algorithm.attr,
 	&dev_attr_recompress.attr,
+#endif
+#ifdef CONFIG_ZRAM_DEDUP
+	&dev_attr_dedup.attr,
 #endif
 	&dev_attr_algorithm_params.attr,
 	NULL,
@@ -2731,6 +3191,7 @@ static void destroy_devices(void)
 	idr_destroy(&zram_index_idr);
 	unregister_blkdev(zram_major, "zram");
 	cpuhp_remove_multi_state(CPUHP_ZCOMP_PREPARE);
+	destroy_workqueue(zram_write_wq);
 }
 
 static int __init zram_init(void)
@@ -2740,15 +3201,24 @@ static int __init zram_init(void)
 
 	BUILD_BUG_ON(__NR_ZRAM_PAGEFLAGS > sizeof(zram_te.flags) * 8);
 
+	/* Swap-out goes through here, so it has to make forward progress */
+	zram_write_wq = alloc_workqueue("zram_write",
+			WQ_UNBOUND | WQ_HIGHPRI | WQ_MEM_RECLAIM, 0);
+	if (!zram_write_wq)
+		return -ENOMEM;
+
 	ret = cpuhp_setup_state_multi(CPUHP_ZCOMP_PREPARE, "block/zram:prepare",
 				      zcomp_cpu_up_prepare, zcomp_cpu_dead);
-	if (ret < 0)
+	if (ret < 0) {
+		destroy_workqueue(zram_write_wq);
 		return ret;
+	}
 
 	ret = class_register(&zram_control_class);
 	if (ret) {
 		pr_err("Unable to register zram-control class\n");
 		cpuhp_remove_multi_state(CPUHP_ZCOMP_PREPARE);
+		destroy_workqueue(zram_write_wq);
 		return ret;
 	}
 
@@ -2758,6 +3228,7 @@ static int __init zram_init(void)
 		pr_err("Unable to get major number\n");
 		class_unregister(&zram_control_class);
 		cpuhp_remove_multi_state(CPUHP_ZCOMP_PREPARE);
+		destroy_workqueue(zram_write_wq);
 		return -EBUSY;
 	}
 
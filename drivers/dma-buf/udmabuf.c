@@ -2,6 +2,7 @@
 #include <linux/cred.h>
 #include <linux/device.h>
 #include <linux/dma-buf.h>
+#include <linux/dma-mapping.h>
 #include <linux/dma-resv.h>
 #include <linux/highmem.h>
 #include <linux/init.h>
@@ -148,26 +149,53 @@ static void vunmap_udmabuf(struct dma_buf *buf, struct iosys_map *map)
 	vm_unmap_ram(map->vaddr, ubuf->pagecount);
 }
 
+/*
+ * Length of the run of pages starting at @pg that are contiguous within the
+ * same folio, capped at @max_len bytes.
+ */
+static unsigned int udmabuf_run_len(struct udmabuf *ubuf, pgoff_t pg,
+				    unsigned int max_len)
+{
+	unsigned int len = PAGE_SIZE;
+
+	while (++pg < ubuf->pagecount && len + PAGE_SIZE <= max_len &&
+	       ubuf->folios[pg] == ubuf->folios[pg - 1] &&
+	       ubuf->offsets[pg] == ubuf->offsets[pg - 1] + PAGE_SIZE)
+		len += PAGE_SIZE;
+
+	return len;
+}
+
 static struct sg_table *get_sg_table(struct device *dev, struct dma_buf *buf,
 				     enum dma_data_direction direction)
 {
 	struct udmabuf *ubuf = buf->priv;
+	unsigned int max_len, nents = 0;
 	struct sg_table *sg;
 	struct scatterlist *sgl;
-	unsigned int i = 0;
+	pgoff_t pg;
 	int ret;
 
 	sg = kzalloc(sizeof(*sg), GFP_KERNEL);
 	if (!sg)
 		return ERR_PTR(-ENOMEM);
 
-	ret = sg_alloc_table(sg, ubuf->pagecount, GFP_KERNEL);
+	/* Emit one entry per contiguous folio range rather than per page */
+	max_len = max_t(unsigned int, PAGE_SIZE,
+			rounddown(dma_get_max_seg_size(dev), PAGE_SIZE));
+	for (pg = 0; pg < ubuf->pagecount; nents++)
+		pg += udmabuf_run_len(ubuf, pg, max_len) >> PAGE_SHIFT;
+
+	ret = sg_alloc_table(sg, nents, GFP_KERNEL);
 	if (ret < 0)
 		goto err_alloc;
 
-	for_each_sg(sg->sgl, sgl, ubuf->pagecount, i)
-		sg_set_folio(sgl, ubuf->folios[i], PAGE_SIZE,
-			     ubuf->offsets[i]);
+	for (pg = 0, sgl = sg->sgl; pg < ubuf->pagecount; sgl = sg_next(sgl)) {
+		unsigned int len = udmabuf_run_len(ubuf, pg, max_len);
+
+		sg_set_folio(sgl, ubuf->folios[pg], len, ubuf->offsets[pg]);
+		pg += len >> PAGE_SHIFT;
+	}
 
 	ret = dma_map_sgtable(dev, sg, direction, 0);
 	if (ret < 0)
@@ -577,15 +577,21 @@ struct open_bucket {
  * Both of those tasks will be doing fairly random IO so we can't rely on
  * detecting sequential IO to segregate their data, but going off of the task
  * should be a sane heuristic.
+ *
+ * The open buckets are split into OPEN_BUCKET_SHARDS shards, each with its own
+ * lock, and a write point only ever uses the buckets of one shard. A task's
+ * sequential writes therefore still find the bucket their last write went to,
+ * while writers from different tasks mostly don't contend on the same lock.
  */
 static struct open_bucket *pick_data_bucket(struct cache_set *c,
+					    struct open_bucket_shard *shard,
 					    const struct bkey *search,
 					    unsigned int write_point,
 					    struct bkey *alloc)
 {
 	struct open_bucket *ret, *ret_task = NULL;
 
-	list_for_each_entry_reverse(ret, &c->data_buckets, list)
+	list_for_each_entry_reverse(ret, &shard->buckets, list)
 		if (UUID_FLASH_ONLY(&c->uuids[KEY_INODE(&ret->key)]) !=
 		    UUID_FLASH_ONLY(&c->uuids[KEY_INODE(search)]))
 			continue;
@@ -594,7 +600,7 @@ static struct open_bucket *pick_data_bucket(struct cache_set *c,
 		else if (ret->last_write_point == write_point)
 			ret_task = ret;
 
-	ret = ret_task ?: list_first_entry(&c->data_buckets,
+	ret = ret_task ?: list_first_entry(&shard->buckets,
 					   struct open_bucket, list);
 found:
 	if (!ret->sectors_free && KEY_PTRS(alloc)) {
@@ -626,6 +632,8 @@ bool bch_alloc_sectors(struct cache_set *c,
 		       unsigned int write_prio,
 		       bool wait)
 {
+	struct open_bucket_shard *shard =
+		&c->data_buckets[write_point % OPEN_BUCKET_SHARDS];
 	struct open_bucket *b;
 	BKEY_PADDED(key) alloc;
 	unsigned int i;
@@ -638,19 +646,19 @@ bool bch_alloc_sectors(struct cache_set *c,
 	 */
 
 	bkey_init(&alloc.key);
-	spin_lock(&c->data_bucket_lock);
+	spin_lock(&shard->lock);
 
-	while (!(b = pick_data_bucket(c, k, write_point, &alloc.key))) {
+	while (!(b = pick_data_bucket(c, shard, k, write_point, &alloc.key))) {
 		unsigned int watermark = write_prio
 			? RESERVE_MOVINGGC
 			: RESERVE_NONE;
 
-		spin_unlock(&c->data_bucket_lock);
+		spin_unlock(&shard->lock);
 
 		if (bch_bucket_alloc_set(c, watermark, &alloc.key, wait))
 			return false;
 
-		spin_lock(&c->data_bucket_lock);
+		spin_lock(&shard->lock);
 	}
 
 	/*
@@ -679,7 +687,7 @@ bool bch_alloc_sectors(struct cache_set *c,
 	 * Move b to the end of the lru, and keep track of what this bucket was
 	 * last used for:
 	 */
-	list_move_tail(&b->list, &c->data_buckets);
+	list_move_tail(&b->list, &shard->buckets);
 	bkey_copy_key(&b->key, k);
 	b->last_write_point = write_point;
 
@@ -704,7 +712,7 @@ bool bch_alloc_sectors(struct cache_set *c,
 		for (i = 0; i < KEY_PTRS(&b->key); i++)
 			atomic_inc(&PTR_BUCKET(c, &b->key, i)->pin);
 
-	spin_unlock(&c->data_bucket_lock);
+	spin_unlock(&shard->lock);
 	return true;
 }
 
@@ -713,12 +721,17 @@ bool bch_alloc_sectors(struct cache_set *c,
 void bch_open_buckets_free(struct cache_set *c)
 {
 	struct open_bucket *b;
+	int i;
 
-	while (!list_empty(&c->data_buckets)) {
-		b = list_first_entry(&c->data_buckets,
-				     struct open_bucket, list);
-		list_del(&b->list);
-		kfree(b);
+	for (i = 0; i < OPEN_BUCKET_SHARDS; i++) {
+		struct list_head *buckets = &c->data_buckets[i].buckets;
+
+		while (!list_empty(buckets)) {
+			b = list_first_entry(buckets,
+					     struct open_bucket, list);
+			list_del(&b->list);
+			kfree(b);
+		}
 	}
 }
 
@@ -726,7 +739,8 @@ int bch_open_buckets_alloc(struct cache_set *c)
 {
 	int i;
 
-	spin_lock_init(&c->data_bucket_lock);
+	for (i = 0; i < OPEN_BUCKET_SHARDS; i++)
+		spin_lock_init(&c->data_buckets[i].lock);
 
 	for (i = 0; i < MAX_OPEN_BUCKETS; i++) {
 		struct open_bucket *b = kzalloc(sizeof(*b), GFP_KERNEL);
@@ -734,7 +748,7 @@ int bch_open_buckets_alloc(struct cache_set *c)
 		if (!b)
 			return -ENOMEM;
 
-		list_add(&b->list, &c->data_buckets);
+		list_add(&b->list, &c->data_buckets[i % OPEN_BUCKET_SHARDS].buckets);
 	}
 
 	return 0;
@@ -514,6 +514,13 @@ struct gc_stat {
 #define	CACHE_SET_RUNNING		2
 #define CACHE_SET_IO_DISABLE		3
 
+#define OPEN_BUCKET_SHARDS	8
+
+struct open_bucket_shard {
+	struct list_head	buckets;
+	spinlock_t		lock;
+} ____cacheline_aligned_in_smp;
+
 struct cache_set {
 	struct closure		cl;
 
@@ -695,9 +702,11 @@ struct cache_set {
 
 	struct bset_sort_state	sort;
 
-	/* List of buckets we're currently writing data to */
-	struct list_head	data_buckets;
-	spinlock_t		data_bucket_lock;
+	/*
+	 * Buckets we're currently writing data to, split into shards by
+	 * write point so that writers don't all serialise on one lock
+	 */
+	struct open_bucket_shard data_buckets[OPEN_BUCKET_SHARDS];
 
 	struct journal		journal;
 
@@ -1849,7 +1849,7 @@ void bch_cache_set_unregister(struct cache_set *c)
 
 struct cache_set *bch_cache_set_alloc(struct cache_sb *sb)
 {
-	int iter_size;
+	int i, iter_size;
 	struct cache *ca = container_of(sb, struct cache, sb);
 	struct cache_set *c = kzalloc(sizeof(struct cache_set), GFP_KERNEL);
 
@@ -1905,7 +1905,8 @@ struct cache_set *bch_cache_set_alloc(struct cache_sb *sb)
 	INIT_LIST_HEAD(&c->btree_cache);
 	INIT_LIST_HEAD(&c->btree_cache_freeable);
 	INIT_LIST_HEAD(&c->btree_cache_freed);
-	INIT_LIST_HEAD(&c->data_buckets);
+	for (i = 0; i < OPEN_BUCKET_SHARDS; i++)
+		INIT_LIST_HEAD(&c->data_buckets[i].buckets);
 
 	iter_size = ((meta_bucket_pages(sb) * PAGE_SECTORS) / sb->block_size) *
 			    sizeof(struct btree_iter_set);
@@ -14,6 +14,8 @@
 #include <linux/jiffies.h>
 #include <linux/module.h>
 #include <linux/mutex.h>
+#include <linux/percpu.h>
+#include <linux/seqlock.h>
 #include <linux/vmalloc.h>
 #include <linux/math64.h>
 
@@ -576,17 +578,25 @@ struct smq_hash_table {
 	struct entry_space *es;
 	unsigned long long hash_bits;
 	unsigned int *buckets;
+
+	/*
+	 * Bumped around every change of the chains, so they can be walked
+	 * without the policy lock.  See h_lookup_lockless().
+	 */
+	seqcount_spinlock_t seq;
 };
 
 /*
  * All cache entries are stored in a chained hash table.  To save space we
  * use indexing again, and only store indexes to the next entry.
  */
-static int h_init(struct smq_hash_table *ht, struct entry_space *es, unsigned int nr_entries)
+static int h_init(struct smq_hash_table *ht, struct entry_space *es, unsigned int nr_entries,
+		  spinlock_t *lock)
 {
 	unsigned int i, nr_buckets;
 
 	ht->es = es;
+	seqcount_spinlock_init(&ht->seq, lock);
 	nr_buckets = roundup_pow_of_two(max(nr_entries / 4u, 16u));
 	ht->hash_bits = __ffs(nr_buckets);
 
@@ -625,7 +635,9 @@ static void h_insert(struct smq_hash_table *ht, struct entry *e)
 {
 	unsigned int h = hash_64(from_oblock(e->oblock), ht->hash_bits);
 
+	write_seqcount_begin(&ht->seq);
 	__h_insert(ht, h, e);
+	write_seqcount_end(&ht->seq);
 }
 
 static struct entry *__h_lookup(struct smq_hash_table *ht, unsigned int h, dm_oblock_t oblock,
@@ -667,8 +679,10 @@ static struct entry *h_lookup(struct smq_hash_table *ht, dm_oblock_t oblock)
 		 * Move to the front because this entry is likely
 		 * to be hit again.
 		 */
+		write_seqcount_begin(&ht->seq);
 		__h_unlink(ht, h, e, prev);
 		__h_insert(ht, h, e);
+		write_seqcount_end(&ht->seq);
 	}
 
 	return e;
@@ -684,8 +698,50 @@ static void h_remove(struct smq_hash_table *ht, struct entry *e)
 	 * iterate the bucket to remove an item.
 	 */
 	e = __h_lookup(ht, h, e->oblock, &prev);
-	if (e)
+	if (e) {
+		write_seqcount_begin(&ht->seq);
 		__h_unlink(ht, h, e, prev);
+		write_seqcount_end(&ht->seq);
+	}
+}
+
+/*
+ * Longest chain h_lookup_lockless() walks before giving up, buckets hold
+ * four entries on average.
+ */
+#define H_LOCKLESS_MAX_CHAIN 16u
+
+/*
+ * Look up @oblock without the lock that serialises the writers.  The
+ * chains may change under us, so every index is bounds checked before
+ * following it, and the result is only valid if the sequence count
+ * returned in @seq is unchanged afterwards.  Chains are not reordered.
+ */
+static struct entry *h_lookup_lockless(struct smq_hash_table *ht, dm_oblock_t oblock,
+				       unsigned int *seq)
+{
+	struct entry_space *es = ht->es;
+	unsigned int h = hash_64(from_oblock(oblock), ht->hash_bits);
+	unsigned int i, index, nr_entries = es->end - es->begin;
+	struct entry *e;
+
+	*seq = raw_read_seqcount(&ht->seq);
+	if (*seq & 1)
+		return NULL;
+
+	index = READ_ONCE(ht->buckets[h]);
+	for (i = 0; i < H_LOCKLESS_MAX_CHAIN; i++) {
+		if (index >= nr_entries)
+			return NULL;
+
+		e = es->begin + index;
+		if (data_race(e->oblock) == oblock)
+			return e;
+
+		index = data_race(e->hash_next);
+	}
+
+	return NULL;
 }
 
 /*----------------------------------------------------------------*/
@@ -794,10 +850,29 @@ static struct entry *get_entry(struct entry_alloc *ea, unsigned int index)
 #define HOTSPOT_UPDATE_PERIOD (HZ)
 #define CACHE_UPDATE_PERIOD (60ul * HZ)
 
+/*
+ * Cache hits found without the policy lock are recorded per cpu and
+ * applied to the queues in batches, either by the tick or by a lookup
+ * finding its buffer full.
+ */
+#define HIT_BATCH 64u
+
+struct smq_hit {
+	dm_oblock_t oblock;
+	unsigned int cblock;
+};
+
+struct smq_hit_buffer {
+	/* nests outside of smq_policy.lock */
+	spinlock_t lock;
+	unsigned int nr;
+	struct smq_hit hits[HIT_BATCH];
+};
+
 struct smq_policy {
 	struct dm_cache_policy policy;
 
-	/* protects everything */
+	/* protects everything but the hit buffers */
 	spinlock_t lock;
 	dm_cblock_t cache_size;
 	sector_t cache_block_size;
@@ -857,6 +932,8 @@ struct smq_policy {
 
 	struct background_tracker *bg_work;
 
+	struct smq_hit_buffer __percpu *hit_buffers;
+
 	bool migrations_allowed:1;
 
 	/*
@@ -1362,6 +1439,7 @@ static void smq_destroy(struct dm_cache_policy *p)
 {
 	struct smq_policy *mq = to_smq_policy(p);
 
+	free_percpu(mq->hit_buffers);
 	btracker_destroy(mq->bg_work);
 	h_exit(&mq->hotspot_table);
 	h_exit(&mq->table);
@@ -1408,6 +1486,96 @@ static int __lookup(struct smq_policy *mq, dm_oblock_t oblock, dm_cblock_t *cblo
 	}
 }
 
+/*
+ * Applies the buffered hits as __lookup() would have done.  Entries which
+ * changed mapping since the hit are skipped.
+ */
+static void __apply_hits(struct smq_policy *mq, struct smq_hit_buffer *hb)
+{
+	unsigned int i;
+	struct entry *e;
+
+	lockdep_assert_held(&hb->lock);
+	lockdep_assert_held(&mq->lock);
+
+	for (i = 0; i < hb->nr; i++) {
+		e = get_entry(&mq->cache_alloc, hb->hits[i].cblock);
+		if (!e->allocated || e->oblock != hb->hits[i].oblock)
+			continue;
+
+		stats_level_accessed(&mq->cache_stats, e->level);
+		requeue(mq, e);
+	}
+	hb->nr = 0;
+}
+
+static void apply_all_hits(struct smq_policy *mq)
+{
+	struct smq_hit_buffer *hb;
+	unsigned long flags;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		hb = per_cpu_ptr(mq->hit_buffers, cpu);
+		if (!data_race(hb->nr))
+			continue;
+
+		spin_lock_irqsave(&hb->lock, flags);
+		spin_lock(&mq->lock);
+		__apply_hits(mq, hb);
+		spin_unlock(&mq->lock);
+		spin_unlock_irqrestore(&hb->lock, flags);
+	}
+}
+
+/*
+ * If the buffer is full and the policy lock is contended the hit is
+ * dropped, which only costs some accuracy of the clean/dirty queues.
+ */
+static void record_hit(struct smq_policy *mq, dm_oblock_t oblock, unsigned int cblock)
+{
+	struct smq_hit_buffer *hb = raw_cpu_ptr(mq->hit_buffers);
+	unsigned long flags;
+
+	spin_lock_irqsave(&hb->lock, flags);
+	if (hb->nr == HIT_BATCH && spin_trylock(&mq->lock)) {
+		__apply_hits(mq, hb);
+		spin_unlock(&mq->lock);
+	}
+
+	if (hb->nr < HIT_BATCH) {
+		hb->hits[hb->nr].oblock = oblock;
+		hb->hits[hb->nr].cblock = cblock;
+		hb->nr++;
+	}
+	spin_unlock_irqrestore(&hb->lock, flags);
+}
+
+/*
+ * The hit path of __lookup() without taking the policy lock.  Anything
+ * else, including hits racing with a change of the hash table, falls
+ * back to the locked path.
+ */
+static bool lookup_hit_lockless(struct smq_policy *mq, dm_oblock_t oblock, dm_cblock_t *cblock)
+{
+	struct entry_alloc *ea = &mq->cache_alloc;
+	unsigned int seq, index;
+	struct entry *e;
+
+	e = h_lookup_lockless(&mq->table, oblock, &seq);
+	if (!e)
+		return false;
+
+	/* Only cache entries are ever hashed in the table */
+	index = e - ea->es->begin - ea->begin;
+	if (read_seqcount_retry(&mq->table.seq, seq))
+		return false;
+
+	record_hit(mq, oblock, index);
+	*cblock = to_cblock(index);
+	return true;
+}
+
 static int smq_lookup(struct dm_cache_policy *p, dm_oblock_t oblock, dm_cblock_t *cblock,
 		      int data_dir, bool fast_copy,
 		      bool *background_work)
@@ -1416,6 +1584,11 @@ static int smq_lookup(struct dm_cache_policy *p, dm_oblock_t oblock, dm_cblock_t
 	unsigned long flags;
 	struct smq_policy *mq = to_smq_policy(p);
 
+	if (lookup_hit_lockless(mq, oblock, cblock)) {
+		*background_work = false;
+		return 0;
+	}
+
 	spin_lock_irqsave(&mq->lock, flags);
 	r = __lookup(mq, oblock, cblock,
 		     data_dir, fast_copy,
@@ -1435,6 +1608,9 @@ static int smq_lookup_with_work(struct dm_cache_policy *p,
 	unsigned long flags;
 	struct smq_policy *mq = to_smq_policy(p);
 
+	if (lookup_hit_lockless(mq, oblock, cblock))
+		return 0;
+
 	spin_lock_irqsave(&mq->lock, flags);
 	r = __lookup(mq, oblock, cblock, data_dir, fast_copy, work, &background_queued);
 	spin_unlock_irqrestore(&mq->lock, flags);
@@ -1568,8 +1744,11 @@ static int smq_load_mapping(struct dm_cache_policy *p,
 			    bool dirty, uint32_t hint, bool hint_valid)
 {
 	struct smq_policy *mq = to_smq_policy(p);
+	unsigned long flags;
 	struct entry *e;
 
+	/* Lockless lookups may race with loading */
+	spin_lock_irqsave(&mq->lock, flags);
 	e = alloc_particular_entry(&mq->cache_alloc, from_cblock(cblock));
 	e->oblock = oblock;
 	e->dirty = dirty;
@@ -1581,6 +1760,7 @@ static int smq_load_mapping(struct dm_cache_policy *p,
 	 * allow demotions and cleaning to occur immediately.
 	 */
 	push_front(mq, e);
+	spin_unlock_irqrestore(&mq->lock, flags);
 
 	return 0;
 }
@@ -1589,15 +1769,22 @@ static int smq_invalidate_mapping(struct dm_cache_policy *p, dm_cblock_t cblock)
 {
 	struct smq_policy *mq = to_smq_policy(p);
 	struct entry *e = get_entry(&mq->cache_alloc, from_cblock(cblock));
+	unsigned long flags;
+	int r = 0;
 
-	if (!e->allocated)
-		return -ENODATA;
+	spin_lock_irqsave(&mq->lock, flags);
+	if (!e->allocated) {
+		r = -ENODATA;
+		goto out;
+	}
 
 	// FIXME: what if this block has pending background work?
 	del_queue(mq, e);
 	h_remove(&mq->table, e);
 	free_entry(&mq->cache_alloc, e);
-	return 0;
+out:
+	spin_unlock_irqrestore(&mq->lock, flags);
+	return r;
 }
 
 static uint32_t smq_get_hint(struct dm_cache_policy *p, dm_cblock_t cblock)
@@ -1629,6 +1816,8 @@ static void smq_tick(struct dm_cache_policy *p, bool can_block)
 	struct smq_policy *mq = to_smq_policy(p);
 	unsigned long flags;
 
+	apply_all_hits(mq);
+
 	spin_lock_irqsave(&mq->lock, flags);
 	mq->tick++;
 	update_sentinels(mq);
@@ -1733,6 +1922,7 @@ __smq_create(dm_cblock_t cache_size, sector_t origin_size, sector_t cache_block_
 	     bool mimic_mq, bool migrations_allowed, bool cleaner)
 {
 	unsigned int i;
+	int cpu;
 	unsigned int nr_sentinels_per_queue = 2u * NR_CACHE_LEVELS;
 	unsigned int total_sentinels = 2u * nr_sentinels_per_queue;
 	struct smq_policy *mq = kzalloc(sizeof(*mq), GFP_KERNEL);
@@ -1800,10 +1990,10 @@ __smq_create(dm_cblock_t cache_size, sector_t origin_size, sector_t cache_block_
 	stats_init(&mq->hotspot_stats, NR_HOTSPOT_LEVELS);
 	stats_init(&mq->cache_stats, NR_CACHE_LEVELS);
 
-	if (h_init(&mq->table, &mq->es, from_cblock(cache_size)))
+	if (h_init(&mq->table, &mq->es, from_cblock(cache_size), &mq->lock))
 		goto bad_alloc_table;
 
-	if (h_init(&mq->hotspot_table, &mq->es, mq->nr_hotspot_blocks))
+	if (h_init(&mq->hotspot_table, &mq->es, mq->nr_hotspot_blocks, &mq->lock))
 		goto bad_alloc_hotspot_table;
 
 	sentinels_init(mq);
@@ -1816,11 +2006,19 @@ __smq_create(dm_cblock_t cache_size, sector_t origin_size, sector_t cache_block_
 	if (!mq->bg_work)
 		goto bad_btracker;
 
+	mq->hit_buffers = alloc_percpu(struct smq_hit_buffer);
+	if (!mq->hit_buffers)
+		goto bad_hit_buffers;
+	for_each_possible_cpu(cpu)
+		spin_lock_init(&per_cpu_ptr(mq->hit_buffers, cpu)->lock);
+
 	mq->migrations_allowed = migrations_allowed;
 	mq->cleaner = cleaner;
 
 	return &mq->policy;
 
+bad_hit_buffers:
+	btracker_destroy(mq->bg_work);
 bad_btracker:
 	h_exit(&mq->hotspot_table);
 bad_alloc_hotspot_table:
@@ -141,7 +141,8 @@ struct iv_elephant_private {
 enum flags { DM_CRYPT_SUSPENDED, DM_CRYPT_KEY_VALID,
 	     DM_CRYPT_SAME_CPU, DM_CRYPT_HIGH_PRIORITY,
 	     DM_CRYPT_NO_OFFLOAD, DM_CRYPT_NO_READ_WORKQUEUE,
-	     DM_CRYPT_NO_WRITE_WORKQUEUE, DM_CRYPT_WRITE_INLINE };
+	     DM_CRYPT_NO_WRITE_WORKQUEUE, DM_CRYPT_WRITE_INLINE,
+	     DM_CRYPT_NUMA_AFFINE };
 
 enum cipher_flags {
 	CRYPT_MODE_INTEGRITY_AEAD,	/* Use authenticated mode for cipher */
@@ -161,6 +162,7 @@ struct crypt_config {
 
 	struct workqueue_struct *io_queue;
 	struct workqueue_struct *crypt_queue;
+	int crypt_node;		/* node of the device for numa_affine_crypt */
 
 	spinlock_t write_thread_lock;
 	struct task_struct *write_thread;
@@ -1499,6 +1501,35 @@ static int crypt_convert_block_skcipher(struct crypt_config *cc,
 	return r;
 }
 
+/*
+ * Convert the sectors of the current page one after the other with the same
+ * request for as long as the cipher completes them synchronously, sparing
+ * crypt_convert() its per-request bookkeeping for each of them. Returns like
+ * crypt_convert_block_skcipher() for the last sector converted; the
+ * sectors before it are accounted for already.
+ */
+static int crypt_convert_page_skcipher(struct crypt_config *cc,
+				       struct convert_context *ctx,
+				       struct skcipher_request *req,
+				       unsigned int *tag_offset)
+{
+	unsigned int sector_step = cc->sector_size >> SECTOR_SHIFT;
+	unsigned int left;
+	int r;
+
+	left = min(bio_iter_iovec(ctx->bio_in, ctx->iter_in).bv_len,
+		   bio_iter_iovec(ctx->bio_out, ctx->iter_out).bv_len);
+
+	for (;;) {
+		r = crypt_convert_block_skcipher(cc, ctx, req, *tag_offset);
+		if (r || left < 2 * cc->sector_size)
+			return r;
+		left -= cc->sector_size;
+		ctx->cc_sector += sector_step;
+		(*tag_offset)++;
+	}
+}
+
 static void kcryptd_async_done(void *async_req, int error);
 
 static int crypt_alloc_req_skcipher(struct crypt_config *cc,
@@ -1612,6 +1643,8 @@ static blk_status_t crypt_convert(struct crypt_config *cc,
 
 		if (crypt_integrity_aead(cc))
 			r = crypt_convert_block_aead(cc, ctx, ctx->r.req_aead, tag_offset);
+		else if (cc->tfms_count == 1)
+			r = crypt_convert_page_skcipher(cc, ctx, ctx->r.req, &tag_offset);
 		else
 			r = crypt_convert_block_skcipher(cc, ctx, ctx->r.req, tag_offset);
 
@@ -2337,7 +2370,10 @@ static void kcryptd_queue_crypt(struct dm_crypt_io *io)
 	}
 
 	INIT_WORK(&io->work, kcryptd_crypt);
-	queue_work(cc->crypt_queue, &io->work);
+	if (test_bit(DM_CRYPT_NUMA_AFFINE, &cc->flags))
+		queue_work_node(cc->crypt_node, cc->crypt_queue, &io->work);
+	else
+		queue_work(cc->crypt_queue, &io->work);
 }
 
 static void crypt_free_tfms_aead(struct crypt_config *cc)
@@ -3164,7 +3200,7 @@ static int crypt_ctr_optional(struct dm_target *ti, unsigned int argc, char **ar
 	struct crypt_config *cc = ti->private;
 	struct dm_arg_set as;
 	static const struct dm_arg _args[] = {
-		{0, 9, "Invalid number of feature args"},
+		{0, 10, "Invalid number of feature args"},
 	};
 	unsigned int opt_params, val;
 	const char *opt_string, *sval;
@@ -3191,6 +3227,8 @@ static int crypt_ctr_optional(struct dm_target *ti, unsigned int argc, char **ar
 
 		else if (!strcasecmp(opt_string, "same_cpu_crypt"))
 			set_bit(DM_CRYPT_SAME_CPU, &cc->flags);
+		else if (!strcasecmp(opt_string, "numa_affine_crypt"))
+			set_bit(DM_CRYPT_NUMA_AFFINE, &cc->flags);
 		else if (!strcasecmp(opt_string, "high_priority"))
 			set_bit(DM_CRYPT_HIGH_PRIORITY, &cc->flags);
 
@@ -3395,6 +3433,20 @@ static int crypt_ctr(struct dm_target *ti, unsigned int argc, char **argv)
 	}
 	cc->start = tmpll;
 
+	if (test_bit(DM_CRYPT_NUMA_AFFINE, &cc->flags)) {
+		if (test_bit(DM_CRYPT_SAME_CPU, &cc->flags)) {
+			ti->error = "Cannot combine same_cpu_crypt and numa_affine_crypt";
+			goto bad;
+		}
+		/*
+		 * Encrypt on the node the device's queues live on, so data
+		 * does not cross the interconnect between crypto and DMA.
+		 */
+		cc->crypt_node = bdev_get_queue(cc->dev->bdev)->node;
+	} else {
+		cc->crypt_node = NUMA_NO_NODE;
+	}
+
 	if (bdev_is_zoned(cc->dev->bdev)) {
 		/*
 		 * For zoned block devices, we need to preserve the issuer write
@@ -3478,7 +3530,8 @@ static int crypt_ctr(struct dm_target *ti, unsigned int argc, char **argv)
 	spin_lock_init(&cc->write_thread_lock);
 	cc->write_tree = RB_ROOT;
 
-	cc->write_thread = kthread_run(dmcrypt_write, cc, "dmcrypt_write/%s", devname);
+	cc->write_thread = kthread_create_on_node(dmcrypt_write, cc, cc->crypt_node,
+						  "dmcrypt_write/%s", devname);
 	if (IS_ERR(cc->write_thread)) {
 		ret = PTR_ERR(cc->write_thread);
 		cc->write_thread = NULL;
@@ -3487,6 +3540,7 @@ static int crypt_ctr(struct dm_target *ti, unsigned int argc, char **argv)
 	}
 	if (test_bit(DM_CRYPT_HIGH_PRIORITY, &cc->flags))
 		set_user_nice(cc->write_thread, MIN_NICE);
+	wake_up_process(cc->write_thread);
 
 	ti->num_flush_bios = 1;
 	ti->limit_swap_bios = true;
@@ -3608,6 +3662,7 @@ static void crypt_status(struct dm_target *ti, status_type_t type,
 
 		num_feature_args += !!ti->num_discard_bios;
 		num_feature_args += test_bit(DM_CRYPT_SAME_CPU, &cc->flags);
+		num_feature_args += test_bit(DM_CRYPT_NUMA_AFFINE, &cc->flags);
 		num_feature_args += test_bit(DM_CRYPT_HIGH_PRIORITY, &cc->flags);
 		num_feature_args += test_bit(DM_CRYPT_NO_OFFLOAD, &cc->flags);
 		num_feature_args += test_bit(DM_CRYPT_NO_READ_WORKQUEUE, &cc->flags);
@@ -3622,6 +3677,8 @@ static void crypt_status(struct dm_target *ti, status_type_t type,
 				DMEMIT(" allow_discards");
 			if (test_bit(DM_CRYPT_SAME_CPU, &cc->flags))
 				DMEMIT(" same_cpu_crypt");
+			if (test_bit(DM_CRYPT_NUMA_AFFINE, &cc->flags))
+				DMEMIT(" numa_affine_crypt");
 			if (test_bit(DM_CRYPT_HIGH_PRIORITY, &cc->flags))
 				DMEMIT(" high_priority");
 			if (test_bit(DM_CRYPT_NO_OFFLOAD, &cc->flags))
@@ -3645,6 +3702,8 @@ static void crypt_status(struct dm_target *ti, status_type_t type,
 		DMEMIT_TARGET_NAME_VERSION(ti->type);
 		DMEMIT(",allow_discards=%c", ti->num_discard_bios ? 'y' : 'n');
 		DMEMIT(",same_cpu_crypt=%c", test_bit(DM_CRYPT_SAME_CPU, &cc->flags) ? 'y' : 'n');
+		DMEMIT(",numa_affine_crypt=%c", test_bit(DM_CRYPT_NUMA_AFFINE, &cc->flags) ?
+		       'y' : 'n');
 		DMEMIT(",high_priority=%c", test_bit(DM_CRYPT_HIGH_PRIORITY, &cc->flags) ? 'y' : 'n');
 		DMEMIT(",submit_from_crypt_cpus=%c", test_bit(DM_CRYPT_NO_OFFLOAD, &cc->flags) ?
 		       'y' : 'n');
@@ -3765,7 +3824,7 @@ static void crypt_io_hints(struct dm_target *ti, struct queue_limits *limits)
 
 static struct target_type crypt_target = {
 	.name   = "crypt",
-	.version = {1, 28, 0},
+	.version = {1, 29, 0},
 	.module = THIS_MODULE,
 	.ctr    = crypt_ctr,
 	.dtr    = crypt_dtr,
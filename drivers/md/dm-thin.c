@@ -15,6 +15,7 @@
 #include <linux/jiffies.h>
 #include <linux/log2.h>
 #include <linux/list.h>
+#include <linux/list_sort.h>
 #include <linux/rculist.h>
 #include <linux/init.h>
 #include <linux/module.h>
@@ -1230,6 +1231,63 @@ static void process_prepared(struct pool *pool, struct list_head *head,
 		(*fn)(m);
 }
 
+static int cmp_mappings(void *priv, const struct list_head *a,
+			const struct list_head *b)
+{
+	struct dm_thin_new_mapping *ma = list_entry(a, struct dm_thin_new_mapping, list);
+	struct dm_thin_new_mapping *mb = list_entry(b, struct dm_thin_new_mapping, list);
+	dm_thin_id ida = dm_thin_dev_id(ma->tc->td);
+	dm_thin_id idb = dm_thin_dev_id(mb->tc->td);
+
+	if (ida != idb)
+		return ida < idb ? -1 : 1;
+
+	if (ma->virt_begin != mb->virt_begin)
+		return ma->virt_begin < mb->virt_begin ? -1 : 1;
+
+	return 0;
+}
+
+/*
+ * Prepared mappings complete in whatever order their copies or zeroes
+ * finish, so a batch inserts into the mapping btree at random keys.
+ * Sort the batch by (device, virtual block) so that consecutive inserts
+ * walk the same, already shadowed, nodes.  Before inserting, look up
+ * every key without issuing io; the lookups queue the btree nodes that
+ * are not in core as prefetches, so they are read in parallel rather
+ * than one at a time by the inserts.
+ */
+static void process_prepared_mappings(struct pool *pool)
+{
+	struct list_head maps;
+	struct dm_thin_new_mapping *m, *tmp;
+	struct dm_thin_lookup_result lookup_result;
+	process_mapping_fn *fn = &pool->process_prepared_mapping;
+
+	INIT_LIST_HEAD(&maps);
+	spin_lock_irq(&pool->lock);
+	list_splice_init(&pool->prepared_mappings, &maps);
+	spin_unlock_irq(&pool->lock);
+
+	if (list_empty(&maps))
+		return;
+
+	if (!list_is_singular(&maps)) {
+		list_sort(NULL, &maps, cmp_mappings);
+
+		if (*fn == process_prepared_mapping) {
+			list_for_each_entry(m, &maps, list)
+				if (!m->status)
+					dm_thin_find_block(m->tc->td, m->virt_begin,
+							   0, &lookup_result);
+			dm_pool_issue_prefetches(pool->pmd);
+		}
+	}
+
+	list_for_each_entry_safe(m, tmp, &maps, list)
+		(*fn)(m);
+}
+
 /*
  * Deferred bio jobs.
  */
@@ -2420,7 +2478,7 @@ static void do_worker(struct work_struct *ws)
 	throttle_work_start(&pool->throttle);
 	dm_pool_issue_prefetches(pool->pmd);
 	throttle_work_update(&pool->throttle);
-	process_prepared(pool, &pool->prepared_mappings, &pool->process_prepared_mapping);
+	process_prepared_mappings(pool);
 	throttle_work_update(&pool->throttle);
 	process_prepared(pool, &pool->prepared_discards, &pool->process_prepared_discard);
 	throttle_work_update(&pool->throttle);
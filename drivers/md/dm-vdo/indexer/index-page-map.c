@@ -81,15 +81,25 @@ u32 uds_find_index_page_number(const struct index_page_map *map,
 			       const struct uds_record_name *name, u32 chapter_number)
 {
 	u32 delta_list_number = uds_hash_to_chapter_delta_list(name, map->geometry);
-	u32 slot = chapter_number * map->entries_per_chapter;
-	u32 page;
-
-	for (page = 0; page < map->entries_per_chapter; page++) {
-		if (delta_list_number <= map->entries[slot + page])
-			break;
+	const u16 *entries = &map->entries[chapter_number * map->entries_per_chapter];
+	u32 low = 0;
+	u32 high = map->entries_per_chapter;
+
+	/*
+	 * The entries for a chapter are in ascending order, so find the first page whose last
+	 * delta list is not below the one we want. This runs once per chapter in every sparse
+	 * cache search, so a binary search beats a scan of the whole chapter's entries.
+	 */
+	while (low < high) {
+		u32 middle = low + (high - low) / 2;
+
+		if (delta_list_number <= entries[middle])
+			high = middle;
+		else
+			low = middle + 1;
 	}
 
-	return page;
+	return low;
 }
 
 void uds_get_list_number_bounds(const struct index_page_map *map, u32 chapter_number,
@@ -329,6 +329,14 @@ static int verity_verify_level(struct dm_verity *v, struct dm_verity_io *io,
 
 	aux = dm_bufio_get_aux_data(buf);
 
+	/*
+	 * With check_at_most_once, a hash block verified before its buffer
+	 * got evicted from bufio does not need to be hashed again.
+	 */
+	if (!aux->hash_verified && v->validated_hash_blocks &&
+	    test_bit(hash_block - v->hash_start, v->validated_hash_blocks))
+		aux->hash_verified = 1;
+
 	if (!aux->hash_verified) {
 		if (skip_unverified) {
 			r = 1;
@@ -364,6 +372,9 @@ static int verity_verify_level(struct dm_verity *v, struct dm_verity_io *io,
 			r = -EIO;
 			goto release_ret_r;
 		}
+		if (aux->hash_verified && v->validated_hash_blocks)
+			set_bit(hash_block - v->hash_start,
+				v->validated_hash_blocks);
 	}
 
 	data += offset;
@@ -489,6 +500,75 @@ static int verity_handle_data_hash_mismatch(struct dm_verity *v,
 	return 0;
 }
 
+static void verity_clear_pending_blocks(struct dm_verity_io *io)
+{
+	int i;
+
+	/* kunmap_local() has to go in the reverse order of the mappings */
+	for (i = io->num_pending - 1; i >= 0; i--)
+		kunmap_local(io->pending_blocks[i].data);
+	io->num_pending = 0;
+}
+
+/*
+ * Hash the pending data blocks, interleaved if the shash supports it, and
+ * check them against their wanted digests.
+ */
+static int verity_verify_pending_blocks(struct dm_verity *v,
+					struct dm_verity_io *io,
+					struct bio *bio)
+{
+	const unsigned int block_size = 1 << v->data_dev_block_bits;
+	const u8 *data[DM_VERITY_MAX_PENDING_DATA_BLOCKS];
+	u8 *outs[DM_VERITY_MAX_PENDING_DATA_BLOCKS];
+	unsigned int i;
+	int r;
+
+	if (io->num_pending == 1) {
+		struct pending_block *block = &io->pending_blocks[0];
+
+		r = verity_hash(v, io, block->data, block_size,
+				block->real_digest, !io->in_bh);
+		if (unlikely(r))
+			return r;
+	} else {
+		struct shash_desc *desc = verity_io_hash_req(v, io);
+
+		for (i = 0; i < io->num_pending; i++) {
+			data[i] = io->pending_blocks[i].data;
+			outs[i] = io->pending_blocks[i].real_digest;
+		}
+
+		desc->tfm = v->shash_tfm;
+		r = crypto_shash_import(desc, v->initial_hashstate) ?:
+		    crypto_shash_finup_mb(desc, data, block_size, outs,
+					  io->num_pending);
+		if (unlikely(r)) {
+			DMERR("Error hashing block: %d", r);
+			return r;
+		}
+	}
+
+	for (i = 0; i < io->num_pending; i++) {
+		struct pending_block *block = &io->pending_blocks[i];
+
+		if (likely(memcmp(block->real_digest, block->want_digest,
+				  v->digest_size) == 0)) {
+			if (v->validated_blocks)
+				set_bit(block->blkno, v->validated_blocks);
+			continue;
+		}
+		/* Recheck and FEC work on the digests in the io */
+		memcpy(verity_io_want_digest(v, io), block->want_digest,
+		       v->digest_size);
+		r = verity_handle_data_hash_mismatch(v, io, bio, block->blkno,
+						     block->data);
+		if (unlikely(r))
+			return r;
+	}
+	return 0;
+}
+
 /*
  * Verify one "dm_verity_io" structure.
  */
@@ -500,6 +580,7 @@ static int verity_verify_io(struct dm_verity_io *io)
 	struct bvec_iter *iter;
 	struct bio *bio = dm_bio_from_per_bio_data(io, v->ti->per_io_data_size);
 	unsigned int b;
+	int r;
 
 	if (static_branch_unlikely(&use_bh_wq_enabled) && io->in_bh) {
 		/*
@@ -511,10 +592,11 @@ static int verity_verify_io(struct dm_verity_io *io)
 	} else
 		iter = &io->iter;
 
+	io->num_pending = 0;
 	for (b = 0; b < io->n_blocks;
 	     b++, bio_advance_iter(bio, iter, block_size)) {
-		int r;
 		sector_t cur_block = io->block + b;
+		struct pending_block *block;
 		bool is_zero;
 		struct bio_vec bv;
 		void *data;
@@ -523,11 +605,11 @@ static int verity_verify_io(struct dm_verity_io *io)
 		    likely(test_bit(cur_block, v->validated_blocks)))
 			continue;
 
-		r = verity_hash_for_block(v, io, cur_block,
-					  verity_io_want_digest(v, io),
+		block = &io->pending_blocks[io->num_pending];
+		r = verity_hash_for_block(v, io, cur_block, block->want_digest,
 					  &is_zero);
 		if (unlikely(r < 0))
-			return r;
+			goto error;
 
 		bv = bio_iter_iovec(bio, *iter);
 		if (unlikely(bv.bv_len < block_size)) {
@@ -538,7 +620,8 @@ static int verity_verify_io(struct dm_verity_io *io)
 			 * data block size to be greater than PAGE_SIZE.
 			 */
 			DMERR_LIMIT("unaligned io (data block spans pages)");
-			return -EIO;
+			r = -EIO;
+			goto error;
 		}
 
 		data = bvec_kmap_local(&bv);
@@ -553,28 +636,28 @@ static int verity_verify_io(struct dm_verity_io *io)
 			continue;
 		}
 
-		r = verity_hash(v, io, data, block_size,
-				verity_io_real_digest(v, io), !io->in_bh);
-		if (unlikely(r < 0)) {
-			kunmap_local(data);
-			return r;
+		block->data = data;
+		block->blkno = cur_block;
+		if (++io->num_pending == v->mb_max_msgs) {
+			r = verity_verify_pending_blocks(v, io, bio);
+			if (unlikely(r))
+				goto error;
+			verity_clear_pending_blocks(io);
 		}
+	}
 
-		if (likely(memcmp(verity_io_real_digest(v, io),
-				  verity_io_want_digest(v, io), v->digest_size) == 0)) {
-			if (v->validated_blocks)
-				set_bit(cur_block, v->validated_blocks);
-			kunmap_local(data);
-			continue;
-		}
-		r = verity_handle_data_hash_mismatch(v, io, bio, cur_block,
-						     data);
-		kunmap_local(data);
+	if (io->num_pending) {
+		r = verity_verify_pending_blocks(v, io, bio);
 		if (unlikely(r))
-			return r;
+			goto error;
+		verity_clear_pending_blocks(io);
 	}
 
 	return 0;
+
+error:
+	verity_clear_pending_blocks(io);
+	return r;
 }
 
 /*
@@ -1035,6 +1118,7 @@ static void verity_dtr(struct dm_target *ti)
 	if (v->bufio)
 		dm_bufio_client_destroy(v->bufio);
 
+	kvfree(v->validated_hash_blocks);
 	kvfree(v->validated_blocks);
 	kfree(v->salt);
 	kfree(v->initial_hashstate);
@@ -1313,6 +1397,8 @@ static int verity_setup_hash_alg(struct dm_verity *v, const char *alg_name)
 		v->digest_size = crypto_shash_digestsize(shash);
 		v->hash_reqsize = sizeof(struct shash_desc) +
 				  crypto_shash_descsize(shash);
+		v->mb_max_msgs = min(crypto_shash_mb_max_msgs(shash),
+				     DM_VERITY_MAX_PENDING_DATA_BLOCKS);
 		DMINFO("%s using shash \"%s\"", alg_name, driver_name);
 	} else {
 		v->ahash_tfm = ahash;
@@ -1320,6 +1406,7 @@ static int verity_setup_hash_alg(struct dm_verity *v, const char *alg_name)
 		v->digest_size = crypto_ahash_digestsize(ahash);
 		v->hash_reqsize = sizeof(struct ahash_request) +
 				  crypto_ahash_reqsize(ahash);
+		v->mb_max_msgs = 1;
 		DMINFO("%s using ahash \"%s\"", alg_name, driver_name);
 	}
 	if ((1 << v->hash_dev_block_bits) < v->digest_size * 2) {
@@ -1578,6 +1665,17 @@ static int verity_ctr(struct dm_target *ti, unsigned int argc, char **argv)
 	}
 	v->hash_blocks = hash_position;
 
+	if (v->validated_blocks) {
+		v->validated_hash_blocks =
+			kvcalloc(BITS_TO_LONGS(v->hash_blocks - v->hash_start),
+				 sizeof(unsigned long), GFP_KERNEL);
+		if (!v->validated_hash_blocks) {
+			ti->error = "failed to allocate bitset for check_at_most_once";
+			r = -ENOMEM;
+			goto bad;
+		}
+	}
+
 	r = mempool_init_page_pool(&v->recheck_pool, 1, 0);
 	if (unlikely(r)) {
 		ti->error = "Cannot allocate mempool";
@@ -16,6 +16,7 @@
 #include <linux/pfn_t.h>
 #include <linux/libnvdimm.h>
 #include <linux/delay.h>
+#include <linux/sort.h>
 #include "dm-io-tracker.h"
 
 #define DM_MSG_PREFIX "writecache"
@@ -31,6 +32,7 @@
 #define MAX_AGE_DIV			16
 #define MAX_AGE_UNSPECIFIED		-1UL
 #define PAUSE_WRITEBACK			(HZ * 3)
+#define MAX_WRITEBACK_THREADS		16
 
 #define BITMAP_GRANULARITY	65536
 #if BITMAP_GRANULARITY < PAGE_SIZE
@@ -174,6 +176,7 @@ struct dm_writecache {
 	bool cleaner_set:1;
 	bool metadata_only:1;
 	bool pause_set:1;
+	bool writeback_threads_set:1;
 
 	unsigned int high_wm_percent_value;
 	unsigned int low_wm_percent_value;
@@ -186,6 +189,12 @@ struct dm_writecache {
 	struct work_struct writeback_work;
 	struct work_struct flush_work;
 
+	unsigned int writeback_threads;
+	struct workqueue_struct *writeback_submit_wq;
+	struct writeback_chunk *writeback_chunks;
+	/* entries picked for writeback whose I/O was not submitted yet */
+	atomic_long_t writeback_unsubmitted;
+
 	struct dm_io_tracker iot;
 
 	struct dm_io_client *dm_io;
@@ -1814,12 +1823,31 @@ struct writeback_list {
 	size_t size;
 };
 
+/*
+ * A part of a writeback batch, submitted by an extra thread when
+ * writeback_threads is set.
+ */
+struct writeback_chunk {
+	struct work_struct work;
+	struct dm_writecache *wc;
+	struct writeback_list wbl;
+};
+
+/*
+ * The batch may be split across several submitters, so the number of
+ * jobs in flight is computed from the unsubmitted entries of all of them.
+ */
+static size_t writeback_in_flight(struct dm_writecache *wc)
+{
+	return READ_ONCE(wc->writeback_size) - atomic_long_read(&wc->writeback_unsubmitted);
+}
+
 static void __writeback_throttle(struct dm_writecache *wc, struct writeback_list *wbl)
 {
 	if (unlikely(wc->max_writeback_jobs)) {
-		if (READ_ONCE(wc->writeback_size) - wbl->size >= wc->max_writeback_jobs) {
+		if (writeback_in_flight(wc) >= wc->max_writeback_jobs) {
 			wc_lock(wc);
-			while (wc->writeback_size - wbl->size >= wc->max_writeback_jobs)
+			while (writeback_in_flight(wc) >= wc->max_writeback_jobs)
 				writecache_wait_on_freelist(wc);
 			wc_unlock(wc);
 		}
@@ -1875,6 +1903,7 @@ static void __writecache_writeback_pmem(struct dm_writecache *wc, struct writeba
 			wb->wc_list[wb->wc_list_n++] = f;
 			e = f;
 		}
+		atomic_long_sub(wb->wc_list_n, &wc->writeback_unsubmitted);
 		if (WC_MODE_FUA(wc))
 			bio->bi_opf |= REQ_FUA;
 		if (writecache_has_error(wc)) {
@@ -1925,6 +1954,7 @@ static void __writecache_writeback_ssd(struct dm_writecache *wc, struct writebac
 			list_del(&f->lru);
 			e = f;
 		}
+		atomic_long_sub(c->n_entries, &wc->writeback_unsubmitted);
 
 		if (unlikely(to.sector + to.count > wc->data_device_sectors)) {
 			if (to.sector >= wc->data_device_sectors) {
@@ -1940,15 +1970,99 @@ static void __writecache_writeback_ssd(struct dm_writecache *wc, struct writebac
 	}
 }
 
+static void __writecache_writeback_list(struct dm_writecache *wc, struct writeback_list *wbl)
+{
+	struct blk_plug plug;
+
+	blk_start_plug(&plug);
+
+	if (WC_MODE_PMEM(wc))
+		__writecache_writeback_pmem(wc, wbl);
+	else
+		__writecache_writeback_ssd(wc, wbl);
+
+	blk_finish_plug(&plug);
+}
+
+static void writecache_writeback_chunk(struct work_struct *work)
+{
+	struct writeback_chunk *wch = container_of(work, struct writeback_chunk, work);
+
+	__writecache_writeback_list(wch->wc, &wch->wbl);
+}
+
+static int writeback_run_cmp(const void *a, const void *b, const void *priv)
+{
+	struct dm_writecache *wc = (struct dm_writecache *)priv;
+	uint64_t sa = read_original_sector(wc, *(struct wc_entry **)a);
+	uint64_t sb = read_original_sector(wc, *(struct wc_entry **)b);
+
+	return sa < sb ? -1 : sa > sb;
+}
+
+/*
+ * Move the run of contiguous entries started by @e to @wbl, keeping its
+ * order.  The run is processed from the tail of the list.
+ */
+static void writeback_move_run(struct wc_entry *e, struct writeback_list *wbl)
+{
+	unsigned int n = e->wc_list_contiguous;
+	struct list_head *next;
+
+	wbl->size += n;
+	while (1) {
+		next = e->lru.prev;
+		list_move(&e->lru, &wbl->list);
+		if (!--n)
+			break;
+		e = container_of(next, struct wc_entry, lru);
+	}
+}
+
+/*
+ * Sort the runs of a batch by their origin sector and deal them out to
+ * @threads submitters in ascending ranges, so that the origin device sees
+ * sequential streams.  Returns the number of submitters that got work.
+ */
+static unsigned int writeback_sort_batch(struct dm_writecache *wc, struct writeback_list *wbl,
+					 struct wc_entry **runs, unsigned int nr_runs,
+					 unsigned int threads)
+{
+	struct writeback_list *l = wbl;
+	size_t per_thread;
+	unsigned int i, t = 0;
+	LIST_HEAD(batch);
+
+	sort_r(runs, nr_runs, sizeof(*runs), writeback_run_cmp, NULL, wc);
+
+	per_thread = DIV_ROUND_UP(wbl->size, threads);
+	list_splice_init(&wbl->list, &batch);
+	wbl->size = 0;
+	for (i = 1; i < threads; i++) {
+		INIT_LIST_HEAD(&wc->writeback_chunks[i - 1].wbl.list);
+		wc->writeback_chunks[i - 1].wbl.size = 0;
+	}
+
+	for (i = 0; i < nr_runs; i++) {
+		if (l->size >= per_thread && t + 1 < threads)
+			l = &wc->writeback_chunks[t++].wbl;
+		writeback_move_run(runs[i], l);
+	}
+	BUG_ON(!list_empty(&batch));
+
+	return t + 1;
+}
+
 static void writecache_writeback(struct work_struct *work)
 {
 	struct dm_writecache *wc = container_of(work, struct dm_writecache, writeback_work);
-	struct blk_plug plug;
 	struct wc_entry *f, *g, *e = NULL;
 	struct rb_node *node, *next_node;
 	struct list_head skipped;
 	struct writeback_list wbl;
 	unsigned long n_walked;
+	struct wc_entry *runs[WRITEBACK_LATENCY];
+	unsigned int i, nr_runs, threads;
 
 	if (!WC_MODE_PMEM(wc)) {
 		/* Wait for any active kcopyd work on behalf of ssd writeback */
@@ -1987,7 +2101,17 @@ static void writecache_writeback(struct work_struct *work)
 	if (wc->overwrote_committed)
 		writecache_wait_for_ios(wc, WRITE);
 
+	/*
+	 * Use the extra submitters only while the free list is short, that is
+	 * while writes come in faster than they are written back.  Age based
+	 * writeback trickles out from this thread alone.
+	 */
+	threads = 1;
+	if (wc->freelist_size + wc->writeback_size <= wc->freelist_low_watermark)
+		threads = wc->writeback_threads;
+
 	n_walked = 0;
+	nr_runs = 0;
 	INIT_LIST_HEAD(&skipped);
 	INIT_LIST_HEAD(&wbl.list);
 	wbl.size = 0;
@@ -2033,6 +2157,9 @@ static void writecache_writeback(struct work_struct *work)
 		wbl.size++;
 		e->write_in_progress = true;
 		e->wc_list_contiguous = 1;
+		if (nr_runs < WRITEBACK_LATENCY)
+			runs[nr_runs] = e;
+		nr_runs++;
 
 		f = e;
 
@@ -2092,16 +2219,27 @@ static void writecache_writeback(struct work_struct *work)
 			writecache_wait_for_writeback(wc);
 	}
 
-	wc_unlock(wc);
+	atomic_long_add(wbl.size, &wc->writeback_unsubmitted);
 
-	blk_start_plug(&plug);
+	wc_unlock(wc);
 
-	if (WC_MODE_PMEM(wc))
-		__writecache_writeback_pmem(wc, &wbl);
+	/*
+	 * With writeback_all the batch comes from a walk of the tree, which is
+	 * already sorted, and it is not bounded by WRITEBACK_LATENCY.
+	 */
+	if (nr_runs > 1 && nr_runs <= WRITEBACK_LATENCY && likely(!wc->writeback_all))
+		threads = writeback_sort_batch(wc, &wbl, runs, nr_runs,
+					       min(threads, nr_runs));
 	else
-		__writecache_writeback_ssd(wc, &wbl);
+		threads = 1;
 
-	blk_finish_plug(&plug);
+	for (i = 1; i < threads; i++)
+		queue_work(wc->writeback_submit_wq, &wc->writeback_chunks[i - 1].work);
+
+	__writecache_writeback_list(wc, &wbl);
+
+	for (i = 1; i < threads; i++)
+		flush_work(&wc->writeback_chunks[i - 1].work);
 
 	if (unlikely(wc->writeback_all)) {
 		wc_lock(wc);
@@ -2200,6 +2338,11 @@ static void writecache_dtr(struct dm_target *ti)
 	if (wc->writeback_wq)
 		destroy_workqueue(wc->writeback_wq);
 
+	if (wc->writeback_submit_wq)
+		destroy_workqueue(wc->writeback_submit_wq);
+
+	kfree(wc->writeback_chunks);
+
 	if (wc->dev)
 		dm_put_device(ti, wc->dev);
 
@@ -2241,7 +2384,7 @@ static int writecache_ctr(struct dm_target *ti, unsigned int argc, char **argv)
 	struct wc_memory_superblock s;
 
 	static struct dm_arg _args[] = {
-		{0, 18, "Invalid number of feature args"},
+		{0, 20, "Invalid number of feature args"},
 	};
 
 	as.argc = argc;
@@ -2389,6 +2532,7 @@ static int writecache_ctr(struct dm_target *ti, unsigned int argc, char **argv)
 	wc->block_size_bits = __ffs(wc->block_size);
 
 	wc->max_writeback_jobs = MAX_WRITEBACK_JOBS;
+	wc->writeback_threads = 1;
 	wc->autocommit_blocks = !WC_MODE_PMEM(wc) ? AUTOCOMMIT_BLOCKS_SSD : AUTOCOMMIT_BLOCKS_PMEM;
 	wc->autocommit_jiffies = msecs_to_jiffies(AUTOCOMMIT_MSEC);
 
@@ -2490,6 +2634,13 @@ static int writecache_ctr(struct dm_target *ti, unsigned int argc, char **argv)
 			wc->pause = msecs_to_jiffies(pause_msecs);
 			wc->pause_set = true;
 			wc->pause_value = pause_msecs;
+		} else if (!strcasecmp(string, "writeback_threads") && opt_params >= 1) {
+			string = dm_shift_arg(&as), opt_params--;
+			if (sscanf(string, "%u%c", &wc->writeback_threads, &dummy) != 1)
+				goto invalid_optional;
+			if (!wc->writeback_threads || wc->writeback_threads > MAX_WRITEBACK_THREADS)
+				goto invalid_optional;
+			wc->writeback_threads_set = true;
 		} else {
 invalid_optional:
 			r = -EINVAL;
@@ -2504,6 +2655,23 @@ static int writecache_ctr(struct dm_target *ti, unsigned int argc, char **argv)
 		goto bad;
 	}
 
+	if (wc->writeback_threads > 1) {
+		wc->writeback_submit_wq = alloc_workqueue("writecache-submit",
+							  WQ_MEM_RECLAIM | WQ_UNBOUND,
+							  wc->writeback_threads - 1);
+		wc->writeback_chunks = kcalloc(wc->writeback_threads - 1,
+					       sizeof(struct writeback_chunk), GFP_KERNEL);
+		if (!wc->writeback_submit_wq || !wc->writeback_chunks) {
+			r = -ENOMEM;
+			ti->error = "Could not allocate writeback threads";
+			goto bad;
+		}
+		for (i = 0; i < wc->writeback_threads - 1; i++) {
+			INIT_WORK(&wc->writeback_chunks[i].work, writecache_writeback_chunk);
+			wc->writeback_chunks[i].wc = wc;
+		}
+	}
+
 	if (WC_MODE_PMEM(wc)) {
 		if (!dax_synchronous(wc->ssd_dev->dax_dev)) {
 			r = -EOPNOTSUPP;
@@ -2727,6 +2895,8 @@ static void writecache_status(struct dm_target *ti, status_type_t type,
 			extra_args++;
 		if (wc->pause_set)
 			extra_args += 2;
+		if (wc->writeback_threads_set)
+			extra_args += 2;
 
 		DMEMIT("%u", extra_args);
 		if (wc->start_sector_set)
@@ -2751,6 +2921,8 @@ static void writecache_status(struct dm_target *ti, status_type_t type,
 			DMEMIT(" metadata_only");
 		if (wc->pause_set)
 			DMEMIT(" pause_writeback %u", wc->pause_value);
+		if (wc->writeback_threads_set)
+			DMEMIT(" writeback_threads %u", wc->writeback_threads);
 		break;
 	case STATUSTYPE_IMA:
 		*result = '\0';
@@ -2760,7 +2932,7 @@ static void writecache_status(struct dm_target *ti, status_type_t type,
 
 static struct target_type writecache_target = {
 	.name			= "writecache",
-	.version		= {1, 6, 0},
+	.version		= {1, 7, 0},
 	.module			= THIS_MODULE,
 	.ctr			= writecache_ctr,
 	.dtr			= writecache_dtr,
@@ -426,7 +426,7 @@ static inline void remove_hash(struct stripe_head *sh)
 	pr_debug("remove_hash(), stripe %llu\n",
 		(unsigned long long)sh->sector);
 
-	hlist_del_init(&sh->hash);
+	hlist_del_init_rcu(&sh->hash);
 }
 
 static inline void insert_hash(struct r5conf *conf, struct stripe_head *sh)
@@ -436,7 +436,7 @@ static inline void insert_hash(struct r5conf *conf, struct stripe_head *sh)
 	pr_debug("insert_hash(), stripe %llu\n",
 		(unsigned long long)sh->sector);
 
-	hlist_add_head(&sh->hash, hp);
+	hlist_add_head_rcu(&sh->hash, hp);
 }
 
 /* find an idle stripe, make sure it is unhashed, and return it. */
@@ -621,7 +621,7 @@ static struct stripe_head *__find_stripe(struct r5conf *conf, sector_t sector,
 	struct stripe_head *sh;
 
 	pr_debug("__find_stripe, sector %llu\n", (unsigned long long)sector);
-	hlist_for_each_entry(sh, stripe_hash(conf, sector), hash)
+	hlist_for_each_entry_rcu(sh, stripe_hash(conf, sector), hash)
 		if (sh->sector == sector && sh->generation == generation)
 			return sh;
 	pr_debug("__stripe %llu not in cache\n", (unsigned long long)sector);
@@ -800,6 +800,43 @@ static bool is_inactive_blocked(struct r5conf *conf, int hash)
 		(conf->max_nr_stripes * 3 / 4));
 }
 
+/*
+ * Look up a stripe without the hash lock. This only succeeds for stripes
+ * which are referenced already. Stripes with a zero count sit on some list
+ * and are left to find_get_stripe(), as is everything while the array is
+ * quiescing or reshaping.
+ */
+static struct stripe_head *find_get_stripe_rcu(struct r5conf *conf,
+		sector_t sector, int previous, unsigned int flags)
+{
+	struct stripe_head *sh;
+	short generation;
+
+	if ((!(flags & R5_GAS_NOQUIESCE) && READ_ONCE(conf->quiesce)) ||
+	    READ_ONCE(conf->reshape_progress) != MaxSector)
+		return NULL;
+
+	generation = READ_ONCE(conf->generation) - previous;
+	rcu_read_lock();
+	sh = __find_stripe(conf, sector, generation);
+	if (sh && !atomic_inc_not_zero(&sh->count))
+		sh = NULL;
+	rcu_read_unlock();
+	if (!sh)
+		return NULL;
+
+	/*
+	 * The slab is SLAB_TYPESAFE_BY_RCU, so the stripe may have been
+	 * reused for another sector before we got our reference.
+	 */
+	if (unlikely(sh->sector != sector || sh->generation != generation ||
+		     hlist_unhashed(&sh->hash))) {
+		raid5_release_stripe(sh);
+		return NULL;
+	}
+	return sh;
+}
+
 struct stripe_head *raid5_get_active_stripe(struct r5conf *conf,
 		struct stripe_request_ctx *ctx, sector_t sector,
 		unsigned int flags)
@@ -810,6 +847,10 @@ struct stripe_head *raid5_get_active_stripe(struct r5conf *conf,
 
 	pr_debug("get_stripe, sector %llu\n", (unsigned long long)sector);
 
+	sh = find_get_stripe_rcu(conf, sector, previous, flags);
+	if (sh)
+		return sh;
+
 	spin_lock_irq(conf->hash_locks + hash);
 
 	for (;;) {
@@ -2366,7 +2407,6 @@ static struct stripe_head *alloc_stripe(struct kmem_cache *sc, gfp_t gfp,
 		INIT_LIST_HEAD(&sh->lru);
 		INIT_LIST_HEAD(&sh->r5c);
 		INIT_LIST_HEAD(&sh->log_list);
-		atomic_set(&sh->count, 1);
 		sh->raid_conf = conf;
 		sh->log_start = MaxSector;
 
@@ -2399,6 +2439,12 @@ static int grow_one_stripe(struct r5conf *conf, gfp_t gfp)
 		free_stripe(conf->slab_cache, sh);
 		return 0;
 	}
+	/*
+	 * Only take the reference now. find_get_stripe_rcu() may still look
+	 * at the memory of a freed stripe and must not pin one about to be
+	 * freed again.
+	 */
+	atomic_set(&sh->count, 1);
 	sh->hash_lock_index =
 		conf->max_nr_stripes % NR_STRIPE_HASH_LOCKS;
 	/* we just created an active stripe so... */
@@ -2426,7 +2472,7 @@ static int grow_stripes(struct r5conf *conf, int num)
 	conf->active_name = 0;
 	sc = kmem_cache_create(conf->cache_name[conf->active_name],
 			       struct_size_t(struct stripe_head, dev, devs),
-			       0, 0, NULL);
+			       0, SLAB_TYPESAFE_BY_RCU, NULL);
 	if (!sc)
 		return 1;
 	conf->slab_cache = sc;
@@ -2550,7 +2596,7 @@ static int resize_stripes(struct r5conf *conf, int newsize)
 	/* Step 1 */
 	sc = kmem_cache_create(conf->cache_name[1-conf->active_name],
 			       struct_size_t(struct stripe_head, dev, newsize),
-			       0, 0, NULL);
+			       0, SLAB_TYPESAFE_BY_RCU, NULL);
 	if (!sc)
 		return -ENOMEM;
 
@@ -2675,6 +2721,7 @@ static int resize_stripes(struct r5conf *conf, int newsize)
 					err = -ENOMEM;
 			}
 #endif
+		atomic_set(&nsh->count, 1);
 		raid5_release_stripe(nsh);
 	}
 	/* critical section pass, GFP_NOIO no longer needed */
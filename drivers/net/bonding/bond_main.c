@@ -5281,11 +5281,15 @@ static struct slave *bond_xmit_3ad_xor_slave_get(struct bonding *bond,
 	unsigned int count;
 	u32 hash;
 
-	hash = bond_xmit_hash(bond, skb);
 	count = slaves ? READ_ONCE(slaves->count) : 0;
 	if (unlikely(!count))
 		return NULL;
 
+	/* No choice to make, so don't pay for dissecting the headers. */
+	if (count == 1)
+		return slaves->arr[0];
+
+	hash = bond_xmit_hash(bond, skb);
 	slave = slaves->arr[hash % count];
 	return slave;
 }
@@ -5297,12 +5301,15 @@ static struct slave *bond_xdp_xmit_3ad_xor_slave_get(struct bonding *bond,
 	unsigned int count;
 	u32 hash;
 
-	hash = bond_xmit_hash_xdp(bond, xdp);
 	slaves = rcu_dereference(bond->usable_slaves);
 	count = slaves ? READ_ONCE(slaves->count) : 0;
 	if (unlikely(!count))
 		return NULL;
 
+	if (count == 1)
+		return slaves->arr[0];
+
+	hash = bond_xmit_hash_xdp(bond, xdp);
 	return slaves->arr[hash % count];
 }
 
@@ -14,6 +14,7 @@
  */
 
 #include <linux/debugfs.h>
+#include <linux/delay.h>
 #include <linux/etherdevice.h>
 #include <linux/kernel.h>
 #include <linux/module.h>
@@ -334,6 +335,8 @@ static int nsim_get_iflink(const struct net_device *dev)
 
 static int nsim_rcv(struct nsim_rq *rq, int budget)
 {
+	struct netdevsim *ns = netdev_priv(rq->napi.dev);
+	u32 cost_ns = READ_ONCE(ns->rx_pkt_cost_ns);
 	struct sk_buff *skb;
 	int i;
 
@@ -341,6 +344,10 @@ static int nsim_rcv(struct nsim_rq *rq, int budget)
 		if (skb_queue_empty(&rq->skb_queue))
 			break;
 
+		/* Model the per-packet work a real driver does in its poll */
+		if (cost_ns)
+			ndelay(cost_ns);
+
 		skb = skb_dequeue(&rq->skb_queue);
 		netif_receive_skb(skb);
 	}
@@ -649,6 +656,29 @@ static const struct file_operations nsim_pp_hold_fops = {
 	.owner = THIS_MODULE,
 };
 
+static int nsim_rx_pkt_cost_get(void *data, u64 *val)
+{
+	struct netdevsim *ns = data;
+
+	*val = READ_ONCE(ns->rx_pkt_cost_ns);
+	return 0;
+}
+
+static int nsim_rx_pkt_cost_set(void *data, u64 val)
+{
+	struct netdevsim *ns = data;
+
+	/* The cost is burnt in softirq context, keep it short */
+	if (val > NSEC_PER_MSEC)
+		return -EINVAL;
+
+	WRITE_ONCE(ns->rx_pkt_cost_ns, val);
+	return 0;
+}
+
+DEFINE_DEBUGFS_ATTRIBUTE(nsim_rx_pkt_cost_fops, nsim_rx_pkt_cost_get,
+			 nsim_rx_pkt_cost_set, "%llu\n");
+
 static void nsim_setup(struct net_device *dev)
 {
 	ether_setup(dev);
@@ -798,6 +828,9 @@ nsim_create(struct nsim_dev *nsim_dev, struct nsim_dev_port *nsim_dev_port)
 
 	ns->pp_dfs = debugfs_create_file("pp_hold", 0600, nsim_dev_port->ddir,
 					 ns, &nsim_pp_hold_fops);
+	ns->rx_pkt_cost_dfs = debugfs_create_file("rx_pkt_cost_ns", 0600,
+						  nsim_dev_port->ddir, ns,
+						  &nsim_rx_pkt_cost_fops);
 
 	return ns;
 
@@ -811,6 +844,7 @@ void nsim_destroy(struct netdevsim *ns)
 	struct net_device *dev = ns->netdev;
 	struct netdevsim *peer;
 
+	debugfs_remove(ns->rx_pkt_cost_dfs);
 	debugfs_remove(ns->pp_dfs);
 
 	rtnl_lock();
@@ -135,6 +135,9 @@ struct netdevsim {
 	struct page *page;
 	struct dentry *pp_dfs;
 
+	u32 rx_pkt_cost_ns;
+	struct dentry *rx_pkt_cost_dfs;
+
 	struct nsim_ethtool ethtool;
 	struct netdevsim __rcu *peer;
 };
@@ -407,25 +407,37 @@ static inline struct hlist_head *vxlan_fdb_head(struct vxlan_dev *vxlan,
 	return &vxlan->fdb_head[fdb_head_index(vxlan, mac, vni)];
 }
 
+/* The fixed-size fdb_head[] chains are kept for walking the table and for
+ * picking the per-chain hash_lock, but lookups go through a resizable
+ * rhashtable so that they stay O(1) with very large forwarding tables.
+ */
+static const struct rhashtable_params vxlan_fdb_rht_params = {
+	.head_offset = offsetof(struct vxlan_fdb, rhnode),
+	.key_offset = offsetof(struct vxlan_fdb, key),
+	.key_len = sizeof(struct vxlan_fdb_key),
+	.automatic_shrinking = true,
+};
+
+static void vxlan_fdb_key_init(struct vxlan_dev *vxlan,
+			       struct vxlan_fdb_key *key,
+			       const u8 *mac, __be32 vni)
+{
+	memset(key, 0, sizeof(*key));
+	memcpy(key->eth_addr, mac, ETH_ALEN);
+	if (vxlan->cfg.flags & VXLAN_F_COLLECT_METADATA)
+		key->vni = vni;
+}
+
 /* Look up Ethernet address in forwarding table */
 static struct vxlan_fdb *__vxlan_find_mac(struct vxlan_dev *vxlan,
 					  const u8 *mac, __be32 vni)
 {
-	struct hlist_head *head = vxlan_fdb_head(vxlan, mac, vni);
-	struct vxlan_fdb *f;
+	struct vxlan_fdb_key key;
 
-	hlist_for_each_entry_rcu(f, head, hlist) {
-		if (ether_addr_equal(mac, f->eth_addr)) {
-			if (vxlan->cfg.flags & VXLAN_F_COLLECT_METADATA) {
-				if (vni == f->vni)
-					return f;
-			} else {
-				return f;
-			}
-		}
-	}
+	vxlan_fdb_key_init(vxlan, &key, mac, vni);
 
-	return NULL;
+	return rhashtable_lookup_fast(&vxlan->fdb_hash_tbl, &key,
+				      vxlan_fdb_rht_params);
 }
 
 static struct vxlan_fdb *vxlan_find_mac(struct vxlan_dev *vxlan,
@@ -807,16 +819,26 @@ static struct vxlan_fdb *vxlan_fdb_alloc(struct vxlan_dev *vxlan, const u8 *mac,
 	INIT_LIST_HEAD(&f->nh_list);
 	INIT_LIST_HEAD(&f->remotes);
 	memcpy(f->eth_addr, mac, ETH_ALEN);
+	vxlan_fdb_key_init(vxlan, &f->key, mac, src_vni);
 
 	return f;
 }
 
-static void vxlan_fdb_insert(struct vxlan_dev *vxlan, const u8 *mac,
-			     __be32 src_vni, struct vxlan_fdb *f)
+static int vxlan_fdb_insert(struct vxlan_dev *vxlan, const u8 *mac,
+			    __be32 src_vni, struct vxlan_fdb *f)
 {
+	int rc;
+
+	rc = rhashtable_lookup_insert_fast(&vxlan->fdb_hash_tbl, &f->rhnode,
+					   vxlan_fdb_rht_params);
+	if (rc)
+		return rc;
+
 	++vxlan->addrcnt;
 	hlist_add_head_rcu(&f->hlist,
 			   vxlan_fdb_head(vxlan, mac, src_vni));
+
+	return 0;
 }
 
 static int vxlan_fdb_nh_update(struct vxlan_dev *vxlan, struct vxlan_fdb *fdb,
@@ -961,11 +983,20 @@ static void vxlan_fdb_destroy(struct vxlan_dev *vxlan, struct vxlan_fdb *f,
 						 swdev_notify, NULL);
 	}
 
+	rhashtable_remove_fast(&vxlan->fdb_hash_tbl, &f->rhnode,
+			       vxlan_fdb_rht_params);
 	hlist_del_rcu(&f->hlist);
 	list_del_rcu(&f->nh_list);
 	call_rcu(&f->rcu, vxlan_fdb_free);
 }
 
+/* Release an entry from vxlan_fdb_create() that failed to be inserted */
+static void vxlan_fdb_discard(struct vxlan_fdb *f)
+{
+	list_del_rcu(&f->nh_list);
+	call_rcu(&f->rcu, vxlan_fdb_free);
+}
+
 static void vxlan_dst_free(struct rcu_head *head)
 {
 	struct vxlan_rdst *rd = container_of(head, struct vxlan_rdst, rcu);
@@ -1097,7 +1128,12 @@ static int vxlan_fdb_update_create(struct vxlan_dev *vxlan,
 	if (rc < 0)
 		return rc;
 
-	vxlan_fdb_insert(vxlan, mac, src_vni, f);
+	rc = vxlan_fdb_insert(vxlan, mac, src_vni, f);
+	if (rc) {
+		vxlan_fdb_discard(f);
+		return rc;
+	}
+
 	rc = vxlan_fdb_notify(vxlan, f, first_remote_rtnl(f), RTM_NEWNEIGH,
 			      swdev_notify, extack);
 	if (rc)
@@ -2911,13 +2947,19 @@ static int vxlan_init(struct net_device *dev)
 	if (err)
 		goto err_vnigroup_uninit;
 
-	err = vxlan_mdb_init(vxlan);
+	err = rhashtable_init(&vxlan->fdb_hash_tbl, &vxlan_fdb_rht_params);
 	if (err)
 		goto err_gro_cells_destroy;
 
+	err = vxlan_mdb_init(vxlan);
+	if (err)
+		goto err_fdb_hash_destroy;
+
 	netdev_lockdep_set_classes(dev);
 	return 0;
 
+err_fdb_hash_destroy:
+	rhashtable_destroy(&vxlan->fdb_hash_tbl);
 err_gro_cells_destroy:
 	gro_cells_destroy(&vxlan->gro_cells);
 err_vnigroup_uninit:
@@ -2950,6 +2992,7 @@ static void vxlan_uninit(struct net_device *dev)
 	gro_cells_destroy(&vxlan->gro_cells);
 
 	vxlan_fdb_delete_default(vxlan, vxlan->cfg.vni);
+	rhashtable_destroy(&vxlan->fdb_hash_tbl);
 }
 
 /* Start ageing timer and join group when device is brought up */
@@ -4005,7 +4048,13 @@ static int __vxlan_dev_create(struct net *net, struct net_device *dev,
 		goto unlink;
 
 	if (f) {
-		vxlan_fdb_insert(vxlan, all_zeros_mac, dst->remote_vni, f);
+		err = vxlan_fdb_insert(vxlan, all_zeros_mac, dst->remote_vni, f);
+		if (err) {
+			vxlan_fdb_discard(f);
+			if (remote_dev)
+				netdev_upper_dev_unlink(remote_dev, dev);
+			goto unregister;
+		}
 
 		/* notify default fdb entry */
 		err = vxlan_fdb_notify(vxlan, f, first_remote_rtnl(f),
@@ -24,9 +24,16 @@ struct vxlan_net {
 	struct notifier_block nexthop_notifier_block;
 };
 
+struct vxlan_fdb_key {
+	u8 eth_addr[ETH_ALEN];
+	__be32 vni;			/* only set in COLLECT_METADATA mode */
+};
+
 /* Forwarding table entry */
 struct vxlan_fdb {
 	struct hlist_node hlist;	/* linked list of entries */
+	struct rhash_head rhnode;	/* node in vxlan->fdb_hash_tbl */
+	struct vxlan_fdb_key key;
 	struct rcu_head	  rcu;
 	unsigned long	  updated;	/* jiffies */
 	unsigned long	  used;
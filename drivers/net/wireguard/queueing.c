@@ -4,8 +4,13 @@
  */
 
 #include "queueing.h"
+#include <linux/module.h>
 #include <linux/skb_array.h>
 
+bool wg_numa_local_crypt __read_mostly;
+module_param_named(numa_local_crypt, wg_numa_local_crypt, bool, 0644);
+MODULE_PARM_DESC(numa_local_crypt, "Keep crypt work on the node that queued it");
+
 struct multicore_worker __percpu *
 wg_packet_percpu_multicore_worker_alloc(work_func_t function, void *ptr)
 {
@@ -9,6 +9,7 @@
 #include "peer.h"
 #include <linux/types.h>
 #include <linux/skbuff.h>
+#include <linux/topology.h>
 #include <linux/ip.h>
 #include <linux/ipv6.h>
 #include <net/ip_tunnels.h>
@@ -121,12 +122,35 @@ static inline int wg_cpumask_choose_online(int *stored_cpu, unsigned int id)
  * unlocked, so it could return the same CPU twice. Adding locking or using
  * atomic sequence numbers is slower though, and the consequences of racing are
  * harmless, so live with it.
+ *
+ * With the numa_local_crypt module parameter set, the round robin is confined
+ * to the online CPUs of the enqueuing CPU's node, so that the skb, which was
+ * allocated there, is encrypted or decrypted by a worker that does not have to
+ * pull it across the interconnect. This caps a busy device at the CPUs of one
+ * node, so it is off by default. Nodes without online CPUs fall back to all
+ * online CPUs.
  */
+extern bool wg_numa_local_crypt;
+
 static inline int wg_cpumask_next_online(int *last_cpu)
 {
-	int cpu = cpumask_next(READ_ONCE(*last_cpu), cpu_online_mask);
+	const struct cpumask *node_mask;
+	int cpu;
+
+	if (READ_ONCE(wg_numa_local_crypt)) {
+		node_mask = cpumask_of_node(numa_node_id());
+		cpu = cpumask_next_and(READ_ONCE(*last_cpu), node_mask,
+				       cpu_online_mask);
+		if (cpu >= nr_cpu_ids)
+			cpu = cpumask_first_and(node_mask, cpu_online_mask);
+		if (cpu < nr_cpu_ids)
+			goto out;
+	}
+
+	cpu = cpumask_next(READ_ONCE(*last_cpu), cpu_online_mask);
 	if (cpu >= nr_cpu_ids)
 		cpu = cpumask_first(cpu_online_mask);
+out:
 	WRITE_ONCE(*last_cpu, cpu);
 	return cpu;
 }
@@ -123,7 +123,11 @@ struct xenvif_stats {
 	unsigned long tx_frag_overflow;
 };
 
-#define COPY_BATCH_SIZE 64
+/* Guest RX grant copies issued per GNTTABOP_copy hypercall. A GSO skb can
+ * use up to XEN_NETBK_LEGACY_SLOTS_MAX slots, so this is sized to cover a
+ * handful of them between flushes.
+ */
+#define COPY_BATCH_SIZE 128
 
 struct xenvif_copy_state {
 	struct gnttab_copy op[COPY_BATCH_SIZE];
@@ -18,6 +18,7 @@ static const char *nvme_iopolicy_names[] = {
 	[NVME_IOPOLICY_NUMA]	= "numa",
 	[NVME_IOPOLICY_RR]	= "round-robin",
 	[NVME_IOPOLICY_QD]      = "queue-depth",
+	[NVME_IOPOLICY_ST]	= "service-time",
 };
 
 static int iopolicy = NVME_IOPOLICY_NUMA;
@@ -32,6 +33,8 @@ static int nvme_set_iopolicy(const char *val, const struct kernel_param *kp)
 		iopolicy = NVME_IOPOLICY_RR;
 	else if (!strncmp(val, "queue-depth", 11))
 		iopolicy = NVME_IOPOLICY_QD;
+	else if (!strncmp(val, "service-time", 12))
+		iopolicy = NVME_IOPOLICY_ST;
 	else
 		return -EINVAL;
 
@@ -46,7 +49,7 @@ static int nvme_get_iopolicy(char *buf, const struct kernel_param *kp)
 module_param_call(iopolicy, nvme_set_iopolicy, nvme_get_iopolicy,
 	&iopolicy, 0644);
 MODULE_PARM_DESC(iopolicy,
-	"Default multipath I/O policy; 'numa' (default), 'round-robin' or 'queue-depth'");
+	"Default multipath I/O policy; 'numa' (default), 'round-robin', 'queue-depth' or 'service-time'");
 
 void nvme_mpath_default_iopolicy(struct nvme_subsystem *subsys)
 {
@@ -126,16 +129,42 @@ void nvme_failover_req(struct request *req)
 	kblockd_schedule_work(&ns->head->requeue_work);
 }
 
+/*
+ * The service-time policy keeps an EWMA of the completion latency per
+ * controller, weighting each new sample by 1/2^NVME_ST_EWMA_SHIFT.  An
+ * estimate halves for every NVME_ST_DECAY without samples so that a path
+ * that was slow once gets retried eventually.
+ */
+#define NVME_ST_EWMA_SHIFT	3
+#define NVME_ST_DECAY		(HZ / 10)
+
+static void nvme_mpath_update_service_time(struct nvme_ctrl *ctrl, u64 lat)
+{
+	u64 old = atomic64_read(&ctrl->service_time);
+
+	if (old)
+		lat = old - (old >> NVME_ST_EWMA_SHIFT) +
+			(lat >> NVME_ST_EWMA_SHIFT);
+	atomic64_set(&ctrl->service_time, lat);
+	WRITE_ONCE(ctrl->service_stamp, jiffies);
+}
+
 void nvme_mpath_start_request(struct request *rq)
 {
 	struct nvme_ns *ns = rq->q->queuedata;
 	struct gendisk *disk = ns->head->disk;
+	int policy = READ_ONCE(ns->head->subsys->iopolicy);
 
-	if (READ_ONCE(ns->head->subsys->iopolicy) == NVME_IOPOLICY_QD) {
+	if (policy == NVME_IOPOLICY_QD || policy == NVME_IOPOLICY_ST) {
 		atomic_inc(&ns->ctrl->nr_active);
 		nvme_req(rq)->flags |= NVME_MPATH_CNT_ACTIVE;
 	}
 
+	if (policy == NVME_IOPOLICY_ST && !blk_rq_is_passthrough(rq)) {
+		nvme_req(rq)->flags |= NVME_MPATH_CNT_LATENCY;
+		nvme_req(rq)->service_start = ktime_get_ns();
+	}
+
 	if (!blk_queue_io_stat(disk->queue) || blk_rq_is_passthrough(rq))
 		return;
 
@@ -152,6 +181,10 @@ void nvme_mpath_end_request(struct request *rq)
 	if (nvme_req(rq)->flags & NVME_MPATH_CNT_ACTIVE)
 		atomic_dec_if_positive(&ns->ctrl->nr_active);
 
+	if (nvme_req(rq)->flags & NVME_MPATH_CNT_LATENCY)
+		nvme_mpath_update_service_time(ns->ctrl,
+				ktime_get_ns() - nvme_req(rq)->service_start);
+
 	if (!(nvme_req(rq)->flags & NVME_MPATH_IO_STATS))
 		return;
 	bdev_end_io_acct(ns->head->disk->part0, req_op(rq),
@@ -391,6 +424,55 @@ static struct nvme_ns *nvme_queue_depth_path(struct nvme_ns_head *head)
 	return best_opt ? best_opt : best_nonopt;
 }
 
+static u64 nvme_service_time(struct nvme_ns *ns)
+{
+	struct nvme_ctrl *ctrl = ns->ctrl;
+	unsigned long idle = jiffies - READ_ONCE(ctrl->service_stamp);
+	u64 st = atomic64_read(&ctrl->service_time);
+
+	st >>= min_t(unsigned long, idle / NVME_ST_DECAY, 63);
+	/* estimated time for a new request to complete on this path */
+	return st * (atomic_read(&ctrl->nr_active) + 1);
+}
+
+static struct nvme_ns *nvme_service_time_path(struct nvme_ns_head *head)
+{
+	struct nvme_ns *best_opt = NULL, *best_nonopt = NULL, *ns;
+	u64 min_st_opt = U64_MAX, min_st_nonopt = U64_MAX;
+	u64 st;
+
+	list_for_each_entry_srcu(ns, &head->list, siblings,
+				 srcu_read_lock_held(&head->srcu)) {
+		if (nvme_path_is_disabled(ns))
+			continue;
+
+		st = nvme_service_time(ns);
+
+		switch (ns->ana_state) {
+		case NVME_ANA_OPTIMIZED:
+			if (st < min_st_opt) {
+				min_st_opt = st;
+				best_opt = ns;
+			}
+			break;
+		case NVME_ANA_NONOPTIMIZED:
+			if (st < min_st_nonopt) {
+				min_st_nonopt = st;
+				best_nonopt = ns;
+			}
+			break;
+		default:
+			break;
+		}
+
+		/* an idle or unmeasured path can't be beaten */
+		if (min_st_opt == 0)
+			return best_opt;
+	}
+
+	return best_opt ? best_opt : best_nonopt;
+}
+
 static inline bool nvme_path_is_optimized(struct nvme_ns *ns)
 {
 	return nvme_ctrl_state(ns->ctrl) == NVME_CTRL_LIVE &&
@@ -415,6 +497,8 @@ inline struct nvme_ns *nvme_find_path(struct nvme_ns_head *head)
 	switch (READ_ONCE(head->subsys->iopolicy)) {
 	case NVME_IOPOLICY_QD:
 		return nvme_queue_depth_path(head);
+	case NVME_IOPOLICY_ST:
+		return nvme_service_time_path(head);
 	case NVME_IOPOLICY_RR:
 		return nvme_round_robin_path(head);
 	default:
@@ -1045,6 +1129,7 @@ int nvme_mpath_init_identify(struct nvme_ctrl *ctrl, struct nvme_id_ctrl *id)
 
 	/* initialize this in the identify path to cover controller resets */
 	atomic_set(&ctrl->nr_active, 0);
+	atomic64_set(&ctrl->service_time, 0);
 
 	if (!ctrl->max_namespaces ||
 	    ctrl->max_namespaces > le32_to_cpu(id->nn)) {
@@ -193,6 +193,7 @@ struct nvme_request {
 	u16			status;
 #ifdef CONFIG_NVME_MULTIPATH
 	unsigned long		start_time;
+	u64			service_start;
 #endif
 	struct nvme_ctrl	*ctrl;
 };
@@ -207,6 +208,7 @@ enum {
 	NVME_REQ_USERCMD		= (1 << 1),
 	NVME_MPATH_IO_STATS		= (1 << 2),
 	NVME_MPATH_CNT_ACTIVE		= (1 << 3),
+	NVME_MPATH_CNT_LATENCY		= (1 << 4),
 };
 
 static inline struct nvme_request *nvme_req(struct request *req)
@@ -372,6 +374,8 @@ struct nvme_ctrl {
 	struct timer_list anatt_timer;
 	struct work_struct ana_work;
 	atomic_t nr_active;
+	atomic64_t service_time;	/* EWMA of completion latency in ns */
+	unsigned long service_stamp;	/* jiffies of the last sample */
 #endif
 
 #ifdef CONFIG_NVME_HOST_AUTH
@@ -421,6 +425,7 @@ enum nvme_iopolicy {
 	NVME_IOPOLICY_NUMA,
 	NVME_IOPOLICY_RR,
 	NVME_IOPOLICY_QD,
+	NVME_IOPOLICY_ST,
 };
 
 struct nvme_subsystem {
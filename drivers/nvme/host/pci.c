@@ -10,11 +10,13 @@
 #include <linux/blk-mq.h>
 #include <linux/blk-mq-pci.h>
 #include <linux/blk-integrity.h>
+#include <linux/delay.h>
 #include <linux/dmi.h>
 #include <linux/init.h>
 #include <linux/interrupt.h>
 #include <linux/io.h>
 #include <linux/kstrtox.h>
+#include <linux/kthread.h>
 #include <linux/memremap.h>
 #include <linux/mm.h>
 #include <linux/module.h>
@@ -106,6 +108,16 @@ static bool noacpi;
 module_param(noacpi, bool, 0444);
 MODULE_PARM_DESC(noacpi, "disable acpi bios quirks");
 
+static bool kpoll;
+module_param(kpoll, bool, 0644);
+MODULE_PARM_DESC(kpoll,
+	"Reap non-polled I/O queues from per-node kernel threads instead of interrupts");
+
+static unsigned int kpoll_max_sleep_us = 50;
+module_param(kpoll_max_sleep_us, uint, 0644);
+MODULE_PARM_DESC(kpoll_max_sleep_us,
+	"Maximum time a kpoll thread sleeps when it finds no completions");
+
 struct nvme_dev;
 struct nvme_queue;
 
@@ -163,6 +175,8 @@ struct nvme_dev {
 	unsigned int nr_allocated_queues;
 	unsigned int nr_write_queues;
 	unsigned int nr_poll_queues;
+	bool kpoll;
+	int kpoll_node;
 };
 
 static int io_queue_depth_set(const char *val, const struct kernel_param *kp)
@@ -213,6 +227,8 @@ struct nvme_queue {
 #define NVMEQ_SQ_CMB		1
 #define NVMEQ_DELETE_ERROR	2
 #define NVMEQ_POLLED		3
+#define NVMEQ_KPOLL		4
+	struct list_head kpoll_entry;	/* on nvme_kpoller.queues */
 	__le32 *dbbuf_sq_db;
 	__le32 *dbbuf_cq_db;
 	__le32 *dbbuf_sq_ei;
@@ -1221,6 +1237,144 @@ static int nvme_poll(struct blk_mq_hw_ctx *hctx, struct io_comp_batch *iob)
 	return found;
 }
 
+/*
+ * With the kpoll parameter set, the I/O queues that would otherwise take
+ * interrupts are created without them and reaped by one kernel thread per
+ * NUMA node, which backs off exponentially up to kpoll_max_sleep_us while
+ * it finds nothing.
+ */
+struct nvme_kpoller {
+	spinlock_t		lock;
+	struct list_head	queues;		/* RCU protected */
+	wait_queue_head_t	wait;
+	struct task_struct	*task;
+};
+
+static struct nvme_kpoller *nvme_kpollers;
+static DEFINE_MUTEX(nvme_kpoll_mutex);
+
+static int nvme_kpoll_queue(struct nvme_queue *nvmeq)
+{
+	DEFINE_IO_COMP_BATCH(iob);
+	int found;
+
+	if (!test_bit(NVMEQ_ENABLED, &nvmeq->flags) ||
+	    !nvme_cqe_pending(nvmeq))
+		return 0;
+
+	spin_lock(&nvmeq->cq_poll_lock);
+	found = nvme_poll_cq(nvmeq, &iob);
+	spin_unlock(&nvmeq->cq_poll_lock);
+
+	if (!rq_list_empty(&iob.req_list))
+		nvme_pci_complete_batch(&iob);
+	return found;
+}
+
+static int nvme_kpoll_thread(void *data)
+{
+	struct nvme_kpoller *kp = data;
+	unsigned int sleep_us = 0;
+
+	while (!kthread_should_stop()) {
+		struct nvme_queue *nvmeq;
+		int found = 0;
+
+		wait_event_idle(kp->wait, !list_empty(&kp->queues) ||
+				kthread_should_stop());
+
+		rcu_read_lock();
+		list_for_each_entry_rcu(nvmeq, &kp->queues, kpoll_entry)
+			found += nvme_kpoll_queue(nvmeq);
+		rcu_read_unlock();
+
+		if (found) {
+			sleep_us = 0;
+			cond_resched();
+			continue;
+		}
+
+		sleep_us = clamp(sleep_us * 2, 1U,
+				 max(READ_ONCE(kpoll_max_sleep_us), 1U));
+		usleep_range_idle(sleep_us, sleep_us * 2);
+	}
+	return 0;
+}
+
+/* Start the poller of @node unless it already runs */
+static int nvme_kpoll_start(int node)
+{
+	struct nvme_kpoller *kp = &nvme_kpollers[node];
+	struct task_struct *task;
+	int ret = 0;
+
+	mutex_lock(&nvme_kpoll_mutex);
+	if (kp->task)
+		goto out_unlock;
+
+	task = kthread_create_on_node(nvme_kpoll_thread, kp, node,
+				      "nvme_kpoll/%d", node);
+	if (IS_ERR(task)) {
+		ret = PTR_ERR(task);
+		goto out_unlock;
+	}
+	set_cpus_allowed_ptr(task, cpumask_of_node(node));
+	kp->task = task;
+	wake_up_process(task);
+out_unlock:
+	mutex_unlock(&nvme_kpoll_mutex);
+	return ret;
+}
+
+static void nvme_kpoll_add(struct nvme_queue *nvmeq)
+{
+	struct nvme_kpoller *kp = &nvme_kpollers[nvmeq->dev->kpoll_node];
+
+	set_bit(NVMEQ_KPOLL, &nvmeq->flags);
+	spin_lock(&kp->lock);
+	list_add_tail_rcu(&nvmeq->kpoll_entry, &kp->queues);
+	spin_unlock(&kp->lock);
+	wake_up(&kp->wait);
+}
+
+/* The caller has to wait for an RCU grace period before freeing @nvmeq */
+static void nvme_kpoll_del(struct nvme_queue *nvmeq)
+{
+	struct nvme_kpoller *kp = &nvme_kpollers[nvmeq->dev->kpoll_node];
+
+	spin_lock(&kp->lock);
+	list_del_rcu(&nvmeq->kpoll_entry);
+	spin_unlock(&kp->lock);
+}
+
+static int __init nvme_kpoll_init(void)
+{
+	int node;
+
+	nvme_kpollers = kcalloc(nr_node_ids, sizeof(*nvme_kpollers),
+				GFP_KERNEL);
+	if (!nvme_kpollers)
+		return -ENOMEM;
+
+	for (node = 0; node < nr_node_ids; node++) {
+		spin_lock_init(&nvme_kpollers[node].lock);
+		INIT_LIST_HEAD(&nvme_kpollers[node].queues);
+		init_waitqueue_head(&nvme_kpollers[node].wait);
+	}
+	return 0;
+}
+
+static void nvme_kpoll_exit(void)
+{
+	int node;
+
+	for (node = 0; node < nr_node_ids; node++) {
+		if (nvme_kpollers[node].task)
+			kthread_stop(nvme_kpollers[node].task);
+	}
+	kfree(nvme_kpollers);
+}
+
 static void nvme_pci_submit_async_event(struct nvme_ctrl *ctrl)
 {
 	struct nvme_dev *dev = to_nvme_dev(ctrl);
@@ -1573,6 +1727,8 @@ static void nvme_suspend_queue(struct nvme_dev *dev, unsigned int qid)
 	nvmeq->dev->online_queues--;
 	if (!nvmeq->qid && nvmeq->dev->ctrl.admin_q)
 		nvme_quiesce_admin_queue(&nvmeq->dev->ctrl);
+	if (test_and_clear_bit(NVMEQ_KPOLL, &nvmeq->flags))
+		nvme_kpoll_del(nvmeq);
 	if (!test_and_clear_bit(NVMEQ_POLLED, &nvmeq->flags))
 		pci_free_irq(to_pci_dev(dev->dev), nvmeq->cq_vector, nvmeq);
 }
@@ -1583,6 +1739,10 @@ static void nvme_suspend_io_queues(struct nvme_dev *dev)
 
 	for (i = dev->ctrl.queue_count - 1; i > 0; i--)
 		nvme_suspend_queue(dev, i);
+
+	/* wait for the kpoll threads to let go of the queues */
+	if (dev->kpoll)
+		synchronize_rcu();
 }
 
 /*
@@ -1931,9 +2091,11 @@ static int nvme_create_io_queues(struct nvme_dev *dev)
 	for (i = dev->online_queues; i <= max; i++) {
 		bool polled = i > rw_queues;
 
-		ret = nvme_create_queue(&dev->queues[i], i, polled);
+		ret = nvme_create_queue(&dev->queues[i], i, polled || dev->kpoll);
 		if (ret)
 			break;
+		if (!polled && dev->kpoll)
+			nvme_kpoll_add(&dev->queues[i]);
 	}
 
 	/*
@@ -2418,6 +2580,13 @@ static int nvme_setup_irqs(struct nvme_dev *dev, unsigned int nr_io_queues)
 	dev->io_queues[HCTX_TYPE_DEFAULT] = 1;
 	dev->io_queues[HCTX_TYPE_READ] = 0;
 
+	/* Only the admin queue takes interrupts, the kpoll threads do the rest */
+	if (dev->kpoll) {
+		dev->io_queues[HCTX_TYPE_DEFAULT] = nr_io_queues - poll_queues;
+		return pci_alloc_irq_vectors(pdev, 1, 1,
+					     flags & ~PCI_IRQ_AFFINITY);
+	}
+
 	/*
 	 * We need interrupts for the admin queue and each non-polled I/O queue,
 	 * but some Apple controllers require all queues to use the first
@@ -2457,6 +2626,17 @@ static int nvme_setup_io_queues(struct nvme_dev *dev)
 	 */
 	dev->nr_write_queues = write_queues;
 	dev->nr_poll_queues = poll_queues;
+	dev->kpoll = READ_ONCE(kpoll);
+	if (dev->kpoll) {
+		dev->kpoll_node = dev_to_node(dev->dev);
+		if (dev->kpoll_node == NUMA_NO_NODE)
+			dev->kpoll_node = first_online_node;
+		if (nvme_kpoll_start(dev->kpoll_node)) {
+			dev_warn(dev->ctrl.device,
+				 "failed to start kpoll thread, using interrupts\n");
+			dev->kpoll = false;
+		}
+	}
 
 	nr_io_queues = dev->nr_allocated_queues - 1;
 	result = nvme_set_queue_count(&dev->ctrl, &nr_io_queues);
@@ -2520,7 +2700,10 @@ static int nvme_setup_io_queues(struct nvme_dev *dev)
 	}
 
 	dev->num_vecs = result;
-	result = max(result - 1, 1);
+	if (dev->kpoll)
+		result = dev->io_queues[HCTX_TYPE_DEFAULT];
+	else
+		result = max(result - 1, 1);
 	dev->max_qid = result + dev->io_queues[HCTX_TYPE_POLL];
 
 	/*
@@ -3783,6 +3966,8 @@ static struct pci_driver nvme_driver = {
 
 static int __init nvme_init(void)
 {
+	int ret;
+
 	BUILD_BUG_ON(sizeof(struct nvme_create_cq) != 64);
 	BUILD_BUG_ON(sizeof(struct nvme_create_sq) != 64);
 	BUILD_BUG_ON(sizeof(struct nvme_delete_queue) != 64);
@@ -3791,13 +3976,21 @@ static int __init nvme_init(void)
 	BUILD_BUG_ON(sizeof(struct scatterlist) * NVME_MAX_SEGS > PAGE_SIZE);
 	BUILD_BUG_ON(nvme_pci_npages_prp() > NVME_MAX_NR_ALLOCATIONS);
 
-	return pci_register_driver(&nvme_driver);
+	ret = nvme_kpoll_init();
+	if (ret)
+		return ret;
+
+	ret = pci_register_driver(&nvme_driver);
+	if (ret)
+		nvme_kpoll_exit();
+	return ret;
 }
 
 static void __exit nvme_exit(void)
 {
 	pci_unregister_driver(&nvme_driver);
 	flush_workqueue(nvme_wq);
+	nvme_kpoll_exit();
 }
 
 MODULE_AUTHOR("Matthew Wilcox <willy@linux.intel.com>");
@@ -44,6 +44,23 @@ static bool wq_unbound;
 module_param(wq_unbound, bool, 0644);
 MODULE_PARM_DESC(wq_unbound, "Use unbound workqueue for nvme-tcp IO context (default false)");
 
+/*
+ * Process received PDUs directly from the socket's data_ready callback in
+ * softirq context instead of bouncing them to io_work.  Not used for TLS
+ * queues, whose read_sock may sleep.
+ */
+static bool softirq_rx;
+module_param(softirq_rx, bool, 0644);
+MODULE_PARM_DESC(softirq_rx, "Receive PDUs in softirq context (default false)");
+
+/*
+ * Send requests from queue_rq on any CPU while the socket is writable,
+ * instead of only on io_cpu.
+ */
+static bool inline_tx;
+module_param(inline_tx, bool, 0644);
+MODULE_PARM_DESC(inline_tx, "Send requests inline from queue_rq on any CPU (default false)");
+
 /*
  * TLS handshake timeout
  */
@@ -399,9 +416,12 @@ static inline void nvme_tcp_queue_request(struct nvme_tcp_request *req,
 	/*
 	 * if we're the first on the send_list and we can try to send
 	 * directly, otherwise queue io_work. Also, only do that if we
-	 * are on the same cpu, so we don't introduce contention.
+	 * are on the same cpu, so we don't introduce contention, unless
+	 * inline_tx asks to send whenever the socket has room.
 	 */
-	if (queue->io_cpu == raw_smp_processor_id() &&
+	if ((queue->io_cpu == raw_smp_processor_id() ||
+	     (READ_ONCE(inline_tx) &&
+	      sk_stream_is_writeable(queue->sock->sk))) &&
 	    sync && empty && mutex_trylock(&queue->send_mutex)) {
 		nvme_tcp_send_all(queue);
 		mutex_unlock(&queue->send_mutex);
@@ -970,6 +990,22 @@ static int nvme_tcp_recv_skb(read_descriptor_t *desc, struct sk_buff *skb,
 	return consumed;
 }
 
+/*
+ * Called from data_ready, which runs either in softirq with the socket
+ * spinlock held and the socket not owned by a user, or from
+ * release_sock() by the owner.  Either way receive is serialized against
+ * nvme_tcp_try_recv().
+ */
+static void nvme_tcp_recv_direct(struct nvme_tcp_queue *queue)
+{
+	struct socket *sock = queue->sock;
+	read_descriptor_t rd_desc;
+
+	rd_desc.arg.data = queue;
+	rd_desc.count = 1;
+	sock->ops->read_sock(sock->sk, &rd_desc, nvme_tcp_recv_skb);
+}
+
 static void nvme_tcp_data_ready(struct sock *sk)
 {
 	struct nvme_tcp_queue *queue;
@@ -979,8 +1015,13 @@ static void nvme_tcp_data_ready(struct sock *sk)
 	read_lock_bh(&sk->sk_callback_lock);
 	queue = sk->sk_user_data;
 	if (likely(queue && queue->rd_enabled) &&
-	    !test_bit(NVME_TCP_Q_POLLING, &queue->flags))
-		queue_work_on(queue->io_cpu, nvme_tcp_wq, &queue->io_work);
+	    !test_bit(NVME_TCP_Q_POLLING, &queue->flags)) {
+		if (READ_ONCE(softirq_rx) && !nvme_tcp_queue_tls(queue))
+			nvme_tcp_recv_direct(queue);
+		else
+			queue_work_on(queue->io_cpu, nvme_tcp_wq,
+				      &queue->io_work);
+	}
 	read_unlock_bh(&sk->sk_callback_lock);
 }
 
@@ -743,6 +743,36 @@ static ssize_t nvmet_ns_buffered_io_store(struct config_item *item,
 
 CONFIGFS_ATTR(nvmet_ns_, buffered_io);
 
+#ifdef CONFIG_NVME_TARGET_CACHE
+static ssize_t nvmet_ns_cache_size_show(struct config_item *item, char *page)
+{
+	return sprintf(page, "%llu\n", to_nvmet_ns(item)->cache_size);
+}
+
+static ssize_t nvmet_ns_cache_size_store(struct config_item *item,
+		const char *page, size_t count)
+{
+	struct nvmet_ns *ns = to_nvmet_ns(item);
+	u64 val;
+
+	if (kstrtou64(page, 0, &val))
+		return -EINVAL;
+
+	mutex_lock(&ns->subsys->lock);
+	if (ns->enabled) {
+		pr_err("disable ns before setting cache_size value.\n");
+		mutex_unlock(&ns->subsys->lock);
+		return -EINVAL;
+	}
+
+	ns->cache_size = val;
+	mutex_unlock(&ns->subsys->lock);
+	return count;
+}
+
+CONFIGFS_ATTR(nvmet_ns_, cache_size);
+#endif /* CONFIG_NVME_TARGET_CACHE */
+
 static ssize_t nvmet_ns_revalidate_size_store(struct config_item *item,
 		const char *page, size_t count)
 {
@@ -804,6 +834,9 @@ static struct configfs_attribute *nvmet_ns_attrs[] = {
 	&nvmet_ns_attr_buffered_io,
 	&nvmet_ns_attr_revalidate_size,
 	&nvmet_ns_attr_resv_enable,
+#ifdef CONFIG_NVME_TARGET_CACHE
+	&nvmet_ns_attr_cache_size,
+#endif
 #ifdef CONFIG_PCI_P2PDMA
 	&nvmet_ns_attr_p2pmem,
 #endif
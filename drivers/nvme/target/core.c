@@ -469,6 +469,7 @@ void nvmet_put_namespace(struct nvmet_ns *ns)
 
 static void nvmet_ns_dev_disable(struct nvmet_ns *ns)
 {
+	nvmet_cache_ns_disable(ns);
 	nvmet_bdev_ns_disable(ns);
 	nvmet_file_ns_disable(ns);
 }
@@ -597,6 +598,10 @@ int nvmet_ns_enable(struct nvmet_ns *ns)
 	if (ret)
 		goto out_dev_disable;
 
+	ret = nvmet_cache_ns_enable(ns);
+	if (ret)
+		goto out_dev_disable;
+
 	list_for_each_entry(ctrl, &subsys->ctrls, subsys_entry)
 		nvmet_p2pmem_ns_add_p2p(ctrl, ns);
 
@@ -970,7 +975,9 @@ static u16 nvmet_parse_io_cmd(struct nvmet_req *req)
 
 	switch (req->ns->csi) {
 	case NVME_CSI_NVM:
-		if (req->ns->file)
+		if (req->ns->cache)
+			ret = nvmet_cache_parse_io_cmd(req);
+		else if (req->ns->file)
 			ret = nvmet_file_parse_io_cmd(req);
 		else
 			ret = nvmet_bdev_parse_io_cmd(req);
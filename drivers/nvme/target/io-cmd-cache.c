@@ -0,0 +1,506 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * NVMe in-memory write-back cache in front of the bdev and file backends.
+ *
+ * Writes are copied into logical block sized buffers indexed by LBA and
+ * completed right away.  Reads which are fully cached are served from
+ * memory, everything else goes to the backend once the dirty blocks it
+ * overlaps have been written back.  Dirty blocks are written back in LBA
+ * order by a background work, on flush and when clean blocks have to be
+ * reclaimed.  FUA and large writes bypass the cache.
+ */
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+#include <linux/blkdev.h>
+#include <linux/bvec.h>
+#include <linux/fs.h>
+#include <linux/uio.h>
+#include "nvmet.h"
+
+#define NVMET_CACHE_DIRTY		XA_MARK_0
+#define NVMET_CACHE_WB_BATCH		BIO_MAX_VECS
+#define NVMET_CACHE_WB_INTERVAL		(5 * HZ)
+
+/**
+ * struct nvmet_cache - write-back cache of a namespace
+ * @ns:		the cached namespace
+ * @blocks:	cached logical blocks, dirty ones are marked %NVMET_CACHE_DIRTY
+ * @lock:	protects @blocks, the block contents and the counters
+ * @wb_mutex:	serializes writeback and the removal of blocks
+ * @wb_work:	background writeback
+ * @wb_bvec:	bvecs of the block run under writeback, protected by @wb_mutex
+ * @nr_blocks:	number of cached blocks
+ * @nr_dirty:	number of dirty blocks
+ * @capacity:	soft limit of @nr_blocks
+ * @reclaim_idx: next index clean blocks are reclaimed from
+ */
+struct nvmet_cache {
+	struct nvmet_ns		*ns;
+	struct xarray		blocks;
+	struct mutex		lock;
+	struct mutex		wb_mutex;
+	struct delayed_work	wb_work;
+	struct bio_vec		*wb_bvec;
+	unsigned long		nr_blocks;
+	unsigned long		nr_dirty;
+	unsigned long		capacity;
+	unsigned long		reclaim_idx;
+};
+
+static int nvmet_cache_backend_write(struct nvmet_ns *ns, loff_t pos,
+		struct bio_vec *bv, unsigned int nr, size_t len)
+{
+	struct iov_iter iter;
+	struct bio *bio;
+	ssize_t ret;
+	int i;
+
+	if (ns->file) {
+		iov_iter_bvec(&iter, ITER_SOURCE, bv, nr, len);
+		ret = vfs_iter_write(ns->file, &iter, &pos, 0);
+		if (ret < 0)
+			return ret;
+		return ret == len ? 0 : -EIO;
+	}
+
+	bio = bio_alloc(ns->bdev, nr, REQ_OP_WRITE | REQ_SYNC, GFP_KERNEL);
+	bio->bi_iter.bi_sector = pos >> SECTOR_SHIFT;
+	for (i = 0; i < nr; i++)
+		__bio_add_page(bio, bv[i].bv_page, bv[i].bv_len,
+			       bv[i].bv_offset);
+	ret = submit_bio_wait(bio);
+	bio_put(bio);
+	return ret;
+}
+
+/*
+ * Write back the dirty blocks between @first and @last, called with
+ * @wb_mutex held so none of the blocks can go away while they are written.
+ * Blocks redirtied while under writeback are simply marked dirty again.
+ */
+static int __nvmet_cache_writeback(struct nvmet_cache *cache,
+		unsigned long first, unsigned long last)
+{
+	struct nvmet_ns *ns = cache->ns;
+	size_t bsize = 1UL << ns->blksize_shift;
+	unsigned long idx = first;
+	unsigned int nr, i;
+	void *buf;
+	int ret;
+
+	lockdep_assert_held(&cache->wb_mutex);
+
+	for (;;) {
+		mutex_lock(&cache->lock);
+		buf = xa_find(&cache->blocks, &idx, last, NVMET_CACHE_DIRTY);
+		if (!buf) {
+			mutex_unlock(&cache->lock);
+			return 0;
+		}
+
+		nr = 0;
+		do {
+			xa_clear_mark(&cache->blocks, idx + nr,
+				      NVMET_CACHE_DIRTY);
+			bvec_set_virt(&cache->wb_bvec[nr++], buf, bsize);
+			if (nr == NVMET_CACHE_WB_BATCH || idx + nr - 1 == last ||
+			    !xa_get_mark(&cache->blocks, idx + nr,
+					 NVMET_CACHE_DIRTY))
+				break;
+			buf = xa_load(&cache->blocks, idx + nr);
+		} while (buf);
+		cache->nr_dirty -= nr;
+		mutex_unlock(&cache->lock);
+
+		ret = nvmet_cache_backend_write(ns,
+				(loff_t)idx << ns->blksize_shift,
+				cache->wb_bvec, nr, nr * bsize);
+		if (ret) {
+			mutex_lock(&cache->lock);
+			for (i = 0; i < nr; i++) {
+				if (xa_get_mark(&cache->blocks, idx + i,
+						NVMET_CACHE_DIRTY))
+					continue;
+				xa_set_mark(&cache->blocks, idx + i,
+					    NVMET_CACHE_DIRTY);
+				cache->nr_dirty++;
+			}
+			mutex_unlock(&cache->lock);
+			return ret;
+		}
+
+		idx += nr;
+		if (!idx || idx - 1 == last)
+			return 0;
+	}
+}
+
+static int nvmet_cache_writeback(struct nvmet_cache *cache,
+		unsigned long first, unsigned long last)
+{
+	int ret;
+
+	mutex_lock(&cache->wb_mutex);
+	ret = __nvmet_cache_writeback(cache, first, last);
+	mutex_unlock(&cache->wb_mutex);
+	return ret;
+}
+
+static void nvmet_cache_wb_work(struct work_struct *w)
+{
+	struct nvmet_cache *cache =
+		container_of(to_delayed_work(w), struct nvmet_cache, wb_work);
+	int ret;
+
+	ret = nvmet_cache_writeback(cache, 0, ULONG_MAX);
+	if (ret) {
+		pr_warn_ratelimited("nsid %u: cache writeback failed (%d)\n",
+				    cache->ns->nsid, ret);
+		queue_delayed_work(nvmet_wq, &cache->wb_work,
+				   NVMET_CACHE_WB_INTERVAL);
+	}
+}
+
+/* Drop the cached blocks between @first and @last, dirty or not */
+static void nvmet_cache_invalidate(struct nvmet_cache *cache,
+		unsigned long first, unsigned long last)
+{
+	unsigned long idx;
+	void *buf;
+
+	mutex_lock(&cache->wb_mutex);
+	mutex_lock(&cache->lock);
+	xa_for_each_range(&cache->blocks, idx, buf, first, last) {
+		if (xa_get_mark(&cache->blocks, idx, NVMET_CACHE_DIRTY))
+			cache->nr_dirty--;
+		xa_erase(&cache->blocks, idx);
+		cache->nr_blocks--;
+		kfree(buf);
+	}
+	mutex_unlock(&cache->lock);
+	mutex_unlock(&cache->wb_mutex);
+}
+
+/* Free up to @nr clean blocks, round robin over the LBA space */
+static unsigned long nvmet_cache_evict(struct nvmet_cache *cache,
+		unsigned long nr)
+{
+	unsigned long idx, freed = 0;
+	bool wrapped = false;
+	void *buf;
+
+	mutex_lock(&cache->lock);
+	idx = cache->reclaim_idx;
+	while (freed < nr && cache->nr_blocks > cache->nr_dirty) {
+		buf = xa_find(&cache->blocks, &idx, ULONG_MAX, XA_PRESENT);
+		if (!buf) {
+			if (wrapped)
+				break;
+			wrapped = true;
+			idx = 0;
+			continue;
+		}
+		if (!xa_get_mark(&cache->blocks, idx, NVMET_CACHE_DIRTY)) {
+			xa_erase(&cache->blocks, idx);
+			cache->nr_blocks--;
+			kfree(buf);
+			freed++;
+		}
+		if (++idx == 0)
+			wrapped = true;
+	}
+	cache->reclaim_idx = idx;
+	mutex_unlock(&cache->lock);
+	return freed;
+}
+
+/*
+ * Make room for @nr new blocks.  The capacity is a soft limit, concurrent
+ * writers may overshoot it by the size of their requests.
+ */
+static int nvmet_cache_reserve(struct nvmet_cache *cache, unsigned long nr)
+{
+	unsigned long want;
+	int ret = 0;
+
+	if (READ_ONCE(cache->nr_blocks) + nr <= cache->capacity)
+		return 0;
+
+	mutex_lock(&cache->wb_mutex);
+	/* Reclaim an extra 1/8 of the cache to not do this for every write */
+	want = nr + cache->capacity / 8;
+	want -= nvmet_cache_evict(cache, want);
+	if (want) {
+		ret = __nvmet_cache_writeback(cache, 0, ULONG_MAX);
+		if (!ret)
+			nvmet_cache_evict(cache, want);
+	}
+	mutex_unlock(&cache->wb_mutex);
+	return ret;
+}
+
+/* Hand the command to the backend the namespace was enabled with */
+static void nvmet_cache_submit_backend(struct nvmet_req *req)
+{
+	u16 status;
+
+	if (req->ns->file)
+		status = nvmet_file_parse_io_cmd(req);
+	else
+		status = nvmet_bdev_parse_io_cmd(req);
+	if (status) {
+		nvmet_req_complete(req, status);
+		return;
+	}
+	req->execute(req);
+}
+
+static u16 nvmet_cache_check_range(struct nvmet_req *req, u64 slba, u32 nlb)
+{
+	struct nvmet_ns *ns = req->ns;
+
+	if (slba + nlb > (ns->size >> ns->blksize_shift)) {
+		req->error_slba = slba;
+		req->error_loc = offsetof(struct nvme_rw_command, slba);
+		return NVME_SC_LBA_RANGE | NVME_STATUS_DNR;
+	}
+	return NVME_SC_SUCCESS;
+}
+
+static void nvmet_cache_execute_read(struct nvmet_req *req)
+{
+	struct nvmet_cache *cache = req->ns->cache;
+	u64 slba = le64_to_cpu(req->cmd->rw.slba);
+	u32 nlb = le16_to_cpu(req->cmd->rw.length) + 1;
+	size_t bsize = 1UL << req->ns->blksize_shift;
+	unsigned long last = slba + nlb - 1;
+	u16 status;
+	u32 i;
+
+	if (!nvmet_check_transfer_len(req, nvmet_rw_data_len(req)))
+		return;
+
+	status = nvmet_cache_check_range(req, slba, nlb);
+	if (status)
+		goto out;
+
+	mutex_lock(&cache->lock);
+	for (i = 0; i < nlb; i++) {
+		if (!xa_load(&cache->blocks, slba + i))
+			break;
+	}
+	if (i < nlb) {
+		unsigned long idx = slba;
+		bool dirty = xa_find(&cache->blocks, &idx, last,
+				     NVMET_CACHE_DIRTY);
+
+		mutex_unlock(&cache->lock);
+		if (dirty) {
+			status = errno_to_nvme_status(req,
+				nvmet_cache_writeback(cache, slba, last));
+			if (status)
+				goto out;
+		}
+		nvmet_cache_submit_backend(req);
+		return;
+	}
+
+	for (i = 0; i < nlb && !status; i++)
+		status = nvmet_copy_to_sgl(req, i * bsize,
+				xa_load(&cache->blocks, slba + i), bsize);
+	mutex_unlock(&cache->lock);
+out:
+	nvmet_req_complete(req, status);
+}
+
+static void nvmet_cache_execute_write(struct nvmet_req *req)
+{
+	struct nvmet_cache *cache = req->ns->cache;
+	u64 slba = le64_to_cpu(req->cmd->rw.slba);
+	u32 nlb = le16_to_cpu(req->cmd->rw.length) + 1;
+	size_t bsize = 1UL << req->ns->blksize_shift;
+	u16 status;
+	void *buf;
+	u32 i;
+
+	if (!nvmet_check_transfer_len(req, nvmet_rw_data_len(req)))
+		return;
+
+	status = nvmet_cache_check_range(req, slba, nlb);
+	if (status)
+		goto out;
+
+	if ((req->cmd->rw.control & cpu_to_le16(NVME_RW_FUA)) ||
+	    nlb > cache->capacity / 4) {
+		nvmet_cache_invalidate(cache, slba, slba + nlb - 1);
+		nvmet_cache_submit_backend(req);
+		return;
+	}
+
+	status = errno_to_nvme_status(req, nvmet_cache_reserve(cache, nlb));
+	if (status)
+		goto out;
+
+	mutex_lock(&cache->lock);
+	for (i = 0; i < nlb; i++) {
+		buf = xa_load(&cache->blocks, slba + i);
+		if (!buf) {
+			buf = kmalloc(bsize, GFP_KERNEL);
+			if (!buf ||
+			    xa_err(xa_store(&cache->blocks, slba + i, buf,
+					    GFP_KERNEL))) {
+				kfree(buf);
+				status = NVME_SC_INTERNAL;
+				break;
+			}
+			cache->nr_blocks++;
+		}
+
+		status = nvmet_copy_from_sgl(req, i * bsize, buf, bsize);
+		if (status)
+			break;
+
+		if (!xa_get_mark(&cache->blocks, slba + i, NVMET_CACHE_DIRTY)) {
+			xa_set_mark(&cache->blocks, slba + i,
+				    NVMET_CACHE_DIRTY);
+			cache->nr_dirty++;
+		}
+	}
+
+	/* Start writing back early once half of the cache is dirty */
+	if (cache->nr_dirty > cache->capacity / 2)
+		mod_delayed_work(nvmet_wq, &cache->wb_work, 0);
+	else
+		queue_delayed_work(nvmet_wq, &cache->wb_work,
+				   NVMET_CACHE_WB_INTERVAL);
+	mutex_unlock(&cache->lock);
+out:
+	nvmet_req_complete(req, status);
+}
+
+static void nvmet_cache_execute_flush(struct nvmet_req *req)
+{
+	u16 status;
+
+	if (!nvmet_check_transfer_len(req, 0))
+		return;
+
+	status = errno_to_nvme_status(req,
+			nvmet_cache_writeback(req->ns->cache, 0, ULONG_MAX));
+	if (!status) {
+		if (req->ns->file)
+			status = nvmet_file_flush(req);
+		else
+			status = nvmet_bdev_flush(req);
+	}
+	nvmet_req_complete(req, status);
+}
+
+static void nvmet_cache_execute_dsm(struct nvmet_req *req)
+{
+	struct nvmet_cache *cache = req->ns->cache;
+	struct nvme_dsm_range range;
+	u64 slba;
+	int i;
+
+	if (le32_to_cpu(req->cmd->dsm.attributes) == NVME_DSMGMT_AD) {
+		for (i = 0; i <= le32_to_cpu(req->cmd->dsm.nr); i++) {
+			if (nvmet_copy_from_sgl(req, i * sizeof(range), &range,
+						sizeof(range)))
+				break;
+			slba = le64_to_cpu(range.slba);
+			if (range.nlb)
+				nvmet_cache_invalidate(cache, slba,
+					slba + le32_to_cpu(range.nlb) - 1);
+		}
+	}
+	nvmet_cache_submit_backend(req);
+}
+
+static void nvmet_cache_execute_write_zeroes(struct nvmet_req *req)
+{
+	u64 slba = le64_to_cpu(req->cmd->write_zeroes.slba);
+
+	nvmet_cache_invalidate(req->ns->cache, slba,
+			slba + le16_to_cpu(req->cmd->write_zeroes.length));
+	nvmet_cache_submit_backend(req);
+}
+
+u16 nvmet_cache_parse_io_cmd(struct nvmet_req *req)
+{
+	switch (req->cmd->common.opcode) {
+	case nvme_cmd_read:
+		req->execute = nvmet_cache_execute_read;
+		return 0;
+	case nvme_cmd_write:
+		req->execute = nvmet_cache_execute_write;
+		return 0;
+	case nvme_cmd_flush:
+		req->execute = nvmet_cache_execute_flush;
+		return 0;
+	case nvme_cmd_dsm:
+		req->execute = nvmet_cache_execute_dsm;
+		return 0;
+	case nvme_cmd_write_zeroes:
+		req->execute = nvmet_cache_execute_write_zeroes;
+		return 0;
+	default:
+		return nvmet_report_invalid_opcode(req);
+	}
+}
+
+int nvmet_cache_ns_enable(struct nvmet_ns *ns)
+{
+	struct nvmet_cache *cache;
+
+	if (!ns->cache_size)
+		return 0;
+
+	if (ns->csi != NVME_CSI_NVM || nvmet_ns_has_pi(ns) || ns->use_p2pmem) {
+		pr_err("cache is not supported with ZNS, PI or p2pmem namespaces\n");
+		return -EINVAL;
+	}
+
+	cache = kzalloc(sizeof(*cache), GFP_KERNEL);
+	if (!cache)
+		return -ENOMEM;
+
+	cache->wb_bvec = kcalloc(NVMET_CACHE_WB_BATCH,
+				 sizeof(*cache->wb_bvec), GFP_KERNEL);
+	if (!cache->wb_bvec) {
+		kfree(cache);
+		return -ENOMEM;
+	}
+
+	cache->ns = ns;
+	cache->capacity = max(ns->cache_size >> ns->blksize_shift, 4ULL);
+	xa_init(&cache->blocks);
+	mutex_init(&cache->lock);
+	mutex_init(&cache->wb_mutex);
+	INIT_DELAYED_WORK(&cache->wb_work, nvmet_cache_wb_work);
+	ns->cache = cache;
+	return 0;
+}
+
+void nvmet_cache_ns_disable(struct nvmet_ns *ns)
+{
+	struct nvmet_cache *cache = ns->cache;
+	unsigned long idx;
+	void *buf;
+	int ret;
+
+	if (!cache)
+		return;
+
+	cancel_delayed_work_sync(&cache->wb_work);
+	ret = nvmet_cache_writeback(cache, 0, ULONG_MAX);
+	if (ret)
+		pr_err("nsid %u: failed to write back %lu cached blocks (%d)\n",
+		       ns->nsid, cache->nr_dirty, ret);
+
+	xa_for_each(&cache->blocks, idx, buf)
+		kfree(buf);
+	xa_destroy(&cache->blocks);
+	kfree(cache->wb_bvec);
+	kfree(cache);
+	ns->cache = NULL;
+}
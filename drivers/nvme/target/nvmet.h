@@ -128,6 +128,8 @@ struct nvmet_ns {
 	u8			csi;
 	struct nvmet_pr		pr;
 	struct xarray		pr_per_ctrl_refs;
+	u64			cache_size;
+	struct nvmet_cache	*cache;
 };
 
 static inline struct nvmet_ns *to_nvmet_ns(struct config_item *item)
@@ -696,6 +698,24 @@ static inline bool nvmet_is_disc_subsys(struct nvmet_subsys *subsys)
     return subsys->type != NVME_NQN_NVME;
 }
 
+#ifdef CONFIG_NVME_TARGET_CACHE
+int nvmet_cache_ns_enable(struct nvmet_ns *ns);
+void nvmet_cache_ns_disable(struct nvmet_ns *ns);
+u16 nvmet_cache_parse_io_cmd(struct nvmet_req *req);
+#else /* CONFIG_NVME_TARGET_CACHE */
+static inline int nvmet_cache_ns_enable(struct nvmet_ns *ns)
+{
+	return ns->cache_size ? -EOPNOTSUPP : 0;
+}
+static inline void nvmet_cache_ns_disable(struct nvmet_ns *ns)
+{
+}
+static inline u16 nvmet_cache_parse_io_cmd(struct nvmet_req *req)
+{
+	return 0;
+}
+#endif /* CONFIG_NVME_TARGET_CACHE */
+
 #ifdef CONFIG_NVME_TARGET_PASSTHRU
 void nvmet_passthru_subsys_free(struct nvmet_subsys *subsys);
 int nvmet_passthru_ctrl_enable(struct nvmet_subsys *subsys);
@@ -73,6 +73,15 @@ device_param_cb(idle_poll_period_usecs, &set_param_ops,
 MODULE_PARM_DESC(idle_poll_period_usecs,
 		"nvmet tcp io_work poll till idle time period in usecs: Default 0");
 
+/* Run io_work of new queues on CPUs picked round-robin instead of on the
+ * CPU the socket receives on.  Queues whose flows get steered to the same
+ * RX CPU then don't serialize behind each other.
+ */
+static bool io_work_spread;
+module_param(io_work_spread, bool, 0644);
+MODULE_PARM_DESC(io_work_spread,
+		"nvmet tcp spread io_work of queues over all online cpus: Default false");
+
 #ifdef CONFIG_NVME_TARGET_TCP_TLS
 /*
  * TLS handshake timeout
@@ -150,6 +159,7 @@ struct nvmet_tcp_queue {
 	struct socket		*sock;
 	struct nvmet_tcp_port	*port;
 	struct work_struct	io_work;
+	int			io_cpu;
 	struct nvmet_cq		nvme_cq;
 	struct nvmet_sq		nvme_sq;
 	struct kref		kref;
@@ -282,9 +292,27 @@ static inline void nvmet_tcp_put_cmd(struct nvmet_tcp_cmd *cmd)
 
 static inline int queue_cpu(struct nvmet_tcp_queue *queue)
 {
+	if (queue->io_cpu != WORK_CPU_UNBOUND)
+		return queue->io_cpu;
 	return queue->sock->sk->sk_incoming_cpu;
 }
 
+static int nvmet_tcp_pick_io_cpu(void)
+{
+	static atomic_t next_cpu = ATOMIC_INIT(0);
+	unsigned int n, cpu;
+
+	if (!READ_ONCE(io_work_spread))
+		return WORK_CPU_UNBOUND;
+
+	/* a CPU going offline in between makes the mask shorter than n */
+	n = atomic_fetch_inc(&next_cpu) % num_online_cpus();
+	cpu = cpumask_nth(n, cpu_online_mask);
+	if (cpu >= nr_cpu_ids)
+		return WORK_CPU_UNBOUND;
+	return cpu;
+}
+
 static inline u8 nvmet_tcp_hdgst_len(struct nvmet_tcp_queue *queue)
 {
 	return queue->hdr_digest ? NVME_TCP_DIGEST_LENGTH : 0;
@@ -1884,6 +1912,7 @@ static void nvmet_tcp_alloc_queue(struct nvmet_tcp_port *port,
 
 	INIT_WORK(&queue->release_work, nvmet_tcp_release_queue_work);
 	INIT_WORK(&queue->io_work, nvmet_tcp_io_work);
+	queue->io_cpu = nvmet_tcp_pick_io_cpu();
 	kref_init(&queue->kref);
 	queue->sock = newsock;
 	queue->port = port;
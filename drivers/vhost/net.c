@@ -351,15 +351,15 @@ static bool vhost_sock_xdp(struct socket *sock)
 
 /* In case of DMA done not in order in lower device driver for some reason.
  * upend_idx is used to track end of used idx, done_idx is used to track head
- * of used idx. Once lower device DMA done contiguously, we will signal KVM
- * guest used idx.
+ * of used idx. Once lower device DMA done contiguously, we will add them to
+ * the used ring. Returns the number of buffers added.
  */
-static void vhost_zerocopy_signal_used(struct vhost_net *net,
-				       struct vhost_virtqueue *vq)
+static int vhost_zerocopy_add_used(struct vhost_net *net,
+				   struct vhost_virtqueue *vq)
 {
 	struct vhost_net_virtqueue *nvq =
 		container_of(vq, struct vhost_net_virtqueue, vq);
-	int i, add;
+	int i, add, added;
 	int j = 0;
 
 	for (i = nvq->done_idx; i != nvq->upend_idx; i = (i + 1) % UIO_MAXIOV) {
@@ -371,13 +371,23 @@ static void vhost_zerocopy_signal_used(struct vhost_net *net,
 		} else
 			break;
 	}
+	added = j;
 	while (j) {
 		add = min(UIO_MAXIOV - nvq->done_idx, j);
-		vhost_add_used_and_signal_n(vq->dev, vq,
-					    &vq->heads[nvq->done_idx], add);
+		vhost_add_used_n(vq, &vq->heads[nvq->done_idx], add);
 		nvq->done_idx = (nvq->done_idx + add) % UIO_MAXIOV;
 		j -= add;
 	}
+
+	return added;
+}
+
+/* Add the buffers whose DMA is done and signal the guest if there were any. */
+static void vhost_zerocopy_signal_used(struct vhost_net *net,
+				       struct vhost_virtqueue *vq)
+{
+	if (vhost_zerocopy_add_used(net, vq))
+		vhost_signal(vq->dev, vq);
 }
 
 static void vhost_zerocopy_complete(struct sk_buff *skb,
@@ -449,6 +459,15 @@ static int vhost_net_enable_vq(struct vhost_net *n,
 	return vhost_poll_start(poll, sock->file);
 }
 
+static void vhost_net_flush_used(struct vhost_net_virtqueue *nvq)
+{
+	if (!nvq->done_idx)
+		return;
+
+	vhost_add_used_n(&nvq->vq, nvq->vq.heads, nvq->done_idx);
+	nvq->done_idx = 0;
+}
+
 static void vhost_net_signal_used(struct vhost_net_virtqueue *nvq)
 {
 	struct vhost_virtqueue *vq = &nvq->vq;
@@ -848,12 +867,13 @@ static void handle_tx_zerocopy(struct vhost_net *net, struct socket *sock)
 	struct ubuf_info_msgzc *ubuf;
 	bool zcopy_used;
 	int sent_pkts = 0;
+	int unsignalled = 0;
 
 	do {
 		bool busyloop_intr;
 
 		/* Release DMAs done buffers first */
-		vhost_zerocopy_signal_used(net, vq);
+		unsignalled += vhost_zerocopy_add_used(net, vq);
 
 		busyloop_intr = false;
 		head = get_tx_bufs(net, nvq, &msg, &out, &in, &len,
@@ -927,12 +947,25 @@ static void handle_tx_zerocopy(struct vhost_net *net, struct socket *sock)
 		} else if (unlikely(err != len))
 			pr_debug("Truncated TX packet: "
 				 " len %d != %zd\n", err, len);
-		if (!zcopy_used)
-			vhost_add_used_and_signal(&net->dev, vq, head, 0);
-		else
-			vhost_zerocopy_signal_used(net, vq);
+		if (!zcopy_used) {
+			vhost_add_used(vq, head, 0);
+			unsignalled++;
+		} else {
+			unsignalled += vhost_zerocopy_add_used(net, vq);
+		}
+		/*
+		 * Completions are added to the used ring as they come in, but
+		 * the guest is only signalled once per batch of them.
+		 */
+		if (unsignalled >= VHOST_NET_BATCH) {
+			vhost_signal(&net->dev, vq);
+			unsignalled = 0;
+		}
 		vhost_net_tx_packet(net);
 	} while (likely(!vhost_exceeds_weight(vq, ++sent_pkts, total_len)));
+
+	if (unsignalled)
+		vhost_signal(&net->dev, vq);
 }
 
 /* Expects to be always run from workqueue - which acts as
@@ -1111,6 +1144,7 @@ static void handle_rx(struct vhost_net *net)
 	struct iov_iter fixup;
 	__virtio16 num_buffers;
 	int recv_pkts = 0;
+	bool flushed = false;
 
 	mutex_lock_nested(&vq->mutex, VHOST_NET_VQ_RX);
 	sock = vhost_vq_get_backend(vq);
@@ -1213,8 +1247,13 @@ static void handle_rx(struct vhost_net *net)
 			goto out;
 		}
 		nvq->done_idx += headcount;
-		if (nvq->done_idx > VHOST_NET_BATCH)
-			vhost_net_signal_used(nvq);
+		/* Publish full batches to the guest, but only signal it once
+		 * at the end, for everything received in this run.
+		 */
+		if (nvq->done_idx > VHOST_NET_BATCH) {
+			vhost_net_flush_used(nvq);
+			flushed = true;
+		}
 		if (unlikely(vq_log))
 			vhost_log_write(vq, vq_log, log, vhost_len,
 					vq->iov, in);
@@ -1226,7 +1265,12 @@ static void handle_rx(struct vhost_net *net)
 	else if (!sock_len)
 		vhost_net_enable_vq(net, vq);
 out:
-	vhost_net_signal_used(nvq);
+	if (flushed) {
+		vhost_net_flush_used(nvq);
+		vhost_signal(&net->dev, vq);
+	} else {
+		vhost_net_signal_used(nvq);
+	}
 	mutex_unlock(&vq->mutex);
 }
 
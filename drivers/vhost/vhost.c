@@ -30,6 +30,7 @@
 #include <linux/interval_tree_generic.h>
 #include <linux/nospec.h>
 #include <linux/kcov.h>
+#include <linux/sched/clock.h>
 
 #include "vhost.h"
 
@@ -41,6 +42,10 @@ static int max_iotlb_entries = 2048;
 module_param(max_iotlb_entries, int, 0444);
 MODULE_PARM_DESC(max_iotlb_entries,
 	"Maximum number of iotlb entries. (default: 2048)");
+static unsigned int balance_interval_ms;
+module_param(balance_interval_ms, uint, 0644);
+MODULE_PARM_DESC(balance_interval_ms,
+	"Interval at which vqs are moved between a device's workers to even out their load, 0 to disable. Applies to devices set up afterwards. (default: 0)");
 
 enum {
 	VHOST_MEMORY_F_LOG = 0x1,
@@ -182,6 +187,7 @@ void vhost_work_init(struct vhost_work *work, vhost_work_fn_t fn)
 {
 	clear_bit(VHOST_WORK_QUEUED, &work->flags);
 	work->fn = fn;
+	work->vq = NULL;
 }
 EXPORT_SYMBOL_GPL(vhost_work_init);
 
@@ -255,6 +261,7 @@ bool vhost_vq_work_queue(struct vhost_virtqueue *vq, struct vhost_work *work)
 	worker = rcu_dereference(vq->worker);
 	if (worker) {
 		queued = true;
+		WRITE_ONCE(work->vq, vq);
 		vhost_worker_queue(worker, work);
 	}
 	rcu_read_unlock();
@@ -402,10 +409,18 @@ static bool vhost_run_work_list(void *data)
 		/* make sure flag is seen after deletion */
 		smp_wmb();
 		llist_for_each_entry_safe(work, work_next, node, node) {
+			struct vhost_virtqueue *vq = READ_ONCE(work->vq);
+			u64 start = 0;
+
+			if (vq && READ_ONCE(balance_interval_ms))
+				start = local_clock();
 			clear_bit(VHOST_WORK_QUEUED, &work->flags);
 			kcov_remote_start_common(worker->kcov_handle);
 			work->fn(work);
 			kcov_remote_stop();
+			if (start)
+				WRITE_ONCE(vq->work_time_ns, vq->work_time_ns +
+					   local_clock() - start);
 			cond_resched();
 		}
 	}
@@ -530,6 +545,8 @@ static size_t vhost_get_desc_size(struct vhost_virtqueue *vq,
 	return sizeof(*vq->desc) * num;
 }
 
+static void vhost_balance_workers(struct work_struct *work);
+
 void vhost_dev_init(struct vhost_dev *dev,
 		    struct vhost_virtqueue **vqs, int nvqs,
 		    int iov_limit, int weight, int byte_weight,
@@ -557,6 +574,7 @@ void vhost_dev_init(struct vhost_dev *dev,
 	INIT_LIST_HEAD(&dev->pending_list);
 	spin_lock_init(&dev->iotlb_lock);
 	xa_init_flags(&dev->worker_xa, XA_FLAGS_ALLOC);
+	INIT_DELAYED_WORK(&dev->balance_work, vhost_balance_workers);
 
 	for (i = 0; i < dev->nvqs; ++i) {
 		vq = dev->vqs[i];
@@ -917,6 +935,98 @@ long vhost_worker_ioctl(struct vhost_dev *dev, unsigned int ioctl,
 }
 EXPORT_SYMBOL_GPL(vhost_worker_ioctl);
 
+static void vhost_balance_schedule(struct vhost_dev *dev)
+{
+	unsigned int interval = READ_ONCE(balance_interval_ms);
+
+	if (interval)
+		schedule_delayed_work(&dev->balance_work,
+				      msecs_to_jiffies(interval));
+}
+
+/*
+ * Even out the load of a device's workers: sum up the time each worker
+ * spent on its vqs' works since the last pass and move one vq from the
+ * busiest to the least busy worker, if that makes the two closer.
+ * __vhost_vq_attach_worker() flushes the old worker before returning, so
+ * the works of the moved vq stay in order.
+ */
+static void vhost_balance_workers(struct work_struct *work)
+{
+	struct vhost_dev *dev = container_of(to_delayed_work(work),
+					     struct vhost_dev, balance_work);
+	struct vhost_worker *worker, *busiest = NULL, *idlest = NULL;
+	struct vhost_virtqueue *vq, *move = NULL;
+	u64 gap, dist, best = 0;
+	unsigned long index;
+	int i;
+
+	/* vhost_dev_cleanup() cancels us with the device mutex held. */
+	if (!mutex_trylock(&dev->mutex))
+		goto out;
+
+	xa_for_each(&dev->worker_xa, index, worker) {
+		worker->balance_load = 0;
+		worker->balance_nr_vqs = 0;
+	}
+
+	for (i = 0; i < dev->nvqs; i++) {
+		vq = dev->vqs[i];
+		worker = rcu_dereference_check(vq->worker,
+					       lockdep_is_held(&dev->mutex));
+		vq->balance_load = READ_ONCE(vq->work_time_ns) -
+				   vq->balance_last_ns;
+		vq->balance_last_ns += vq->balance_load;
+		if (!worker)
+			continue;
+
+		worker->balance_load += vq->balance_load;
+		worker->balance_nr_vqs++;
+	}
+
+	xa_for_each(&dev->worker_xa, index, worker) {
+		if (worker->killed)
+			continue;
+		if (!busiest || worker->balance_load > busiest->balance_load)
+			busiest = worker;
+		if (!idlest || worker->balance_load < idlest->balance_load)
+			idlest = worker;
+	}
+
+	if (!busiest || busiest == idlest || busiest->balance_nr_vqs < 2)
+		goto unlock;
+
+	/*
+	 * Moving a vq with load l changes the gap between the two workers to
+	 * |gap - 2 * l|, so it only helps for l < gap. Pick the vq closest to
+	 * gap / 2, and leave small imbalances alone rather than bouncing vqs
+	 * between workers.
+	 */
+	gap = busiest->balance_load - idlest->balance_load;
+	if (gap < busiest->balance_load / 4)
+		goto unlock;
+
+	for (i = 0; i < dev->nvqs; i++) {
+		vq = dev->vqs[i];
+		if (rcu_access_pointer(vq->worker) != busiest ||
+		    !vq->balance_load || vq->balance_load >= gap)
+			continue;
+
+		dist = abs_diff(vq->balance_load, gap / 2);
+		if (!move || dist < best) {
+			move = vq;
+			best = dist;
+		}
+	}
+
+	if (move)
+		__vhost_vq_attach_worker(move, idlest);
+unlock:
+	mutex_unlock(&dev->mutex);
+out:
+	vhost_balance_schedule(dev);
+}
+
 /* Caller should have device mutex */
 long vhost_dev_set_owner(struct vhost_dev *dev)
 {
@@ -950,6 +1060,8 @@ long vhost_dev_set_owner(struct vhost_dev *dev)
 
 		for (i = 0; i < dev->nvqs; i++)
 			__vhost_vq_attach_worker(dev->vqs[i], worker);
+
+		vhost_balance_schedule(dev);
 	}
 
 	return 0;
@@ -1028,6 +1140,9 @@ void vhost_dev_cleanup(struct vhost_dev *dev)
 {
 	int i;
 
+	/* The balancer walks the vqs and their workers */
+	cancel_delayed_work_sync(&dev->balance_work);
+
 	for (i = 0; i < dev->nvqs; ++i) {
 		if (dev->vqs[i]->error_ctx)
 			eventfd_ctx_put(dev->vqs[i]->error_ctx);
@@ -24,6 +24,8 @@ struct vhost_work {
 	struct llist_node	node;
 	vhost_work_fn_t		fn;
 	unsigned long		flags;
+	/* The vq this work was last queued for, if any. */
+	struct vhost_virtqueue	*vq;
 };
 
 struct vhost_worker {
@@ -36,6 +38,9 @@ struct vhost_worker {
 	u32			id;
 	int			attachment_cnt;
 	bool			killed;
+	/* Work time of the attached vqs over the last balancing interval. */
+	u64			balance_load;
+	int			balance_nr_vqs;
 };
 
 /* Poll a file (eventfd or socket) */
@@ -81,6 +86,13 @@ struct vhost_vring_call {
 struct vhost_virtqueue {
 	struct vhost_dev *dev;
 	struct vhost_worker __rcu *worker;
+	/* Time spent running this vq's works, its value at the last
+	 * balancing pass and the difference between the last two passes.
+	 * Only updated when worker balancing is enabled.
+	 */
+	u64 work_time_ns;
+	u64 balance_last_ns;
+	u64 balance_load;
 
 	/* The actual ring of buffers. */
 	struct mutex mutex;
@@ -176,6 +188,7 @@ struct vhost_dev {
 	int byte_weight;
 	struct xarray worker_xa;
 	bool use_worker;
+	struct delayed_work balance_work;
 	int (*msg_handler)(struct vhost_dev *dev, u32 asid,
 			   struct vhost_iotlb_msg *msg);
 };
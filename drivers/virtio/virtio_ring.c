@@ -180,6 +180,9 @@ struct vring_virtqueue {
 	/* Host publishes avail event idx */
 	bool event;
 
+	/* Adding a batch: defer publishing the avail idx until it is done. */
+	bool batch_add;
+
 	/* Head of free buffer list. */
 	unsigned int free_head;
 	/* Number we've added since last sync. */
@@ -526,6 +529,15 @@ static inline unsigned int virtqueue_add_desc_split(struct virtqueue *vq,
 	return next;
 }
 
+static void virtqueue_publish_avail_split(struct vring_virtqueue *vq)
+{
+	/* Descriptors and available array need to be set before we expose the
+	 * new available array entries. */
+	virtio_wmb(vq->weak_barriers);
+	vq->split.vring.avail->idx = cpu_to_virtio16(vq->vq.vdev,
+						vq->split.avail_idx_shadow);
+}
+
 static inline int virtqueue_add_split(struct virtqueue *_vq,
 				      struct scatterlist *sgs[],
 				      unsigned int total_sg,
@@ -673,12 +685,9 @@ static inline int virtqueue_add_split(struct virtqueue *_vq,
 	avail = vq->split.avail_idx_shadow & (vq->split.vring.num - 1);
 	vq->split.vring.avail->ring[avail] = cpu_to_virtio16(_vq->vdev, head);
 
-	/* Descriptors and available array need to be set before we expose the
-	 * new available array entries. */
-	virtio_wmb(vq->weak_barriers);
 	vq->split.avail_idx_shadow++;
-	vq->split.vring.avail->idx = cpu_to_virtio16(_vq->vdev,
-						vq->split.avail_idx_shadow);
+	if (!vq->batch_add)
+		virtqueue_publish_avail_split(vq);
 	vq->num_added++;
 
 	pr_debug("Added buffer head %i to %p\n", head, vq);
@@ -686,8 +695,11 @@ static inline int virtqueue_add_split(struct virtqueue *_vq,
 
 	/* This is very unlikely, but theoretically possible.  Kick
 	 * just in case. */
-	if (unlikely(vq->num_added == (1 << 16) - 1))
+	if (unlikely(vq->num_added == (1 << 16) - 1)) {
+		if (vq->batch_add)
+			virtqueue_publish_avail_split(vq);
 		virtqueue_kick(_vq);
+	}
 
 	return 0;
 
@@ -2318,6 +2330,65 @@ int virtqueue_add_sgs(struct virtqueue *_vq,
 }
 EXPORT_SYMBOL_GPL(virtqueue_add_sgs);
 
+/**
+ * virtqueue_add_batch - expose several buffers to other end at once
+ * @_vq: the struct virtqueue we're talking about.
+ * @bufs: the buffers to add.
+ * @num: the number of entries in @bufs.
+ * @gfp: how to do memory allocations (if necessary).
+ *
+ * Adds the buffers in order, as if virtqueue_add_sgs() (or
+ * virtqueue_add_inbuf_ctx() for entries with a @ctx) had been called for
+ * each of them. On a split ring the new entries are exposed to the other
+ * end with a single barrier and avail idx write after the last one has
+ * been added, instead of once per buffer.
+ *
+ * Adding stops at the first buffer that fails; the buffers before it stay
+ * added and must still be kicked.
+ *
+ * Caller must ensure we don't call this with other virtqueue operations
+ * at the same time (except where noted).
+ *
+ * Returns the number of buffers added, or a negative error (ie. ENOSPC,
+ * ENOMEM, EIO) if the first one could not be added.
+ */
+int virtqueue_add_batch(struct virtqueue *_vq,
+			struct virtqueue_buf *bufs, unsigned int num,
+			gfp_t gfp)
+{
+	struct vring_virtqueue *vq = to_vvq(_vq);
+	unsigned int n, i, total_sg;
+	int err = 0;
+
+	vq->batch_add = !vq->packed_ring;
+
+	for (n = 0; n < num; n++) {
+		struct virtqueue_buf *buf = &bufs[n];
+
+		total_sg = 0;
+		for (i = 0; i < buf->out_sgs + buf->in_sgs; i++) {
+			struct scatterlist *sg;
+
+			for (sg = buf->sgs[i]; sg; sg = sg_next(sg))
+				total_sg++;
+		}
+
+		err = virtqueue_add(_vq, buf->sgs, total_sg, buf->out_sgs,
+				    buf->in_sgs, buf->data, buf->ctx, false, gfp);
+		if (err)
+			break;
+	}
+
+	if (vq->batch_add) {
+		vq->batch_add = false;
+		if (n)
+			virtqueue_publish_avail_split(vq);
+	}
+
+	return n ? n : err;
+}
+EXPORT_SYMBOL_GPL(virtqueue_add_batch);
+
 /**
  * virtqueue_add_outbuf - expose output buffers to other end
  * @vq: the struct virtqueue we're talking about.
@@ -394,7 +394,7 @@ static bool merge_ref(struct btrfs_fs_info *fs_info,
 		      struct btrfs_delayed_ref_root *delayed_refs,
 		      struct btrfs_delayed_ref_head *head,
 		      struct btrfs_delayed_ref_node *ref,
-		      u64 seq)
+		      u64 seq, int *nr_dropped)
 {
 	struct btrfs_delayed_ref_node *next;
 	struct rb_node *node = rb_next(&ref->ref_node);
@@ -421,9 +421,11 @@ static bool merge_ref(struct btrfs_fs_info *fs_info,
 		}
 
 		drop_delayed_ref(fs_info, delayed_refs, head, next);
+		(*nr_dropped)++;
 		ref->ref_mod += mod;
 		if (ref->ref_mod == 0) {
 			drop_delayed_ref(fs_info, delayed_refs, head, ref);
+			(*nr_dropped)++;
 			done = true;
 		} else {
 			/*
@@ -437,22 +439,31 @@ static bool merge_ref(struct btrfs_fs_info *fs_info,
 	return done;
 }
 
-void btrfs_merge_delayed_refs(struct btrfs_fs_info *fs_info,
-			      struct btrfs_delayed_ref_root *delayed_refs,
-			      struct btrfs_delayed_ref_head *head)
+/*
+ * Merge add/drop pairs queued against the same extent.
+ *
+ * Returns the number of delayed refs that were dropped, each of which saves
+ * an extent tree search when the head is run.
+ */
+int btrfs_merge_delayed_refs(struct btrfs_fs_info *fs_info,
+			     struct btrfs_delayed_ref_root *delayed_refs,
+			     struct btrfs_delayed_ref_head *head)
 {
 	struct btrfs_delayed_ref_node *ref;
 	struct rb_node *node;
+	int nr_dropped = 0;
 	u64 seq = 0;
 
 	lockdep_assert_held(&head->lock);
 
-	if (RB_EMPTY_ROOT(&head->ref_tree.rb_root))
-		return;
-
-	/* We don't have too many refs to merge for data. */
-	if (head->is_data)
-		return;
+	/*
+	 * Nothing to merge with a single ref. Data heads usually have just one,
+	 * but reflinks and snapshot deletion can queue many refs for the same
+	 * extent, and cancelling them here is much cheaper than running them.
+	 */
+	if (RB_EMPTY_ROOT(&head->ref_tree.rb_root) ||
+	    rb_first_cached(&head->ref_tree) == rb_last(&head->ref_tree.rb_root))
+		return 0;
 
 	seq = btrfs_tree_mod_log_lowest_seq(fs_info);
 again:
@@ -461,9 +472,12 @@ void btrfs_merge_delayed_refs(struct btrfs_fs_info *fs_info,
 		ref = rb_entry(node, struct btrfs_delayed_ref_node, ref_node);
 		if (seq && ref->seq >= seq)
 			continue;
-		if (merge_ref(fs_info, delayed_refs, head, ref, seq))
+		if (merge_ref(fs_info, delayed_refs, head, ref, seq,
+			      &nr_dropped))
 			goto again;
 	}
+
+	return nr_dropped;
 }
 
 int btrfs_check_delayed_seq(struct btrfs_fs_info *fs_info, u64 seq)
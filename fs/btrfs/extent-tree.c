@@ -1945,7 +1945,9 @@ static int cleanup_ref_head(struct btrfs_trans_handle *trans,
 
 static int btrfs_run_delayed_refs_for_head(struct btrfs_trans_handle *trans,
 					   struct btrfs_delayed_ref_head *locked_ref,
-					   u64 *bytes_released)
+					   u64 *bytes_released,
+					   unsigned long *nr_refs,
+					   unsigned long *nr_merged)
 {
 	struct btrfs_fs_info *fs_info = trans->fs_info;
 	struct btrfs_delayed_ref_root *delayed_refs;
@@ -2017,10 +2019,12 @@ static int btrfs_run_delayed_refs_for_head(struct btrfs_trans_handle *trans,
 		}
 
 		btrfs_put_delayed_ref(ref);
+		(*nr_refs)++;
 		cond_resched();
 
 		spin_lock(&locked_ref->lock);
-		btrfs_merge_delayed_refs(fs_info, delayed_refs, locked_ref);
+		*nr_merged += btrfs_merge_delayed_refs(fs_info, delayed_refs,
+						       locked_ref);
 	}
 
 	return 0;
@@ -2039,7 +2043,10 @@ static noinline int __btrfs_run_delayed_refs(struct btrfs_trans_handle *trans,
 	int ret;
 	unsigned long count = 0;
 	unsigned long max_count = 0;
+	unsigned long nr_refs = 0;
+	unsigned long nr_merged = 0;
 	u64 bytes_processed = 0;
+	u64 start_ns = ktime_get_ns();
 
 	delayed_refs = &trans->transaction->delayed_refs;
 	if (min_bytes == 0) {
@@ -2072,9 +2079,12 @@ static noinline int __btrfs_run_delayed_refs(struct btrfs_trans_handle *trans,
 		 * insert_inline_extent_backref()).
 		 */
 		spin_lock(&locked_ref->lock);
-		btrfs_merge_delayed_refs(fs_info, delayed_refs, locked_ref);
+		nr_merged += btrfs_merge_delayed_refs(fs_info, delayed_refs,
+						      locked_ref);
 
-		ret = btrfs_run_delayed_refs_for_head(trans, locked_ref, &bytes_processed);
+		ret = btrfs_run_delayed_refs_for_head(trans, locked_ref,
+						      &bytes_processed,
+						      &nr_refs, &nr_merged);
 		if (ret < 0 && ret != -EAGAIN) {
 			/*
 			 * Error, btrfs_run_delayed_refs_for_head already
@@ -2107,6 +2117,10 @@ static noinline int __btrfs_run_delayed_refs(struct btrfs_trans_handle *trans,
 		 (max_count > 0 && count < max_count) ||
 		 locked_ref);
 
+	if (count)
+		trace_btrfs_run_delayed_refs_batch(fs_info, count, nr_refs,
+						   nr_merged,
+						   ktime_get_ns() - start_ns);
 	return 0;
 }
 
@@ -4215,6 +4229,36 @@ static bool find_free_extent_check_size_class(struct find_free_extent_ctl *ffe_c
 	return ffe_ctl->size_class == bg->size_class;
 }
 
+/*
+ * Check if an uncached block group could possibly satisfy the allocation.
+ *
+ * The block group item accounting is loaded at mount time, so we know an upper
+ * bound of the largest free extent of every block group without having to load
+ * its free space cache or free space tree. Skipping the block groups that are
+ * too full avoids kicking off caching for them, which is what makes the first
+ * allocations after mount stall on large, fragmented filesystems.
+ */
+static bool find_free_extent_check_avail(struct find_free_extent_ctl *ffe_ctl,
+					 struct btrfs_block_group *bg)
+{
+	u64 avail;
+
+	if (ffe_ctl->policy == BTRFS_EXTENT_ALLOC_ZONED)
+		return true;
+
+	spin_lock(&bg->lock);
+	avail = bg->length - bg->used - bg->pinned - bg->reserved -
+		bg->bytes_super - bg->zone_unusable;
+	spin_unlock(&bg->lock);
+
+	if (avail >= ffe_ctl->num_bytes + ffe_ctl->empty_cluster +
+		     ffe_ctl->empty_size)
+		return true;
+
+	ffe_ctl->total_free_space = max_t(u64, ffe_ctl->total_free_space, avail);
+	return false;
+}
+
 static int prepare_allocation_clustered(struct btrfs_fs_info *fs_info,
 					struct find_free_extent_ctl *ffe_ctl,
 					struct btrfs_space_info *space_info,
@@ -4486,6 +4530,11 @@ static noinline int find_free_extent(struct btrfs_root *root,
 		trace_find_free_extent_have_block_group(root, ffe_ctl, block_group);
 		ffe_ctl->cached = btrfs_block_group_done(block_group);
 		if (unlikely(!ffe_ctl->cached)) {
+			if (!find_free_extent_check_avail(ffe_ctl, block_group)) {
+				/* Don't wait for caching that can't help us. */
+				ffe_ctl->retry_uncached = true;
+				goto loop;
+			}
 			ffe_ctl->have_caching_bg = true;
 			ret = btrfs_cache_block_group(block_group, false);
 
@@ -737,6 +737,130 @@ int btrfs_lookup_csums_bitmap(struct btrfs_root *root, struct btrfs_path *path,
 	return ret;
 }
 
+/*
+ * Calculate checksums of the data blocks in the range described by @start of
+ * @bio and store them to @sums, in the order of the blocks.
+ */
+static void csum_bio_range(struct btrfs_fs_info *fs_info, struct bio *bio,
+			   struct bvec_iter start, u8 *sums)
+{
+	SHASH_DESC_ON_STACK(shash, fs_info->csum_shash);
+	struct bvec_iter iter;
+	struct bio_vec bvec;
+	unsigned int blockcount;
+	char *data;
+	int i;
+
+	shash->tfm = fs_info->csum_shash;
+
+	__bio_for_each_segment(bvec, bio, iter, start) {
+		blockcount = BTRFS_BYTES_TO_BLKS(fs_info,
+						 bvec.bv_len + fs_info->sectorsize
+						 - 1);
+
+		for (i = 0; i < blockcount; i++) {
+			data = bvec_kmap_local(&bvec);
+			crypto_shash_digest(shash,
+					    data + (i * fs_info->sectorsize),
+					    fs_info->sectorsize,
+					    sums);
+			kunmap_local(data);
+			sums += fs_info->csum_size;
+		}
+	}
+}
+
+/*
+ * Bios of at least BTRFS_CSUM_CHUNK_MIN_BIO bytes are split into chunks of
+ * BTRFS_CSUM_CHUNK_SIZE bytes, checksummed in parallel by csum_workers.
+ */
+#define BTRFS_CSUM_CHUNK_SIZE		SZ_256K
+#define BTRFS_CSUM_CHUNK_MIN_BIO	(4 * BTRFS_CSUM_CHUNK_SIZE)
+
+struct btrfs_csum_chunk {
+	struct btrfs_fs_info *fs_info;
+	struct bio *bio;
+	struct bvec_iter iter;
+	u8 *sums;
+	atomic_t *pending;
+	struct completion *done;
+	struct btrfs_work work;
+};
+
+static void csum_chunk_work(struct btrfs_work *work)
+{
+	struct btrfs_csum_chunk *chunk =
+		container_of(work, struct btrfs_csum_chunk, work);
+	struct completion *done = chunk->done;
+
+	csum_bio_range(chunk->fs_info, chunk->bio, chunk->iter, chunk->sums);
+	/* The submitter frees @chunk as soon as the last one completes. */
+	if (atomic_dec_and_test(chunk->pending))
+		complete(done);
+}
+
+static bool should_csum_parallel(struct btrfs_fs_info *fs_info,
+				 struct bio *bio)
+{
+	if (bio->bi_iter.bi_size < BTRFS_CSUM_CHUNK_MIN_BIO)
+		return false;
+	/* A fast implementation is bound by memory bandwidth, not CPU. */
+	if (test_bit(BTRFS_FS_CSUM_IMPL_FAST, &fs_info->flags))
+		return false;
+	return fs_info->thread_pool_size > 1;
+}
+
+/*
+ * Checksum a large bio by splitting it into chunks which are queued to
+ * csum_workers, while the submitter takes the first chunk itself.  Each chunk
+ * writes its own slice of @sums, so they are reassembled in bio order for
+ * free.
+ *
+ * Return false if the chunks could not be allocated, in which case the
+ * caller checksums the bio itself.
+ */
+static bool csum_bio_parallel(struct btrfs_fs_info *fs_info, struct bio *bio,
+			      u8 *sums)
+{
+	const u32 nr_chunks = DIV_ROUND_UP(bio->bi_iter.bi_size,
+					   BTRFS_CSUM_CHUNK_SIZE);
+	const u32 chunk_csums = BTRFS_CSUM_CHUNK_SIZE >> fs_info->sectorsize_bits;
+	DECLARE_COMPLETION_ONSTACK(done);
+	struct btrfs_csum_chunk *chunks;
+	struct bvec_iter iter = bio->bi_iter;
+	atomic_t pending;
+	u32 i;
+
+	chunks = kmalloc_array(nr_chunks, sizeof(*chunks), GFP_NOFS);
+	if (!chunks)
+		return false;
+
+	atomic_set(&pending, nr_chunks);
+	for (i = 0; i < nr_chunks; i++) {
+		struct btrfs_csum_chunk *chunk = &chunks[i];
+		u32 len = min_t(u32, iter.bi_size, BTRFS_CSUM_CHUNK_SIZE);
+
+		chunk->fs_info = fs_info;
+		chunk->bio = bio;
+		chunk->iter = iter;
+		chunk->iter.bi_size = len;
+		chunk->sums = sums + i * chunk_csums * fs_info->csum_size;
+		chunk->pending = &pending;
+		chunk->done = &done;
+		bio_advance_iter(bio, &iter, len);
+
+		if (i == 0)
+			continue;
+		btrfs_init_work(&chunk->work, csum_chunk_work, NULL);
+		btrfs_queue_work(fs_info->csum_workers, &chunk->work);
+	}
+
+	csum_chunk_work(&chunks[0].work);
+	wait_for_completion(&done);
+	kfree(chunks);
+	return true;
+}
+
 /*
  * Calculate checksums of the data contained inside a bio.
  */
@@ -745,15 +869,8 @@ blk_status_t btrfs_csum_one_bio(struct btrfs_bio *bbio)
 	struct btrfs_ordered_extent *ordered = bbio->ordered;
 	struct btrfs_inode *inode = bbio->inode;
 	struct btrfs_fs_info *fs_info = inode->root->fs_info;
-	SHASH_DESC_ON_STACK(shash, fs_info->csum_shash);
 	struct bio *bio = &bbio->bio;
 	struct btrfs_ordered_sum *sums;
-	char *data;
-	struct bvec_iter iter;
-	struct bio_vec bvec;
-	int index;
-	unsigned int blockcount;
-	int i;
 	unsigned nofs_flag;
 
 	nofs_flag = memalloc_nofs_save();
@@ -768,26 +885,10 @@ blk_status_t btrfs_csum_one_bio(struct btrfs_bio *bbio)
 	INIT_LIST_HEAD(&sums->list);
 
 	sums->logical = bio->bi_iter.bi_sector << SECTOR_SHIFT;
-	index = 0;
-
-	shash->tfm = fs_info->csum_shash;
-
-	bio_for_each_segment(bvec, bio, iter) {
-		blockcount = BTRFS_BYTES_TO_BLKS(fs_info,
-						 bvec.bv_len + fs_info->sectorsize
-						 - 1);
-
-		for (i = 0; i < blockcount; i++) {
-			data = bvec_kmap_local(&bvec);
-			crypto_shash_digest(shash,
-					    data + (i * fs_info->sectorsize),
-					    fs_info->sectorsize,
-					    sums->sums + index);
-			kunmap_local(data);
-			index += fs_info->csum_size;
-		}
 
-	}
+	if (!should_csum_parallel(fs_info, bio) ||
+	    !csum_bio_parallel(fs_info, bio, sums->sums))
+		csum_bio_range(fs_info, bio, bio->bi_iter, sums->sums);
 
 	bbio->sums = sums;
 	btrfs_add_ordered_sum(ordered, sums);
@@ -610,6 +610,8 @@ struct btrfs_fs_info {
 	struct btrfs_workqueue *endio_write_workers;
 	struct btrfs_workqueue *endio_freespace_worker;
 	struct btrfs_workqueue *caching_workers;
+	/* Checksum chunks of large data bios in parallel, never blocks. */
+	struct btrfs_workqueue *csum_workers;
 
 	/*
 	 * Fixup workers take dirty pages that didn't properly go through the
@@ -345,7 +345,7 @@ static int erofs_iomap_end(struct inode *inode, loff_t pos, loff_t length,
 	return written;
 }
 
-static const struct iomap_ops erofs_iomap_ops = {
+const struct iomap_ops erofs_iomap_ops = {
 	.iomap_begin = erofs_iomap_begin,
 	.iomap_end = erofs_iomap_end,
 };
@@ -446,7 +446,7 @@ static int erofs_file_mmap(struct file *file, struct vm_area_struct *vma)
 
 static loff_t erofs_file_llseek(struct file *file, loff_t offset, int whence)
 {
-	struct inode *inode = file->f_mapping->host;
+	struct inode *inode = file_inode(file);
 	const struct iomap_ops *ops = &erofs_iomap_ops;
 
 	if (erofs_inode_is_data_compressed(EROFS_I(inode)->datalayout))
@@ -468,7 +468,13 @@ static loff_t erofs_file_llseek(struct file *file, loff_t offset, int whence)
 	return vfs_setpos(file, offset, inode->i_sb->s_maxbytes);
 }
 
+static int erofs_file_open(struct inode *inode, struct file *file)
+{
+	return erofs_ishare_open(inode, file);
+}
+
 const struct file_operations erofs_file_fops = {
+	.open		= erofs_file_open,
 	.llseek		= erofs_file_llseek,
 	.read_iter	= erofs_file_read_iter,
 	.mmap		= erofs_file_mmap,
@@ -177,6 +177,7 @@ struct erofs_sb_info {
 #define EROFS_MOUNT_DAX_ALWAYS		0x00000040
 #define EROFS_MOUNT_DAX_NEVER		0x00000080
 #define EROFS_MOUNT_DIRECT_IO		0x00000100
+#define EROFS_MOUNT_INODE_SHARE		0x00000200
 
 #define clear_opt(opt, option)	((opt)->mount_opt &= ~EROFS_MOUNT_##option)
 #define set_opt(opt, option)	((opt)->mount_opt |= EROFS_MOUNT_##option)
@@ -280,6 +281,10 @@ struct erofs_inode {
 		};
 #endif	/* CONFIG_EROFS_FS_ZIP */
 	};
+#ifdef CONFIG_EROFS_FS_INODE_SHARE
+	struct erofs_ishare *ishare;
+	struct list_head ishare_list;
+#endif
 	/* the corresponding vfs inode */
 	struct inode vfs_inode;
 };
@@ -377,6 +382,7 @@ extern const struct inode_operations erofs_dir_iops;
 extern const struct file_operations erofs_file_fops;
 extern const struct file_operations erofs_dir_fops;
 
+extern const struct iomap_ops erofs_iomap_ops;
 extern const struct iomap_ops z_erofs_iomap_report_ops;
 
 /* flags for erofs_fscache_register_cookie() */
@@ -507,6 +513,21 @@ static inline struct bio *erofs_fscache_bio_alloc(struct erofs_map_dev *mdev) {
 static inline void erofs_fscache_submit_bio(struct bio *bio) {}
 #endif
 
+#ifdef CONFIG_EROFS_FS_INODE_SHARE
+int erofs_ishare_open(struct inode *inode, struct file *file);
+void erofs_ishare_leave(struct inode *inode);
+int __init erofs_init_ishare(void);
+void erofs_exit_ishare(void);
+#else
+static inline int erofs_ishare_open(struct inode *inode, struct file *file)
+{
+	return 0;
+}
+static inline void erofs_ishare_leave(struct inode *inode) {}
+static inline int erofs_init_ishare(void) { return 0; }
+static inline void erofs_exit_ishare(void) {}
+#endif
+
 #define EFSCORRUPTED    EUCLEAN         /* Filesystem is corrupted */
 
 #endif	/* __EROFS_INTERNAL_H */
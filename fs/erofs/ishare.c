@@ -0,0 +1,250 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Page cache sharing of identical files across EROFS images.
+ *
+ * Regular files carrying a content fingerprint in the "trusted.erofs.fp"
+ * xattr on filesystems mounted with "inode_share" are attached to a shared
+ * anonymous inode keyed by that fingerprint.  Opened files use the page cache
+ * of the shared inode, which reads its data through any erofs inode (member)
+ * that is currently attached to it.
+ */
+#include <linux/pseudo_fs.h>
+#include <linux/hashtable.h>
+#include <linux/jhash.h>
+#include <linux/iomap.h>
+#include "xattr.h"
+
+#define EROFS_ISHARE_XATTR_NAME		"erofs.fp"
+#define EROFS_ISHARE_FP_MAX		64
+#define EROFS_ISHARE_HASH_BITS		10
+
+struct erofs_ishare {
+	struct hlist_node node;
+	struct inode *inode;		/* the shared anonymous inode */
+
+	/* protects members against readers using one of them for I/O */
+	struct rw_semaphore rwsem;
+	struct list_head members;
+
+	unsigned int fplen;
+	u8 fp[EROFS_ISHARE_FP_MAX];
+};
+
+static DEFINE_MUTEX(erofs_ishare_lock);
+static DEFINE_HASHTABLE(erofs_ishare_table, EROFS_ISHARE_HASH_BITS);
+static struct vfsmount *erofs_ishare_mnt;
+
+static int erofs_ishare_init_fs_context(struct fs_context *fc)
+{
+	return init_pseudo(fc, EROFS_SUPER_MAGIC) ? 0 : -ENOMEM;
+}
+
+static struct file_system_type erofs_ishare_fs_type = {
+	.owner		= THIS_MODULE,
+	.name		= "pseudo_erofs_ishare",
+	.init_fs_context = erofs_ishare_init_fs_context,
+	.kill_sb	= kill_anon_super,
+};
+
+static int erofs_ishare_iomap_begin(struct inode *inode, loff_t offset,
+		loff_t length, unsigned int flags, struct iomap *iomap,
+		struct iomap *srcmap)
+{
+	struct erofs_ishare *ish = inode->i_private;
+	struct erofs_inode *vi;
+	int ret;
+
+	down_read(&ish->rwsem);
+	vi = list_first_entry_or_null(&ish->members, struct erofs_inode,
+				      ishare_list);
+	if (!vi) {
+		up_read(&ish->rwsem);
+		return -EIO;
+	}
+	ret = erofs_iomap_ops.iomap_begin(&vi->vfs_inode, offset, length,
+					  flags, iomap, srcmap);
+	if (ret)
+		up_read(&ish->rwsem);
+	return ret;
+}
+
+static int erofs_ishare_iomap_end(struct inode *inode, loff_t pos,
+		loff_t length, ssize_t written, unsigned int flags,
+		struct iomap *iomap)
+{
+	struct erofs_ishare *ish = inode->i_private;
+	int ret;
+
+	ret = erofs_iomap_ops.iomap_end(inode, pos, length, written, flags,
+					iomap);
+	up_read(&ish->rwsem);
+	return ret;
+}
+
+static const struct iomap_ops erofs_ishare_iomap_ops = {
+	.iomap_begin = erofs_ishare_iomap_begin,
+	.iomap_end = erofs_ishare_iomap_end,
+};
+
+static int erofs_ishare_read_folio(struct file *file, struct folio *folio)
+{
+	return iomap_read_folio(folio, &erofs_ishare_iomap_ops);
+}
+
+static void erofs_ishare_readahead(struct readahead_control *rac)
+{
+	return iomap_readahead(rac, &erofs_ishare_iomap_ops);
+}
+
+static const struct address_space_operations erofs_ishare_aops = {
+	.read_folio = erofs_ishare_read_folio,
+	.readahead = erofs_ishare_readahead,
+	.direct_IO = noop_direct_IO,
+	.release_folio = iomap_release_folio,
+	.invalidate_folio = iomap_invalidate_folio,
+};
+
+/* only plain uncompressed data on block devices can be read for others */
+static bool erofs_ishare_eligible(struct inode *inode)
+{
+	struct erofs_sb_info *sbi = EROFS_SB(inode->i_sb);
+
+	return test_opt(&sbi->opt, INODE_SHARE) && S_ISREG(inode->i_mode) &&
+		!erofs_inode_is_data_compressed(EROFS_I(inode)->datalayout) &&
+		inode->i_sb->s_bdev && !erofs_is_fileio_mode(sbi) &&
+		!erofs_is_fscache_mode(inode->i_sb) && !IS_DAX(inode);
+}
+
+static struct erofs_ishare *erofs_ishare_lookup(const u8 *fp,
+		unsigned int fplen, u32 hash)
+{
+	struct erofs_ishare *ish;
+
+	hash_for_each_possible(erofs_ishare_table, ish, node, hash)
+		if (ish->fplen == fplen && !memcmp(ish->fp, fp, fplen))
+			return ish;
+	return NULL;
+}
+
+static struct erofs_ishare *erofs_ishare_alloc(struct inode *realinode,
+		const u8 *fp, unsigned int fplen)
+{
+	struct erofs_ishare *ish;
+	struct inode *inode;
+
+	ish = kzalloc(sizeof(*ish), GFP_KERNEL);
+	if (!ish)
+		return NULL;
+
+	inode = new_inode(erofs_ishare_mnt->mnt_sb);
+	if (!inode) {
+		kfree(ish);
+		return NULL;
+	}
+	inode->i_mode = S_IFREG | 0444;
+	inode->i_size = i_size_read(realinode);
+	inode->i_blkbits = realinode->i_blkbits;
+	inode->i_mapping->a_ops = &erofs_ishare_aops;
+	mapping_set_large_folios(inode->i_mapping);
+	inode->i_private = ish;
+
+	ish->inode = inode;
+	init_rwsem(&ish->rwsem);
+	INIT_LIST_HEAD(&ish->members);
+	memcpy(ish->fp, fp, fplen);
+	ish->fplen = fplen;
+	return ish;
+}
+
+static void erofs_ishare_join(struct inode *inode)
+{
+	struct erofs_inode *vi = EROFS_I(inode);
+	struct erofs_ishare *ish;
+	u8 fp[EROFS_ISHARE_FP_MAX];
+	int fplen;
+	u32 hash;
+
+	fplen = erofs_getxattr(inode, EROFS_XATTR_INDEX_TRUSTED,
+			       EROFS_ISHARE_XATTR_NAME, fp, sizeof(fp));
+	if (fplen <= 0)
+		return;
+
+	hash = jhash(fp, fplen, 0);
+	mutex_lock(&erofs_ishare_lock);
+	if (vi->ishare)
+		goto out_unlock;
+
+	ish = erofs_ishare_lookup(fp, fplen, hash);
+	if (ish) {
+		/* a fingerprint collision with a different size, don't share */
+		if (i_size_read(ish->inode) != i_size_read(inode) ||
+		    (1 << ish->inode->i_blkbits) != i_blocksize(inode))
+			goto out_unlock;
+	} else {
+		ish = erofs_ishare_alloc(inode, fp, fplen);
+		if (!ish)
+			goto out_unlock;
+		hash_add(erofs_ishare_table, &ish->node, hash);
+	}
+
+	down_write(&ish->rwsem);
+	list_add_tail(&vi->ishare_list, &ish->members);
+	up_write(&ish->rwsem);
+	vi->ishare = ish;
+out_unlock:
+	mutex_unlock(&erofs_ishare_lock);
+}
+
+int erofs_ishare_open(struct inode *inode, struct file *file)
+{
+	struct erofs_inode *vi = EROFS_I(inode);
+	struct erofs_ishare *ish;
+
+	if (!erofs_ishare_eligible(inode))
+		return 0;
+
+	if (!READ_ONCE(vi->ishare))
+		erofs_ishare_join(inode);
+
+	ish = READ_ONCE(vi->ishare);
+	if (ish)
+		file->f_mapping = ish->inode->i_mapping;
+	return 0;
+}
+
+/* called on eviction, no file can use the shared page cache through it */
+void erofs_ishare_leave(struct inode *inode)
+{
+	struct erofs_inode *vi = EROFS_I(inode);
+	struct erofs_ishare *ish = vi->ishare;
+	bool last;
+
+	if (!ish)
+		return;
+
+	mutex_lock(&erofs_ishare_lock);
+	down_write(&ish->rwsem);
+	list_del(&vi->ishare_list);
+	last = list_empty(&ish->members);
+	up_write(&ish->rwsem);
+	if (last)
+		hash_del(&ish->node);
+	mutex_unlock(&erofs_ishare_lock);
+	vi->ishare = NULL;
+
+	if (last) {
+		iput(ish->inode);
+		kfree(ish);
+	}
+}
+
+int __init erofs_init_ishare(void)
+{
+	erofs_ishare_mnt = kern_mount(&erofs_ishare_fs_type);
+	return PTR_ERR_OR_ZERO(erofs_ishare_mnt);
+}
+
+void erofs_exit_ishare(void)
+{
+	kern_unmount(erofs_ishare_mnt);
+}
@@ -1404,6 +1404,106 @@ static int z_erofs_decompress_pcluster(struct z_erofs_decompress_backend *be,
 	return err;
 }
 
+#define Z_EROFS_PARALLEL_MIN_PAGES	16
+
+struct z_erofs_decompress_job {
+	struct work_struct work;
+	struct super_block *sb;
+	struct z_erofs_pcluster *pcl;
+	atomic_t claimed;
+	int err;
+};
+
+static int z_erofs_decompress_one(struct super_block *sb,
+				  struct z_erofs_pcluster *pcl,
+				  struct page **pagepool, int err)
+{
+	struct z_erofs_decompress_backend be = {
+		.sb = sb,
+		.pcl = pcl,
+		.pagepool = pagepool,
+		.decompressed_secondary_bvecs =
+			LIST_HEAD_INIT(be.decompressed_secondary_bvecs),
+	};
+
+	return z_erofs_decompress_pcluster(&be, err);
+}
+
+static void z_erofs_decompress_job_work(struct work_struct *work)
+{
+	struct z_erofs_decompress_job *job =
+		container_of(work, struct z_erofs_decompress_job, work);
+	struct page *pagepool = NULL;
+
+	if (atomic_xchg(&job->claimed, 1))
+		return;
+	job->err = z_erofs_decompress_one(job->sb, job->pcl, &pagepool,
+					  job->err);
+	erofs_release_pages(&pagepool);
+}
+
+/*
+ * Decompress pclusters of a large batch on several workers.  Each pcluster is
+ * a separate job which either a worker or the submitting context claims, so
+ * the submitter never waits for a job which has not been started yet.
+ * Returns 1 if the batch is too small (or memory is short) and should be
+ * decompressed serially instead.
+ */
+static int z_erofs_decompress_parallel(const struct z_erofs_decompressqueue *io,
+				       struct page **pagepool, int err)
+{
+	z_erofs_next_pcluster_t owned = io->head;
+	struct z_erofs_decompress_job *jobs;
+	unsigned int nr = 0, pages = 0, i;
+	struct z_erofs_pcluster *pcl;
+
+	while (owned != Z_EROFS_PCLUSTER_TAIL) {
+		pcl = container_of(owned, struct z_erofs_pcluster, next);
+		owned = READ_ONCE(pcl->next);
+		pages += z_erofs_pclusterpages(pcl);
+		++nr;
+	}
+	if (nr < 2 || pages < Z_EROFS_PARALLEL_MIN_PAGES)
+		return 1;
+
+	jobs = kvcalloc(nr, sizeof(*jobs), GFP_KERNEL | __GFP_NOWARN);
+	if (!jobs)
+		return 1;
+
+	/* collect the chain first, decompression resets pcl->next */
+	owned = io->head;
+	for (i = 0; i < nr; ++i) {
+		pcl = container_of(owned, struct z_erofs_pcluster, next);
+		owned = READ_ONCE(pcl->next);
+
+		INIT_WORK(&jobs[i].work, z_erofs_decompress_job_work);
+		jobs[i].sb = io->sb;
+		jobs[i].pcl = pcl;
+		jobs[i].err = err;
+		atomic_set(&jobs[i].claimed, 0);
+	}
+
+	/* keep the first one for ourselves */
+	for (i = 1; i < nr; ++i)
+		queue_work(z_erofs_workqueue, &jobs[i].work);
+
+	for (i = 0; i < nr; ++i) {
+		if (atomic_xchg(&jobs[i].claimed, 1))
+			continue;
+		jobs[i].err = z_erofs_decompress_one(io->sb, jobs[i].pcl,
+						     pagepool, jobs[i].err);
+	}
+
+	/* wait for the jobs claimed by workers, drop the unstarted ones */
+	for (i = 1; i < nr; ++i)
+		cancel_work_sync(&jobs[i].work);
+
+	for (i = 0; i < nr; ++i)
+		err = err ?: jobs[i].err;
+	kvfree(jobs);
+	return err;
+}
+
 static int z_erofs_decompress_queue(const struct z_erofs_decompressqueue *io,
 				    struct page **pagepool)
 {
@@ -1416,6 +1516,13 @@ static int z_erofs_decompress_queue(const struct z_erofs_decompressqueue *io,
 	z_erofs_next_pcluster_t owned = io->head;
 	int err = io->eio ? -EIO : 0;
 
+	if (num_online_cpus() > 1) {
+		int ret = z_erofs_decompress_parallel(io, pagepool, err);
+
+		if (ret <= 0)
+			return ret;
+	}
+
 	while (owned != Z_EROFS_PCLUSTER_TAIL) {
 		DBG_BUGON(owned == Z_EROFS_PCLUSTER_NIL);
 
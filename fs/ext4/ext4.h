@@ -1117,6 +1117,7 @@ struct ext4_inode_info {
 	/* extents status tree */
 	struct ext4_es_tree i_es_tree;
 	rwlock_t i_es_lock;
+	seqcount_rwlock_t i_es_seq;	/* i_es_tree changes, for RCU lookups */
 	struct list_head i_es_list;
 	unsigned int i_es_all_nr;	/* protected by i_es_lock */
 	unsigned int i_es_shk_nr;	/* protected by i_es_lock */
@@ -1599,6 +1600,7 @@ struct ext4_sb_info {
 	unsigned int s_mb_stats;
 	unsigned int s_mb_order2_reqs;
 	unsigned int s_mb_group_prealloc;
+	unsigned int s_mb_pcpu_batch;
 	unsigned int s_max_dir_size_kb;
 	/* where last allocation was done - for stream allocation */
 	unsigned long s_mb_last_group;
@@ -1735,6 +1737,12 @@ struct ext4_sb_info {
 
 	/* Ext4 fast commit sub transaction ID */
 	atomic_t s_fc_subtid;
+	/* fsync callers waiting for the next fast commit */
+	atomic_t s_fc_batch_pending;
+	/* last task that asked for a fast commit, for group commit */
+	pid_t s_fc_last_sync_writer;
+	/* upper bound of the group commit window in usec, 0 disables */
+	unsigned int s_fc_max_batch_time;
 
 	/*
 	 * After commit starts, the main queue gets locked, and the further
@@ -2936,6 +2944,8 @@ extern ext4_group_t ext4_mb_prefetch(struct super_block *sb,
 				     unsigned int nr, int *cnt);
 extern void ext4_mb_prefetch_fini(struct super_block *sb, ext4_group_t group,
 				  unsigned int nr);
+extern void ext4_mb_pcpu_stats(struct super_block *sb, unsigned long *hits,
+			       unsigned long *refills);
 
 extern void ext4_free_blocks(handle_t *handle, struct inode *inode,
 			     struct buffer_head *bh, ext4_fsblk_t block,
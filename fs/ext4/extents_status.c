@@ -113,7 +113,10 @@
  *	next extent, adding a extent(a range of blocks) and removing a extent.
  *
  *   --	race on a extent status tree
- *	Extent status tree is protected by inode->i_es_lock.
+ *	Extent status tree is protected by inode->i_es_lock.  Writers also
+ *	bump inode->i_es_seq while they hold the lock for write, which lets
+ *	ext4_es_lookup_extent() walk the tree under RCU without taking the
+ *	lock; extent_status objects are SLAB_TYPESAFE_BY_RCU for that reason.
  *
  *   --	memory consumption
  *      Fragmented extent tree will make extent status tree cost too much
@@ -158,7 +161,8 @@ static int __revise_pending(struct inode *inode, ext4_lblk_t lblk,
 
 int __init ext4_init_es(void)
 {
-	ext4_es_cachep = KMEM_CACHE(extent_status, SLAB_RECLAIM_ACCOUNT);
+	ext4_es_cachep = KMEM_CACHE(extent_status,
+				    SLAB_RECLAIM_ACCOUNT | SLAB_TYPESAFE_BY_RCU);
 	if (ext4_es_cachep == NULL)
 		return -ENOMEM;
 	return 0;
@@ -175,6 +179,18 @@ void ext4_es_init_tree(struct ext4_es_tree *tree)
 	tree->cache_es = NULL;
 }
 
+static inline void ext4_es_write_lock(struct ext4_inode_info *ei)
+{
+	write_lock(&ei->i_es_lock);
+	write_seqcount_begin(&ei->i_es_seq);
+}
+
+static inline void ext4_es_write_unlock(struct ext4_inode_info *ei)
+{
+	write_seqcount_end(&ei->i_es_seq);
+	write_unlock(&ei->i_es_lock);
+}
+
 #ifdef ES_DEBUG__
 static void ext4_es_print_tree(struct inode *inode)
 {
@@ -834,7 +850,8 @@ static int __es_insert_extent(struct inode *inode, struct extent_status *newes,
 	ext4_es_init_extent(inode, es, newes->es_lblk, newes->es_len,
 			    newes->es_pblk);
 
-	rb_link_node(&es->rb_node, parent, p);
+	/* publish the initialized extent to lockless lookups */
+	rb_link_node_rcu(&es->rb_node, parent, p);
 	rb_insert_color(&es->rb_node, &tree->root);
 
 out:
@@ -890,7 +907,7 @@ void ext4_es_insert_extent(struct inode *inode, ext4_lblk_t lblk,
 		es2 = __es_alloc_extent(true);
 	if ((err1 || err2 || err3 < 0) && revise_pending && !pr)
 		pr = __alloc_pending(true);
-	write_lock(&EXT4_I(inode)->i_es_lock);
+	ext4_es_write_lock(EXT4_I(inode));
 
 	err1 = __es_remove_extent(inode, lblk, end, &resv_used, es1);
 	if (err1 != 0)
@@ -925,7 +942,7 @@ void ext4_es_insert_extent(struct inode *inode, ext4_lblk_t lblk,
 		pending = err3;
 	}
 error:
-	write_unlock(&EXT4_I(inode)->i_es_lock);
+	ext4_es_write_unlock(EXT4_I(inode));
 	/*
 	 * Reduce the reserved cluster count to reflect successful deferred
 	 * allocation of delayed allocated clusters or direct allocation of
@@ -980,12 +997,72 @@ void ext4_es_cache_extent(struct inode *inode, ext4_lblk_t lblk,
 
 	BUG_ON(end < lblk);
 
-	write_lock(&EXT4_I(inode)->i_es_lock);
+	ext4_es_write_lock(EXT4_I(inode));
 
 	es = __es_tree_search(&EXT4_I(inode)->i_es_tree.root, lblk);
 	if (!es || es->es_lblk > end)
 		__es_insert_extent(inode, &newes, NULL);
-	write_unlock(&EXT4_I(inode)->i_es_lock);
+	ext4_es_write_unlock(EXT4_I(inode));
+}
+
+/*
+ * Lockless lookup of @lblk in the extent status tree, done under RCU and
+ * validated against i_es_seq. Fields are read with READ_ONCE() because
+ * writers may be changing them under us; anything read from a stale or
+ * recycled extent is discarded by the sequence check.
+ *
+ * Returns false if the lookup raced with a writer, or if the found extent
+ * still needs its referenced bit set, which has to be done under i_es_lock.
+ */
+static bool __es_lookup_extent_rcu(struct ext4_inode_info *ei,
+				   ext4_lblk_t lblk, struct extent_status *es,
+				   int *found)
+{
+	struct ext4_es_tree *tree = &ei->i_es_tree;
+	struct extent_status *es1;
+	struct rb_node *node;
+	ext4_lblk_t es_lblk = 0, es_len = 0;
+	unsigned int seq;
+	bool valid = true;
+
+	rcu_read_lock();
+	seq = raw_seqcount_begin(&ei->i_es_seq);
+
+	*found = 0;
+	es1 = READ_ONCE(tree->cache_es);
+	if (es1) {
+		es_lblk = READ_ONCE(es1->es_lblk);
+		es_len = READ_ONCE(es1->es_len);
+		if (in_range(lblk, es_lblk, es_len))
+			*found = 1;
+	}
+
+	node = READ_ONCE(tree->root.rb_node);
+	while (!*found && node) {
+		es1 = rb_entry(node, struct extent_status, rb_node);
+		es_lblk = READ_ONCE(es1->es_lblk);
+		es_len = READ_ONCE(es1->es_len);
+		if (lblk < es_lblk)
+			node = READ_ONCE(node->rb_left);
+		else if (lblk > es_lblk + es_len - 1)
+			node = READ_ONCE(node->rb_right);
+		else
+			*found = 1;
+	}
+
+	if (*found) {
+		es->es_lblk = es_lblk;
+		es->es_len = es_len;
+		es->es_pblk = READ_ONCE(es1->es_pblk);
+		if (!ext4_es_is_referenced(es))
+			valid = false;
+	}
+
+	if (read_seqcount_retry(&ei->i_es_seq, seq))
+		valid = false;
+	rcu_read_unlock();
+
+	return valid;
 }
 
 /*
@@ -1011,6 +1088,22 @@ int ext4_es_lookup_extent(struct inode *inode, ext4_lblk_t lblk,
 	trace_ext4_es_lookup_extent_enter(inode, lblk);
 	es_debug("lookup extent in block %u\n", lblk);
 
+	/*
+	 * The block mapping paths only want the extent covering @lblk, try
+	 * to find it without bouncing i_es_lock between readers.
+	 */
+	if (!next_lblk &&
+	    __es_lookup_extent_rcu(EXT4_I(inode), lblk, es, &found)) {
+		stats = &EXT4_SB(inode->i_sb)->s_es_stats;
+		if (found) {
+			percpu_counter_inc(&stats->es_stats_cache_hits);
+		} else {
+			es->es_lblk = es->es_len = es->es_pblk = 0;
+			percpu_counter_inc(&stats->es_stats_cache_misses);
+		}
+		goto out_trace;
+	}
+
 	tree = &EXT4_I(inode)->i_es_tree;
 	read_lock(&EXT4_I(inode)->i_es_lock);
 
@@ -1062,6 +1155,7 @@ int ext4_es_lookup_extent(struct inode *inode, ext4_lblk_t lblk,
 
 	read_unlock(&EXT4_I(inode)->i_es_lock);
 
+out_trace:
 	trace_ext4_es_lookup_extent_exit(inode, es, found);
 	return found;
 }
@@ -1537,7 +1631,7 @@ void ext4_es_remove_extent(struct inode *inode, ext4_lblk_t lblk,
 	 * so that we are sure __es_shrink() is done with the inode before it
 	 * is reclaimed.
 	 */
-	write_lock(&EXT4_I(inode)->i_es_lock);
+	ext4_es_write_lock(EXT4_I(inode));
 	err = __es_remove_extent(inode, lblk, end, &reserved, es);
 	/* Free preallocated extent if it didn't get used. */
 	if (es) {
@@ -1545,7 +1639,7 @@ void ext4_es_remove_extent(struct inode *inode, ext4_lblk_t lblk,
 			__es_free_extent(es);
 		es = NULL;
 	}
-	write_unlock(&EXT4_I(inode)->i_es_lock);
+	ext4_es_write_unlock(EXT4_I(inode));
 	if (err)
 		goto retry;
 
@@ -1601,8 +1695,9 @@ static int __es_shrink(struct ext4_sb_info *sbi, int nr_to_scan,
 		 */
 		spin_unlock(&sbi->s_es_lock);
 
+		write_seqcount_begin(&ei->i_es_seq);
 		nr_shrunk += es_reclaim_extents(ei, &nr_to_scan);
-		write_unlock(&ei->i_es_lock);
+		ext4_es_write_unlock(ei);
 
 		if (nr_to_scan <= 0)
 			goto out;
@@ -1860,7 +1955,7 @@ void ext4_clear_inode_es(struct inode *inode)
 	struct ext4_es_tree *tree;
 	struct rb_node *node;
 
-	write_lock(&ei->i_es_lock);
+	ext4_es_write_lock(ei);
 	tree = &EXT4_I(inode)->i_es_tree;
 	tree->cache_es = NULL;
 	node = rb_first(&tree->root);
@@ -1873,7 +1968,7 @@ void ext4_clear_inode_es(struct inode *inode)
 		}
 	}
 	ext4_clear_inode_state(inode, EXT4_STATE_EXT_PRECACHED);
-	write_unlock(&ei->i_es_lock);
+	ext4_es_write_unlock(ei);
 }
 
 #ifdef ES_DEBUG__
@@ -2126,7 +2221,7 @@ void ext4_es_insert_delayed_extent(struct inode *inode, ext4_lblk_t lblk,
 		if (end_allocated && !pr2)
 			pr2 = __alloc_pending(true);
 	}
-	write_lock(&EXT4_I(inode)->i_es_lock);
+	ext4_es_write_lock(EXT4_I(inode));
 
 	err1 = __es_remove_extent(inode, lblk, end, NULL, es1);
 	if (err1 != 0)
@@ -2167,7 +2262,7 @@ void ext4_es_insert_delayed_extent(struct inode *inode, ext4_lblk_t lblk,
 		}
 	}
 error:
-	write_unlock(&EXT4_I(inode)->i_es_lock);
+	ext4_es_write_unlock(EXT4_I(inode));
 	if (err1 || err2 || err3 < 0)
 		goto retry;
 
@@ -1194,6 +1194,55 @@ static void ext4_fc_update_stats(struct super_block *sb, int status,
 	trace_ext4_fc_commit_stop(sb, nblks, status, commit_tid);
 }
 
+/*
+ * Account a successful fast commit to the batch size histogram. Every fsync
+ * caller bumps s_fc_batch_pending on entry; the caller doing the commit
+ * collects all of them, including those which were covered by it and skip
+ * their own commit.
+ */
+static void ext4_fc_update_batch_stats(struct super_block *sb)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	int batch = atomic_xchg(&sbi->s_fc_batch_pending, 0);
+
+	if (batch <= 0)
+		return;
+	sbi->s_fc_stats.fc_batch_hist[min_t(int, ilog2(batch),
+					    EXT4_FC_BATCH_HIST_SIZE - 1)]++;
+}
+
+/*
+ * Group commit: when fsync callers from different tasks race for fast
+ * commits, hold the commit back for about one average fast commit time,
+ * but no longer than s_fc_max_batch_time, so that the other callers get to
+ * queue their inodes and a single fast commit covers all of them. This
+ * mirrors the batching jbd2 does for synchronous handles.
+ *
+ * Returns true if we waited.
+ */
+static bool ext4_fc_batch_wait(struct super_block *sb)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	pid_t pid = current->pid;
+	ktime_t expires;
+	u64 window;
+
+	if (!sbi->s_fc_max_batch_time ||
+	    READ_ONCE(sbi->s_fc_last_sync_writer) == pid)
+		return false;
+	WRITE_ONCE(sbi->s_fc_last_sync_writer, pid);
+
+	window = min_t(u64, sbi->s_fc_stats.s_fc_avg_commit_time,
+		       1000ULL * sbi->s_fc_max_batch_time);
+	if (!window)
+		return false;
+
+	expires = ktime_add_ns(ktime_get(), window);
+	set_current_state(TASK_UNINTERRUPTIBLE);
+	schedule_hrtimeout(&expires, HRTIMER_MODE_ABS);
+	return true;
+}
+
 /*
  * The main commit entry point. Performs a fast commit for transaction
  * commit_tid if needed. If it's not possible to perform a fast commit
@@ -1205,17 +1254,40 @@ int ext4_fc_commit(journal_t *journal, tid_t commit_tid)
 	struct super_block *sb = journal->j_private;
 	struct ext4_sb_info *sbi = EXT4_SB(sb);
 	int nblks = 0, ret, bsize = journal->j_blocksize;
-	int subtid = atomic_read(&sbi->s_fc_subtid);
+	int subtid;
+	bool ongoing;
 	int status = EXT4_FC_STATUS_OK, fc_bufs_before = 0;
 	ktime_t start_time, commit_time;
 
 	if (!test_opt2(sb, JOURNAL_FAST_COMMIT))
 		return jbd2_complete_transaction(journal, commit_tid);
 
+	/* join the batch before sampling subtid, see ext4_fc_update_batch_stats */
+	atomic_inc(&sbi->s_fc_batch_pending);
+	/*
+	 * A commit that is running now may have missed our updates, sample
+	 * that before subtid: it bumps subtid before clearing the flag.
+	 */
+	ongoing = READ_ONCE(journal->j_flags) &
+		  (JBD2_FAST_COMMIT_ONGOING | JBD2_FULL_COMMIT_ONGOING);
+	smp_rmb();
+	subtid = atomic_read(&sbi->s_fc_subtid);
+
 	trace_ext4_fc_commit_start(sb, commit_tid);
 
 	start_time = ktime_get();
 
+	/*
+	 * A fast commit that started after we got called and completed while
+	 * we were batching covers all of our updates.
+	 */
+	if (ext4_fc_batch_wait(sb) &&
+	    atomic_read(&sbi->s_fc_subtid) > subtid + (ongoing ? 1 : 0)) {
+		ext4_fc_update_stats(sb, EXT4_FC_STATUS_SKIPPED, 0, 0,
+				commit_tid);
+		return 0;
+	}
+
 restart_fc:
 	ret = jbd2_fc_begin_commit(journal, commit_tid);
 	if (ret == -EALREADY) {
@@ -1258,6 +1330,7 @@ int ext4_fc_commit(journal_t *journal, tid_t commit_tid)
 		goto fallback;
 	}
 	atomic_inc(&sbi->s_fc_subtid);
+	ext4_fc_update_batch_stats(sb);
 	ret = jbd2_fc_end_commit(journal);
 	/*
 	 * weight the commit time higher than the average time so we
@@ -1268,6 +1341,8 @@ int ext4_fc_commit(journal_t *journal, tid_t commit_tid)
 	return ret;
 
 fallback:
+	/* the full commit serves the waiting callers, not a fast commit batch */
+	atomic_set(&sbi->s_fc_batch_pending, 0);
 	ret = jbd2_fc_end_commit_fallback(journal);
 	ext4_fc_update_stats(sb, status, 0, 0, commit_tid);
 	return ret;
@@ -2313,6 +2388,12 @@ int ext4_fc_info_show(struct seq_file *seq, void *v)
 	for (i = 0; i < EXT4_FC_REASON_MAX; i++)
 		seq_printf(seq, "\"%s\":\t%d\n", fc_ineligible_reasons[i],
 			stats->fc_ineligible_reason_count[i]);
+	seq_puts(seq, "Batch sizes:\n");
+	seq_printf(seq, "\"1\":\t%lu\n", stats->fc_batch_hist[0]);
+	for (i = 1; i < EXT4_FC_BATCH_HIST_SIZE - 1; i++)
+		seq_printf(seq, "\"%d-%d\":\t%lu\n", 1 << i, (2 << i) - 1,
+			   stats->fc_batch_hist[i]);
+	seq_printf(seq, "\"%d+\":\t%lu\n", 1 << i, stats->fc_batch_hist[i]);
 
 	return 0;
 }
@@ -115,6 +115,12 @@ struct ext4_fc_dentry_update {
 	struct list_head fcd_dilist;
 };
 
+/*
+ * Number of fsync callers served by one fast commit, in log2 sized buckets:
+ * 1, 2-3, 4-7, ..., 128+.
+ */
+#define EXT4_FC_BATCH_HIST_SIZE		8
+
 struct ext4_fc_stats {
 	unsigned int fc_ineligible_reason_count[EXT4_FC_REASON_MAX];
 	unsigned long fc_num_commits;
@@ -122,6 +128,7 @@ struct ext4_fc_stats {
 	unsigned long fc_failed_commits;
 	unsigned long fc_skipped_commits;
 	unsigned long fc_numblks;
+	unsigned long fc_batch_hist[EXT4_FC_BATCH_HIST_SIZE];
 	u64 s_fc_avg_commit_time;
 };
 
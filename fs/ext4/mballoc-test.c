@@ -933,6 +933,61 @@ static void test_mb_mark_used_cost(struct kunit *test)
 	ext4_mb_unload_buddy(&e4b);
 }
 
+static void test_mb_pcpu_refill_len(struct kunit *test)
+{
+	struct super_block *sb = (struct super_block *)test->priv;
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	unsigned int prealloc = sbi->s_mb_group_prealloc;
+	ext4_grpblk_t max = EXT4_CLUSTERS_PER_GROUP(sb);
+
+	/* mode disabled: refills are plain group preallocations */
+	sbi->s_mb_pcpu_batch = 0;
+	KUNIT_EXPECT_EQ(test, ext4_mb_pcpu_refill_len(sb),
+			min_t(ext4_grpblk_t, prealloc, max));
+
+	sbi->s_mb_pcpu_batch = 1;
+	KUNIT_EXPECT_EQ(test, ext4_mb_pcpu_refill_len(sb),
+			min_t(ext4_grpblk_t, prealloc, max));
+
+	sbi->s_mb_pcpu_batch = 4;
+	KUNIT_EXPECT_EQ(test, ext4_mb_pcpu_refill_len(sb),
+			min_t(ext4_grpblk_t, prealloc * 4, max));
+
+	/* a refill never spans more than one group */
+	sbi->s_mb_pcpu_batch = UINT_MAX;
+	KUNIT_EXPECT_EQ(test, ext4_mb_pcpu_refill_len(sb), max);
+
+	sbi->s_mb_pcpu_batch = MB_DEFAULT_PCPU_BATCH;
+}
+
+static void test_mb_pcpu_goal_group(struct kunit *test)
+{
+	struct super_block *sb = (struct super_block *)test->priv;
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	ext4_group_t ngroups = ext4_get_groups_count(sb);
+	struct ext4_locality_group *lg;
+	ext4_group_t prev = 0;
+	int cpu;
+
+	/* refills of consecutive CPUs are spread over the groups in order */
+	for_each_possible_cpu(cpu) {
+		lg = per_cpu_ptr(sbi->s_locality_groups, cpu);
+		KUNIT_EXPECT_LT(test, lg->lg_goal_group, ngroups);
+		KUNIT_EXPECT_EQ(test, ext4_mb_pcpu_goal_group(lg, ngroups),
+				lg->lg_goal_group);
+		KUNIT_EXPECT_GE(test, lg->lg_goal_group, prev);
+		prev = lg->lg_goal_group;
+	}
+
+	/* out of range goals are folded back for block mapped files */
+	lg = per_cpu_ptr(sbi->s_locality_groups, 0);
+	prev = lg->lg_goal_group;
+	lg->lg_goal_group = ngroups + 1;
+	KUNIT_EXPECT_EQ(test, ext4_mb_pcpu_goal_group(lg, ngroups), 1);
+	KUNIT_EXPECT_EQ(test, ext4_mb_pcpu_goal_group(lg, 1), 0);
+	lg->lg_goal_group = prev;
+}
+
 static const struct mbt_ext4_block_layout mbt_test_layouts[] = {
 	{
 		.blocksize_bits = 10,
@@ -975,6 +1030,8 @@ static struct kunit_case mbt_test_cases[] = {
 	KUNIT_CASE_PARAM(test_mb_mark_used, mbt_layouts_gen_params),
 	KUNIT_CASE_PARAM(test_mb_free_blocks, mbt_layouts_gen_params),
 	KUNIT_CASE_PARAM(test_mark_diskspace_used, mbt_layouts_gen_params),
+	KUNIT_CASE_PARAM(test_mb_pcpu_refill_len, mbt_layouts_gen_params),
+	KUNIT_CASE_PARAM(test_mb_pcpu_goal_group, mbt_layouts_gen_params),
 	KUNIT_CASE_PARAM_ATTR(test_mb_mark_used_cost, mbt_layouts_gen_params,
 			      { .speed = KUNIT_SPEED_SLOW }),
 	{}
@@ -2172,6 +2172,15 @@ static void ext4_mb_use_best_found(struct ext4_allocation_context *ac,
 		sbi->s_mb_last_start = ac->ac_f_ex.fe_start;
 		spin_unlock(&sbi->s_md_lock);
 	}
+	/*
+	 * Remember where the per-CPU cache was refilled from so that the next
+	 * refill on this CPU starts there. Protected by lg_mutex.
+	 */
+	if (ac->ac_lg) {
+		ac->ac_lg->lg_refills++;
+		if (sbi->s_mb_pcpu_batch)
+			ac->ac_lg->lg_goal_group = ac->ac_f_ex.fe_group;
+	}
 	/*
 	 * As we've just preallocated more space than
 	 * user requested originally, we store allocated
@@ -2793,6 +2802,18 @@ void ext4_mb_prefetch_fini(struct super_block *sb, ext4_group_t group,
 	}
 }
 
+/*
+ * Starting group for a per-CPU cache refill. Block mapped files can only use
+ * the first s_blockfile_groups groups, so lg_goal_group may be out of range.
+ */
+static ext4_group_t ext4_mb_pcpu_goal_group(struct ext4_locality_group *lg,
+					    ext4_group_t ngroups)
+{
+	if (lg->lg_goal_group >= ngroups)
+		return lg->lg_goal_group % ngroups;
+	return lg->lg_goal_group;
+}
+
 static noinline_for_stack int
 ext4_mb_regular_allocator(struct ext4_allocation_context *ac)
 {
@@ -2851,6 +2872,14 @@ ext4_mb_regular_allocator(struct ext4_allocation_context *ac)
 		spin_unlock(&sbi->s_md_lock);
 	}
 
+	/*
+	 * Batched per-CPU refills start from the group this CPU was last
+	 * refilled from, so that CPUs keep away from each other's groups.
+	 */
+	if (ac->ac_lg && sbi->s_mb_pcpu_batch)
+		ac->ac_g_ex.fe_group = ext4_mb_pcpu_goal_group(ac->ac_lg,
+							       ngroups);
+
 	/*
 	 * Let's just scan groups to find more-less suitable blocks We
 	 * start with CR_GOAL_LEN_FAST, unless it is power of 2
@@ -3092,10 +3121,29 @@ const struct seq_operations ext4_mb_seq_groups_ops = {
 	.show   = ext4_mb_seq_groups_show,
 };
 
+void ext4_mb_pcpu_stats(struct super_block *sb, unsigned long *hits,
+			unsigned long *refills)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	int i;
+
+	*hits = *refills = 0;
+	if (!sbi->s_locality_groups)
+		return;
+	for_each_possible_cpu(i) {
+		struct ext4_locality_group *lg;
+
+		lg = per_cpu_ptr(sbi->s_locality_groups, i);
+		*hits += READ_ONCE(lg->lg_hits);
+		*refills += READ_ONCE(lg->lg_refills);
+	}
+}
+
 int ext4_seq_mb_stats_show(struct seq_file *seq, void *offset)
 {
 	struct super_block *sb = seq->private;
 	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	unsigned long pcpu_hits, pcpu_refills;
 
 	seq_puts(seq, "mballoc:\n");
 	if (!sbi->s_mb_stats) {
@@ -3188,6 +3236,9 @@ int ext4_seq_mb_stats_show(struct seq_file *seq, void *offset)
 	seq_printf(seq, "\t\t2^n_hits: %u\n", atomic_read(&sbi->s_bal_2orders));
 	seq_printf(seq, "\t\tbreaks: %u\n", atomic_read(&sbi->s_bal_breaks));
 	seq_printf(seq, "\t\tlost: %u\n", atomic_read(&sbi->s_mb_lost_chunks));
+	ext4_mb_pcpu_stats(sb, &pcpu_hits, &pcpu_refills);
+	seq_printf(seq, "\tpcpu_cache_hits: %lu\n", pcpu_hits);
+	seq_printf(seq, "\tpcpu_cache_refills: %lu\n", pcpu_refills);
 	seq_printf(seq, "\tbuddies_generated: %u/%u\n",
 		   atomic_read(&sbi->s_mb_buddies_generated),
 		   ext4_get_groups_count(sb));
@@ -3683,6 +3734,7 @@ int ext4_mb_init(struct super_block *sb)
 	sbi->s_mb_stream_request = MB_DEFAULT_STREAM_THRESHOLD;
 	sbi->s_mb_order2_reqs = MB_DEFAULT_ORDER2_REQS;
 	sbi->s_mb_best_avail_max_trim_order = MB_DEFAULT_BEST_AVAIL_TRIM_ORDER;
+	sbi->s_mb_pcpu_batch = MB_DEFAULT_PCPU_BATCH;
 
 	/*
 	 * The default group preallocation is 512, which for 4k block
@@ -3723,6 +3775,9 @@ int ext4_mb_init(struct super_block *sb)
 		for (j = 0; j < PREALLOC_TB_SIZE; j++)
 			INIT_LIST_HEAD(&lg->lg_prealloc_list[j]);
 		spin_lock_init(&lg->lg_prealloc_lock);
+		/* spread the per-CPU refills evenly over the groups */
+		lg->lg_goal_group = div_u64((u64)i * ext4_get_groups_count(sb),
+					    nr_cpu_ids);
 	}
 
 	if (bdev_nonrot(sb->s_bdev))
@@ -4201,6 +4256,22 @@ void ext4_mb_mark_bb(struct super_block *sb, ext4_fsblk_t block,
 	}
 }
 
+/*
+ * Size of a locality group refill. With mb_pcpu_batch set, a refill grabs
+ * several group preallocations worth of space at once, so that the following
+ * small allocations on this CPU are served from its prealloc lists without
+ * scanning groups or taking group locks. A refill never exceeds one group.
+ */
+static ext4_grpblk_t ext4_mb_pcpu_refill_len(struct super_block *sb)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	u64 len = sbi->s_mb_group_prealloc;
+
+	if (sbi->s_mb_pcpu_batch > 1)
+		len *= sbi->s_mb_pcpu_batch;
+	return min_t(u64, len, EXT4_CLUSTERS_PER_GROUP(sb));
+}
+
 /*
  * here we normalize request for locality group
  * Group request are normalized to s_mb_group_prealloc, which goes to
@@ -4216,7 +4287,7 @@ static void ext4_mb_normalize_group_request(struct ext4_allocation_context *ac)
 	struct ext4_locality_group *lg = ac->ac_lg;
 
 	BUG_ON(lg == NULL);
-	ac->ac_g_ex.fe_len = EXT4_SB(sb)->s_mb_group_prealloc;
+	ac->ac_g_ex.fe_len = ext4_mb_pcpu_refill_len(sb);
 	mb_debug(sb, "goal %u blocks for locality group\n", ac->ac_g_ex.fe_len);
 }
 
@@ -4974,6 +5045,7 @@ ext4_mb_use_preallocated(struct ext4_allocation_context *ac)
 	}
 	if (cpa) {
 		ext4_mb_use_group_pa(ac, cpa);
+		lg->lg_hits++;
 		return true;
 	}
 	return false;
@@ -6969,7 +7041,14 @@ int ext4_trim_fs(struct super_block *sb, struct fstrim_range *range)
 		 */
 		if (group == last_group)
 			end = last_cluster;
-		if (grp->bb_free >= minlen) {
+		/*
+		 * Groups that had no blocks freed since they were last trimmed
+		 * with at most this minlen are skipped without loading their
+		 * buddy. ext4_trim_all_free() rechecks under the group lock.
+		 */
+		if (grp->bb_free >= minlen &&
+		    !(EXT4_MB_GRP_WAS_TRIMMED(grp) &&
+		      minlen >= EXT4_SB(sb)->s_last_trim_minblks)) {
 			cnt = ext4_trim_all_free(sb, group, first_cluster,
 						 end, minlen);
 			if (cnt < 0) {
@@ -73,6 +73,12 @@
  */
 #define MB_DEFAULT_GROUP_PREALLOC	512
 
+/*
+ * Number of group prealloc sized chunks refilled at once into the per-CPU
+ * locality group cache when mb_pcpu_batch is enabled; 0 disables the mode.
+ */
+#define MB_DEFAULT_PCPU_BATCH		0
+
 /*
  * Number of groups to search linearly before performing group scanning
  * optimization.
@@ -168,6 +174,12 @@ struct ext4_locality_group {
 	/* list of preallocations */
 	struct list_head	lg_prealloc_list[PREALLOC_TB_SIZE];
 	spinlock_t		lg_prealloc_lock;
+	/* group the per-CPU cache is refilled from (mb_pcpu_batch mode) */
+	ext4_group_t		lg_goal_group;
+	/* allocations served from the prealloc lists, under lg_mutex */
+	unsigned long		lg_hits;
+	/* refills of the prealloc lists from the buddy cache */
+	unsigned long		lg_refills;
 };
 
 struct ext4_allocation_context {
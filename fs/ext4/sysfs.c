@@ -40,6 +40,8 @@ typedef enum {
 	attr_pointer_string,
 	attr_pointer_atomic,
 	attr_journal_task,
+	attr_mb_pcpu_hits,
+	attr_mb_pcpu_refills,
 } attr_id_t;
 
 typedef enum {
@@ -130,6 +132,16 @@ static ssize_t trigger_test_error(struct ext4_sb_info *sbi,
 	return count;
 }
 
+static ssize_t mb_pcpu_stats_show(struct ext4_sb_info *sbi, int attr_id,
+				  char *buf)
+{
+	unsigned long hits, refills;
+
+	ext4_mb_pcpu_stats(sbi->s_sb, &hits, &refills);
+	return sysfs_emit(buf, "%lu\n",
+			  attr_id == attr_mb_pcpu_hits ? hits : refills);
+}
+
 static ssize_t journal_task_show(struct ext4_sb_info *sbi, char *buf)
 {
 	if (!sbi->s_journal)
@@ -210,6 +222,8 @@ EXT4_ATTR_FUNC(session_write_kbytes, 0444);
 EXT4_ATTR_FUNC(lifetime_write_kbytes, 0444);
 EXT4_ATTR_FUNC(reserved_clusters, 0644);
 EXT4_ATTR_FUNC(sra_exceeded_retry_limit, 0444);
+EXT4_ATTR_FUNC(mb_pcpu_hits, 0444);
+EXT4_ATTR_FUNC(mb_pcpu_refills, 0444);
 
 EXT4_ATTR_OFFSET(inode_readahead_blks, 0644, inode_readahead,
 		 ext4_sb_info, s_inode_readahead_blks);
@@ -224,6 +238,8 @@ EXT4_RW_ATTR_SBI_UI(mb_min_to_scan, s_mb_min_to_scan);
 EXT4_RW_ATTR_SBI_UI(mb_order2_req, s_mb_order2_reqs);
 EXT4_RW_ATTR_SBI_UI(mb_stream_req, s_mb_stream_request);
 EXT4_RW_ATTR_SBI_UI(mb_max_linear_groups, s_mb_max_linear_groups);
+EXT4_RW_ATTR_SBI_UI(mb_pcpu_batch, s_mb_pcpu_batch);
+EXT4_RW_ATTR_SBI_UI(fc_max_batch_time, s_fc_max_batch_time);
 EXT4_RW_ATTR_SBI_UI(extent_max_zeroout_kb, s_extent_max_zeroout_kb);
 EXT4_ATTR(trigger_fs_error, 0200, trigger_test_error);
 EXT4_RW_ATTR_SBI_PI(err_ratelimit_interval_ms, s_err_ratelimit_state.interval);
@@ -273,8 +289,12 @@ static struct attribute *ext4_attrs[] = {
 	ATTR_LIST(mb_stream_req),
 	ATTR_LIST(mb_group_prealloc),
 	ATTR_LIST(mb_max_linear_groups),
+	ATTR_LIST(mb_pcpu_batch),
+	ATTR_LIST(mb_pcpu_hits),
+	ATTR_LIST(mb_pcpu_refills),
 	ATTR_LIST(max_writeback_mb_bump),
 	ATTR_LIST(extent_max_zeroout_kb),
+	ATTR_LIST(fc_max_batch_time),
 	ATTR_LIST(trigger_fs_error),
 	ATTR_LIST(err_ratelimit_interval_ms),
 	ATTR_LIST(err_ratelimit_burst),
@@ -439,6 +459,9 @@ static ssize_t ext4_attr_show(struct kobject *kobj,
 		return print_tstamp(buf, sbi->s_es, s_last_error_time);
 	case attr_journal_task:
 		return journal_task_show(sbi, buf);
+	case attr_mb_pcpu_hits:
+	case attr_mb_pcpu_refills:
+		return mb_pcpu_stats_show(sbi, a->attr_id, buf);
 	default:
 		return ext4_generic_attr_show(a, sbi, buf);
 	}
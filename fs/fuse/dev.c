@@ -21,6 +21,8 @@
 #include <linux/swap.h>
 #include <linux/splice.h>
 #include <linux/sched.h>
+#include <linux/sched/mm.h>
+#include <linux/percpu.h>
 
 #define CREATE_TRACE_POINTS
 #include "fuse_trace.h"
@@ -216,21 +218,9 @@ unsigned int fuse_len_args(unsigned int numargs, struct fuse_arg *args)
 }
 EXPORT_SYMBOL_GPL(fuse_len_args);
 
-static u64 fuse_get_unique_locked(struct fuse_iqueue *fiq)
-{
-	fiq->reqctr += FUSE_REQ_ID_STEP;
-	return fiq->reqctr;
-}
-
 u64 fuse_get_unique(struct fuse_iqueue *fiq)
 {
-	u64 ret;
-
-	spin_lock(&fiq->lock);
-	ret = fuse_get_unique_locked(fiq);
-	spin_unlock(&fiq->lock);
-
-	return ret;
+	return atomic64_add_return(FUSE_REQ_ID_STEP, &fiq->reqctr);
 }
 EXPORT_SYMBOL_GPL(fuse_get_unique);
 
@@ -284,12 +274,48 @@ static void fuse_dev_queue_interrupt(struct fuse_iqueue *fiq, struct fuse_req *r
 	}
 }
 
+/*
+ * Queue the request on the per-CPU input queue of the submitting CPU if a
+ * device is bound to it.  Returns false if the request has to go through
+ * fiq->pending instead.
+ */
+static bool fuse_dev_queue_req_cpu(struct fuse_iqueue *fiq,
+				   struct fuse_req *req)
+{
+	struct fuse_conn *fc = container_of(fiq, struct fuse_conn, iq);
+	struct fuse_iqueue_cpu __percpu *iq_cpu = READ_ONCE(fc->iq_cpu);
+	struct fuse_iqueue_cpu *iqc;
+
+	if (!iq_cpu)
+		return false;
+
+	iqc = per_cpu_ptr(iq_cpu, raw_smp_processor_id());
+	spin_lock(&iqc->lock);
+	/* fuse_abort_conn() clears fiq->connected before draining iqc */
+	if (!iqc->nr_devs || !READ_ONCE(fiq->connected)) {
+		spin_unlock(&iqc->lock);
+		return false;
+	}
+	if (req->in.h.opcode != FUSE_NOTIFY_REPLY)
+		req->in.h.unique = fuse_get_unique(fiq);
+	req->iqc = iqc;
+	list_add_tail(&req->list, &iqc->pending);
+	wake_up(&iqc->waitq);
+	spin_unlock(&iqc->lock);
+	kill_fasync(&fiq->fasync, SIGIO, POLL_IN);
+
+	return true;
+}
+
 static void fuse_dev_queue_req(struct fuse_iqueue *fiq, struct fuse_req *req)
 {
+	if (fuse_dev_queue_req_cpu(fiq, req))
+		return;
+
 	spin_lock(&fiq->lock);
 	if (fiq->connected) {
 		if (req->in.h.opcode != FUSE_NOTIFY_REPLY)
-			req->in.h.unique = fuse_get_unique_locked(fiq);
+			req->in.h.unique = fuse_get_unique(fiq);
 		list_add_tail(&req->list, &fiq->pending);
 		fuse_dev_wake_and_unlock(fiq);
 	} else {
@@ -418,6 +444,40 @@ static int queue_interrupt(struct fuse_req *req)
 	return 0;
 }
 
+/*
+ * Remove a request that has not been read by userspace yet from whichever
+ * input queue it is on.  Requests only ever move from a per-CPU queue to
+ * fiq->pending, so once req->iqc is seen as NULL fiq->lock is sufficient.
+ */
+static bool fuse_remove_pending(struct fuse_iqueue *fiq, struct fuse_req *req)
+{
+	struct fuse_iqueue_cpu *iqc;
+	bool removed = false;
+
+	while ((iqc = READ_ONCE(req->iqc))) {
+		spin_lock(&iqc->lock);
+		if (req->iqc == iqc) {
+			if (test_bit(FR_PENDING, &req->flags)) {
+				list_del(&req->list);
+				req->iqc = NULL;
+				removed = true;
+			}
+			spin_unlock(&iqc->lock);
+			return removed;
+		}
+		spin_unlock(&iqc->lock);
+	}
+
+	spin_lock(&fiq->lock);
+	if (test_bit(FR_PENDING, &req->flags)) {
+		list_del(&req->list);
+		removed = true;
+	}
+	spin_unlock(&fiq->lock);
+
+	return removed;
+}
+
 static void request_wait_answer(struct fuse_req *req)
 {
 	struct fuse_conn *fc = req->fm->fc;
@@ -445,16 +505,12 @@ static void request_wait_answer(struct fuse_req *req)
 		if (!err)
 			return;
 
-		spin_lock(&fiq->lock);
 		/* Request is not yet in userspace, bail out */
-		if (test_bit(FR_PENDING, &req->flags)) {
-			list_del(&req->list);
-			spin_unlock(&fiq->lock);
+		if (fuse_remove_pending(fiq, req)) {
 			__fuse_put_request(req);
 			req->out.h.error = -EINTR;
 			return;
 		}
-		spin_unlock(&fiq->lock);
 	}
 
 	/*
@@ -704,6 +760,7 @@ struct fuse_copy_state {
 	unsigned len;
 	unsigned offset;
 	unsigned move_pages:1;
+	struct fuse_dev_buf *buf;
 };
 
 static void fuse_copy_init(struct fuse_copy_state *cs, int write,
@@ -733,6 +790,151 @@ static void fuse_copy_finish(struct fuse_copy_state *cs)
 	cs->pg = NULL;
 }
 
+static void fuse_dev_buf_put(struct fuse_dev_buf *buf)
+{
+	if (!buf || !refcount_dec_and_test(&buf->count))
+		return;
+
+	mmu_interval_notifier_remove(&buf->notifier);
+	unpin_user_pages(buf->pages, buf->nr_pages);
+	/* Nothing to unaccount once the address space has gone away */
+	if (mmget_not_zero(buf->mm)) {
+		account_locked_vm(buf->mm, buf->nr_pages, false);
+		mmput(buf->mm);
+	}
+	mmdrop(buf->mm);
+	kvfree(buf->pages);
+	kfree_rcu(buf, rcu);
+}
+
+/*
+ * A change to the mapping of the registered range (munmap, mremap,
+ * MAP_FIXED over it, exit, ...) means the pinned pages may no longer be what
+ * the server sees at those addresses.  Bumping the sequence makes
+ * mmu_interval_check_retry() fail, and the next device read or write checks
+ * the range again, see fuse_dev_buf_revalidate().
+ *
+ * Protection changes (mprotect, NUMA hinting, soft-dirty and uffd write
+ * protection) and device migration, which gives up on pinned pages, leave
+ * the pinned pages mapped, so they don't need that.
+ */
+static bool fuse_dev_buf_invalidate(struct mmu_interval_notifier *mni,
+				    const struct mmu_notifier_range *range,
+				    unsigned long cur_seq)
+{
+	switch (range->event) {
+	case MMU_NOTIFY_PROTECTION_VMA:
+	case MMU_NOTIFY_PROTECTION_PAGE:
+	case MMU_NOTIFY_SOFT_DIRTY:
+	case MMU_NOTIFY_MIGRATE:
+		return true;
+	default:
+		break;
+	}
+
+	mmu_interval_set_seq(mni, cur_seq);
+	return true;
+}
+
+/*
+ * Many invalidations still leave the pinned pages mapped, e.g. a migration,
+ * compaction or KSM merge that gave up on them.  Compare the pages mapped at
+ * the range now with the pinned ones, and keep using the buffer if nothing
+ * changed.  Once a page did change, device io falls back to pinning the
+ * current pages until the server registers the buffer again.
+ */
+static bool fuse_dev_buf_revalidate(struct fuse_dev_buf *buf)
+{
+	struct page **pages;
+	unsigned long seq;
+	bool same = false;
+	long pinned;
+
+	if (test_bit(FUSE_DEV_BUF_STALE, &buf->flags) ||
+	    test_and_set_bit_lock(FUSE_DEV_BUF_REVALIDATING, &buf->flags))
+		return false;
+
+	pages = kvmalloc_array(buf->nr_pages, sizeof(*pages), GFP_KERNEL);
+	if (!pages)
+		goto out;
+
+	seq = mmu_interval_read_begin(&buf->notifier);
+	pinned = pin_user_pages_fast(buf->addr, buf->nr_pages, FOLL_WRITE,
+				     pages);
+	if (pinned == buf->nr_pages)
+		same = !memcmp(pages, buf->pages,
+			       buf->nr_pages * sizeof(*pages));
+	if (pinned > 0)
+		unpin_user_pages(pages, pinned);
+	kvfree(pages);
+
+	if (!same)
+		set_bit(FUSE_DEV_BUF_STALE, &buf->flags);
+	else if (mmu_interval_read_retry(&buf->notifier, seq))
+		same = false;	/* invalidated again, check next time */
+	else
+		WRITE_ONCE(buf->notifier_seq, seq);
+out:
+	clear_bit_unlock(FUSE_DEV_BUF_REVALIDATING, &buf->flags);
+	return same;
+}
+
+static const struct mmu_interval_notifier_ops fuse_dev_buf_notifier_ops = {
+	.invalidate = fuse_dev_buf_invalidate,
+};
+
+static struct fuse_dev_buf *fuse_dev_buf_get(struct fuse_dev *fud)
+{
+	struct fuse_dev_buf *buf;
+
+	rcu_read_lock();
+	buf = rcu_dereference(fud->buf);
+	/* The pinned pages only describe the registering process' memory */
+	if (buf && (buf->mm != current->mm ||
+		    !refcount_inc_not_zero(&buf->count)))
+		buf = NULL;
+	rcu_read_unlock();
+
+	if (buf && mmu_interval_check_retry(&buf->notifier,
+					    READ_ONCE(buf->notifier_seq)) &&
+	    !fuse_dev_buf_revalidate(buf)) {
+		fuse_dev_buf_put(buf);
+		buf = NULL;
+	}
+
+	return buf;
+}
+
+/*
+ * Use the pinned page of the registered buffer if the current segment of
+ * the userspace buffer starts within it.
+ */
+static bool fuse_copy_fill_buf(struct fuse_copy_state *cs)
+{
+	struct fuse_dev_buf *buf = cs->buf;
+	unsigned long uaddr, off;
+	size_t len;
+
+	if (!buf || !user_backed_iter(cs->iter) ||
+	    mmu_interval_check_retry(&buf->notifier,
+				     READ_ONCE(buf->notifier_seq)))
+		return false;
+
+	uaddr = (unsigned long) iter_iov_addr(cs->iter);
+	len = iter_iov_len(cs->iter);
+	if (!len || uaddr < buf->addr || uaddr - buf->addr >= buf->len)
+		return false;
+
+	off = uaddr - buf->addr;
+	cs->pg = buf->pages[off >> PAGE_SHIFT];
+	cs->offset = offset_in_page(off);
+	cs->len = min_t(size_t, len, PAGE_SIZE - cs->offset);
+	get_page(cs->pg);
+	iov_iter_advance(cs->iter, cs->len);
+
+	return true;
+}
+
 /*
  * Get another pagefull of userspace buffer, and map it to kernel
  * address space, and lock request
@@ -781,7 +983,7 @@ static int fuse_copy_fill(struct fuse_copy_state *cs)
 			cs->pipebufs++;
 			cs->nr_segs++;
 		}
-	} else {
+	} else if (!fuse_copy_fill_buf(cs)) {
 		size_t off;
 		err = iov_iter_get_pages2(cs->iter, &page, PAGE_SIZE, 1, &off);
 		if (err < 0)
@@ -1169,7 +1371,7 @@ __releases(fiq->lock)
 	struct fuse_in_header ih = {
 		.opcode = FUSE_FORGET,
 		.nodeid = forget->forget_one.nodeid,
-		.unique = fuse_get_unique_locked(fiq),
+		.unique = fuse_get_unique(fiq),
 		.len = sizeof(ih) + sizeof(arg),
 	};
 
@@ -1200,7 +1402,7 @@ __releases(fiq->lock)
 	struct fuse_batch_forget_in arg = { .count = 0 };
 	struct fuse_in_header ih = {
 		.opcode = FUSE_BATCH_FORGET,
-		.unique = fuse_get_unique_locked(fiq),
+		.unique = fuse_get_unique(fiq),
 		.len = sizeof(ih) + sizeof(arg),
 	};
 
@@ -1249,6 +1451,51 @@ __releases(fiq->lock)
 		return fuse_read_batch_forget(fiq, cs, nbytes);
 }
 
+static bool fuse_iqc_ready(struct fuse_iqueue *fiq, struct fuse_iqueue_cpu *iqc)
+{
+	return !READ_ONCE(fiq->connected) || !list_empty_careful(&iqc->pending);
+}
+
+/*
+ * Dequeue the next request for a device bound to a per-CPU input queue.
+ * Returns the request or an ERR_PTR.
+ */
+static struct fuse_req *fuse_dev_dequeue_cpu(struct fuse_conn *fc,
+					     struct fuse_iqueue_cpu *iqc,
+					     struct file *file)
+{
+	struct fuse_iqueue *fiq = &fc->iq;
+	struct fuse_req *req;
+	int err;
+
+	for (;;) {
+		spin_lock(&iqc->lock);
+		if (fuse_iqc_ready(fiq, iqc))
+			break;
+		spin_unlock(&iqc->lock);
+
+		if (file->f_flags & O_NONBLOCK)
+			return ERR_PTR(-EAGAIN);
+		err = wait_event_interruptible_exclusive(iqc->waitq,
+				fuse_iqc_ready(fiq, iqc));
+		if (err)
+			return ERR_PTR(err);
+	}
+
+	if (!READ_ONCE(fiq->connected)) {
+		spin_unlock(&iqc->lock);
+		return ERR_PTR(fc->aborted ? -ECONNABORTED : -ENODEV);
+	}
+
+	req = list_entry(iqc->pending.next, struct fuse_req, list);
+	clear_bit(FR_PENDING, &req->flags);
+	list_del_init(&req->list);
+	req->iqc = NULL;
+	spin_unlock(&iqc->lock);
+
+	return req;
+}
+
 /*
  * Read a single request into the userspace filesystem's buffer.  This
  * function waits until a request is available, then removes it from
@@ -1261,6 +1508,7 @@ __releases(fiq->lock)
 static ssize_t fuse_dev_do_read(struct fuse_dev *fud, struct file *file,
 				struct fuse_copy_state *cs, size_t nbytes)
 {
+	struct fuse_iqueue_cpu *iqc = READ_ONCE(fud->iqc);
 	ssize_t err;
 	struct fuse_conn *fc = fud->fc;
 	struct fuse_iqueue *fiq = &fc->iq;
@@ -1289,6 +1537,13 @@ static ssize_t fuse_dev_do_read(struct fuse_dev *fud, struct file *file,
 		return -EINVAL;
 
  restart:
+	if (iqc) {
+		req = fuse_dev_dequeue_cpu(fc, iqc, file);
+		if (IS_ERR(req))
+			return PTR_ERR(req);
+		goto dequeued;
+	}
+
 	for (;;) {
 		spin_lock(&fiq->lock);
 		if (!fiq->connected || request_pending(fiq))
@@ -1327,6 +1582,7 @@ static ssize_t fuse_dev_do_read(struct fuse_dev *fud, struct file *file,
 	list_del_init(&req->list);
 	spin_unlock(&fiq->lock);
 
+ dequeued:
 	args = req->args;
 	reqsize = req->in.h.len;
 
@@ -1412,6 +1668,7 @@ static ssize_t fuse_dev_read(struct kiocb *iocb, struct iov_iter *to)
 	struct fuse_copy_state cs;
 	struct file *file = iocb->ki_filp;
 	struct fuse_dev *fud = fuse_get_dev(file);
+	ssize_t ret;
 
 	if (!fud)
 		return -EPERM;
@@ -1420,8 +1677,12 @@ static ssize_t fuse_dev_read(struct kiocb *iocb, struct iov_iter *to)
 		return -EINVAL;
 
 	fuse_copy_init(&cs, 1, to);
+	cs.buf = fuse_dev_buf_get(fud);
+
+	ret = fuse_dev_do_read(fud, file, &cs, iov_iter_count(to));
+	fuse_dev_buf_put(cs.buf);
 
-	return fuse_dev_do_read(fud, file, &cs, iov_iter_count(to));
+	return ret;
 }
 
 static ssize_t fuse_dev_splice_read(struct file *in, loff_t *ppos,
@@ -2075,6 +2336,7 @@ static ssize_t fuse_dev_write(struct kiocb *iocb, struct iov_iter *from)
 {
 	struct fuse_copy_state cs;
 	struct fuse_dev *fud = fuse_get_dev(iocb->ki_filp);
+	ssize_t ret;
 
 	if (!fud)
 		return -EPERM;
@@ -2083,8 +2345,12 @@ static ssize_t fuse_dev_write(struct kiocb *iocb, struct iov_iter *from)
 		return -EINVAL;
 
 	fuse_copy_init(&cs, 0, from);
+	cs.buf = fuse_dev_buf_get(fud);
 
-	return fuse_dev_do_write(fud, &cs, iov_iter_count(from));
+	ret = fuse_dev_do_write(fud, &cs, iov_iter_count(from));
+	fuse_dev_buf_put(cs.buf);
+
+	return ret;
 }
 
 static ssize_t fuse_dev_splice_write(struct pipe_inode_info *pipe,
@@ -2185,12 +2451,27 @@ static __poll_t fuse_dev_poll(struct file *file, poll_table *wait)
 {
 	__poll_t mask = EPOLLOUT | EPOLLWRNORM;
 	struct fuse_iqueue *fiq;
+	struct fuse_iqueue_cpu *iqc;
 	struct fuse_dev *fud = fuse_get_dev(file);
 
 	if (!fud)
 		return EPOLLERR;
 
 	fiq = &fud->fc->iq;
+	iqc = READ_ONCE(fud->iqc);
+	if (iqc) {
+		poll_wait(file, &iqc->waitq, wait);
+
+		spin_lock(&iqc->lock);
+		if (!READ_ONCE(fiq->connected))
+			mask = EPOLLERR;
+		else if (!list_empty(&iqc->pending))
+			mask |= EPOLLIN | EPOLLRDNORM;
+		spin_unlock(&iqc->lock);
+
+		return mask;
+	}
+
 	poll_wait(file, &fiq->waitq, wait);
 
 	spin_lock(&fiq->lock);
@@ -2231,6 +2512,33 @@ static void end_polls(struct fuse_conn *fc)
 	}
 }
 
+/*
+ * Called after fiq->connected has been cleared, so nothing new can be queued
+ * on the per-CPU queues.
+ */
+static void fuse_abort_iq_cpu(struct fuse_conn *fc, struct list_head *to_end)
+{
+	struct fuse_iqueue_cpu __percpu *iq_cpu = READ_ONCE(fc->iq_cpu);
+	struct fuse_iqueue_cpu *iqc;
+	struct fuse_req *req;
+	int cpu;
+
+	if (!iq_cpu)
+		return;
+
+	for_each_possible_cpu(cpu) {
+		iqc = per_cpu_ptr(iq_cpu, cpu);
+		spin_lock(&iqc->lock);
+		list_for_each_entry(req, &iqc->pending, list) {
+			clear_bit(FR_PENDING, &req->flags);
+			req->iqc = NULL;
+		}
+		list_splice_tail_init(&iqc->pending, to_end);
+		wake_up_all(&iqc->waitq);
+		spin_unlock(&iqc->lock);
+	}
+}
+
 /*
  * Abort all requests.
  *
@@ -2302,6 +2610,7 @@ void fuse_abort_conn(struct fuse_conn *fc)
 			kfree(fuse_dequeue_forget(fiq, 1, NULL));
 		wake_up_all(&fiq->waitq);
 		spin_unlock(&fiq->lock);
+		fuse_abort_iq_cpu(fc, &to_end);
 		kill_fasync(&fiq->fasync, SIGIO, POLL_IN);
 		end_polls(fc);
 		wake_up_all(&fc->blocked_waitq);
@@ -2321,6 +2630,32 @@ void fuse_wait_aborted(struct fuse_conn *fc)
 	wait_event(fc->blocked_waitq, atomic_read(&fc->num_waiting) == 0);
 }
 
+/*
+ * Drop a device's binding to a per-CPU input queue.  When the last device
+ * bound to the queue goes away, whatever is still pending on it is handed
+ * over to fiq->pending so that the remaining devices can pick it up.
+ */
+static void fuse_dev_unbind_cpu(struct fuse_dev *fud)
+{
+	struct fuse_iqueue_cpu *iqc = fud->iqc;
+	struct fuse_iqueue *fiq = &fud->fc->iq;
+	struct fuse_req *req;
+
+	if (!iqc)
+		return;
+
+	spin_lock(&iqc->lock);
+	if (!--iqc->nr_devs && !list_empty(&iqc->pending)) {
+		spin_lock(&fiq->lock);
+		list_for_each_entry(req, &iqc->pending, list)
+			req->iqc = NULL;
+		list_splice_tail_init(&iqc->pending, &fiq->pending);
+		fuse_dev_wake_and_unlock(fiq);
+	}
+	spin_unlock(&iqc->lock);
+	fud->iqc = NULL;
+}
+
 int fuse_dev_release(struct inode *inode, struct file *file)
 {
 	struct fuse_dev *fud = fuse_get_dev(file);
@@ -2339,6 +2674,9 @@ int fuse_dev_release(struct inode *inode, struct file *file)
 
 		end_requests(&to_end);
 
+		fuse_dev_unbind_cpu(fud);
+		fuse_dev_buf_put(rcu_replace_pointer(fud->buf, NULL, true));
+
 		/* Are we the last open device? */
 		if (atomic_dec_and_test(&fc->dev_count)) {
 			WARN_ON(fc->iq.fasync != NULL);
@@ -2443,6 +2781,166 @@ static long fuse_dev_ioctl_backing_close(struct file *file, __u32 __user *argp)
 	return fuse_backing_close(fud->fc, backing_id);
 }
 
+static long fuse_dev_ioctl_bind_cpu(struct file *file, __u32 __user *argp)
+{
+	struct fuse_dev *fud = fuse_get_dev(file);
+	struct fuse_iqueue_cpu __percpu *iq_cpu;
+	struct fuse_iqueue_cpu *iqc;
+	struct fuse_conn *fc;
+	__u32 cpu;
+	int i;
+
+	if (!fud)
+		return -EPERM;
+
+	if (get_user(cpu, argp))
+		return -EFAULT;
+
+	if (cpu >= nr_cpu_ids || !cpu_possible(cpu))
+		return -EINVAL;
+
+	fc = fud->fc;
+	iq_cpu = READ_ONCE(fc->iq_cpu);
+	if (!iq_cpu) {
+		iq_cpu = alloc_percpu(struct fuse_iqueue_cpu);
+		if (!iq_cpu)
+			return -ENOMEM;
+
+		for_each_possible_cpu(i) {
+			iqc = per_cpu_ptr(iq_cpu, i);
+			spin_lock_init(&iqc->lock);
+			init_waitqueue_head(&iqc->waitq);
+			INIT_LIST_HEAD(&iqc->pending);
+		}
+
+		if (cmpxchg(&fc->iq_cpu, NULL, iq_cpu)) {
+			free_percpu(iq_cpu);
+			iq_cpu = fc->iq_cpu;
+		}
+	}
+
+	iqc = per_cpu_ptr(iq_cpu, cpu);
+	spin_lock(&iqc->lock);
+	if (fud->iqc) {
+		spin_unlock(&iqc->lock);
+		return -EBUSY;
+	}
+	iqc->nr_devs++;
+	WRITE_ONCE(fud->iqc, iqc);
+	spin_unlock(&iqc->lock);
+
+	return 0;
+}
+
+/* Attempts to pin the registered buffer without it being remapped meanwhile */
+#define FUSE_DEV_BUF_PIN_TRIES	3
+
+static long fuse_dev_ioctl_register_buf(struct file *file,
+					struct fuse_dev_buf_reg __user *argp)
+{
+	struct fuse_dev *fud = fuse_get_dev(file);
+	struct fuse_dev_buf_reg reg;
+	struct fuse_dev_buf *buf;
+	unsigned long nr_pages;
+	long pinned;
+	int tries;
+	int err;
+
+	if (!fud)
+		return -EPERM;
+
+	if (copy_from_user(&reg, argp, sizeof(reg)))
+		return -EFAULT;
+
+	if (!reg.addr && !reg.len) {
+		buf = unrcu_pointer(xchg(&fud->buf, NULL));
+		if (!buf)
+			return -ENOENT;
+		fuse_dev_buf_put(buf);
+		return 0;
+	}
+
+	if (!reg.len || !PAGE_ALIGNED(reg.addr) || !PAGE_ALIGNED(reg.len) ||
+	    !access_ok(u64_to_user_ptr(reg.addr), reg.len))
+		return -EINVAL;
+
+	if (rcu_access_pointer(fud->buf))
+		return -EBUSY;
+
+	nr_pages = reg.len >> PAGE_SHIFT;
+	if (nr_pages > INT_MAX)
+		return -EINVAL;
+
+	buf = kzalloc(sizeof(*buf), GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+
+	err = -ENOMEM;
+	buf->pages = kvmalloc_array(nr_pages, sizeof(struct page *), GFP_KERNEL);
+	if (!buf->pages)
+		goto out_free;
+
+	/* Watch the range before pinning so that no remap can be missed */
+	err = mmu_interval_notifier_insert(&buf->notifier, current->mm, reg.addr,
+					   reg.len, &fuse_dev_buf_notifier_ops);
+	if (err)
+		goto out_free;
+
+	err = account_locked_vm(current->mm, nr_pages, true);
+	if (err)
+		goto out_remove;
+
+	/*
+	 * A long term pin may migrate the pages first, which itself
+	 * invalidates the range, so retry until the pages we hold are the
+	 * ones mapped after the last invalidation.
+	 */
+	for (tries = 1; ; tries++) {
+		buf->notifier_seq = mmu_interval_read_begin(&buf->notifier);
+		pinned = pin_user_pages_fast(reg.addr, nr_pages,
+					     FOLL_WRITE | FOLL_LONGTERM,
+					     buf->pages);
+		if (pinned != nr_pages) {
+			err = pinned < 0 ? pinned : -EFAULT;
+			break;
+		}
+		if (!mmu_interval_read_retry(&buf->notifier, buf->notifier_seq))
+			break;
+		if (tries == FUSE_DEV_BUF_PIN_TRIES) {
+			err = -EAGAIN;
+			break;
+		}
+		unpin_user_pages(buf->pages, pinned);
+	}
+	if (err) {
+		if (pinned > 0)
+			unpin_user_pages(buf->pages, pinned);
+		account_locked_vm(current->mm, nr_pages, false);
+		goto out_remove;
+	}
+
+	buf->addr = reg.addr;
+	buf->len = reg.len;
+	buf->nr_pages = nr_pages;
+	buf->mm = current->mm;
+	mmgrab(buf->mm);
+	refcount_set(&buf->count, 1);
+
+	if (cmpxchg(&fud->buf, NULL, RCU_INITIALIZER(buf))) {
+		fuse_dev_buf_put(buf);
+		return -EBUSY;
+	}
+
+	return 0;
+
+out_remove:
+	mmu_interval_notifier_remove(&buf->notifier);
+out_free:
+	kvfree(buf->pages);
+	kfree(buf);
+	return err;
+}
+
 static long fuse_dev_ioctl(struct file *file, unsigned int cmd,
 			   unsigned long arg)
 {
@@ -2458,6 +2956,12 @@ static long fuse_dev_ioctl(struct file *file, unsigned int cmd,
 	case FUSE_DEV_IOC_BACKING_CLOSE:
 		return fuse_dev_ioctl_backing_close(file, argp);
 
+	case FUSE_DEV_IOC_BIND_CPU:
+		return fuse_dev_ioctl_bind_cpu(file, argp);
+
+	case FUSE_DEV_IOC_REGISTER_BUF:
+		return fuse_dev_ioctl_register_buf(file, argp);
+
 	default:
 		return -ENOTTY;
 	}
@@ -1658,6 +1658,31 @@ static const char *fuse_get_link(struct dentry *dentry, struct inode *inode,
 	return ERR_PTR(err);
 }
 
+static int fuse_dir_passthrough_open(struct inode *inode, struct file *file)
+{
+	struct fuse_file *ff = file->private_data;
+	struct fuse_conn *fc = get_fuse_conn(inode);
+	int err;
+
+	err = -EINVAL;
+	if (!IS_ENABLED(CONFIG_FUSE_PASSTHROUGH) || !fc->passthrough ||
+	    !ff->args)
+		goto fail;
+
+	err = fuse_passthrough_open_dir(file, inode,
+					ff->args->open_outarg.backing_id);
+	if (err)
+		goto fail;
+
+	return 0;
+
+fail:
+	pr_debug("failed to open dir in passthrough mode (open_flags=0x%x, err=%i).\n",
+		 ff->open_flags, err);
+	/* Same as for regular files, a bad open mode is a server mistake */
+	return -EIO;
+}
+
 static int fuse_dir_open(struct inode *inode, struct file *file)
 {
 	struct fuse_mount *fm = get_fuse_mount(inode);
@@ -1683,6 +1708,13 @@ static int fuse_dir_open(struct inode *inode, struct file *file)
 			nonseekable_open(inode, file);
 		if (!(ff->open_flags & FOPEN_KEEP_CACHE))
 			invalidate_inode_pages2(inode->i_mapping);
+
+		/* Serve readdir from the backing directory, see fuse_readdir() */
+		if (ff->open_flags & FOPEN_PASSTHROUGH) {
+			err = fuse_dir_passthrough_open(inode, file);
+			if (err)
+				fuse_release_common(file, true);
+		}
 	}
 
 	return err;
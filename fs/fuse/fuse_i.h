@@ -20,6 +20,7 @@
 #include <linux/list.h>
 #include <linux/spinlock.h>
 #include <linux/mm.h>
+#include <linux/mmu_notifier.h>
 #include <linux/backing-dev.h>
 #include <linux/mutex.h>
 #include <linux/rwsem.h>
@@ -438,6 +439,9 @@ struct fuse_req {
 
 	/** fuse_mount this request belongs to */
 	struct fuse_mount *fm;
+
+	/** Per-CPU input queue while pending on it, see struct fuse_iqueue_cpu */
+	struct fuse_iqueue_cpu *iqc;
 };
 
 struct fuse_iqueue;
@@ -486,7 +490,7 @@ struct fuse_iqueue {
 	wait_queue_head_t waitq;
 
 	/** The next unique request id */
-	u64 reqctr;
+	atomic64_t reqctr;
 
 	/** The list of pending requests */
 	struct list_head pending;
@@ -511,6 +515,66 @@ struct fuse_iqueue {
 	void *priv;
 };
 
+/**
+ * Per-CPU input queue used when devices are bound to CPUs with
+ * FUSE_DEV_IOC_BIND_CPU.  Requests submitted on a CPU with at least one bound
+ * device are queued here instead of on fc->iq, so that they can be read and
+ * answered without touching the shared input queue.  Interrupts, forgets and
+ * requests from CPUs without a bound device still go through fc->iq.
+ */
+struct fuse_iqueue_cpu {
+	/** Lock protecting accesses to members of this structure */
+	spinlock_t lock;
+
+	/** Readers bound to this queue are waiting on this */
+	wait_queue_head_t waitq;
+
+	/** The list of pending requests */
+	struct list_head pending;
+
+	/** Number of devices bound to this queue */
+	unsigned int nr_devs;
+};
+
+/**
+ * Server buffer pinned with FUSE_DEV_IOC_REGISTER_BUF.  Reads and writes on
+ * the device that fall within it use the pinned pages instead of pinning the
+ * user pages on every request, as long as the range stays mapped as it was
+ * at registration.
+ */
+struct fuse_dev_buf {
+	/** Start and length of the buffer in the server's address space */
+	unsigned long addr;
+	unsigned long len;
+
+	/** Pinned pages backing the buffer */
+	unsigned long nr_pages;
+	struct page **pages;
+
+	/** The mm the pages are accounted to */
+	struct mm_struct *mm;
+
+	/** Notices the range being unmapped or remapped */
+	struct mmu_interval_notifier notifier;
+
+	/** Notifier sequence the pages were pinned at, see fuse_copy_fill_buf() */
+	unsigned long notifier_seq;
+
+	/** FUSE_DEV_BUF_* bits */
+	unsigned long flags;
+
+	refcount_t count;
+	struct rcu_head rcu;
+};
+
+/** Bits in fuse_dev_buf::flags */
+enum {
+	/** The pages mapped at the range are compared with the pinned ones */
+	FUSE_DEV_BUF_REVALIDATING,
+	/** The pinned pages are no longer the ones mapped at the range */
+	FUSE_DEV_BUF_STALE,
+};
+
 #define FUSE_PQ_HASH_BITS 8
 #define FUSE_PQ_HASH_SIZE (1 << FUSE_PQ_HASH_BITS)
 
@@ -540,6 +604,12 @@ struct fuse_dev {
 
 	/** list entry on fc->devices */
 	struct list_head entry;
+
+	/** Per-CPU input queue this device reads from, NULL for fc->iq */
+	struct fuse_iqueue_cpu *iqc;
+
+	/** Pinned server buffer, see FUSE_DEV_IOC_REGISTER_BUF */
+	struct fuse_dev_buf __rcu *buf;
 };
 
 enum fuse_dax_mode {
@@ -636,6 +706,9 @@ struct fuse_conn {
 	/** Input queue */
 	struct fuse_iqueue iq;
 
+	/** Per-CPU input queues, allocated on first FUSE_DEV_IOC_BIND_CPU */
+	struct fuse_iqueue_cpu __percpu *iq_cpu;
+
 	/** The next unique kernel file handle */
 	atomic64_t khctr;
 
@@ -1476,6 +1549,8 @@ struct fuse_backing *fuse_passthrough_open(struct file *file,
 					   struct inode *inode,
 					   int backing_id);
 void fuse_passthrough_release(struct fuse_file *ff, struct fuse_backing *fb);
+int fuse_passthrough_open_dir(struct file *file, struct inode *inode,
+			      int backing_id);
 
 static inline struct file *fuse_file_passthrough(struct fuse_file *ff)
 {
@@ -1495,6 +1570,7 @@ ssize_t fuse_passthrough_splice_write(struct pipe_inode_info *pipe,
 				      struct file *out, loff_t *ppos,
 				      size_t len, unsigned int flags);
 ssize_t fuse_passthrough_mmap(struct file *file, struct vm_area_struct *vma);
+int fuse_passthrough_readdir(struct file *file, struct dir_context *ctx);
 
 #ifdef CONFIG_SYSCTL
 extern int fuse_sysctl_register(void);
@@ -129,6 +129,30 @@ ssize_t fuse_passthrough_splice_write(struct pipe_inode_info *pipe,
 	return ret;
 }
 
+int fuse_passthrough_readdir(struct file *file, struct dir_context *ctx)
+{
+	struct fuse_file *ff = file->private_data;
+	struct file *backing_file = fuse_file_passthrough(ff);
+	const struct cred *old_cred;
+	int ret;
+
+	pr_debug("%s: backing_file=0x%p, pos=%lld\n", __func__,
+		 backing_file, ctx->pos);
+
+	/*
+	 * The backing directory stream stays open for the life of the fuse
+	 * file, so its position is the fuse file position.
+	 */
+	old_cred = override_creds(ff->cred);
+	backing_file->f_pos = ctx->pos;
+	ret = iterate_dir(backing_file, ctx);
+	revert_creds(old_cred);
+
+	fuse_file_accessed(file);
+
+	return ret;
+}
+
 ssize_t fuse_passthrough_mmap(struct file *file, struct vm_area_struct *vma)
 {
 	struct fuse_file *ff = file->private_data;
@@ -343,6 +367,31 @@ struct fuse_backing *fuse_passthrough_open(struct file *file,
 	return err ? ERR_PTR(err) : fb;
 }
 
+/*
+ * Setup readdir passthrough to a backing directory.
+ *
+ * Directories have no inode io mode, so unlike regular files the fb reference
+ * is not kept; the backing file holds its own reference to the real path.
+ */
+int fuse_passthrough_open_dir(struct file *file, struct inode *inode,
+			      int backing_id)
+{
+	struct fuse_file *ff = file->private_data;
+	struct fuse_backing *fb;
+
+	fb = fuse_passthrough_open(file, inode, backing_id);
+	if (IS_ERR(fb))
+		return PTR_ERR(fb);
+
+	fuse_backing_put(fb);
+	if (!S_ISDIR(file_inode(ff->passthrough)->i_mode)) {
+		fuse_passthrough_release(ff, NULL);
+		return -ENOTDIR;
+	}
+
+	return 0;
+}
+
 void fuse_passthrough_release(struct fuse_file *ff, struct fuse_backing *fb)
 {
 	pr_debug("%s: fb=0x%p, backing_file=0x%p\n", __func__,
@@ -178,6 +178,42 @@ static void iomap_set_range_dirty(struct folio *folio, size_t off, size_t len)
 		ifs_set_range_dirty(folio, ifs, off, len);
 }
 
+/*
+ * Mark the blocks covered by a buffered write uptodate and dirty with a single
+ * trip through the state lock.  @len is the length that write_begin prepared
+ * for, @copied what actually ended up in the folio.
+ */
+static void iomap_set_range_written(struct folio *folio, size_t off,
+		size_t len, size_t copied)
+{
+	struct iomap_folio_state *ifs = folio->private;
+	struct inode *inode = folio->mapping->host;
+	bool uptodate = folio_test_uptodate(folio);
+	unsigned long flags;
+
+	if (!ifs) {
+		if (!uptodate)
+			folio_mark_uptodate(folio);
+		return;
+	}
+
+	spin_lock_irqsave(&ifs->state_lock, flags);
+	if (!uptodate)
+		uptodate = ifs_set_range_uptodate(folio, ifs, off, len);
+	if (copied) {
+		unsigned int first_blk = off >> inode->i_blkbits;
+		unsigned int last_blk = (off + copied - 1) >> inode->i_blkbits;
+
+		bitmap_set(ifs->state,
+			   first_blk + i_blocks_per_folio(inode, folio),
+			   last_blk - first_blk + 1);
+	}
+	spin_unlock_irqrestore(&ifs->state_lock, flags);
+
+	if (uptodate && !folio_test_uptodate(folio))
+		folio_mark_uptodate(folio);
+}
+
 static struct iomap_folio_state *ifs_alloc(struct inode *inode,
 		struct folio *folio, unsigned int flags)
 {
@@ -858,8 +894,7 @@ static bool __iomap_write_end(struct inode *inode, loff_t pos, size_t len,
 	 */
 	if (unlikely(copied < len && !folio_test_uptodate(folio)))
 		return false;
-	iomap_set_range_uptodate(folio, offset_in_folio(folio, pos), len);
-	iomap_set_range_dirty(folio, offset_in_folio(folio, pos), copied);
+	iomap_set_range_written(folio, offset_in_folio(folio, pos), len, copied);
 	filemap_dirty_folio(inode->i_mapping, folio);
 	return true;
 }
@@ -86,6 +86,11 @@ static void netfs_unlock_read_folio(struct netfs_io_subrequest *subreq,
 /*
  * Unlock any folios that are now completely read.  Returns true if the
  * subrequest is removed from the list.
+ *
+ * This is called for each subrequest as it makes progress, in whatever order
+ * they complete, so a slow subrequest only holds back the folios it covers.
+ * A folio that straddles two subrequests is passed by donation to whichever
+ * of them completes last.
  */
 static bool netfs_consume_read_data(struct netfs_io_subrequest *subreq, bool was_async)
 {
@@ -501,7 +506,10 @@ void netfs_read_subreq_terminated(struct netfs_io_subrequest *subreq,
 			netfs_consume_read_data(subreq, was_async);
 			__set_bit(NETFS_SREQ_MADE_PROGRESS, &subreq->flags);
 		}
+		/* Subrequests may be terminated concurrently. */
+		spin_lock_bh(&rreq->lock);
 		rreq->transferred += subreq->transferred;
+		spin_unlock_bh(&rreq->lock);
 	}
 
 	/* Deal with retry requests, short reads and errors.  If we retry
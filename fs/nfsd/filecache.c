@@ -66,12 +66,19 @@ struct nfsd_fcache_disposal {
 	struct list_head freeme;
 };
 
+/* GC of the LRU list of one NUMA node, run on that node */
+struct nfsd_file_gc_node {
+	struct work_struct work;
+	int nid;
+};
+
 static struct kmem_cache		*nfsd_file_slab;
 static struct kmem_cache		*nfsd_file_mark_slab;
 static struct list_lru			nfsd_file_lru;
 static unsigned long			nfsd_file_flags;
 static struct fsnotify_group		*nfsd_file_fsnotify_group;
 static struct delayed_work		nfsd_filecache_laundrette;
+static struct nfsd_file_gc_node		*nfsd_file_gc_nodes;
 static struct rhltable			nfsd_file_rhltable
 						____cacheline_aligned_in_smp;
 
@@ -539,17 +546,37 @@ nfsd_file_lru_cb(struct list_head *item, struct list_lru_one *lru,
 }
 
 static void
-nfsd_file_gc(void)
+nfsd_file_gc_node_worker(struct work_struct *work)
 {
+	struct nfsd_file_gc_node *gcn =
+		container_of(work, struct nfsd_file_gc_node, work);
 	LIST_HEAD(dispose);
-	unsigned long ret;
+	unsigned long nr, ret;
 
-	ret = list_lru_walk(&nfsd_file_lru, nfsd_file_lru_cb,
-			    &dispose, list_lru_count(&nfsd_file_lru));
+	nr = list_lru_count_node(&nfsd_file_lru, gcn->nid);
+	ret = list_lru_walk_node(&nfsd_file_lru, gcn->nid, nfsd_file_lru_cb,
+				 &dispose, &nr);
 	trace_nfsd_file_gc_removed(ret, list_lru_count(&nfsd_file_lru));
 	nfsd_file_dispose_list_delayed(&dispose);
 }
 
+/*
+ * The LRU keeps a list per NUMA node, holding the nfsd_files allocated on
+ * that node. Walk each of them from a worker on the same node, so that GC
+ * doesn't pull the cachelines of remote entries across the interconnect.
+ */
+static void
+nfsd_file_gc(void)
+{
+	int nid;
+
+	for_each_node(nid) {
+		if (list_lru_count_node(&nfsd_file_lru, nid))
+			queue_work_node(nid, system_unbound_wq,
+					&nfsd_file_gc_nodes[nid].work);
+	}
+}
+
 static void
 nfsd_file_gc_worker(struct work_struct *work)
 {
@@ -561,7 +588,7 @@ nfsd_file_gc_worker(struct work_struct *work)
 static unsigned long
 nfsd_file_lru_count(struct shrinker *s, struct shrink_control *sc)
 {
-	return list_lru_count(&nfsd_file_lru);
+	return list_lru_shrink_count(&nfsd_file_lru, sc);
 }
 
 static unsigned long
@@ -740,7 +767,7 @@ static const struct fsnotify_ops nfsd_file_fsnotify_ops = {
 int
 nfsd_file_cache_init(void)
 {
-	int ret;
+	int ret, nid;
 
 	lockdep_assert_held(&nfsd_mutex);
 	if (test_and_set_bit(NFSD_FILE_CACHE_UP, &nfsd_file_flags) == 1)
@@ -769,11 +796,24 @@ nfsd_file_cache_init(void)
 		goto out_err;
 	}
 
-	nfsd_file_shrinker = shrinker_alloc(0, "nfsd-filecache");
+	nfsd_file_gc_nodes = kcalloc(nr_node_ids, sizeof(*nfsd_file_gc_nodes),
+				     GFP_KERNEL);
+	if (!nfsd_file_gc_nodes) {
+		ret = -ENOMEM;
+		goto out_lru;
+	}
+	for_each_node(nid) {
+		INIT_WORK(&nfsd_file_gc_nodes[nid].work,
+			  nfsd_file_gc_node_worker);
+		nfsd_file_gc_nodes[nid].nid = nid;
+	}
+
+	nfsd_file_shrinker = shrinker_alloc(SHRINKER_NUMA_AWARE,
+					    "nfsd-filecache");
 	if (!nfsd_file_shrinker) {
 		ret = -ENOMEM;
 		pr_err("nfsd: failed to allocate nfsd_file_shrinker\n");
-		goto out_lru;
+		goto out_gc_nodes;
 	}
 
 	nfsd_file_shrinker->count_objects = nfsd_file_lru_count;
@@ -807,6 +847,9 @@ nfsd_file_cache_init(void)
 	lease_unregister_notifier(&nfsd_file_lease_notifier);
 out_shrinker:
 	shrinker_free(nfsd_file_shrinker);
+out_gc_nodes:
+	kfree(nfsd_file_gc_nodes);
+	nfsd_file_gc_nodes = NULL;
 out_lru:
 	list_lru_destroy(&nfsd_file_lru);
 out_err:
@@ -912,7 +955,7 @@ nfsd_file_cache_shutdown_net(struct net *net)
 void
 nfsd_file_cache_shutdown(void)
 {
-	int i;
+	int i, nid;
 
 	lockdep_assert_held(&nfsd_mutex);
 	if (test_and_clear_bit(NFSD_FILE_CACHE_UP, &nfsd_file_flags) == 0)
@@ -925,8 +968,12 @@ nfsd_file_cache_shutdown(void)
 	 * calling nfsd_file_cache_purge
 	 */
 	cancel_delayed_work_sync(&nfsd_filecache_laundrette);
+	for_each_node(nid)
+		cancel_work_sync(&nfsd_file_gc_nodes[nid].work);
 	__nfsd_file_cache_purge(NULL);
 	list_lru_destroy(&nfsd_file_lru);
+	kfree(nfsd_file_gc_nodes);
+	nfsd_file_gc_nodes = NULL;
 	rcu_barrier();
 	fsnotify_put_group(nfsd_file_fsnotify_group);
 	nfsd_file_fsnotify_group = NULL;
@@ -1279,6 +1326,34 @@ nfsd_file_acquire_opened(struct svc_rqst *rqstp, struct svc_fh *fhp,
 				    fhp, may_flags, file, pnf, false);
 }
 
+/*
+ * Hits and misses are counted against the node of the nfsd thread doing the
+ * lookup, lru entries against the node the nfsd_file was allocated on.
+ */
+static void nfsd_file_cache_node_stats_show(struct seq_file *m)
+{
+	unsigned long hits, acquisitions, lru;
+	int nid, cpu;
+
+	for_each_online_node(nid) {
+		hits = acquisitions = lru = 0;
+		for_each_cpu(cpu, cpumask_of_node(nid)) {
+			hits += per_cpu(nfsd_file_cache_hits, cpu);
+			acquisitions += per_cpu(nfsd_file_acquisitions, cpu);
+		}
+
+		mutex_lock(&nfsd_mutex);
+		if (test_bit(NFSD_FILE_CACHE_UP, &nfsd_file_flags) == 1)
+			lru = list_lru_count_node(&nfsd_file_lru, nid);
+		mutex_unlock(&nfsd_mutex);
+
+		seq_printf(m, "node%d lru entries: %lu\n", nid, lru);
+		seq_printf(m, "node%d cache hits: %lu\n", nid, hits);
+		seq_printf(m, "node%d cache misses: %lu\n", nid,
+			   acquisitions > hits ? acquisitions - hits : 0);
+	}
+}
+
 /*
  * Note that fields may be added, removed or reordered in the future. Programs
  * scraping this file for info should test the labels to ensure they're
@@ -1329,5 +1404,8 @@ int nfsd_file_cache_stats_show(struct seq_file *m, void *v)
 		seq_printf(m, "mean age (ms): %ld\n", total_age / releases);
 	else
 		seq_printf(m, "mean age (ms): -\n");
+
+	if (num_online_nodes() > 1)
+		nfsd_file_cache_node_stats_show(m);
 	return 0;
 }
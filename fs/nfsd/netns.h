@@ -179,7 +179,7 @@ struct nfsd_net {
 	 */
 
 	/* total number of entries */
-	atomic_t                 num_drc_entries;
+	struct percpu_counter    num_drc_entries;
 
 	/* Per-netns stats counters */
 	struct percpu_counter    counter[NFSD_STATS_COUNTERS_NUM];
@@ -195,6 +195,9 @@ struct nfsd_net {
 
 	struct shrinker		*nfsd_reply_cache_shrinker;
 
+	/* prunes expired DRC entries off the request path */
+	struct delayed_work	drc_prune_work;
+
 	/* tracking server-to-server copy mounts */
 	spinlock_t              nfsd_ssc_lock;
 	struct list_head        nfsd_ssc_mount_list;
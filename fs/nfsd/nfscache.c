@@ -29,6 +29,9 @@
  */
 #define TARGET_BUCKET_SIZE	64
 
+/* How often expired entries are pruned while the cache is not empty */
+#define RC_PRUNE_INTERVAL	HZ
+
 struct nfsd_drc_bucket {
 	struct rb_root rb_head;
 	struct list_head lru_head;
@@ -42,6 +45,7 @@ static unsigned long nfsd_reply_cache_count(struct shrinker *shrink,
 					    struct shrink_control *sc);
 static unsigned long nfsd_reply_cache_scan(struct shrinker *shrink,
 					   struct shrink_control *sc);
+static void nfsd_reply_cache_prune_work(struct work_struct *work);
 
 /*
  * Put a cap on the size of the DRC based on the amount of available
@@ -141,7 +145,7 @@ nfsd_cacherep_unlink_locked(struct nfsd_net *nn, struct nfsd_drc_bucket *b,
 	if (rp->c_state != RC_UNUSED) {
 		rb_erase(&rp->c_node, &b->rb_head);
 		list_del(&rp->c_lru);
-		atomic_dec(&nn->num_drc_entries);
+		percpu_counter_dec(&nn->num_drc_entries);
 		nfsd_stats_drc_mem_usage_sub(nn, sizeof(*rp));
 	}
 }
@@ -181,14 +185,16 @@ int nfsd_reply_cache_init(struct nfsd_net *nn)
 	unsigned int i;
 
 	nn->max_drc_entries = nfsd_cache_size_limit();
-	atomic_set(&nn->num_drc_entries, 0);
+	if (percpu_counter_init(&nn->num_drc_entries, 0, GFP_KERNEL))
+		goto out_nomem;
 	hashsize = nfsd_hashsize(nn->max_drc_entries);
 	nn->maskbits = ilog2(hashsize);
 
 	nn->drc_hashtbl = kvzalloc(array_size(hashsize,
 				sizeof(*nn->drc_hashtbl)), GFP_KERNEL);
 	if (!nn->drc_hashtbl)
-		return -ENOMEM;
+		goto out_hashtbl;
+	INIT_DELAYED_WORK(&nn->drc_prune_work, nfsd_reply_cache_prune_work);
 
 	nn->nfsd_reply_cache_shrinker = shrinker_alloc(0, "nfsd-reply:%s",
 						       nn->nfsd_name);
@@ -211,6 +217,9 @@ int nfsd_reply_cache_init(struct nfsd_net *nn)
 	return 0;
 out_shrinker:
 	kvfree(nn->drc_hashtbl);
+out_hashtbl:
+	percpu_counter_destroy(&nn->num_drc_entries);
+out_nomem:
 	printk(KERN_ERR "nfsd: failed to allocate reply cache\n");
 	return -ENOMEM;
 }
@@ -221,6 +230,7 @@ void nfsd_reply_cache_shutdown(struct nfsd_net *nn)
 	unsigned int i;
 
 	shrinker_free(nn->nfsd_reply_cache_shrinker);
+	cancel_delayed_work_sync(&nn->drc_prune_work);
 
 	for (i = 0; i < nn->drc_hashsize; i++) {
 		struct list_head *head = &nn->drc_hashtbl[i].lru_head;
@@ -234,6 +244,7 @@ void nfsd_reply_cache_shutdown(struct nfsd_net *nn)
 	kvfree(nn->drc_hashtbl);
 	nn->drc_hashtbl = NULL;
 	nn->drc_hashsize = 0;
+	percpu_counter_destroy(&nn->num_drc_entries);
 
 }
 
@@ -257,7 +268,8 @@ nfsd_cache_bucket_find(__be32 xid, struct nfsd_net *nn)
 }
 
 /*
- * Remove and return no more than @max expired entries in bucket @b.
+ * Remove and return the expired entries in bucket @b, or as many entries as
+ * needed to get the cache back under its limit, but no more than @max.
  * If @max is zero, do not limit the number of removed entries.
  */
 static void
@@ -279,18 +291,51 @@ nfsd_prune_bucket_locked(struct nfsd_net *nn, struct nfsd_drc_bucket *b,
 		if (rp->c_state == RC_INPROG)
 			continue;
 
-		if (atomic_read(&nn->num_drc_entries) <= nn->max_drc_entries &&
+		if (percpu_counter_compare(&nn->num_drc_entries,
+					   nn->max_drc_entries) <= 0 &&
 		    time_before(expiry, rp->c_timestamp))
 			break;
 
 		nfsd_cacherep_unlink_locked(nn, b, rp);
 		list_add(&rp->c_lru, dispose);
 
-		if (max && ++freed > max)
+		if (max && ++freed >= max)
 			break;
 	}
 }
 
+/*
+ * Pruning is done here in batches rather than on each insertion, so that
+ * the request path only touches the bucket it hashes to.  The work rearms
+ * itself as long as the cache has entries, and is kicked off again by the
+ * next insertion into an empty cache.
+ */
+static void nfsd_reply_cache_prune_work(struct work_struct *work)
+{
+	struct nfsd_net *nn = container_of(to_delayed_work(work),
+					   struct nfsd_net, drc_prune_work);
+	LIST_HEAD(dispose);
+	unsigned int i;
+
+	for (i = 0; i < nn->drc_hashsize; i++) {
+		struct nfsd_drc_bucket *b = &nn->drc_hashtbl[i];
+
+		if (list_empty(&b->lru_head))
+			continue;
+
+		spin_lock(&b->cache_lock);
+		nfsd_prune_bucket_locked(nn, b, 0, &dispose);
+		spin_unlock(&b->cache_lock);
+
+		nfsd_cacherep_dispose(&dispose);
+		cond_resched();
+	}
+
+	if (percpu_counter_sum_positive(&nn->num_drc_entries))
+		queue_delayed_work(system_unbound_wq, &nn->drc_prune_work,
+				   RC_PRUNE_INTERVAL);
+}
+
 /**
  * nfsd_reply_cache_count - count_objects method for the DRC shrinker
  * @shrink: our registered shrinker context
@@ -306,7 +351,7 @@ nfsd_reply_cache_count(struct shrinker *shrink, struct shrink_control *sc)
 {
 	struct nfsd_net *nn = shrink->private_data;
 
-	return atomic_read(&nn->num_drc_entries);
+	return percpu_counter_read_positive(&nn->num_drc_entries);
 }
 
 /**
@@ -446,12 +491,13 @@ nfsd_cache_insert(struct nfsd_drc_bucket *b, struct nfsd_cacherep *key,
 	/* tally hash chain length stats */
 	if (entries > nn->longest_chain) {
 		nn->longest_chain = entries;
-		nn->longest_chain_cachesize = atomic_read(&nn->num_drc_entries);
+		nn->longest_chain_cachesize =
+			percpu_counter_read_positive(&nn->num_drc_entries);
 	} else if (entries == nn->longest_chain) {
 		/* prefer to keep the smallest cachesize possible here */
 		nn->longest_chain_cachesize = min_t(unsigned int,
 				nn->longest_chain_cachesize,
-				atomic_read(&nn->num_drc_entries));
+				percpu_counter_read_positive(&nn->num_drc_entries));
 	}
 
 	lru_put_end(b, ret);
@@ -509,14 +555,23 @@ int nfsd_cache_lookup(struct svc_rqst *rqstp, unsigned int start,
 		goto found_entry;
 	*cacherep = rp;
 	rp->c_state = RC_INPROG;
-	nfsd_prune_bucket_locked(nn, b, 3, &dispose);
+	/*
+	 * The prune work only runs once per RC_PRUNE_INTERVAL.  Don't let the
+	 * cache grow past its cap meanwhile: make room in this bucket first.
+	 */
+	if (percpu_counter_compare(&nn->num_drc_entries,
+				   nn->max_drc_entries) >= 0)
+		nfsd_prune_bucket_locked(nn, b, 3, &dispose);
 	spin_unlock(&b->cache_lock);
 
 	nfsd_cacherep_dispose(&dispose);
 
 	nfsd_stats_rc_misses_inc(nn);
-	atomic_inc(&nn->num_drc_entries);
+	percpu_counter_inc(&nn->num_drc_entries);
 	nfsd_stats_drc_mem_usage_add(nn, sizeof(*rp));
+	if (!delayed_work_pending(&nn->drc_prune_work))
+		queue_delayed_work(system_unbound_wq, &nn->drc_prune_work,
+				   RC_PRUNE_INTERVAL);
 	goto out;
 
 found_entry:
@@ -660,8 +715,8 @@ int nfsd_reply_cache_stats_show(struct seq_file *m, void *v)
 					  nfsd_net_id);
 
 	seq_printf(m, "max entries:           %u\n", nn->max_drc_entries);
-	seq_printf(m, "num entries:           %u\n",
-		   atomic_read(&nn->num_drc_entries));
+	seq_printf(m, "num entries:           %lld\n",
+		   percpu_counter_sum_positive(&nn->num_drc_entries));
 	seq_printf(m, "hash buckets:          %u\n", 1 << nn->maskbits);
 	seq_printf(m, "mem usage:             %lld\n",
 		   percpu_counter_sum_positive(&nn->counter[NFSD_STATS_DRC_MEM_USAGE]));
@@ -1133,6 +1133,47 @@ static int ovl_copy_up_meta_inode_data(struct ovl_copy_up_ctx *c)
 	return err;
 }
 
+struct ovl_copy_up_work {
+	struct work_struct work;
+	struct dentry *dentry;
+};
+
+static void ovl_copy_up_data_work(struct work_struct *work)
+{
+	struct ovl_copy_up_work *cw =
+		container_of(work, struct ovl_copy_up_work, work);
+	struct dentry *dentry = cw->dentry;
+
+	if (!ovl_want_write(dentry)) {
+		ovl_copy_up_with_data(dentry);
+		ovl_drop_write(dentry);
+	}
+	dput(dentry);
+	kfree(cw);
+}
+
+/*
+ * With async_copyup=on, populate the data of an inode that was just copied up
+ * metadata only in the background, so that a later open for write does not
+ * have to copy it.  Until then reads keep being served from lower data.
+ */
+static void ovl_queue_data_copy_up(struct dentry *dentry)
+{
+	struct ovl_fs *ofs = OVL_FS(dentry->d_sb);
+	struct ovl_copy_up_work *cw;
+
+	if (!ofs->copyup_wq)
+		return;
+
+	cw = kmalloc(sizeof(*cw), GFP_KERNEL);
+	if (!cw)
+		return;
+
+	INIT_WORK(&cw->work, ovl_copy_up_data_work);
+	cw->dentry = dget(dentry);
+	queue_work(ofs->copyup_wq, &cw->work);
+}
+
 static int ovl_copy_up_one(struct dentry *parent, struct dentry *dentry,
 			   int flags)
 {
@@ -1205,6 +1246,8 @@ static int ovl_copy_up_one(struct dentry *parent, struct dentry *dentry,
 		if (!err && ovl_dentry_needs_data_copy_up_locked(dentry, flags))
 			err = ovl_copy_up_meta_inode_data(&ctx);
 		ovl_copy_up_end(dentry);
+		if (!err && ctx.metacopy && !ovl_has_upperdata(d_inode(dentry)))
+			ovl_queue_data_copy_up(dentry);
 	}
 	do_delayed_call(&done);
 
@@ -50,6 +50,7 @@ enum ovl_xattr {
 	OVL_XATTR_METACOPY,
 	OVL_XATTR_PROTATTR,
 	OVL_XATTR_XWHITEOUT,
+	OVL_XATTR_DIRCACHE,
 };
 
 enum ovl_inode_flag {
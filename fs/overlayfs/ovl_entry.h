@@ -17,6 +17,8 @@ struct ovl_config {
 	bool nfs_export;
 	int xino;
 	bool metacopy;
+	bool async_copyup;
+	bool readdir_cache;
 	bool userxattr;
 	bool ovl_volatile;
 };
@@ -90,6 +92,8 @@ struct ovl_fs {
 	bool no_shared_whiteout;
 	/* r/o snapshot of upperdir sb's only taken on volatile mounts */
 	errseq_t errseq;
+	/* Background data copy up after metacopy with async_copyup=on */
+	struct workqueue_struct *copyup_wq;
 };
 
 /* Number of lower layers, not including data-only layers */
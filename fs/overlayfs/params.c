@@ -57,6 +57,8 @@ enum ovl_opt {
 	Opt_userxattr,
 	Opt_xino,
 	Opt_metacopy,
+	Opt_async_copyup,
+	Opt_readdir_cache,
 	Opt_verity,
 	Opt_volatile,
 };
@@ -153,6 +155,8 @@ const struct fs_parameter_spec ovl_parameter_spec[] = {
 	fsparam_flag("userxattr",           Opt_userxattr),
 	fsparam_enum("xino",                Opt_xino, ovl_parameter_xino),
 	fsparam_enum("metacopy",            Opt_metacopy, ovl_parameter_bool),
+	fsparam_enum("async_copyup",        Opt_async_copyup, ovl_parameter_bool),
+	fsparam_enum("readdir_cache",       Opt_readdir_cache, ovl_parameter_bool),
 	fsparam_enum("verity",              Opt_verity, ovl_parameter_verity),
 	fsparam_flag("volatile",            Opt_volatile),
 	{}
@@ -653,6 +657,12 @@ static int ovl_parse_param(struct fs_context *fc, struct fs_parameter *param)
 		config->metacopy = result.uint_32;
 		ctx->set.metacopy = true;
 		break;
+	case Opt_async_copyup:
+		config->async_copyup = result.uint_32;
+		break;
+	case Opt_readdir_cache:
+		config->readdir_cache = result.uint_32;
+		break;
 	case Opt_verity:
 		config->verity_mode = result.uint_32;
 		break;
@@ -785,6 +795,9 @@ void ovl_free_fs(struct ovl_fs *ofs)
 	struct vfsmount **mounts;
 	unsigned i;
 
+	if (ofs->copyup_wq)
+		destroy_workqueue(ofs->copyup_wq);
+
 	iput(ofs->workbasedir_trap);
 	iput(ofs->workdir_trap);
 	dput(ofs->whiteout);
@@ -962,6 +975,11 @@ int ovl_fs_params_verify(const struct ovl_fs_context *ctx,
 			       ovl_verity_mode(config));
 			return -EINVAL;
 		}
+		/* user xattrs of the upper dir can be forged by its owner */
+		if (config->readdir_cache) {
+			pr_err("conflicting options: userxattr,readdir_cache=on\n");
+			return -EINVAL;
+		}
 		/*
 		 * Silently disable default setting of redirect and metacopy.
 		 * This shall be the default in the future as well: these
@@ -990,6 +1008,10 @@ int ovl_fs_params_verify(const struct ovl_fs_context *ctx,
 			pr_err("verity requires permission to access trusted xattrs\n");
 			return -EPERM;
 		}
+		if (config->readdir_cache) {
+			pr_err("readdir_cache requires permission to access trusted xattrs\n");
+			return -EPERM;
+		}
 		if (ctx->nr_data > 0) {
 			pr_err("lower data-only dirs require permission to access trusted xattrs\n");
 			return -EPERM;
@@ -1005,6 +1027,11 @@ int ovl_fs_params_verify(const struct ovl_fs_context *ctx,
 		return -EINVAL;
 	}
 
+	if (config->async_copyup && !config->metacopy) {
+		pr_err("async_copyup requires metacopy support.\n");
+		return -EINVAL;
+	}
+
 	return 0;
 }
 
@@ -1064,6 +1091,10 @@ int ovl_show_options(struct seq_file *m, struct dentry *dentry)
 	if (ofs->config.metacopy != ovl_metacopy_def)
 		seq_printf(m, ",metacopy=%s",
 			   ofs->config.metacopy ? "on" : "off");
+	if (ofs->config.async_copyup)
+		seq_puts(m, ",async_copyup=on");
+	if (ofs->config.readdir_cache)
+		seq_puts(m, ",readdir_cache=on");
 	if (ofs->config.ovl_volatile)
 		seq_puts(m, ",volatile");
 	if (ofs->config.userxattr)
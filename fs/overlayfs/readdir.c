@@ -344,8 +344,9 @@ static void ovl_dir_reset(struct file *file)
 	}
 }
 
-static int ovl_dir_read_merged(struct dentry *dentry, struct list_head *list,
-	struct rb_root *root)
+/* Merge the layers of @dentry from layer index @idx down to the lowest layer */
+static int ovl_dir_read_layers(struct dentry *dentry, struct list_head *list,
+			       struct rb_root *root, int idx)
 {
 	int err;
 	struct path realpath;
@@ -356,10 +357,10 @@ static int ovl_dir_read_merged(struct dentry *dentry, struct list_head *list,
 		.root = root,
 		.is_lowest = false,
 	};
-	int idx, next;
+	int next;
 	const struct ovl_layer *layer;
 
-	for (idx = 0; idx != -1; idx = next) {
+	for (; idx != -1; idx = next) {
 		next = ovl_path_next(idx, dentry, &realpath, &layer);
 		rdd.is_upper = ovl_dentry_upper(dentry) == realpath.dentry;
 		rdd.in_xwhiteouts_dir = layer->has_xwhiteouts &&
@@ -383,6 +384,317 @@ static int ovl_dir_read_merged(struct dentry *dentry, struct list_head *list,
 	return err;
 }
 
+static int ovl_dir_read_merged(struct dentry *dentry, struct list_head *list,
+	struct rb_root *root)
+{
+	return ovl_dir_read_layers(dentry, list, root, 0);
+}
+
+/*
+ * With readdir_cache=on, the merged and whiteout resolved listing of the lower
+ * layers of a merge dir is stored in the "overlay.dircache" xattr of the upper
+ * dir.  Lower layers do not change while mounted, so only the upper dir needs
+ * to be read on a cold readdir if the stored listing is still valid.
+ *
+ * The listing is tagged with the inode number, device, ctime and change cookie
+ * (i_version) of every lower dir in the stack, so it is ignored after a lower
+ * layer was changed offline, or when the dir is mounted with a different lower
+ * stack.  Lower filesystems without a change cookie are not cached, as ctime
+ * alone can miss changes within one timestamp tick.
+ *
+ * The xattr is a trusted one, so only the admin can write it, but its entries
+ * are still checked like names coming from ->iterate_shared() before use.
+ */
+#define OVL_DIRCACHE_VERSION	2
+
+struct ovl_dircache_layer {
+	__le64 ino;
+	__le64 ctime_sec;
+	__le32 ctime_nsec;
+	__le32 dev;
+	__le64 change_cookie;
+} __packed;
+
+struct ovl_dircache_hdr {
+	u8 version;
+	u8 pad;
+	__le16 numlower;
+	__le32 count;
+	struct ovl_dircache_layer layers[];
+} __packed;
+
+struct ovl_dircache_entry {
+	__le64 ino;
+	__le16 len;
+	u8 type;
+	char name[];
+} __packed;
+
+static bool ovl_dircache_enabled(struct dentry *dentry)
+{
+	return OVL_FS(dentry->d_sb)->config.readdir_cache &&
+		ovl_dentry_upper(dentry) && ovl_numlower(OVL_E(dentry)) &&
+		!ovl_dentry_has_xwhiteouts(dentry);
+}
+
+static int ovl_dircache_stat_lower(struct dentry *dentry,
+				   struct ovl_dircache_hdr *hdr)
+{
+	struct ovl_entry *oe = OVL_E(dentry);
+	struct ovl_path *lowerstack = ovl_lowerstack(oe);
+	struct kstat stat;
+	int i, err;
+
+	for (i = 0; i < ovl_numlower(oe); i++) {
+		struct path path = {
+			.mnt = lowerstack[i].layer->mnt,
+			.dentry = lowerstack[i].dentry,
+		};
+
+		err = vfs_getattr(&path, &stat,
+				  STATX_INO | STATX_CTIME | STATX_CHANGE_COOKIE,
+				  AT_STATX_SYNC_AS_STAT);
+		if (err)
+			return err;
+		if (!(stat.result_mask & STATX_CHANGE_COOKIE))
+			return -EOPNOTSUPP;
+
+		hdr->layers[i].ino = cpu_to_le64(stat.ino);
+		hdr->layers[i].ctime_sec = cpu_to_le64(stat.ctime.tv_sec);
+		hdr->layers[i].ctime_nsec = cpu_to_le32(stat.ctime.tv_nsec);
+		hdr->layers[i].dev = cpu_to_le32(new_encode_dev(stat.dev));
+		hdr->layers[i].change_cookie = cpu_to_le64(stat.change_cookie);
+	}
+	hdr->version = OVL_DIRCACHE_VERSION;
+	hdr->numlower = cpu_to_le16(ovl_numlower(oe));
+	return 0;
+}
+
+static bool ovl_dircache_entry_valid(const struct ovl_dircache_entry *ent,
+				     unsigned int len)
+{
+	if (!len || len > NAME_MAX || memchr(ent->name, '/', len) ||
+	    memchr(ent->name, '\0', len))
+		return false;
+
+	/* Whiteouts were resolved before the listing was stored */
+	switch (ent->type) {
+	case DT_UNKNOWN:
+	case DT_FIFO:
+	case DT_CHR:
+	case DT_DIR:
+	case DT_BLK:
+	case DT_REG:
+	case DT_LNK:
+	case DT_SOCK:
+		return true;
+	default:
+		return false;
+	}
+}
+
+static bool ovl_dircache_valid(const void *buf, size_t size,
+			       const struct ovl_dircache_hdr *want,
+			       size_t hdrsize)
+{
+	const struct ovl_dircache_hdr *hdr = buf;
+	const struct ovl_dircache_entry *ent;
+	u32 i, count = le32_to_cpu(hdr->count);
+	size_t pos = hdrsize;
+
+	if (size < hdrsize || hdr->version != want->version ||
+	    hdr->numlower != want->numlower ||
+	    memcmp(hdr->layers, want->layers, hdrsize - sizeof(*hdr)))
+		return false;
+
+	for (i = 0; i < count; i++) {
+		if (size - pos < sizeof(*ent))
+			return false;
+		ent = buf + pos;
+		pos += sizeof(*ent);
+		if (size - pos < le16_to_cpu(ent->len) ||
+		    !ovl_dircache_entry_valid(ent, le16_to_cpu(ent->len)))
+			return false;
+		pos += le16_to_cpu(ent->len);
+	}
+	return pos == size;
+}
+
+static void *ovl_dircache_load(struct dentry *dentry,
+			       const struct ovl_dircache_hdr *want,
+			       size_t hdrsize, size_t *sizep, bool *stale)
+{
+	struct ovl_fs *ofs = OVL_FS(dentry->d_sb);
+	struct dentry *upper = ovl_dentry_upper(dentry);
+	ssize_t size, res;
+	void *buf;
+
+	size = ovl_getxattr_upper(ofs, upper, OVL_XATTR_DIRCACHE, NULL, 0);
+	if (size <= 0)
+		return NULL;
+
+	*stale = true;
+	if (size < hdrsize)
+		return NULL;
+
+	buf = kvmalloc(size, GFP_KERNEL);
+	if (!buf)
+		return NULL;
+
+	res = ovl_getxattr_upper(ofs, upper, OVL_XATTR_DIRCACHE, buf, size);
+	if (res != size || !ovl_dircache_valid(buf, size, want, hdrsize)) {
+		kvfree(buf);
+		return NULL;
+	}
+	*sizep = size;
+	return buf;
+}
+
+/* Read and encode the merged listing of the lower layers of @dentry */
+static void *ovl_dircache_build(struct dentry *dentry,
+				const struct ovl_dircache_hdr *hdr,
+				size_t hdrsize, size_t *sizep)
+{
+	struct ovl_cache_entry *p;
+	struct ovl_dircache_hdr *newhdr;
+	struct ovl_dircache_entry *ent;
+	struct rb_root root = RB_ROOT;
+	LIST_HEAD(list);
+	size_t size = hdrsize;
+	u32 count = 0;
+	void *buf = NULL;
+	int err;
+
+	/* Layer index 1 is the uppermost lower layer */
+	err = ovl_dir_read_layers(dentry, &list, &root, 1);
+	if (err)
+		goto out;
+
+	list_for_each_entry(p, &list, l_node) {
+		if (p->is_whiteout)
+			continue;
+		size += sizeof(*ent) + p->len;
+		count++;
+	}
+
+	buf = kvmalloc(size, GFP_KERNEL);
+	if (!buf)
+		goto out;
+
+	memcpy(buf, hdr, hdrsize);
+	newhdr = buf;
+	newhdr->count = cpu_to_le32(count);
+	ent = buf + hdrsize;
+	list_for_each_entry(p, &list, l_node) {
+		if (p->is_whiteout)
+			continue;
+		ent->ino = cpu_to_le64(p->real_ino);
+		ent->len = cpu_to_le16(p->len);
+		ent->type = p->type;
+		memcpy(ent->name, p->name, p->len);
+		ent = (void *)ent->name + p->len;
+	}
+	*sizep = size;
+out:
+	ovl_cache_free(&list);
+	return buf;
+}
+
+static void ovl_dircache_store(struct dentry *dentry, const void *buf,
+			       size_t size, bool stale)
+{
+	struct ovl_fs *ofs = OVL_FS(dentry->d_sb);
+	struct dentry *upper = ovl_dentry_upper(dentry);
+	int err;
+
+	if (ovl_want_write(dentry))
+		return;
+
+	err = -E2BIG;
+	if (size <= XATTR_SIZE_MAX)
+		err = ovl_setxattr(ofs, upper, OVL_XATTR_DIRCACHE, buf, size);
+	/* Don't leave an outdated listing behind to be read on every miss */
+	if (err && stale)
+		ovl_removexattr(ofs, upper, OVL_XATTR_DIRCACHE);
+	ovl_drop_write(dentry);
+}
+
+/* Merge the upper dir with the stored listing of the lower layers */
+static int ovl_dircache_merge(struct dentry *dentry, struct list_head *list,
+			      struct rb_root *root, const void *buf,
+			      size_t hdrsize)
+{
+	const struct ovl_dircache_hdr *hdr = buf;
+	const struct ovl_dircache_entry *ent = buf + hdrsize;
+	struct path realpath;
+	struct ovl_readdir_data rdd = {
+		.ctx.actor = ovl_fill_merge,
+		.dentry = dentry,
+		.list = list,
+		.root = root,
+		.is_upper = true,
+	};
+	u32 i, count = le32_to_cpu(hdr->count);
+	int err;
+
+	ovl_path_upper(dentry, &realpath);
+	err = ovl_dir_read(&realpath, &rdd);
+	if (err)
+		return err;
+
+	/* Lower entries go before upper ones, as in ovl_dir_read_merged() */
+	list_add(&rdd.middle, rdd.list);
+	rdd.is_lowest = true;
+	rdd.is_upper = false;
+	for (i = 0; i < count; i++) {
+		unsigned int len = le16_to_cpu(ent->len);
+
+		if (!ovl_fill_lowest(&rdd, ent->name, len, 0,
+				     le64_to_cpu(ent->ino), ent->type))
+			break;
+		ent = (void *)ent->name + len;
+	}
+	list_del(&rdd.middle);
+
+	return rdd.err;
+}
+
+static int ovl_dir_read_cached(struct dentry *dentry, struct list_head *list,
+			       struct rb_root *root)
+{
+	struct ovl_dircache_hdr *hdr;
+	size_t hdrsize, size;
+	bool stale = false;
+	void *buf;
+	int err;
+
+	hdrsize = struct_size(hdr, layers, ovl_numlower(OVL_E(dentry)));
+	hdr = kzalloc(hdrsize, GFP_KERNEL);
+	if (!hdr)
+		return -ENOMEM;
+
+	err = ovl_dircache_stat_lower(dentry, hdr);
+	if (err)
+		goto out_free;
+
+	buf = ovl_dircache_load(dentry, hdr, hdrsize, &size, &stale);
+	if (!buf) {
+		buf = ovl_dircache_build(dentry, hdr, hdrsize, &size);
+		if (!buf)
+			goto out_free;
+		ovl_dircache_store(dentry, buf, size, stale);
+	}
+
+	err = ovl_dircache_merge(dentry, list, root, buf, hdrsize);
+	kvfree(buf);
+	kfree(hdr);
+	return err;
+
+out_free:
+	kfree(hdr);
+	return ovl_dir_read_merged(dentry, list, root);
+}
+
 static void ovl_seek_cursor(struct ovl_dir_file *od, loff_t pos)
 {
 	struct list_head *p;
@@ -419,7 +731,10 @@ static struct ovl_dir_cache *ovl_cache_get(struct dentry *dentry)
 	INIT_LIST_HEAD(&cache->entries);
 	cache->root = RB_ROOT;
 
-	res = ovl_dir_read_merged(dentry, &cache->entries, &cache->root);
+	if (ovl_dircache_enabled(dentry))
+		res = ovl_dir_read_cached(dentry, &cache->entries, &cache->root);
+	else
+		res = ovl_dir_read_merged(dentry, &cache->entries, &cache->root);
 	if (res) {
 		ovl_cache_free(&cache->entries);
 		kfree(cache);
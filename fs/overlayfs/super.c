@@ -1380,6 +1380,14 @@ int ovl_fill_super(struct super_block *sb, struct fs_context *fc)
 		if (!ofs->workdir)
 			sb->s_flags |= SB_RDONLY;
 
+		if (ofs->config.async_copyup && ofs->workdir) {
+			err = -ENOMEM;
+			ofs->copyup_wq = alloc_workqueue("ovl-copyup",
+							 WQ_UNBOUND, 0);
+			if (!ofs->copyup_wq)
+				goto out_err;
+		}
+
 		sb->s_stack_depth = upper_sb->s_stack_depth;
 		sb->s_time_gran = upper_sb->s_time_gran;
 	}
@@ -1473,13 +1481,23 @@ int ovl_fill_super(struct super_block *sb, struct fs_context *fc)
 	return err;
 }
 
+static void ovl_kill_sb(struct super_block *sb)
+{
+	struct ovl_fs *ofs = OVL_FS(sb);
+
+	/* Queued data copy ups hold dentry references, finish them first */
+	if (ofs && ofs->copyup_wq)
+		drain_workqueue(ofs->copyup_wq);
+	kill_anon_super(sb);
+}
+
 struct file_system_type ovl_fs_type = {
 	.owner			= THIS_MODULE,
 	.name			= "overlay",
 	.init_fs_context	= ovl_init_fs_context,
 	.parameters		= ovl_parameter_spec,
 	.fs_flags		= FS_USERNS_MOUNT,
-	.kill_sb		= kill_anon_super,
+	.kill_sb		= ovl_kill_sb,
 };
 MODULE_ALIAS_FS("overlay");
 
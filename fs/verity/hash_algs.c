@@ -197,6 +197,48 @@ int fsverity_hash_block(const struct merkle_tree_params *params,
 	return err;
 }
 
+/**
+ * fsverity_hash_blocks() - hash several data blocks at once
+ * @params: the Merkle tree's parameters
+ * @inode: inode for which the hashing is being done
+ * @data: virtual addresses of the blocks to hash
+ * @outs: output digests, each of size 'params->digest_size' bytes
+ * @num_blocks: number of blocks to hash
+ *
+ * Like fsverity_hash_block(), but for several blocks, which the hash algorithm
+ * may interleave.  See crypto_shash_finup_mb().
+ *
+ * Return: 0 on success, -errno on failure
+ */
+int fsverity_hash_blocks(const struct merkle_tree_params *params,
+			 const struct inode *inode, const u8 * const data[],
+			 u8 * const outs[], unsigned int num_blocks)
+{
+	SHASH_DESC_ON_STACK(desc, params->hash_alg->tfm);
+	int err;
+
+	desc->tfm = params->hash_alg->tfm;
+
+	if (params->hashstate) {
+		err = crypto_shash_import(desc, params->hashstate);
+		if (err) {
+			fsverity_err(inode,
+				     "Error %d importing hash state", err);
+			return err;
+		}
+	} else {
+		err = crypto_shash_init(desc);
+		if (err)
+			goto out;
+	}
+	err = crypto_shash_finup_mb(desc, data, params->block_size, outs,
+				    num_blocks);
+out:
+	if (err)
+		fsverity_err(inode, "Error %d computing block hashes", err);
+	return err;
+}
+
 /**
  * fsverity_hash_buffer() - hash some data
  * @alg: the hash algorithm to use
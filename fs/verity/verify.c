@@ -79,18 +79,19 @@ static bool is_hash_block_verified(struct fsverity_info *vi, struct page *hpage,
 }
 
 /*
- * Verify a single data block against the file's Merkle tree.
+ * Find the expected hash of a single data block by walking the file's Merkle
+ * tree, and store it in @want_hash_out.
  *
  * In principle, we need to verify the entire path to the root node.  However,
  * for efficiency the filesystem may cache the hash blocks.  Therefore we need
  * only ascend the tree until an already-verified hash block is seen, and then
  * verify the path to that block.
  *
- * Return: %true if the data block is valid, else %false.
+ * Return: %true if the hash blocks on the path are valid, else %false.
  */
 static bool
-verify_data_block(struct inode *inode, struct fsverity_info *vi,
-		  const void *data, u64 data_pos, unsigned long max_ra_pages)
+get_data_block_hash(struct inode *inode, struct fsverity_info *vi,
+		    u64 data_pos, unsigned long max_ra_pages, u8 *want_hash_out)
 {
 	const struct merkle_tree_params *params = &vi->tree_params;
 	const unsigned int hsize = params->digest_size;
@@ -115,25 +116,11 @@ verify_data_block(struct inode *inode, struct fsverity_info *vi,
 	 */
 	u64 hidx = data_pos >> params->log_blocksize;
 
-	/* Up to 1 + FS_VERITY_MAX_LEVELS pages may be mapped at once */
-	BUILD_BUG_ON(1 + FS_VERITY_MAX_LEVELS > KM_MAX_IDX);
-
-	if (unlikely(data_pos >= inode->i_size)) {
-		/*
-		 * This can happen in the data page spanning EOF when the Merkle
-		 * tree block size is less than the page size.  The Merkle tree
-		 * doesn't cover data blocks fully past EOF.  But the entire
-		 * page spanning EOF can be visible to userspace via a mmap, and
-		 * any part past EOF should be all zeroes.  Therefore, we need
-		 * to verify that any data blocks fully past EOF are all zeroes.
-		 */
-		if (memchr_inv(data, 0, params->block_size)) {
-			fsverity_err(inode,
-				     "FILE CORRUPTED!  Data past EOF is not zeroed");
-			return false;
-		}
-		return true;
-	}
+	/*
+	 * Up to HASH_MAX_MB_MSGS data blocks and FS_VERITY_MAX_LEVELS hash
+	 * pages may be mapped at once
+	 */
+	BUILD_BUG_ON(HASH_MAX_MB_MSGS + FS_VERITY_MAX_LEVELS > KM_MAX_IDX);
 
 	/*
 	 * Starting at the leaf level, ascend the tree saving hash blocks along
@@ -221,11 +208,7 @@ verify_data_block(struct inode *inode, struct fsverity_info *vi,
 		put_page(hpage);
 	}
 
-	/* Finally, verify the data block. */
-	if (fsverity_hash_block(params, inode, data, real_hash) != 0)
-		goto error;
-	if (memcmp(want_hash, real_hash, hsize) != 0)
-		goto corrupted;
+	memcpy(want_hash_out, want_hash, hsize);
 	return true;
 
 corrupted:
@@ -242,14 +225,77 @@ verify_data_block(struct inode *inode, struct fsverity_info *vi,
 	return false;
 }
 
+/* A mapped data block whose expected hash is known, waiting to be hashed */
+struct fsverity_pending_block {
+	const void *data;
+	u64 pos;
+	u8 want_hash[FS_VERITY_MAX_DIGEST_SIZE];
+};
+
+/*
+ * Hash the pending data blocks together, so that algorithms which can
+ * interleave several messages get to do so, and compare each result with the
+ * block's expected hash.
+ *
+ * Return: %true if all the data blocks are valid, else %false.
+ */
+static bool
+verify_pending_blocks(struct inode *inode, struct fsverity_info *vi,
+		      const struct fsverity_pending_block pending[],
+		      unsigned int num_pending)
+{
+	const struct merkle_tree_params *params = &vi->tree_params;
+	const unsigned int hsize = params->digest_size;
+	u8 real_hashes[HASH_MAX_MB_MSGS][FS_VERITY_MAX_DIGEST_SIZE];
+	const u8 *data[HASH_MAX_MB_MSGS];
+	u8 *outs[HASH_MAX_MB_MSGS];
+	unsigned int i;
+
+	for (i = 0; i < num_pending; i++) {
+		data[i] = pending[i].data;
+		outs[i] = real_hashes[i];
+	}
+	if (fsverity_hash_blocks(params, inode, data, outs, num_pending) != 0)
+		return false;
+
+	for (i = 0; i < num_pending; i++) {
+		if (memcmp(pending[i].want_hash, real_hashes[i], hsize) != 0) {
+			fsverity_err(inode,
+				     "FILE CORRUPTED! pos=%llu, level=-1, want_hash=%s:%*phN, real_hash=%s:%*phN",
+				     pending[i].pos,
+				     params->hash_alg->name, hsize,
+				     pending[i].want_hash,
+				     params->hash_alg->name, hsize,
+				     real_hashes[i]);
+			return false;
+		}
+	}
+	return true;
+}
+
+static void unmap_pending_blocks(struct fsverity_pending_block pending[],
+				 unsigned int *num_pending)
+{
+	/* kmap_local mappings must be released in reverse order */
+	while (*num_pending)
+		kunmap_local(pending[--(*num_pending)].data);
+}
+
 static bool
 verify_data_blocks(struct folio *data_folio, size_t len, size_t offset,
 		   unsigned long max_ra_pages)
 {
 	struct inode *inode = data_folio->mapping->host;
 	struct fsverity_info *vi = inode->i_verity_info;
-	const unsigned int block_size = vi->tree_params.block_size;
+	const struct merkle_tree_params *params = &vi->tree_params;
+	const unsigned int block_size = params->block_size;
+	const unsigned int max_pending =
+		min(crypto_shash_mb_max_msgs(params->hash_alg->tfm),
+		    HASH_MAX_MB_MSGS);
+	struct fsverity_pending_block pending[HASH_MAX_MB_MSGS];
+	unsigned int num_pending = 0;
 	u64 pos = (u64)data_folio->index << PAGE_SHIFT;
+	bool valid = true;
 
 	if (WARN_ON_ONCE(len <= 0 || !IS_ALIGNED(len | offset, block_size)))
 		return false;
@@ -257,19 +303,55 @@ verify_data_blocks(struct folio *data_folio, size_t len, size_t offset,
 			 folio_test_uptodate(data_folio)))
 		return false;
 	do {
+		u64 data_pos = pos + offset;
 		void *data;
-		bool valid;
 
 		data = kmap_local_folio(data_folio, offset);
-		valid = verify_data_block(inode, vi, data, pos + offset,
-					  max_ra_pages);
-		kunmap_local(data);
+		if (unlikely(data_pos >= inode->i_size)) {
+			/*
+			 * This can happen in the data page spanning EOF when
+			 * the Merkle tree block size is less than the page
+			 * size.  The Merkle tree doesn't cover data blocks fully
+			 * past EOF.  But the entire page spanning EOF can be
+			 * visible to userspace via a mmap, and any part past
+			 * EOF should be all zeroes.  Therefore, we need to
+			 * verify that any data blocks fully past EOF are all
+			 * zeroes.
+			 */
+			if (memchr_inv(data, 0, block_size)) {
+				fsverity_err(inode,
+					     "FILE CORRUPTED!  Data past EOF is not zeroed");
+				valid = false;
+			}
+			kunmap_local(data);
+		} else {
+			pending[num_pending].data = data;
+			pending[num_pending].pos = data_pos;
+			num_pending++;
+			valid = get_data_block_hash(inode, vi, data_pos,
+					max_ra_pages,
+					pending[num_pending - 1].want_hash);
+			if (valid && num_pending == max_pending)
+				valid = verify_pending_blocks(inode, vi,
+							      pending,
+							      num_pending);
+			if (!valid || num_pending == max_pending)
+				unmap_pending_blocks(pending, &num_pending);
+		}
 		if (!valid)
-			return false;
+			break;
 		offset += block_size;
 		len -= block_size;
 	} while (len);
-	return true;
+
+	if (num_pending) {
+		/* Don't let the pending blocks hide a bad block past EOF */
+		if (valid)
+			valid = verify_pending_blocks(inode, vi, pending,
+						      num_pending);
+		unmap_pending_blocks(pending, &num_pending);
+	}
+	return valid;
 }
 
 /**
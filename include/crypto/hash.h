@@ -164,6 +164,9 @@ struct shash_desc {
  */
 #define HASH_MAX_DESCSIZE	(sizeof(struct shash_desc) + 360)
 
+/* Maximum number of messages an algorithm's ->finup_mb() may take at once */
+#define HASH_MAX_MB_MSGS	2
+
 #define SHASH_DESC_ON_STACK(shash, ctx)					     \
 	char __##shash##_desc[sizeof(struct shash_desc) + HASH_MAX_DESCSIZE] \
 		__aligned(__alignof__(struct shash_desc));		     \
@@ -176,6 +179,9 @@ struct shash_desc {
  * @final: see struct ahash_alg
  * @finup: see struct ahash_alg
  * @digest: see struct ahash_alg
+ * @finup_mb: Finish hashing @num_msgs messages of equal length, all starting
+ *	      from the state in @desc, interleaved for better instruction-level
+ *	      parallelism. Optional, see crypto_shash_finup_mb().
  * @export: see struct ahash_alg
  * @import: see struct ahash_alg
  * @setkey: see struct ahash_alg
@@ -194,6 +200,8 @@ struct shash_desc {
  * @descsize: Size of the operational state for the message digest. This state
  * 	      size is the memory size that needs to be allocated for
  *	      shash_desc.__ctx
+ * @mb_max_msgs: Maximum number of messages @finup_mb takes, 1 if there is no
+ *	      @finup_mb
  * @halg: see struct hash_alg_common
  * @HASH_ALG_COMMON: see struct hash_alg_common
  */
@@ -206,6 +214,9 @@ struct shash_alg {
 		     unsigned int len, u8 *out);
 	int (*digest)(struct shash_desc *desc, const u8 *data,
 		      unsigned int len, u8 *out);
+	int (*finup_mb)(struct shash_desc *desc, const u8 * const data[],
+			unsigned int len, u8 * const outs[],
+			unsigned int num_msgs);
 	int (*export)(struct shash_desc *desc, void *out);
 	int (*import)(struct shash_desc *desc, const void *in);
 	int (*setkey)(struct crypto_shash *tfm, const u8 *key,
@@ -215,6 +226,7 @@ struct shash_alg {
 	int (*clone_tfm)(struct crypto_shash *dst, struct crypto_shash *src);
 
 	unsigned int descsize;
+	unsigned int mb_max_msgs;
 
 	union {
 		struct HASH_ALG_COMMON;
@@ -944,6 +956,42 @@ int crypto_shash_final(struct shash_desc *desc, u8 *out);
 int crypto_shash_finup(struct shash_desc *desc, const u8 *data,
 		       unsigned int len, u8 *out);
 
+/**
+ * crypto_shash_finup_mb() - finish hashing several messages at once
+ * @desc: the hash state, which all messages start from
+ * @data: the data of the messages
+ * @len: the length of each message
+ * @outs: where to write the message digests
+ * @num_msgs: the number of messages
+ *
+ * Hash @num_msgs messages of equal length, typically data blocks, which
+ * continue the same state in @desc, e.g. a salted initial state. This is
+ * faster than a crypto_shash_finup() per message if the algorithm can
+ * interleave the messages, which crypto_shash_mb_max_msgs() tells. Otherwise
+ * the messages are hashed one after the other.
+ *
+ * The state in @desc is undefined on return.
+ *
+ * Context: Any context.
+ * Return: 0 if the message digests have been calculated successfully; < 0 if
+ *	   an error occurred
+ */
+int crypto_shash_finup_mb(struct shash_desc *desc, const u8 * const data[],
+			  unsigned int len, u8 * const outs[],
+			  unsigned int num_msgs);
+
+/**
+ * crypto_shash_mb_max_msgs() - maximum number of messages hashed in parallel
+ * @tfm: cipher handle
+ *
+ * Return: the number of messages crypto_shash_finup_mb() can interleave, 1 if
+ *	   the algorithm does not support multi-buffer hashing
+ */
+static inline unsigned int crypto_shash_mb_max_msgs(struct crypto_shash *tfm)
+{
+	return crypto_shash_alg(tfm)->mb_max_msgs;
+}
+
 static inline void shash_desc_zero(struct shash_desc *desc)
 {
 	memzero_explicit(desc,
@@ -115,6 +115,8 @@ static inline void sha256_init(struct sha256_state *sctx)
 void sha256_update(struct sha256_state *sctx, const u8 *data, unsigned int len);
 void sha256_final(struct sha256_state *sctx, u8 *out);
 void sha256(const u8 *data, unsigned int len, u8 *out);
+void sha256_finup_2x(const struct sha256_state *sctx, const u8 *data1,
+		     const u8 *data2, unsigned int len, u8 *out1, u8 *out2);
 
 static inline void sha224_init(struct sha256_state *sctx)
 {
@@ -130,5 +132,7 @@ static inline void sha224_init(struct sha256_state *sctx)
 }
 /* Simply use sha256_update as it is equivalent to sha224_update. */
 void sha224_final(struct sha256_state *sctx, u8 *out);
+void sha224_finup_2x(const struct sha256_state *sctx, const u8 *data1,
+		     const u8 *data2, unsigned int len, u8 *out1, u8 *out2);
 
 #endif /* _CRYPTO_SHA2_H */
@@ -175,6 +175,8 @@ struct bpf_map_ops {
 				     void *callback_ctx, u64 flags);
 
 	u64 (*map_mem_usage)(const struct bpf_map *map);
+	/* map type specific lines of /proc/<pid>/fdinfo/<fd> */
+	void (*map_show_fdinfo)(const struct bpf_map *map, struct seq_file *m);
 
 	/* BTF id of struct allocated by map_alloc */
 	int *map_btf_id;
@@ -2332,7 +2334,8 @@ struct bpf_map *bpf_map_get_curr_or_next(u32 *id);
 struct bpf_prog *bpf_prog_get_curr_or_next(u32 *id);
 
 int bpf_map_alloc_pages(const struct bpf_map *map, gfp_t gfp, int nid,
-			unsigned long nr_pages, struct page **page_array);
+			unsigned int order, unsigned long nr_pages,
+			struct page **page_array);
 #ifdef CONFIG_MEMCG
 void *bpf_map_kmalloc_node(const struct bpf_map *map, size_t size, gfp_t flags,
 			   int node);
@@ -91,15 +91,31 @@ struct bpf_local_storage_elem {
 	struct bpf_local_storage_data sdata ____cacheline_aligned;
 };
 
+/* Open addressed index of the sdata-s of a bpf_local_storage, keyed by
+ * smap.  It is only built once an owner has more elems than cache slots.
+ * When present it covers every elem in bpf_local_storage->list, deleted
+ * entries are left as BPF_LOCAL_STORAGE_INDEX_DEAD until the next rebuild.
+ */
+struct bpf_local_storage_index {
+	struct rcu_head rcu;
+	u32 mask;
+	u32 nr_used;		/* live and dead slots */
+	struct bpf_local_storage_data __rcu *slots[];
+};
+
+#define BPF_LOCAL_STORAGE_INDEX_DEAD	((struct bpf_local_storage_data *)1UL)
+
 struct bpf_local_storage {
 	struct bpf_local_storage_data __rcu *cache[BPF_LOCAL_STORAGE_CACHE_SIZE];
 	struct bpf_local_storage_map __rcu *smap;
+	struct bpf_local_storage_index __rcu *index;
 	struct hlist_head list; /* List of bpf_local_storage_elem */
 	void *owner;		/* The object that owns the above "list" of
 				 * bpf_local_storage_elem.
 				 */
 	struct rcu_head rcu;
 	raw_spinlock_t lock;	/* Protect adding/removing from the "list" */
+	u32 nr_selems;		/* Number of elems in the "list" */
 };
 
 /* U16_MAX is much more than enough for sk local storage
@@ -138,12 +154,33 @@ bpf_local_storage_map_alloc(union bpf_attr *attr,
 void __bpf_local_storage_insert_cache(struct bpf_local_storage *local_storage,
 				      struct bpf_local_storage_map *smap,
 				      struct bpf_local_storage_elem *selem);
+
+static inline struct bpf_local_storage_data *
+bpf_local_storage_index_lookup(struct bpf_local_storage_index *index,
+			       struct bpf_local_storage_map *smap)
+{
+	struct bpf_local_storage_data *sdata;
+	u32 i, n, mask = index->mask;
+
+	i = hash_ptr(smap, 32) & mask;
+	for (n = 0; n <= mask; n++, i = (i + 1) & mask) {
+		sdata = rcu_dereference_check(index->slots[i], bpf_rcu_lock_held());
+		if (!sdata)
+			break;
+		if (sdata != BPF_LOCAL_STORAGE_INDEX_DEAD &&
+		    rcu_access_pointer(sdata->smap) == smap)
+			return sdata;
+	}
+	return NULL;
+}
+
 /* If cacheit_lockit is false, this lookup function is lockless */
 static inline struct bpf_local_storage_data *
 bpf_local_storage_lookup(struct bpf_local_storage *local_storage,
 			 struct bpf_local_storage_map *smap,
 			 bool cacheit_lockit)
 {
+	struct bpf_local_storage_index *index;
 	struct bpf_local_storage_data *sdata;
 	struct bpf_local_storage_elem *selem;
 
@@ -154,6 +191,15 @@ bpf_local_storage_lookup(struct bpf_local_storage *local_storage,
 		return sdata;
 
 	/* Slow path (cache miss) */
+	index = rcu_dereference_check(local_storage->index, bpf_rcu_lock_held());
+	if (index) {
+		sdata = bpf_local_storage_index_lookup(index, smap);
+		if (!sdata)
+			return NULL;
+		selem = SELEM(sdata);
+		goto found;
+	}
+
 	hlist_for_each_entry_rcu(selem, &local_storage->list, snode,
 				  rcu_read_lock_trace_held())
 		if (rcu_access_pointer(SDATA(selem)->smap) == smap)
@@ -161,6 +207,7 @@ bpf_local_storage_lookup(struct bpf_local_storage *local_storage,
 
 	if (!selem)
 		return NULL;
+found:
 	if (cacheit_lockit)
 		__bpf_local_storage_insert_cache(local_storage, smap, selem);
 	return SDATA(selem);
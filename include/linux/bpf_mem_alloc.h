@@ -7,10 +7,12 @@
 
 struct bpf_mem_cache;
 struct bpf_mem_caches;
+struct bpf_mem_depot;
 
 struct bpf_mem_alloc {
 	struct bpf_mem_caches __percpu *caches;
 	struct bpf_mem_cache __percpu *cache;
+	struct bpf_mem_depot *depots;
 	struct obj_cgroup *objcg;
 	bool percpu;
 	struct work_struct work;
@@ -33,6 +35,16 @@ int bpf_mem_alloc_percpu_init(struct bpf_mem_alloc *ma, struct obj_cgroup *objcg
 int bpf_mem_alloc_percpu_unit_init(struct bpf_mem_alloc *ma, int size);
 void bpf_mem_alloc_destroy(struct bpf_mem_alloc *ma);
 
+struct bpf_mem_alloc_stats {
+	u64 refill_cnt;		/* refills of per-cpu caches */
+	u64 trim_cnt;		/* trims of per-cpu caches */
+	u64 depot_get_cnt;	/* objects refilled from the shared depot */
+	u64 depot_put_cnt;	/* objects trimmed into the shared depot */
+	u64 depot_cnt;		/* objects currently in the shared depot */
+};
+
+void bpf_mem_alloc_get_stats(struct bpf_mem_alloc *ma, struct bpf_mem_alloc_stats *stats);
+
 /* Check the allocation size for kmalloc equivalent allocator */
 int bpf_mem_alloc_check_size(bool percpu, size_t size);
 
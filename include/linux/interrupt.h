@@ -248,6 +248,15 @@ extern void teardown_percpu_nmi(unsigned int irq);
 
 extern int irq_inject_interrupt(unsigned int irq);
 
+#ifdef CONFIG_IRQ_COALESCE
+extern int irq_set_coalesce_rate(unsigned int irq, unsigned int rate);
+#else
+static inline int irq_set_coalesce_rate(unsigned int irq, unsigned int rate)
+{
+	return -EOPNOTSUPP;
+}
+#endif
+
 /* The following three functions are for the core kernel use only. */
 extern void suspend_device_irqs(void);
 extern void resume_device_irqs(void);
@@ -11,6 +11,7 @@
  */
 
 struct irq_affinity_notify;
+struct irq_coalesce;
 struct proc_dir_entry;
 struct module;
 struct irq_desc;
@@ -21,12 +22,18 @@ struct pt_regs;
  * struct irqstat - interrupt statistics
  * @cnt:	real-time interrupt count
  * @ref:	snapshot of interrupt count
+ * @ns:		time spent in the handlers while balancing is enabled
+ * @ns_ref:	snapshot of @ns at the last balancing pass
  */
 struct irqstat {
 	unsigned int	cnt;
 #ifdef CONFIG_GENERIC_IRQ_STAT_SNAPSHOT
 	unsigned int	ref;
 #endif
+#ifdef CONFIG_IRQ_AUTO_BALANCE
+	u64		ns;
+	u64		ns_ref;
+#endif
 };
 
 /**
@@ -49,6 +56,10 @@ struct irqstat {
  * @affinity_hint:	hint to user space for preferred irq affinity
  * @affinity_notify:	context for notification of affinity changes
  * @pending_mask:	pending rebalanced interrupts
+ * @balance_load:	handling time in the last balancing interval
+ * @balance_stamp:	jiffies when the balancer last moved the irq
+ * @balance_src:	CPU which did most of the handling in the last interval
+ * @balance_cpu:	CPU the balancer moved the irq to, -1 if none
  * @threads_oneshot:	bitfield to handle shared oneshot threads
  * @threads_active:	number of irqaction threads currently running
  * @wait_for_threads:	wait queue for sync_irq to wait for threaded handlers
@@ -60,6 +71,7 @@ struct irqstat {
  * @rcu:		rcu head for delayed free
  * @kobj:		kobject used to represent this struct in sysfs
  * @request_mutex:	mutex to protect request/free before locking desc->lock
+ * @coalesce:		software interrupt coalescing state
  * @dir:		/proc/irq/ procfs entry
  * @debugfs_file:	dentry for the debugfs file
  * @name:		flow handler name for /proc/interrupts output
@@ -89,6 +101,12 @@ struct irq_desc {
 #ifdef CONFIG_GENERIC_PENDING_IRQ
 	cpumask_var_t		pending_mask;
 #endif
+#ifdef CONFIG_IRQ_AUTO_BALANCE
+	u64			balance_load;
+	unsigned long		balance_stamp;
+	int			balance_src;
+	int			balance_cpu;
+#endif
 #endif
 	unsigned long		threads_oneshot;
 	atomic_t		threads_active;
@@ -111,6 +129,9 @@ struct irq_desc {
 	struct kobject		kobj;
 #endif
 	struct mutex		request_mutex;
+#ifdef CONFIG_IRQ_COALESCE
+	struct irq_coalesce	*coalesce;
+#endif
 	int			parent_irq;
 	struct module		*owner;
 	const char		*name;
@@ -800,6 +800,7 @@ struct mm_cid {
 
 struct kioctx_table;
 struct iommu_mm_data;
+struct futex_private_hash;
 struct mm_struct {
 	struct {
 		/*
@@ -1020,6 +1021,10 @@ struct mm_struct {
 		atomic_t tlb_flush_batched;
 #endif
 		struct uprobes_state uprobes_state;
+#ifdef CONFIG_FUTEX
+		/* private futex hash set up with PR_FUTEX_HASH, or NULL */
+		struct futex_private_hash *futex_phash;
+#endif
 #ifdef CONFIG_PREEMPT_RT
 		struct rcu_head delayed_drop;
 #endif
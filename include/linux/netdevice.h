@@ -341,7 +341,17 @@ struct gro_list {
  * size of gro hash buckets, must less than bit number of
  * napi_struct::gro_bitmask
  */
-#define GRO_HASH_BUCKETS	8
+#define GRO_HASH_BUCKETS	32
+
+/*
+ * Per-NAPI software GRO counters, only written from the NAPI context.
+ * held / (held + merged) is the inverse of the aggregation ratio.
+ */
+struct gro_stats {
+	unsigned long		held;	 /* skbs held as the head of a flow */
+	unsigned long		merged;	 /* skbs merged into a held flow */
+	unsigned long		evicted; /* flows flushed early, bucket full */
+};
 
 /*
  * Structure for per-NAPI config
@@ -378,6 +388,7 @@ struct napi_struct {
 	int			list_owner;
 	struct net_device	*dev;
 	struct gro_list		gro_hash[GRO_HASH_BUCKETS];
+	struct gro_stats	gro_stats;
 	struct sk_buff		*skb;
 	struct list_head	rx_list; /* Pending GRO_NORMAL skbs */
 	int			rx_count; /* length of rx_list */
@@ -3161,7 +3172,7 @@ u16 dev_pick_tx_zero(struct net_device *dev, struct sk_buff *skb,
 		     struct net_device *sb_dev);
 
 int __dev_queue_xmit(struct sk_buff *skb, struct net_device *sb_dev);
-int __dev_direct_xmit(struct sk_buff *skb, u16 queue_id);
+int __dev_direct_xmit(struct sk_buff *skb, u16 queue_id, bool more);
 
 static inline int dev_queue_xmit(struct sk_buff *skb)
 {
@@ -3178,7 +3189,7 @@ static inline int dev_direct_xmit(struct sk_buff *skb, u16 queue_id)
 {
 	int ret;
 
-	ret = __dev_direct_xmit(skb, queue_id);
+	ret = __dev_direct_xmit(skb, queue_id, false);
 	if (!dev_xmit_complete(ret))
 		kfree_skb(skb);
 	return ret;
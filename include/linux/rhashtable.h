@@ -241,6 +241,7 @@ static inline int lockdep_rht_bucket_is_held(const struct bucket_table *tbl,
 
 void *rhashtable_insert_slow(struct rhashtable *ht, const void *key,
 			     struct rhash_head *obj);
+int rhashtable_reserve(struct rhashtable *ht, unsigned int nelem);
 
 void rhashtable_walk_enter(struct rhashtable *ht,
 			   struct rhashtable_iter *iter);
@@ -402,7 +402,9 @@ struct tcp_sock {
 				 * receiver in Recovery. */
 	u32	last_oow_ack_time;  /* timestamp of last out-of-window ACK */
 
-	struct hrtimer	pacing_timer;
+	struct rb_node	pacing_node;	/* in per cpu tree of paced sockets */
+	u64	pacing_deadline_ns; /* tree key, tcp_wstamp_ns when queued */
+	int	pacing_cpu;	/* cpu of the tree we are queued on, or -1 */
 	struct hrtimer	compressed_ack_timer;
 
 	struct sk_buff	*ooo_last_skb; /* cache rb_last(out_of_order_queue) */
@@ -402,6 +402,14 @@ enum wq_flags {
 	 */
 	WQ_POWER_EFFICIENT	= 1 << 7,
 
+	/*
+	 * Unbound only.  Limit max_active to the concurrency needed to
+	 * keep the allowed CPUs busy, derived from the measured ratio of
+	 * wall time to CPU time of the executed work items.  max_active
+	 * stays the upper bound.  See wq_adapt_workfn().
+	 */
+	WQ_ADAPTIVE		= 1 << 8,
+
 	__WQ_DESTROYING		= 1 << 15, /* internal: workqueue is destroying */
 	__WQ_DRAINING		= 1 << 16, /* internal: workqueue is draining */
 	__WQ_ORDERED		= 1 << 17, /* internal: workqueue is ordered */
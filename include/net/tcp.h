@@ -649,6 +649,7 @@ int tcp_retransmit_skb(struct sock *sk, struct sk_buff *skb, int segs);
 void tcp_retransmit_timer(struct sock *sk);
 void tcp_xmit_retransmit_queue(struct sock *);
 void tcp_simple_retransmit(struct sock *);
+void tcp_pacing_cancel(struct sock *sk);
 void tcp_enter_recovery(struct sock *sk, bool ece_ack);
 int tcp_trim_head(struct sock *, struct sk_buff *, u32);
 enum tcp_queue {
@@ -687,8 +688,7 @@ void tcp_sack_compress_send_ack(struct sock *sk);
 void tcp_init_xmit_timers(struct sock *);
 static inline void tcp_clear_xmit_timers(struct sock *sk)
 {
-	if (hrtimer_try_to_cancel(&tcp_sk(sk)->pacing_timer) == 1)
-		__sock_put(sk);
+	tcp_pacing_cancel(sk);
 
 	if (hrtimer_try_to_cancel(&tcp_sk(sk)->compressed_ack_timer) == 1)
 		__sock_put(sk);
@@ -2550,8 +2550,6 @@ static inline void tcp_listendrop(const struct sock *sk)
 	__NET_INC_STATS(sock_net(sk), LINUX_MIB_LISTENDROPS);
 }
 
-enum hrtimer_restart tcp_pace_kick(struct hrtimer *timer);
-
 /*
  * Interface for adding Upper Level Protocols over TCP
  */
@@ -304,6 +304,7 @@ struct vxlan_dev {
 	struct vxlan_vni_group  __rcu *vnigrp;
 
 	struct hlist_head fdb_head[FDB_HASH_SIZE];
+	struct rhashtable fdb_hash_tbl;	/* lookup index over fdb_head[] */
 
 	struct rhashtable mdb_tbl;
 	struct hlist_head mdb_list;
@@ -37,7 +37,6 @@ struct xdp_buff_xsk {
 struct xsk_dma_map {
 	dma_addr_t *dma_pages;
 	struct device *dev;
-	struct net_device *netdev;
 	refcount_t users;
 	struct list_head list; /* Protected by the RTNL_LOCK */
 	u32 dma_pages_cnt;
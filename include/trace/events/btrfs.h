@@ -1017,6 +1017,32 @@ DEFINE_EVENT(btrfs_delayed_ref_head,  run_delayed_ref_head,
 	TP_ARGS(fs_info, head_ref, action)
 );
 
+TRACE_EVENT(btrfs_run_delayed_refs_batch,
+
+	TP_PROTO(const struct btrfs_fs_info *fs_info, unsigned long nr_heads,
+		 unsigned long nr_refs, unsigned long nr_merged, u64 duration),
+
+	TP_ARGS(fs_info, nr_heads, nr_refs, nr_merged, duration),
+
+	TP_STRUCT__entry_btrfs(
+		__field(	unsigned long,	nr_heads	)
+		__field(	unsigned long,	nr_refs		)
+		__field(	unsigned long,	nr_merged	)
+		__field(	u64,		duration	)
+	),
+
+	TP_fast_assign_btrfs(fs_info,
+		__entry->nr_heads	= nr_heads;
+		__entry->nr_refs	= nr_refs;
+		__entry->nr_merged	= nr_merged;
+		__entry->duration	= duration;
+	),
+
+	TP_printk_btrfs("nr_heads=%lu nr_refs=%lu nr_merged=%lu duration=%llu",
+		  __entry->nr_heads, __entry->nr_refs, __entry->nr_merged,
+		  __entry->duration)
+);
+
 #define show_chunk_type(type)					\
 	__print_flags(type, "|",				\
 		{ BTRFS_BLOCK_GROUP_DATA, 	"DATA"	},	\
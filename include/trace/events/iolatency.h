@@ -0,0 +1,53 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM iolatency
+
+#if !defined(_TRACE_BLK_IOLATENCY_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_BLK_IOLATENCY_H
+
+#include <linux/tracepoint.h>
+
+/* Number of log2 usec buckets in an io.latency histogram */
+#define IOLATENCY_HIST_BUCKETS	24
+
+/*
+ * Emitted once per io.latency window and per op type with the log2 latency
+ * histogram of the bios completed in that window. Bucket i counts latencies
+ * in [2^(i-1), 2^i) usecs, the last bucket also counts everything slower.
+ */
+TRACE_EVENT(iolatency_window_hist,
+
+	TP_PROTO(const char *devname, u64 cgroup_id, int op, u64 window_nsec,
+		 const u32 *hist),
+
+	TP_ARGS(devname, cgroup_id, op, window_nsec, hist),
+
+	TP_STRUCT__entry (
+		__string(devname, devname)
+		__field(u64, cgroup_id)
+		__field(int, op)
+		__field(u64, window_nsec)
+		__array(u32, hist, IOLATENCY_HIST_BUCKETS)
+	),
+
+	TP_fast_assign(
+		__assign_str(devname);
+		__entry->cgroup_id = cgroup_id;
+		__entry->op = op;
+		__entry->window_nsec = window_nsec;
+		memcpy(__entry->hist, hist, sizeof(__entry->hist));
+	),
+
+	TP_printk("[%s:%llu] op=%s window=%llu hist=%s",
+		__get_str(devname), __entry->cgroup_id,
+		__print_symbolic(__entry->op,
+				 { 0, "read" }, { 1, "write" }, { 2, "discard" }),
+		__entry->window_nsec,
+		__print_array(__entry->hist, IOLATENCY_HIST_BUCKETS, sizeof(u32))
+	)
+);
+
+#endif /* _TRACE_BLK_IOLATENCY_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
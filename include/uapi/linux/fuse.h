@@ -220,6 +220,11 @@
  *
  *  7.41
  *  - add FUSE_ALLOW_IDMAP
+ *
+ *  7.42
+ *  - add FUSE_DEV_IOC_BIND_CPU
+ *  - allow FOPEN_PASSTHROUGH in reply to FUSE_OPENDIR
+ *  - add FUSE_DEV_IOC_REGISTER_BUF and struct fuse_dev_buf_reg
  */
 
 #ifndef _LINUX_FUSE_H
@@ -255,7 +260,7 @@
 #define FUSE_KERNEL_VERSION 7
 
 /** Minor version number of this interface */
-#define FUSE_KERNEL_MINOR_VERSION 41
+#define FUSE_KERNEL_MINOR_VERSION 42
 
 /** The node ID of the root inode */
 #define FUSE_ROOT_ID 1
@@ -362,7 +367,8 @@ struct fuse_file_lock {
  * FOPEN_STREAM: the file is stream-like (no file position at all)
  * FOPEN_NOFLUSH: don't flush data cache on close (unless FUSE_WRITEBACK_CACHE)
  * FOPEN_PARALLEL_DIRECT_WRITES: Allow concurrent direct writes on the same inode
- * FOPEN_PASSTHROUGH: passthrough read/write io for this open file
+ * FOPEN_PASSTHROUGH: passthrough read/write io for this open file, or readdir
+ *		      for this open directory
  */
 #define FOPEN_DIRECT_IO		(1 << 0)
 #define FOPEN_KEEP_CACHE	(1 << 1)
@@ -1099,12 +1105,31 @@ struct fuse_backing_map {
 	uint64_t	padding;
 };
 
+/**
+ * Buffer registered with FUSE_DEV_IOC_REGISTER_BUF
+ *
+ * @addr: page aligned start address in the server's address space
+ * @len: length in bytes, a multiple of the page size; zero with a zero @addr
+ *	 unregisters the current buffer
+ *
+ * Once any part of the range is unmapped or remapped to different memory the
+ * registration stops being used, and it has to be unregistered and registered
+ * again.
+ */
+struct fuse_dev_buf_reg {
+	uint64_t	addr;
+	uint64_t	len;
+};
+
 /* Device ioctls: */
 #define FUSE_DEV_IOC_MAGIC		229
 #define FUSE_DEV_IOC_CLONE		_IOR(FUSE_DEV_IOC_MAGIC, 0, uint32_t)
 #define FUSE_DEV_IOC_BACKING_OPEN	_IOW(FUSE_DEV_IOC_MAGIC, 1, \
 					     struct fuse_backing_map)
 #define FUSE_DEV_IOC_BACKING_CLOSE	_IOW(FUSE_DEV_IOC_MAGIC, 2, uint32_t)
+#define FUSE_DEV_IOC_BIND_CPU		_IOW(FUSE_DEV_IOC_MAGIC, 3, uint32_t)
+#define FUSE_DEV_IOC_REGISTER_BUF	_IOW(FUSE_DEV_IOC_MAGIC, 4, \
+					     struct fuse_dev_buf_reg)
 
 struct fuse_lseek_in {
 	uint64_t	fh;
@@ -71,6 +71,14 @@
 
 #define FUTEX2_SIZE_MASK	0x03
 
+/*
+ * With FUTEX2_NUMA the futex word is immediately followed by a second word of
+ * the same size holding the home node of the futex, which selects the node
+ * local hash buckets it is queued on.  FUTEX_NO_NODE lets the kernel claim the
+ * futex for the node of the first task to use it.
+ */
+#define FUTEX_NO_NODE		(-1)
+
 /* do not use */
 #define FUTEX_32		FUTEX2_SIZE_U32 /* historical accident :-( */
 
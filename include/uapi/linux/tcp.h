@@ -136,6 +136,7 @@ enum {
 #define TCP_AO_REPAIR		42	/* Get/Set SNEs and ISNs */
 
 #define TCP_IS_MPTCP		43	/* Is MPTCP being used? */
+#define TCP_ZEROCOPY_RECEIVE_BATCH 44	/* Zerocopy receive on many sockets */
 
 #define TCP_REPAIR_ON		1
 #define TCP_REPAIR_OFF		0
@@ -485,4 +486,25 @@ struct tcp_zerocopy_receive {
 	__u32 msg_flags;
 	__u32 reserved; /* set to 0 for now */
 };
+
+/* getsockopt(fd, IPPROTO_TCP, TCP_ZEROCOPY_RECEIVE_BATCH, ...)
+ *
+ * Map the receive queues of several TCP sockets, each into its own range of a
+ * TCP mapping. Straggler data that can not be mapped is left for recv().
+ */
+struct tcp_zerocopy_receive_batch_entry {
+	__s32 fd;		/* in: TCP socket to receive from */
+	__u32 length;		/* in/out: number of bytes to map/mapped */
+	__u64 address;		/* in: address of mapping */
+	__u32 recv_skip_hint;	/* out: amount of bytes to skip */
+	__u32 inq;		/* out: amount of bytes in read queue */
+	__s32 err;		/* out: error for this socket, or socket error */
+	__u32 reserved;		/* set to 0 for now */
+};
+
+struct tcp_zerocopy_receive_batch {
+	__u64 entries;		/* in: array of tcp_zerocopy_receive_batch_entry */
+	__u32 nr_entries;	/* in/out: number of entries given/processed */
+	__u32 flags;		/* in: TCP_RECEIVE_ZEROCOPY_FLAG_* */
+};
 #endif /* _UAPI_LINUX_TCP_H */
@@ -7,6 +7,8 @@
 #include <linux/btf_ids.h>
 #include <linux/vmalloc.h>
 #include <linux/pagemap.h>
+#include <linux/pfn_t.h>
+#include <linux/io.h>
 #include "range_tree.h"
 
 /*
@@ -36,25 +38,46 @@
  * bpf program can allocate a page via bpf_arena_alloc_pages() kfunc
  * which will insert it into kernel vm_area.
  * The later fault-in from user space will populate that page into user vma.
+ *
+ * With BPF_F_ARENA_HUGE_PAGES the arena is managed in units of PMD sized
+ * blocks of physically contiguous pages.  kern_vm_start and user_vm_start
+ * are PMD aligned, so blocks are mapped with PMDs into the kernel vm_area
+ * and, with THP, into user vma-s, which are VM_PFNMAP in that case.
  */
 
 /* number of bytes addressable by LDX/STX insn with 16-bit 'off' field */
 #define GUARD_SZ (1ull << sizeof_field(struct bpf_insn, off) * 8)
 #define KERN_VM_SZ (SZ_4G + GUARD_SZ)
 
+#define ARENA_HUGE_NR (1L << PMD_ORDER)
+
 struct bpf_arena {
 	struct bpf_map map;
 	u64 user_vm_start;
 	u64 user_vm_end;
+	u64 kern_vm_start;
 	struct vm_struct *kern_vm;
 	struct range_tree rt;
 	struct list_head vma_list;
 	struct mutex lock;
+	/* last node of a BPF_F_ARENA_INTERLEAVE allocation */
+	int next_node;
 };
 
 u64 bpf_arena_get_kern_vm_start(struct bpf_arena *arena)
 {
-	return arena ? (u64) (long) arena->kern_vm->addr + GUARD_SZ / 2 : 0;
+	return arena ? arena->kern_vm_start : 0;
+}
+
+static bool arena_is_huge(const struct bpf_arena *arena)
+{
+	return arena->map.map_flags & BPF_F_ARENA_HUGE_PAGES;
+}
+
+/* number of pages the arena is allocated, mapped and freed in */
+static long arena_page_nr(const struct bpf_arena *arena)
+{
+	return arena_is_huge(arena) ? ARENA_HUGE_NR : 1;
 }
 
 u64 bpf_arena_get_user_vm_start(struct bpf_arena *arena)
@@ -94,10 +117,11 @@ static long compute_pgoff(struct bpf_arena *arena, long uaddr)
 
 static struct bpf_map *arena_map_alloc(union bpf_attr *attr)
 {
-	struct vm_struct *kern_vm;
+	bool huge = attr->map_flags & BPF_F_ARENA_HUGE_PAGES;
 	int numa_node = bpf_map_attr_numa_node(attr);
+	struct vm_struct *kern_vm;
 	struct bpf_arena *arena;
-	u64 vm_range;
+	u64 vm_range, kern_vm_sz;
 	int err = -ENOMEM;
 
 	if (!bpf_jit_supports_arena())
@@ -107,13 +131,18 @@ static struct bpf_map *arena_map_alloc(union bpf_attr *attr)
 	    /* BPF_F_MMAPABLE must be set */
 	    !(attr->map_flags & BPF_F_MMAPABLE) ||
 	    /* No unsupported flags present */
-	    (attr->map_flags & ~(BPF_F_SEGV_ON_FAULT | BPF_F_MMAPABLE | BPF_F_NO_USER_CONV)))
+	    (attr->map_flags & ~(BPF_F_SEGV_ON_FAULT | BPF_F_MMAPABLE | BPF_F_NO_USER_CONV |
+				 BPF_F_ARENA_HUGE_PAGES)))
 		return ERR_PTR(-EINVAL);
 
 	if (attr->map_extra & ~PAGE_MASK)
 		/* If non-zero the map_extra is an expected user VMA start address */
 		return ERR_PTR(-EINVAL);
 
+	if (huge && (!IS_ALIGNED(attr->max_entries, ARENA_HUGE_NR) ||
+		     !IS_ALIGNED(attr->map_extra, PMD_SIZE)))
+		return ERR_PTR(-EINVAL);
+
 	vm_range = (u64)attr->max_entries * PAGE_SIZE;
 	if (vm_range > SZ_4G)
 		return ERR_PTR(-E2BIG);
@@ -122,7 +151,9 @@ static struct bpf_map *arena_map_alloc(union bpf_attr *attr)
 		/* user vma must not cross 32-bit boundary */
 		return ERR_PTR(-ERANGE);
 
-	kern_vm = get_vm_area(KERN_VM_SZ, VM_SPARSE | VM_USERMAP);
+	/* leave room to align kern_vm_start to PMD_SIZE */
+	kern_vm_sz = KERN_VM_SZ + (huge ? PMD_SIZE : 0);
+	kern_vm = get_vm_area(kern_vm_sz, VM_SPARSE | VM_USERMAP);
 	if (!kern_vm)
 		return ERR_PTR(-ENOMEM);
 
@@ -131,6 +162,10 @@ static struct bpf_map *arena_map_alloc(union bpf_attr *attr)
 		goto err;
 
 	arena->kern_vm = kern_vm;
+	arena->kern_vm_start = (u64)(long)kern_vm->addr + GUARD_SZ / 2;
+	if (huge)
+		arena->kern_vm_start = round_up(arena->kern_vm_start, PMD_SIZE);
+	arena->next_node = NUMA_NO_NODE;
 	arena->user_vm_start = attr->map_extra;
 	if (arena->user_vm_start)
 		arena->user_vm_end = arena->user_vm_start + vm_range;
@@ -167,6 +202,23 @@ static int existing_page_cb(pte_t *ptep, unsigned long addr, void *data)
 	return 0;
 }
 
+/* apply_to_existing_page_range() does not walk PMD mappings */
+static void arena_free_huge_pages(struct bpf_arena *arena)
+{
+	u64 kaddr, kend = arena->kern_vm_start + SZ_4G;
+	struct page *page;
+	long i;
+
+	for (kaddr = arena->kern_vm_start; kaddr < kend; kaddr += PMD_SIZE) {
+		page = vmalloc_to_page((void *)kaddr);
+		if (!page)
+			continue;
+		for (i = 0; i < ARENA_HUGE_NR; i++)
+			__free_page(page + i);
+		cond_resched();
+	}
+}
+
 static void arena_map_free(struct bpf_map *map)
 {
 	struct bpf_arena *arena = container_of(map, struct bpf_arena, map);
@@ -186,8 +238,11 @@ static void arena_map_free(struct bpf_map *map)
 	 * Call apply_to_existing_page_range() first to find populated ptes and
 	 * free those pages.
 	 */
-	apply_to_existing_page_range(&init_mm, bpf_arena_get_kern_vm_start(arena),
-				     KERN_VM_SZ - GUARD_SZ, existing_page_cb, NULL);
+	if (arena_is_huge(arena))
+		arena_free_huge_pages(arena);
+	else
+		apply_to_existing_page_range(&init_mm, bpf_arena_get_kern_vm_start(arena),
+					     KERN_VM_SZ - GUARD_SZ, existing_page_cb, NULL);
 	free_vm_area(arena->kern_vm);
 	range_tree_destroy(&arena->rt);
 	bpf_map_area_free(arena);
@@ -259,54 +314,160 @@ static void arena_vm_close(struct vm_area_struct *vma)
 
 #define MT_ENTRY ((void *)&arena_map_ops) /* unused. has to be valid pointer */
 
-static vm_fault_t arena_vm_fault(struct vm_fault *vmf)
+/* Allocate @page_cnt pages for the arena, accounted into the memcg of the
+ * process that created it.  With BPF_F_ARENA_INTERLEAVE every arena page
+ * (4K or huge) comes from the next memory node.  Called with arena->lock held.
+ */
+static int arena_alloc_kern_pages(struct bpf_arena *arena, int node_id, u64 flags,
+				  long page_cnt, struct page **pages)
 {
-	struct bpf_map *map = vmf->vma->vm_file->private_data;
-	struct bpf_arena *arena = container_of(map, struct bpf_arena, map);
-	struct page *page;
-	long kbase, kaddr;
+	unsigned int order = arena_is_huge(arena) ? PMD_ORDER : 0;
+	long i, j, nr = arena_page_nr(arena);
 	int ret;
 
-	kbase = bpf_arena_get_kern_vm_start(arena);
-	kaddr = kbase + (u32)(vmf->address);
+	if (!(flags & BPF_F_ARENA_INTERLEAVE))
+		return bpf_map_alloc_pages(&arena->map, GFP_KERNEL | __GFP_ZERO,
+					   node_id, order, page_cnt, pages);
+
+	for (i = 0; i < page_cnt; i += nr) {
+		arena->next_node = next_node_in(arena->next_node,
+						node_states[N_MEMORY]);
+		ret = bpf_map_alloc_pages(&arena->map, GFP_KERNEL | __GFP_ZERO,
+					  arena->next_node, order, nr, pages + i);
+		if (ret) {
+			for (j = 0; j < i; j++)
+				__free_page(pages[j]);
+			return ret;
+		}
+	}
+	return 0;
+}
 
-	guard(mutex)(&arena->lock);
+/* Map @page_cnt pages at @kaddr into the kernel vm_area of the arena */
+static int arena_map_kern_pages(struct bpf_arena *arena, long kaddr, long page_cnt,
+				struct page **pages)
+{
+	long i;
+	int ret;
+
+	if (!arena_is_huge(arena))
+		return vm_area_map_pages(arena->kern_vm, kaddr,
+					 kaddr + page_cnt * PAGE_SIZE, pages);
+
+	/* blocks are physically contiguous, so the arch can map them with PMDs */
+	for (i = 0; i < page_cnt; i += ARENA_HUGE_NR) {
+		ret = vmap_page_range(kaddr + i * PAGE_SIZE,
+				      kaddr + (i + ARENA_HUGE_NR) * PAGE_SIZE,
+				      page_to_phys(pages[i]), PAGE_KERNEL);
+		if (ret) {
+			vm_area_unmap_pages(arena->kern_vm, kaddr,
+					    kaddr + i * PAGE_SIZE);
+			return ret;
+		}
+	}
+	return 0;
+}
+
+/* Return the page backing user address @uaddr, allocating the arena page
+ * around it unless the arena is BPF_F_SEGV_ON_FAULT.  Called with
+ * arena->lock held.
+ */
+static struct page *arena_fault_page(struct bpf_arena *arena, unsigned long uaddr)
+{
+	long kbase = bpf_arena_get_kern_vm_start(arena);
+	long nr = arena_page_nr(arena);
+	long kaddr, kstart, pgoff, i;
+	struct page *page, **pages;
+
+	kaddr = kbase + (u32)uaddr;
 	page = vmalloc_to_page((void *)kaddr);
 	if (page)
 		/* already have a page vmap-ed */
-		goto out;
+		return page;
 
 	if (arena->map.map_flags & BPF_F_SEGV_ON_FAULT)
 		/* User space requested to segfault when page is not allocated by bpf prog */
-		return VM_FAULT_SIGSEGV;
+		return NULL;
 
-	ret = range_tree_clear(&arena->rt, vmf->pgoff, 1);
-	if (ret)
-		return VM_FAULT_SIGSEGV;
+	pgoff = round_down(compute_pgoff(arena, uaddr), nr);
+	kstart = round_down(kaddr, nr * PAGE_SIZE);
 
-	/* Account into memcg of the process that created bpf_arena */
-	ret = bpf_map_alloc_pages(map, GFP_KERNEL | __GFP_ZERO, NUMA_NO_NODE, 1, &page);
-	if (ret) {
-		range_tree_set(&arena->rt, vmf->pgoff, 1);
-		return VM_FAULT_SIGSEGV;
-	}
+	if (range_tree_clear(&arena->rt, pgoff, nr))
+		return NULL;
 
-	ret = vm_area_map_pages(arena->kern_vm, kaddr, kaddr + PAGE_SIZE, &page);
-	if (ret) {
-		range_tree_set(&arena->rt, vmf->pgoff, 1);
-		__free_page(page);
-		return VM_FAULT_SIGSEGV;
+	pages = kvcalloc(nr, sizeof(*pages), GFP_KERNEL);
+	if (!pages)
+		goto out;
+
+	if (arena_alloc_kern_pages(arena, NUMA_NO_NODE, 0, nr, pages))
+		goto out_free_array;
+
+	if (arena_map_kern_pages(arena, kstart, nr, pages)) {
+		for (i = 0; i < nr; i++)
+			__free_page(pages[i]);
+		goto out_free_array;
 	}
+
+	page = pages[(kaddr - kstart) >> PAGE_SHIFT];
+	kvfree(pages);
+	return page;
+
+out_free_array:
+	kvfree(pages);
 out:
+	range_tree_set(&arena->rt, pgoff, nr);
+	return NULL;
+}
+
+static vm_fault_t arena_vm_fault(struct vm_fault *vmf)
+{
+	struct bpf_map *map = vmf->vma->vm_file->private_data;
+	struct bpf_arena *arena = container_of(map, struct bpf_arena, map);
+	struct page *page;
+
+	guard(mutex)(&arena->lock);
+	page = arena_fault_page(arena, vmf->address);
+	if (!page)
+		return VM_FAULT_SIGSEGV;
+
+	if (arena_is_huge(arena))
+		/* huge arenas are mapped VM_PFNMAP, see arena_map_mmap() */
+		return vmf_insert_pfn(vmf->vma, vmf->address, page_to_pfn(page));
+
 	page_ref_add(page, 1);
 	vmf->page = page;
 	return 0;
 }
 
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+static vm_fault_t arena_vm_huge_fault(struct vm_fault *vmf, unsigned int order)
+{
+	struct bpf_map *map = vmf->vma->vm_file->private_data;
+	struct bpf_arena *arena = container_of(map, struct bpf_arena, map);
+	unsigned long uaddr = vmf->address & PMD_MASK;
+	struct page *page;
+
+	if (order != PMD_ORDER || !arena_is_huge(arena) ||
+	    uaddr < vmf->vma->vm_start || uaddr + PMD_SIZE > vmf->vma->vm_end)
+		return VM_FAULT_FALLBACK;
+
+	guard(mutex)(&arena->lock);
+	page = arena_fault_page(arena, uaddr);
+	if (!page)
+		return VM_FAULT_SIGSEGV;
+
+	return vmf_insert_pfn_pmd(vmf, page_to_pfn_t(page),
+				  vmf->flags & FAULT_FLAG_WRITE);
+}
+#endif
+
 static const struct vm_operations_struct arena_vm_ops = {
 	.open		= arena_vm_open,
 	.close		= arena_vm_close,
 	.fault          = arena_vm_fault,
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	.huge_fault	= arena_vm_huge_fault,
+#endif
 };
 
 static unsigned long arena_get_unmapped_area(struct file *filp, unsigned long addr,
@@ -335,6 +496,9 @@ static unsigned long arena_get_unmapped_area(struct file *filp, unsigned long ad
 	ret = mm_get_unmapped_area(current->mm, filp, addr, len * 2, 0, flags);
 	if (IS_ERR_VALUE(ret))
 		return ret;
+	if (arena_is_huge(arena))
+		/* len is a multiple of PMD_SIZE, so there is room for this */
+		ret = round_up(ret, PMD_SIZE);
 	if ((ret >> 32) == ((ret + len - 1) >> 32))
 		return ret;
 	if (WARN_ON_ONCE(arena->user_vm_start))
@@ -367,6 +531,11 @@ static int arena_map_mmap(struct bpf_map *map, struct vm_area_struct *vma)
 	if (WARN_ON_ONCE(vma->vm_end - vma->vm_start > SZ_4G || vma->vm_pgoff))
 		return -EFAULT;
 
+	if (arena_is_huge(arena) &&
+	    (!IS_ALIGNED(vma->vm_start, PMD_SIZE) ||
+	     !IS_ALIGNED(vma->vm_end, PMD_SIZE)))
+		return -EINVAL;
+
 	if (remember_vma(arena, vma))
 		return -ENOMEM;
 
@@ -378,6 +547,13 @@ static int arena_map_mmap(struct bpf_map *map, struct vm_area_struct *vma)
 	 * potential change of user_vm_start.
 	 */
 	vm_flags_set(vma, VM_DONTEXPAND);
+	/*
+	 * Huge arena pages are split high order allocations, they are
+	 * inserted as PFNs (possibly with a PMD) instead of being
+	 * refcounted by the user mappings.
+	 */
+	if (arena_is_huge(arena))
+		vm_flags_set(vma, VM_PFNMAP);
 	vma->vm_ops = &arena_vm_ops;
 	return 0;
 }
@@ -421,7 +597,8 @@ static u64 clear_lo32(u64 val)
  * Allocate pages and vmap them into kernel vmalloc area.
  * Later the pages will be mmaped into user space vma.
  */
-static long arena_alloc_pages(struct bpf_arena *arena, long uaddr, long page_cnt, int node_id)
+static long arena_alloc_pages(struct bpf_arena *arena, long uaddr, long page_cnt, int node_id,
+			      u64 flags)
 {
 	/* user_vm_end/start are fixed before bpf prog runs */
 	long page_cnt_max = (arena->user_vm_end - arena->user_vm_start) >> PAGE_SHIFT;
@@ -434,9 +611,20 @@ static long arena_alloc_pages(struct bpf_arena *arena, long uaddr, long page_cnt
 	if (page_cnt > page_cnt_max)
 		return 0;
 
+	if (node_id != NUMA_NO_NODE &&
+	    ((unsigned int)node_id >= nr_node_ids || !node_online(node_id) ||
+	     (flags & BPF_F_ARENA_INTERLEAVE)))
+		return 0;
+
+	/* huge arenas are allocated in whole, aligned huge pages */
+	if (!IS_ALIGNED(page_cnt, arena_page_nr(arena)))
+		return 0;
+
 	if (uaddr) {
 		if (uaddr & ~PAGE_MASK)
 			return 0;
+		if (!IS_ALIGNED(uaddr, arena_page_nr(arena) * PAGE_SIZE))
+			return 0;
 		pgoff = compute_pgoff(arena, uaddr);
 		if (pgoff > page_cnt_max - page_cnt)
 			/* requested address will be outside of user VMA */
@@ -463,8 +651,7 @@ static long arena_alloc_pages(struct bpf_arena *arena, long uaddr, long page_cnt
 	if (ret)
 		goto out_free_pages;
 
-	ret = bpf_map_alloc_pages(&arena->map, GFP_KERNEL | __GFP_ZERO,
-				  node_id, page_cnt, pages);
+	ret = arena_alloc_kern_pages(arena, node_id, flags, page_cnt, pages);
 	if (ret)
 		goto out;
 
@@ -476,8 +663,7 @@ static long arena_alloc_pages(struct bpf_arena *arena, long uaddr, long page_cnt
 	 * kern_vm_start + uaddr32 + page_cnt * PAGE_SIZE - 1 can overflow
 	 * lower 32-bit and it's ok.
 	 */
-	ret = vm_area_map_pages(arena->kern_vm, kern_vm_start + uaddr32,
-				kern_vm_start + uaddr32 + page_cnt * PAGE_SIZE, pages);
+	ret = arena_map_kern_pages(arena, kern_vm_start + uaddr32, page_cnt, pages);
 	if (ret) {
 		for (i = 0; i < page_cnt; i++)
 			__free_page(pages[i]);
@@ -508,8 +694,8 @@ static void zap_pages(struct bpf_arena *arena, long uaddr, long page_cnt)
 
 static void arena_free_pages(struct bpf_arena *arena, long uaddr, long page_cnt)
 {
+	long kaddr, pgoff, i, j, nr = arena_page_nr(arena);
 	u64 full_uaddr, uaddr_end;
-	long kaddr, pgoff, i;
 	struct page *page;
 
 	/* only aligned lower 32-bit are relevant */
@@ -522,6 +708,10 @@ static void arena_free_pages(struct bpf_arena *arena, long uaddr, long page_cnt)
 
 	page_cnt = (uaddr_end - full_uaddr) >> PAGE_SHIFT;
 
+	/* huge pages cannot be freed partially */
+	if (!IS_ALIGNED(uaddr, nr * PAGE_SIZE) || !IS_ALIGNED(page_cnt, nr))
+		return;
+
 	guard(mutex)(&arena->lock);
 
 	pgoff = compute_pgoff(arena, uaddr);
@@ -533,7 +723,8 @@ static void arena_free_pages(struct bpf_arena *arena, long uaddr, long page_cnt)
 		zap_pages(arena, full_uaddr, page_cnt);
 
 	kaddr = bpf_arena_get_kern_vm_start(arena) + uaddr;
-	for (i = 0; i < page_cnt; i++, kaddr += PAGE_SIZE, full_uaddr += PAGE_SIZE) {
+	for (i = 0; i < page_cnt; i += nr, kaddr += nr * PAGE_SIZE,
+	     full_uaddr += nr * PAGE_SIZE) {
 		page = vmalloc_to_page((void *)kaddr);
 		if (!page)
 			continue;
@@ -544,8 +735,9 @@ static void arena_free_pages(struct bpf_arena *arena, long uaddr, long page_cnt)
 			 * page_cnt is big it's faster to do the batched zap.
 			 */
 			zap_pages(arena, full_uaddr, 1);
-		vm_area_unmap_pages(arena->kern_vm, kaddr, kaddr + PAGE_SIZE);
-		__free_page(page);
+		vm_area_unmap_pages(arena->kern_vm, kaddr, kaddr + nr * PAGE_SIZE);
+		for (j = 0; j < nr; j++)
+			__free_page(page + j);
 	}
 }
 
@@ -557,10 +749,11 @@ __bpf_kfunc void *bpf_arena_alloc_pages(void *p__map, void *addr__ign, u32 page_
 	struct bpf_map *map = p__map;
 	struct bpf_arena *arena = container_of(map, struct bpf_arena, map);
 
-	if (map->map_type != BPF_MAP_TYPE_ARENA || flags || !page_cnt)
+	if (map->map_type != BPF_MAP_TYPE_ARENA || (flags & ~BPF_F_ARENA_INTERLEAVE) ||
+	    !page_cnt)
 		return NULL;
 
-	return (void *)arena_alloc_pages(arena, (long)addr__ign, page_cnt, node_id);
+	return (void *)arena_alloc_pages(arena, (long)addr__ign, page_cnt, node_id, flags);
 }
 
 __bpf_kfunc void bpf_arena_free_pages(void *p__map, void *ptr__ign, u32 page_cnt)
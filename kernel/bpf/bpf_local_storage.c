@@ -17,6 +17,9 @@
 
 #define BPF_LOCAL_STORAGE_CREATE_FLAG_MASK (BPF_F_NO_PREALLOC | BPF_F_CLONE)
 
+/* Beyond that many index slots lookups walk the local_storage->list */
+#define BPF_LOCAL_STORAGE_INDEX_MAX	4096
+
 static struct bpf_local_storage_map_bucket *
 select_bucket(struct bpf_local_storage_map *smap,
 	      struct bpf_local_storage_elem *selem)
@@ -114,6 +117,149 @@ bpf_selem_alloc(struct bpf_local_storage_map *smap, void *owner,
 	return NULL;
 }
 
+static void bpf_local_storage_index_free_trace_rcu(struct rcu_head *rcu)
+{
+	struct bpf_local_storage_index *index;
+
+	index = container_of(rcu, struct bpf_local_storage_index, rcu);
+	if (rcu_trace_implies_rcu_gp())
+		kfree(index);
+	else
+		kfree_rcu(index, rcu);
+}
+
+static void bpf_local_storage_index_free(struct bpf_local_storage_index *index)
+{
+	if (index)
+		call_rcu_tasks_trace(&index->rcu,
+				     bpf_local_storage_index_free_trace_rcu);
+}
+
+/* The index is changed with local_storage->lock held or before
+ * local_storage is published to the owner.
+ */
+static struct bpf_local_storage_index *
+storage_index(struct bpf_local_storage *local_storage)
+{
+	return rcu_dereference_protected(local_storage->index, true);
+}
+
+static bool index_is_full(const struct bpf_local_storage_index *index)
+{
+	return (index->nr_used + 1) * 4 > (index->mask + 1) * 3;
+}
+
+static bool index_needs_grow(const struct bpf_local_storage_index *index,
+			     u32 nr_selems)
+{
+	if (!index)
+		return nr_selems > BPF_LOCAL_STORAGE_CACHE_SIZE;
+	return index_is_full(index);
+}
+
+/* Called on a private index or under local_storage->lock.  The index must
+ * not be full.  An sdata of the same smap is replaced in place, so that a
+ * lockless lookup finds either the old or the new one during an update.
+ */
+static void index_add(struct bpf_local_storage_index *index,
+		      struct bpf_local_storage_data *sdata)
+{
+	struct bpf_local_storage_map *smap = rcu_access_pointer(sdata->smap);
+	struct bpf_local_storage_data *cur;
+	u32 i, dead = U32_MAX, mask = index->mask;
+
+	for (i = hash_ptr(smap, 32) & mask;; i = (i + 1) & mask) {
+		cur = rcu_dereference_protected(index->slots[i], true);
+		if (!cur)
+			break;
+		if (cur == BPF_LOCAL_STORAGE_INDEX_DEAD) {
+			if (dead == U32_MAX)
+				dead = i;
+			continue;
+		}
+		if (rcu_access_pointer(cur->smap) == smap) {
+			rcu_assign_pointer(index->slots[i], sdata);
+			return;
+		}
+	}
+
+	if (dead != U32_MAX)
+		i = dead;
+	else
+		index->nr_used++;
+	rcu_assign_pointer(index->slots[i], sdata);
+}
+
+static void index_del(struct bpf_local_storage_index *index,
+		      struct bpf_local_storage_map *smap,
+		      struct bpf_local_storage_data *sdata)
+{
+	struct bpf_local_storage_data *cur;
+	u32 i, n, mask = index->mask;
+
+	i = hash_ptr(smap, 32) & mask;
+	for (n = 0; n <= mask; n++, i = (i + 1) & mask) {
+		cur = rcu_dereference_protected(index->slots[i], true);
+		if (!cur)
+			return;
+		if (cur == sdata) {
+			RCU_INIT_POINTER(index->slots[i], BPF_LOCAL_STORAGE_INDEX_DEAD);
+			return;
+		}
+	}
+}
+
+/* Allocate a bigger index before taking local_storage->lock if adding
+ * one more elem would need it.
+ */
+static struct bpf_local_storage_index *
+bpf_local_storage_index_alloc(struct bpf_local_storage *local_storage,
+			      struct bpf_local_storage_map *smap, gfp_t gfp_flags)
+{
+	u32 nr_selems = READ_ONCE(local_storage->nr_selems) + 1;
+	struct bpf_local_storage_index *index;
+	u32 slots;
+
+	/* Same as for the selem, kmalloc is not safe for every bpf_ma user */
+	if (smap->bpf_ma && gfp_flags != GFP_KERNEL)
+		return NULL;
+
+	index = rcu_dereference_check(local_storage->index, bpf_rcu_lock_held());
+	if (!index_needs_grow(index, nr_selems))
+		return NULL;
+
+	slots = roundup_pow_of_two(nr_selems * 2);
+	if (slots > BPF_LOCAL_STORAGE_INDEX_MAX)
+		return NULL;
+
+	index = bpf_map_kzalloc(&smap->map, struct_size(index, slots, slots),
+				gfp_flags | __GFP_NOWARN);
+	if (index)
+		index->mask = slots - 1;
+	return index;
+}
+
+/* local_storage->lock must be held.  Returns false if new_index is not
+ * needed (anymore) and should be freed by the caller.
+ */
+static bool bpf_local_storage_index_install(struct bpf_local_storage *local_storage,
+					    struct bpf_local_storage_index *new_index)
+{
+	struct bpf_local_storage_index *index = storage_index(local_storage);
+	u32 nr_selems = local_storage->nr_selems + 1;
+	struct bpf_local_storage_elem *selem;
+
+	if (!index_needs_grow(index, nr_selems) ||
+	    nr_selems * 4 > (new_index->mask + 1) * 3)
+		return false;
+
+	hlist_for_each_entry(selem, &local_storage->list, snode)
+		index_add(new_index, SDATA(selem));
+	rcu_assign_pointer(local_storage->index, new_index);
+	bpf_local_storage_index_free(index);
+	return true;
+}
+
 /* rcu tasks trace callback for bpf_ma == false */
 static void __bpf_local_storage_free_trace_rcu(struct rcu_head *rcu)
 {
@@ -290,6 +436,7 @@ static bool bpf_selem_unlink_storage_nolock(struct bpf_local_storage *local_stor
 					    struct bpf_local_storage_elem *selem,
 					    bool uncharge_mem, struct hlist_head *free_selem_list)
 {
+	struct bpf_local_storage_index *index;
 	struct bpf_local_storage_map *smap;
 	bool free_local_storage;
 	void *owner;
@@ -328,6 +475,14 @@ static bool bpf_selem_unlink_storage_nolock(struct bpf_local_storage *local_stor
 		 */
 	}
 	hlist_del_init_rcu(&selem->snode);
+	local_storage->nr_selems--;
+	index = storage_index(local_storage);
+	if (index && free_local_storage) {
+		RCU_INIT_POINTER(local_storage->index, NULL);
+		bpf_local_storage_index_free(index);
+	} else if (index) {
+		index_del(index, smap, SDATA(selem));
+	}
 	if (rcu_access_pointer(local_storage->cache[smap->cache_idx]) ==
 	    SDATA(selem))
 		RCU_INIT_POINTER(local_storage->cache[smap->cache_idx], NULL);
@@ -409,8 +564,24 @@ static void bpf_selem_unlink_storage(struct bpf_local_storage_elem *selem,
 void bpf_selem_link_storage_nolock(struct bpf_local_storage *local_storage,
 				   struct bpf_local_storage_elem *selem)
 {
+	struct bpf_local_storage_index *index = storage_index(local_storage);
+
 	RCU_INIT_POINTER(selem->local_storage, local_storage);
 	hlist_add_head_rcu(&selem->snode, &local_storage->list);
+	local_storage->nr_selems++;
+
+	if (!index)
+		return;
+	if (index_is_full(index)) {
+		/* No bigger index was allocated, fall back to the list */
+		RCU_INIT_POINTER(local_storage->index, NULL);
+		bpf_local_storage_index_free(index);
+		return;
+	}
+	/* SDATA(selem)->smap is set, the index only exists for a storage
+	 * that has been published and bpf_selem_link_map() comes first.
+	 */
+	index_add(index, SDATA(selem));
 }
 
 static void bpf_selem_unlink_map(struct bpf_local_storage_elem *selem)
@@ -512,9 +683,11 @@ int bpf_local_storage_alloc(void *owner,
 	}
 
 	RCU_INIT_POINTER(storage->smap, smap);
+	RCU_INIT_POINTER(storage->index, NULL);
 	INIT_HLIST_HEAD(&storage->list);
 	raw_spin_lock_init(&storage->lock);
 	storage->owner = owner;
+	storage->nr_selems = 0;
 
 	bpf_selem_link_storage_nolock(storage, first_selem);
 	bpf_selem_link_map(smap, first_selem);
@@ -567,6 +740,7 @@ bpf_local_storage_update(void *owner, struct bpf_local_storage_map *smap,
 {
 	struct bpf_local_storage_data *old_sdata = NULL;
 	struct bpf_local_storage_elem *alloc_selem, *selem = NULL;
+	struct bpf_local_storage_index *new_index;
 	struct bpf_local_storage *local_storage;
 	HLIST_HEAD(old_selem_free_list);
 	unsigned long flags;
@@ -628,6 +802,8 @@ bpf_local_storage_update(void *owner, struct bpf_local_storage_map *smap,
 	if (!alloc_selem)
 		return ERR_PTR(-ENOMEM);
 
+	new_index = bpf_local_storage_index_alloc(local_storage, smap, gfp_flags);
+
 	raw_spin_lock_irqsave(&local_storage->lock, flags);
 
 	/* Recheck local_storage->list under local_storage->lock */
@@ -653,6 +829,9 @@ bpf_local_storage_update(void *owner, struct bpf_local_storage_map *smap,
 		goto unlock;
 	}
 
+	if (new_index && bpf_local_storage_index_install(local_storage, new_index))
+		new_index = NULL;
+
 	alloc_selem = NULL;
 	/* First, link the new selem to the map */
 	bpf_selem_link_map(smap, selem);
@@ -669,6 +848,8 @@ bpf_local_storage_update(void *owner, struct bpf_local_storage_map *smap,
 
 unlock:
 	raw_spin_unlock_irqrestore(&local_storage->lock, flags);
+	/* never published */
+	kfree(new_index);
 	bpf_selem_free_list(&old_selem_free_list, false);
 	if (alloc_selem) {
 		mem_uncharge(smap, owner, smap->elem_size);
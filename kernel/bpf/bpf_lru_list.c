@@ -13,6 +13,8 @@
 #define PERCPU_FREE_TARGET		(4)
 #define PERCPU_NR_SCANS			PERCPU_FREE_TARGET
 
+#define SAMPLED_NR_SCANS		(32)
+
 /* Helpers to get the local list index */
 #define LOCAL_LIST_IDX(t)	((t) - BPF_LOCAL_LIST_T_OFFSET)
 #define LOCAL_FREE_LIST_IDX	LOCAL_LIST_IDX(BPF_LRU_LOCAL_LIST_T_FREE)
@@ -496,9 +498,140 @@ static struct bpf_lru_node *bpf_common_lru_pop_free(struct bpf_lru *lru,
 	return node;
 }
 
+/* Sampled LRU.  Free nodes sit on the free list of a per-cpu local
+ * list and in use nodes are only linked in the htab, so neither lookups
+ * nor updates touch any LRU state shared with other cpus.
+ *
+ * Whoever deletes a node from the htab owns it: a concurrent delete or
+ * an eviction by another cpu cannot succeed twice because
+ * del_from_htab() searches the bucket under the bucket lock.  The hand
+ * and the type of the nodes are therefore only hints and are read and
+ * written without any lock.
+ */
+static struct bpf_lru_node *__sampled_lru_node(struct bpf_sampled_lru *slru,
+					       u32 idx)
+{
+	return slru->buf + (size_t)idx * slru->elem_size + slru->node_offset;
+}
+
+/* Sweep the nodes from the hand of the current cpu:
+ * 1. A node with the ref bit set gets its ref bit cleared and
+ *    survives this sweep.
+ * 2. The first node without the ref bit set that can be deleted
+ *    from the htab is evicted.
+ * 3. If nothing was evicted after nr_scans nodes, the next
+ *    nr_scans nodes are considered without honoring the ref bit.
+ */
+static struct bpf_lru_node *
+bpf_sampled_lru_evict(struct bpf_lru *lru, struct bpf_lru_locallist *loc_l)
+{
+	struct bpf_sampled_lru *slru = &lru->sampled_lru;
+	u32 idx = READ_ONCE(loc_l->next_evict);
+	struct bpf_lru_node *node, *evicted = NULL;
+	unsigned int i;
+
+	for (i = 0; i < 2 * lru->nr_scans; i++) {
+		node = __sampled_lru_node(slru, idx);
+		if (++idx == slru->nr_elems)
+			idx = 0;
+
+		if (READ_ONCE(node->type) != BPF_LRU_LIST_T_ACTIVE)
+			continue;
+
+		if (i < lru->nr_scans && bpf_lru_node_is_ref(node)) {
+			bpf_lru_node_clear_ref(node);
+			continue;
+		}
+
+		if (lru->del_from_htab(lru->del_arg, node)) {
+			evicted = node;
+			break;
+		}
+	}
+
+	WRITE_ONCE(loc_l->next_evict, idx);
+
+	return evicted;
+}
+
+/* Steal a node from the local free list of other cpus in RR */
+static struct bpf_lru_node *
+bpf_sampled_lru_steal(struct bpf_lru *lru, struct bpf_lru_locallist *loc_l)
+{
+	struct bpf_sampled_lru *slru = &lru->sampled_lru;
+	struct bpf_lru_locallist *steal_loc_l;
+	struct bpf_lru_node *node;
+	int steal, first_steal;
+	unsigned long flags;
+
+	first_steal = loc_l->next_steal;
+	steal = first_steal;
+	do {
+		steal_loc_l = per_cpu_ptr(slru->local_list, steal);
+
+		raw_spin_lock_irqsave(&steal_loc_l->lock, flags);
+		node = __local_list_pop_free(steal_loc_l);
+		raw_spin_unlock_irqrestore(&steal_loc_l->lock, flags);
+
+		steal = get_next_cpu(steal);
+	} while (!node && steal != first_steal);
+
+	loc_l->next_steal = steal;
+
+	if (!node && !READ_ONCE(slru->free_exhausted))
+		WRITE_ONCE(slru->free_exhausted, true);
+
+	return node;
+}
+
+static struct bpf_lru_node *bpf_sampled_lru_pop_free(struct bpf_lru *lru,
+						     u32 hash)
+{
+	struct bpf_sampled_lru *slru = &lru->sampled_lru;
+	struct bpf_lru_locallist *loc_l;
+	struct bpf_lru_node *node;
+	unsigned long flags;
+	int cpu = raw_smp_processor_id();
+
+	loc_l = per_cpu_ptr(slru->local_list, cpu);
+
+	raw_spin_lock_irqsave(&loc_l->lock, flags);
+	node = __local_list_pop_free(loc_l);
+	raw_spin_unlock_irqrestore(&loc_l->lock, flags);
+
+	/* The free nodes are split between the cpus, so a map far from
+	 * full can have run out of them on this cpu only.  Take a free
+	 * node from another cpu before evicting a live element.  Once a
+	 * steal found every free list empty, the map is full and further
+	 * inserts go straight to eviction, until a node is freed again.
+	 */
+	if (!node && !READ_ONCE(slru->free_exhausted))
+		node = bpf_sampled_lru_steal(lru, loc_l);
+
+	if (!node)
+		node = bpf_sampled_lru_evict(lru, loc_l);
+
+	/* Nothing could be evicted (e.g. most of the elements are being
+	 * updated or deleted on other cpus).
+	 */
+	if (!node)
+		node = bpf_sampled_lru_steal(lru, loc_l);
+
+	if (node) {
+		*(u32 *)((void *)node + lru->hash_offset) = hash;
+		node->cpu = cpu;
+		bpf_lru_node_clear_ref(node);
+		WRITE_ONCE(node->type, BPF_LRU_LIST_T_ACTIVE);
+	}
+
+	return node;
+}
+
 struct bpf_lru_node *bpf_lru_pop_free(struct bpf_lru *lru, u32 hash)
 {
-	if (lru->percpu)
+	if (lru->sampled)
+		return bpf_sampled_lru_pop_free(lru, hash);
+	else if (lru->percpu)
 		return bpf_percpu_lru_pop_free(lru, hash);
 	else
 		return bpf_common_lru_pop_free(lru, hash);
@@ -553,9 +686,38 @@ static void bpf_percpu_lru_push_free(struct bpf_lru *lru,
 	raw_spin_unlock_irqrestore(&l->lock, flags);
 }
 
+/* The node goes back to the cpu which popped it, so that elements
+ * which are inserted on one cpu and deleted on another do not pile up
+ * on the free list of the deleting cpu.
+ */
+static void bpf_sampled_lru_push_free(struct bpf_lru *lru,
+				      struct bpf_lru_node *node)
+{
+	struct bpf_lru_locallist *loc_l;
+	unsigned long flags;
+
+	if (WARN_ON_ONCE(READ_ONCE(node->type) != BPF_LRU_LIST_T_ACTIVE))
+		return;
+
+	loc_l = per_cpu_ptr(lru->sampled_lru.local_list, node->cpu);
+
+	raw_spin_lock_irqsave(&loc_l->lock, flags);
+
+	WRITE_ONCE(node->type, BPF_LRU_LOCAL_LIST_T_FREE);
+	bpf_lru_node_clear_ref(node);
+	list_add(&node->list, local_free_list(loc_l));
+
+	raw_spin_unlock_irqrestore(&loc_l->lock, flags);
+
+	if (READ_ONCE(lru->sampled_lru.free_exhausted))
+		WRITE_ONCE(lru->sampled_lru.free_exhausted, false);
+}
+
 void bpf_lru_push_free(struct bpf_lru *lru, struct bpf_lru_node *node)
 {
-	if (lru->percpu)
+	if (lru->sampled)
+		bpf_sampled_lru_push_free(lru, node);
+	else if (lru->percpu)
 		bpf_percpu_lru_push_free(lru, node);
 	else
 		bpf_common_lru_push_free(lru, node);
@@ -610,10 +772,51 @@ static void bpf_percpu_lru_populate(struct bpf_lru *lru, void *buf,
 	}
 }
 
+static void bpf_sampled_lru_populate(struct bpf_lru *lru, void *buf,
+				     u32 node_offset, u32 elem_size,
+				     u32 nr_elems)
+{
+	struct bpf_sampled_lru *slru = &lru->sampled_lru;
+	struct bpf_lru_locallist *loc_l = NULL;
+	u32 i, pcpu_entries;
+	int cpu;
+
+	slru->buf = buf;
+	slru->node_offset = node_offset;
+	slru->elem_size = elem_size;
+	slru->nr_elems = nr_elems;
+
+	/* Hand out a contiguous chunk of nodes to each cpu and start
+	 * the hand of a cpu at its own chunk.
+	 */
+	pcpu_entries = DIV_ROUND_UP(nr_elems, num_possible_cpus());
+	cpu = cpumask_first(cpu_possible_mask);
+
+	for (i = 0; i < nr_elems; i++) {
+		struct bpf_lru_node *node;
+
+		if (!(i % pcpu_entries)) {
+			if (i)
+				cpu = get_next_cpu(cpu);
+			loc_l = per_cpu_ptr(slru->local_list, cpu);
+			loc_l->next_evict = i;
+		}
+
+		node = __sampled_lru_node(slru, i);
+		node->cpu = cpu;
+		node->type = BPF_LRU_LOCAL_LIST_T_FREE;
+		bpf_lru_node_clear_ref(node);
+		list_add(&node->list, local_free_list(loc_l));
+	}
+}
+
 void bpf_lru_populate(struct bpf_lru *lru, void *buf, u32 node_offset,
 		      u32 elem_size, u32 nr_elems)
 {
-	if (lru->percpu)
+	if (lru->sampled)
+		bpf_sampled_lru_populate(lru, buf, node_offset, elem_size,
+					 nr_elems);
+	else if (lru->percpu)
 		bpf_percpu_lru_populate(lru, buf, node_offset, elem_size,
 					nr_elems);
 	else
@@ -629,6 +832,7 @@ static void bpf_lru_locallist_init(struct bpf_lru_locallist *loc_l, int cpu)
 		INIT_LIST_HEAD(&loc_l->lists[i]);
 
 	loc_l->next_steal = cpu;
+	loc_l->next_evict = 0;
 
 	raw_spin_lock_init(&loc_l->lock);
 }
@@ -648,12 +852,27 @@ static void bpf_lru_list_init(struct bpf_lru_list *l)
 	raw_spin_lock_init(&l->lock);
 }
 
-int bpf_lru_init(struct bpf_lru *lru, bool percpu, u32 hash_offset,
-		 del_from_htab_func del_from_htab, void *del_arg)
+int bpf_lru_init(struct bpf_lru *lru, bool percpu, bool sampled,
+		 u32 hash_offset, del_from_htab_func del_from_htab,
+		 void *del_arg)
 {
 	int cpu;
 
-	if (percpu) {
+	if (sampled) {
+		struct bpf_sampled_lru *slru = &lru->sampled_lru;
+
+		slru->local_list = alloc_percpu(struct bpf_lru_locallist);
+		if (!slru->local_list)
+			return -ENOMEM;
+
+		for_each_possible_cpu(cpu) {
+			struct bpf_lru_locallist *loc_l;
+
+			loc_l = per_cpu_ptr(slru->local_list, cpu);
+			bpf_lru_locallist_init(loc_l, cpu);
+		}
+		lru->nr_scans = SAMPLED_NR_SCANS;
+	} else if (percpu) {
 		lru->percpu_lru = alloc_percpu(struct bpf_lru_list);
 		if (!lru->percpu_lru)
 			return -ENOMEM;
@@ -684,6 +903,7 @@ int bpf_lru_init(struct bpf_lru *lru, bool percpu, u32 hash_offset,
 	}
 
 	lru->percpu = percpu;
+	lru->sampled = sampled;
 	lru->del_from_htab = del_from_htab;
 	lru->del_arg = del_arg;
 	lru->hash_offset = hash_offset;
@@ -693,7 +913,9 @@ int bpf_lru_init(struct bpf_lru *lru, bool percpu, u32 hash_offset,
 
 void bpf_lru_destroy(struct bpf_lru *lru)
 {
-	if (lru->percpu)
+	if (lru->sampled)
+		free_percpu(lru->sampled_lru.local_list);
+	else if (lru->percpu)
 		free_percpu(lru->percpu_lru);
 	else
 		free_percpu(lru->common_lru.local_list);
@@ -40,6 +40,8 @@ struct bpf_lru_list {
 struct bpf_lru_locallist {
 	struct list_head lists[NR_BPF_LRU_LOCAL_LIST_T];
 	u16 next_steal;
+	/* The next sampled eviction of this cpu starts from here */
+	u32 next_evict;
 	raw_spinlock_t lock;
 };
 
@@ -48,18 +50,34 @@ struct bpf_common_lru {
 	struct bpf_lru_locallist __percpu *local_list;
 };
 
+/* Sampled LRU: in use nodes are not on any list.  Eviction sweeps the
+ * node array like a CLOCK hand (one hand per cpu) and picks the first
+ * node whose ref bit is not set.
+ */
+struct bpf_sampled_lru {
+	struct bpf_lru_locallist __percpu *local_list;
+	void *buf;
+	u32 node_offset;
+	u32 elem_size;
+	u32 nr_elems;
+	/* hint: the last steal found no free node on any cpu */
+	bool free_exhausted;
+};
+
 typedef bool (*del_from_htab_func)(void *arg, struct bpf_lru_node *node);
 
 struct bpf_lru {
 	union {
 		struct bpf_common_lru common_lru;
 		struct bpf_lru_list __percpu *percpu_lru;
+		struct bpf_sampled_lru sampled_lru;
 	};
 	del_from_htab_func del_from_htab;
 	void *del_arg;
 	unsigned int hash_offset;
 	unsigned int nr_scans;
 	bool percpu;
+	bool sampled;
 };
 
 static inline void bpf_lru_node_set_ref(struct bpf_lru_node *node)
@@ -68,8 +86,9 @@ static inline void bpf_lru_node_set_ref(struct bpf_lru_node *node)
 		WRITE_ONCE(node->ref, 1);
 }
 
-int bpf_lru_init(struct bpf_lru *lru, bool percpu, u32 hash_offset,
-		 del_from_htab_func del_from_htab, void *delete_arg);
+int bpf_lru_init(struct bpf_lru *lru, bool percpu, bool sampled,
+		 u32 hash_offset, del_from_htab_func del_from_htab,
+		 void *delete_arg);
 void bpf_lru_populate(struct bpf_lru *lru, void *buf, u32 node_offset,
 		      u32 elem_size, u32 nr_elems);
 void bpf_lru_destroy(struct bpf_lru *lru);
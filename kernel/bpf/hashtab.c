@@ -16,10 +16,13 @@
 #include "bpf_lru_list.h"
 #include "map_in_map.h"
 #include <linux/bpf_mem_alloc.h>
+#include <linux/irq_work.h>
+#include <linux/seq_file.h>
 
 #define HTAB_CREATE_FLAG_MASK						\
 	(BPF_F_NO_PREALLOC | BPF_F_NO_COMMON_LRU | BPF_F_NUMA_NODE |	\
-	 BPF_F_ACCESS_MASK | BPF_F_ZERO_SEED)
+	 BPF_F_ACCESS_MASK | BPF_F_ZERO_SEED | BPF_F_RESIZABLE |	\
+	 BPF_F_LRU_SAMPLED)
 
 #define BATCH_OPS(_name)			\
 	.map_lookup_batch =			\
@@ -81,6 +84,44 @@ struct bucket {
 	raw_spinlock_t raw_lock;
 };
 
+/*
+ * The buckets of a BPF_F_RESIZABLE hash table are resized online, with an
+ * incremental rehash similar to lib/rhashtable.c. A worker links a new
+ * table as future_tbl of the current one, then moves the elements of each
+ * old bucket, one bucket at a time and always the last element first, to
+ * the new table. Buckets below rehash have been moved:
+ *
+ * - readers search the current table and, if they do not find the key and
+ *   a future table is linked, the future table. A reader walking off a
+ *   moved element into a chain of the new table sees a nulls value of the
+ *   wrong table and restarts, so it never misses an element that is still
+ *   in the old bucket.
+ * - writers lock the old bucket and, if it has been moved already, lock
+ *   the bucket of the future table instead. Every writer therefore holds
+ *   exactly one bucket lock, the lock of the bucket that holds the key.
+ *
+ * Once all buckets are moved, the future table becomes the current one and
+ * the old table is freed after a grace period. Walks over all elements
+ * (get_next_key, batch ops, iterators) only look at one table, so like with
+ * concurrent updates they may miss or repeat elements during a resize.
+ *
+ * The nulls value of a bucket is its index, tagged with a table generation
+ * above HTAB_NULLS_GEN_SHIFT so that chains of different tables can be told
+ * apart.
+ */
+struct bucket_table {
+	u32 n_buckets;
+	u32 nulls_base;		/* generation tag of the nulls values */
+	u32 rehash;		/* buckets below were moved to future_tbl */
+	struct bucket_table __rcu *future_tbl;
+	struct bucket buckets[];
+};
+
+#define HTAB_NULLS_GEN_SHIFT 28
+#define HTAB_NULLS_GEN_MASK (3U << HTAB_NULLS_GEN_SHIFT)
+/* smallest bucket array of a resizable table */
+#define HTAB_RESIZE_MIN_BUCKETS 16
+
 #define HASHTAB_MAP_LOCK_COUNT 8
 #define HASHTAB_MAP_LOCK_MASK (HASHTAB_MAP_LOCK_COUNT - 1)
 
@@ -88,7 +129,7 @@ struct bpf_htab {
 	struct bpf_map map;
 	struct bpf_mem_alloc ma;
 	struct bpf_mem_alloc pcpu_ma;
-	struct bucket *buckets;
+	struct bucket_table __rcu *tbl;
 	void *elems;
 	union {
 		struct pcpu_freelist freelist;
@@ -101,11 +142,15 @@ struct bpf_htab {
 	struct percpu_counter pcount;
 	atomic_t count;
 	bool use_percpu_counter;
-	u32 n_buckets;	/* number of hash buckets */
+	u32 n_buckets;	/* number of hash buckets of the current table */
+	u32 max_buckets; /* bound of n_buckets of a resizable table */
+	u32 lock_mask;	/* mask of the map_locked index */
 	u32 elem_size;	/* size of each element in bytes */
 	u32 hashrnd;
 	struct lock_class_key lockdep_key;
 	int __percpu *map_locked[HASHTAB_MAP_LOCK_COUNT];
+	struct irq_work resize_irq_work;
+	struct work_struct resize_work;
 };
 
 /* each htab element is struct htab_elem + key + value */
@@ -134,26 +179,37 @@ static inline bool htab_is_prealloc(const struct bpf_htab *htab)
 	return !(htab->map.map_flags & BPF_F_NO_PREALLOC);
 }
 
-static void htab_init_buckets(struct bpf_htab *htab)
+static bool htab_is_resizable(const struct bpf_htab *htab)
+{
+	return htab->map.map_flags & BPF_F_RESIZABLE;
+}
+
+static void htab_init_buckets(struct bpf_htab *htab, struct bucket_table *tbl)
 {
 	unsigned int i;
 
-	for (i = 0; i < htab->n_buckets; i++) {
-		INIT_HLIST_NULLS_HEAD(&htab->buckets[i].head, i);
-		raw_spin_lock_init(&htab->buckets[i].raw_lock);
-		lockdep_set_class(&htab->buckets[i].raw_lock,
+	for (i = 0; i < tbl->n_buckets; i++) {
+		INIT_HLIST_NULLS_HEAD(&tbl->buckets[i].head,
+				      tbl->nulls_base | i);
+		raw_spin_lock_init(&tbl->buckets[i].raw_lock);
+		lockdep_set_class(&tbl->buckets[i].raw_lock,
 					  &htab->lockdep_key);
 		cond_resched();
 	}
 }
 
+static inline struct bucket_table *htab_table(const struct bpf_htab *htab)
+{
+	return rcu_dereference_raw(htab->tbl);
+}
+
 static inline int htab_lock_bucket(const struct bpf_htab *htab,
 				   struct bucket *b, u32 hash,
 				   unsigned long *pflags)
 {
 	unsigned long flags;
 
-	hash = hash & min_t(u32, HASHTAB_MAP_LOCK_MASK, htab->n_buckets - 1);
+	hash = hash & htab->lock_mask;
 
 	preempt_disable();
 	local_irq_save(flags);
@@ -174,7 +230,7 @@ static inline void htab_unlock_bucket(const struct bpf_htab *htab,
 				      struct bucket *b, u32 hash,
 				      unsigned long flags)
 {
-	hash = hash & min_t(u32, HASHTAB_MAP_LOCK_MASK, htab->n_buckets - 1);
+	hash = hash & htab->lock_mask;
 	raw_spin_unlock(&b->raw_lock);
 	__this_cpu_dec(*(htab->map_locked[hash]));
 	local_irq_restore(flags);
@@ -182,6 +238,8 @@ static inline void htab_unlock_bucket(const struct bpf_htab *htab,
 }
 
 static bool htab_lru_map_delete_node(void *arg, struct bpf_lru_node *node);
+static void htab_resize_irq_work(struct irq_work *work);
+static void htab_resize_work(struct work_struct *work);
 
 static bool htab_is_lru(const struct bpf_htab *htab)
 {
@@ -351,6 +409,7 @@ static int prealloc_init(struct bpf_htab *htab)
 	if (htab_is_lru(htab))
 		err = bpf_lru_init(&htab->lru,
 				   htab->map.map_flags & BPF_F_NO_COMMON_LRU,
+				   htab->map.map_flags & BPF_F_LRU_SAMPLED,
 				   offsetof(struct htab_elem, hash) -
 				   offsetof(struct htab_elem, lru_node),
 				   htab_lru_map_delete_node,
@@ -425,6 +484,8 @@ static int htab_map_alloc_check(union bpf_attr *attr)
 	bool percpu_lru = (attr->map_flags & BPF_F_NO_COMMON_LRU);
 	bool prealloc = !(attr->map_flags & BPF_F_NO_PREALLOC);
 	bool zero_seed = (attr->map_flags & BPF_F_ZERO_SEED);
+	bool resizable = (attr->map_flags & BPF_F_RESIZABLE);
+	bool sampled_lru = (attr->map_flags & BPF_F_LRU_SAMPLED);
 	int numa_node = bpf_map_attr_numa_node(attr);
 
 	BUILD_BUG_ON(offsetof(struct htab_elem, fnode.next) !=
@@ -441,9 +502,17 @@ static int htab_map_alloc_check(union bpf_attr *attr)
 	if (!lru && percpu_lru)
 		return -EINVAL;
 
+	/* the sampled LRU replaces both the common and the percpu lists */
+	if (sampled_lru && (!lru || percpu_lru))
+		return -EINVAL;
+
 	if (lru && !prealloc)
 		return -ENOTSUPP;
 
+	/* only elements allocated on demand can be rehashed */
+	if (resizable && prealloc)
+		return -EINVAL;
+
 	if (numa_node != NUMA_NO_NODE && (percpu || percpu_lru))
 		return -EINVAL;
 
@@ -482,6 +551,7 @@ static struct bpf_map *htab_map_alloc(union bpf_attr *attr)
 	 */
 	bool percpu_lru = (attr->map_flags & BPF_F_NO_COMMON_LRU);
 	bool prealloc = !(attr->map_flags & BPF_F_NO_PREALLOC);
+	struct bucket_table *tbl;
 	struct bpf_htab *htab;
 	int err, i;
 
@@ -513,6 +583,18 @@ static struct bpf_map *htab_map_alloc(union bpf_attr *attr)
 		goto free_htab;
 
 	htab->n_buckets = roundup_pow_of_two(htab->map.max_entries);
+	htab->max_buckets = htab->n_buckets;
+	if (htab_is_resizable(htab)) {
+		/* the nulls values need room for a table generation */
+		htab->max_buckets = min_t(u32, htab->max_buckets,
+					  1U << HTAB_NULLS_GEN_SHIFT);
+		htab->n_buckets = min_t(u32, htab->max_buckets,
+					HTAB_RESIZE_MIN_BUCKETS);
+	}
+	/* Resizable tables keep at least HASHTAB_MAP_LOCK_COUNT buckets, so
+	 * the map_locked slot of a hash does not change with the table.
+	 */
+	htab->lock_mask = min_t(u32, HASHTAB_MAP_LOCK_MASK, htab->n_buckets - 1);
 
 	htab->elem_size = sizeof(struct htab_elem) +
 			  round_up(htab->map.key_size, 8);
@@ -522,7 +604,7 @@ static struct bpf_map *htab_map_alloc(union bpf_attr *attr)
 		htab->elem_size += round_up(htab->map.value_size, 8);
 
 	/* check for u32 overflow */
-	if (htab->n_buckets > U32_MAX / sizeof(struct bucket))
+	if (htab->max_buckets > U32_MAX / sizeof(struct bucket))
 		goto free_htab;
 
 	err = bpf_map_init_elem_count(&htab->map);
@@ -530,11 +612,14 @@ static struct bpf_map *htab_map_alloc(union bpf_attr *attr)
 		goto free_htab;
 
 	err = -ENOMEM;
-	htab->buckets = bpf_map_area_alloc(htab->n_buckets *
-					   sizeof(struct bucket),
-					   htab->map.numa_node);
-	if (!htab->buckets)
+	tbl = bpf_map_area_alloc(struct_size(tbl, buckets, htab->n_buckets),
+				 htab->map.numa_node);
+	if (!tbl)
 		goto free_elem_count;
+	tbl->n_buckets = htab->n_buckets;
+	RCU_INIT_POINTER(htab->tbl, tbl);
+	init_irq_work(&htab->resize_irq_work, htab_resize_irq_work);
+	INIT_WORK(&htab->resize_work, htab_resize_work);
 
 	for (i = 0; i < HASHTAB_MAP_LOCK_COUNT; i++) {
 		htab->map_locked[i] = bpf_map_alloc_percpu(&htab->map,
@@ -550,7 +635,7 @@ static struct bpf_map *htab_map_alloc(union bpf_attr *attr)
 	else
 		htab->hashrnd = get_random_u32();
 
-	htab_init_buckets(htab);
+	htab_init_buckets(htab, tbl);
 
 /* compute_batch_value() computes batch value as num_online_cpus() * 2
  * and __percpu_counter_compare() needs
@@ -609,7 +694,7 @@ static struct bpf_map *htab_map_alloc(union bpf_attr *attr)
 		percpu_counter_destroy(&htab->pcount);
 	for (i = 0; i < HASHTAB_MAP_LOCK_COUNT; i++)
 		free_percpu(htab->map_locked[i]);
-	bpf_map_area_free(htab->buckets);
+	bpf_map_area_free(tbl);
 	bpf_mem_alloc_destroy(&htab->pcpu_ma);
 	bpf_mem_alloc_destroy(&htab->ma);
 free_elem_count:
@@ -627,14 +712,19 @@ static inline u32 htab_map_hash(const void *key, u32 key_len, u32 hashrnd)
 	return jhash(key, key_len, hashrnd);
 }
 
-static inline struct bucket *__select_bucket(struct bpf_htab *htab, u32 hash)
+static inline struct bucket *__select_bucket(struct bucket_table *tbl, u32 hash)
+{
+	return &tbl->buckets[hash & (tbl->n_buckets - 1)];
+}
+
+static inline struct hlist_nulls_head *select_bucket(struct bucket_table *tbl, u32 hash)
 {
-	return &htab->buckets[hash & (htab->n_buckets - 1)];
+	return &__select_bucket(tbl, hash)->head;
 }
 
-static inline struct hlist_nulls_head *select_bucket(struct bpf_htab *htab, u32 hash)
+static inline u32 bucket_nulls(const struct bucket_table *tbl, u32 hash)
 {
-	return &__select_bucket(htab, hash)->head;
+	return tbl->nulls_base | (hash & (tbl->n_buckets - 1));
 }
 
 /* this lookup function can only be called with bucket lock taken */
@@ -657,7 +747,7 @@ static struct htab_elem *lookup_elem_raw(struct hlist_nulls_head *head, u32 hash
  */
 static struct htab_elem *lookup_nulls_elem_raw(struct hlist_nulls_head *head,
 					       u32 hash, void *key,
-					       u32 key_size, u32 n_buckets)
+					       u32 key_size, u32 nulls)
 {
 	struct hlist_nulls_node *n;
 	struct htab_elem *l;
@@ -667,12 +757,196 @@ static struct htab_elem *lookup_nulls_elem_raw(struct hlist_nulls_head *head,
 		if (l->hash == hash && !memcmp(&l->key, key, key_size))
 			return l;
 
-	if (unlikely(get_nulls_value(n) != (hash & (n_buckets - 1))))
+	if (unlikely(get_nulls_value(n) != nulls))
 		goto again;
 
 	return NULL;
 }
 
+/* can be called without bucket lock, looks into the future table as well
+ * when a resize is in progress
+ */
+static struct htab_elem *htab_lookup_nulls_elem(struct bpf_htab *htab,
+						u32 hash, void *key,
+						u32 key_size)
+{
+	struct bucket_table *tbl = htab_table(htab);
+	struct htab_elem *l;
+
+	do {
+		l = lookup_nulls_elem_raw(select_bucket(tbl, hash), hash, key,
+					  key_size, bucket_nulls(tbl, hash));
+		if (l)
+			return l;
+		/* an element is linked into the future table before it
+		 * is unlinked from the old one, see htab_rehash_bucket()
+		 */
+		smp_rmb();
+		tbl = rcu_dereference_raw(tbl->future_tbl);
+	} while (unlikely(tbl));
+
+	return NULL;
+}
+
+/* Lock the bucket that holds the elements of @hash, which is the bucket of
+ * the future table once the bucket of the current one has been rehashed.
+ */
+static int htab_lock_hash_bucket(struct bpf_htab *htab, u32 hash,
+				 struct bucket **pb, unsigned long *pflags)
+{
+	struct bucket_table *tbl = htab_table(htab);
+	struct bucket *b;
+	int ret;
+
+	for (;;) {
+		b = __select_bucket(tbl, hash);
+		ret = htab_lock_bucket(htab, b, hash, pflags);
+		if (ret)
+			return ret;
+		if (likely((hash & (tbl->n_buckets - 1)) >=
+			   READ_ONCE(tbl->rehash)))
+			break;
+		htab_unlock_bucket(htab, b, hash, *pflags);
+		tbl = rcu_dereference_raw(tbl->future_tbl);
+	}
+
+	*pb = b;
+	return 0;
+}
+
+static u32 htab_elem_count(struct bpf_htab *htab)
+{
+	if (htab->use_percpu_counter)
+		return percpu_counter_read_positive(&htab->pcount);
+	return atomic_read(&htab->count);
+}
+
+/* Grow the table above 75% and shrink it below 30% of load. */
+static u32 htab_resize_target(struct bpf_htab *htab, u32 n_buckets)
+{
+	u32 count = htab_elem_count(htab);
+
+	if (count > n_buckets / 4 * 3 && n_buckets < htab->max_buckets)
+		return n_buckets * 2;
+	if (count < n_buckets / 10 * 3 && n_buckets > HTAB_RESIZE_MIN_BUCKETS)
+		return n_buckets / 2;
+	return n_buckets;
+}
+
+/* Called with the element count updated, from any context. */
+static void htab_check_resize(struct bpf_htab *htab)
+{
+	u32 n_buckets = READ_ONCE(htab->n_buckets);
+
+	if (htab_resize_target(htab, n_buckets) != n_buckets)
+		irq_work_queue(&htab->resize_irq_work);
+}
+
+static void htab_resize_irq_work(struct irq_work *work)
+{
+	struct bpf_htab *htab = container_of(work, struct bpf_htab,
+					     resize_irq_work);
+
+	schedule_work(&htab->resize_work);
+}
+
+static struct bucket_table *htab_alloc_table(struct bpf_htab *htab,
+					     u32 n_buckets, u32 nulls_base)
+{
+	struct bucket_table *tbl;
+
+	tbl = bpf_map_kvcalloc(&htab->map, 1,
+			       struct_size(tbl, buckets, n_buckets),
+			       GFP_KERNEL | __GFP_NOWARN);
+	if (!tbl)
+		return NULL;
+
+	tbl->n_buckets = n_buckets;
+	tbl->nulls_base = nulls_base;
+	htab_init_buckets(htab, tbl);
+	return tbl;
+}
+
+/* Move the elements of bucket @i of @tbl into @new_tbl. Each element is
+ * linked into its new chain before being unlinked from the tail of the old
+ * one, so lockless readers find it in at least one of the two tables.
+ */
+static void htab_rehash_bucket(struct bpf_htab *htab, struct bucket_table *tbl,
+			       struct bucket_table *new_tbl, u32 i)
+{
+	struct bucket *b = &tbl->buckets[i], *nb;
+	struct hlist_nulls_node **pprev, *n;
+	unsigned long flags;
+	struct htab_elem *l;
+
+	/* nothing else can hold this map_locked slot on this cpu */
+	while (htab_lock_bucket(htab, b, i, &flags))
+		cpu_relax();
+
+	for (;;) {
+		pprev = &b->head.first;
+		n = *pprev;
+		if (is_a_nulls(n))
+			break;
+		while (!is_a_nulls(n->next)) {
+			pprev = &n->next;
+			n = *pprev;
+		}
+		l = container_of(n, struct htab_elem, hash_node);
+
+		/* The old and the new bucket map to the same map_locked slot,
+		 * as both tables have at least HASHTAB_MAP_LOCK_COUNT buckets.
+		 */
+		nb = __select_bucket(new_tbl, l->hash);
+		raw_spin_lock_nested(&nb->raw_lock, SINGLE_DEPTH_NESTING);
+		hlist_nulls_add_head_rcu(&l->hash_node, &nb->head);
+		smp_store_release(pprev, (struct hlist_nulls_node *)
+				  NULLS_MARKER(tbl->nulls_base | i));
+		raw_spin_unlock(&nb->raw_lock);
+	}
+
+	WRITE_ONCE(tbl->rehash, i + 1);
+	htab_unlock_bucket(htab, b, i, flags);
+}
+
+static void htab_resize_work(struct work_struct *work)
+{
+	struct bpf_htab *htab = container_of(work, struct bpf_htab,
+					     resize_work);
+	struct bucket_table *tbl, *new_tbl;
+	u32 n_buckets, nulls_base, i;
+
+	/* only this worker replaces the table */
+	tbl = rcu_dereference_protected(htab->tbl, true);
+	n_buckets = htab_resize_target(htab, tbl->n_buckets);
+	if (n_buckets == tbl->n_buckets)
+		return;
+
+	nulls_base = (tbl->nulls_base + (1U << HTAB_NULLS_GEN_SHIFT)) &
+		     HTAB_NULLS_GEN_MASK;
+	new_tbl = htab_alloc_table(htab, n_buckets, nulls_base);
+	if (!new_tbl)
+		return;
+
+	rcu_assign_pointer(tbl->future_tbl, new_tbl);
+	for (i = 0; i < tbl->n_buckets; i++) {
+		htab_rehash_bucket(htab, tbl, new_tbl, i);
+		cond_resched();
+	}
+	rcu_assign_pointer(htab->tbl, new_tbl);
+	WRITE_ONCE(htab->n_buckets, n_buckets);
+
+	/* wait for the readers and writers of the old table, including
+	 * sleepable programs
+	 */
+	synchronize_rcu_mult(call_rcu, call_rcu_tasks_trace);
+	kvfree(tbl);
+
+	/* the element count may have changed while rehashing */
+	if (htab_resize_target(htab, n_buckets) != n_buckets)
+		schedule_work(&htab->resize_work);
+}
+
 /* Called from syscall or from eBPF program directly, so
  * arguments have to match bpf_map_lookup_elem() exactly.
  * The return value is adjusted by BPF instructions
@@ -681,8 +955,6 @@ static struct htab_elem *lookup_nulls_elem_raw(struct hlist_nulls_head *head,
 static void *__htab_map_lookup_elem(struct bpf_map *map, void *key)
 {
 	struct bpf_htab *htab = container_of(map, struct bpf_htab, map);
-	struct hlist_nulls_head *head;
-	struct htab_elem *l;
 	u32 hash, key_size;
 
 	WARN_ON_ONCE(!rcu_read_lock_held() && !rcu_read_lock_trace_held() &&
@@ -692,11 +964,7 @@ static void *__htab_map_lookup_elem(struct bpf_map *map, void *key)
 
 	hash = htab_map_hash(key, key_size, htab->hashrnd);
 
-	head = select_bucket(htab, hash);
-
-	l = lookup_nulls_elem_raw(head, hash, key, key_size, htab->n_buckets);
-
-	return l;
+	return htab_lookup_nulls_elem(htab, hash, key, key_size);
 }
 
 static void *htab_map_lookup_elem(struct bpf_map *map, void *key)
@@ -814,7 +1082,7 @@ static bool htab_lru_map_delete_node(void *arg, struct bpf_lru_node *node)
 	int ret;
 
 	tgt_l = container_of(node, struct htab_elem, lru_node);
-	b = __select_bucket(htab, tgt_l->hash);
+	b = __select_bucket(htab_table(htab), tgt_l->hash);
 	head = &b->head;
 
 	ret = htab_lock_bucket(htab, b, tgt_l->hash, &flags);
@@ -838,6 +1106,7 @@ static bool htab_lru_map_delete_node(void *arg, struct bpf_lru_node *node)
 static int htab_map_get_next_key(struct bpf_map *map, void *key, void *next_key)
 {
 	struct bpf_htab *htab = container_of(map, struct bpf_htab, map);
+	struct bucket_table *tbl = htab_table(htab);
 	struct hlist_nulls_head *head;
 	struct htab_elem *l, *next_l;
 	u32 hash, key_size;
@@ -852,10 +1121,11 @@ static int htab_map_get_next_key(struct bpf_map *map, void *key, void *next_key)
 
 	hash = htab_map_hash(key, key_size, htab->hashrnd);
 
-	head = select_bucket(htab, hash);
+	head = select_bucket(tbl, hash);
 
 	/* lookup the key */
-	l = lookup_nulls_elem_raw(head, hash, key, key_size, htab->n_buckets);
+	l = lookup_nulls_elem_raw(head, hash, key, key_size,
+				  bucket_nulls(tbl, hash));
 
 	if (!l)
 		goto find_first_elem;
@@ -871,13 +1141,13 @@ static int htab_map_get_next_key(struct bpf_map *map, void *key, void *next_key)
 	}
 
 	/* no more elements in this hash list, go to the next bucket */
-	i = hash & (htab->n_buckets - 1);
+	i = hash & (tbl->n_buckets - 1);
 	i++;
 
 find_first_elem:
 	/* iterate over buckets */
-	for (; i < htab->n_buckets; i++) {
-		head = select_bucket(htab, i);
+	for (; i < tbl->n_buckets; i++) {
+		head = select_bucket(tbl, i);
 
 		/* pick first element in the bucket */
 		next_l = hlist_nulls_entry_safe(rcu_dereference_raw(hlist_nulls_first_rcu(head)),
@@ -931,6 +1201,9 @@ static void inc_elem_count(struct bpf_htab *htab)
 		percpu_counter_add_batch(&htab->pcount, 1, PERCPU_COUNTER_BATCH);
 	else
 		atomic_inc(&htab->count);
+
+	if (htab_is_resizable(htab))
+		htab_check_resize(htab);
 }
 
 static void dec_elem_count(struct bpf_htab *htab)
@@ -941,6 +1214,9 @@ static void dec_elem_count(struct bpf_htab *htab)
 		percpu_counter_add_batch(&htab->pcount, -1, PERCPU_COUNTER_BATCH);
 	else
 		atomic_dec(&htab->count);
+
+	if (htab_is_resizable(htab))
+		htab_check_resize(htab);
 }
 
 
@@ -1123,15 +1399,11 @@ static long htab_map_update_elem(struct bpf_map *map, void *key, void *value,
 
 	hash = htab_map_hash(key, key_size, htab->hashrnd);
 
-	b = __select_bucket(htab, hash);
-	head = &b->head;
-
 	if (unlikely(map_flags & BPF_F_LOCK)) {
 		if (unlikely(!btf_record_has_field(map->record, BPF_SPIN_LOCK)))
 			return -EINVAL;
 		/* find an element without taking the bucket lock */
-		l_old = lookup_nulls_elem_raw(head, hash, key, key_size,
-					      htab->n_buckets);
+		l_old = htab_lookup_nulls_elem(htab, hash, key, key_size);
 		ret = check_flags(htab, l_old, map_flags);
 		if (ret)
 			return ret;
@@ -1148,9 +1420,10 @@ static long htab_map_update_elem(struct bpf_map *map, void *key, void *value,
 		 */
 	}
 
-	ret = htab_lock_bucket(htab, b, hash, &flags);
+	ret = htab_lock_hash_bucket(htab, hash, &b, &flags);
 	if (ret)
 		return ret;
+	head = &b->head;
 
 	l_old = lookup_elem_raw(head, hash, key, key_size);
 
@@ -1241,7 +1514,7 @@ static long htab_lru_map_update_elem(struct bpf_map *map, void *key, void *value
 
 	hash = htab_map_hash(key, key_size, htab->hashrnd);
 
-	b = __select_bucket(htab, hash);
+	b = __select_bucket(htab_table(htab), hash);
 	head = &b->head;
 
 	/* For LRU, we need to alloc before taking bucket's
@@ -1310,12 +1583,10 @@ static long __htab_percpu_map_update_elem(struct bpf_map *map, void *key,
 
 	hash = htab_map_hash(key, key_size, htab->hashrnd);
 
-	b = __select_bucket(htab, hash);
-	head = &b->head;
-
-	ret = htab_lock_bucket(htab, b, hash, &flags);
+	ret = htab_lock_hash_bucket(htab, hash, &b, &flags);
 	if (ret)
 		return ret;
+	head = &b->head;
 
 	l_old = lookup_elem_raw(head, hash, key, key_size);
 
@@ -1365,7 +1636,7 @@ static long __htab_lru_percpu_map_update_elem(struct bpf_map *map, void *key,
 
 	hash = htab_map_hash(key, key_size, htab->hashrnd);
 
-	b = __select_bucket(htab, hash);
+	b = __select_bucket(htab_table(htab), hash);
 	head = &b->head;
 
 	/* For LRU, we need to alloc before taking bucket's
@@ -1442,12 +1713,10 @@ static long htab_map_delete_elem(struct bpf_map *map, void *key)
 	key_size = map->key_size;
 
 	hash = htab_map_hash(key, key_size, htab->hashrnd);
-	b = __select_bucket(htab, hash);
-	head = &b->head;
-
-	ret = htab_lock_bucket(htab, b, hash, &flags);
+	ret = htab_lock_hash_bucket(htab, hash, &b, &flags);
 	if (ret)
 		return ret;
+	head = &b->head;
 
 	l = lookup_elem_raw(head, hash, key, key_size);
 	if (l)
@@ -1478,7 +1747,7 @@ static long htab_lru_map_delete_elem(struct bpf_map *map, void *key)
 	key_size = map->key_size;
 
 	hash = htab_map_hash(key, key_size, htab->hashrnd);
-	b = __select_bucket(htab, hash);
+	b = __select_bucket(htab_table(htab), hash);
 	head = &b->head;
 
 	ret = htab_lock_bucket(htab, b, hash, &flags);
@@ -1500,14 +1769,15 @@ static long htab_lru_map_delete_elem(struct bpf_map *map, void *key)
 
 static void delete_all_elements(struct bpf_htab *htab)
 {
+	struct bucket_table *tbl = htab_table(htab);
 	int i;
 
 	/* It's called from a worker thread, so disable migration here,
 	 * since bpf_mem_cache_free() relies on that.
 	 */
 	migrate_disable();
-	for (i = 0; i < htab->n_buckets; i++) {
-		struct hlist_nulls_head *head = select_bucket(htab, i);
+	for (i = 0; i < tbl->n_buckets; i++) {
+		struct hlist_nulls_head *head = select_bucket(tbl, i);
 		struct hlist_nulls_node *n;
 		struct htab_elem *l;
 
@@ -1522,11 +1792,14 @@ static void delete_all_elements(struct bpf_htab *htab)
 
 static void htab_free_malloced_timers_and_wq(struct bpf_htab *htab)
 {
+	struct bucket_table *tbl;
 	int i;
 
 	rcu_read_lock();
-	for (i = 0; i < htab->n_buckets; i++) {
-		struct hlist_nulls_head *head = select_bucket(htab, i);
+	tbl = rcu_dereference(htab->tbl);
+again:
+	for (i = 0; i < tbl->n_buckets; i++) {
+		struct hlist_nulls_head *head = select_bucket(tbl, i);
 		struct hlist_nulls_node *n;
 		struct htab_elem *l;
 
@@ -1541,6 +1814,10 @@ static void htab_free_malloced_timers_and_wq(struct bpf_htab *htab)
 		}
 		cond_resched_rcu();
 	}
+	/* elements only move forward to the future table of a resize */
+	tbl = rcu_dereference(tbl->future_tbl);
+	if (tbl)
+		goto again;
 	rcu_read_unlock();
 }
 
@@ -1567,6 +1844,10 @@ static void htab_map_free(struct bpf_map *map)
 	 * bpf_free_used_maps() is called after bpf prog is no longer executing.
 	 * There is no need to synchronize_rcu() here to protect map elements.
 	 */
+	if (htab_is_resizable(htab)) {
+		irq_work_sync(&htab->resize_irq_work);
+		cancel_work_sync(&htab->resize_work);
+	}
 
 	/* htab no longer uses call_rcu() directly. bpf_mem_alloc does it
 	 * underneath and is responsible for waiting for callbacks to finish
@@ -1581,7 +1862,7 @@ static void htab_map_free(struct bpf_map *map)
 
 	bpf_map_free_elem_count(map);
 	free_percpu(htab->extra_elems);
-	bpf_map_area_free(htab->buckets);
+	bpf_map_area_free(rcu_dereference_protected(htab->tbl, true));
 	bpf_mem_alloc_destroy(&htab->pcpu_ma);
 	bpf_mem_alloc_destroy(&htab->ma);
 	if (htab->use_percpu_counter)
@@ -1628,12 +1909,10 @@ static int __htab_map_lookup_and_delete_elem(struct bpf_map *map, void *key,
 	key_size = map->key_size;
 
 	hash = htab_map_hash(key, key_size, htab->hashrnd);
-	b = __select_bucket(htab, hash);
-	head = &b->head;
-
-	ret = htab_lock_bucket(htab, b, hash, &bflags);
+	ret = htab_lock_hash_bucket(htab, hash, &b, &bflags);
 	if (ret)
 		return ret;
+	head = &b->head;
 
 	l = lookup_elem_raw(head, hash, key, key_size);
 	if (!l) {
@@ -1723,6 +2002,7 @@ __htab_map_lookup_and_delete_batch(struct bpf_map *map,
 	u32 batch, max_count, size, bucket_size, map_id;
 	struct htab_elem *node_to_free = NULL;
 	u64 elem_map_flags, map_flags;
+	struct bucket_table *tbl;
 	struct hlist_nulls_head *head;
 	struct hlist_nulls_node *n;
 	unsigned long flags = 0;
@@ -1751,7 +2031,7 @@ __htab_map_lookup_and_delete_batch(struct bpf_map *map,
 	if (ubatch && copy_from_user(&batch, ubatch, sizeof(batch)))
 		return -EFAULT;
 
-	if (batch >= htab->n_buckets)
+	if (batch >= READ_ONCE(htab->n_buckets))
 		return -ENOENT;
 
 	key_size = htab->map.key_size;
@@ -1780,10 +2060,18 @@ __htab_map_lookup_and_delete_batch(struct bpf_map *map,
 again:
 	bpf_disable_instrumentation();
 	rcu_read_lock();
+	/* a resize may have replaced the table since the last batch */
+	tbl = htab_table(htab);
+	if (batch >= tbl->n_buckets) {
+		rcu_read_unlock();
+		bpf_enable_instrumentation();
+		ret = -ENOENT;
+		goto after_loop;
+	}
 again_nocopy:
 	dst_key = keys;
 	dst_val = values;
-	b = &htab->buckets[batch];
+	b = &tbl->buckets[batch];
 	head = &b->head;
 	/* do not grab the lock unless need it (bucket_cnt > 0). */
 	if (locked) {
@@ -1900,7 +2188,7 @@ __htab_map_lookup_and_delete_batch(struct bpf_map *map,
 	/* If we are not copying data, we can go to next bucket and avoid
 	 * unlocking the rcu.
 	 */
-	if (!bucket_cnt && (batch + 1 < htab->n_buckets)) {
+	if (!bucket_cnt && (batch + 1 < tbl->n_buckets)) {
 		batch++;
 		goto again_nocopy;
 	}
@@ -1917,7 +2205,7 @@ __htab_map_lookup_and_delete_batch(struct bpf_map *map,
 
 	total += bucket_cnt;
 	batch++;
-	if (batch >= htab->n_buckets) {
+	if (batch >= READ_ONCE(htab->n_buckets)) {
 		ret = -ENOENT;
 		goto after_loop;
 	}
@@ -2021,6 +2309,7 @@ bpf_hash_map_seq_find_next(struct bpf_iter_seq_hash_map_info *info,
 			   struct htab_elem *prev_elem)
 {
 	const struct bpf_htab *htab = info->htab;
+	struct bucket_table *tbl;
 	u32 skip_elems = info->skip_elems;
 	u32 bucket_id = info->bucket_id;
 	struct hlist_nulls_head *head;
@@ -2029,7 +2318,7 @@ bpf_hash_map_seq_find_next(struct bpf_iter_seq_hash_map_info *info,
 	struct bucket *b;
 	u32 i, count;
 
-	if (bucket_id >= htab->n_buckets)
+	if (bucket_id >= READ_ONCE(htab->n_buckets))
 		return NULL;
 
 	/* try to find next elem in the same bucket */
@@ -2043,14 +2332,19 @@ bpf_hash_map_seq_find_next(struct bpf_iter_seq_hash_map_info *info,
 			return elem;
 
 		/* not found, unlock and go to the next bucket */
-		b = &htab->buckets[bucket_id++];
+		bucket_id++;
 		rcu_read_unlock();
 		skip_elems = 0;
 	}
 
-	for (i = bucket_id; i < htab->n_buckets; i++) {
-		b = &htab->buckets[i];
+	for (i = bucket_id; i < READ_ONCE(htab->n_buckets); i++) {
 		rcu_read_lock();
+		tbl = htab_table(htab);
+		if (i >= tbl->n_buckets) {
+			rcu_read_unlock();
+			break;
+		}
+		b = &tbl->buckets[i];
 
 		count = 0;
 		head = &b->head;
@@ -2197,6 +2491,7 @@ static long bpf_for_each_hash_elem(struct bpf_map *map, bpf_callback_t callback_
 				   void *callback_ctx, u64 flags)
 {
 	struct bpf_htab *htab = container_of(map, struct bpf_htab, map);
+	struct bucket_table *tbl;
 	struct hlist_nulls_head *head;
 	struct hlist_nulls_node *n;
 	struct htab_elem *elem;
@@ -2219,9 +2514,14 @@ static long bpf_for_each_hash_elem(struct bpf_map *map, bpf_callback_t callback_
 	 */
 	if (is_percpu)
 		migrate_disable();
-	for (i = 0; i < htab->n_buckets; i++) {
-		b = &htab->buckets[i];
+	for (i = 0; i < READ_ONCE(htab->n_buckets); i++) {
 		rcu_read_lock();
+		tbl = htab_table(htab);
+		if (i >= tbl->n_buckets) {
+			rcu_read_unlock();
+			break;
+		}
+		b = &tbl->buckets[i];
 		head = &b->head;
 		hlist_nulls_for_each_entry_rcu(elem, n, head, hash_node) {
 			key = elem->key;
@@ -2259,7 +2559,7 @@ static u64 htab_map_mem_usage(const struct bpf_map *map)
 	u64 num_entries;
 	u64 usage = sizeof(struct bpf_htab);
 
-	usage += sizeof(struct bucket) * htab->n_buckets;
+	usage += sizeof(struct bucket) * READ_ONCE(htab->n_buckets);
 	usage += sizeof(int) * num_possible_cpus() * HASHTAB_MAP_LOCK_COUNT;
 	if (prealloc) {
 		num_entries = map->max_entries;
@@ -2287,6 +2587,29 @@ static u64 htab_map_mem_usage(const struct bpf_map *map)
 	return usage;
 }
 
+#ifdef CONFIG_PROC_FS
+static void htab_map_show_fdinfo(const struct bpf_map *map, struct seq_file *m)
+{
+	struct bpf_htab *htab = container_of(map, struct bpf_htab, map);
+	struct bpf_mem_alloc_stats stats;
+
+	if (htab_is_prealloc(htab))
+		return;
+
+	bpf_mem_alloc_get_stats(&htab->ma, &stats);
+	seq_printf(m,
+		   "ma_refills:\t%llu\n"
+		   "ma_trims:\t%llu\n"
+		   "ma_depot_gets:\t%llu\n"
+		   "ma_depot_puts:\t%llu\n"
+		   "ma_depot_objs:\t%llu\n",
+		   stats.refill_cnt, stats.trim_cnt, stats.depot_get_cnt,
+		   stats.depot_put_cnt, stats.depot_cnt);
+}
+#else
+#define htab_map_show_fdinfo NULL
+#endif
+
 BTF_ID_LIST_SINGLE(htab_map_btf_ids, struct, bpf_htab)
 const struct bpf_map_ops htab_map_ops = {
 	.map_meta_equal = bpf_map_meta_equal,
@@ -2304,6 +2627,7 @@ const struct bpf_map_ops htab_map_ops = {
 	.map_set_for_each_callback_args = map_set_for_each_callback_args,
 	.map_for_each_callback = bpf_for_each_hash_elem,
 	.map_mem_usage = htab_map_mem_usage,
+	.map_show_fdinfo = htab_map_show_fdinfo,
 	BATCH_OPS(htab),
 	.map_btf_id = &htab_map_btf_ids[0],
 	.iter_seq_info = &iter_seq_info,
@@ -2326,6 +2650,7 @@ const struct bpf_map_ops htab_lru_map_ops = {
 	.map_set_for_each_callback_args = map_set_for_each_callback_args,
 	.map_for_each_callback = bpf_for_each_hash_elem,
 	.map_mem_usage = htab_map_mem_usage,
+	.map_show_fdinfo = htab_map_show_fdinfo,
 	BATCH_OPS(htab_lru),
 	.map_btf_id = &htab_map_btf_ids[0],
 	.iter_seq_info = &iter_seq_info,
@@ -2499,6 +2824,7 @@ const struct bpf_map_ops htab_percpu_map_ops = {
 	.map_set_for_each_callback_args = map_set_for_each_callback_args,
 	.map_for_each_callback = bpf_for_each_hash_elem,
 	.map_mem_usage = htab_map_mem_usage,
+	.map_show_fdinfo = htab_map_show_fdinfo,
 	BATCH_OPS(htab_percpu),
 	.map_btf_id = &htab_map_btf_ids[0],
 	.iter_seq_info = &iter_seq_info,
@@ -2519,6 +2845,7 @@ const struct bpf_map_ops htab_lru_percpu_map_ops = {
 	.map_set_for_each_callback_args = map_set_for_each_callback_args,
 	.map_for_each_callback = bpf_for_each_hash_elem,
 	.map_mem_usage = htab_map_mem_usage,
+	.map_show_fdinfo = htab_map_show_fdinfo,
 	BATCH_OPS(htab_lru_percpu),
 	.map_btf_id = &htab_map_btf_ids[0],
 	.iter_seq_info = &iter_seq_info,
@@ -2534,13 +2861,20 @@ static int fd_htab_map_alloc_check(union bpf_attr *attr)
 static void fd_htab_map_free(struct bpf_map *map)
 {
 	struct bpf_htab *htab = container_of(map, struct bpf_htab, map);
+	struct bucket_table *tbl;
 	struct hlist_nulls_node *n;
 	struct hlist_nulls_head *head;
 	struct htab_elem *l;
 	int i;
 
-	for (i = 0; i < htab->n_buckets; i++) {
-		head = select_bucket(htab, i);
+	if (htab_is_resizable(htab)) {
+		irq_work_sync(&htab->resize_irq_work);
+		cancel_work_sync(&htab->resize_work);
+	}
+
+	tbl = rcu_dereference_protected(htab->tbl, true);
+	for (i = 0; i < tbl->n_buckets; i++) {
+		head = select_bucket(tbl, i);
 
 		hlist_nulls_for_each_entry_safe(l, n, head, hash_node) {
 			void *ptr = fd_htab_map_get_ptr(map, l);
@@ -2663,6 +2997,7 @@ const struct bpf_map_ops htab_of_maps_map_ops = {
 	.map_gen_lookup = htab_of_map_gen_lookup,
 	.map_check_btf = map_check_no_btf,
 	.map_mem_usage = htab_map_mem_usage,
+	.map_show_fdinfo = htab_map_show_fdinfo,
 	BATCH_OPS(htab),
 	.map_btf_id = &htab_map_btf_ids[0],
 };
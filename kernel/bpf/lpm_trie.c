@@ -312,44 +312,34 @@ static struct lpm_trie_node *lpm_trie_node_alloc(struct lpm_trie *trie,
 	return node;
 }
 
-static int trie_check_add_elem(struct lpm_trie *trie, u64 flags)
+static int trie_check_add_elem(struct lpm_trie *trie, size_t *n_entries,
+			       u64 flags)
 {
 	if (flags == BPF_EXIST)
 		return -ENOENT;
-	if (trie->n_entries == trie->map.max_entries)
+	if (*n_entries == trie->map.max_entries)
 		return -ENOSPC;
-	trie->n_entries++;
+	(*n_entries)++;
 	return 0;
 }
 
-/* Called from syscall or from eBPF program */
-static long trie_update_elem(struct bpf_map *map,
-			     void *_key, void *value, u64 flags)
+/* Link @new_node for @key into the trie at @root, which is either
+ * trie->root with trie->lock held or a trie which is not visible to
+ * anyone else yet.  A node with the same prefix that is replaced is
+ * returned in @free_node.  Migration must be disabled.
+ */
+static int __trie_update_elem(struct lpm_trie *trie,
+			      struct lpm_trie_node __rcu **root,
+			      size_t *n_entries,
+			      struct lpm_trie_node *new_node,
+			      const struct bpf_lpm_trie_key_u8 *key,
+			      u64 flags, struct lpm_trie_node **free_node)
 {
-	struct lpm_trie *trie = container_of(map, struct lpm_trie, map);
-	struct lpm_trie_node *node, *im_node, *new_node;
-	struct lpm_trie_node *free_node = NULL;
+	struct lpm_trie_node *node, *im_node;
 	struct lpm_trie_node __rcu **slot;
-	struct bpf_lpm_trie_key_u8 *key = _key;
-	unsigned long irq_flags;
 	unsigned int next_bit;
 	size_t matchlen = 0;
-	int ret = 0;
-
-	if (unlikely(flags > BPF_EXIST))
-		return -EINVAL;
-
-	if (key->prefixlen > trie->max_prefixlen)
-		return -EINVAL;
-
-	/* Allocate and fill a new node. Need to disable migration before
-	 * invoking bpf_mem_cache_alloc().
-	 */
-	new_node = lpm_trie_node_alloc(trie, value, true);
-	if (!new_node)
-		return -ENOMEM;
-
-	raw_spin_lock_irqsave(&trie->lock, irq_flags);
+	int ret;
 
 	new_node->prefixlen = key->prefixlen;
 	RCU_INIT_POINTER(new_node->child[0], NULL);
@@ -361,10 +351,11 @@ static long trie_update_elem(struct bpf_map *map,
 	 * we either find an empty slot or a slot that needs to be replaced by
 	 * an intermediate node.
 	 */
-	slot = &trie->root;
+	slot = root;
 
 	while ((node = rcu_dereference_protected(*slot,
-					lockdep_is_held(&trie->lock)))) {
+					lockdep_is_held(&trie->lock) ||
+					root != &trie->root))) {
 		matchlen = longest_prefix_match(trie, node, key);
 
 		if (node->prefixlen != matchlen ||
@@ -379,12 +370,12 @@ static long trie_update_elem(struct bpf_map *map,
 	 * simply assign the @new_node to that slot and be done.
 	 */
 	if (!node) {
-		ret = trie_check_add_elem(trie, flags);
+		ret = trie_check_add_elem(trie, n_entries, flags);
 		if (ret)
-			goto out;
+			return ret;
 
 		rcu_assign_pointer(*slot, new_node);
-		goto out;
+		return 0;
 	}
 
 	/* If the slot we picked already exists, replace it with @new_node
@@ -392,28 +383,26 @@ static long trie_update_elem(struct bpf_map *map,
 	 */
 	if (node->prefixlen == matchlen) {
 		if (!(node->flags & LPM_TREE_NODE_FLAG_IM)) {
-			if (flags == BPF_NOEXIST) {
-				ret = -EEXIST;
-				goto out;
-			}
+			if (flags == BPF_NOEXIST)
+				return -EEXIST;
 		} else {
-			ret = trie_check_add_elem(trie, flags);
+			ret = trie_check_add_elem(trie, n_entries, flags);
 			if (ret)
-				goto out;
+				return ret;
 		}
 
 		new_node->child[0] = node->child[0];
 		new_node->child[1] = node->child[1];
 
 		rcu_assign_pointer(*slot, new_node);
-		free_node = node;
+		*free_node = node;
 
-		goto out;
+		return 0;
 	}
 
-	ret = trie_check_add_elem(trie, flags);
+	ret = trie_check_add_elem(trie, n_entries, flags);
 	if (ret)
-		goto out;
+		return ret;
 
 	/* If the new node matches the prefix completely, it must be inserted
 	 * as an ancestor. Simply insert it between @node and *@slot.
@@ -422,15 +411,13 @@ static long trie_update_elem(struct bpf_map *map,
 		next_bit = extract_bit(node->data, matchlen);
 		rcu_assign_pointer(new_node->child[next_bit], node);
 		rcu_assign_pointer(*slot, new_node);
-		goto out;
+		return 0;
 	}
 
-	/* migration is disabled within the locked scope */
 	im_node = lpm_trie_node_alloc(trie, NULL, false);
 	if (!im_node) {
-		trie->n_entries--;
-		ret = -ENOMEM;
-		goto out;
+		(*n_entries)--;
+		return -ENOMEM;
 	}
 
 	im_node->prefixlen = matchlen;
@@ -449,7 +436,36 @@ static long trie_update_elem(struct bpf_map *map,
 	/* Finally, assign the intermediate node to the determined slot */
 	rcu_assign_pointer(*slot, im_node);
 
-out:
+	return 0;
+}
+
+/* Called from syscall or from eBPF program */
+static long trie_update_elem(struct bpf_map *map,
+			     void *_key, void *value, u64 flags)
+{
+	struct lpm_trie *trie = container_of(map, struct lpm_trie, map);
+	struct lpm_trie_node *new_node, *free_node = NULL;
+	struct bpf_lpm_trie_key_u8 *key = _key;
+	unsigned long irq_flags;
+	int ret;
+
+	if (unlikely(flags > BPF_EXIST))
+		return -EINVAL;
+
+	if (key->prefixlen > trie->max_prefixlen)
+		return -EINVAL;
+
+	/* Allocate and fill a new node. Need to disable migration before
+	 * invoking bpf_mem_cache_alloc().
+	 */
+	new_node = lpm_trie_node_alloc(trie, value, true);
+	if (!new_node)
+		return -ENOMEM;
+
+	/* migration is disabled within the locked scope */
+	raw_spin_lock_irqsave(&trie->lock, irq_flags);
+	ret = __trie_update_elem(trie, &trie->root, &trie->n_entries,
+				 new_node, key, flags, &free_node);
 	raw_spin_unlock_irqrestore(&trie->lock, irq_flags);
 
 	migrate_disable();
@@ -760,6 +776,147 @@ static int trie_get_next_key(struct bpf_map *map, void *_key, void *_next_key)
 	return err;
 }
 
+/* Free all nodes of a trie which has been unlinked from trie->root (@rcu)
+ * or was never published.  The walk does not modify the nodes, so lookups
+ * still traversing an old trie are not disturbed.  @stack must have room for
+ * max_prefixlen + 2 entries, the depth of a trie is at most max_prefixlen + 1.
+ */
+static void trie_free_nodes(struct lpm_trie *trie, struct lpm_trie_node *root,
+			    struct lpm_trie_node **stack, bool rcu)
+{
+	struct lpm_trie_node *node, *child;
+	int i, sp = 0;
+
+	if (!root)
+		return;
+
+	stack[sp++] = root;
+
+	migrate_disable();
+	while (sp) {
+		node = stack[--sp];
+		for (i = 0; i < 2; i++) {
+			child = rcu_dereference_protected(node->child[i], 1);
+			if (child)
+				stack[sp++] = child;
+		}
+
+		if (rcu)
+			bpf_mem_cache_free_rcu(&trie->ma, node);
+		else
+			bpf_mem_cache_free(&trie->ma, node);
+		cond_resched();
+	}
+	migrate_enable();
+}
+
+/* With BPF_F_BATCH_REPLACE, build a new trie from the batch off to the
+ * side, without holding trie->lock, and then swap it in as a whole.
+ * Programs see either the complete old or the complete new trie, and
+ * updates are not serialized against lookups and updates from programs
+ * while the new trie is built.
+ */
+static int trie_update_batch(struct bpf_map *map, struct file *map_file,
+			     const union bpf_attr *attr,
+			     union bpf_attr __user *uattr)
+{
+	struct lpm_trie *trie = container_of(map, struct lpm_trie, map);
+	void __user *values = u64_to_user_ptr(attr->batch.values);
+	void __user *keys = u64_to_user_ptr(attr->batch.keys);
+	struct lpm_trie_node *node, *free_node, *old_root;
+	struct lpm_trie_node __rcu *root = NULL;
+	struct lpm_trie_node **stack = NULL;
+	struct bpf_lpm_trie_key_u8 *key;
+	unsigned long irq_flags;
+	size_t n_entries = 0;
+	u32 cp = 0, count;
+	void *value;
+	int err = 0;
+
+	if (!(attr->batch.flags & BPF_F_BATCH_REPLACE))
+		return generic_map_update_batch(map, map_file, attr, uattr);
+
+	if (attr->batch.flags & ~BPF_F_BATCH_REPLACE || attr->batch.elem_flags)
+		return -EINVAL;
+
+	count = attr->batch.count;
+	if (count > map->max_entries)
+		return -E2BIG;
+
+	if (put_user(0, &uattr->batch.count))
+		return -EFAULT;
+
+	key = kvmalloc(map->key_size, GFP_USER | __GFP_NOWARN);
+	value = kvmalloc(map->value_size, GFP_USER | __GFP_NOWARN);
+	stack = kmalloc_array(trie->max_prefixlen + 2, sizeof(*stack),
+			      GFP_USER | __GFP_NOWARN);
+	if (!key || !value || !stack) {
+		err = -ENOMEM;
+		goto out;
+	}
+
+	for (cp = 0; cp < count; cp++) {
+		err = -EFAULT;
+		if (copy_from_user(key, keys + cp * map->key_size,
+				   map->key_size) ||
+		    copy_from_user(value, values + cp * map->value_size,
+				   map->value_size))
+			break;
+
+		err = -EINVAL;
+		if (key->prefixlen > trie->max_prefixlen)
+			break;
+
+		err = -ENOMEM;
+		node = lpm_trie_node_alloc(trie, value, true);
+		if (!node)
+			break;
+
+		/* nobody else can see the new trie, free replaced nodes
+		 * right away
+		 */
+		free_node = NULL;
+		migrate_disable();
+		err = __trie_update_elem(trie, &root, &n_entries, node, key,
+					 BPF_ANY, &free_node);
+		if (err)
+			bpf_mem_cache_free(&trie->ma, node);
+		bpf_mem_cache_free(&trie->ma, free_node);
+		migrate_enable();
+		if (err)
+			break;
+
+		cond_resched();
+	}
+
+	if (err) {
+		trie_free_nodes(trie, rcu_dereference_protected(root, 1),
+				stack, false);
+		/* the map is left unchanged, nothing was applied */
+		cp = 0;
+		goto out;
+	}
+
+	raw_spin_lock_irqsave(&trie->lock, irq_flags);
+	old_root = rcu_dereference_protected(trie->root,
+					     lockdep_is_held(&trie->lock));
+	rcu_assign_pointer(trie->root, rcu_dereference_protected(root, 1));
+	trie->n_entries = n_entries;
+	raw_spin_unlock_irqrestore(&trie->lock, irq_flags);
+
+	trie_free_nodes(trie, old_root, stack, true);
+
+out:
+	if (copy_to_user(&uattr->batch.count, &cp, sizeof(cp)))
+		err = -EFAULT;
+
+	kfree(stack);
+	kvfree(value);
+	kvfree(key);
+
+	return err;
+}
+
 static int trie_check_btf(const struct bpf_map *map,
 			  const struct btf *btf,
 			  const struct btf_type *key_type,
@@ -790,7 +947,7 @@ const struct bpf_map_ops trie_map_ops = {
 	.map_update_elem = trie_update_elem,
 	.map_delete_elem = trie_delete_elem,
 	.map_lookup_batch = generic_map_lookup_batch,
-	.map_update_batch = generic_map_update_batch,
+	.map_update_batch = trie_update_batch,
 	.map_delete_batch = generic_map_delete_batch,
 	.map_check_btf = trie_check_btf,
 	.map_mem_usage = trie_mem_usage,
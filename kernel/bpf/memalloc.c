@@ -30,6 +30,13 @@
  * and refills them with kmalloc, so global kmalloc logic takes care
  * of freeing objects allocated by one cpu and freed on another.
  *
+ * Producer/consumer patterns keep trimming buckets on one cpu and
+ * refilling them on another one. To make that cheaper each bucket size
+ * of a bpf_mem_alloc has a depot shared by all cpus: irq_work trims
+ * extra free elements into the depot first and refills from it before
+ * going to kmalloc. Elements in the depot are reused directly, without
+ * waiting for RCU grace periods.
+ *
  * Every allocated objected is padded with extra 8 bytes that contains
  * struct llist_node.
  */
@@ -78,6 +85,17 @@ static int bpf_mem_cache_idx(size_t size)
 
 #define NUM_CACHES 11
 
+/* Free objects shared by the per-cpu caches of one size */
+struct bpf_mem_depot {
+	raw_spinlock_t lock;
+	struct llist_node *first;
+	int cnt;
+	int max_cnt;
+};
+
+/* How many refill batches a depot can keep */
+#define BPF_MEM_DEPOT_BATCHES 8
+
 struct bpf_mem_cache {
 	/* per-cpu list of free objects of size 'unit_size'.
 	 * All accesses are done with interrupts disabled and 'active' counter
@@ -102,6 +120,13 @@ struct bpf_mem_cache {
 	int percpu_size;
 	bool draining;
 	struct bpf_mem_cache *tgt;
+	struct bpf_mem_depot *depot;
+
+	/* irq_work statistics, see bpf_mem_alloc_get_stats() */
+	unsigned long refill_cnt;
+	unsigned long trim_cnt;
+	unsigned long depot_get_cnt;
+	unsigned long depot_put_cnt;
 
 	/* list of objects to be freed after RCU GP */
 	struct llist_head free_by_rcu;
@@ -201,6 +226,60 @@ static void add_obj_to_free_list(struct bpf_mem_cache *c, void *obj)
 	dec_active(c, &flags);
 }
 
+/* Move up to 'cnt' objects from the depot into the free_llist of 'c' */
+static int depot_get(struct bpf_mem_cache *c, int cnt)
+{
+	struct bpf_mem_depot *d = c->depot;
+	struct llist_node *first, *last;
+	unsigned long flags;
+	int i;
+
+	if (!d || !READ_ONCE(d->cnt))
+		return 0;
+
+	raw_spin_lock_irqsave(&d->lock, flags);
+	first = last = d->first;
+	for (i = 0; last && i < cnt; i++)
+		last = last->next;
+	/* cut the first 'i' objects off */
+	d->first = last;
+	d->cnt -= i;
+	raw_spin_unlock_irqrestore(&d->lock, flags);
+
+	while (first != last) {
+		struct llist_node *next = first->next;
+
+		add_obj_to_free_list(c, first);
+		first = next;
+	}
+	c->depot_get_cnt += i;
+	return i;
+}
+
+static void depot_put(struct bpf_mem_cache *c, struct llist_node *first,
+		      struct llist_node *last, int cnt)
+{
+	struct bpf_mem_depot *d = c->depot;
+	unsigned long flags;
+
+	raw_spin_lock_irqsave(&d->lock, flags);
+	last->next = d->first;
+	d->first = first;
+	d->cnt += cnt;
+	raw_spin_unlock_irqrestore(&d->lock, flags);
+	c->depot_put_cnt += cnt;
+}
+
+/* Racy, the depot may end up slightly over max_cnt */
+static int depot_room(struct bpf_mem_cache *c)
+{
+	struct bpf_mem_depot *d = c->depot;
+
+	if (!d || READ_ONCE(c->draining))
+		return 0;
+	return max(d->max_cnt - READ_ONCE(d->cnt), 0);
+}
+
 /* Mostly runs from irq_work except __init phase. */
 static void alloc_bulk(struct bpf_mem_cache *c, int cnt, int node, bool atomic)
 {
@@ -226,6 +305,11 @@ static void alloc_bulk(struct bpf_mem_cache *c, int cnt, int node, bool atomic)
 	if (i >= cnt)
 		return;
 
+	/* objects trimmed by other cpus */
+	i += depot_get(c, cnt - i);
+	if (i >= cnt)
+		return;
+
 	for (; i < cnt; i++) {
 		obj = llist_del_first(&c->waiting_for_gp_ttrace);
 		if (!obj)
@@ -332,14 +416,16 @@ static void do_call_rcu_ttrace(struct bpf_mem_cache *c)
 
 static void free_bulk(struct bpf_mem_cache *c)
 {
+	struct llist_node *llnode, *t, *first = NULL, *last = NULL;
 	struct bpf_mem_cache *tgt = c->tgt;
-	struct llist_node *llnode, *t;
+	int cnt, room, nr = 0;
+	bool queued = false;
 	unsigned long flags;
-	int cnt;
 
 	WARN_ON_ONCE(tgt->unit_size != c->unit_size);
 	WARN_ON_ONCE(tgt->percpu_size != c->percpu_size);
 
+	room = depot_room(c);
 	do {
 		inc_active(c, &flags);
 		llnode = __llist_del_first(&c->free_llist);
@@ -348,14 +434,31 @@ static void free_bulk(struct bpf_mem_cache *c)
 		else
 			cnt = 0;
 		dec_active(c, &flags);
-		if (llnode)
+		if (!llnode)
+			continue;
+		if (nr < room) {
+			/* keep it for refills of other cpus */
+			llnode->next = first;
+			first = llnode;
+			if (!last)
+				last = llnode;
+			nr++;
+		} else {
 			enque_to_free(tgt, llnode);
+			queued = true;
+		}
 	} while (cnt > (c->high_watermark + c->low_watermark) / 2);
 
+	if (nr)
+		depot_put(c, first, last, nr);
+
 	/* and drain free_llist_extra */
-	llist_for_each_safe(llnode, t, llist_del_all(&c->free_llist_extra))
+	llist_for_each_safe(llnode, t, llist_del_all(&c->free_llist_extra)) {
 		enque_to_free(tgt, llnode);
-	do_call_rcu_ttrace(tgt);
+		queued = true;
+	}
+	if (queued)
+		do_call_rcu_ttrace(tgt);
 }
 
 static void __free_by_rcu(struct rcu_head *head)
@@ -431,13 +534,16 @@ static void bpf_mem_refill(struct irq_work *work)
 
 	/* Racy access to free_cnt. It doesn't need to be 100% accurate */
 	cnt = c->free_cnt;
-	if (cnt < c->low_watermark)
+	if (cnt < c->low_watermark) {
 		/* irq_work runs on this cpu and kmalloc will allocate
 		 * from the current numa node which is what we want here.
 		 */
 		alloc_bulk(c, c->batch, NUMA_NO_NODE, true);
-	else if (cnt > c->high_watermark)
+		c->refill_cnt++;
+	} else if (cnt > c->high_watermark) {
 		free_bulk(c);
+		c->trim_cnt++;
+	}
 
 	check_free_by_rcu(c);
 }
@@ -485,6 +591,17 @@ static void init_refill_work(struct bpf_mem_cache *c)
 	c->batch = max((c->high_watermark - c->low_watermark) / 4 * 3, 1);
 }
 
+/* The depot of 'c' is shared by all cpus and initialized once */
+static void init_depot(struct bpf_mem_cache *c)
+{
+	struct bpf_mem_depot *d = c->depot;
+
+	if (d->max_cnt)
+		return;
+	raw_spin_lock_init(&d->lock);
+	d->max_cnt = c->batch * BPF_MEM_DEPOT_BATCHES;
+}
+
 static void prefill_mem_cache(struct bpf_mem_cache *c, int cpu)
 {
 	int cnt = 1;
@@ -526,6 +643,12 @@ int bpf_mem_alloc_init(struct bpf_mem_alloc *ma, int size, bool percpu)
 		if (!pc)
 			return -ENOMEM;
 
+		ma->depots = kcalloc(1, sizeof(*ma->depots), GFP_KERNEL);
+		if (!ma->depots) {
+			free_percpu(pc);
+			return -ENOMEM;
+		}
+
 		if (!percpu)
 			size += LLIST_NODE_SZ; /* room for llist_node */
 		unit_size = size;
@@ -542,7 +665,9 @@ int bpf_mem_alloc_init(struct bpf_mem_alloc *ma, int size, bool percpu)
 			c->objcg = objcg;
 			c->percpu_size = percpu_size;
 			c->tgt = c;
+			c->depot = ma->depots;
 			init_refill_work(c);
+			init_depot(c);
 			prefill_mem_cache(c, cpu);
 		}
 		ma->cache = pc;
@@ -552,6 +677,12 @@ int bpf_mem_alloc_init(struct bpf_mem_alloc *ma, int size, bool percpu)
 	pcc = __alloc_percpu_gfp(sizeof(*cc), 8, GFP_KERNEL);
 	if (!pcc)
 		return -ENOMEM;
+
+	ma->depots = kcalloc(NUM_CACHES, sizeof(*ma->depots), GFP_KERNEL);
+	if (!ma->depots) {
+		free_percpu(pcc);
+		return -ENOMEM;
+	}
 #ifdef CONFIG_MEMCG
 	objcg = get_obj_cgroup_from_current();
 #endif
@@ -564,8 +695,10 @@ int bpf_mem_alloc_init(struct bpf_mem_alloc *ma, int size, bool percpu)
 			c->objcg = objcg;
 			c->percpu_size = percpu_size;
 			c->tgt = c;
+			c->depot = &ma->depots[i];
 
 			init_refill_work(c);
+			init_depot(c);
 			prefill_mem_cache(c, cpu);
 		}
 	}
@@ -582,6 +715,12 @@ int bpf_mem_alloc_percpu_init(struct bpf_mem_alloc *ma, struct obj_cgroup *objcg
 	if (!pcc)
 		return -ENOMEM;
 
+	ma->depots = kcalloc(NUM_CACHES, sizeof(*ma->depots), GFP_KERNEL);
+	if (!ma->depots) {
+		free_percpu(pcc);
+		return -ENOMEM;
+	}
+
 	ma->caches = pcc;
 	ma->objcg = objcg;
 	ma->percpu = true;
@@ -616,8 +755,10 @@ int bpf_mem_alloc_percpu_unit_init(struct bpf_mem_alloc *ma, int size)
 		c->objcg = objcg;
 		c->percpu_size = percpu_size;
 		c->tgt = c;
+		c->depot = &ma->depots[i];
 
 		init_refill_work(c);
+		init_depot(c);
 		prefill_mem_cache(c, cpu);
 	}
 
@@ -655,12 +796,26 @@ static void check_mem_cache(struct bpf_mem_cache *c)
 	WARN_ON_ONCE(!llist_empty(&c->waiting_for_gp));
 }
 
+static void drain_depots(struct bpf_mem_alloc *ma, int cnt)
+{
+	int i;
+
+	for (i = 0; i < cnt; i++) {
+		free_all(ma->depots[i].first, ma->percpu);
+		ma->depots[i].first = NULL;
+		ma->depots[i].cnt = 0;
+	}
+}
+
 static void check_leaked_objs(struct bpf_mem_alloc *ma)
 {
 	struct bpf_mem_caches *cc;
 	struct bpf_mem_cache *c;
 	int cpu, i;
 
+	for (i = 0; ma->depots && i < (ma->caches ? NUM_CACHES : 1); i++)
+		WARN_ON_ONCE(ma->depots[i].first);
+
 	if (ma->cache) {
 		for_each_possible_cpu(cpu) {
 			c = per_cpu_ptr(ma->cache, cpu);
@@ -683,8 +838,10 @@ static void free_mem_alloc_no_barrier(struct bpf_mem_alloc *ma)
 	check_leaked_objs(ma);
 	free_percpu(ma->cache);
 	free_percpu(ma->caches);
+	kfree(ma->depots);
 	ma->cache = NULL;
 	ma->caches = NULL;
+	ma->depots = NULL;
 }
 
 static void free_mem_alloc(struct bpf_mem_alloc *ma)
@@ -755,6 +912,7 @@ void bpf_mem_alloc_destroy(struct bpf_mem_alloc *ma)
 			rcu_in_progress += atomic_read(&c->call_rcu_ttrace_in_progress);
 			rcu_in_progress += atomic_read(&c->call_rcu_in_progress);
 		}
+		drain_depots(ma, 1);
 		obj_cgroup_put(ma->objcg);
 		destroy_mem_alloc(ma, rcu_in_progress);
 	}
@@ -771,6 +929,7 @@ void bpf_mem_alloc_destroy(struct bpf_mem_alloc *ma)
 				rcu_in_progress += atomic_read(&c->call_rcu_in_progress);
 			}
 		}
+		drain_depots(ma, NUM_CACHES);
 		obj_cgroup_put(ma->objcg);
 		destroy_mem_alloc(ma, rcu_in_progress);
 	}
@@ -1005,6 +1164,35 @@ void notrace *bpf_mem_cache_alloc_flags(struct bpf_mem_alloc *ma, gfp_t flags)
 	return !ret ? NULL : ret + LLIST_NODE_SZ;
 }
 
+static void add_cache_stats(struct bpf_mem_cache *c, struct bpf_mem_alloc_stats *stats)
+{
+	stats->refill_cnt += READ_ONCE(c->refill_cnt);
+	stats->trim_cnt += READ_ONCE(c->trim_cnt);
+	stats->depot_get_cnt += READ_ONCE(c->depot_get_cnt);
+	stats->depot_put_cnt += READ_ONCE(c->depot_put_cnt);
+}
+
+/* Racy snapshot of the irq_work activity of all cpus */
+void bpf_mem_alloc_get_stats(struct bpf_mem_alloc *ma, struct bpf_mem_alloc_stats *stats)
+{
+	struct bpf_mem_caches *cc;
+	int cpu, i;
+
+	memset(stats, 0, sizeof(*stats));
+	for_each_possible_cpu(cpu) {
+		if (ma->cache)
+			add_cache_stats(per_cpu_ptr(ma->cache, cpu), stats);
+		if (!ma->caches)
+			continue;
+		cc = per_cpu_ptr(ma->caches, cpu);
+		for (i = 0; i < NUM_CACHES; i++)
+			add_cache_stats(&cc->cache[i], stats);
+	}
+	if (ma->depots)
+		for (i = 0; i < (ma->caches ? NUM_CACHES : 1); i++)
+			stats->depot_cnt += READ_ONCE(ma->depots[i].cnt);
+}
+
 int bpf_mem_alloc_check_size(bool percpu, size_t size)
 {
 	/* The size of percpu allocation doesn't have LLIST_NODE_SZ overhead */
@@ -25,6 +25,8 @@
 
 struct bpf_ringbuf {
 	wait_queue_head_t waitq;
+	/* woken up by work, the waitq of the map for per-CPU ring buffers */
+	wait_queue_head_t *notify_waitq;
 	struct irq_work work;
 	u64 mask;
 	struct page **pages;
@@ -78,6 +80,11 @@ struct bpf_ringbuf {
 struct bpf_ringbuf_map {
 	struct bpf_map map;
 	struct bpf_ringbuf *rb;
+	/* BPF_MAP_TYPE_PERCPU_RINGBUF: one ring buffer per possible CPU
+	 * (indexed by CPU id), all of them waking up waitq.
+	 */
+	struct bpf_ringbuf **cpu_rb;
+	wait_queue_head_t waitq;
 };
 
 /* 8-byte ring buffer record header structure */
@@ -151,7 +158,7 @@ static void bpf_ringbuf_notify(struct irq_work *work)
 {
 	struct bpf_ringbuf *rb = container_of(work, struct bpf_ringbuf, work);
 
-	wake_up_all(&rb->waitq);
+	wake_up_all(rb->notify_waitq);
 }
 
 /* Maximum size of ring buffer area is limited by 32-bit page offset within
@@ -176,6 +183,7 @@ static struct bpf_ringbuf *bpf_ringbuf_alloc(size_t data_sz, int numa_node)
 	raw_spin_lock_init(&rb->spinlock);
 	atomic_set(&rb->busy, 0);
 	init_waitqueue_head(&rb->waitq);
+	rb->notify_waitq = &rb->waitq;
 	init_irq_work(&rb->work, bpf_ringbuf_notify);
 
 	rb->mask = data_sz - 1;
@@ -186,17 +194,27 @@ static struct bpf_ringbuf *bpf_ringbuf_alloc(size_t data_sz, int numa_node)
 	return rb;
 }
 
-static struct bpf_map *ringbuf_map_alloc(union bpf_attr *attr)
+static int ringbuf_map_alloc_check(union bpf_attr *attr)
 {
-	struct bpf_ringbuf_map *rb_map;
-
 	if (attr->map_flags & ~RINGBUF_CREATE_FLAG_MASK)
-		return ERR_PTR(-EINVAL);
+		return -EINVAL;
 
 	if (attr->key_size || attr->value_size ||
 	    !is_power_of_2(attr->max_entries) ||
 	    !PAGE_ALIGNED(attr->max_entries))
-		return ERR_PTR(-EINVAL);
+		return -EINVAL;
+
+	/* each ring buffer is placed on the node of its CPU */
+	if (attr->map_type == BPF_MAP_TYPE_PERCPU_RINGBUF &&
+	    (attr->map_flags & BPF_F_NUMA_NODE))
+		return -EINVAL;
+
+	return 0;
+}
+
+static struct bpf_map *ringbuf_map_alloc(union bpf_attr *attr)
+{
+	struct bpf_ringbuf_map *rb_map;
 
 	rb_map = bpf_map_area_alloc(sizeof(*rb_map), NUMA_NO_NODE);
 	if (!rb_map)
@@ -236,6 +254,67 @@ static void ringbuf_map_free(struct bpf_map *map)
 	bpf_map_area_free(rb_map);
 }
 
+static void percpu_ringbuf_map_free(struct bpf_map *map)
+{
+	struct bpf_ringbuf_map *rb_map;
+	int cpu;
+
+	rb_map = container_of(map, struct bpf_ringbuf_map, map);
+	for_each_possible_cpu(cpu) {
+		if (rb_map->cpu_rb[cpu])
+			bpf_ringbuf_free(rb_map->cpu_rb[cpu]);
+	}
+	bpf_map_area_free(rb_map->cpu_rb);
+	bpf_map_area_free(rb_map);
+}
+
+static struct bpf_map *percpu_ringbuf_map_alloc(union bpf_attr *attr)
+{
+	struct bpf_ringbuf_map *rb_map;
+	struct bpf_ringbuf *rb;
+	int cpu;
+
+	rb_map = bpf_map_area_alloc(sizeof(*rb_map), NUMA_NO_NODE);
+	if (!rb_map)
+		return ERR_PTR(-ENOMEM);
+
+	bpf_map_init_from_attr(&rb_map->map, attr);
+	init_waitqueue_head(&rb_map->waitq);
+
+	rb_map->cpu_rb = bpf_map_area_alloc(nr_cpu_ids * sizeof(*rb_map->cpu_rb),
+					    NUMA_NO_NODE);
+	if (!rb_map->cpu_rb) {
+		bpf_map_area_free(rb_map);
+		return ERR_PTR(-ENOMEM);
+	}
+
+	for_each_possible_cpu(cpu) {
+		rb = bpf_ringbuf_alloc(attr->max_entries, cpu_to_node(cpu));
+		if (!rb) {
+			percpu_ringbuf_map_free(&rb_map->map);
+			return ERR_PTR(-ENOMEM);
+		}
+		rb->notify_waitq = &rb_map->waitq;
+		rb_map->cpu_rb[cpu] = rb;
+	}
+
+	return &rb_map->map;
+}
+
+/* The ring buffer a BPF program running on the current CPU produces to.
+ * Programs run with migration disabled, so the CPU is stable until the
+ * record is committed, and the commit finds the ring from the record.
+ */
+static struct bpf_ringbuf *ringbuf_map_this_rb(struct bpf_map *map)
+{
+	struct bpf_ringbuf_map *rb_map;
+
+	rb_map = container_of(map, struct bpf_ringbuf_map, map);
+	if (map->map_type == BPF_MAP_TYPE_PERCPU_RINGBUF)
+		return rb_map->cpu_rb[raw_smp_processor_id()];
+	return rb_map->rb;
+}
+
 static void *ringbuf_map_lookup_elem(struct bpf_map *map, void *key)
 {
 	return ERR_PTR(-ENOTSUPP);
@@ -258,22 +337,49 @@ static int ringbuf_map_get_next_key(struct bpf_map *map, void *key,
 	return -ENOTSUPP;
 }
 
-static int ringbuf_map_mmap_kern(struct bpf_map *map, struct vm_area_struct *vma)
+static int __ringbuf_map_mmap_kern(struct bpf_ringbuf *rb,
+				   struct vm_area_struct *vma,
+				   unsigned long pgoff)
 {
-	struct bpf_ringbuf_map *rb_map;
-
-	rb_map = container_of(map, struct bpf_ringbuf_map, map);
-
 	if (vma->vm_flags & VM_WRITE) {
 		/* allow writable mapping for the consumer_pos only */
-		if (vma->vm_pgoff != 0 || vma->vm_end - vma->vm_start != PAGE_SIZE)
+		if (pgoff != 0 || vma->vm_end - vma->vm_start != PAGE_SIZE)
 			return -EPERM;
 	} else {
 		vm_flags_clear(vma, VM_MAYWRITE);
 	}
 	/* remap_vmalloc_range() checks size and offset constraints */
-	return remap_vmalloc_range(vma, rb_map->rb,
-				   vma->vm_pgoff + RINGBUF_PGOFF);
+	return remap_vmalloc_range(vma, rb, pgoff + RINGBUF_PGOFF);
+}
+
+static int ringbuf_map_mmap_kern(struct bpf_map *map, struct vm_area_struct *vma)
+{
+	struct bpf_ringbuf_map *rb_map;
+
+	rb_map = container_of(map, struct bpf_ringbuf_map, map);
+
+	return __ringbuf_map_mmap_kern(rb_map->rb, vma, vma->vm_pgoff);
+}
+
+/* The ring buffer of each CPU is mapped like the one of a
+ * BPF_MAP_TYPE_RINGBUF map, at an offset of
+ * cpu * (RINGBUF_POS_PAGES + 2 * max_entries / PAGE_SIZE) pages.
+ */
+static int percpu_ringbuf_map_mmap(struct bpf_map *map,
+				   struct vm_area_struct *vma)
+{
+	unsigned long nr_pages = RINGBUF_POS_PAGES +
+				 2 * (map->max_entries >> PAGE_SHIFT);
+	unsigned long cpu = vma->vm_pgoff / nr_pages;
+	struct bpf_ringbuf_map *rb_map;
+
+	rb_map = container_of(map, struct bpf_ringbuf_map, map);
+
+	if (cpu >= nr_cpu_ids || !rb_map->cpu_rb[cpu])
+		return -EINVAL;
+
+	return __ringbuf_map_mmap_kern(rb_map->cpu_rb[cpu], vma,
+				       vma->vm_pgoff % nr_pages);
 }
 
 static int ringbuf_map_mmap_user(struct bpf_map *map, struct vm_area_struct *vma)
@@ -336,24 +442,62 @@ static __poll_t ringbuf_map_poll_user(struct bpf_map *map, struct file *filp,
 	return 0;
 }
 
-static u64 ringbuf_map_mem_usage(const struct bpf_map *map)
+static u64 __ringbuf_mem_usage(const struct bpf_map *map,
+			       const struct bpf_ringbuf *rb)
 {
-	struct bpf_ringbuf *rb;
 	int nr_data_pages;
 	int nr_meta_pages;
-	u64 usage = sizeof(struct bpf_ringbuf_map);
+	u64 usage;
 
-	rb = container_of(map, struct bpf_ringbuf_map, map)->rb;
-	usage += (u64)rb->nr_pages << PAGE_SHIFT;
+	usage = (u64)rb->nr_pages << PAGE_SHIFT;
 	nr_meta_pages = RINGBUF_NR_META_PAGES;
 	nr_data_pages = map->max_entries >> PAGE_SHIFT;
 	usage += (nr_meta_pages + 2 * nr_data_pages) * sizeof(struct page *);
 	return usage;
 }
 
+static u64 ringbuf_map_mem_usage(const struct bpf_map *map)
+{
+	struct bpf_ringbuf *rb;
+	u64 usage = sizeof(struct bpf_ringbuf_map);
+
+	rb = container_of(map, struct bpf_ringbuf_map, map)->rb;
+	return usage + __ringbuf_mem_usage(map, rb);
+}
+
+static __poll_t percpu_ringbuf_map_poll(struct bpf_map *map, struct file *filp,
+					struct poll_table_struct *pts)
+{
+	struct bpf_ringbuf_map *rb_map;
+	int cpu;
+
+	rb_map = container_of(map, struct bpf_ringbuf_map, map);
+	poll_wait(filp, &rb_map->waitq, pts);
+
+	for_each_possible_cpu(cpu) {
+		if (ringbuf_avail_data_sz(rb_map->cpu_rb[cpu]))
+			return EPOLLIN | EPOLLRDNORM;
+	}
+	return 0;
+}
+
+static u64 percpu_ringbuf_map_mem_usage(const struct bpf_map *map)
+{
+	struct bpf_ringbuf_map *rb_map;
+	u64 usage = sizeof(struct bpf_ringbuf_map);
+	int cpu;
+
+	rb_map = container_of(map, struct bpf_ringbuf_map, map);
+	usage += nr_cpu_ids * sizeof(*rb_map->cpu_rb);
+	for_each_possible_cpu(cpu)
+		usage += __ringbuf_mem_usage(map, rb_map->cpu_rb[cpu]);
+	return usage;
+}
+
 BTF_ID_LIST_SINGLE(ringbuf_map_btf_ids, struct, bpf_ringbuf_map)
 const struct bpf_map_ops ringbuf_map_ops = {
 	.map_meta_equal = bpf_map_meta_equal,
+	.map_alloc_check = ringbuf_map_alloc_check,
 	.map_alloc = ringbuf_map_alloc,
 	.map_free = ringbuf_map_free,
 	.map_mmap = ringbuf_map_mmap_kern,
@@ -369,6 +513,7 @@ const struct bpf_map_ops ringbuf_map_ops = {
 BTF_ID_LIST_SINGLE(user_ringbuf_map_btf_ids, struct, bpf_ringbuf_map)
 const struct bpf_map_ops user_ringbuf_map_ops = {
 	.map_meta_equal = bpf_map_meta_equal,
+	.map_alloc_check = ringbuf_map_alloc_check,
 	.map_alloc = ringbuf_map_alloc,
 	.map_free = ringbuf_map_free,
 	.map_mmap = ringbuf_map_mmap_user,
@@ -381,6 +526,22 @@ const struct bpf_map_ops user_ringbuf_map_ops = {
 	.map_btf_id = &user_ringbuf_map_btf_ids[0],
 };
 
+BTF_ID_LIST_SINGLE(percpu_ringbuf_map_btf_ids, struct, bpf_ringbuf_map)
+const struct bpf_map_ops percpu_ringbuf_map_ops = {
+	.map_meta_equal = bpf_map_meta_equal,
+	.map_alloc_check = ringbuf_map_alloc_check,
+	.map_alloc = percpu_ringbuf_map_alloc,
+	.map_free = percpu_ringbuf_map_free,
+	.map_mmap = percpu_ringbuf_map_mmap,
+	.map_poll = percpu_ringbuf_map_poll,
+	.map_lookup_elem = ringbuf_map_lookup_elem,
+	.map_update_elem = ringbuf_map_update_elem,
+	.map_delete_elem = ringbuf_map_delete_elem,
+	.map_get_next_key = ringbuf_map_get_next_key,
+	.map_mem_usage = percpu_ringbuf_map_mem_usage,
+	.map_btf_id = &percpu_ringbuf_map_btf_ids[0],
+};
+
 /* Given pointer to ring buffer record metadata and struct bpf_ringbuf itself,
  * calculate offset from record metadata to ring buffer in pages, rounded
  * down. This page offset is stored as part of record metadata and allows to
@@ -469,13 +630,11 @@ static void *__bpf_ringbuf_reserve(struct bpf_ringbuf *rb, u64 size)
 
 BPF_CALL_3(bpf_ringbuf_reserve, struct bpf_map *, map, u64, size, u64, flags)
 {
-	struct bpf_ringbuf_map *rb_map;
-
 	if (unlikely(flags))
 		return 0;
 
-	rb_map = container_of(map, struct bpf_ringbuf_map, map);
-	return (unsigned long)__bpf_ringbuf_reserve(rb_map->rb, size);
+	return (unsigned long)__bpf_ringbuf_reserve(ringbuf_map_this_rb(map),
+						    size);
 }
 
 const struct bpf_func_proto bpf_ringbuf_reserve_proto = {
@@ -543,14 +702,12 @@ const struct bpf_func_proto bpf_ringbuf_discard_proto = {
 BPF_CALL_4(bpf_ringbuf_output, struct bpf_map *, map, void *, data, u64, size,
 	   u64, flags)
 {
-	struct bpf_ringbuf_map *rb_map;
 	void *rec;
 
 	if (unlikely(flags & ~(BPF_RB_NO_WAKEUP | BPF_RB_FORCE_WAKEUP)))
 		return -EINVAL;
 
-	rb_map = container_of(map, struct bpf_ringbuf_map, map);
-	rec = __bpf_ringbuf_reserve(rb_map->rb, size);
+	rec = __bpf_ringbuf_reserve(ringbuf_map_this_rb(map), size);
 	if (!rec)
 		return -EAGAIN;
 
@@ -570,9 +727,7 @@ const struct bpf_func_proto bpf_ringbuf_output_proto = {
 
 BPF_CALL_2(bpf_ringbuf_query, struct bpf_map *, map, u64, flags)
 {
-	struct bpf_ringbuf *rb;
-
-	rb = container_of(map, struct bpf_ringbuf_map, map)->rb;
+	struct bpf_ringbuf *rb = ringbuf_map_this_rb(map);
 
 	switch (flags) {
 	case BPF_RB_AVAIL_DATA:
@@ -598,7 +753,6 @@ const struct bpf_func_proto bpf_ringbuf_query_proto = {
 BPF_CALL_4(bpf_ringbuf_reserve_dynptr, struct bpf_map *, map, u32, size, u64, flags,
 	   struct bpf_dynptr_kern *, ptr)
 {
-	struct bpf_ringbuf_map *rb_map;
 	void *sample;
 	int err;
 
@@ -613,9 +767,7 @@ BPF_CALL_4(bpf_ringbuf_reserve_dynptr, struct bpf_map *, map, u32, size, u64, fl
 		return err;
 	}
 
-	rb_map = container_of(map, struct bpf_ringbuf_map, map);
-
-	sample = __bpf_ringbuf_reserve(rb_map->rb, size);
+	sample = __bpf_ringbuf_reserve(ringbuf_map_this_rb(map), size);
 	if (!sample) {
 		bpf_dynptr_set_null(ptr);
 		return -EINVAL;
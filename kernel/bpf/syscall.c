@@ -569,8 +569,13 @@ static void bpf_map_release_memcg(struct bpf_map *map)
 }
 #endif
 
+/* Allocate @nr_pages order-0 pages. With a non-zero @order they come in
+ * physically contiguous, naturally aligned blocks of 1 << @order pages and
+ * @nr_pages must be a multiple of that.
+ */
 int bpf_map_alloc_pages(const struct bpf_map *map, gfp_t gfp, int nid,
-			unsigned long nr_pages, struct page **pages)
+			unsigned int order, unsigned long nr_pages,
+			struct page **pages)
 {
 	unsigned long i, j;
 	struct page *pg;
@@ -581,11 +586,17 @@ int bpf_map_alloc_pages(const struct bpf_map *map, gfp_t gfp, int nid,
 	memcg = bpf_map_get_memcg(map);
 	old_memcg = set_active_memcg(memcg);
 #endif
-	for (i = 0; i < nr_pages; i++) {
-		pg = alloc_pages_node(nid, gfp | __GFP_ACCOUNT, 0);
+	if (order)
+		gfp |= __GFP_NOWARN;
+
+	for (i = 0; i < nr_pages; i += 1UL << order) {
+		pg = alloc_pages_node(nid, gfp | __GFP_ACCOUNT, order);
 
 		if (pg) {
-			pages[i] = pg;
+			if (order)
+				split_page(pg, order);
+			for (j = 0; j < 1UL << order; j++)
+				pages[i + j] = pg + j;
 			continue;
 		}
 		for (j = 0; j < i; j++)
@@ -984,6 +995,8 @@ static void bpf_map_show_fdinfo(struct seq_file *m, struct file *filp)
 		seq_printf(m, "owner_prog_type:\t%u\n", type);
 		seq_printf(m, "owner_jited:\t%u\n", jited);
 	}
+	if (map->ops->map_show_fdinfo)
+		map->ops->map_show_fdinfo(map, m);
 }
 #endif
 
@@ -1404,6 +1417,7 @@ static int map_create(union bpf_attr *attr)
 	case BPF_MAP_TYPE_HASH_OF_MAPS:
 	case BPF_MAP_TYPE_RINGBUF:
 	case BPF_MAP_TYPE_USER_RINGBUF:
+	case BPF_MAP_TYPE_PERCPU_RINGBUF:
 	case BPF_MAP_TYPE_CGROUP_STORAGE:
 	case BPF_MAP_TYPE_PERCPU_CGROUP_STORAGE:
 		/* unprivileged */
@@ -1913,6 +1927,10 @@ int generic_map_update_batch(struct bpf_map *map, struct file *map_file,
 	void *key, *value;
 	int err = 0;
 
+	/* BPF_F_BATCH_REPLACE needs map specific support, see trie_update_batch() */
+	if (attr->batch.flags)
+		return -EINVAL;
+
 	if (attr->batch.elem_flags & ~BPF_F_LOCK)
 		return -EINVAL;
 
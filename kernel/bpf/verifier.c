@@ -9304,6 +9304,7 @@ static int check_map_func_compatibility(struct bpf_verifier_env *env,
 			goto error;
 		break;
 	case BPF_MAP_TYPE_RINGBUF:
+	case BPF_MAP_TYPE_PERCPU_RINGBUF:
 		if (func_id != BPF_FUNC_ringbuf_output &&
 		    func_id != BPF_FUNC_ringbuf_reserve &&
 		    func_id != BPF_FUNC_ringbuf_query &&
@@ -9439,7 +9440,8 @@ static int check_map_func_compatibility(struct bpf_verifier_env *env,
 	case BPF_FUNC_ringbuf_reserve_dynptr:
 	case BPF_FUNC_ringbuf_submit_dynptr:
 	case BPF_FUNC_ringbuf_discard_dynptr:
-		if (map->map_type != BPF_MAP_TYPE_RINGBUF)
+		if (map->map_type != BPF_MAP_TYPE_RINGBUF &&
+		    map->map_type != BPF_MAP_TYPE_PERCPU_RINGBUF)
 			goto error;
 		break;
 	case BPF_FUNC_user_ringbuf_drain:
@@ -19124,6 +19126,7 @@ static int check_map_prog_compatibility(struct bpf_verifier_env *env,
 		case BPF_MAP_TYPE_HASH_OF_MAPS:
 		case BPF_MAP_TYPE_RINGBUF:
 		case BPF_MAP_TYPE_USER_RINGBUF:
+		case BPF_MAP_TYPE_PERCPU_RINGBUF:
 		case BPF_MAP_TYPE_INODE_STORAGE:
 		case BPF_MAP_TYPE_SK_STORAGE:
 		case BPF_MAP_TYPE_TASK_STORAGE:
@@ -990,6 +990,62 @@ static void dl_rebuild_rd_accounting(void)
 	rcu_read_unlock();
 }
 
+/*
+ * A copy of the sched domains and attributes cpuset last passed to
+ * partition_sched_domains(), to skip rebuilds that would not change
+ * anything.  Protected by cpuset_mutex.
+ */
+static cpumask_var_t *last_doms;
+static struct sched_domain_attr *last_dattr;
+static int last_ndoms;
+
+static bool sched_domains_unchanged(int ndoms, cpumask_var_t doms[],
+				    struct sched_domain_attr *dattr)
+{
+	int i;
+
+	if (!doms || !last_doms || ndoms != last_ndoms || !dattr != !last_dattr)
+		return false;
+
+	for (i = 0; i < ndoms; i++) {
+		if (!cpumask_equal(doms[i], last_doms[i]))
+			return false;
+		if (dattr && memcmp(&dattr[i], &last_dattr[i], sizeof(*dattr)))
+			return false;
+	}
+	return true;
+}
+
+static void save_sched_domains(int ndoms, cpumask_var_t doms[],
+			       struct sched_domain_attr *dattr)
+{
+	int i;
+
+	free_sched_domains(last_doms, last_ndoms);
+	kfree(last_dattr);
+	last_doms = NULL;
+	last_dattr = NULL;
+	last_ndoms = 0;
+
+	if (!doms)
+		return;
+
+	last_doms = alloc_sched_domains(ndoms);
+	if (!last_doms)
+		return;
+	if (dattr) {
+		last_dattr = kmemdup(dattr, ndoms * sizeof(*dattr), GFP_KERNEL);
+		if (!last_dattr) {
+			free_sched_domains(last_doms, ndoms);
+			last_doms = NULL;
+			return;
+		}
+	}
+	for (i = 0; i < ndoms; i++)
+		cpumask_copy(last_doms[i], doms[i]);
+	last_ndoms = ndoms;
+}
+
 static void
 partition_and_rebuild_sched_domains(int ndoms_new, cpumask_var_t doms_new[],
 				    struct sched_domain_attr *dattr_new)
@@ -1009,9 +1065,14 @@ partition_and_rebuild_sched_domains(int ndoms_new, cpumask_var_t doms_new[],
  * 'cpus' is removed, then call this routine to rebuild the
  * scheduler's dynamic sched domains.
  *
+ * Unless @force is set, the rebuild is skipped when the generated
+ * domains and attributes are the ones cpuset passed to the scheduler
+ * the last time.  Callers outside of cpuset always force it, the
+ * topology or the domains may have changed behind cpuset's back.
+ *
  * Call with cpuset_mutex held.  Takes cpus_read_lock().
  */
-void rebuild_sched_domains_locked(void)
+static void __rebuild_sched_domains_locked(bool force)
 {
 	struct cgroup_subsys_state *pos_css;
 	struct sched_domain_attr *attr;
@@ -1060,13 +1121,35 @@ void rebuild_sched_domains_locked(void)
 	/* Generate domain masks and attrs */
 	ndoms = generate_sched_domains(&doms, &attr);
 
+	if (!force && sched_domains_unchanged(ndoms, doms, attr)) {
+		free_sched_domains(doms, ndoms);
+		kfree(attr);
+		return;
+	}
+	save_sched_domains(ndoms, doms, attr);
+
 	/* Have scheduler rebuild the domains */
 	partition_and_rebuild_sched_domains(ndoms, doms, attr);
 }
+
+void rebuild_sched_domains_locked(void)
+{
+	__rebuild_sched_domains_locked(true);
+}
+
+/* Rebuild after a cpuset change, unless the domains stay the same */
+static void rebuild_sched_domains_changed(void)
+{
+	__rebuild_sched_domains_locked(false);
+}
 #else /* !CONFIG_SMP */
 void rebuild_sched_domains_locked(void)
 {
 }
+
+static void rebuild_sched_domains_changed(void)
+{
+}
 #endif /* CONFIG_SMP */
 
 static void rebuild_sched_domains_cpuslocked(void)
@@ -2760,7 +2843,7 @@ int cpuset_update_flag(cpuset_flagbits_t bit, struct cpuset *cs,
 		if (cpuset_v2())
 			cpuset_force_rebuild();
 		else
-			rebuild_sched_domains_locked();
+			rebuild_sched_domains_changed();
 	}
 
 	if (spread_flag_changed)
@@ -2882,7 +2965,7 @@ static int update_prstate(struct cpuset *cs, int new_prs)
 
 	notify_partition_change(cs, old_prs);
 	if (force_sd_rebuild)
-		rebuild_sched_domains_locked();
+		rebuild_sched_domains_changed();
 	free_cpumasks(NULL, &tmpmask);
 	return 0;
 }
@@ -3152,7 +3235,7 @@ ssize_t cpuset_write_resmask(struct kernfs_open_file *of,
 
 	free_cpuset(trialcs);
 	if (force_sd_rebuild)
-		rebuild_sched_domains_locked();
+		rebuild_sched_domains_changed();
 out_unlock:
 	mutex_unlock(&cpuset_mutex);
 	cpus_read_unlock();
@@ -12538,6 +12538,10 @@ static int perf_copy_attr(struct perf_event_attr __user *uattr,
 	if (attr->sigtrap && !attr->remove_on_exec)
 		return -EINVAL;
 
+	/* only overwriting buffers need to be read while written */
+	if (attr->record_seq && !attr->write_backward)
+		return -EINVAL;
+
 out:
 	return ret;
 
@@ -12596,6 +12600,10 @@ perf_event_set_output(struct perf_event *event, struct perf_event *output_event)
 	if (is_write_backward(output_event) != is_write_backward(event))
 		goto out;
 
+	/* nor are records with and without sequence numbers */
+	if (has_record_seq(output_event) != has_record_seq(event))
+		goto out;
+
 	/*
 	 * If both events generate aux data, they must be on the same PMU
 	 */
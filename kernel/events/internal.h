@@ -28,6 +28,7 @@ struct perf_buffer {
 	local_t				events;		/* event limit       */
 	local_t				wakeup;		/* wakeup stamp      */
 	local_t				lost;		/* nr records lost   */
+	local64_t			seq;		/* record_seq number */
 
 	long				watermark;	/* wakeup watermark  */
 	long				aux_watermark;
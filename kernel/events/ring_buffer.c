@@ -138,6 +138,25 @@ static void perf_output_put_handle(struct perf_output_handle *handle)
 	preempt_enable();
 }
 
+/*
+ * Let readers of an overwrite buffer know which part of it is about to be
+ * overwritten, before any of the data stores.  Like in perf_output_put_handle()
+ * an IRQ/NMI can reserve space between our load and store of @rb->head, retry
+ * until the value published is not stale.
+ */
+static void perf_output_publish_reserved(struct perf_buffer *rb)
+{
+	unsigned long head;
+
+	do {
+		head = local_read(&rb->head);
+		WRITE_ONCE(rb->user_page->data_reserved, head);
+		barrier();
+	} while (unlikely(head != local_read(&rb->head)));
+
+	smp_wmb(); /* matches the reader's smp_rmb() before ->data_reserved */
+}
+
 static __always_inline bool
 ring_buffer_has_space(unsigned long head, unsigned long tail,
 		      unsigned long data_size, unsigned int size,
@@ -158,6 +177,8 @@ __perf_output_begin(struct perf_output_handle *handle,
 	struct perf_buffer *rb;
 	unsigned long tail, offset, head;
 	int have_lost, page_shift;
+	bool record_seq;
+	u64 seq = 0;
 	struct {
 		struct perf_event_header header;
 		u64			 id;
@@ -186,11 +207,17 @@ __perf_output_begin(struct perf_output_handle *handle,
 	handle->rb    = rb;
 	handle->event = event;
 
+	record_seq = unlikely(has_record_seq(event));
+	if (record_seq)
+		size += sizeof(seq);
+
 	have_lost = local_read(&rb->lost);
 	if (unlikely(have_lost)) {
 		size += sizeof(lost_event);
 		if (event->attr.sample_id_all)
 			size += event->id_header_size;
+		if (record_seq)
+			size += sizeof(seq);
 	}
 
 	perf_output_get_handle(handle);
@@ -224,6 +251,13 @@ __perf_output_begin(struct perf_output_handle *handle,
 			head -= size;
 	} while (!local_try_cmpxchg(&rb->head, &offset, head));
 
+	if (record_seq) {
+		perf_output_publish_reserved(rb);
+		seq = local64_add_return(have_lost ? 2 : 1, &rb->seq);
+		if (have_lost)
+			seq--;
+	}
+
 	if (backward) {
 		offset = head;
 		head = (u64)(-head);
@@ -253,10 +287,17 @@ __perf_output_begin(struct perf_output_handle *handle,
 
 		/* XXX mostly redundant; @data is already fully initializes */
 		perf_event_header__init_id(&lost_event.header, data, event);
+		if (record_seq) {
+			perf_output_put(handle, seq);
+			seq++;
+		}
 		perf_output_put(handle, lost_event);
 		perf_event__output_id_sample(event, handle, data);
 	}
 
+	if (record_seq)
+		perf_output_put(handle, seq);
+
 	return 0;
 
 fail:
@@ -39,21 +39,38 @@
 #include <linux/memblock.h>
 #include <linux/fault-inject.h>
 #include <linux/slab.h>
+#include <linux/prctl.h>
+#include <linux/sched/signal.h>
 
 #include "futex.h"
 #include "../locking/rtmutex_common.h"
 
 /*
- * The base of the bucket array and its size are always used together
- * (after initialization only in futex_hash()), so ensure that they
- * reside in the same cacheline.
+ * The global hash consists of one bucket array per node, allocated on that
+ * node.  The arrays and their size are always used together (after
+ * initialization only in futex_hash()), so ensure that the size and the
+ * first bases reside in the same cacheline.
  */
 static struct {
-	struct futex_hash_bucket *queues;
-	unsigned long            hashsize;
+	unsigned long            hashmask;
+	unsigned int             hashshift;
+	struct futex_hash_bucket *queues[MAX_NUMNODES];
 } __futex_data __read_mostly __aligned(2*sizeof(long));
-#define futex_queues   (__futex_data.queues)
-#define futex_hashsize (__futex_data.hashsize)
+#define futex_queues    (__futex_data.queues)
+#define futex_hashmask  (__futex_data.hashmask)
+#define futex_hashshift (__futex_data.hashshift)
+
+/*
+ * Per process hash for private futexes, see futex_hash_prctl().  It only
+ * changes while the mm has a single user, so that no futex_q can be queued
+ * on it and futex_hash() needs no synchronization.
+ */
+struct futex_private_hash {
+	unsigned int		hash_mask;
+	struct futex_hash_bucket queues[];
+};
+
+#define FUTEX_PRIVATE_HASH_MAX	(1U << 16)
 
 
 /*
@@ -112,14 +129,130 @@ late_initcall(fail_futex_debugfs);
  * @key:	Pointer to the futex key for which the hash is calculated
  *
  * We hash on the keys returned from get_futex_key (see below) and return the
- * corresponding hash bucket in the global hash.
+ * corresponding hash bucket in the global hash, or in the private hash of
+ * the process for private futexes if it has one.  Futexes with a home node
+ * always use the buckets of that node in the global hash, the others are
+ * spread over all nodes.
  */
 struct futex_hash_bucket *futex_hash(union futex_key *key)
 {
-	u32 hash = jhash2((u32 *)key, offsetof(typeof(*key), both.offset) / 4,
-			  key->both.offset);
+	struct futex_private_hash *fph;
+	int node = key->both.node;
+	u32 hash;
+
+	/* private keys carry no mm on !MMU, see get_futex_key() */
+	if (IS_ENABLED(CONFIG_MMU) && node == FUTEX_NO_NODE &&
+	    !(key->both.offset & (FUT_OFF_INODE | FUT_OFF_MMSHARED))) {
+		fph = READ_ONCE(key->private.mm->futex_phash);
+		if (fph) {
+			/* the mm is implied, hash on the address only */
+			hash = jhash2((u32 *)&key->private.address,
+				      sizeof(key->private.address) / 4,
+				      key->both.offset);
+			return &fph->queues[hash & fph->hash_mask];
+		}
+	}
+
+	hash = jhash2((u32 *)key, offsetof(typeof(*key), both.offset) / 4,
+		      key->both.offset);
+
+	if (node == FUTEX_NO_NODE) {
+		node = (hash >> futex_hashshift) % nr_node_ids;
+		if (!node_possible(node))
+			node = find_next_bit_wrap(node_possible_map.bits,
+						  nr_node_ids, node);
+	}
+
+	return &futex_queues[node][hash & futex_hashmask];
+}
+
+static void futex_hash_bucket_init(struct futex_hash_bucket *hb)
+{
+	atomic_set(&hb->waiters, 0);
+	plist_head_init(&hb->chain);
+	spin_lock_init(&hb->lock);
+}
 
-	return &futex_queues[hash & (futex_hashsize - 1)];
+void futex_mm_init(struct mm_struct *mm)
+{
+	mm->futex_phash = NULL;
+}
+
+void futex_hash_free(struct mm_struct *mm)
+{
+	kvfree(mm->futex_phash);
+}
+
+static int futex_hash_set_slots(unsigned int slots)
+{
+	struct mm_struct *mm = current->mm;
+	struct futex_private_hash *fph = NULL;
+	unsigned int i;
+
+	if (slots && (slots < 2 || slots > FUTEX_PRIVATE_HASH_MAX ||
+		      !is_power_of_2(slots)))
+		return -EINVAL;
+
+	/*
+	 * Only a single threaded process that does not share its mm can
+	 * switch tables, nobody else can be waiting on a private futex then.
+	 * mm_users may also be elevated temporarily, e.g. by /proc readers.
+	 */
+	if (get_nr_threads(current) != 1 || atomic_read(&mm->mm_users) != 1)
+		return -EBUSY;
+#ifdef CONFIG_IO_URING
+	/* io_uring can have futex_q-s queued without a waiting task */
+	if (current->io_uring)
+		return -EBUSY;
+#endif
+
+	if (slots) {
+		fph = kvzalloc(struct_size(fph, queues, slots), GFP_KERNEL_ACCOUNT);
+		if (!fph)
+			return -ENOMEM;
+		fph->hash_mask = slots - 1;
+		for (i = 0; i < slots; i++)
+			futex_hash_bucket_init(&fph->queues[i]);
+	}
+
+	kvfree(mm->futex_phash);
+	WRITE_ONCE(mm->futex_phash, fph);
+	return 0;
+}
+
+static int futex_hash_get_slots(void)
+{
+	struct futex_private_hash *fph = current->mm->futex_phash;
+
+	return fph ? fph->hash_mask + 1 : 0;
+}
+
+/**
+ * futex_hash_prctl - PR_FUTEX_HASH
+ * @arg2:	PR_FUTEX_HASH_SET_SLOTS or PR_FUTEX_HASH_GET_SLOTS
+ * @arg3:	number of buckets to set, a power of two or 0
+ *
+ * Give private futexes of the current process their own hash table, so that
+ * they stop sharing hash buckets (and their locks) with other processes.
+ * The table is not inherited over fork() or exec().
+ */
+int futex_hash_prctl(unsigned long arg2, unsigned long arg3)
+{
+	if (!current->mm)
+		return -EINVAL;
+
+	switch (arg2) {
+	case PR_FUTEX_HASH_SET_SLOTS:
+		if (arg3 > FUTEX_PRIVATE_HASH_MAX)
+			return -EINVAL;
+		return futex_hash_set_slots(arg3);
+	case PR_FUTEX_HASH_GET_SLOTS:
+		if (arg3)
+			return -EINVAL;
+		return futex_hash_get_slots();
+	default:
+		return -EINVAL;
+	}
 }
 
 
@@ -192,6 +325,43 @@ static u64 get_inode_sequence_number(struct inode *inode)
 	}
 }
 
+/*
+ * Read the home node of a FUTEX2_NUMA futex.  An unset node is claimed for
+ * the local node with a cmpxchg, so that racing users of the futex all agree
+ * on the node of the first one.
+ */
+static int futex_get_node(u32 __user *naddr, int *node)
+{
+	u32 val, cur;
+	int nid, ret;
+
+	if (get_user(val, naddr))
+		return -EFAULT;
+
+	while (val == (u32)FUTEX_NO_NODE) {
+		nid = numa_node_id();
+		ret = futex_cmpxchg_value_locked(&cur, naddr, val, nid);
+		if (ret == -EFAULT) {
+			if (fault_in_user_writeable(naddr))
+				return -EFAULT;
+			continue;
+		}
+		if (ret == -EAGAIN) {
+			cond_resched();
+			continue;
+		}
+		if (ret)
+			return ret;
+		val = cur == (u32)FUTEX_NO_NODE ? nid : cur;
+	}
+
+	if (val >= MAX_NUMNODES || !node_possible(val))
+		return -EINVAL;
+
+	*node = val;
+	return 0;
+}
+
 /**
  * get_futex_key() - Get parameters which are the keys for a futex
  * @uaddr:	virtual address of the futex
@@ -227,22 +397,35 @@ int get_futex_key(u32 __user *uaddr, unsigned int flags, union futex_key *key,
 	struct page *page;
 	struct folio *folio;
 	struct address_space *mapping;
+	size_t size = futex_size(flags);
+	int node = FUTEX_NO_NODE;
 	int err, ro = 0;
 	bool fshared;
 
 	fshared = flags & FLAGS_SHARED;
 
+	/* a NUMA futex is followed by its node */
+	if (flags & FLAGS_NUMA)
+		size *= 2;
+
 	/*
 	 * The futex address must be "naturally" aligned.
 	 */
 	key->both.offset = address % PAGE_SIZE;
-	if (unlikely((address % sizeof(u32)) != 0))
+	if (unlikely((address % size) != 0))
 		return -EINVAL;
 	address -= key->both.offset;
 
-	if (unlikely(!access_ok(uaddr, sizeof(u32))))
+	if (unlikely(!access_ok(uaddr, size)))
 		return -EFAULT;
 
+	if (flags & FLAGS_NUMA) {
+		err = futex_get_node((void __user *)uaddr + size / 2, &node);
+		if (err)
+			return err;
+	}
+	key->both.node = node;
+
 	if (unlikely(should_fail_futex(fshared)))
 		return -EFAULT;
 
@@ -1126,27 +1309,32 @@ void futex_exit_release(struct task_struct *tsk)
 
 static int __init futex_init(void)
 {
-	unsigned int futex_shift;
-	unsigned long i;
+	struct futex_hash_bucket *table;
+	unsigned long i, hashsize;
+	int n;
 
 #ifdef CONFIG_BASE_SMALL
-	futex_hashsize = 16;
+	hashsize = 16;
 #else
-	futex_hashsize = roundup_pow_of_two(256 * num_possible_cpus());
+	hashsize = 256 * num_possible_cpus() / num_possible_nodes();
+	hashsize = roundup_pow_of_two(max(hashsize, 16UL));
 #endif
 
-	futex_queues = alloc_large_system_hash("futex", sizeof(*futex_queues),
-					       futex_hashsize, 0, 0,
-					       &futex_shift, NULL,
-					       futex_hashsize, futex_hashsize);
-	futex_hashsize = 1UL << futex_shift;
+	for_each_node(n) {
+		table = kvmalloc_node(array_size(hashsize, sizeof(*table)),
+				      GFP_KERNEL, n);
+		if (!table)
+			panic("futex: Failed to allocate the hash of node %d\n", n);
 
-	for (i = 0; i < futex_hashsize; i++) {
-		atomic_set(&futex_queues[i].waiters, 0);
-		plist_head_init(&futex_queues[i].chain);
-		spin_lock_init(&futex_queues[i].lock);
+		for (i = 0; i < hashsize; i++)
+			futex_hash_bucket_init(&table[i]);
+		futex_queues[n] = table;
 	}
+	futex_hashmask = hashsize - 1;
+	futex_hashshift = ilog2(hashsize);
 
+	pr_info("futex hash table entries: %lu per node, %u nodes\n",
+		hashsize, num_possible_nodes());
 	return 0;
 }
 core_initcall(futex_init);
@@ -0,0 +1,254 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * In-kernel interrupt affinity balancing.
+ *
+ * While enabled, the time spent in the handlers of each interrupt is
+ * accounted per CPU. A periodic pass sums it up per CPU and moves hot
+ * interrupts from the busiest housekeeping CPU to the least busy one.
+ *
+ * Only interrupts whose affinity can be set from user space and which are
+ * affine to all balancing targets, or still sit where the balancer put them,
+ * are considered. Anything pinned by a driver or by user space is left
+ * alone.
+ */
+#define pr_fmt(fmt) "irqbalance: " fmt
+
+#include <linux/interrupt.h>
+#include <linux/irq.h>
+#include <linux/jiffies.h>
+#include <linux/moduleparam.h>
+#include <linux/sched/isolation.h>
+#include <linux/workqueue.h>
+
+#include "internals.h"
+
+#undef MODULE_PARAM_PREFIX
+#define MODULE_PARAM_PREFIX "irqbalance."
+
+/* Upper limit of interrupts moved per pass */
+#define IRQ_BALANCE_MAX_MOVES	4
+
+DEFINE_STATIC_KEY_FALSE(irq_balance_enabled);
+
+static DEFINE_MUTEX(irq_balance_mutex);
+static DEFINE_PER_CPU(u64, irq_balance_load);
+static cpumask_var_t irq_balance_targets;
+static bool irq_balance_ready;
+static bool irq_balance_on;
+
+static unsigned int irq_balance_interval_ms = 1000;
+module_param_named(interval_ms, irq_balance_interval_ms, uint, 0644);
+MODULE_PARM_DESC(interval_ms, "Balancing period in milliseconds");
+
+static unsigned int irq_balance_threshold = 10;
+module_param_named(threshold, irq_balance_threshold, uint, 0644);
+MODULE_PARM_DESC(threshold, "Percentage of a CPU spent in handlers which makes it a source");
+
+static unsigned int irq_balance_cooldown = 10;
+module_param_named(cooldown, irq_balance_cooldown, uint, 0644);
+MODULE_PARM_DESC(cooldown, "Number of periods before a moved interrupt may move again");
+
+static void irq_balance_workfn(struct work_struct *work);
+static DECLARE_DELAYED_WORK(irq_balance_work, irq_balance_workfn);
+
+static unsigned long irq_balance_interval(void)
+{
+	return msecs_to_jiffies(max(READ_ONCE(irq_balance_interval_ms), 10U));
+}
+
+static bool irq_balance_movable(struct irq_desc *desc)
+{
+	const struct cpumask *m = irq_data_get_affinity_mask(&desc->irq_data);
+	int cpu = desc->balance_cpu;
+
+	if (!desc->action || !irq_can_set_affinity_usr(irq_desc_get_irq(desc)))
+		return false;
+
+	/* Still where the balancer put it, or not pinned by anyone */
+	if (cpu >= 0 && cpumask_equal(m, cpumask_of(cpu)))
+		return true;
+	return cpumask_subset(irq_balance_targets, m);
+}
+
+/* Sum up the handling time of the last period per CPU and per interrupt */
+static void irq_balance_sample(void)
+{
+	struct irq_desc *desc;
+	unsigned int irq;
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		per_cpu(irq_balance_load, cpu) = 0;
+
+	for_each_active_irq(irq) {
+		u64 most = 0;
+
+		desc = irq_to_desc(irq);
+		if (!desc || !desc->kstat_irqs)
+			continue;
+
+		desc->balance_load = 0;
+		desc->balance_src = -1;
+		for_each_online_cpu(cpu) {
+			struct irqstat *st = per_cpu_ptr(desc->kstat_irqs, cpu);
+			u64 ns = READ_ONCE(st->ns), delta = ns - st->ns_ref;
+
+			st->ns_ref = ns;
+			per_cpu(irq_balance_load, cpu) += delta;
+			desc->balance_load += delta;
+			if (delta > most) {
+				most = delta;
+				desc->balance_src = cpu;
+			}
+		}
+	}
+}
+
+/*
+ * Pick the biggest movable interrupt on @src which fits into half of the
+ * imbalance @gap, so a move never turns @dst into the new hot spot.
+ */
+static struct irq_desc *irq_balance_pick(int src, u64 gap)
+{
+	unsigned long cooldown = irq_balance_cooldown * irq_balance_interval();
+	struct irq_desc *desc, *best = NULL;
+	unsigned int irq;
+
+	for_each_active_irq(irq) {
+		desc = irq_to_desc(irq);
+		if (!desc || desc->balance_src != src || !desc->balance_load)
+			continue;
+		if (desc->balance_load > gap / 2)
+			continue;
+		if (best && desc->balance_load <= best->balance_load)
+			continue;
+		if (desc->balance_stamp &&
+		    time_before(jiffies, desc->balance_stamp + cooldown))
+			continue;
+		if (irq_balance_movable(desc))
+			best = desc;
+	}
+	return best;
+}
+
+static void irq_balance_run(void)
+{
+	u64 threshold = div_u64((u64)jiffies_to_nsecs(irq_balance_interval()) *
+				irq_balance_threshold, 100);
+	int i, cpu, src, dst;
+
+	cpumask_and(irq_balance_targets, irq_default_affinity, cpu_online_mask);
+	cpumask_and(irq_balance_targets, irq_balance_targets,
+		    housekeeping_cpumask(HK_TYPE_DOMAIN));
+	if (cpumask_weight(irq_balance_targets) < 2)
+		return;
+
+	irq_balance_sample();
+
+	for (i = 0; i < IRQ_BALANCE_MAX_MOVES; i++) {
+		struct irq_desc *desc;
+		u64 load;
+
+		src = dst = -1;
+		for_each_cpu(cpu, irq_balance_targets) {
+			load = per_cpu(irq_balance_load, cpu);
+			if (src < 0 || load > per_cpu(irq_balance_load, src))
+				src = cpu;
+			if (dst < 0 || load < per_cpu(irq_balance_load, dst))
+				dst = cpu;
+		}
+
+		load = per_cpu(irq_balance_load, src);
+		if (load < threshold)
+			break;
+
+		desc = irq_balance_pick(src, load - per_cpu(irq_balance_load, dst));
+		if (!desc)
+			break;
+
+		if (irq_set_affinity(irq_desc_get_irq(desc), cpumask_of(dst)))
+			break;
+
+		desc->balance_cpu = dst;
+		desc->balance_src = dst;
+		desc->balance_stamp = jiffies ?: 1;
+		per_cpu(irq_balance_load, src) -= desc->balance_load;
+		per_cpu(irq_balance_load, dst) += desc->balance_load;
+		pr_debug("moved irq %u from CPU%d to CPU%d\n",
+			 irq_desc_get_irq(desc), src, dst);
+	}
+}
+
+static void irq_balance_workfn(struct work_struct *work)
+{
+	mutex_lock(&irq_balance_mutex);
+	if (!irq_balance_on) {
+		mutex_unlock(&irq_balance_mutex);
+		return;
+	}
+
+	cpus_read_lock();
+	irq_lock_sparse();
+	irq_balance_run();
+	irq_unlock_sparse();
+	cpus_read_unlock();
+	mutex_unlock(&irq_balance_mutex);
+
+	queue_delayed_work(system_unbound_wq, &irq_balance_work,
+			   irq_balance_interval());
+}
+
+static void irq_balance_start_locked(void)
+{
+	static_branch_enable(&irq_balance_enabled);
+	queue_delayed_work(system_unbound_wq, &irq_balance_work,
+			   irq_balance_interval());
+}
+
+static int irq_balance_set(const char *val, const struct kernel_param *kp)
+{
+	bool on;
+	int ret;
+
+	ret = kstrtobool(val, &on);
+	if (ret)
+		return ret;
+
+	/* Boot time, irq_balance_init() takes care of it */
+	if (!irq_balance_ready) {
+		irq_balance_on = on;
+		return 0;
+	}
+
+	mutex_lock(&irq_balance_mutex);
+	if (on != irq_balance_on) {
+		irq_balance_on = on;
+		if (on)
+			irq_balance_start_locked();
+		else
+			static_branch_disable(&irq_balance_enabled);
+	}
+	mutex_unlock(&irq_balance_mutex);
+	return 0;
+}
+
+static const struct kernel_param_ops irq_balance_ops = {
+	.set	= irq_balance_set,
+	.get	= param_get_bool,
+};
+module_param_cb(enable, &irq_balance_ops, &irq_balance_on, 0644);
+MODULE_PARM_DESC(enable, "Balance interrupt affinity in the kernel");
+
+static int __init irq_balance_init(void)
+{
+	if (!zalloc_cpumask_var(&irq_balance_targets, GFP_KERNEL))
+		return -ENOMEM;
+
+	mutex_lock(&irq_balance_mutex);
+	irq_balance_ready = true;
+	if (irq_balance_on)
+		irq_balance_start_locked();
+	mutex_unlock(&irq_balance_mutex);
+	return 0;
+}
+late_initcall(irq_balance_init);
@@ -0,0 +1,245 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Software interrupt coalescing.
+ *
+ * Once an interrupt line fires faster than its configured rate, the line is
+ * disabled and its handlers are invoked from a hrtimer instead. The polling
+ * interval adapts to whether the handlers found work and the line goes back
+ * to interrupt mode when traffic falls well below the rate.
+ *
+ * Handlers are invoked without the device having raised an interrupt, so
+ * this is only usable for handlers which cope with that, like the ones of
+ * shared interrupts have to. Threaded handlers are not supported.
+ */
+#define pr_fmt(fmt) "irq_coalesce: " fmt
+
+#include <linux/hrtimer.h>
+#include <linux/interrupt.h>
+#include <linux/irq.h>
+#include <linux/slab.h>
+
+#include "internals.h"
+
+/* Length of the window the interrupt rate is measured in */
+#define IRQ_COALESCE_WINDOW_NS	(10 * NSEC_PER_MSEC)
+
+/*
+ * Shortest polling interval. Each poll is a hard interrupt of its own, so
+ * polling faster than this costs more than the interrupts it replaces.
+ */
+#define IRQ_COALESCE_MIN_NS	(10ULL * NSEC_PER_USEC)
+
+/**
+ * struct irq_coalesce - software coalescing state of an interrupt line
+ * @timer:	polling timer
+ * @desc:	the interrupt descriptor
+ * @rate:	interrupts per second switching to polling, 0 if disabled
+ * @count:	interrupts in the current measurement window
+ * @window:	start of the current measurement window
+ * @base_ns:	interrupt spacing at @rate
+ * @interval_ns: current polling interval, between @base_ns / 4 and
+ *		@base_ns * 4, and no less than %IRQ_COALESCE_MIN_NS
+ * @polling:	line is disabled and polled
+ */
+struct irq_coalesce {
+	struct hrtimer		timer;
+	struct irq_desc		*desc;
+	unsigned int		rate;
+	unsigned int		count;
+	u64			window;
+	u64			base_ns;
+	u64			interval_ns;
+	bool			polling;
+};
+
+static bool irq_coalesce_has_threads(struct irq_desc *desc)
+{
+	struct irqaction *action;
+
+	for_each_action_of_desc(desc, action) {
+		if (action->thread_fn)
+			return true;
+	}
+	return false;
+}
+
+/* Switch back to interrupts, called with desc->lock held */
+static void irq_coalesce_unpoll(struct irq_desc *desc, struct irq_coalesce *c)
+{
+	c->polling = false;
+	c->count = 0;
+	c->window = local_clock();
+	__enable_irq(desc);
+}
+
+static enum hrtimer_restart irq_coalesce_poll(struct hrtimer *timer)
+{
+	struct irq_coalesce *c = container_of(timer, struct irq_coalesce, timer);
+	struct irq_desc *desc = c->desc;
+	irqreturn_t ret = IRQ_NONE;
+
+	raw_spin_lock(&desc->lock);
+	if (!c->polling) {
+		raw_spin_unlock(&desc->lock);
+		return HRTIMER_NORESTART;
+	}
+
+	/*
+	 * Only run the handlers while the line is disabled by us alone, not
+	 * by drivers or suspend, and not while they run elsewhere.
+	 */
+	if (desc->depth == 1 && desc->action &&
+	    !irqd_irq_inprogress(&desc->irq_data) &&
+	    !irq_coalesce_has_threads(desc)) {
+		irqd_set(&desc->irq_data, IRQD_IRQ_INPROGRESS);
+		raw_spin_unlock(&desc->lock);
+		ret = __handle_irq_event_percpu(desc);
+		raw_spin_lock(&desc->lock);
+		irqd_clear(&desc->irq_data, IRQD_IRQ_INPROGRESS);
+	}
+
+	if (ret & IRQ_HANDLED)
+		c->interval_ns = max3(c->interval_ns - c->interval_ns / 4,
+				      c->base_ns / 4, IRQ_COALESCE_MIN_NS);
+	else
+		c->interval_ns *= 2;
+
+	if (c->interval_ns > c->base_ns * 4 || irq_coalesce_has_threads(desc)) {
+		irq_coalesce_unpoll(desc, c);
+		raw_spin_unlock(&desc->lock);
+		return HRTIMER_NORESTART;
+	}
+	raw_spin_unlock(&desc->lock);
+
+	hrtimer_forward_now(timer, ns_to_ktime(c->interval_ns));
+	return HRTIMER_RESTART;
+}
+
+/* Called from handle_irq_event() with desc->lock held */
+void __irq_coalesce_note(struct irq_desc *desc)
+{
+	struct irq_coalesce *c = desc->coalesce;
+	u64 now;
+
+	if (!c->rate || c->polling)
+		return;
+
+	now = local_clock();
+	if (now - c->window > IRQ_COALESCE_WINDOW_NS) {
+		c->window = now;
+		c->count = 0;
+	}
+
+	if (++c->count < div_u64((u64)c->rate * IRQ_COALESCE_WINDOW_NS,
+				 NSEC_PER_SEC))
+		return;
+
+	if (irq_coalesce_has_threads(desc))
+		return;
+
+	c->polling = true;
+	c->interval_ns = c->base_ns;
+	__disable_irq(desc);
+	hrtimer_start(&c->timer, ns_to_ktime(c->interval_ns),
+		      HRTIMER_MODE_REL_HARD);
+}
+
+/*
+ * Called from __free_irq() with desc->lock held before the line is shut
+ * down, which resets the disable depth we hold.
+ */
+void irq_coalesce_shutdown(struct irq_desc *desc)
+{
+	if (desc->coalesce)
+		desc->coalesce->polling = false;
+}
+
+/* Wait for a running poll, called without desc->lock held */
+void irq_coalesce_sync(struct irq_desc *desc)
+{
+	if (desc->coalesce)
+		hrtimer_cancel(&desc->coalesce->timer);
+}
+
+void irq_coalesce_free(struct irq_desc *desc)
+{
+	struct irq_coalesce *c = desc->coalesce;
+
+	if (!c)
+		return;
+
+	hrtimer_cancel(&c->timer);
+	desc->coalesce = NULL;
+	kfree(c);
+}
+
+/**
+ * irq_set_coalesce_rate - configure software coalescing of an interrupt
+ * @irq:	the interrupt line
+ * @rate:	interrupts per second above which the line is polled, 0 to
+ *		disable
+ *
+ * All handlers of @irq must cope with being invoked while their device did
+ * not raise an interrupt. Per CPU, NMI and threaded interrupts cannot be
+ * coalesced. @rate must be between 100 and 100000, so that the handlers run
+ * at least once per 10ms measurement window and are not polled more often
+ * than every 10us.
+ *
+ * Return: 0 on success, a negative error code otherwise.
+ */
+int irq_set_coalesce_rate(unsigned int irq, unsigned int rate)
+{
+	struct irq_desc *desc = irq_to_desc(irq);
+	struct irq_coalesce *c;
+	unsigned long flags;
+	int ret = 0;
+
+	if (!desc)
+		return -EINVAL;
+	if (irq_settings_is_per_cpu_devid(desc) || irq_is_nmi(desc))
+		return -EINVAL;
+	/* The handlers have to run at least once per measurement window */
+	if (rate && rate < NSEC_PER_SEC / IRQ_COALESCE_WINDOW_NS)
+		return -EINVAL;
+	if (rate > NSEC_PER_SEC / IRQ_COALESCE_MIN_NS)
+		return -EINVAL;
+
+	mutex_lock(&desc->request_mutex);
+	c = desc->coalesce;
+	if (!c) {
+		if (!rate)
+			goto out_unlock;
+		c = kzalloc(sizeof(*c), GFP_KERNEL);
+		if (!c) {
+			ret = -ENOMEM;
+			goto out_unlock;
+		}
+		hrtimer_setup(&c->timer, irq_coalesce_poll, CLOCK_MONOTONIC,
+			      HRTIMER_MODE_REL_HARD);
+		c->desc = desc;
+	}
+
+	raw_spin_lock_irqsave(&desc->lock, flags);
+	c->rate = rate;
+	if (rate)
+		c->base_ns = div_u64(NSEC_PER_SEC, rate);
+	else if (c->polling)
+		irq_coalesce_unpoll(desc, c);
+	c->count = 0;
+	c->window = local_clock();
+	desc->coalesce = c;
+	raw_spin_unlock_irqrestore(&desc->lock, flags);
+
+	if (!rate)
+		irq_coalesce_sync(desc);
+
+out_unlock:
+	mutex_unlock(&desc->request_mutex);
+	return ret;
+}
+EXPORT_SYMBOL_GPL(irq_set_coalesce_rate);
+
+unsigned int irq_get_coalesce_rate(struct irq_desc *desc)
+{
+	return desc->coalesce ? READ_ONCE(desc->coalesce->rate) : 0;
+}
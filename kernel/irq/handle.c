@@ -188,9 +188,11 @@ irqreturn_t __handle_irq_event_percpu(struct irq_desc *desc)
 
 irqreturn_t handle_irq_event_percpu(struct irq_desc *desc)
 {
+	u64 start = irq_balance_start();
 	irqreturn_t retval;
 
 	retval = __handle_irq_event_percpu(desc);
+	irq_balance_account(desc, start);
 
 	add_interrupt_randomness(desc->irq_data.irq);
 
@@ -211,6 +213,7 @@ irqreturn_t handle_irq_event(struct irq_desc *desc)
 
 	raw_spin_lock(&desc->lock);
 	irqd_clear(&desc->irq_data, IRQD_IRQ_INPROGRESS);
+	irq_coalesce_note(desc);
 	return ret;
 }
 
@@ -406,6 +406,44 @@ static inline void irq_setup_timings(struct irq_desc *desc,
 static inline void record_irq_time(struct irq_desc *desc) {}
 #endif /* CONFIG_IRQ_TIMINGS */
 
+#ifdef CONFIG_IRQ_AUTO_BALANCE
+DECLARE_STATIC_KEY_FALSE(irq_balance_enabled);
+
+/* Account the time spent in the handlers for the in-kernel balancer */
+static __always_inline u64 irq_balance_start(void)
+{
+	return static_branch_unlikely(&irq_balance_enabled) ? local_clock() : 0;
+}
+
+static __always_inline void irq_balance_account(struct irq_desc *desc, u64 start)
+{
+	if (start)
+		__this_cpu_add(desc->kstat_irqs->ns, local_clock() - start);
+}
+#else
+static inline u64 irq_balance_start(void) { return 0; }
+static inline void irq_balance_account(struct irq_desc *desc, u64 start) { }
+#endif /* CONFIG_IRQ_AUTO_BALANCE */
+
+#ifdef CONFIG_IRQ_COALESCE
+void __irq_coalesce_note(struct irq_desc *desc);
+void irq_coalesce_shutdown(struct irq_desc *desc);
+void irq_coalesce_sync(struct irq_desc *desc);
+void irq_coalesce_free(struct irq_desc *desc);
+unsigned int irq_get_coalesce_rate(struct irq_desc *desc);
+
+static inline void irq_coalesce_note(struct irq_desc *desc)
+{
+	if (unlikely(desc->coalesce))
+		__irq_coalesce_note(desc);
+}
+#else
+static inline void irq_coalesce_note(struct irq_desc *desc) { }
+static inline void irq_coalesce_shutdown(struct irq_desc *desc) { }
+static inline void irq_coalesce_sync(struct irq_desc *desc) { }
+static inline void irq_coalesce_free(struct irq_desc *desc) { }
+#endif /* CONFIG_IRQ_COALESCE */
+
 
 #ifdef CONFIG_GENERIC_IRQ_CHIP
 void irq_init_generic_chip(struct irq_chip_generic *gc, const char *name,
@@ -88,6 +88,10 @@ static void desc_smp_init(struct irq_desc *desc, int node,
 #ifdef CONFIG_GENERIC_PENDING_IRQ
 	cpumask_clear(desc->pending_mask);
 #endif
+#ifdef CONFIG_IRQ_AUTO_BALANCE
+	desc->balance_src = -1;
+	desc->balance_cpu = -1;
+#endif
 #ifdef CONFIG_NUMA
 	desc->irq_common_data.node = node;
 #endif
@@ -506,6 +510,7 @@ static void free_desc(unsigned int irq)
 
 	irq_remove_debugfs_entry(desc);
 	unregister_irq_proc(irq, desc);
+	irq_coalesce_free(desc);
 
 	/*
 	 * sparse_irq_lock protects also show_interrupts() and
@@ -658,6 +663,8 @@ static void free_desc(unsigned int irq)
 	struct irq_desc *desc = irq_to_desc(irq);
 	unsigned long flags;
 
+	irq_coalesce_free(desc);
+
 	raw_spin_lock_irqsave(&desc->lock, flags);
 	desc_set_defaults(irq, desc, irq_desc_get_node(desc), NULL, NULL);
 	raw_spin_unlock_irqrestore(&desc->lock, flags);
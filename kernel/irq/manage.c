@@ -1917,6 +1917,7 @@ static struct irqaction *__free_irq(struct irq_desc *desc, void *dev_id)
 	/* If this was the last handler, shut down the IRQ line: */
 	if (!desc->action) {
 		irq_settings_clr_disable_unlazy(desc);
+		irq_coalesce_shutdown(desc);
 		/* Only shutdown. Deactivate after synchronize_hardirq() */
 		irq_shutdown(desc);
 	}
@@ -1946,6 +1947,9 @@ static struct irqaction *__free_irq(struct irq_desc *desc, void *dev_id)
 
 	unregister_handler_proc(irq, action);
 
+	if (!desc->action)
+		irq_coalesce_sync(desc);
+
 	/*
 	 * Make sure it's not being used on another CPU and if the chip
 	 * supports it also make sure that there is no (not yet serviced)
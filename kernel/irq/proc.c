@@ -293,6 +293,44 @@ static int irq_spurious_proc_show(struct seq_file *m, void *v)
 	return 0;
 }
 
+#ifdef CONFIG_IRQ_COALESCE
+static int irq_coalesce_proc_show(struct seq_file *m, void *v)
+{
+	struct irq_desc *desc = irq_to_desc((long) m->private);
+
+	seq_printf(m, "%u\n", irq_get_coalesce_rate(desc));
+	return 0;
+}
+
+static int irq_coalesce_proc_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, irq_coalesce_proc_show, pde_data(inode));
+}
+
+static ssize_t irq_coalesce_proc_write(struct file *file,
+		const char __user *buffer, size_t count, loff_t *pos)
+{
+	unsigned int irq = (int)(long)pde_data(file_inode(file));
+	unsigned int rate;
+	int err;
+
+	err = kstrtouint_from_user(buffer, count, 0, &rate);
+	if (err)
+		return err;
+
+	err = irq_set_coalesce_rate(irq, rate);
+	return err ?: count;
+}
+
+static const struct proc_ops irq_coalesce_proc_ops = {
+	.proc_open	= irq_coalesce_proc_open,
+	.proc_read	= seq_read,
+	.proc_lseek	= seq_lseek,
+	.proc_release	= single_release,
+	.proc_write	= irq_coalesce_proc_write,
+};
+#endif
+
 #define MAX_NAMELEN 128
 
 static int name_unique(unsigned int irq, struct irqaction *new_action)
@@ -388,6 +426,10 @@ void register_irq_proc(unsigned int irq, struct irq_desc *desc)
 #endif
 	proc_create_single_data("spurious", 0444, desc->dir,
 			irq_spurious_proc_show, (void *)(long)irq);
+#ifdef CONFIG_IRQ_COALESCE
+	proc_create_data("coalesce_rate", 0644, desc->dir,
+			 &irq_coalesce_proc_ops, (void *)(long)irq);
+#endif
 
 out_unlock:
 	mutex_unlock(&register_lock);
@@ -410,6 +452,9 @@ void unregister_irq_proc(unsigned int irq, struct irq_desc *desc)
 # endif
 #endif
 	remove_proc_entry("spurious", desc->dir);
+#ifdef CONFIG_IRQ_COALESCE
+	remove_proc_entry("coalesce_rate", desc->dir);
+#endif
 
 	sprintf(name, "%u", irq);
 	remove_proc_entry(name, root_irq_dir);
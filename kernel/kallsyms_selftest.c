@@ -187,6 +187,46 @@ static void test_perf_kallsyms_lookup_name(void)
 		stat.min, stat.max, div_u64(stat.sum, stat.real_cnt));
 }
 
+static int lookup_addr(void *data, const char *name, unsigned long addr)
+{
+	u64 t0, t1, t;
+	unsigned long size, offset;
+	char namebuf[KSYM_NAME_LEN];
+	struct test_stat *stat = (struct test_stat *)data;
+
+	t0 = ktime_get_ns();
+	(void)kallsyms_lookup(addr, &size, &offset, NULL, namebuf);
+	t1 = ktime_get_ns();
+
+	t = t1 - t0;
+	if (t < stat->min)
+		stat->min = t;
+
+	if (t > stat->max)
+		stat->max = t;
+
+	stat->real_cnt++;
+	stat->sum += t;
+
+	return 0;
+}
+
+/*
+ * Reverse lookups are what stack trace symbolization (%pS, ftrace 'sym'
+ * output, BPF stack printing) pays for every frame.
+ */
+static void test_perf_kallsyms_lookup(void)
+{
+	struct test_stat stat;
+
+	memset(&stat, 0, sizeof(stat));
+	stat.min = INT_MAX;
+	kallsyms_on_each_symbol(lookup_addr, &stat);
+	pr_info("kallsyms_lookup() looked up %d addresses\n", stat.real_cnt);
+	pr_info("The time spent on each address is (ns): min=%d, max=%d, avg=%lld\n",
+		stat.min, stat.max, div_u64(stat.sum, stat.real_cnt));
+}
+
 static int find_symbol(void *data, const char *name, unsigned long addr)
 {
 	struct test_stat *stat = (struct test_stat *)data;
@@ -424,6 +464,7 @@ static int test_entry(void *p)
 
 	test_kallsyms_compression_ratio();
 	test_perf_kallsyms_lookup_name();
+	test_perf_kallsyms_lookup();
 	test_perf_kallsyms_on_each_symbol();
 	test_perf_kallsyms_on_each_match_symbol();
 	pr_info("finish\n");
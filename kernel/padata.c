@@ -35,29 +35,26 @@ static DEFINE_SPINLOCK(padata_works_lock);
 static struct padata_work *padata_works;
 static LIST_HEAD(padata_free_works);
 
-struct padata_mt_job_state {
+/* The part of a multithreaded job a helper still has to do, [start, end) */
+struct padata_mt_range {
 	spinlock_t		lock;
+	unsigned long		start;
+	unsigned long		end;
+} ____cacheline_aligned_in_smp;
+
+struct padata_mt_job_state {
 	struct completion	completion;
 	struct padata_mt_job	*job;
+	struct padata_mt_range	*ranges;
 	int			nworks;
-	int			nworks_fini;
+	atomic_t		nworks_started;
+	atomic_t		nworks_fini;
 	unsigned long		chunk_size;
 };
 
 static void padata_free_pd(struct parallel_data *pd);
 static void __init padata_mt_helper(struct work_struct *work);
 
-static int padata_index_to_cpu(struct parallel_data *pd, int cpu_index)
-{
-	int cpu, target_cpu;
-
-	target_cpu = cpumask_first(pd->cpumask.pcpu);
-	for (cpu = 0; cpu < cpu_index; cpu++)
-		target_cpu = cpumask_next(target_cpu, pd->cpumask.pcpu);
-
-	return target_cpu;
-}
-
 static int padata_cpu_hash(struct parallel_data *pd, unsigned int seq_nr)
 {
 	/*
@@ -66,7 +63,7 @@ static int padata_cpu_hash(struct parallel_data *pd, unsigned int seq_nr)
 	 */
 	int cpu_index = seq_nr % cpumask_weight(pd->cpumask.pcpu);
 
-	return padata_index_to_cpu(pd, cpu_index);
+	return cpumask_nth(cpu_index, pd->cpumask.pcpu);
 }
 
 static struct padata_work *padata_work_alloc(void)
@@ -176,7 +173,7 @@ int padata_do_parallel(struct padata_shell *ps,
 		       struct padata_priv *padata, int *cb_cpu)
 {
 	struct padata_instance *pinst = ps->pinst;
-	int i, cpu, cpu_index, err;
+	int cpu_index, err;
 	struct parallel_data *pd;
 	struct padata_work *pw;
 
@@ -194,12 +191,7 @@ int padata_do_parallel(struct padata_shell *ps,
 
 		/* Select an alternate fallback CPU and notify the caller. */
 		cpu_index = *cb_cpu % cpumask_weight(pd->cpumask.cbcpu);
-
-		cpu = cpumask_first(pd->cpumask.cbcpu);
-		for (i = 0; i < cpu_index; i++)
-			cpu = cpumask_next(cpu, pd->cpumask.cbcpu);
-
-		*cb_cpu = cpu;
+		*cb_cpu = cpumask_nth(cpu_index, pd->cpumask.cbcpu);
 	}
 
 	err = -EBUSY;
@@ -439,37 +431,83 @@ static int padata_setup_cpumasks(struct padata_instance *pinst)
 	return err;
 }
 
+/*
+ * Take the upper half of the range of the helper with the most work left.
+ * Returns false when no range is worth splitting any more.
+ */
+static bool __init padata_mt_steal(struct padata_mt_job_state *ps,
+				   struct padata_mt_range *own)
+{
+	struct padata_mt_range *victim = NULL;
+	unsigned long most = 0, start, end, mid;
+	int i;
+
+	for (i = 0; i < ps->nworks; ++i) {
+		struct padata_mt_range *r = &ps->ranges[i];
+
+		/* Unlocked, only a hint rechecked below. */
+		start = data_race(r->start);
+		end = data_race(r->end);
+		if (r != own && end > start && end - start > most) {
+			most = end - start;
+			victim = r;
+		}
+	}
+
+	/* Leave the victim at least one chunk and steal at least one. */
+	if (!victim || most <= 2 * ps->chunk_size)
+		return false;
+
+	spin_lock(&victim->lock);
+	start = victim->start;
+	end = victim->end;
+	if (end <= start || end - start <= 2 * ps->chunk_size) {
+		/* Raced with its owner or another thief, look again. */
+		spin_unlock(&victim->lock);
+		return true;
+	}
+	mid = roundup(start + (end - start) / 2, ps->job->align);
+	victim->end = mid;
+	spin_unlock(&victim->lock);
+
+	spin_lock(&own->lock);
+	own->start = mid;
+	own->end = end;
+	spin_unlock(&own->lock);
+	return true;
+}
+
 static void __init padata_mt_helper(struct work_struct *w)
 {
+	/* Chunks shrink with the work left so the tail can be balanced. */
+	static const unsigned long load_balance_factor = 4;
 	struct padata_work *pw = container_of(w, struct padata_work, pw_work);
 	struct padata_mt_job_state *ps = pw->pw_data;
 	struct padata_mt_job *job = ps->job;
-	bool done;
-
-	spin_lock(&ps->lock);
+	struct padata_mt_range *own;
 
-	while (job->size > 0) {
-		unsigned long start, size, end;
+	own = &ps->ranges[atomic_inc_return(&ps->nworks_started) - 1];
 
-		start = job->start;
-		/* So end is chunk size aligned if enough work remains. */
-		size = roundup(start + 1, ps->chunk_size) - start;
-		size = min(size, job->size);
-		end = start + size;
+	do {
+		spin_lock(&own->lock);
+		while (own->start < own->end) {
+			unsigned long start, size, end;
 
-		job->start = end;
-		job->size -= size;
+			start = own->start;
+			size = (own->end - start) / load_balance_factor;
+			size = max(size, ps->chunk_size);
+			/* So end is aligned if enough work remains. */
+			end = min(roundup(start + size, job->align), own->end);
+			own->start = end;
 
-		spin_unlock(&ps->lock);
-		job->thread_fn(start, end, job->fn_arg);
-		spin_lock(&ps->lock);
-	}
-
-	++ps->nworks_fini;
-	done = (ps->nworks_fini == ps->nworks);
-	spin_unlock(&ps->lock);
+			spin_unlock(&own->lock);
+			job->thread_fn(start, end, job->fn_arg);
+			spin_lock(&own->lock);
+		}
+		spin_unlock(&own->lock);
+	} while (padata_mt_steal(ps, own));
 
-	if (done)
+	if (atomic_inc_return(&ps->nworks_fini) == ps->nworks)
 		complete(&ps->completion);
 }
 
@@ -481,12 +519,11 @@ static void __init padata_mt_helper(struct work_struct *w)
  */
 void __init padata_do_multithreaded(struct padata_mt_job *job)
 {
-	/* In case threads finish at different times. */
-	static const unsigned long load_balance_factor = 4;
 	struct padata_work my_work, *pw;
 	struct padata_mt_job_state ps;
+	unsigned long end, per_work;
 	LIST_HEAD(works);
-	int nworks, nid;
+	int nworks, nid, i;
 	static atomic_t last_used_nid __initdata;
 
 	if (job->size == 0)
@@ -496,31 +533,46 @@ void __init padata_do_multithreaded(struct padata_mt_job *job)
 	nworks = max(job->size / max(job->min_chunk, job->align), 1ul);
 	nworks = min(nworks, job->max_threads);
 
-	if (nworks == 1) {
-		/* Single thread, no coordination needed, cut to the chase. */
-		job->thread_fn(job->start, job->start + job->size, job->fn_arg);
-		return;
-	}
+	if (nworks == 1)
+		goto single_thread;
+
+	ps.ranges = kcalloc(nworks, sizeof(*ps.ranges), GFP_KERNEL);
+	if (!ps.ranges)
+		goto single_thread;
 
-	spin_lock_init(&ps.lock);
 	init_completion(&ps.completion);
 	ps.job	       = job;
 	ps.nworks      = padata_work_alloc_mt(nworks, &ps, &works);
-	ps.nworks_fini = 0;
+	atomic_set(&ps.nworks_started, 0);
+	atomic_set(&ps.nworks_fini, 0);
 
 	/*
-	 * Chunk size is the amount of work a helper does per call to the
-	 * thread function.  Load balance large jobs between threads by
-	 * increasing the number of chunks, guarantee at least the minimum
-	 * chunk size from the caller, and honor the caller's alignment.
-	 * Ensure chunk_size is at least 1 to prevent divide-by-0
-	 * panic in padata_mt_helper().
+	 * Chunk size is the smallest amount of work a helper does per call to
+	 * the thread function and the granularity of stealing.  Guarantee at
+	 * least the minimum chunk size from the caller, and honor the
+	 * caller's alignment.  Ensure chunk_size is at least 1 so helpers make
+	 * progress.
 	 */
-	ps.chunk_size = job->size / (ps.nworks * load_balance_factor);
-	ps.chunk_size = max(ps.chunk_size, job->min_chunk);
-	ps.chunk_size = max(ps.chunk_size, 1ul);
+	ps.chunk_size = max(job->min_chunk, 1ul);
 	ps.chunk_size = roundup(ps.chunk_size, job->align);
 
+	/*
+	 * Give each helper an equal, aligned share up front.  Helpers that
+	 * finish early steal from the ones with the most work left instead of
+	 * idling, e.g. when part of the range is backed by remote memory.
+	 */
+	end = job->start + job->size;
+	per_work = job->size / ps.nworks;
+	for (i = 0; i < ps.nworks; ++i) {
+		struct padata_mt_range *r = &ps.ranges[i];
+
+		spin_lock_init(&r->lock);
+		r->start = i ? ps.ranges[i - 1].end : job->start;
+		r->end = i == ps.nworks - 1 ? end :
+			 min(roundup(job->start + (i + 1) * per_work, job->align),
+			     end);
+	}
+
 	list_for_each_entry(pw, &works, pw_list)
 		if (job->numa_aware) {
 			int old_node = atomic_read(&last_used_nid);
@@ -542,6 +594,12 @@ void __init padata_do_multithreaded(struct padata_mt_job *job)
 
 	destroy_work_on_stack(&my_work.pw_work);
 	padata_works_free(&works);
+	kfree(ps.ranges);
+	return;
+
+single_thread:
+	/* Single thread, no coordination needed, cut to the chase. */
+	job->thread_fn(job->start, job->start + job->size, job->fn_arg);
 }
 
 static void __padata_list_init(struct padata_list *pd_list)
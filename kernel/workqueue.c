@@ -51,10 +51,13 @@
 #include <linux/uaccess.h>
 #include <linux/sched/isolation.h>
 #include <linux/sched/debug.h>
+#include <linux/sched/cputime.h>
 #include <linux/nmi.h>
 #include <linux/kvm_para.h>
 #include <linux/delay.h>
 #include <linux/irq_work.h>
+#include <linux/bpf.h>
+#include <linux/btf_ids.h>
 
 #include "workqueue_internal.h"
 
@@ -247,6 +250,21 @@ enum pool_workqueue_stats {
 	PWQ_NR_STATS,
 };
 
+#ifdef CONFIG_WQ_LATENCY_HIST
+#define WQ_HIST_BUCKETS		24
+
+/*
+ * log2 histograms of the time work items spent pending, from being queued to
+ * starting execution, and of the time they executed.  Bucket i counts
+ * [2^i, 2^(i+1)) usecs, the last bucket everything longer.
+ */
+struct wq_latency_hist {
+	u64			pending[WQ_HIST_BUCKETS];
+	u64			exec[WQ_HIST_BUCKETS];
+	u64			slo_missed;	/* pending over latency_slo_us */
+};
+#endif
+
 /*
  * The per-pool workqueue.  While queued, bits below WORK_PWQ_SHIFT
  * of work_struct->data are used for flags and the remaining high bits
@@ -286,6 +304,11 @@ struct pool_workqueue {
 	struct list_head	mayday_node;	/* MD: node on wq->maydays */
 
 	u64			stats[PWQ_NR_STATS];
+#ifdef CONFIG_WQ_LATENCY_HIST
+	struct wq_latency_hist	hist;
+#endif
+	u64			adapt_wall_ns;	/* L: WQ_ADAPTIVE execution time */
+	u64			adapt_cpu_ns;	/* L: WQ_ADAPTIVE CPU time */
 
 	/*
 	 * Release of unbound pwq is punted to a kthread_worker. See put_pwq()
@@ -358,6 +381,16 @@ struct workqueue_struct {
 	struct workqueue_attrs	*unbound_attrs;	/* PW: only for unbound wqs */
 	struct pool_workqueue __rcu *dfl_pwq;   /* PW: only for unbound wqs */
 
+	/* WQ_ADAPTIVE, see wq_adapt_workfn() */
+	struct delayed_work	adapt_work;
+	int			adapt_max_active; /* WQ: 0 if not limiting */
+	u64			adapt_wall_ns;	/* WQ: pwq sums at last sample */
+	u64			adapt_cpu_ns;	/* WQ: pwq sums at last sample */
+
+#ifdef CONFIG_WQ_LATENCY_HIST
+	unsigned int		latency_slo_us;	/* pending delay objective */
+#endif
+
 #ifdef CONFIG_SYSFS
 	struct wq_device	*wq_dev;	/* I: for sysfs interface */
 #endif
@@ -2161,6 +2194,65 @@ static bool work_grab_pending(struct work_struct *work, u32 cflags,
 	}
 }
 
+#ifdef CONFIG_WQ_LATENCY_HIST
+static void wq_hist_add(u64 *hist, u64 ns)
+{
+	unsigned int bucket = ilog2((ns / NSEC_PER_USEC) | 1);
+
+	hist[min(bucket, WQ_HIST_BUCKETS - 1)]++;
+}
+
+static void wq_hist_queued(struct work_struct *work)
+{
+	work->queued_ns = local_clock();
+}
+
+/* returns the start time of execution for wq_hist_completed() */
+static u64 wq_hist_started(struct pool_workqueue *pwq, struct work_struct *work)
+{
+	unsigned int slo_us = READ_ONCE(pwq->wq->latency_slo_us);
+	u64 now = local_clock();
+	u64 delay = now - work->queued_ns;
+
+	wq_hist_add(pwq->hist.pending, delay);
+	if (slo_us && delay > (u64)slo_us * NSEC_PER_USEC)
+		pwq->hist.slo_missed++;
+	return now;
+}
+
+static void wq_hist_completed(struct pool_workqueue *pwq, u64 start)
+{
+	wq_hist_add(pwq->hist.exec, local_clock() - start);
+}
+
+static void __maybe_unused wq_latency_hist_sum(struct workqueue_struct *wq,
+					       struct wq_latency_hist *sum)
+{
+	struct pool_workqueue *pwq;
+	int i;
+
+	memset(sum, 0, sizeof(*sum));
+
+	rcu_read_lock();
+	for_each_pwq(pwq, wq) {
+		for (i = 0; i < WQ_HIST_BUCKETS; i++) {
+			sum->pending[i] += READ_ONCE(pwq->hist.pending[i]);
+			sum->exec[i] += READ_ONCE(pwq->hist.exec[i]);
+		}
+		sum->slo_missed += READ_ONCE(pwq->hist.slo_missed);
+	}
+	rcu_read_unlock();
+}
+#else
+static inline void wq_hist_queued(struct work_struct *work) { }
+static inline u64 wq_hist_started(struct pool_workqueue *pwq,
+				  struct work_struct *work)
+{
+	return 0;
+}
+static inline void wq_hist_completed(struct pool_workqueue *pwq, u64 start) { }
+#endif
+
 /**
  * insert_work - insert a work into a pool
  * @pwq: pwq @work belongs to
@@ -2178,6 +2270,7 @@ static void insert_work(struct pool_workqueue *pwq, struct work_struct *work,
 			struct list_head *head, unsigned int extra_flags)
 {
 	debug_work_activate(work);
+	wq_hist_queued(work);
 
 	/* record the work call stack in order to print it in KASAN reports */
 	kasan_record_aux_stack_noalloc(work);
@@ -3141,6 +3234,7 @@ __acquires(&pool->lock)
 	unsigned long work_data;
 	int lockdep_start_depth, rcu_start_depth;
 	bool bh_draining = pool->flags & POOL_BH_DRAINING;
+	u64 exec_start, adapt_wall = 0, adapt_cpu = 0;
 #ifdef CONFIG_LOCKDEP
 	/*
 	 * It is permissible to free the struct work_struct from
@@ -3202,8 +3296,19 @@ __acquires(&pool->lock)
 	set_work_pool_and_clear_pending(work, pool->id, pool_offq_flags(pool));
 
 	pwq->stats[PWQ_STAT_STARTED]++;
+	exec_start = wq_hist_started(pwq, work);
+	if (unlikely(pwq->wq->flags & WQ_ADAPTIVE))
+		adapt_wall = local_clock();
 	raw_spin_unlock_irq(&pool->lock);
 
+	/*
+	 * se.sum_exec_runtime only advances at ticks and context switches,
+	 * which most work items never see. task_sched_runtime() includes the
+	 * pending delta but takes the rq lock, which nests outside pool->lock.
+	 */
+	if (adapt_wall)
+		adapt_cpu = task_sched_runtime(current);
+
 	rcu_start_depth = rcu_preempt_depth();
 	lockdep_start_depth = lockdep_depth(current);
 	/* see drain_dead_softirq_workfn() */
@@ -3240,6 +3345,7 @@ __acquires(&pool->lock)
 	 */
 	trace_workqueue_execute_end(work, worker->current_func);
 	pwq->stats[PWQ_STAT_COMPLETED]++;
+	wq_hist_completed(pwq, exec_start);
 	lock_map_release(&lockdep_map);
 	if (!bh_draining)
 		lock_map_release(pwq->wq->lockdep_map);
@@ -3268,8 +3374,18 @@ __acquires(&pool->lock)
 	if (worker->task)
 		cond_resched();
 
+	if (adapt_wall) {
+		adapt_cpu = task_sched_runtime(current) - adapt_cpu;
+		adapt_wall = local_clock() - adapt_wall;
+	}
+
 	raw_spin_lock_irq(&pool->lock);
 
+	if (adapt_wall) {
+		pwq->adapt_wall_ns += adapt_wall;
+		pwq->adapt_cpu_ns += adapt_cpu;
+	}
+
 	/*
 	 * In addition to %WQ_CPU_INTENSIVE, @worker may also have been marked
 	 * CPU intensive by wq_worker_tick() if @work hogged CPU longer than
@@ -5610,6 +5726,10 @@ static void wq_adjust_max_active(struct workqueue_struct *wq)
 	} else {
 		new_max = wq->saved_max_active;
 		new_min = wq->saved_min_active;
+		if (wq->adapt_max_active) {
+			new_max = min(new_max, wq->adapt_max_active);
+			new_min = min(new_min, new_max);
+		}
 	}
 
 	if (wq->max_active == new_max && wq->min_active == new_min)
@@ -5652,6 +5772,72 @@ static void wq_adjust_max_active(struct workqueue_struct *wq)
 	} while (activated);
 }
 
+/* WQ_ADAPTIVE sampling period and minimum execution time to act upon */
+#define WQ_ADAPT_INTERVAL	msecs_to_jiffies(100)
+#define WQ_ADAPT_MIN_NS		(10 * NSEC_PER_MSEC)
+
+/*
+ * Work items which block for a fraction of their execution time need
+ * proportionally more concurrency to keep the CPUs of @wq busy while more
+ * than that only adds contention. Periodically compare the wall and CPU time
+ * spent executing work items and cap the effective max_active accordingly.
+ * The allowed CPUs are those of the effective cpumask which is already
+ * bounded by workqueue_unbound_cpumask. @wq->saved_max_active stays the upper
+ * limit.
+ */
+static void wq_adapt_workfn(struct work_struct *work)
+{
+	struct workqueue_struct *wq = container_of(to_delayed_work(work),
+						   struct workqueue_struct,
+						   adapt_work);
+	struct pool_workqueue *pwq;
+	u64 wall = 0, cpu = 0, d_wall, d_cpu;
+	int nr_cpus, target;
+
+	mutex_lock(&wq->mutex);
+	if (!(wq->flags & WQ_ADAPTIVE) || (wq->flags & __WQ_DESTROYING)) {
+		mutex_unlock(&wq->mutex);
+		return;
+	}
+
+	for_each_pwq(pwq, wq) {
+		wall += READ_ONCE(pwq->adapt_wall_ns);
+		cpu += READ_ONCE(pwq->adapt_cpu_ns);
+	}
+
+	/* the sums go backwards when pwqs are replaced, restart from there */
+	d_wall = wall >= wq->adapt_wall_ns ? wall - wq->adapt_wall_ns : wall;
+	d_cpu = cpu >= wq->adapt_cpu_ns ? cpu - wq->adapt_cpu_ns : cpu;
+	wq->adapt_wall_ns = wall;
+	wq->adapt_cpu_ns = cpu;
+
+	if (d_wall >= WQ_ADAPT_MIN_NS) {
+		nr_cpus = cpumask_weight_and(unbound_effective_cpumask(wq),
+					     cpu_online_mask) ?: 1;
+		target = min_t(u64, div64_u64((u64)nr_cpus * d_wall,
+					      max(d_cpu, 1ULL)),
+			       wq->saved_max_active);
+		target = max(target, 1);
+
+		/* ignore small fluctuations */
+		if (abs(target - wq->adapt_max_active) > target / 8) {
+			wq->adapt_max_active = target;
+			wq_adjust_max_active(wq);
+		}
+	}
+	mutex_unlock(&wq->mutex);
+
+	queue_delayed_work(system_unbound_wq, &wq->adapt_work,
+			   WQ_ADAPT_INTERVAL);
+}
+
+/* start sampling for adaptive max_active, called with WQ_ADAPTIVE set */
+static void wq_adapt_start(struct workqueue_struct *wq)
+{
+	queue_delayed_work(system_unbound_wq, &wq->adapt_work,
+			   WQ_ADAPT_INTERVAL);
+}
+
 __printf(1, 0)
 static struct workqueue_struct *__alloc_workqueue(const char *fmt,
 						  unsigned int flags,
@@ -5672,6 +5858,9 @@ static struct workqueue_struct *__alloc_workqueue(const char *fmt,
 	if ((flags & WQ_POWER_EFFICIENT) && wq_power_efficient)
 		flags |= WQ_UNBOUND;
 
+	if (WARN_ON_ONCE((flags & WQ_ADAPTIVE) && !(flags & WQ_UNBOUND)))
+		flags &= ~WQ_ADAPTIVE;
+
 	/* allocate wq and format name */
 	if (flags & WQ_UNBOUND)
 		wq_size = struct_size(wq, node_nr_active, nr_node_ids + 1);
@@ -5717,6 +5906,7 @@ static struct workqueue_struct *__alloc_workqueue(const char *fmt,
 	INIT_LIST_HEAD(&wq->flusher_queue);
 	INIT_LIST_HEAD(&wq->flusher_overflow);
 	INIT_LIST_HEAD(&wq->maydays);
+	INIT_DELAYED_WORK(&wq->adapt_work, wq_adapt_workfn);
 
 	INIT_LIST_HEAD(&wq->list);
 
@@ -5743,6 +5933,9 @@ static struct workqueue_struct *__alloc_workqueue(const char *fmt,
 	if (wq_online && init_rescuer(wq) < 0)
 		goto err_unlock_destroy;
 
+	if (wq_online && (wq->flags & WQ_ADAPTIVE))
+		wq_adapt_start(wq);
+
 	apply_wqattrs_unlock();
 
 	if ((wq->flags & WQ_SYSFS) && workqueue_sysfs_register(wq))
@@ -5852,6 +6045,8 @@ void destroy_workqueue(struct workqueue_struct *wq)
 	wq->flags |= __WQ_DESTROYING;
 	mutex_unlock(&wq->mutex);
 
+	cancel_delayed_work_sync(&wq->adapt_work);
+
 	/* drain it before proceeding with destruction */
 	drain_workqueue(wq);
 
@@ -7028,6 +7223,7 @@ module_param_cb(default_affinity_scope, &wq_affn_dfl_ops, NULL, 0644);
  *  cpumask		RW mask	: bitmask of allowed CPUs for the workers
  *  affinity_scope	RW str  : worker CPU affinity scope (cache, numa, none)
  *  affinity_strict	RW bool : worker CPU affinity is strict
+ *  adaptive		RW bool : max_active adapts to measured CPU usage
  */
 struct wq_device {
 	struct workqueue_struct		*wq;
@@ -7073,9 +7269,58 @@ static ssize_t max_active_store(struct device *dev,
 }
 static DEVICE_ATTR_RW(max_active);
 
+#ifdef CONFIG_WQ_LATENCY_HIST
+static ssize_t latency_hist_show(struct device *dev,
+				 struct device_attribute *attr, char *buf)
+{
+	struct workqueue_struct *wq = dev_to_wq(dev);
+	struct wq_latency_hist hist;
+	int i, len;
+
+	wq_latency_hist_sum(wq, &hist);
+
+	len = sysfs_emit(buf, "pending");
+	for (i = 0; i < WQ_HIST_BUCKETS; i++)
+		len += sysfs_emit_at(buf, len, " %llu", hist.pending[i]);
+	len += sysfs_emit_at(buf, len, "\nexec");
+	for (i = 0; i < WQ_HIST_BUCKETS; i++)
+		len += sysfs_emit_at(buf, len, " %llu", hist.exec[i]);
+	len += sysfs_emit_at(buf, len, "\nslo_missed %llu\n", hist.slo_missed);
+	return len;
+}
+static DEVICE_ATTR_RO(latency_hist);
+
+static ssize_t latency_slo_us_show(struct device *dev,
+				   struct device_attribute *attr, char *buf)
+{
+	struct workqueue_struct *wq = dev_to_wq(dev);
+
+	return sysfs_emit(buf, "%u\n", READ_ONCE(wq->latency_slo_us));
+}
+
+static ssize_t latency_slo_us_store(struct device *dev,
+				    struct device_attribute *attr,
+				    const char *buf, size_t count)
+{
+	struct workqueue_struct *wq = dev_to_wq(dev);
+	unsigned int val;
+
+	if (kstrtouint(buf, 0, &val))
+		return -EINVAL;
+
+	WRITE_ONCE(wq->latency_slo_us, val);
+	return count;
+}
+static DEVICE_ATTR_RW(latency_slo_us);
+#endif
+
 static struct attribute *wq_sysfs_attrs[] = {
 	&dev_attr_per_cpu.attr,
 	&dev_attr_max_active.attr,
+#ifdef CONFIG_WQ_LATENCY_HIST
+	&dev_attr_latency_hist.attr,
+	&dev_attr_latency_slo_us.attr,
+#endif
 	NULL,
 };
 ATTRIBUTE_GROUPS(wq_sysfs);
@@ -7243,11 +7488,51 @@ static ssize_t wq_affinity_strict_store(struct device *dev,
 	return ret ?: count;
 }
 
+static ssize_t wq_adaptive_show(struct device *dev,
+				struct device_attribute *attr, char *buf)
+{
+	struct workqueue_struct *wq = dev_to_wq(dev);
+
+	return scnprintf(buf, PAGE_SIZE, "%d\n", !!(wq->flags & WQ_ADAPTIVE));
+}
+
+static ssize_t wq_adaptive_store(struct device *dev,
+				 struct device_attribute *attr,
+				 const char *buf, size_t count)
+{
+	struct workqueue_struct *wq = dev_to_wq(dev);
+	bool start = false;
+	int v;
+
+	if (sscanf(buf, "%d", &v) != 1)
+		return -EINVAL;
+
+	/* ordered workqueues must stay at max_active of 1 */
+	if (wq->flags & __WQ_ORDERED)
+		return -EINVAL;
+
+	mutex_lock(&wq->mutex);
+	if (v && !(wq->flags & WQ_ADAPTIVE)) {
+		wq->flags |= WQ_ADAPTIVE;
+		start = true;
+	} else if (!v && (wq->flags & WQ_ADAPTIVE)) {
+		wq->flags &= ~WQ_ADAPTIVE;
+		wq->adapt_max_active = 0;
+		wq_adjust_max_active(wq);
+	}
+	mutex_unlock(&wq->mutex);
+
+	if (start)
+		wq_adapt_start(wq);
+	return count;
+}
+
 static struct device_attribute wq_sysfs_unbound_attrs[] = {
 	__ATTR(nice, 0644, wq_nice_show, wq_nice_store),
 	__ATTR(cpumask, 0644, wq_cpumask_show, wq_cpumask_store),
 	__ATTR(affinity_scope, 0644, wq_affn_scope_show, wq_affn_scope_store),
 	__ATTR(affinity_strict, 0644, wq_affinity_strict_show, wq_affinity_strict_store),
+	__ATTR(adaptive, 0644, wq_adaptive_show, wq_adaptive_store),
 	__ATTR_NULL,
 };
 
@@ -7448,6 +7733,103 @@ static void workqueue_sysfs_unregister(struct workqueue_struct *wq)
 static void workqueue_sysfs_unregister(struct workqueue_struct *wq)	{ }
 #endif	/* CONFIG_SYSFS */
 
+#if defined(CONFIG_WQ_LATENCY_HIST) && defined(CONFIG_BPF_SYSCALL)
+/*
+ * BPF iterator over all workqueues.  @hist holds the latency histograms of
+ * @wq summed over its pwqs.
+ */
+struct bpf_iter__workqueue {
+	__bpf_md_ptr(struct bpf_iter_meta *, meta);
+	__bpf_md_ptr(struct workqueue_struct *, wq);
+	__bpf_md_ptr(struct wq_latency_hist *, hist);
+};
+
+static void *bpf_iter_wq_seq_start(struct seq_file *seq, loff_t *pos)
+{
+	mutex_lock(&wq_pool_mutex);
+	return seq_list_start(&workqueues, *pos);
+}
+
+static void *bpf_iter_wq_seq_next(struct seq_file *seq, void *v, loff_t *pos)
+{
+	return seq_list_next(v, &workqueues, pos);
+}
+
+static int wq_prog_seq_show(struct seq_file *seq, struct list_head *v,
+			    bool in_stop)
+{
+	struct wq_latency_hist *hist = seq->private;
+	struct bpf_iter__workqueue ctx;
+	struct bpf_iter_meta meta;
+	struct bpf_prog *prog;
+
+	meta.seq = seq;
+	prog = bpf_iter_get_info(&meta, in_stop);
+	if (!prog)
+		return 0;
+
+	ctx.meta = &meta;
+	ctx.wq = v ? list_entry(v, struct workqueue_struct, list) : NULL;
+	ctx.hist = NULL;
+	if (ctx.wq) {
+		wq_latency_hist_sum(ctx.wq, hist);
+		ctx.hist = hist;
+	}
+	return bpf_iter_run_prog(prog, &ctx);
+}
+
+static int bpf_iter_wq_seq_show(struct seq_file *seq, void *v)
+{
+	return wq_prog_seq_show(seq, v, false);
+}
+
+static void bpf_iter_wq_seq_stop(struct seq_file *seq, void *v)
+{
+	if (!v)
+		(void)wq_prog_seq_show(seq, NULL, true);
+	mutex_unlock(&wq_pool_mutex);
+}
+
+static const struct seq_operations bpf_iter_wq_seq_ops = {
+	.start	= bpf_iter_wq_seq_start,
+	.next	= bpf_iter_wq_seq_next,
+	.stop	= bpf_iter_wq_seq_stop,
+	.show	= bpf_iter_wq_seq_show,
+};
+
+DEFINE_BPF_ITER_FUNC(workqueue, struct bpf_iter_meta *meta,
+		     struct workqueue_struct *wq, struct wq_latency_hist *hist)
+
+static const struct bpf_iter_seq_info wq_iter_seq_info = {
+	.seq_ops		= &bpf_iter_wq_seq_ops,
+	.seq_priv_size		= sizeof(struct wq_latency_hist),
+};
+
+static struct bpf_iter_reg wq_iter_reg_info = {
+	.target			= "workqueue",
+	.ctx_arg_info_size	= 2,
+	.ctx_arg_info		= {
+		{ offsetof(struct bpf_iter__workqueue, wq),
+		  PTR_TO_BTF_ID_OR_NULL },
+		{ offsetof(struct bpf_iter__workqueue, hist),
+		  PTR_TO_BTF_ID_OR_NULL },
+	},
+	.seq_info		= &wq_iter_seq_info,
+};
+
+BTF_ID_LIST(btf_wq_iter_ids)
+BTF_ID(struct, workqueue_struct)
+BTF_ID(struct, wq_latency_hist)
+
+static int __init bpf_wq_iter_register(void)
+{
+	wq_iter_reg_info.ctx_arg_info[0].btf_id = btf_wq_iter_ids[0];
+	wq_iter_reg_info.ctx_arg_info[1].btf_id = btf_wq_iter_ids[1];
+	return bpf_iter_reg_target(&wq_iter_reg_info);
+}
+late_initcall(bpf_wq_iter_register);
+#endif	/* CONFIG_WQ_LATENCY_HIST && CONFIG_BPF_SYSCALL */
+
 /*
  * Workqueue watchdog.
  *
@@ -7908,6 +8290,8 @@ void __init workqueue_init(void)
 		WARN(init_rescuer(wq),
 		     "workqueue: failed to create early rescuer for %s",
 		     wq->name);
+		if (wq->flags & WQ_ADAPTIVE)
+			wq_adapt_start(wq);
 	}
 
 	mutex_unlock(&wq_pool_mutex);
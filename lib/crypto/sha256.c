@@ -131,6 +131,80 @@ static void sha256_transform_blocks(struct sha256_state *sctx,
 	memzero_explicit(W, sizeof(W));
 }
 
+/*
+ * Two independent messages are hashed by interleaving their rounds, which
+ * gives the CPU two dependency chains to schedule instead of one.
+ */
+#define SHA256_ROUND_2X(i, a, b, c, d, e, f, g, h) do {		\
+	u32 t1, t2, u1, u2;					\
+	t1 = h##x + e1(e##x) + Ch(e##x, f##x, g##x) + SHA256_K[i] + W1[i]; \
+	u1 = h##y + e1(e##y) + Ch(e##y, f##y, g##y) + SHA256_K[i] + W2[i]; \
+	t2 = e0(a##x) + Maj(a##x, b##x, c##x);			\
+	u2 = e0(a##y) + Maj(a##y, b##y, c##y);			\
+	d##x += t1;						\
+	d##y += u1;						\
+	h##x = t1 + t2;						\
+	h##y = u1 + u2;						\
+} while (0)
+
+static void sha256_transform_2x(u32 *state1, u32 *state2,
+				const u8 *input1, const u8 *input2,
+				u32 *W1, u32 *W2)
+{
+	u32 ax, bx, cx, dx, ex, fx, gx, hx;
+	u32 ay, by, cy, dy, ey, fy, gy, hy;
+	int i;
+
+	for (i = 0; i < 16; i++) {
+		LOAD_OP(i, W1, input1);
+		LOAD_OP(i, W2, input2);
+	}
+
+	for (i = 16; i < 64; i++) {
+		BLEND_OP(i, W1);
+		BLEND_OP(i, W2);
+	}
+
+	ax = state1[0];  bx = state1[1];  cx = state1[2];  dx = state1[3];
+	ex = state1[4];  fx = state1[5];  gx = state1[6];  hx = state1[7];
+	ay = state2[0];  by = state2[1];  cy = state2[2];  dy = state2[3];
+	ey = state2[4];  fy = state2[5];  gy = state2[6];  hy = state2[7];
+
+	for (i = 0; i < 64; i += 8) {
+		SHA256_ROUND_2X(i + 0, a, b, c, d, e, f, g, h);
+		SHA256_ROUND_2X(i + 1, h, a, b, c, d, e, f, g);
+		SHA256_ROUND_2X(i + 2, g, h, a, b, c, d, e, f);
+		SHA256_ROUND_2X(i + 3, f, g, h, a, b, c, d, e);
+		SHA256_ROUND_2X(i + 4, e, f, g, h, a, b, c, d);
+		SHA256_ROUND_2X(i + 5, d, e, f, g, h, a, b, c);
+		SHA256_ROUND_2X(i + 6, c, d, e, f, g, h, a, b);
+		SHA256_ROUND_2X(i + 7, b, c, d, e, f, g, h, a);
+	}
+
+	state1[0] += ax; state1[1] += bx; state1[2] += cx; state1[3] += dx;
+	state1[4] += ex; state1[5] += fx; state1[6] += gx; state1[7] += hx;
+	state2[0] += ay; state2[1] += by; state2[2] += cy; state2[3] += dy;
+	state2[4] += ey; state2[5] += fy; state2[6] += gy; state2[7] += hy;
+}
+
+static void sha256_transform_blocks_2x(struct sha256_state *sctx1,
+				       struct sha256_state *sctx2,
+				       const u8 *input1, const u8 *input2,
+				       int blocks)
+{
+	u32 W1[64], W2[64];
+
+	do {
+		sha256_transform_2x(sctx1->state, sctx2->state,
+				    input1, input2, W1, W2);
+		input1 += SHA256_BLOCK_SIZE;
+		input2 += SHA256_BLOCK_SIZE;
+	} while (--blocks);
+
+	memzero_explicit(W1, sizeof(W1));
+	memzero_explicit(W2, sizeof(W2));
+}
+
 void sha256_update(struct sha256_state *sctx, const u8 *data, unsigned int len)
 {
 	lib_sha256_base_do_update(sctx, data, len, sha256_transform_blocks);
@@ -155,6 +229,94 @@ void sha224_final(struct sha256_state *sctx, u8 *out)
 }
 EXPORT_SYMBOL(sha224_final);
 
+static void __sha256_finup_2x(const struct sha256_state *sctx,
+			      const u8 *data1, const u8 *data2,
+			      unsigned int len, u8 *out1, u8 *out2,
+			      int digest_size)
+{
+	const int bit_offset = SHA256_BLOCK_SIZE - sizeof(__be64);
+	struct sha256_state sctx1 = *sctx, sctx2 = *sctx;
+	unsigned int partial = sctx->count % SHA256_BLOCK_SIZE;
+	unsigned int blocks;
+
+	/* Top up a partially filled buffer one message at a time */
+	if (partial) {
+		unsigned int fill = min(len, SHA256_BLOCK_SIZE - partial);
+
+		sha256_update(&sctx1, data1, fill);
+		sha256_update(&sctx2, data2, fill);
+		data1 += fill;
+		data2 += fill;
+		len -= fill;
+	}
+
+	blocks = len / SHA256_BLOCK_SIZE;
+	if (blocks) {
+		sha256_transform_blocks_2x(&sctx1, &sctx2, data1, data2,
+					   blocks);
+		sctx1.count += blocks * SHA256_BLOCK_SIZE;
+		sctx2.count += blocks * SHA256_BLOCK_SIZE;
+		data1 += blocks * SHA256_BLOCK_SIZE;
+		data2 += blocks * SHA256_BLOCK_SIZE;
+		len %= SHA256_BLOCK_SIZE;
+	}
+
+	/* Both buffers now hold the same number of bytes: pad them together */
+	partial = sctx1.count % SHA256_BLOCK_SIZE;
+	memcpy(sctx1.buf + partial, data1, len);
+	memcpy(sctx2.buf + partial, data2, len);
+	sctx1.count += len;
+	sctx2.count += len;
+	partial += len;
+
+	sctx1.buf[partial] = 0x80;
+	sctx2.buf[partial] = 0x80;
+	partial++;
+	if (partial > bit_offset) {
+		memset(sctx1.buf + partial, 0x0, SHA256_BLOCK_SIZE - partial);
+		memset(sctx2.buf + partial, 0x0, SHA256_BLOCK_SIZE - partial);
+		partial = 0;
+
+		sha256_transform_blocks_2x(&sctx1, &sctx2, sctx1.buf,
+					   sctx2.buf, 1);
+	}
+
+	memset(sctx1.buf + partial, 0x0, bit_offset - partial);
+	memset(sctx2.buf + partial, 0x0, bit_offset - partial);
+	put_unaligned_be64(sctx1.count << 3, sctx1.buf + bit_offset);
+	put_unaligned_be64(sctx2.count << 3, sctx2.buf + bit_offset);
+	sha256_transform_blocks_2x(&sctx1, &sctx2, sctx1.buf, sctx2.buf, 1);
+
+	lib_sha256_base_finish(&sctx1, out1, digest_size);
+	lib_sha256_base_finish(&sctx2, out2, digest_size);
+}
+
+/**
+ * sha256_finup_2x() - finish hashing two equal-length messages at once
+ * @sctx: state shared by both messages so far; it is not modified
+ * @data1: remaining data of the first message
+ * @data2: remaining data of the second message
+ * @len: length of @data1 and of @data2 in bytes
+ * @out1: digest of the first message
+ * @out2: digest of the second message
+ *
+ * Same result as two sha256_update()/sha256_final() sequences on copies of
+ * @sctx, but the block function processes both messages interleaved.
+ */
+void sha256_finup_2x(const struct sha256_state *sctx, const u8 *data1,
+		     const u8 *data2, unsigned int len, u8 *out1, u8 *out2)
+{
+	__sha256_finup_2x(sctx, data1, data2, len, out1, out2, 32);
+}
+EXPORT_SYMBOL(sha256_finup_2x);
+
+void sha224_finup_2x(const struct sha256_state *sctx, const u8 *data1,
+		     const u8 *data2, unsigned int len, u8 *out1, u8 *out2)
+{
+	__sha256_finup_2x(sctx, data1, data2, len, out1, out2, 28);
+}
+EXPORT_SYMBOL(sha224_finup_2x);
+
 void sha256(const u8 *data, unsigned int len, u8 *out)
 {
 	struct sha256_state sctx;
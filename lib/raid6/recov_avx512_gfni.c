@@ -0,0 +1,273 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * RAID-6 data recovery in dual failure mode based on the AVX512 GFNI
+ * GF2P8AFFINEQB instruction, which multiplies each byte by a constant
+ * in one step instead of the two nibble table lookups of recov_avx512.c.
+ */
+
+#if defined(CONFIG_AS_AVX512) && defined(CONFIG_AS_GFNI)
+
+#include <linux/raid/pq.h>
+#include "x86.h"
+
+static int raid6_has_avx512_gfni(void)
+{
+	return boot_cpu_has(X86_FEATURE_AVX2) &&
+		boot_cpu_has(X86_FEATURE_AVX) &&
+		boot_cpu_has(X86_FEATURE_AVX512F) &&
+		boot_cpu_has(X86_FEATURE_AVX512BW) &&
+		boot_cpu_has(X86_FEATURE_AVX512VL) &&
+		boot_cpu_has(X86_FEATURE_AVX512DQ) &&
+		boot_cpu_has(X86_FEATURE_GFNI);
+}
+
+/*
+ * GF2P8AFFINEQB bit matrix multiplying by the constant whose product
+ * table is @mul: byte 7 - i of the matrix selects the input bits which
+ * make up bit i of the product.
+ */
+static u64 raid6_gfni_matrix(const u8 *mul)
+{
+	u64 m = 0;
+	int i, j;
+
+	for (i = 0; i < 8; i++) {
+		u8 row = 0;
+
+		for (j = 0; j < 8; j++)
+			row |= ((mul[1 << j] >> i) & 1) << j;
+		m |= (u64)row << (8 * (7 - i));
+	}
+	return m;
+}
+
+static void raid6_2data_recov_avx512_gfni(int disks, size_t bytes, int faila,
+					  int failb, void **ptrs)
+{
+	u8 *p, *q, *dp, *dq;
+	u64 pbmat;		/* P multiplier matrix for B data */
+	u64 qmat;		/* Q multiplier matrix (for both) */
+
+	p = (u8 *)ptrs[disks-2];
+	q = (u8 *)ptrs[disks-1];
+
+	/*
+	 * Compute syndrome with zero for the missing data pages
+	 * Use the dead data pages as temporary storage for
+	 * delta p and delta q
+	 */
+	dp = (u8 *)ptrs[faila];
+	ptrs[faila] = (void *)raid6_empty_zero_page;
+	ptrs[disks-2] = dp;
+	dq = (u8 *)ptrs[failb];
+	ptrs[failb] = (void *)raid6_empty_zero_page;
+	ptrs[disks-1] = dq;
+
+	raid6_call.gen_syndrome(disks, bytes, ptrs);
+
+	/* Restore pointer table */
+	ptrs[faila]   = dp;
+	ptrs[failb]   = dq;
+	ptrs[disks-2] = p;
+	ptrs[disks-1] = q;
+
+	/* Now, pick the proper data matrices */
+	pbmat = raid6_gfni_matrix(raid6_gfmul[raid6_gfexi[failb-faila]]);
+	qmat  = raid6_gfni_matrix(raid6_gfmul[raid6_gfinv[raid6_gfexp[faila] ^
+					      raid6_gfexp[failb]]]);
+
+	kernel_fpu_begin();
+
+	asm volatile("vpbroadcastq %0, %%zmm6\n\t"
+		     "vpbroadcastq %1, %%zmm7"
+		     :
+		     : "m" (pbmat), "m" (qmat));
+
+	while (bytes) {
+#ifdef CONFIG_X86_64
+		asm volatile("vmovdqa64 %0, %%zmm1\n\t"
+			     "vmovdqa64 %1, %%zmm9\n\t"
+			     "vmovdqa64 %2, %%zmm0\n\t"
+			     "vmovdqa64 %3, %%zmm8\n\t"
+			     "vpxorq %4, %%zmm1, %%zmm1\n\t"
+			     "vpxorq %5, %%zmm9, %%zmm9\n\t"
+			     "vpxorq %6, %%zmm0, %%zmm0\n\t"
+			     "vpxorq %7, %%zmm8, %%zmm8"
+			     :
+			     : "m" (q[0]), "m" (q[64]), "m" (p[0]),
+			       "m" (p[64]), "m" (dq[0]), "m" (dq[64]),
+			       "m" (dp[0]), "m" (dp[64]));
+
+		/*
+		 * 1 = dq[0]  ^ q[0]
+		 * 9 = dq[64] ^ q[64]
+		 * 0 = dp[0]  ^ p[0]
+		 * 8 = dp[64] ^ p[64]
+		 */
+
+		asm volatile("vgf2p8affineqb $0, %%zmm7, %%zmm1, %%zmm1\n\t"
+			     "vgf2p8affineqb $0, %%zmm7, %%zmm9, %%zmm9\n\t"
+			     "vgf2p8affineqb $0, %%zmm6, %%zmm0, %%zmm2\n\t"
+			     "vgf2p8affineqb $0, %%zmm6, %%zmm8, %%zmm10\n\t"
+			     "vpxorq %%zmm2, %%zmm1, %%zmm1\n\t"
+			     "vpxorq %%zmm10, %%zmm9, %%zmm9\n\t"
+			     "vpxorq %%zmm1, %%zmm0, %%zmm0\n\t"
+			     "vpxorq %%zmm9, %%zmm8, %%zmm8"
+			     :
+			     : );
+
+		/*
+		 * 1 = db = DQ = qmul[qx] ^ pbmul[px]
+		 * 0 = db ^ px = DP
+		 */
+
+		asm volatile("vmovdqa64 %%zmm1, %0\n\t"
+			     "vmovdqa64 %%zmm9, %1\n\t"
+			     "vmovdqa64 %%zmm0, %2\n\t"
+			     "vmovdqa64 %%zmm8, %3"
+			     :
+			     : "m" (dq[0]), "m" (dq[64]), "m" (dp[0]),
+			       "m" (dp[64]));
+
+		bytes -= 128;
+		p += 128;
+		q += 128;
+		dp += 128;
+		dq += 128;
+#else
+		asm volatile("vmovdqa64 %0, %%zmm1\n\t"
+			     "vmovdqa64 %1, %%zmm0\n\t"
+			     "vpxorq %2, %%zmm1, %%zmm1\n\t"
+			     "vpxorq %3, %%zmm0, %%zmm0"
+			     :
+			     : "m" (*q), "m" (*p), "m" (*dq), "m" (*dp));
+
+		/* 1 = dq ^ q;  0 = dp ^ p */
+
+		asm volatile("vgf2p8affineqb $0, %%zmm7, %%zmm1, %%zmm1\n\t"
+			     "vgf2p8affineqb $0, %%zmm6, %%zmm0, %%zmm2\n\t"
+			     "vpxorq %%zmm2, %%zmm1, %%zmm1\n\t"
+			     "vpxorq %%zmm1, %%zmm0, %%zmm0"
+			     :
+			     : );
+
+		/* 1 = db = DQ;  0 = db ^ px = DP */
+
+		asm volatile("vmovdqa64 %%zmm1, %0\n\t"
+			     "vmovdqa64 %%zmm0, %1"
+			     :
+			     : "m" (dq[0]), "m" (dp[0]));
+
+		bytes -= 64;
+		p += 64;
+		q += 64;
+		dp += 64;
+		dq += 64;
+#endif
+	}
+
+	kernel_fpu_end();
+}
+
+static void raid6_datap_recov_avx512_gfni(int disks, size_t bytes, int faila,
+					  void **ptrs)
+{
+	u8 *p, *q, *dq;
+	u64 qmat;		/* Q multiplier matrix */
+
+	p = (u8 *)ptrs[disks-2];
+	q = (u8 *)ptrs[disks-1];
+
+	/*
+	 * Compute syndrome with zero for the missing data page
+	 * Use the dead data page as temporary storage for delta q
+	 */
+	dq = (u8 *)ptrs[faila];
+	ptrs[faila] = (void *)raid6_empty_zero_page;
+	ptrs[disks-1] = dq;
+
+	raid6_call.gen_syndrome(disks, bytes, ptrs);
+
+	/* Restore pointer table */
+	ptrs[faila]   = dq;
+	ptrs[disks-1] = q;
+
+	/* Now, pick the proper data matrix */
+	qmat = raid6_gfni_matrix(raid6_gfmul[raid6_gfinv[raid6_gfexp[faila]]]);
+
+	kernel_fpu_begin();
+
+	asm volatile("vpbroadcastq %0, %%zmm7" : : "m" (qmat));
+
+	while (bytes) {
+#ifdef CONFIG_X86_64
+		asm volatile("vmovdqa64 %0, %%zmm3\n\t"
+			     "vmovdqa64 %1, %%zmm8\n\t"
+			     "vpxorq %2, %%zmm3, %%zmm3\n\t"
+			     "vpxorq %3, %%zmm8, %%zmm8\n\t"
+			     "vgf2p8affineqb $0, %%zmm7, %%zmm3, %%zmm3\n\t"
+			     "vgf2p8affineqb $0, %%zmm7, %%zmm8, %%zmm8"
+			     :
+			     : "m" (dq[0]), "m" (dq[64]), "m" (q[0]),
+			       "m" (q[64]));
+
+		/*
+		 * 3 = qmul[q[0]  ^ dq[0]]
+		 * 8 = qmul[q[64] ^ dq[64]]
+		 */
+
+		asm volatile("vmovdqa64 %0, %%zmm2\n\t"
+			     "vmovdqa64 %1, %%zmm12\n\t"
+			     "vpxorq %%zmm3, %%zmm2, %%zmm2\n\t"
+			     "vpxorq %%zmm8, %%zmm12, %%zmm12\n\t"
+			     "vmovdqa64 %%zmm3, %2\n\t"
+			     "vmovdqa64 %%zmm8, %3\n\t"
+			     "vmovdqa64 %%zmm2, %0\n\t"
+			     "vmovdqa64 %%zmm12, %1"
+			     :
+			     : "m" (p[0]), "m" (p[64]), "m" (dq[0]),
+			       "m" (dq[64]));
+
+		bytes -= 128;
+		p += 128;
+		q += 128;
+		dq += 128;
+#else
+		asm volatile("vmovdqa64 %0, %%zmm3\n\t"
+			     "vpxorq %1, %%zmm3, %%zmm3\n\t"
+			     "vgf2p8affineqb $0, %%zmm7, %%zmm3, %%zmm3"
+			     :
+			     : "m" (dq[0]), "m" (q[0]));
+
+		/* 3 = qmul[q ^ dq] */
+
+		asm volatile("vmovdqa64 %0, %%zmm2\n\t"
+			     "vpxorq %%zmm3, %%zmm2, %%zmm2\n\t"
+			     "vmovdqa64 %%zmm3, %1\n\t"
+			     "vmovdqa64 %%zmm2, %0"
+			     :
+			     : "m" (p[0]), "m" (dq[0]));
+
+		bytes -= 64;
+		p += 64;
+		q += 64;
+		dq += 64;
+#endif
+	}
+
+	kernel_fpu_end();
+}
+
+const struct raid6_recov_calls raid6_recov_avx512_gfni = {
+	.data2 = raid6_2data_recov_avx512_gfni,
+	.datap = raid6_datap_recov_avx512_gfni,
+	.valid = raid6_has_avx512_gfni,
+#ifdef CONFIG_X86_64
+	.name = "avx512gfnix2",
+#else
+	.name = "avx512gfnix1",
+#endif
+	.priority = 4,
+};
+
+#endif /* CONFIG_AS_AVX512 && CONFIG_AS_GFNI */
@@ -51,6 +51,7 @@ static inline void kernel_fpu_end(void)
 #define X86_FEATURE_AVX512VL    (9*32+31) /* AVX-512 VL (128/256 Vector Length)
 					   * Extensions
 					   */
+#define X86_FEATURE_GFNI	(16*32+ 8) /* Galois Field New Instructions */
 #define X86_FEATURE_MMXEXT	(1*32+22) /* AMD MMX extensions */
 
 /* Should work well enough on modern CPUs for testing */
@@ -58,14 +59,14 @@ static inline int boot_cpu_has(int flag)
 {
 	u32 eax, ebx, ecx, edx;
 
-	eax = (flag & 0x100) ? 7 :
+	eax = (flag & 0x300) ? 7 :
 		(flag & 0x20) ? 0x80000001 : 1;
 	ecx = 0;
 
 	asm volatile("cpuid"
 		     : "+a" (eax), "=b" (ebx), "=d" (edx), "+c" (ecx));
 
-	return ((flag & 0x100 ? ebx :
+	return ((flag & 0x200 ? ecx : flag & 0x100 ? ebx :
 		(flag & 0x80) ? ecx : edx) >> (flag & 31)) & 1;
 }
 
@@ -649,6 +649,62 @@ void *rhashtable_insert_slow(struct rhashtable *ht, const void *key,
 }
 EXPORT_SYMBOL_GPL(rhashtable_insert_slow);
 
+/**
+ * rhashtable_reserve - size a hash table ahead of a bulk insertion
+ * @ht:		the hash table
+ * @nelem:	number of elements about to be inserted
+ *
+ * Resizes @ht once, so that its current elements plus @nelem fit without
+ * crossing the 75% growth threshold, instead of letting the deferred
+ * worker double the table again and again while they are inserted.
+ * Lookups, insertions and removals may run concurrently.
+ *
+ * Must be called from process context. Returns 0 on success, -ENOMEM if
+ * the larger bucket table could not be allocated. The table is left
+ * usable at its current size in that case.
+ */
+int rhashtable_reserve(struct rhashtable *ht, unsigned int nelem)
+{
+	unsigned long nelems = atomic_read(&ht->nelems) + (unsigned long)nelem;
+	struct bucket_table *tbl;
+	unsigned long size;
+	int err = 0;
+
+	size = roundup_pow_of_two(nelems * 4 / 3 + 1);
+	if (ht->p.max_size && size > ht->p.max_size)
+		size = ht->p.max_size;
+
+	mutex_lock(&ht->mutex);
+
+	do {
+		tbl = rhashtable_last_table(ht, rht_dereference(ht->tbl, ht));
+		if (tbl->size >= size)
+			break;
+
+		/* Raced with an atomic-context rehash, size on top of it */
+		err = rhashtable_rehash_alloc(ht, tbl, size);
+	} while (err == -EEXIST);
+
+	if (!err) {
+		/* Keep going while each pass publishes a new table */
+		do {
+			tbl = rht_dereference(ht->tbl, ht);
+			err = rhashtable_rehash_table(ht);
+		} while (err == -EAGAIN && rht_dereference(ht->tbl, ht) != tbl);
+
+		/* Leave what is left of the rehash to the worker */
+		if (err) {
+			schedule_work(&ht->run_work);
+			err = 0;
+		}
+	}
+
+	mutex_unlock(&ht->mutex);
+
+	return err;
+}
+EXPORT_SYMBOL_GPL(rhashtable_reserve);
+
 /**
  * rhashtable_walk_enter - Initialise an iterator
  * @ht:		Table to walk over
@@ -8,6 +8,25 @@
 #include <linux/random.h>
 #include <linux/sbitmap.h>
 #include <linux/seq_file.h>
+#include <linux/topology.h>
+
+/*
+ * Pick a random starting bit for @cpu within the slice of the map that
+ * belongs to its NUMA node, so that CPUs of one node mostly share words
+ * among themselves instead of bouncing them across nodes. Maps with less
+ * than one word per node are spread over their whole depth.
+ */
+static unsigned int sbitmap_random_hint(struct sbitmap *sb, int cpu,
+					unsigned int depth)
+{
+	unsigned int span = depth / nr_node_ids;
+	int node = cpu_to_node(cpu);
+
+	if (nr_node_ids > 1 && node >= 0 && span >= (1U << sb->shift))
+		return node * span + get_random_u32_below(span);
+
+	return get_random_u32_below(depth);
+}
 
 static int init_alloc_hint(struct sbitmap *sb, gfp_t flags)
 {
@@ -21,7 +40,8 @@ static int init_alloc_hint(struct sbitmap *sb, gfp_t flags)
 		int i;
 
 		for_each_possible_cpu(i)
-			*per_cpu_ptr(sb->alloc_hint, i) = get_random_u32_below(depth);
+			*per_cpu_ptr(sb->alloc_hint, i) =
+				sbitmap_random_hint(sb, i, depth);
 	}
 	return 0;
 }
@@ -33,7 +53,8 @@ static inline unsigned update_alloc_hint_before_get(struct sbitmap *sb,
 
 	hint = this_cpu_read(*sb->alloc_hint);
 	if (unlikely(hint >= depth)) {
-		hint = depth ? get_random_u32_below(depth) : 0;
+		hint = depth ? sbitmap_random_hint(sb, raw_smp_processor_id(),
+						   depth) : 0;
 		this_cpu_write(*sb->alloc_hint, hint);
 	}
 
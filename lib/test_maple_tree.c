@@ -48,6 +48,8 @@ atomic_t maple_tree_tests_passed;
 /* #define BENCH_FORK */
 /* #define BENCH_MAS_FOR_EACH */
 /* #define BENCH_MAS_PREV */
+/* #define BENCH_SEQ_LOAD */
+/* #define BENCH_BULK_LOAD */
 
 #ifdef __KERNEL__
 #define mt_set_non_kernel(x)		do {} while (0)
@@ -2082,6 +2084,46 @@ static noinline void __init check_mas_store_gfp(struct maple_tree *mt)
 	mtree_destroy(&newmt);
 }
 
+#if defined(BENCH_SEQ_LOAD) || defined(BENCH_BULK_LOAD)
+/* Build a tree from sorted ranges, optionally in bulk mode */
+static noinline void __init bench_load_sorted(bool bulk)
+{
+	struct maple_tree mt;
+	int i, j, nr_entries = 1000, nr_loops = 20000, ret;
+	MA_STATE(mas, &mt, 0, 0);
+	struct rw_semaphore mt_lock;
+
+	init_rwsem(&mt_lock);
+
+	for (i = 0; i < nr_loops; i++) {
+		mt_init_flags(&mt, MT_FLAGS_ALLOC_RANGE | MT_FLAGS_LOCK_EXTERN);
+		mt_set_external_lock(&mt, &mt_lock);
+
+		down_write(&mt_lock);
+		mas_set(&mas, 0);
+		if (bulk) {
+			ret = mas_expected_entries(&mas, nr_entries);
+			if (ret) {
+				pr_err("OOM!");
+				BUG_ON(1);
+			}
+		}
+
+		for (j = 0; j < nr_entries; j++) {
+			mas_set_range(&mas, j * 10, j * 10 + 5);
+			if (bulk)
+				mas_store(&mas, xa_mk_value(j));
+			else
+				mas_store_gfp(&mas, xa_mk_value(j), GFP_KERNEL);
+		}
+
+		mas_destroy(&mas);
+		__mt_destroy(&mt);
+		up_write(&mt_lock);
+	}
+}
+#endif
+
 #if defined(BENCH_FORK)
 static noinline void __init bench_forking(void)
 {
@@ -3774,6 +3816,16 @@ static int __init maple_tree_seed(void)
 	bench_forking();
 	goto skip;
 #endif
+#if defined(BENCH_SEQ_LOAD)
+#define BENCH
+	bench_load_sorted(false);
+	goto skip;
+#endif
+#if defined(BENCH_BULK_LOAD)
+#define BENCH
+	bench_load_sorted(true);
+	goto skip;
+#endif
 #if defined(BENCH_MT_FOR_EACH)
 #define BENCH
 	mt_init_flags(&tree, MT_FLAGS_ALLOC_RANGE);
@@ -55,6 +55,10 @@ static bool enomem_retry = false;
 module_param(enomem_retry, bool, 0);
 MODULE_PARM_DESC(enomem_retry, "Retry insert even if -ENOMEM was returned (default: off)");
 
+static bool reserve = false;
+module_param(reserve, bool, 0);
+MODULE_PARM_DESC(reserve, "Size the table for all entries before adding them (default: off)");
+
 struct test_obj_val {
 	int	id;
 	int	tid;
@@ -220,6 +224,11 @@ static s64 __init test_rhashtable(struct rhashtable *ht, struct test_obj *array,
 	 */
 	pr_info("  Adding %d keys\n", entries);
 	start = ktime_get_ns();
+	if (reserve) {
+		err = rhashtable_reserve(ht, entries);
+		if (err)
+			return err;
+	}
 	for (i = 0; i < entries; i++) {
 		struct test_obj *obj = &array[i];
 
@@ -690,9 +690,18 @@ static void damos_commit_quota_goal(
 {
 	dst->metric = src->metric;
 	dst->target_value = src->target_value;
-	if (dst->metric == DAMOS_QUOTA_USER_INPUT)
+	switch (dst->metric) {
+	case DAMOS_QUOTA_USER_INPUT:
 		dst->current_value = src->current_value;
-	/* keep last_psi_total as is, since it will be updated in next cycle */
+		break;
+	case DAMOS_QUOTA_NODE_MEM_USED_BP:
+	case DAMOS_QUOTA_NODE_MEM_FREE_BP:
+		dst->nid = src->nid;
+		break;
+	default:
+		/* keep last_psi_total as is, it will be updated next cycle */
+		break;
+	}
 }
 
 /**
@@ -726,6 +735,7 @@ int damos_commit_quota_goals(struct damos_quota *dst, struct damos_quota *src)
 				src_goal->metric, src_goal->target_value);
 		if (!new_goal)
 			return -ENOMEM;
+		damos_commit_quota_goal(new_goal, src_goal);
 		damos_add_quota_goal(dst, new_goal);
 	}
 	return 0;
@@ -1510,6 +1520,32 @@ static inline u64 damos_get_some_mem_psi_total(void)
 
 #endif	/* CONFIG_PSI */
 
+#ifdef CONFIG_NUMA
+static unsigned long damos_get_node_mem_bp(struct damos_quota_goal *goal)
+{
+	struct sysinfo i;
+	unsigned long numerator;
+
+	if (goal->nid < 0 || goal->nid >= MAX_NUMNODES ||
+			!node_state(goal->nid, N_MEMORY))
+		return 0;
+
+	si_meminfo_node(&i, goal->nid);
+	if (!i.totalram)
+		return 0;
+	if (goal->metric == DAMOS_QUOTA_NODE_MEM_USED_BP)
+		numerator = i.totalram - i.freeram;
+	else	/* DAMOS_QUOTA_NODE_MEM_FREE_BP */
+		numerator = i.freeram;
+	return mult_frac(numerator, 10000, i.totalram);
+}
+#else
+static unsigned long damos_get_node_mem_bp(struct damos_quota_goal *goal)
+{
+	return 0;
+}
+#endif
+
 static void damos_set_quota_goal_current_value(struct damos_quota_goal *goal)
 {
 	u64 now_psi_total;
@@ -1523,6 +1559,10 @@ static void damos_set_quota_goal_current_value(struct damos_quota_goal *goal)
 		goal->current_value = now_psi_total - goal->last_psi_total;
 		goal->last_psi_total = now_psi_total;
 		break;
+	case DAMOS_QUOTA_NODE_MEM_USED_BP:
+	case DAMOS_QUOTA_NODE_MEM_FREE_BP:
+		goal->current_value = damos_get_node_mem_bp(goal);
+		break;
 	default:
 		break;
 	}
@@ -58,7 +58,7 @@ static void damon_folio_mkold(struct folio *folio)
 
 }
 
-static void damon_pa_mkold(unsigned long paddr)
+static void damon_pa_mkold(unsigned long paddr, unsigned long *folio_sz)
 {
 	struct folio *folio = damon_get_folio(PHYS_PFN(paddr));
 
@@ -66,24 +66,35 @@ static void damon_pa_mkold(unsigned long paddr)
 		return;
 
 	damon_folio_mkold(folio);
+	*folio_sz = folio_size(folio);
 	folio_put(folio);
 }
 
-static void __damon_pa_prepare_access_check(struct damon_region *r)
+static void __damon_pa_prepare_access_check(struct damon_region *r,
+		unsigned long *last_addr, unsigned long *last_folio_sz)
 {
 	r->sampling_addr = damon_rand(r->ar.start, r->ar.end);
 
-	damon_pa_mkold(r->sampling_addr);
+	/* The whole folio was made old for a previous region already */
+	if (ALIGN_DOWN(*last_addr, *last_folio_sz) ==
+				ALIGN_DOWN(r->sampling_addr, *last_folio_sz))
+		return;
+
+	*last_folio_sz = PAGE_SIZE;
+	damon_pa_mkold(r->sampling_addr, last_folio_sz);
+	*last_addr = r->sampling_addr;
 }
 
 static void damon_pa_prepare_access_checks(struct damon_ctx *ctx)
 {
+	unsigned long last_addr = ULONG_MAX, last_folio_sz = PAGE_SIZE;
 	struct damon_target *t;
 	struct damon_region *r;
 
 	damon_for_each_target(t, ctx) {
 		damon_for_each_region(r, t)
-			__damon_pa_prepare_access_check(r);
+			__damon_pa_prepare_access_check(r, &last_addr,
+					&last_folio_sz);
 	}
 }
 
@@ -162,35 +173,48 @@ static bool damon_pa_young(unsigned long paddr, unsigned long *folio_sz)
 	return accessed;
 }
 
+/*
+ * Remembers the last checked folio within one access check pass. It lives on
+ * the stack of the pass, so that concurrent kdamonds of different contexts
+ * don't share it and a pass never reuses a result from the previous sample.
+ */
+struct damon_pa_access_cache {
+	unsigned long last_addr;
+	unsigned long last_folio_sz;
+	bool last_accessed;
+};
+
 static void __damon_pa_check_access(struct damon_region *r,
-		struct damon_attrs *attrs)
+		struct damon_attrs *attrs, struct damon_pa_access_cache *cache)
 {
-	static unsigned long last_addr;
-	static unsigned long last_folio_sz = PAGE_SIZE;
-	static bool last_accessed;
-
 	/* If the region is in the last checked page, reuse the result */
-	if (ALIGN_DOWN(last_addr, last_folio_sz) ==
-				ALIGN_DOWN(r->sampling_addr, last_folio_sz)) {
-		damon_update_region_access_rate(r, last_accessed, attrs);
+	if (ALIGN_DOWN(cache->last_addr, cache->last_folio_sz) ==
+			ALIGN_DOWN(r->sampling_addr, cache->last_folio_sz)) {
+		damon_update_region_access_rate(r, cache->last_accessed, attrs);
 		return;
 	}
 
-	last_accessed = damon_pa_young(r->sampling_addr, &last_folio_sz);
-	damon_update_region_access_rate(r, last_accessed, attrs);
+	cache->last_folio_sz = PAGE_SIZE;
+	cache->last_accessed = damon_pa_young(r->sampling_addr,
+			&cache->last_folio_sz);
+	damon_update_region_access_rate(r, cache->last_accessed, attrs);
 
-	last_addr = r->sampling_addr;
+	cache->last_addr = r->sampling_addr;
 }
 
 static unsigned int damon_pa_check_accesses(struct damon_ctx *ctx)
 {
+	struct damon_pa_access_cache cache = {
+		.last_addr = ULONG_MAX,
+		.last_folio_sz = PAGE_SIZE,
+	};
 	struct damon_target *t;
 	struct damon_region *r;
 	unsigned int max_nr_accesses = 0;
 
 	damon_for_each_target(t, ctx) {
 		damon_for_each_region(r, t) {
-			__damon_pa_check_access(r, &ctx->attrs);
+			__damon_pa_check_access(r, &ctx->attrs, &cache);
 			max_nr_accesses = max(r->nr_accesses, max_nr_accesses);
 		}
 	}
@@ -18,6 +18,7 @@
 #include <linux/lockdep.h>
 #include <linux/mm.h>
 #include <linux/printk.h>
+#include <linux/ratelimit.h>
 #include <linux/sched.h>
 #include <linux/slab.h>
 #include <linux/stackdepot.h>
@@ -610,9 +611,21 @@ bool kasan_report(const void *addr, size_t size, bool is_write,
 }
 
 #ifdef CONFIG_KASAN_HW_TAGS
+/*
+ * Asynchronous faults carry no details, so in multi-shot mode a storm of them
+ * only produces identical reports, each printed with interrupts off under
+ * report_lock. Print a bounded number and count the rest.
+ */
+static struct ratelimit_state async_report_rs =
+	RATELIMIT_STATE_INIT_FLAGS(async_report_rs, DEFAULT_RATELIMIT_INTERVAL,
+				   DEFAULT_RATELIMIT_BURST,
+				   RATELIMIT_MSG_ON_RELEASE);
+static atomic_t async_reports_suppressed = ATOMIC_INIT(0);
+
 void kasan_report_async(void)
 {
 	unsigned long flags;
+	int suppressed;
 
 	/*
 	 * Do not check report_suppressed_sw(), as
@@ -622,9 +635,19 @@ void kasan_report_async(void)
 	if (unlikely(!report_enabled()))
 		return;
 
+	if (!kasan_kunit_test_suite_executing() &&
+	    !__ratelimit(&async_report_rs)) {
+		atomic_inc(&async_reports_suppressed);
+		return;
+	}
+
 	start_report(&flags, false);
 	pr_err("BUG: KASAN: invalid-access\n");
 	pr_err("Asynchronous fault: no details available\n");
+	suppressed = atomic_xchg(&async_reports_suppressed, 0);
+	if (suppressed)
+		pr_err("%d more asynchronous faults since the last report\n",
+		       suppressed);
 	pr_err("\n");
 	dump_stack_lvl(KERN_ERR);
 	/*
@@ -4495,7 +4495,7 @@ int __dev_queue_xmit(struct sk_buff *skb, struct net_device *sb_dev)
 }
 EXPORT_SYMBOL(__dev_queue_xmit);
 
-int __dev_direct_xmit(struct sk_buff *skb, u16 queue_id)
+int __dev_direct_xmit(struct sk_buff *skb, u16 queue_id, bool more)
 {
 	struct net_device *dev = skb->dev;
 	struct sk_buff *orig_skb = skb;
@@ -4519,7 +4519,7 @@ int __dev_direct_xmit(struct sk_buff *skb, u16 queue_id)
 	dev_xmit_recursion_inc();
 	HARD_TX_LOCK(dev, txq, smp_processor_id());
 	if (!netif_xmit_frozen_or_drv_stopped(txq))
-		ret = netdev_start_xmit(skb, dev, txq, false);
+		ret = netdev_start_xmit(skb, dev, txq, more);
 	HARD_TX_UNLOCK(dev, txq);
 	dev_xmit_recursion_dec();
 
@@ -6645,6 +6645,7 @@ static void init_gro_hash(struct napi_struct *napi)
 		napi->gro_hash[i].count = 0;
 	}
 	napi->gro_bitmask = 0;
+	memset(&napi->gro_stats, 0, sizeof(napi->gro_stats));
 }
 
 int dev_set_threaded(struct net_device *dev, bool threaded)
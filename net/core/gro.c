@@ -533,16 +533,21 @@ static enum gro_result dev_gro_receive(struct napi_struct *napi, struct sk_buff
 		gro_list->count--;
 	}
 
-	if (same_flow)
+	if (same_flow) {
+		WRITE_ONCE(napi->gro_stats.merged, napi->gro_stats.merged + 1);
 		goto ok;
+	}
 
 	if (NAPI_GRO_CB(skb)->flush)
 		goto normal;
 
-	if (unlikely(gro_list->count >= MAX_GRO_SKBS))
+	if (unlikely(gro_list->count >= MAX_GRO_SKBS)) {
 		gro_flush_oldest(napi, &gro_list->list);
-	else
+		WRITE_ONCE(napi->gro_stats.evicted, napi->gro_stats.evicted + 1);
+	} else {
 		gro_list->count++;
+	}
+	WRITE_ONCE(napi->gro_stats.held, napi->gro_stats.held + 1);
 
 	/* Must be called before setting NAPI_GRO_CB(skb)->{age|last} */
 	gro_try_pull_from_frag0(skb);
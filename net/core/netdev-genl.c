@@ -204,6 +204,14 @@ netdev_nl_napi_fill_one(struct sk_buff *rsp, struct napi_struct *napi,
 			 gro_flush_timeout))
 		goto nla_put_failure;
 
+	if (nla_put_uint(rsp, NETDEV_A_NAPI_GRO_HELD,
+			 READ_ONCE(napi->gro_stats.held)) ||
+	    nla_put_uint(rsp, NETDEV_A_NAPI_GRO_MERGED,
+			 READ_ONCE(napi->gro_stats.merged)) ||
+	    nla_put_uint(rsp, NETDEV_A_NAPI_GRO_EVICTED,
+			 READ_ONCE(napi->gro_stats.evicted)))
+		goto nla_put_failure;
+
 	genlmsg_end(rsp, hdr);
 
 	return 0;
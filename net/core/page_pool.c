@@ -839,6 +839,35 @@ void page_pool_put_unrefed_page(struct page_pool *pool, struct page *page,
 }
 EXPORT_SYMBOL(page_pool_put_unrefed_page);
 
+/* Bulk producer into ptr_ring page_pool cache */
+static void page_pool_recycle_ring_bulk(struct page_pool *pool, void **bulk,
+					int bulk_len)
+{
+	bool in_softirq;
+	int i;
+
+	in_softirq = page_pool_producer_lock(pool);
+	for (i = 0; i < bulk_len; i++) {
+		if (__ptr_ring_produce(&pool->ring, bulk[i])) {
+			/* ring full */
+			recycle_stat_inc(pool, ring_full);
+			break;
+		}
+	}
+	recycle_stat_add(pool, ring, i);
+	page_pool_producer_unlock(pool, in_softirq);
+
+	/* Hopefully all pages was return into ptr_ring */
+	if (likely(i == bulk_len))
+		return;
+
+	/* ptr_ring cache full, free remaining pages outside producer lock
+	 * since put_page() with refcnt == 1 can be an expensive operation
+	 */
+	for (; i < bulk_len; i++)
+		page_pool_return_page(pool, (__force netmem_ref)bulk[i]);
+}
+
 /**
  * page_pool_put_page_bulk() - release references on multiple pages
  * @pool:	pool from which pages were allocated
@@ -859,7 +888,6 @@ void page_pool_put_page_bulk(struct page_pool *pool, void **data,
 {
 	int i, bulk_len = 0;
 	bool allow_direct;
-	bool in_softirq;
 
 	allow_direct = page_pool_napi_local(pool);
 
@@ -876,32 +904,57 @@ void page_pool_put_page_bulk(struct page_pool *pool, void **data,
 			data[bulk_len++] = (__force void *)netmem;
 	}
 
-	if (!bulk_len)
-		return;
+	if (bulk_len)
+		page_pool_recycle_ring_bulk(pool, data, bulk_len);
+}
+EXPORT_SYMBOL(page_pool_put_page_bulk);
 
-	/* Bulk producer into ptr_ring page_pool cache */
-	in_softirq = page_pool_producer_lock(pool);
-	for (i = 0; i < bulk_len; i++) {
-		if (__ptr_ring_produce(&pool->ring, data[i])) {
-			/* ring full */
-			recycle_stat_inc(pool, ring_full);
-			break;
+#define PP_PUT_BULK_SIZE	16
+
+/**
+ * page_pool_put_netmem_bulk() - release references on page pool netmems
+ * @data:	array of page pool netmems (compound heads) to release
+ * @count:	number of netmems in @data
+ *
+ * Like page_pool_put_full_netmem() on each of @data, which may belong to
+ * different pools. Netmems that can't be recycled directly are returned to
+ * the ptr_ring of their pool in bulk, taking the producer lock once per run
+ * of netmems from the same pool. This is meant for consumers freeing skbs
+ * away from the NAPI context of the pool.
+ */
+void page_pool_put_netmem_bulk(netmem_ref *data, u32 count)
+{
+	void *bulk[PP_PUT_BULK_SIZE];
+	struct page_pool *pool = NULL;
+	bool allow_direct = false;
+	int bulk_len = 0;
+	u32 i;
+
+	for (i = 0; i < count; i++) {
+		netmem_ref netmem = data[i];
+
+		if (netmem_get_pp(netmem) != pool ||
+		    bulk_len == PP_PUT_BULK_SIZE) {
+			if (bulk_len)
+				page_pool_recycle_ring_bulk(pool, bulk, bulk_len);
+			bulk_len = 0;
+			pool = netmem_get_pp(netmem);
+			allow_direct = page_pool_napi_local(pool);
 		}
-	}
-	recycle_stat_add(pool, ring, i);
-	page_pool_producer_unlock(pool, in_softirq);
 
-	/* Hopefully all pages was return into ptr_ring */
-	if (likely(i == bulk_len))
-		return;
+		/* It is not the last user for the page frag case */
+		if (!page_pool_is_last_ref(netmem))
+			continue;
 
-	/* ptr_ring cache full, free remaining pages outside producer lock
-	 * since put_page() with refcnt == 1 can be an expensive operation
-	 */
-	for (; i < bulk_len; i++)
-		page_pool_return_page(pool, (__force netmem_ref)data[i]);
+		netmem = __page_pool_put_page(pool, netmem, -1, allow_direct);
+		if (netmem)
+			bulk[bulk_len++] = (__force void *)netmem;
+	}
+
+	if (bulk_len)
+		page_pool_recycle_ring_bulk(pool, bulk, bulk_len);
 }
-EXPORT_SYMBOL(page_pool_put_page_bulk);
+EXPORT_SYMBOL(page_pool_put_netmem_bulk);
 
 static netmem_ref page_pool_drain_frag(struct page_pool *pool,
 				       netmem_ref netmem)
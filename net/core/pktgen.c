@@ -171,7 +171,7 @@
 #include <asm/dma.h>
 #include <asm/div64.h>		/* do_div */
 
-#define VERSION	"2.75"
+#define VERSION	"2.76"
 #define IP_NAME_SZ 32
 #define MAX_MPLS_LABELS 16 /* This is the max label stack depth */
 #define MPLS_STACK_BOTTOM htonl(0x00000100)
@@ -240,6 +240,7 @@ static char *pkt_flag_names[] = {
 #define PKTGEN_MAGIC 0xbe9be955
 #define PG_PROC_DIR "pktgen"
 #define PGCTRL	    "pgctrl"
+#define PGRX	    "pgrx"
 
 #define MAX_CFLOWS  65536
 
@@ -445,10 +446,46 @@ struct pktgen_hdr {
 
 static unsigned int pg_net_id __read_mostly;
 
+/* log2 buckets of one-way latency in usec, the last one is open ended */
+#define PGRX_LAT_BUCKETS	24
+/* flows whose sequence numbers are followed, per CPU */
+#define PGRX_FLOW_SLOTS		256
+
+struct pktgen_rx_flow {
+	u32 hash;		/* skb flow hash, 0 if the slot is unused */
+	u32 last_seq;
+};
+
+struct pktgen_rx_flows {
+	struct pktgen_rx_flow slot[PGRX_FLOW_SLOTS];
+};
+
+struct pktgen_rx_stats {
+	u64 pkts;
+	u64 bytes;
+	u64 reordered;		/* seq_num lower than one already seen in the flow */
+	u64 lat_pkts;		/* packets carrying a usable timestamp */
+	u64 lat_sum;		/* usec */
+	u64 lat_max;		/* usec */
+	u64 lat_hist[PGRX_LAT_BUCKETS];
+};
+
+/* Receive side sink counting pktgen packets arriving on one device */
+struct pktgen_rx {
+	struct net_device	*dev;
+	netdevice_tracker	dev_tracker;
+	struct packet_type	pt_ip;
+	struct packet_type	pt_ipv6;
+	struct pktgen_rx_stats __percpu *stats;
+	struct pktgen_rx_flows __percpu *flows;
+	ktime_t			started;
+};
+
 struct pktgen_net {
 	struct net		*net;
 	struct proc_dir_entry	*proc_dir;
 	struct list_head	pktgen_threads;
+	struct pktgen_rx	*rx;	/* protected by pktgen_thread_lock */
 	bool			pktgen_exiting;
 };
 
@@ -502,6 +539,229 @@ static struct notifier_block pktgen_notifier_block = {
 	.notifier_call = pktgen_device_event,
 };
 
+/*
+ * Receive side
+ *
+ * Packets carry the sender's wall clock time, so latency is only meaningful
+ * with synchronized clocks (or both ends on one host). Reordering is
+ * detected per flow, identified by the skb flow hash over addresses and
+ * ports: a pktgen device numbers all its packets, so the sequence numbers
+ * within any one of its flows only go up. Flows are followed on the CPU
+ * receiving them, RSS keeps each of them on one queue. A flow whose slot
+ * is taken over by another one starts afresh.
+ */
+
+static void pktgen_rx_account(struct pktgen_rx *rx, struct sk_buff *skb,
+			      int offset)
+{
+	struct pktgen_rx_stats *st;
+	struct pktgen_rx_flow *flow;
+	struct pktgen_hdr _pgh;
+	const struct pktgen_hdr *pgh;
+	struct timespec64 now;
+	u32 hash, seq, tv_sec, tv_usec;
+	s64 lat;
+
+	pgh = skb_header_pointer(skb, offset, sizeof(_pgh), &_pgh);
+	if (!pgh || pgh->pgh_magic != htonl(PKTGEN_MAGIC))
+		return;
+
+	st = this_cpu_ptr(rx->stats);
+	st->pkts++;
+	st->bytes += skb->len;
+
+	seq = ntohl(pgh->seq_num);
+	hash = skb_get_hash(skb);
+	if (hash) {
+		flow = &this_cpu_ptr(rx->flows)->slot[hash % PGRX_FLOW_SLOTS];
+		if (flow->hash == hash && (s32)(seq - flow->last_seq) < 0) {
+			st->reordered++;
+		} else {
+			flow->hash = hash;
+			flow->last_seq = seq;
+		}
+	}
+
+	tv_sec = ntohl(pgh->tv_sec);
+	tv_usec = ntohl(pgh->tv_usec);
+	if (!tv_sec && !tv_usec)
+		return;		/* sent with NO_TIMESTAMP */
+
+	ktime_get_real_ts64(&now);
+	/* tv_sec is truncated to 32 bits by the sender */
+	lat = (s64)(s32)((u32)now.tv_sec - tv_sec) * USEC_PER_SEC +
+	      now.tv_nsec / NSEC_PER_USEC - tv_usec;
+	if (lat < 0)
+		return;		/* clocks out of sync */
+
+	st->lat_pkts++;
+	st->lat_sum += lat;
+	if (lat > st->lat_max)
+		st->lat_max = lat;
+	st->lat_hist[min(fls64(lat), PGRX_LAT_BUCKETS - 1)]++;
+}
+
+static int pktgen_rx_ip(struct sk_buff *skb, struct net_device *dev,
+			struct packet_type *pt, struct net_device *orig_dev)
+{
+	struct pktgen_rx *rx = container_of(pt, struct pktgen_rx, pt_ip);
+	const struct iphdr *iph;
+	struct iphdr _iph;
+
+	iph = skb_header_pointer(skb, 0, sizeof(_iph), &_iph);
+	if (iph && iph->version == 4 && iph->ihl >= 5 &&
+	    iph->protocol == IPPROTO_UDP && !ip_is_fragment(iph))
+		pktgen_rx_account(rx, skb, iph->ihl * 4 + sizeof(struct udphdr));
+
+	consume_skb(skb);
+	return NET_RX_SUCCESS;
+}
+
+static int pktgen_rx_ipv6(struct sk_buff *skb, struct net_device *dev,
+			  struct packet_type *pt, struct net_device *orig_dev)
+{
+	struct pktgen_rx *rx = container_of(pt, struct pktgen_rx, pt_ipv6);
+	const struct ipv6hdr *ip6h;
+	struct ipv6hdr _ip6h;
+
+	ip6h = skb_header_pointer(skb, 0, sizeof(_ip6h), &_ip6h);
+	if (ip6h && ip6h->version == 6 && ip6h->nexthdr == IPPROTO_UDP)
+		pktgen_rx_account(rx, skb, sizeof(*ip6h) + sizeof(struct udphdr));
+
+	consume_skb(skb);
+	return NET_RX_SUCCESS;
+}
+
+/* Must be called with pktgen_thread_lock held */
+static void pktgen_rx_stop(struct pktgen_net *pn)
+{
+	struct pktgen_rx *rx = pn->rx;
+
+	if (!rx)
+		return;
+
+	pn->rx = NULL;
+	__dev_remove_pack(&rx->pt_ip);
+	/* dev_remove_pack() waits for in flight receivers */
+	dev_remove_pack(&rx->pt_ipv6);
+	netdev_put(rx->dev, &rx->dev_tracker);
+	free_percpu(rx->flows);
+	free_percpu(rx->stats);
+	kfree(rx);
+}
+
+/* Must be called with pktgen_thread_lock held */
+static int pktgen_rx_start(struct pktgen_net *pn, const char *ifname)
+{
+	struct pktgen_rx *rx;
+	int err;
+
+	rx = kzalloc(sizeof(*rx), GFP_KERNEL);
+	if (!rx)
+		return -ENOMEM;
+
+	rx->stats = alloc_percpu(struct pktgen_rx_stats);
+	rx->flows = alloc_percpu(struct pktgen_rx_flows);
+	if (!rx->stats || !rx->flows) {
+		err = -ENOMEM;
+		goto err_free;
+	}
+
+	rx->dev = netdev_get_by_name(pn->net, ifname, &rx->dev_tracker,
+				     GFP_KERNEL);
+	if (!rx->dev) {
+		err = -ENODEV;
+		goto err_free;
+	}
+
+	pktgen_rx_stop(pn);
+
+	rx->started = ktime_get();
+	rx->pt_ip.type = htons(ETH_P_IP);
+	rx->pt_ip.dev = rx->dev;
+	rx->pt_ip.func = pktgen_rx_ip;
+	rx->pt_ipv6.type = htons(ETH_P_IPV6);
+	rx->pt_ipv6.dev = rx->dev;
+	rx->pt_ipv6.func = pktgen_rx_ipv6;
+	pn->rx = rx;
+	dev_add_pack(&rx->pt_ip);
+	dev_add_pack(&rx->pt_ipv6);
+	return 0;
+
+err_free:
+	free_percpu(rx->flows);
+	free_percpu(rx->stats);
+	kfree(rx);
+	return err;
+}
+
+static int pgrx_show(struct seq_file *seq, void *v)
+{
+	struct pktgen_net *pn = seq->private;
+	struct pktgen_rx_stats sum = {};
+	struct pktgen_rx *rx;
+	u64 elapsed;
+	int cpu, i;
+
+	mutex_lock(&pktgen_thread_lock);
+	rx = pn->rx;
+	if (!rx) {
+		seq_puts(seq, "Not receiving\n");
+		goto out;
+	}
+
+	for_each_possible_cpu(cpu) {
+		const struct pktgen_rx_stats *st = per_cpu_ptr(rx->stats, cpu);
+
+		sum.pkts += READ_ONCE(st->pkts);
+		sum.bytes += READ_ONCE(st->bytes);
+		sum.reordered += READ_ONCE(st->reordered);
+		sum.lat_pkts += READ_ONCE(st->lat_pkts);
+		sum.lat_sum += READ_ONCE(st->lat_sum);
+		sum.lat_max = max(sum.lat_max, READ_ONCE(st->lat_max));
+		for (i = 0; i < PGRX_LAT_BUCKETS; i++)
+			sum.lat_hist[i] += READ_ONCE(st->lat_hist[i]);
+	}
+
+	elapsed = ktime_us_delta(ktime_get(), rx->started);
+	seq_printf(seq, "Receiving on: %s for %lluus\n", rx->dev->name,
+		   (unsigned long long)elapsed);
+	seq_printf(seq, "  pkts: %llu  bytes: %llu  reordered: %llu\n",
+		   (unsigned long long)sum.pkts,
+		   (unsigned long long)sum.bytes,
+		   (unsigned long long)sum.reordered);
+	seq_printf(seq, "  latency_pkts: %llu  avg: %lluus  max: %lluus\n",
+		   (unsigned long long)sum.lat_pkts,
+		   (unsigned long long)(sum.lat_pkts ?
+			div64_u64(sum.lat_sum, sum.lat_pkts) : 0),
+		   (unsigned long long)sum.lat_max);
+	for (i = 0; i < PGRX_LAT_BUCKETS; i++) {
+		if (!sum.lat_hist[i])
+			continue;
+		if (i == PGRX_LAT_BUCKETS - 1)
+			seq_printf(seq, "  >=%lluus: %llu\n", 1ULL << (i - 1),
+				   (unsigned long long)sum.lat_hist[i]);
+		else
+			seq_printf(seq, "  <%lluus: %llu\n", 1ULL << i,
+				   (unsigned long long)sum.lat_hist[i]);
+	}
+out:
+	mutex_unlock(&pktgen_thread_lock);
+	return 0;
+}
+
+static int pgrx_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, pgrx_show, pde_data(inode));
+}
+
+static const struct proc_ops pktgen_rx_proc_ops = {
+	.proc_open	= pgrx_open,
+	.proc_read	= seq_read,
+	.proc_lseek	= seq_lseek,
+	.proc_release	= single_release,
+};
+
 /*
  * /proc handling functions
  *
@@ -539,7 +799,19 @@ static ssize_t pgctrl_write(struct file *file, const char __user *buf,
 		pktgen_run_all_threads(pn);
 	else if (!strcmp(data, "reset"))
 		pktgen_reset_all_threads(pn);
-	else
+	else if (!strncmp(data, "rx ", 3)) {
+		int err;
+
+		mutex_lock(&pktgen_thread_lock);
+		err = pktgen_rx_start(pn, strim(data + 3));
+		mutex_unlock(&pktgen_thread_lock);
+		if (err)
+			return err;
+	} else if (!strcmp(data, "rx_stop")) {
+		mutex_lock(&pktgen_thread_lock);
+		pktgen_rx_stop(pn);
+		mutex_unlock(&pktgen_thread_lock);
+	} else
 		return -EINVAL;
 
 	return count;
@@ -2086,6 +2358,10 @@ static int pktgen_device_event(struct notifier_block *unused,
 
 	case NETDEV_UNREGISTER:
 		pktgen_mark_device(pn, dev->name);
+		mutex_lock(&pktgen_thread_lock);
+		if (pn->rx && pn->rx->dev == dev)
+			pktgen_rx_stop(pn);
+		mutex_unlock(&pktgen_thread_lock);
 		break;
 	}
 
@@ -3988,6 +4264,13 @@ static int __net_init pg_net_init(struct net *net)
 		ret = -EINVAL;
 		goto remove;
 	}
+	pe = proc_create_data(PGRX, 0400, pn->proc_dir, &pktgen_rx_proc_ops,
+			      pn);
+	if (pe == NULL) {
+		pr_err("cannot create %s procfs entry\n", PGRX);
+		ret = -EINVAL;
+		goto remove_ctrl;
+	}
 
 	cpus_read_lock();
 	for_each_online_cpu(cpu) {
@@ -4009,6 +4292,8 @@ static int __net_init pg_net_init(struct net *net)
 	return 0;
 
 remove_entry:
+	remove_proc_entry(PGRX, pn->proc_dir);
+remove_ctrl:
 	remove_proc_entry(PGCTRL, pn->proc_dir);
 remove:
 	remove_proc_entry(PG_PROC_DIR, pn->net->proc_net);
@@ -4027,6 +4312,7 @@ static void __net_exit pg_net_exit(struct net *net)
 
 	mutex_lock(&pktgen_thread_lock);
 	list_splice_init(&pn->pktgen_threads, &list);
+	pktgen_rx_stop(pn);
 	mutex_unlock(&pktgen_thread_lock);
 
 	list_for_each_safe(q, n, &list) {
@@ -4036,6 +4322,7 @@ static void __net_exit pg_net_exit(struct net *net)
 		kfree(t);
 	}
 
+	remove_proc_entry(PGRX, pn->proc_dir);
 	remove_proc_entry(PGCTRL, pn->proc_dir);
 	remove_proc_entry(PG_PROC_DIR, pn->net->proc_net);
 }
@@ -367,6 +367,20 @@ static struct sk_buff *napi_skb_cache_get(void)
 	return skb;
 }
 
+/* Same as napi_skb_cache_get(), for callers outside of BH context. Heads
+ * freed by napi_consume_skb() on TX completion are reused by local senders.
+ */
+static struct sk_buff *napi_skb_cache_get_bh(void)
+{
+	struct sk_buff *skb;
+
+	local_bh_disable();
+	skb = napi_skb_cache_get();
+	local_bh_enable();
+
+	return skb;
+}
+
 static inline void __finalize_skb_around(struct sk_buff *skb, void *data,
 					 unsigned int size)
 {
@@ -661,13 +675,22 @@ struct sk_buff *__alloc_skb(unsigned int size, gfp_t gfp_mask,
 		gfp_mask |= __GFP_MEMALLOC;
 
 	/* Get the HEAD */
-	if ((flags & (SKB_ALLOC_FCLONE | SKB_ALLOC_NAPI)) == SKB_ALLOC_NAPI &&
-	    likely(node == NUMA_NO_NODE || node == numa_mem_id()))
-		skb = napi_skb_cache_get();
-	else
+	skb = NULL;
+	if (!(flags & SKB_ALLOC_FCLONE) &&
+	    likely(node == NUMA_NO_NODE || node == numa_mem_id())) {
+		if (flags & SKB_ALLOC_NAPI) {
+			skb = napi_skb_cache_get();
+			if (unlikely(!skb))
+				return NULL;
+		} else if (!in_hardirq() && !irqs_disabled()) {
+			skb = napi_skb_cache_get_bh();
+		}
+	}
+	if (!skb) {
 		skb = kmem_cache_alloc_node(cache, gfp_mask & ~GFP_DMA, node);
-	if (unlikely(!skb))
-		return NULL;
+		if (unlikely(!skb))
+			return NULL;
+	}
 	prefetchw(skb);
 
 	/* We do our best to align skb_shared_info on a separate cache
@@ -1040,6 +1063,30 @@ bool napi_pp_put_page(netmem_ref netmem)
 EXPORT_SYMBOL(napi_pp_put_page);
 #endif
 
+/* Release the frags of a page pool aware skb, returning the page pool ones to
+ * their pools in bulk rather than one producer lock round trip at a time.
+ */
+static void skb_pp_frags_unref(struct skb_shared_info *shinfo)
+{
+#if IS_ENABLED(CONFIG_PAGE_POOL)
+	netmem_ref bulk[MAX_SKB_FRAGS];
+	u32 count = 0;
+	int i;
+
+	for (i = 0; i < shinfo->nr_frags; i++) {
+		netmem_ref netmem = skb_frag_netmem(&shinfo->frags[i]);
+		netmem_ref head_netmem = netmem_compound_head(netmem);
+
+		if (likely(is_pp_netmem(head_netmem)))
+			bulk[count++] = head_netmem;
+		else
+			put_page(netmem_to_page(netmem));
+	}
+
+	page_pool_put_netmem_bulk(bulk, count);
+#endif
+}
+
 static bool skb_pp_recycle(struct sk_buff *skb, void *data)
 {
 	if (!IS_ENABLED(CONFIG_PAGE_POOL) || !skb->pp_recycle)
@@ -1115,8 +1162,13 @@ static void skb_release_data(struct sk_buff *skb, enum skb_drop_reason reason)
 			goto free_head;
 	}
 
-	for (i = 0; i < shinfo->nr_frags; i++)
-		__skb_frag_unref(&shinfo->frags[i], skb->pp_recycle);
+	if (IS_ENABLED(CONFIG_PAGE_POOL) && skb->pp_recycle &&
+	    shinfo->nr_frags > 1) {
+		skb_pp_frags_unref(shinfo);
+	} else {
+		for (i = 0; i < shinfo->nr_frags; i++)
+			__skb_frag_unref(&shinfo->frags[i], skb->pp_recycle);
+	}
 
 free_head:
 	if (shinfo->frag_list)
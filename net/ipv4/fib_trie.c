@@ -738,6 +738,16 @@ static unsigned char update_suffix(struct key_vector *tn)
 	return slen;
 }
 
+/* Every lookup goes through the root and one of its children, and with a
+ * full table those two levels are where most of the key bits get consumed.
+ * Size the children of the root with the root thresholds too, so that the
+ * top of the trie stays flat and lookups need fewer nodes to get to a leaf.
+ */
+static inline bool tnode_is_top(struct key_vector *tp)
+{
+	return IS_TRIE(tp) || IS_TRIE(node_parent(tp));
+}
+
 /* From "Implementing a dynamic compressed trie" by Stefan Nilsson of
  * the Helsinki University of Technology and Matti Tikkanen of Nokia
  * Telecommunications, page 6:
@@ -800,8 +810,8 @@ static inline bool should_inflate(struct key_vector *tp, struct key_vector *tn)
 	unsigned long used = child_length(tn);
 	unsigned long threshold = used;
 
-	/* Keep root node larger */
-	threshold *= IS_TRIE(tp) ? inflate_threshold_root : inflate_threshold;
+	/* Keep top nodes larger */
+	threshold *= tnode_is_top(tp) ? inflate_threshold_root : inflate_threshold;
 	used -= tn_info(tn)->empty_children;
 	used += tn_info(tn)->full_children;
 
@@ -815,8 +825,8 @@ static inline bool should_halve(struct key_vector *tp, struct key_vector *tn)
 	unsigned long used = child_length(tn);
 	unsigned long threshold = used;
 
-	/* Keep root node larger */
-	threshold *= IS_TRIE(tp) ? halve_threshold_root : halve_threshold;
+	/* Keep top nodes larger */
+	threshold *= tnode_is_top(tp) ? halve_threshold_root : halve_threshold;
 	used -= tn_info(tn)->empty_children;
 
 	/* if bits == KEYLENGTH then used = 100% on wrap, and will fail below */
@@ -534,10 +534,14 @@ struct sock *__inet_lookup_established(const struct net *net,
 }
 EXPORT_SYMBOL_GPL(__inet_lookup_established);
 
-/* called with local bh disabled */
+/* called with local bh disabled, or with only rcu_read_lock() held for an
+ * @rcu_lookup, which checks that the 4-tuple is not obviously in use without
+ * hashing @sk.
+ */
 static int __inet_check_established(struct inet_timewait_death_row *death_row,
 				    struct sock *sk, __u16 lport,
-				    struct inet_timewait_sock **twp)
+				    struct inet_timewait_sock **twp,
+				    bool rcu_lookup)
 {
 	struct inet_hashinfo *hinfo = death_row->hashinfo;
 	struct inet_sock *inet = inet_sk(sk);
@@ -556,6 +560,19 @@ static int __inet_check_established(struct inet_timewait_death_row *death_row,
 	const struct hlist_nulls_node *node;
 	struct inet_timewait_sock *tw = NULL;
 
+	if (rcu_lookup) {
+		sk_nulls_for_each_rcu(sk2, node, &head->chain) {
+			if (sk2->sk_hash == hash &&
+			    inet_match(net, sk2, acookie, ports, dif, sdif)) {
+				/* Let the locked pass decide on reuse */
+				if (sk2->sk_state == TCP_TIME_WAIT)
+					break;
+				return -EADDRNOTAVAIL;
+			}
+		}
+		return 0;
+	}
+
 	spin_lock(lock);
 
 	sk_nulls_for_each(sk2, node, &head->chain) {
@@ -994,7 +1011,8 @@ static u32 *table_perturb;
 int __inet_hash_connect(struct inet_timewait_death_row *death_row,
 		struct sock *sk, u64 port_offset,
 		int (*check_established)(struct inet_timewait_death_row *,
-			struct sock *, __u16, struct inet_timewait_sock **))
+			struct sock *, __u16, struct inet_timewait_sock **,
+			bool rcu_lookup))
 {
 	struct inet_hashinfo *hinfo = death_row->hashinfo;
 	struct inet_bind_hashbucket *head, *head2;
@@ -1012,7 +1030,7 @@ int __inet_hash_connect(struct inet_timewait_death_row *death_row,
 
 	if (port) {
 		local_bh_disable();
-		ret = check_established(death_row, sk, port, NULL);
+		ret = check_established(death_row, sk, port, NULL, false);
 		local_bh_enable();
 		return ret;
 	}
@@ -1046,6 +1064,19 @@ int __inet_hash_connect(struct inet_timewait_death_row *death_row,
 			port -= remaining;
 		if (inet_is_local_reserved_port(net, port))
 			continue;
+
+		/* With many connections to few destinations, most candidate
+		 * ports are already in use with this 4-tuple. Skip those with
+		 * a lockless ehash lookup before taking any bucket lock.
+		 */
+		rcu_read_lock();
+		ret = check_established(death_row, sk, port, NULL, true);
+		rcu_read_unlock();
+		if (ret) {
+			cond_resched();
+			continue;
+		}
+
 		head = &hinfo->bhash[inet_bhashfn(net, port,
 						  hinfo->bhash_size)];
 		spin_lock_bh(&head->lock);
@@ -1060,7 +1091,7 @@ int __inet_hash_connect(struct inet_timewait_death_row *death_row,
 					goto next_port;
 				WARN_ON(hlist_empty(&tb->bhash2));
 				if (!check_established(death_row, sk,
-						       port, &tw))
+						       port, &tw, false))
 					goto ok;
 				goto next_port;
 			}
@@ -589,12 +589,40 @@ static struct sk_buff *ip_extract_route_hint(const struct net *net,
 	return skb;
 }
 
+/* Number of destinations ip_list_rcv_finish() keeps sublists and hints for,
+ * so that interleaved flows to a few destinations still share lookups.
+ */
+#define IP_LIST_RCV_GROUPS	4
+
+struct ip_list_rcv_group {
+	struct dst_entry	*dst;
+	struct sk_buff		*hint;
+	struct list_head	sublist;
+};
+
+static const struct sk_buff *
+ip_list_rcv_find_hint(const struct ip_list_rcv_group *groups,
+		      const struct sk_buff *skb)
+{
+	const struct iphdr *iph = ip_hdr(skb);
+	int i;
+
+	for (i = 0; i < IP_LIST_RCV_GROUPS; i++)
+		if (ip_can_use_hint(skb, iph, groups[i].hint))
+			return groups[i].hint;
+	return NULL;
+}
+
 static void ip_list_rcv_finish(struct net *net, struct sock *sk,
 			       struct list_head *head)
 {
-	struct sk_buff *skb, *next, *hint = NULL;
-	struct dst_entry *curr_dst = NULL;
-	LIST_HEAD(sublist);
+	struct ip_list_rcv_group groups[IP_LIST_RCV_GROUPS] = {};
+	struct ip_list_rcv_group *curr = NULL;
+	struct sk_buff *skb, *next;
+	int i, victim = 0;
+
+	for (i = 0; i < IP_LIST_RCV_GROUPS; i++)
+		INIT_LIST_HEAD(&groups[i].sublist);
 
 	list_for_each_entry_safe(skb, next, head, list) {
 		struct net_device *dev = skb->dev;
@@ -607,25 +635,36 @@ static void ip_list_rcv_finish(struct net *net, struct sock *sk,
 		skb = l3mdev_ip_rcv(skb);
 		if (!skb)
 			continue;
-		if (ip_rcv_finish_core(net, sk, skb, dev, hint) == NET_RX_DROP)
+		if (ip_rcv_finish_core(net, sk, skb, dev,
+				       ip_list_rcv_find_hint(groups, skb)) ==
+		    NET_RX_DROP)
 			continue;
 
 		dst = skb_dst(skb);
-		if (curr_dst != dst) {
-			hint = ip_extract_route_hint(net, skb,
-						     dst_rtable(dst)->rt_type);
-
-			/* dispatch old sublist */
-			if (!list_empty(&sublist))
-				ip_sublist_rcv_finish(&sublist);
-			/* start new sublist */
-			INIT_LIST_HEAD(&sublist);
-			curr_dst = dst;
+		if (!curr || curr->dst != dst) {
+			for (i = 0; i < IP_LIST_RCV_GROUPS; i++)
+				if (groups[i].dst == dst)
+					break;
+
+			if (i < IP_LIST_RCV_GROUPS) {
+				curr = &groups[i];
+			} else {
+				/* Hints point into their own sublist, dispatch
+				 * the evicted one only once its hint is gone.
+				 */
+				curr = &groups[victim];
+				victim = (victim + 1) % IP_LIST_RCV_GROUPS;
+				ip_sublist_rcv_finish(&curr->sublist);
+				curr->dst = dst;
+				curr->hint = ip_extract_route_hint(net, skb,
+						dst_rtable(dst)->rt_type);
+			}
 		}
-		list_add_tail(&skb->list, &sublist);
+		list_add_tail(&skb->list, &curr->sublist);
 	}
-	/* dispatch final sublist */
-	ip_sublist_rcv_finish(&sublist);
+	/* dispatch final sublists */
+	for (i = 0; i < IP_LIST_RCV_GROUPS; i++)
+		ip_sublist_rcv_finish(&groups[i].sublist);
 }
 
 static void ip_sublist_rcv(struct list_head *head, struct net_device *dev,
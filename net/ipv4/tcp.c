@@ -252,6 +252,7 @@
 #include <linux/inet_diag.h>
 #include <linux/init.h>
 #include <linux/fs.h>
+#include <linux/file.h>
 #include <linux/skbuff.h>
 #include <linux/scatterlist.h>
 #include <linux/splice.h>
@@ -2238,6 +2239,93 @@ static int tcp_zerocopy_receive(struct sock *sk,
 	zc->length = length;
 	return ret;
 }
+
+static int tcp_zerocopy_receive_one(struct tcp_zerocopy_receive_batch_entry *ent,
+				    u32 flags)
+{
+	struct tcp_zerocopy_receive zc = {
+		.address = ent->address,
+		.length = ent->length,
+		.flags = flags,
+	};
+	struct scm_timestamping_internal tss;
+	CLASS(fd, f)(ent->fd);
+	struct socket *sock;
+	struct sock *sk;
+	int err;
+
+	if (ent->reserved)
+		return -EINVAL;
+	if (fd_empty(f))
+		return -EBADF;
+	sock = sock_from_file(fd_file(f));
+	if (!sock)
+		return -ENOTSOCK;
+	sk = sock->sk;
+	if (!sk_is_tcp(sk))
+		return -EOPNOTSUPP;
+
+	lock_sock(sk);
+	err = tcp_zerocopy_receive(sk, &zc, &tss);
+	release_sock(sk);
+
+	ent->length = zc.length;
+	ent->recv_skip_hint = zc.recv_skip_hint;
+	ent->inq = tcp_inq_hint(sk);
+	return err ?: sock_error(sk);
+}
+
+#define TCP_ZEROCOPY_BATCH_MAX	UIO_MAXIOV
+
+/* Handle many TCP_ZEROCOPY_RECEIVE requests in one call. Each socket is
+ * locked on its own, before the mapping, as in tcp_zerocopy_receive().
+ */
+static int tcp_zerocopy_receive_batch(sockptr_t optval, sockptr_t optlen)
+{
+	struct tcp_zerocopy_receive_batch_entry __user *uents;
+	struct tcp_zerocopy_receive_batch_entry ent;
+	struct tcp_zerocopy_receive_batch zb;
+	int len, err = 0;
+	u32 i;
+
+	/* A BPF program may run with the lock of one of the sockets held */
+	if (has_current_bpf_ctx())
+		return -EOPNOTSUPP;
+	if (copy_from_sockptr(&len, optlen, sizeof(int)))
+		return -EFAULT;
+	if (len != sizeof(zb))
+		return -EINVAL;
+	if (copy_from_sockptr(&zb, optval, sizeof(zb)))
+		return -EFAULT;
+	if (zb.flags & ~TCP_RECEIVE_ZEROCOPY_FLAG_TLB_CLEAN_HINT ||
+	    zb.nr_entries > TCP_ZEROCOPY_BATCH_MAX)
+		return -EINVAL;
+
+	uents = u64_to_user_ptr(zb.entries);
+	for (i = 0; i < zb.nr_entries; i++) {
+		if (copy_from_user(&ent, &uents[i], sizeof(ent))) {
+			err = -EFAULT;
+			break;
+		}
+		ent.err = tcp_zerocopy_receive_one(&ent, zb.flags);
+		if (copy_to_user(&uents[i], &ent, sizeof(ent))) {
+			err = -EFAULT;
+			break;
+		}
+		if (signal_pending(current)) {
+			i++;
+			break;
+		}
+		cond_resched();
+	}
+
+	/* Report partial progress rather than the error */
+	if (i || !err) {
+		zb.nr_entries = i;
+		err = copy_to_sockptr(optval, &zb, sizeof(zb)) ? -EFAULT : 0;
+	}
+	return err;
+}
 #endif
 
 /* Similar to __sock_recv_timestamp, but does not require an skb */
@@ -4617,6 +4705,8 @@ int do_tcp_getsockopt(struct sock *sk, int level,
 			err = -EFAULT;
 		return err;
 	}
+	case TCP_ZEROCOPY_RECEIVE_BATCH:
+		return tcp_zerocopy_receive_batch(optval, optlen);
 #endif
 	case TCP_AO_REPAIR:
 		if (!tcp_can_repair_sock(sk))
@@ -5089,6 +5179,9 @@ void __init tcp_init(void)
 	 * hash tables.
 	 *
 	 * The methodology is similar to that of the buffer cache.
+	 * The established table can not be resized once sockets are
+	 * hashed, so let it keep scaling with memory up to 4M slots
+	 * (512 GB) on hosts holding millions of sockets.
 	 */
 	tcp_hashinfo.ehash =
 		alloc_large_system_hash("TCP established",
@@ -5099,7 +5192,7 @@ void __init tcp_init(void)
 					NULL,
 					&tcp_hashinfo.ehash_mask,
 					0,
-					thash_entries ? 0 : 512 * 1024);
+					thash_entries ? 0 : 4 * 1024 * 1024);
 	for (i = 0; i <= tcp_hashinfo.ehash_mask; i++)
 		INIT_HLIST_NULLS_HEAD(&tcp_hashinfo.ehash[i].chain, i);
 
@@ -0,0 +1,1315 @@
+/* Bottleneck Bandwidth and RTT (BBR) congestion control, version 3
+ *
+ * BBRv3 keeps the model of tcp_bbr.c (windowed max delivery rate and min RTT)
+ * and adds explicit bounds on the amount of data in flight, learned from
+ * packet loss and ECN marks:
+ *
+ *   inflight_hi: the highest volume of data in flight that did not see
+ *                excessive loss or ECN marks when probing for bandwidth.
+ *   bw_lo, inflight_lo: short-term lower bounds, cut multiplicatively on
+ *                each round trip with loss or ECN marks and reset when
+ *                probing again.
+ *
+ *   bw = min(max_bw, bw_lo)
+ *   pacing_rate = pacing_gain * bw
+ *   cwnd = min(cwnd_gain * bw * min_rtt, inflight_hi or its headroom,
+ *              inflight_lo)
+ *
+ * PROBE_BW is a sequence of phases instead of an 8-phase gain cycle:
+ *
+ *   DOWN ---> CRUISE ---> REFILL ---> UP ---+
+ *    ^                                      |
+ *    +--------------------------------------+
+ *
+ * DOWN drains the queue built by the last probe, CRUISE shares the link below
+ * inflight_hi with some headroom for other flows, REFILL lifts the lower
+ * bounds and fills the pipe for one round, and UP raises inflight_hi with a
+ * growing slope until it sees the queue is too high or it has probed for a
+ * full BDP. The time between probes is the shorter of a randomized 2-3
+ * seconds and the time a Reno flow with the same BDP takes to grow its cwnd
+ * by one BDP, to coexist with loss-based flows.
+ *
+ * The rate samples of this stack carry no per packet in-flight at send
+ * time, so the loss rate of a probe is estimated against the in-flight data
+ * at ACK time and the losses and CE marks accumulated over the round.
+ *
+ * BBRv3 is described in the IETF CCWG drafts on BBR and in:
+ *   "BBRv3: Algorithm Bug Fixes and Public Internet Deployment",
+ *   Neal Cardwell et al., IETF 117, July 2023.
+ */
+#include <linux/module.h>
+#include <net/tcp.h>
+#include <linux/inet_diag.h>
+#include <linux/inet.h>
+#include <linux/random.h>
+
+/* Scale factor for rate in pkt/uSec unit, see tcp_bbr.c. */
+#define BW_SCALE 24
+#define BW_UNIT (1 << BW_SCALE)
+
+#define BBR_SCALE 8	/* scaling factor for fractions in BBR (e.g. gains) */
+#define BBR_UNIT (1 << BBR_SCALE)
+
+/* BBR has the following modes for deciding how fast to send: */
+enum bbr3_mode {
+	BBR_STARTUP,	/* ramp up sending rate rapidly to fill pipe */
+	BBR_DRAIN,	/* drain any queue created during startup */
+	BBR_PROBE_BW,	/* discover, share bw: pace around estimated bw */
+	BBR_PROBE_RTT,	/* cut inflight to min to probe min_rtt */
+};
+
+/* The phases of BBR_PROBE_BW mode: */
+enum bbr3_pacing_gain_phase {
+	BBR_BW_PROBE_DOWN,	/* drain excess inflight from the queue */
+	BBR_BW_PROBE_CRUISE,	/* use pipe, w/ headroom in queue/pipe */
+	BBR_BW_PROBE_REFILL,	/* refill the pipe again to 100% */
+	BBR_BW_PROBE_UP,	/* push up inflight to probe for bw/vol */
+};
+
+/* BBRv3 congestion control block, must fit in ICSK_CA_PRIV_SIZE */
+struct bbr3 {
+	u32	min_rtt_us;		/* min RTT in min_rtt_win_sec window */
+	u32	min_rtt_stamp;		/* timestamp of min_rtt_us */
+	u32	probe_rtt_done_stamp;	/* end time for BBR_PROBE_RTT mode */
+	u32	rtt_cnt;		/* count of packet-timed rounds elapsed */
+	u32	next_rtt_delivered;	/* tp->delivered at end of round */
+	u32	cycle_stamp;		/* usec time of the last DOWN or UP start */
+	u32	bw_hi[2];		/* max recent bw of the last two cycles */
+	u32	bw_lo;			/* lower bound on bw, ~0U if unset */
+	u32	bw_latest;		/* max delivered bw in this round */
+	u32	inflight_hi;		/* upper bound of inflight data */
+	u32	inflight_lo;		/* lower bound of inflight data */
+	u32	inflight_latest;	/* max delivered data in this round */
+	u32	mode:2,			/* current bbr3_mode in state machine */
+		prev_ca_state:3,	/* CA state on previous ACK */
+		packet_conservation:1,	/* use packet conservation? */
+		round_start:1,		/* start of packet-timed tx->ack round? */
+		idle_restart:1,		/* restarting after idle? */
+		probe_rtt_round_done:1,	/* a BBR_PROBE_RTT round at min cwnd? */
+		cycle_idx:2,		/* current bbr3_pacing_gain_phase */
+		full_bw_reached:1,	/* reached full bw in Startup? */
+		full_bw_cnt:2,		/* rounds without large bw gains */
+		has_seen_rtt:1,		/* have we seen an RTT sample yet? */
+		loss_in_round:1,	/* any loss in this round? */
+		ecn_in_round:1,		/* any CE marks in this round? */
+		bw_probe_samples:1,	/* rate samples reflect a bw probe? */
+		bw_probe_stopping:1,	/* end bw_probe_samples at round start? */
+		unused:13;
+	u32	pacing_gain:10,		/* current gain for setting pacing rate */
+		cwnd_gain:10,		/* current gain for setting cwnd */
+		unused_b:12;
+	u32	prior_cwnd;		/* prior cwnd upon entering loss recovery */
+	u32	full_bw;		/* recent bw, to estimate if pipe is full */
+	u32	round_lost;		/* tp->lost at start of this round */
+	u32	round_ce;		/* tp->delivered_ce at start of this round */
+	u32	probe_wait_us;		/* PROBE_BW wait before probing again */
+	u32	bw_probe_up_cnt;	/* packets acked per inflight_hi increment */
+	u32	bw_probe_up_acks;	/* packets acked toward next increment */
+	u32	ecn_alpha:9,		/* EWMA of the CE marked fraction */
+		rounds_since_probe:8,	/* packet-timed rounds since last probe */
+		bw_probe_up_rounds:5,	/* rounds of doubling the UP slope */
+		unused_c:10;
+
+	/* For tracking ACK aggregation: */
+	u32	ack_epoch_stamp;	/* usec start of ACK sampling epoch */
+	u16	extra_acked[2];		/* max excess data ACKed in epoch */
+	u32	ack_epoch_acked:20,	/* packets (S)ACKed in sampling epoch */
+		extra_acked_win_rtts:5,	/* age of extra_acked, in round trips */
+		extra_acked_win_idx:1,	/* current index in extra_acked array */
+		unused_d:6;
+};
+
+/* Window length of min_rtt filter (in sec), which also paces PROBE_RTT: */
+static const u32 bbr3_min_rtt_win_sec = 5;
+/* Minimum time (in ms) spent at the PROBE_RTT cwnd: */
+static const u32 bbr3_probe_rtt_mode_ms = 200;
+/* Skip TSO below the following bandwidth (bits/sec): */
+static const int bbr3_min_tso_rate = 1200000;
+
+/* Pace at ~1% below estimated bw, on average, to reduce queue at bottleneck. */
+static const int bbr3_pacing_margin_percent = 1;
+
+/* The pacing gain in STARTUP doubles the sending rate each round: */
+static const int bbr3_startup_pacing_gain = BBR_UNIT * 277 / 100 + 1;
+/* The cwnd gain in STARTUP: */
+static const int bbr3_startup_cwnd_gain = BBR_UNIT * 2;
+/* The pacing gain in DRAIN drains the STARTUP queue in about a round: */
+static const int bbr3_drain_gain = BBR_UNIT * 35 / 100;
+/* The gain for deriving steady-state cwnd tolerates delayed/stretched ACKs: */
+static const int bbr3_cwnd_gain = BBR_UNIT * 2;
+/* The pacing gains of the PROBE_BW phases: */
+static const int bbr3_pacing_gain[] = {
+	[BBR_BW_PROBE_DOWN]	= BBR_UNIT * 90 / 100,
+	[BBR_BW_PROBE_CRUISE]	= BBR_UNIT,
+	[BBR_BW_PROBE_REFILL]	= BBR_UNIT,
+	[BBR_BW_PROBE_UP]	= BBR_UNIT * 5 / 4,
+};
+/* The cwnd gain in PROBE_BW UP leaves room for the probe to fill the pipe: */
+static const int bbr3_probe_up_cwnd_gain = BBR_UNIT * 9 / 4;
+/* The cwnd in PROBE_RTT, as a fraction of the estimated BDP: */
+static const int bbr3_probe_rtt_cwnd_gain = BBR_UNIT / 2;
+
+/* Try to keep at least this many packets in flight, if things go smoothly. */
+static const u32 bbr3_cwnd_min_target = 4;
+
+/* To estimate if STARTUP has filled pipe... */
+/* If bw has increased significantly (1.25x), there may be more bw available: */
+static const u32 bbr3_full_bw_thresh = BBR_UNIT * 5 / 4;
+/* But after 3 rounds w/o significant bw growth, estimate pipe is full: */
+static const u32 bbr3_full_bw_cnt = 3;
+/* Exit STARTUP if a round has this many losses and a high loss rate: */
+static const u32 bbr3_full_loss_cnt = 6;
+
+/* Inflight is too high if more than 2% of it is lost: */
+static const u32 bbr3_loss_thresh = BBR_UNIT * 2 / 100;
+/* Multiplicative decrease of the lower bounds upon a round with loss: */
+static const u32 bbr3_beta = BBR_UNIT * 70 / 100;
+/* Leave 15% of inflight_hi as headroom for other flows when cruising: */
+static const u32 bbr3_inflight_headroom = BBR_UNIT * 15 / 100;
+
+/* ECN is only used as a signal on paths with a low min_rtt: */
+static const u32 bbr3_ecn_max_rtt_us = 5000;
+/* Inflight is too high if more than 50% of a round is CE marked: */
+static const u32 bbr3_ecn_thresh = BBR_UNIT / 2;
+/* Gain of the EWMA of the CE marked fraction: */
+static const u32 bbr3_ecn_alpha_gain = BBR_UNIT / 16;
+/* Scale of the inflight_lo cut upon a round with CE marks: */
+static const u32 bbr3_ecn_factor = BBR_UNIT / 3;
+
+/* Wait 2 to 3 seconds between bandwidth probes: */
+static const u32 bbr3_bw_probe_base_us = 2 * USEC_PER_SEC;
+static const u32 bbr3_bw_probe_rand_us = 1 * USEC_PER_SEC;
+/* But do not wait more rounds than a Reno flow would take to grow a BDP: */
+static const u32 bbr3_bw_probe_max_rounds = 63;
+/* Randomize the round count that starts the Reno coexistence clock: */
+static const u32 bbr3_bw_probe_rand_rounds = 2;
+
+/* Gain factor for adding extra_acked to target cwnd: */
+static const int bbr3_extra_acked_gain = BBR_UNIT;
+/* Window length of extra_acked window. */
+static const u32 bbr3_extra_acked_win_rtts = 5;
+/* Max allowed val for ack_epoch_acked, after which sampling epoch is reset */
+static const u32 bbr3_ack_epoch_acked_reset_thresh = 1U << 20;
+/* Time period for clamping cwnd increment due to ack aggregation */
+static const u32 bbr3_extra_acked_max_us = 100 * 1000;
+
+static void bbr3_check_probe_rtt_done(struct sock *sk);
+static void bbr3_start_bw_probe_down(struct sock *sk);
+
+/* Do we estimate that STARTUP filled the pipe? */
+static bool bbr3_full_bw_reached(const struct sock *sk)
+{
+	const struct bbr3 *bbr = inet_csk_ca(sk);
+
+	return bbr->full_bw_reached;
+}
+
+/* Return the max recent bandwidth sample, in pkts/uS << BW_SCALE. */
+static u32 bbr3_max_bw(const struct sock *sk)
+{
+	const struct bbr3 *bbr = inet_csk_ca(sk);
+
+	return max(bbr->bw_hi[0], bbr->bw_hi[1]);
+}
+
+/* Return the estimated bandwidth of the path, in pkts/uS << BW_SCALE. */
+static u32 bbr3_bw(const struct sock *sk)
+{
+	const struct bbr3 *bbr = inet_csk_ca(sk);
+
+	return min(bbr3_max_bw(sk), bbr->bw_lo);
+}
+
+/* Start a new two-cycle window of the max bw filter. */
+static void bbr3_advance_max_bw_filter(struct sock *sk)
+{
+	struct bbr3 *bbr = inet_csk_ca(sk);
+
+	if (!bbr->bw_hi[1])
+		return;		/* no samples in this window; remember old ones */
+	bbr->bw_hi[0] = bbr->bw_hi[1];
+	bbr->bw_hi[1] = 0;
+}
+
+/* Return maximum extra acked in past k-2k round trips,
+ * where k = bbr3_extra_acked_win_rtts.
+ */
+static u16 bbr3_extra_acked(const struct sock *sk)
+{
+	const struct bbr3 *bbr = inet_csk_ca(sk);
+
+	return max(bbr->extra_acked[0], bbr->extra_acked[1]);
+}
+
+/* Return rate in bytes per second, optionally with a gain.
+ * The order here is chosen carefully to avoid overflow of u64. This should
+ * work for input rates of up to 2.9Tbit/sec and gain of 2.89x.
+ */
+static u64 bbr3_rate_bytes_per_sec(struct sock *sk, u64 rate, int gain)
+{
+	unsigned int mss = tcp_sk(sk)->mss_cache;
+
+	rate *= mss;
+	rate *= gain;
+	rate >>= BBR_SCALE;
+	rate *= USEC_PER_SEC / 100 * (100 - bbr3_pacing_margin_percent);
+	return rate >> BW_SCALE;
+}
+
+/* Convert a BBR bw and gain factor to a pacing rate in bytes per second. */
+static unsigned long bbr3_bw_to_pacing_rate(struct sock *sk, u32 bw, int gain)
+{
+	u64 rate = bw;
+
+	rate = bbr3_rate_bytes_per_sec(sk, rate, gain);
+	rate = min_t(u64, rate, READ_ONCE(sk->sk_max_pacing_rate));
+	return rate;
+}
+
+/* Initialize pacing rate to: startup_pacing_gain * init_cwnd / RTT. */
+static void bbr3_init_pacing_rate_from_rtt(struct sock *sk)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr3 *bbr = inet_csk_ca(sk);
+	u64 bw;
+	u32 rtt_us;
+
+	if (tp->srtt_us) {		/* any RTT sample yet? */
+		rtt_us = max(tp->srtt_us >> 3, 1U);
+		bbr->has_seen_rtt = 1;
+	} else {			 /* no RTT sample yet */
+		rtt_us = USEC_PER_MSEC;	 /* use nominal default RTT */
+	}
+	bw = (u64)tcp_snd_cwnd(tp) * BW_UNIT;
+	do_div(bw, rtt_us);
+	WRITE_ONCE(sk->sk_pacing_rate,
+		   bbr3_bw_to_pacing_rate(sk, bw, bbr3_startup_pacing_gain));
+}
+
+/* Pace using current bw estimate and a gain factor. */
+static void bbr3_set_pacing_rate(struct sock *sk, u32 bw, int gain)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr3 *bbr = inet_csk_ca(sk);
+	unsigned long rate = bbr3_bw_to_pacing_rate(sk, bw, gain);
+
+	if (unlikely(!bbr->has_seen_rtt && tp->srtt_us))
+		bbr3_init_pacing_rate_from_rtt(sk);
+	if (bbr3_full_bw_reached(sk) || rate > READ_ONCE(sk->sk_pacing_rate))
+		WRITE_ONCE(sk->sk_pacing_rate, rate);
+}
+
+/* override sysctl_tcp_min_tso_segs */
+static u32 bbr3_min_tso_segs(struct sock *sk)
+{
+	return READ_ONCE(sk->sk_pacing_rate) < (bbr3_min_tso_rate >> 3) ? 1 : 2;
+}
+
+static u32 bbr3_tso_segs_goal(struct sock *sk)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	u32 segs, bytes;
+
+	/* Sort of tcp_tso_autosize() but ignoring
+	 * driver provided sk_gso_max_size.
+	 */
+	bytes = min_t(unsigned long,
+		      READ_ONCE(sk->sk_pacing_rate) >> READ_ONCE(sk->sk_pacing_shift),
+		      GSO_LEGACY_MAX_SIZE - 1 - MAX_TCP_HEADER);
+	segs = max_t(u32, bytes / tp->mss_cache, bbr3_min_tso_segs(sk));
+
+	return min(segs, 0x7FU);
+}
+
+/* Save "last known good" cwnd so we can restore it after losses or PROBE_RTT */
+static void bbr3_save_cwnd(struct sock *sk)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr3 *bbr = inet_csk_ca(sk);
+
+	if (bbr->prev_ca_state < TCP_CA_Recovery && bbr->mode != BBR_PROBE_RTT)
+		bbr->prior_cwnd = tcp_snd_cwnd(tp);  /* this cwnd is good enough */
+	else  /* loss recovery or BBR_PROBE_RTT have temporarily cut cwnd */
+		bbr->prior_cwnd = max(bbr->prior_cwnd, tcp_snd_cwnd(tp));
+}
+
+static void bbr3_cwnd_event(struct sock *sk, enum tcp_ca_event event)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr3 *bbr = inet_csk_ca(sk);
+
+	if (event == CA_EVENT_TX_START && tp->app_limited) {
+		bbr->idle_restart = 1;
+		bbr->ack_epoch_stamp = tp->tcp_mstamp;
+		bbr->ack_epoch_acked = 0;
+		/* Avoid pointless buffer overflows: pace at est. bw if we don't
+		 * need more speed (we're restarting from idle and app-limited).
+		 */
+		if (bbr->mode == BBR_PROBE_BW)
+			bbr3_set_pacing_rate(sk, bbr3_bw(sk), BBR_UNIT);
+		else if (bbr->mode == BBR_PROBE_RTT)
+			bbr3_check_probe_rtt_done(sk);
+	}
+}
+
+/* Calculate bdp based on min RTT and the estimated bottleneck bandwidth:
+ *
+ * bdp = ceil(bw * min_rtt * gain)
+ */
+static u32 bbr3_bdp(struct sock *sk, u32 bw, int gain)
+{
+	struct bbr3 *bbr = inet_csk_ca(sk);
+	u64 w;
+
+	/* If we've never had a valid RTT sample, cap cwnd at the initial
+	 * default, see tcp_bbr.c.
+	 */
+	if (unlikely(bbr->min_rtt_us == ~0U))	 /* no valid RTT samples yet? */
+		return TCP_INIT_CWND;  /* be safe: cap at default initial cwnd*/
+
+	w = (u64)bw * bbr->min_rtt_us;
+
+	/* Apply a gain to the given value, remove the BW_SCALE shift, and
+	 * round the value up to avoid a negative feedback loop.
+	 */
+	return (((w * gain) >> BBR_SCALE) + BW_UNIT - 1) / BW_UNIT;
+}
+
+/* Budget enough cwnd to fit full-sized skbs in-flight on both end hosts,
+ * see tcp_bbr.c.
+ */
+static u32 bbr3_quantization_budget(struct sock *sk, u32 cwnd)
+{
+	struct bbr3 *bbr = inet_csk_ca(sk);
+
+	/* Allow enough full-sized skbs in flight to utilize end systems. */
+	cwnd += 3 * bbr3_tso_segs_goal(sk);
+
+	/* Reduce delayed ACKs by rounding up cwnd to the next even number. */
+	cwnd = (cwnd + 1) & ~1U;
+
+	/* Ensure gain cycling gets inflight above BDP even for small BDPs. */
+	if (bbr->mode == BBR_PROBE_BW && bbr->cycle_idx == BBR_BW_PROBE_UP)
+		cwnd += 2;
+
+	return cwnd;
+}
+
+/* Find inflight based on min RTT and the estimated bottleneck bandwidth. */
+static u32 bbr3_inflight(struct sock *sk, u32 bw, int gain)
+{
+	u32 inflight;
+
+	inflight = bbr3_bdp(sk, bw, gain);
+	inflight = bbr3_quantization_budget(sk, inflight);
+
+	return inflight;
+}
+
+/* The inflight the flow aims for when it is not probing. */
+static u32 bbr3_target_inflight(struct sock *sk)
+{
+	return min(bbr3_bdp(sk, bbr3_bw(sk), BBR_UNIT), tcp_snd_cwnd(tcp_sk(sk)));
+}
+
+/* inflight_hi minus some headroom, to leave space for other flows. */
+static u32 bbr3_inflight_with_headroom(const struct sock *sk)
+{
+	const struct bbr3 *bbr = inet_csk_ca(sk);
+	u32 headroom;
+
+	if (bbr->inflight_hi == ~0U)
+		return ~0U;
+
+	headroom = max_t(u32, 1, ((u64)bbr->inflight_hi *
+				  bbr3_inflight_headroom) >> BBR_SCALE);
+	return max_t(s32, bbr->inflight_hi - headroom, bbr3_cwnd_min_target);
+}
+
+/* Estimate the number of our packets that might be in the network at the
+ * earliest departure time for the next skb scheduled, see tcp_bbr.c.
+ */
+static u32 bbr3_packets_in_net_at_edt(struct sock *sk, u32 inflight_now)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr3 *bbr = inet_csk_ca(sk);
+	u64 now_ns, edt_ns, interval_us;
+	u32 interval_delivered, inflight_at_edt;
+
+	now_ns = tp->tcp_clock_cache;
+	edt_ns = max(tp->tcp_wstamp_ns, now_ns);
+	interval_us = div_u64(edt_ns - now_ns, NSEC_PER_USEC);
+	interval_delivered = (u64)bbr3_bw(sk) * interval_us >> BW_SCALE;
+	inflight_at_edt = inflight_now;
+	if (bbr->pacing_gain > BBR_UNIT)              /* increasing inflight */
+		inflight_at_edt += bbr3_tso_segs_goal(sk);  /* include EDT skb */
+	if (interval_delivered >= inflight_at_edt)
+		return 0;
+	return inflight_at_edt - interval_delivered;
+}
+
+/* Find the cwnd increment based on estimate of ack aggregation */
+static u32 bbr3_ack_aggregation_cwnd(struct sock *sk)
+{
+	u32 max_aggr_cwnd, aggr_cwnd = 0;
+
+	if (bbr3_extra_acked_gain && bbr3_full_bw_reached(sk)) {
+		max_aggr_cwnd = ((u64)bbr3_bw(sk) * bbr3_extra_acked_max_us)
+				/ BW_UNIT;
+		aggr_cwnd = (bbr3_extra_acked_gain * bbr3_extra_acked(sk))
+			     >> BBR_SCALE;
+		aggr_cwnd = min(aggr_cwnd, max_aggr_cwnd);
+	}
+
+	return aggr_cwnd;
+}
+
+/* On the first round of recovery, follow the packet conservation principle,
+ * then slow-start. After recovery, or upon undo, restore the cwnd we had when
+ * recovery started, see tcp_bbr.c.
+ */
+static bool bbr3_set_cwnd_to_recover_or_restore(
+	struct sock *sk, const struct rate_sample *rs, u32 acked, u32 *new_cwnd)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr3 *bbr = inet_csk_ca(sk);
+	u8 prev_state = bbr->prev_ca_state, state = inet_csk(sk)->icsk_ca_state;
+	u32 cwnd = tcp_snd_cwnd(tp);
+
+	if (rs->losses > 0)
+		cwnd = max_t(s32, cwnd - rs->losses, 1);
+
+	if (state == TCP_CA_Recovery && prev_state != TCP_CA_Recovery) {
+		/* Starting 1st round of Recovery, so do packet conservation. */
+		bbr->packet_conservation = 1;
+		bbr->next_rtt_delivered = tp->delivered;  /* start round now */
+		/* Cut unused cwnd from app behavior, TSQ, or TSO deferral: */
+		cwnd = tcp_packets_in_flight(tp) + acked;
+	} else if (prev_state >= TCP_CA_Recovery && state < TCP_CA_Recovery) {
+		/* Exiting loss recovery; restore cwnd saved before recovery. */
+		cwnd = max(cwnd, bbr->prior_cwnd);
+		bbr->packet_conservation = 0;
+	}
+	bbr->prev_ca_state = state;
+
+	if (bbr->packet_conservation) {
+		*new_cwnd = max(cwnd, tcp_packets_in_flight(tp) + acked);
+		return true;	/* yes, using packet conservation */
+	}
+	*new_cwnd = cwnd;
+	return false;
+}
+
+/* Cap cwnd by the upper and lower bounds of the inflight model. When probing
+ * inflight_hi itself is the cap, otherwise leave headroom for other flows.
+ */
+static u32 bbr3_bound_cwnd_for_inflight_model(struct sock *sk, u32 cwnd)
+{
+	struct bbr3 *bbr = inet_csk_ca(sk);
+	u32 cap = ~0U;
+
+	if (bbr->mode == BBR_PROBE_BW &&
+	    bbr->cycle_idx != BBR_BW_PROBE_CRUISE)
+		cap = bbr->inflight_hi;
+	else if (bbr->mode == BBR_PROBE_RTT ||
+		 (bbr->mode == BBR_PROBE_BW &&
+		  bbr->cycle_idx == BBR_BW_PROBE_CRUISE))
+		cap = bbr3_inflight_with_headroom(sk);
+
+	cap = min(cap, bbr->inflight_lo);
+	cap = max(cap, bbr3_cwnd_min_target);
+	return min(cwnd, cap);
+}
+
+/* Slow-start up toward target cwnd (if bw estimate is growing, or packet loss
+ * has drawn us down below target), or snap down to target if we're above it.
+ */
+static void bbr3_set_cwnd(struct sock *sk, const struct rate_sample *rs,
+			  u32 acked, u32 bw, int gain)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr3 *bbr = inet_csk_ca(sk);
+	u32 cwnd = tcp_snd_cwnd(tp), target_cwnd = 0;
+
+	if (!acked)
+		goto done;  /* no packet fully ACKed; just apply caps */
+
+	if (bbr3_set_cwnd_to_recover_or_restore(sk, rs, acked, &cwnd))
+		goto done;
+
+	target_cwnd = bbr3_bdp(sk, bw, gain);
+
+	/* Increment the cwnd to account for excess ACKed data that seems
+	 * due to aggregation (of data and/or ACKs) visible in the ACK stream.
+	 */
+	target_cwnd += bbr3_ack_aggregation_cwnd(sk);
+	target_cwnd = bbr3_quantization_budget(sk, target_cwnd);
+
+	/* If we're below target cwnd, slow start cwnd toward target cwnd. */
+	if (bbr3_full_bw_reached(sk))  /* only cut cwnd if we filled the pipe */
+		cwnd = min(cwnd + acked, target_cwnd);
+	else if (cwnd < target_cwnd || tp->delivered < TCP_INIT_CWND)
+		cwnd = cwnd + acked;
+	cwnd = max(cwnd, bbr3_cwnd_min_target);
+
+done:
+	cwnd = min(cwnd, tp->snd_cwnd_clamp);	/* apply global cap */
+	cwnd = bbr3_bound_cwnd_for_inflight_model(sk, cwnd);
+	if (bbr->mode == BBR_PROBE_RTT)  /* drain queue, refresh min_rtt */
+		cwnd = min(cwnd, max(bbr3_bdp(sk, bw, bbr3_probe_rtt_cwnd_gain),
+				     bbr3_cwnd_min_target));
+	tcp_snd_cwnd_set(tp, cwnd);
+}
+
+/* Is ECN a trustworthy congestion signal for this flow? */
+static bool bbr3_ecn_eligible(const struct sock *sk)
+{
+	const struct bbr3 *bbr = inet_csk_ca(sk);
+
+	return (tcp_sk(sk)->ecn_flags & TCP_ECN_OK) &&
+	       bbr->min_rtt_us <= bbr3_ecn_max_rtt_us;
+}
+
+/* Did this round lose more than bbr3_loss_thresh of the data in flight?
+ * Losses of the round are compared to the larger of the data delivered or
+ * lost so far in the round and the data in flight before this ACK.
+ */
+static bool bbr3_is_loss_too_high(const struct sock *sk,
+				  const struct rate_sample *rs)
+{
+	const struct tcp_sock *tp = tcp_sk(sk);
+	const struct bbr3 *bbr = inet_csk_ca(sk);
+	u32 lost = tp->lost - bbr->round_lost;
+	u32 base;
+
+	if (!lost)
+		return false;
+
+	base = max(lost + tp->delivered - bbr->next_rtt_delivered,
+		   rs->prior_in_flight);
+	return (u64)lost * BBR_UNIT > (u64)base * bbr3_loss_thresh;
+}
+
+/* Was more than bbr3_ecn_thresh of the data delivered in this round marked? */
+static bool bbr3_is_ecn_too_high(const struct sock *sk)
+{
+	const struct tcp_sock *tp = tcp_sk(sk);
+	const struct bbr3 *bbr = inet_csk_ca(sk);
+	u32 delivered = tp->delivered - bbr->next_rtt_delivered;
+	u32 ce = tp->delivered_ce - bbr->round_ce;
+
+	if (!ce || !delivered || !bbr3_ecn_eligible(sk))
+		return false;
+
+	return (u64)ce * BBR_UNIT > (u64)delivered * bbr3_ecn_thresh;
+}
+
+/* Update the EWMA of the CE marked fraction at the end of a round. */
+static void bbr3_update_ecn_alpha(struct sock *sk, u32 delivered)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr3 *bbr = inet_csk_ca(sk);
+	u32 ce = tp->delivered_ce - bbr->round_ce;
+	u32 ce_ratio;
+
+	if (!delivered || !bbr3_ecn_eligible(sk))
+		return;
+
+	ce_ratio = min_t(u64, BBR_UNIT, (u64)ce * BBR_UNIT / delivered);
+	bbr->ecn_alpha = ((BBR_UNIT - bbr3_ecn_alpha_gain) * bbr->ecn_alpha +
+			  bbr3_ecn_alpha_gain * ce_ratio) >> BBR_SCALE;
+}
+
+static bool bbr3_is_probing_bandwidth(const struct sock *sk)
+{
+	const struct bbr3 *bbr = inet_csk_ca(sk);
+
+	return bbr->mode == BBR_STARTUP ||
+	       (bbr->mode == BBR_PROBE_BW &&
+		(bbr->cycle_idx == BBR_BW_PROBE_REFILL ||
+		 bbr->cycle_idx == BBR_BW_PROBE_UP));
+}
+
+static void bbr3_reset_lower_bounds(struct sock *sk)
+{
+	struct bbr3 *bbr = inet_csk_ca(sk);
+
+	bbr->bw_lo = ~0U;
+	bbr->inflight_lo = ~0U;
+}
+
+/* Once per round with loss or CE marks, when not probing, cut the lower
+ * bounds: a multiplicative decrease by bbr3_beta that does not go below
+ * what the round actually delivered, and a cut of inflight_lo that scales
+ * with the recent CE marked fraction.
+ */
+static void bbr3_adapt_lower_bounds(struct sock *sk)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr3 *bbr = inet_csk_ca(sk);
+
+	if (bbr3_is_probing_bandwidth(sk))
+		return;
+
+	if (bbr->ecn_in_round && bbr3_ecn_eligible(sk)) {
+		u32 cut;
+
+		if (bbr->inflight_lo == ~0U)
+			bbr->inflight_lo = tcp_snd_cwnd(tp);
+		cut = ((u64)bbr->inflight_lo * bbr->ecn_alpha *
+		       bbr3_ecn_factor) >> (2 * BBR_SCALE);
+		bbr->inflight_lo = max_t(s32, bbr->inflight_lo - cut,
+					 bbr3_cwnd_min_target);
+	}
+
+	if (bbr->loss_in_round) {
+		if (bbr->bw_lo == ~0U)
+			bbr->bw_lo = bbr3_max_bw(sk);
+		if (bbr->inflight_lo == ~0U)
+			bbr->inflight_lo = tcp_snd_cwnd(tp);
+		bbr->bw_lo = max_t(u32, bbr->bw_latest,
+				   (u64)bbr->bw_lo * bbr3_beta >> BBR_SCALE);
+		bbr->inflight_lo = max_t(u32, bbr->inflight_latest,
+					 (u64)bbr->inflight_lo * bbr3_beta >>
+					 BBR_SCALE);
+	}
+}
+
+/* See if we've reached the next round trip; if so, react to the congestion
+ * signals of the round that just ended and start accounting a new one.
+ */
+static void bbr3_update_round(struct sock *sk, const struct rate_sample *rs)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr3 *bbr = inet_csk_ca(sk);
+
+	bbr->round_start = 0;
+	if (rs->delivered < 0 || rs->interval_us <= 0)
+		return; /* Not a valid observation */
+
+	if (before(rs->prior_delivered, bbr->next_rtt_delivered))
+		return;
+
+	bbr3_update_ecn_alpha(sk, tp->delivered - bbr->next_rtt_delivered);
+	bbr3_adapt_lower_bounds(sk);
+
+	bbr->next_rtt_delivered = tp->delivered;
+	bbr->round_lost = tp->lost;
+	bbr->round_ce = tp->delivered_ce;
+	bbr->loss_in_round = 0;
+	bbr->ecn_in_round = 0;
+	bbr->bw_latest = 0;
+	bbr->inflight_latest = 0;
+	bbr->rtt_cnt++;
+	if (bbr->rounds_since_probe < 0xFF)
+		bbr->rounds_since_probe++;
+	bbr->round_start = 1;
+	bbr->packet_conservation = 0;
+}
+
+/* Estimate the bandwidth based on how fast packets are delivered */
+static void bbr3_update_bw(struct sock *sk, const struct rate_sample *rs)
+{
+	struct bbr3 *bbr = inet_csk_ca(sk);
+	u64 bw;
+
+	bbr->loss_in_round |= (rs->losses > 0);
+	bbr->ecn_in_round |= (rs->delivered_ce > 0);
+
+	if (rs->delivered < 0 || rs->interval_us <= 0)
+		return; /* Not a valid observation */
+
+	bw = div64_long((u64)rs->delivered * BW_UNIT, rs->interval_us);
+
+	bbr->bw_latest = max_t(u32, bbr->bw_latest, bw);
+	bbr->inflight_latest = max_t(u32, bbr->inflight_latest, rs->delivered);
+
+	/* Filter out app-limited samples unless they describe the path bw at
+	 * least as well as our bw model, see tcp_bbr.c.
+	 */
+	if (!rs->is_app_limited || bw >= bbr3_max_bw(sk))
+		bbr->bw_hi[1] = max_t(u32, bbr->bw_hi[1], bw);
+}
+
+/* Estimates the windowed max degree of ack aggregation, see tcp_bbr.c. */
+static void bbr3_update_ack_aggregation(struct sock *sk,
+					const struct rate_sample *rs)
+{
+	u32 epoch_us, expected_acked, extra_acked;
+	struct bbr3 *bbr = inet_csk_ca(sk);
+	struct tcp_sock *tp = tcp_sk(sk);
+
+	if (!bbr3_extra_acked_gain || rs->acked_sacked <= 0 ||
+	    rs->delivered < 0 || rs->interval_us <= 0)
+		return;
+
+	if (bbr->round_start) {
+		bbr->extra_acked_win_rtts = min(0x1F,
+						bbr->extra_acked_win_rtts + 1);
+		if (bbr->extra_acked_win_rtts >= bbr3_extra_acked_win_rtts) {
+			bbr->extra_acked_win_rtts = 0;
+			bbr->extra_acked_win_idx = bbr->extra_acked_win_idx ?
+						   0 : 1;
+			bbr->extra_acked[bbr->extra_acked_win_idx] = 0;
+		}
+	}
+
+	/* Compute how many packets we expected to be delivered over epoch. */
+	epoch_us = (u32)tp->delivered_mstamp - bbr->ack_epoch_stamp;
+	expected_acked = ((u64)bbr3_bw(sk) * epoch_us) / BW_UNIT;
+
+	/* Reset the aggregation epoch if ACK rate is below expected rate or
+	 * significantly large no. of ack received since epoch (potentially
+	 * quite old epoch).
+	 */
+	if (bbr->ack_epoch_acked <= expected_acked ||
+	    (bbr->ack_epoch_acked + rs->acked_sacked >=
+	     bbr3_ack_epoch_acked_reset_thresh)) {
+		bbr->ack_epoch_acked = 0;
+		bbr->ack_epoch_stamp = tp->delivered_mstamp;
+		expected_acked = 0;
+	}
+
+	/* Compute excess data delivered, beyond what was expected. */
+	bbr->ack_epoch_acked = min_t(u32, 0xFFFFF,
+				     bbr->ack_epoch_acked + rs->acked_sacked);
+	extra_acked = bbr->ack_epoch_acked - expected_acked;
+	extra_acked = min(extra_acked, tcp_snd_cwnd(tp));
+	if (extra_acked > bbr->extra_acked[bbr->extra_acked_win_idx])
+		bbr->extra_acked[bbr->extra_acked_win_idx] = extra_acked;
+}
+
+/* Estimate when the pipe is full, using the change in delivery rate, see
+ * tcp_bbr.c. In addition, leave STARTUP once a round has shown that the
+ * queue is too high, with a high loss rate or many CE marks, and remember
+ * the inflight seen then as the upper bound.
+ */
+static void bbr3_check_full_bw_reached(struct sock *sk,
+				       const struct rate_sample *rs)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr3 *bbr = inet_csk_ca(sk);
+	u32 bw_thresh;
+
+	if (bbr3_full_bw_reached(sk))
+		return;
+
+	if ((bbr3_is_loss_too_high(sk, rs) &&
+	     tp->lost - bbr->round_lost >= bbr3_full_loss_cnt) ||
+	    bbr3_is_ecn_too_high(sk)) {
+		bbr->inflight_hi = max(bbr3_bdp(sk, bbr3_max_bw(sk), BBR_UNIT),
+				       bbr->inflight_latest);
+		bbr->full_bw_reached = 1;
+		return;
+	}
+
+	if (!bbr->round_start || rs->is_app_limited)
+		return;
+
+	bw_thresh = (u64)bbr->full_bw * bbr3_full_bw_thresh >> BBR_SCALE;
+	if (bbr3_max_bw(sk) >= bw_thresh) {
+		bbr->full_bw = bbr3_max_bw(sk);
+		bbr->full_bw_cnt = 0;
+		return;
+	}
+	++bbr->full_bw_cnt;
+	bbr->full_bw_reached = bbr->full_bw_cnt >= bbr3_full_bw_cnt;
+}
+
+/* If pipe is probably full, drain the queue and then enter steady-state. */
+static void bbr3_check_drain(struct sock *sk, const struct rate_sample *rs)
+{
+	struct bbr3 *bbr = inet_csk_ca(sk);
+
+	if (bbr->mode == BBR_STARTUP && bbr3_full_bw_reached(sk)) {
+		bbr->mode = BBR_DRAIN;	/* drain queue we created */
+		tcp_sk(sk)->snd_ssthresh =
+				bbr3_inflight(sk, bbr3_max_bw(sk), BBR_UNIT);
+	}	/* fall through to check if in-flight is already small: */
+	if (bbr->mode == BBR_DRAIN &&
+	    bbr3_packets_in_net_at_edt(sk, tcp_packets_in_flight(tcp_sk(sk))) <=
+	    bbr3_inflight(sk, bbr3_max_bw(sk), BBR_UNIT)) {
+		bbr->mode = BBR_PROBE_BW;  /* we estimate queue is drained */
+		bbr3_start_bw_probe_down(sk);
+	}
+}
+
+static bool bbr3_has_elapsed_in_phase(const struct sock *sk, u32 interval_us)
+{
+	const struct bbr3 *bbr = inet_csk_ca(sk);
+
+	return (s32)((u32)tcp_sk(sk)->delivered_mstamp -
+		     (bbr->cycle_stamp + interval_us)) > 0;
+}
+
+static void bbr3_set_cycle_idx(struct sock *sk, int cycle_idx)
+{
+	struct bbr3 *bbr = inet_csk_ca(sk);
+
+	bbr->cycle_idx = cycle_idx;
+}
+
+/* Grow inflight_hi by 1, 2, 4, ... packets in successive rounds of UP. */
+static void bbr3_raise_inflight_hi_slope(struct sock *sk)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr3 *bbr = inet_csk_ca(sk);
+	u32 growth_this_round;
+
+	growth_this_round = 1 << bbr->bw_probe_up_rounds;
+	bbr->bw_probe_up_rounds = min(bbr->bw_probe_up_rounds + 1, 30);
+	bbr->bw_probe_up_cnt = max(tcp_snd_cwnd(tp) / growth_this_round, 1U);
+}
+
+/* In UP, raise inflight_hi if the flow is actually using all of it. */
+static void bbr3_probe_inflight_hi_upward(struct sock *sk,
+					  const struct rate_sample *rs)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr3 *bbr = inet_csk_ca(sk);
+	u32 delta;
+
+	if (!tcp_is_cwnd_limited(sk) || tcp_snd_cwnd(tp) < bbr->inflight_hi)
+		return;
+
+	bbr->bw_probe_up_acks += rs->acked_sacked;
+	if (bbr->bw_probe_up_acks >= bbr->bw_probe_up_cnt) {
+		delta = bbr->bw_probe_up_acks / bbr->bw_probe_up_cnt;
+		bbr->bw_probe_up_acks -= delta * bbr->bw_probe_up_cnt;
+		bbr->inflight_hi += delta;
+	}
+
+	if (bbr->round_start)
+		bbr3_raise_inflight_hi_slope(sk);
+}
+
+static void bbr3_start_bw_probe_down(struct sock *sk)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr3 *bbr = inet_csk_ca(sk);
+
+	/* Start a round now: once it ends, the samples sent while probing
+	 * have all been acked, see bbr3_update_cycle_phase().
+	 */
+	bbr->next_rtt_delivered = tp->delivered;
+	bbr->round_lost = tp->lost;
+	bbr->round_ce = tp->delivered_ce;
+	bbr->loss_in_round = 0;
+	bbr->ecn_in_round = 0;
+	bbr->bw_probe_stopping = bbr->bw_probe_samples;
+
+	bbr3_advance_max_bw_filter(sk);
+	bbr->bw_probe_up_cnt = ~0U;
+	bbr->probe_wait_us = bbr3_bw_probe_base_us +
+			     get_random_u32_below(bbr3_bw_probe_rand_us);
+	bbr->rounds_since_probe =
+		get_random_u32_below(bbr3_bw_probe_rand_rounds);
+	/* the wait before the next probe spans both DOWN and CRUISE */
+	bbr->cycle_stamp = tp->delivered_mstamp;
+	bbr3_set_cycle_idx(sk, BBR_BW_PROBE_DOWN);
+}
+
+static void bbr3_start_bw_probe_cruise(struct sock *sk)
+{
+	struct bbr3 *bbr = inet_csk_ca(sk);
+
+	if (bbr->inflight_lo != ~0U)
+		bbr->inflight_lo = min(bbr->inflight_lo, bbr->inflight_hi);
+	bbr3_set_cycle_idx(sk, BBR_BW_PROBE_CRUISE);
+}
+
+/* Lift the lower bounds and fill the pipe for a round before probing up,
+ * so that the probe starts from a full pipe.
+ */
+static void bbr3_start_bw_probe_refill(struct sock *sk)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr3 *bbr = inet_csk_ca(sk);
+
+	bbr3_reset_lower_bounds(sk);
+	bbr->bw_probe_up_rounds = 0;
+	bbr->bw_probe_up_acks = 0;
+	bbr->next_rtt_delivered = tp->delivered;  /* start round now */
+	bbr3_set_cycle_idx(sk, BBR_BW_PROBE_REFILL);
+}
+
+static void bbr3_start_bw_probe_up(struct sock *sk)
+{
+	struct bbr3 *bbr = inet_csk_ca(sk);
+
+	bbr->bw_probe_up_acks = 0;
+	bbr->bw_probe_samples = 1;
+	bbr->bw_probe_stopping = 0;
+	bbr->cycle_stamp = tcp_sk(sk)->delivered_mstamp;
+	bbr3_set_cycle_idx(sk, BBR_BW_PROBE_UP);
+	bbr3_raise_inflight_hi_slope(sk);
+}
+
+/* Time to probe again: once the randomized wait elapsed, or once a Reno flow
+ * with the same BDP would have probed, whichever comes first.
+ */
+static bool bbr3_check_time_to_probe_bw(struct sock *sk)
+{
+	struct bbr3 *bbr = inet_csk_ca(sk);
+	u32 rounds;
+
+	rounds = min(bbr3_bw_probe_max_rounds, bbr3_target_inflight(sk));
+	if (bbr3_has_elapsed_in_phase(sk, bbr->probe_wait_us) ||
+	    bbr->rounds_since_probe >= rounds) {
+		bbr3_start_bw_probe_refill(sk);
+		return true;
+	}
+	return false;
+}
+
+/* Cruise once the queue built while probing has drained. */
+static bool bbr3_check_time_to_cruise(struct sock *sk, u32 inflight, u32 bw)
+{
+	if (inflight > bbr3_inflight_with_headroom(sk))
+		return false;
+
+	return inflight <= bbr3_inflight(sk, bw, BBR_UNIT);
+}
+
+/* The probe drove the queue too high: remember the inflight it reached as the
+ * upper bound, not less than bbr3_beta of the current target, and back off.
+ */
+static void bbr3_handle_inflight_too_high(struct sock *sk,
+					  const struct rate_sample *rs)
+{
+	struct bbr3 *bbr = inet_csk_ca(sk);
+
+	bbr->bw_probe_samples = 0;
+	if (!rs->is_app_limited)
+		bbr->inflight_hi = max_t(u32, rs->prior_in_flight,
+					 (u64)bbr3_target_inflight(sk) *
+					 bbr3_beta >> BBR_SCALE);
+	if (bbr->mode == BBR_PROBE_BW &&
+	    bbr->cycle_idx == BBR_BW_PROBE_UP)
+		bbr3_start_bw_probe_down(sk);
+}
+
+/* The PROBE_BW state machine: DOWN -> CRUISE -> REFILL -> UP -> DOWN. */
+static void bbr3_update_cycle_phase(struct sock *sk,
+				    const struct rate_sample *rs)
+{
+	struct bbr3 *bbr = inet_csk_ca(sk);
+	bool is_full_length;
+	u32 inflight, bw;
+
+	if (bbr->mode != BBR_PROBE_BW)
+		return;
+
+	/* A round after DOWN started, samples no longer reflect the probe. */
+	if (bbr->bw_probe_stopping && bbr->round_start) {
+		bbr->bw_probe_samples = 0;
+		bbr->bw_probe_stopping = 0;
+	}
+
+	/* Samples sent while probing tell whether the probe pushed too far. */
+	if (bbr->bw_probe_samples &&
+	    (bbr3_is_loss_too_high(sk, rs) || bbr3_is_ecn_too_high(sk))) {
+		bbr3_handle_inflight_too_high(sk, rs);
+		return;
+	}
+
+	inflight = bbr3_packets_in_net_at_edt(sk, rs->prior_in_flight);
+	bw = bbr3_max_bw(sk);
+
+	switch (bbr->cycle_idx) {
+	case BBR_BW_PROBE_DOWN:
+		if (bbr3_check_time_to_probe_bw(sk))
+			return;
+		if (bbr3_check_time_to_cruise(sk, inflight, bw))
+			bbr3_start_bw_probe_cruise(sk);
+		break;
+
+	case BBR_BW_PROBE_CRUISE:
+		bbr3_check_time_to_probe_bw(sk);
+		break;
+
+	case BBR_BW_PROBE_REFILL:
+		/* After one round of refilling, start probing up. */
+		if (bbr->round_start)
+			bbr3_start_bw_probe_up(sk);
+		break;
+
+	case BBR_BW_PROBE_UP:
+		/* Probe for at least a min_rtt, until inflight reached the
+		 * probing gain or the flow has no data to probe with.
+		 */
+		is_full_length = bbr3_has_elapsed_in_phase(sk, bbr->min_rtt_us);
+		if (is_full_length &&
+		    (rs->is_app_limited ||
+		     inflight >= bbr3_inflight(sk, bw,
+					       bbr3_pacing_gain[BBR_BW_PROBE_UP]))) {
+			bbr3_start_bw_probe_down(sk);
+			break;
+		}
+		bbr3_probe_inflight_hi_upward(sk, rs);
+		break;
+	}
+}
+
+static void bbr3_exit_probe_rtt(struct sock *sk)
+{
+	struct bbr3 *bbr = inet_csk_ca(sk);
+
+	bbr3_reset_lower_bounds(sk);
+	if (bbr3_full_bw_reached(sk)) {
+		bbr->mode = BBR_PROBE_BW;
+		bbr3_start_bw_probe_down(sk);
+		bbr3_start_bw_probe_cruise(sk);
+	} else {
+		bbr->mode = BBR_STARTUP;
+	}
+}
+
+static void bbr3_check_probe_rtt_done(struct sock *sk)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr3 *bbr = inet_csk_ca(sk);
+
+	if (!(bbr->probe_rtt_done_stamp &&
+	      after(tcp_jiffies32, bbr->probe_rtt_done_stamp)))
+		return;
+
+	bbr->min_rtt_stamp = tcp_jiffies32;  /* wait a while until PROBE_RTT */
+	tcp_snd_cwnd_set(tp, max(tcp_snd_cwnd(tp), bbr->prior_cwnd));
+	bbr3_exit_probe_rtt(sk);
+}
+
+/* Periodically drain the bottleneck queue to re-measure min_rtt, see
+ * tcp_bbr.c. BBRv3 only halves the cwnd to the estimated BDP for this,
+ * instead of cutting it to 4 packets.
+ */
+static void bbr3_update_min_rtt(struct sock *sk, const struct rate_sample *rs)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr3 *bbr = inet_csk_ca(sk);
+	bool filter_expired;
+	u32 probe_rtt_cwnd;
+
+	/* Track min RTT seen in the min_rtt_win_sec filter window: */
+	filter_expired = after(tcp_jiffies32,
+			       bbr->min_rtt_stamp + bbr3_min_rtt_win_sec * HZ);
+	if (rs->rtt_us >= 0 &&
+	    (rs->rtt_us < bbr->min_rtt_us ||
+	     (filter_expired && !rs->is_ack_delayed))) {
+		bbr->min_rtt_us = rs->rtt_us;
+		bbr->min_rtt_stamp = tcp_jiffies32;
+	}
+
+	if (bbr3_probe_rtt_mode_ms > 0 && filter_expired &&
+	    !bbr->idle_restart && bbr->mode != BBR_PROBE_RTT) {
+		bbr->mode = BBR_PROBE_RTT;  /* dip, drain queue */
+		bbr3_save_cwnd(sk);  /* note cwnd so we can restore it */
+		bbr->probe_rtt_done_stamp = 0;
+	}
+
+	if (bbr->mode == BBR_PROBE_RTT) {
+		/* Ignore low rate samples during this mode. */
+		tp->app_limited =
+			(tp->delivered + tcp_packets_in_flight(tp)) ? : 1;
+		probe_rtt_cwnd = max(bbr3_bdp(sk, bbr3_bw(sk),
+					      bbr3_probe_rtt_cwnd_gain),
+				     bbr3_cwnd_min_target);
+		/* Maintain min packets in flight for max(200 ms, 1 round). */
+		if (!bbr->probe_rtt_done_stamp &&
+		    tcp_packets_in_flight(tp) <= probe_rtt_cwnd) {
+			bbr->probe_rtt_done_stamp = tcp_jiffies32 +
+				msecs_to_jiffies(bbr3_probe_rtt_mode_ms);
+			bbr->probe_rtt_round_done = 0;
+			bbr->next_rtt_delivered = tp->delivered;
+		} else if (bbr->probe_rtt_done_stamp) {
+			if (bbr->round_start)
+				bbr->probe_rtt_round_done = 1;
+			if (bbr->probe_rtt_round_done)
+				bbr3_check_probe_rtt_done(sk);
+		}
+	}
+	/* Restart after idle ends only once we process a new S/ACK for data */
+	if (rs->delivered > 0)
+		bbr->idle_restart = 0;
+}
+
+static void bbr3_update_gains(struct sock *sk)
+{
+	struct bbr3 *bbr = inet_csk_ca(sk);
+
+	switch (bbr->mode) {
+	case BBR_STARTUP:
+		bbr->pacing_gain = bbr3_startup_pacing_gain;
+		bbr->cwnd_gain	 = bbr3_startup_cwnd_gain;
+		break;
+	case BBR_DRAIN:
+		bbr->pacing_gain = bbr3_drain_gain;	/* slow, to drain */
+		bbr->cwnd_gain	 = bbr3_startup_cwnd_gain;	/* keep cwnd */
+		break;
+	case BBR_PROBE_BW:
+		bbr->pacing_gain = bbr3_pacing_gain[bbr->cycle_idx];
+		bbr->cwnd_gain	 = bbr->cycle_idx == BBR_BW_PROBE_UP ?
+				   bbr3_probe_up_cwnd_gain : bbr3_cwnd_gain;
+		break;
+	case BBR_PROBE_RTT:
+		bbr->pacing_gain = BBR_UNIT;
+		bbr->cwnd_gain	 = BBR_UNIT;
+		break;
+	default:
+		WARN_ONCE(1, "BBR bad mode: %u\n", bbr->mode);
+		break;
+	}
+}
+
+static void bbr3_update_model(struct sock *sk, const struct rate_sample *rs)
+{
+	bbr3_update_round(sk, rs);
+	bbr3_update_bw(sk, rs);
+	bbr3_update_ack_aggregation(sk, rs);
+	bbr3_check_full_bw_reached(sk, rs);
+	bbr3_check_drain(sk, rs);
+	bbr3_update_cycle_phase(sk, rs);
+	bbr3_update_min_rtt(sk, rs);
+	bbr3_update_gains(sk);
+}
+
+static void bbr3_main(struct sock *sk, u32 ack, int flag,
+		      const struct rate_sample *rs)
+{
+	struct bbr3 *bbr = inet_csk_ca(sk);
+	u32 bw;
+
+	bbr3_update_model(sk, rs);
+
+	bw = bbr3_bw(sk);
+	bbr3_set_pacing_rate(sk, bw, bbr->pacing_gain);
+	bbr3_set_cwnd(sk, rs, rs->acked_sacked, bw, bbr->cwnd_gain);
+}
+
+static void bbr3_init(struct sock *sk)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr3 *bbr = inet_csk_ca(sk);
+
+	memset(bbr, 0, sizeof(*bbr));
+
+	tp->snd_ssthresh = TCP_INFINITE_SSTHRESH;
+	bbr->next_rtt_delivered = tp->delivered;
+	bbr->round_lost = tp->lost;
+	bbr->round_ce = tp->delivered_ce;
+	bbr->prev_ca_state = TCP_CA_Open;
+
+	bbr->min_rtt_us = tcp_min_rtt(tp);
+	bbr->min_rtt_stamp = tcp_jiffies32;
+
+	bbr3_init_pacing_rate_from_rtt(sk);
+
+	bbr->inflight_hi = ~0U;
+	bbr3_reset_lower_bounds(sk);
+	bbr->bw_probe_up_cnt = ~0U;
+	bbr->ecn_alpha = BBR_UNIT;
+	bbr->mode = BBR_STARTUP;
+
+	bbr->ack_epoch_stamp = tp->tcp_mstamp;
+
+	cmpxchg(&sk->sk_pacing_status, SK_PACING_NONE, SK_PACING_NEEDED);
+}
+
+static u32 bbr3_sndbuf_expand(struct sock *sk)
+{
+	/* Provision 3 * cwnd since BBR may slow-start even during recovery. */
+	return 3;
+}
+
+static u32 bbr3_undo_cwnd(struct sock *sk)
+{
+	struct bbr3 *bbr = inet_csk_ca(sk);
+
+	bbr->full_bw = 0;   /* spurious slow-down; reset full pipe detection */
+	bbr->full_bw_cnt = 0;
+	bbr3_reset_lower_bounds(sk);
+	return tcp_snd_cwnd(tcp_sk(sk));
+}
+
+/* Entering loss recovery, so save cwnd for when we exit or undo recovery. */
+static u32 bbr3_ssthresh(struct sock *sk)
+{
+	bbr3_save_cwnd(sk);
+	return tcp_sk(sk)->snd_ssthresh;
+}
+
+static size_t bbr3_get_info(struct sock *sk, u32 ext, int *attr,
+			    union tcp_cc_info *info)
+{
+	if (ext & (1 << (INET_DIAG_BBRINFO - 1)) ||
+	    ext & (1 << (INET_DIAG_VEGASINFO - 1))) {
+		struct tcp_sock *tp = tcp_sk(sk);
+		struct bbr3 *bbr = inet_csk_ca(sk);
+		u64 bw = bbr3_bw(sk);
+
+		bw = bw * tp->mss_cache * USEC_PER_SEC >> BW_SCALE;
+		memset(&info->bbr, 0, sizeof(info->bbr));
+		info->bbr.bbr_bw_lo		= (u32)bw;
+		info->bbr.bbr_bw_hi		= (u32)(bw >> 32);
+		info->bbr.bbr_min_rtt		= bbr->min_rtt_us;
+		info->bbr.bbr_pacing_gain	= bbr->pacing_gain;
+		info->bbr.bbr_cwnd_gain		= bbr->cwnd_gain;
+		*attr = INET_DIAG_BBRINFO;
+		return sizeof(info->bbr);
+	}
+	return 0;
+}
+
+static void bbr3_set_state(struct sock *sk, u8 new_state)
+{
+	struct bbr3 *bbr = inet_csk_ca(sk);
+
+	if (new_state == TCP_CA_Loss) {
+		bbr->prev_ca_state = TCP_CA_Loss;
+		bbr->full_bw = 0;
+		bbr->round_start = 1;	/* treat RTO like end of a round */
+		bbr->loss_in_round = 1;
+		/* An RTO while probing means the probe went too far. */
+		if (bbr->bw_probe_samples) {
+			bbr->bw_probe_samples = 0;
+			bbr->inflight_hi = max_t(u32, bbr3_cwnd_min_target,
+						 (u64)bbr3_target_inflight(sk) *
+						 bbr3_beta >> BBR_SCALE);
+			if (bbr->mode == BBR_PROBE_BW &&
+			    bbr->cycle_idx == BBR_BW_PROBE_UP)
+				bbr3_start_bw_probe_down(sk);
+		}
+	}
+}
+
+static struct tcp_congestion_ops tcp_bbr3_cong_ops __read_mostly = {
+	.flags		= TCP_CONG_NON_RESTRICTED,
+	.name		= "bbr3",
+	.owner		= THIS_MODULE,
+	.init		= bbr3_init,
+	.cong_control	= bbr3_main,
+	.sndbuf_expand	= bbr3_sndbuf_expand,
+	.undo_cwnd	= bbr3_undo_cwnd,
+	.cwnd_event	= bbr3_cwnd_event,
+	.ssthresh	= bbr3_ssthresh,
+	.min_tso_segs	= bbr3_min_tso_segs,
+	.get_info	= bbr3_get_info,
+	.set_state	= bbr3_set_state,
+};
+
+static int __init bbr3_register(void)
+{
+	BUILD_BUG_ON(sizeof(struct bbr3) > ICSK_CA_PRIV_SIZE);
+	return tcp_register_congestion_control(&tcp_bbr3_cong_ops);
+}
+
+static void __exit bbr3_unregister(void)
+{
+	tcp_unregister_congestion_control(&tcp_bbr3_cong_ops);
+}
+
+module_init(bbr3_register);
+module_exit(bbr3_unregister);
+
+MODULE_LICENSE("Dual BSD/GPL");
+MODULE_DESCRIPTION("TCP BBRv3 (Bottleneck Bandwidth and RTT, version 3)");
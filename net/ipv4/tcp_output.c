@@ -1170,6 +1170,67 @@ void tcp_release_cb(struct sock *sk)
 }
 EXPORT_SYMBOL(tcp_release_cb);
 
+/* TCP internal pacing
+ *
+ * Sockets paced without the help of sch_fq wait for their departure time
+ * (tp->tcp_wstamp_ns) in a per cpu rbtree of throttled sockets, served by
+ * one hrtimer per cpu, much like the delayed flows of sch_fq. This avoids
+ * the cost of one hrtimer per socket, and sockets that are due within
+ * TCP_PACING_SLACK_NS of each other are released in the same batch.
+ *
+ * A socket is queued by its owner on the local cpu, and dequeued by the
+ * timer or by tcp_pacing_cancel(). tp->pacing_cpu is the cpu of the tree
+ * the socket is queued on, or -1, and only changes under that tree's lock.
+ */
+#define TCP_PACING_SLACK_NS	(10 * NSEC_PER_USEC)
+
+struct tcp_pacing_tree {
+	spinlock_t		lock;
+	struct rb_root_cached	root; /* throttled sockets, by deadline */
+	struct hrtimer		timer;
+};
+static DEFINE_PER_CPU(struct tcp_pacing_tree, tcp_pacing_tree);
+
+/* Note: Called under soft irq.
+ * We can call TCP stack right away, unless socket is owned by user.
+ */
+static enum hrtimer_restart tcp_pace_kick(struct hrtimer *timer)
+{
+	struct tcp_pacing_tree *pt = container_of(timer, struct tcp_pacing_tree,
+						  timer);
+	u64 now = ktime_get_ns();
+	struct rb_node *node;
+	struct tcp_sock *tp;
+	struct sock *sk;
+
+	for (;;) {
+		spin_lock(&pt->lock);
+		node = rb_first_cached(&pt->root);
+		if (!node) {
+			spin_unlock(&pt->lock);
+			break;
+		}
+		tp = rb_entry(node, struct tcp_sock, pacing_node);
+		if (tp->pacing_deadline_ns > now + TCP_PACING_SLACK_NS) {
+			hrtimer_start(&pt->timer,
+				      ns_to_ktime(tp->pacing_deadline_ns),
+				      HRTIMER_MODE_ABS_PINNED_SOFT);
+			spin_unlock(&pt->lock);
+			break;
+		}
+		rb_erase_cached(node, &pt->root);
+		/* pairs with smp_load_acquire() in tcp_pacing_check() */
+		smp_store_release(&tp->pacing_cpu, -1);
+		spin_unlock(&pt->lock);
+
+		sk = (struct sock *)tp;
+		tcp_tsq_handler(sk);
+		sock_put(sk);
+	}
+
+	return HRTIMER_NORESTART;
+}
+
 void __init tcp_tasklet_init(void)
 {
 	int i;
@@ -1180,6 +1241,16 @@ void __init tcp_tasklet_init(void)
 		INIT_LIST_HEAD(&tsq->head);
 		tasklet_setup(&tsq->tasklet, tcp_tasklet_func);
 	}
+
+	for_each_possible_cpu(i) {
+		struct tcp_pacing_tree *pt = &per_cpu(tcp_pacing_tree, i);
+
+		spin_lock_init(&pt->lock);
+		pt->root = RB_ROOT_CACHED;
+		hrtimer_init(&pt->timer, CLOCK_MONOTONIC,
+			     HRTIMER_MODE_ABS_PINNED_SOFT);
+		pt->timer.function = tcp_pace_kick;
+	}
 }
 
 /*
@@ -1231,18 +1302,63 @@ void tcp_wfree(struct sk_buff *skb)
 	sk_free(sk);
 }
 
-/* Note: Called under soft irq.
- * We can call TCP stack right away, unless socket is owned by user.
- */
-enum hrtimer_restart tcp_pace_kick(struct hrtimer *timer)
+/* Called by the socket owner, once the socket is not queued anymore. */
+static void tcp_pacing_queue(struct sock *sk)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct rb_node **p, *parent = NULL;
+	struct tcp_pacing_tree *pt;
+	bool leftmost = true;
+
+	tp->pacing_deadline_ns = tp->tcp_wstamp_ns;
+	sock_hold(sk);
+
+	local_bh_disable();
+	pt = this_cpu_ptr(&tcp_pacing_tree);
+	spin_lock(&pt->lock);
+	p = &pt->root.rb_root.rb_node;
+	while (*p) {
+		struct tcp_sock *aux;
+
+		parent = *p;
+		aux = rb_entry(parent, struct tcp_sock, pacing_node);
+		if (tp->pacing_deadline_ns >= aux->pacing_deadline_ns) {
+			p = &parent->rb_right;
+			leftmost = false;
+		} else {
+			p = &parent->rb_left;
+		}
+	}
+	rb_link_node(&tp->pacing_node, parent, p);
+	rb_insert_color_cached(&tp->pacing_node, &pt->root, leftmost);
+	WRITE_ONCE(tp->pacing_cpu, smp_processor_id());
+
+	/* the timer is armed for the leftmost socket, if any */
+	if (leftmost)
+		hrtimer_start(&pt->timer, ns_to_ktime(tp->pacing_deadline_ns),
+			      HRTIMER_MODE_ABS_PINNED_SOFT);
+	spin_unlock(&pt->lock);
+	local_bh_enable();
+}
+
+void tcp_pacing_cancel(struct sock *sk)
 {
-	struct tcp_sock *tp = container_of(timer, struct tcp_sock, pacing_timer);
-	struct sock *sk = (struct sock *)tp;
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct tcp_pacing_tree *pt;
+	int cpu;
 
-	tcp_tsq_handler(sk);
-	sock_put(sk);
+	cpu = READ_ONCE(tp->pacing_cpu);
+	if (cpu < 0)
+		return;
 
-	return HRTIMER_NORESTART;
+	pt = per_cpu_ptr(&tcp_pacing_tree, cpu);
+	spin_lock_bh(&pt->lock);
+	if (tp->pacing_cpu == cpu) {
+		rb_erase_cached(&tp->pacing_node, &pt->root);
+		WRITE_ONCE(tp->pacing_cpu, -1);
+		__sock_put(sk);
+	}
+	spin_unlock_bh(&pt->lock);
 }
 
 static void tcp_update_skb_after_send(struct sock *sk, struct sk_buff *skb,
@@ -2569,12 +2685,8 @@ static bool tcp_pacing_check(struct sock *sk)
 	if (tp->tcp_wstamp_ns <= tp->tcp_clock_cache)
 		return false;
 
-	if (!hrtimer_is_queued(&tp->pacing_timer)) {
-		hrtimer_start(&tp->pacing_timer,
-			      ns_to_ktime(tp->tcp_wstamp_ns),
-			      HRTIMER_MODE_ABS_PINNED_SOFT);
-		sock_hold(sk);
-	}
+	if (smp_load_acquire(&tp->pacing_cpu) < 0)
+		tcp_pacing_queue(sk);
 	return true;
 }
 
@@ -106,12 +106,40 @@ static struct sk_buff *ip6_extract_route_hint(const struct net *net,
 	return skb;
 }
 
+/* Number of destinations ip6_list_rcv_finish() keeps sublists and hints for,
+ * so that interleaved flows to a few destinations still share lookups.
+ */
+#define IP6_LIST_RCV_GROUPS	4
+
+struct ip6_list_rcv_group {
+	struct dst_entry	*dst;
+	struct sk_buff		*hint;
+	struct list_head	sublist;
+};
+
+static const struct sk_buff *
+ip6_list_rcv_find_hint(const struct ip6_list_rcv_group *groups,
+		       const struct sk_buff *skb)
+{
+	int i;
+
+	for (i = 0; i < IP6_LIST_RCV_GROUPS; i++)
+		if (ip6_can_use_hint(skb, groups[i].hint))
+			return groups[i].hint;
+	return NULL;
+}
+
 static void ip6_list_rcv_finish(struct net *net, struct sock *sk,
 				struct list_head *head)
 {
-	struct sk_buff *skb, *next, *hint = NULL;
-	struct dst_entry *curr_dst = NULL;
-	LIST_HEAD(sublist);
+	struct ip6_list_rcv_group groups[IP6_LIST_RCV_GROUPS] = {};
+	struct ip6_list_rcv_group *curr = NULL;
+	const struct sk_buff *hint;
+	struct sk_buff *skb, *next;
+	int i, victim = 0;
+
+	for (i = 0; i < IP6_LIST_RCV_GROUPS; i++)
+		INIT_LIST_HEAD(&groups[i].sublist);
 
 	list_for_each_entry_safe(skb, next, head, list) {
 		struct dst_entry *dst;
@@ -124,25 +152,35 @@ static void ip6_list_rcv_finish(struct net *net, struct sock *sk,
 		if (!skb)
 			continue;
 
-		if (ip6_can_use_hint(skb, hint))
+		hint = ip6_list_rcv_find_hint(groups, skb);
+		if (hint)
 			skb_dst_copy(skb, hint);
 		else
 			ip6_rcv_finish_core(net, sk, skb);
 		dst = skb_dst(skb);
-		if (curr_dst != dst) {
-			hint = ip6_extract_route_hint(net, skb);
+		if (!curr || curr->dst != dst) {
+			for (i = 0; i < IP6_LIST_RCV_GROUPS; i++)
+				if (groups[i].dst == dst)
+					break;
 
-			/* dispatch old sublist */
-			if (!list_empty(&sublist))
-				ip6_sublist_rcv_finish(&sublist);
-			/* start new sublist */
-			INIT_LIST_HEAD(&sublist);
-			curr_dst = dst;
+			if (i < IP6_LIST_RCV_GROUPS) {
+				curr = &groups[i];
+			} else {
+				/* Hints point into their own sublist, dispatch
+				 * the evicted one only once its hint is gone.
+				 */
+				curr = &groups[victim];
+				victim = (victim + 1) % IP6_LIST_RCV_GROUPS;
+				ip6_sublist_rcv_finish(&curr->sublist);
+				curr->dst = dst;
+				curr->hint = ip6_extract_route_hint(net, skb);
+			}
 		}
-		list_add_tail(&skb->list, &sublist);
+		list_add_tail(&skb->list, &curr->sublist);
 	}
-	/* dispatch final sublist */
-	ip6_sublist_rcv_finish(&sublist);
+	/* dispatch final sublists */
+	for (i = 0; i < IP6_LIST_RCV_GROUPS; i++)
+		ip6_sublist_rcv_finish(&groups[i].sublist);
 }
 
 static struct sk_buff *ip6_rcv_core(struct sk_buff *skb, struct net_device *dev,
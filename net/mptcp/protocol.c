@@ -1419,11 +1419,40 @@ bool mptcp_subflow_active(struct mptcp_subflow_context *subflow)
 #define SSK_MODE_BACKUP	1
 #define SSK_MODE_MAX	2
 
+/* Estimated time, in seconds << 32, for a burst queued now on @ssk to reach
+ * the peer: the queued data plus the burst at the measured delivery rate,
+ * plus half a RTT.
+ */
+static u64 mptcp_subflow_delivery_time(const struct sock *ssk, u32 pace,
+				       u32 burst)
+{
+	const struct tcp_sock *tp = tcp_sk(ssk);
+	u32 delivered = READ_ONCE(tp->rate_delivered);
+	u32 intv = READ_ONCE(tp->rate_interval_us);
+	u64 rate = 0, time;
+
+	if (delivered && intv)
+		rate = div_u64((u64)delivered * READ_ONCE(tp->mss_cache) *
+			       USEC_PER_SEC, intv);
+
+	/* An app-limited sample only tells how much we fed this subflow,
+	 * don't let it starve a path the scheduler has been avoiding.
+	 */
+	if (!rate || READ_ONCE(tp->rate_app_limited))
+		rate = max_t(u64, rate, pace);
+
+	time = div64_u64((u64)(READ_ONCE(ssk->sk_wmem_queued) + burst) << 32,
+			 rate);
+	return time + div_u64((u64)(READ_ONCE(tp->srtt_us) >> 4) << 32,
+			      USEC_PER_SEC);
+}
+
 /* implement the mptcp packet scheduler;
  * returns the subflow that will transmit the next DSS
  * additionally updates the rtx timeout
  */
-struct sock *mptcp_subflow_get_send(struct mptcp_sock *msk)
+static struct sock *__mptcp_subflow_get_send(struct mptcp_sock *msk,
+					     bool by_rate)
 {
 	struct subflow_send_info send_info[SSK_MODE_MAX];
 	struct mptcp_subflow_context *subflow;
@@ -1440,6 +1469,8 @@ struct sock *mptcp_subflow_get_send(struct mptcp_sock *msk)
 		send_info[i].linger_time = -1;
 	}
 
+	burst = min_t(int, MPTCP_SEND_BURST_SIZE, mptcp_wnd_end(msk) - msk->snd_nxt);
+
 	mptcp_for_each_subflow(msk, subflow) {
 		bool backup = subflow->backup || subflow->request_bkup;
 
@@ -1459,7 +1490,11 @@ struct sock *mptcp_subflow_get_send(struct mptcp_sock *msk)
 				continue;
 		}
 
-		linger_time = div_u64((u64)READ_ONCE(ssk->sk_wmem_queued) << 32, pace);
+		if (by_rate)
+			linger_time = mptcp_subflow_delivery_time(ssk, pace, burst);
+		else
+			linger_time = div_u64((u64)READ_ONCE(ssk->sk_wmem_queued) << 32,
+					      pace);
 		if (linger_time < send_info[backup].linger_time) {
 			send_info[backup].ssk = ssk;
 			send_info[backup].linger_time = linger_time;
@@ -1486,7 +1521,6 @@ struct sock *mptcp_subflow_get_send(struct mptcp_sock *msk)
 	if (!ssk || !sk_stream_memory_free(ssk))
 		return NULL;
 
-	burst = min_t(int, MPTCP_SEND_BURST_SIZE, mptcp_wnd_end(msk) - msk->snd_nxt);
 	wmem = READ_ONCE(ssk->sk_wmem_queued);
 	if (!burst)
 		return ssk;
@@ -1499,6 +1533,19 @@ struct sock *mptcp_subflow_get_send(struct mptcp_sock *msk)
 	return ssk;
 }
 
+struct sock *mptcp_subflow_get_send(struct mptcp_sock *msk)
+{
+	return __mptcp_subflow_get_send(msk, false);
+}
+
+/* Like mptcp_subflow_get_send(), but weights the subflows by their measured
+ * delivery rate and RTT instead of the pacing rate alone.
+ */
+struct sock *mptcp_subflow_get_send_rate(struct mptcp_sock *msk)
+{
+	return __mptcp_subflow_get_send(msk, true);
+}
+
 static void mptcp_push_release(struct sock *ssk, struct mptcp_sendmsg_info *info)
 {
 	tcp_push(ssk, 0, info->mss_now, tcp_sk(ssk)->nonagle, info->size_goal);
@@ -2332,7 +2379,8 @@ static void mptcp_tout_timer(struct timer_list *t)
  *
  * A backup subflow is returned only if that is the only kind available.
  */
-struct sock *mptcp_subflow_get_retrans(struct mptcp_sock *msk)
+static struct sock *__mptcp_subflow_get_retrans(struct mptcp_sock *msk,
+						bool by_rtt)
 {
 	struct sock *backup = NULL, *pick = NULL;
 	struct mptcp_subflow_context *subflow;
@@ -2357,7 +2405,8 @@ struct sock *mptcp_subflow_get_retrans(struct mptcp_sock *msk)
 			continue;
 		}
 
-		if (!pick)
+		if (!pick || (by_rtt && READ_ONCE(tcp_sk(ssk)->srtt_us) <
+					READ_ONCE(tcp_sk(pick)->srtt_us)))
 			pick = ssk;
 	}
 
@@ -2368,6 +2417,17 @@ struct sock *mptcp_subflow_get_retrans(struct mptcp_sock *msk)
 	return min_stale_count > 1 ? backup : NULL;
 }
 
+struct sock *mptcp_subflow_get_retrans(struct mptcp_sock *msk)
+{
+	return __mptcp_subflow_get_retrans(msk, false);
+}
+
+/* reinject on the idle subflow with the lowest RTT */
+struct sock *mptcp_subflow_get_retrans_rate(struct mptcp_sock *msk)
+{
+	return __mptcp_subflow_get_retrans(msk, true);
+}
+
 bool __mptcp_retransmit_pending_data(struct sock *sk)
 {
 	struct mptcp_data_frag *cur, *rtx_head;
@@ -36,6 +36,27 @@ static struct mptcp_sched_ops mptcp_sched_default = {
 	.owner		= THIS_MODULE,
 };
 
+static int mptcp_sched_rate_get_subflow(struct mptcp_sock *msk,
+					struct mptcp_sched_data *data)
+{
+	struct sock *ssk;
+
+	ssk = data->reinject ? mptcp_subflow_get_retrans_rate(msk) :
+			       mptcp_subflow_get_send_rate(msk);
+	if (!ssk)
+		return -EINVAL;
+
+	mptcp_subflow_set_scheduled(mptcp_subflow_ctx(ssk), true);
+	return 0;
+}
+
+/* weights subflows by delivery rate and RTT, see mptcp_subflow_get_send_rate() */
+static struct mptcp_sched_ops mptcp_sched_rate = {
+	.get_subflow	= mptcp_sched_rate_get_subflow,
+	.name		= "rate",
+	.owner		= THIS_MODULE,
+};
+
 /* Must be called with rcu read lock held */
 struct mptcp_sched_ops *mptcp_sched_find(const char *name)
 {
@@ -90,7 +111,7 @@ int mptcp_register_scheduler(struct mptcp_sched_ops *sched)
 
 void mptcp_unregister_scheduler(struct mptcp_sched_ops *sched)
 {
-	if (sched == &mptcp_sched_default)
+	if (sched == &mptcp_sched_default || sched == &mptcp_sched_rate)
 		return;
 
 	spin_lock(&mptcp_sched_list_lock);
@@ -101,6 +122,7 @@ void mptcp_unregister_scheduler(struct mptcp_sched_ops *sched)
 void mptcp_sched_init(void)
 {
 	mptcp_register_scheduler(&mptcp_sched_default);
+	mptcp_register_scheduler(&mptcp_sched_rate);
 }
 
 int mptcp_init_sched(struct mptcp_sock *msk,
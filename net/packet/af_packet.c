@@ -696,6 +696,17 @@ static void _prb_refresh_rx_retire_blk_timer(struct tpacket_kbdq_core *pkc)
 	pkc->last_kactive_blk_num = pkc->kactive_blk_num;
 }
 
+/* Called with the receive queue lock held. Tells whether a block was closed
+ * since the last call, so that sk_data_ready() can be called after unlock.
+ */
+static bool prb_take_data_ready(struct tpacket_kbdq_core *pkc)
+{
+	bool ready = pkc->data_ready_pending;
+
+	pkc->data_ready_pending = 0;
+	return ready;
+}
+
 /*
  * Timer logic:
  * 1) We refresh the timer only when we open a block.
@@ -726,6 +737,7 @@ static void prb_retire_rx_blk_timer_expired(struct timer_list *t)
 	struct tpacket_kbdq_core *pkc = GET_PBDQC_FROM_RB(&po->rx_ring);
 	unsigned int frozen;
 	struct tpacket_block_desc *pbd;
+	bool data_ready;
 
 	spin_lock(&po->sk.sk_receive_queue.lock);
 
@@ -789,7 +801,11 @@ static void prb_retire_rx_blk_timer_expired(struct timer_list *t)
 	_prb_refresh_rx_retire_blk_timer(pkc);
 
 out:
+	data_ready = prb_take_data_ready(pkc);
 	spin_unlock(&po->sk.sk_receive_queue.lock);
+
+	if (data_ready)
+		po->sk.sk_data_ready(&po->sk);
 }
 
 static void prb_flush_block(struct tpacket_kbdq_core *pkc1,
@@ -843,7 +859,6 @@ static void prb_close_block(struct tpacket_kbdq_core *pkc1,
 
 	struct tpacket3_hdr *last_pkt;
 	struct tpacket_hdr_v1 *h1 = &pbd1->hdr.bh1;
-	struct sock *sk = &po->sk;
 
 	if (atomic_read(&po->tp_drops))
 		status |= TP_STATUS_LOSING;
@@ -872,7 +887,10 @@ static void prb_close_block(struct tpacket_kbdq_core *pkc1,
 	/* Flush the block */
 	prb_flush_block(pkc1, pbd1, status);
 
-	sk->sk_data_ready(sk);
+	/* The reader is woken up once the receive queue lock is dropped,
+	 * see prb_take_data_ready().
+	 */
+	pkc1->data_ready_pending = 1;
 
 	pkc1->kactive_blk_num = GET_NEXT_PRB_BLK_NUM(pkc1);
 }
@@ -2296,6 +2314,7 @@ static int tpacket_rcv(struct sk_buff *skb, struct net_device *dev,
 	struct timespec64 ts;
 	__u32 ts_status;
 	unsigned int slot_id = 0;
+	bool data_ready = false;
 	int vnet_hdr_sz = 0;
 
 	/* struct tpacket{2,3}_hdr is aligned to a multiple of TPACKET_ALIGNMENT.
@@ -2439,8 +2458,13 @@ static int tpacket_rcv(struct sk_buff *skb, struct net_device *dev,
 		skb_clear_delivery_time(copy_skb);
 		__skb_queue_tail(&sk->sk_receive_queue, copy_skb);
 	}
+	if (po->tp_version == TPACKET_V3)
+		data_ready = prb_take_data_ready(GET_PBDQC_FROM_RB(&po->rx_ring));
 	spin_unlock(&sk->sk_receive_queue.lock);
 
+	if (data_ready)
+		sk->sk_data_ready(sk);
+
 	skb_copy_bits(skb, 0, h.raw + macoff, snaplen);
 
 	/* Always timestamp; prefer an existing software timestamp taken
@@ -2551,10 +2575,13 @@ static int tpacket_rcv(struct sk_buff *skb, struct net_device *dev,
 	return 0;
 
 drop_n_account:
+	if (po->tp_version == TPACKET_V3)
+		data_ready = prb_take_data_ready(GET_PBDQC_FROM_RB(&po->rx_ring));
 	spin_unlock(&sk->sk_receive_queue.lock);
 	atomic_inc(&po->tp_drops);
 	drop_reason = SKB_DROP_REASON_PACKET_SOCK_ERROR;
 
+	/* Wake readers for the drop; that also delivers @data_ready */
 	sk->sk_data_ready(sk);
 	sk_skb_reason_drop(sk, copy_skb, drop_reason);
 	goto drop_n_restore;
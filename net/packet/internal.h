@@ -20,6 +20,8 @@ struct tpacket_kbdq_core {
 	unsigned int	hdrlen;
 	unsigned char	reset_pending_on_curr_blk;
 	unsigned char   delete_blk_timer;
+	/* a block was closed, wake up the reader once unlocked */
+	unsigned char	data_ready_pending;
 	unsigned short	kactive_blk_num;
 	unsigned short	blk_sizeof_priv;
 
@@ -54,11 +54,16 @@ struct tls_decrypt_arg {
 	bool async;
 	bool async_done;
 	u8 tail;
+	/* !zc only: leading text bytes to decrypt straight into out_iov */
+	unsigned int zc_head;
 	);
 
 	struct sk_buff *skb;
 };
 
+/* Pinning user pages does not pay off for short reads */
+#define TLS_RX_ZC_HEAD_MIN	PAGE_SIZE
+
 struct tls_decrypt_ctx {
 	struct sock *sk;
 	u8 iv[TLS_MAX_IV_SIZE];
@@ -1494,12 +1499,17 @@ static int tls_decrypt_sg(struct sock *sk, struct iov_iter *out_iov,
 			n_sgout = sg_nents(out_sg);
 	} else {
 		darg->zc = false;
+		if (!out_iov || darg->zc_head >= data_len)
+			darg->zc_head = 0;
 
 		clear_skb = tls_alloc_clrtxt_skb(sk, skb, rxm->full_len);
 		if (!clear_skb)
 			return -ENOMEM;
 
 		n_sgout = 1 + skb_shinfo(clear_skb)->nr_frags;
+		if (darg->zc_head)
+			n_sgout += iov_iter_npages_cap(out_iov, INT_MAX,
+						       darg->zc_head);
 	}
 
 	/* Increment to accommodate AAD */
@@ -1567,13 +1577,28 @@ static int tls_decrypt_sg(struct sock *sk, struct iov_iter *out_iov,
 		goto exit_free;
 
 	if (clear_skb) {
+		unsigned int head = darg->zc_head;
+
 		sg_init_table(sgout, n_sgout);
 		sg_set_buf(&sgout[0], dctx->aad, prot->aad_size);
 
-		err = skb_to_sgvec(clear_skb, &sgout[1], prot->prepend_size,
-				   data_len + prot->tail_size);
+		/* The head of the text goes to user memory, the rest of the
+		 * record to the clear text skb, at the offset it would have
+		 * had anyway.
+		 */
+		if (head) {
+			err = tls_setup_from_iter(out_iov, head, &pages,
+						  &sgout[1], n_sgout - 1);
+			if (err < 0)
+				goto exit_free_pages;
+			sg_unmark_end(&sgout[pages]);
+		}
+
+		err = skb_to_sgvec(clear_skb, &sgout[1 + pages],
+				   prot->prepend_size + head,
+				   data_len - head + prot->tail_size);
 		if (err < 0)
-			goto exit_free;
+			goto exit_free_pages;
 	} else if (out_iov) {
 		sg_init_table(sgout, n_sgout);
 		sg_set_buf(&sgout[0], dctx->aad, prot->aad_size);
@@ -1691,6 +1716,7 @@ tls_decrypt_device(struct sock *sk, struct msghdr *msg,
 		return pad;
 
 	darg->async = false;
+	darg->zc_head = 0;
 	darg->skb = tls_strp_msg(ctx);
 	/* ->zc downgrade check, in case TLS 1.3 gets here */
 	darg->zc &= !(prot->version == TLS_1_3_VERSION &&
@@ -2031,9 +2057,17 @@ int tls_sw_recvmsg(struct sock *sk,
 		if (zc_capable && to_decrypt <= len &&
 		    tlm->control == TLS_RECORD_TYPE_DATA)
 			darg.zc = true;
+		/* TLS 1.2 record bigger than the buffer: decrypt what fits
+		 * straight to the user, only the rest into a clear text skb.
+		 */
+		else if (zc_capable && !async && len >= TLS_RX_ZC_HEAD_MIN &&
+			 prot->version != TLS_1_3_VERSION &&
+			 tlm->control == TLS_RECORD_TYPE_DATA)
+			darg.zc_head = len;
 
 		/* Do not use async mode if record is non-data */
-		if (tlm->control == TLS_RECORD_TYPE_DATA && !bpf_strp_enabled)
+		if (tlm->control == TLS_RECORD_TYPE_DATA && !bpf_strp_enabled &&
+		    !darg.zc_head)
 			darg.async = ctx->async_capable;
 		else
 			darg.async = false;
@@ -2055,7 +2089,7 @@ int tls_sw_recvmsg(struct sock *sk,
 		 */
 		err = tls_record_content_type(msg, tls_msg(darg.skb), &control);
 		if (err <= 0) {
-			DEBUG_NET_WARN_ON_ONCE(darg.zc);
+			DEBUG_NET_WARN_ON_ONCE(darg.zc || darg.zc_head);
 			tls_rx_rec_done(ctx);
 put_on_rx_list_err:
 			__skb_queue_tail(&ctx->rx_list, darg.skb);
@@ -2106,8 +2140,14 @@ int tls_sw_recvmsg(struct sock *sk,
 			if (partially_consumed)
 				chunk = len;
 
-			err = skb_copy_datagram_msg(skb, rxm->offset,
-						    msg, chunk);
+			/* the head was decrypted into the iov already */
+			if (darg.zc_head) {
+				DEBUG_NET_WARN_ON_ONCE(darg.zc_head != chunk);
+				err = 0;
+			} else {
+				err = skb_copy_datagram_msg(skb, rxm->offset,
+							    msg, chunk);
+			}
 			if (err < 0)
 				goto put_on_rx_list_err;
 
@@ -2741,7 +2781,23 @@ int tls_set_sw_offload(struct sock *sk, int tx)
 	memcpy(cctx->rec_seq, rec_seq, cipher_desc->rec_seq);
 
 	if (!*aead) {
-		*aead = crypto_alloc_aead(cipher_desc->cipher_name, 0, 0);
+		char pname[CRYPTO_MAX_ALG_NAME];
+		const char *name = cipher_desc->cipher_name;
+
+		/* Let pcrypt spread records over CPUs, it completes them in
+		 * submission order and tls_encrypt_done() runs as for any
+		 * other async tfm.
+		 */
+		if (tx && ctx->tx_parallel) {
+			if (snprintf(pname, sizeof(pname), "pcrypt(%s)",
+				     name) >= sizeof(pname)) {
+				rc = -ENAMETOOLONG;
+				goto free_priv;
+			}
+			name = pname;
+		}
+
+		*aead = crypto_alloc_aead(name, 0, 0);
 		if (IS_ERR(*aead)) {
 			rc = PTR_ERR(*aead);
 			*aead = NULL;
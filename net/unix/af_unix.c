@@ -646,6 +646,7 @@ static void unix_sock_destructor(struct sock *sk)
 	struct unix_sock *u = unix_sk(sk);
 
 	skb_queue_purge(&sk->sk_receive_queue);
+	skb_queue_purge(&sk->sk_error_queue);
 
 	DEBUG_NET_WARN_ON_ONCE(refcount_read(&sk->sk_wmem_alloc));
 	DEBUG_NET_WARN_ON_ONCE(!sk_unhashed(sk));
@@ -1828,16 +1829,16 @@ static int unix_getname(struct socket *sock, struct sockaddr *uaddr, int peer)
 	return err;
 }
 
-/* The "user->unix_inflight" variable is protected by the garbage
- * collection lock, and we just read it locklessly here. If you go
- * over the limit, there might be a tiny race in actually noticing
- * it across threads. Tough.
+/* The "user->unix_inflight" counter is updated without any lock held
+ * against this check. If you go over the limit, there might be a tiny
+ * race in actually noticing it across threads. Tough.
  */
 static inline bool too_many_unix_fds(struct task_struct *p)
 {
 	struct user_struct *user = current_user();
 
-	if (unlikely(READ_ONCE(user->unix_inflight) > task_rlimit(p, RLIMIT_NOFILE)))
+	if (unlikely(atomic_long_read(&user->unix_inflight) >
+		     task_rlimit(p, RLIMIT_NOFILE)))
 		return !capable(CAP_SYS_RESOURCE) && !capable(CAP_SYS_ADMIN);
 	return false;
 }
@@ -2242,6 +2243,7 @@ static int unix_stream_sendmsg(struct socket *sock, struct msghdr *msg,
 			       size_t len)
 {
 	struct sock *sk = sock->sk;
+	struct ubuf_info *uarg = NULL;
 	struct sock *other = NULL;
 	int err, size;
 	struct sk_buff *skb;
@@ -2279,10 +2281,28 @@ static int unix_stream_sendmsg(struct socket *sock, struct msghdr *msg,
 	if (READ_ONCE(sk->sk_shutdown) & SEND_SHUTDOWN)
 		goto pipe_err;
 
+	/* The receiver copies straight out of the pinned sender pages */
+	if ((msg->msg_flags & MSG_ZEROCOPY) && len &&
+	    !(msg->msg_flags & MSG_SPLICE_PAGES) &&
+	    sock_flag(sk, SOCK_ZEROCOPY) && user_backed_iter(&msg->msg_iter)) {
+		uarg = msg_zerocopy_realloc(sk, len, NULL);
+		if (!uarg) {
+			err = -ENOBUFS;
+			goto out_err;
+		}
+	}
+
 	while (sent < len) {
 		size = len - sent;
 
 		if (unlikely(msg->msg_flags & MSG_SPLICE_PAGES)) {
+			skb = sock_alloc_send_pskb(sk, 0, 0,
+						   msg->msg_flags & MSG_DONTWAIT,
+						   &err, 0);
+		} else if (uarg) {
+			/* Keep two messages in the pipe so it schedules better */
+			size = min_t(int, size, (READ_ONCE(sk->sk_sndbuf) >> 1) - 64);
+
 			skb = sock_alloc_send_pskb(sk, 0, 0,
 						   msg->msg_flags & MSG_DONTWAIT,
 						   &err, 0);
@@ -2322,6 +2342,18 @@ static int unix_stream_sendmsg(struct socket *sock, struct msghdr *msg,
 			}
 			size = err;
 			refcount_add(size, &sk->sk_wmem_alloc);
+		} else if (uarg) {
+			/* Pins up to MAX_SKB_FRAGS pages, charging them to
+			 * sk_wmem_alloc, and stops early with -EMSGSIZE.
+			 */
+			err = __zerocopy_sg_from_iter(msg, NULL, skb,
+						      &msg->msg_iter, size);
+			if (err == -EFAULT || (err == -EMSGSIZE && !skb->len)) {
+				kfree_skb(skb);
+				goto out_err;
+			}
+			skb_zcopy_set(skb, uarg, NULL);
+			size = skb->len;
 		} else {
 			skb_put(skb, size - data_len);
 			skb->data_len = data_len;
@@ -2357,6 +2389,7 @@ static int unix_stream_sendmsg(struct socket *sock, struct msghdr *msg,
 #endif
 
 	scm_destroy(&scm);
+	net_zcopy_put(uarg);
 
 	return sent;
 
@@ -2369,6 +2402,11 @@ static int unix_stream_sendmsg(struct socket *sock, struct msghdr *msg,
 	err = -EPIPE;
 out_err:
 	scm_destroy(&scm);
+	/* a partial send is still reported to the errqueue */
+	if (sent)
+		net_zcopy_put(uarg);
+	else
+		net_zcopy_put_abort(uarg, true);
 	return sent ? : err;
 }
 
@@ -2748,6 +2786,13 @@ static int unix_stream_read_skb(struct sock *sk, skb_read_actor_t recv_actor)
 	}
 #endif
 
+	/* sockmap may keep or redirect the skb */
+	err = skb_orphan_frags_rx(skb, GFP_ATOMIC);
+	if (err) {
+		kfree_skb(skb);
+		return err;
+	}
+
 	return recv_actor(sk, skb);
 }
 
@@ -2987,11 +3032,16 @@ static int unix_stream_recvmsg(struct socket *sock, struct msghdr *msg,
 		.size = size,
 		.flags = flags
 	};
-
-#ifdef CONFIG_BPF_SYSCALL
 	struct sock *sk = sock->sk;
+#ifdef CONFIG_BPF_SYSCALL
 	const struct proto *prot = READ_ONCE(sk->sk_prot);
+#endif
 
+	if (unlikely(flags & MSG_ERRQUEUE))
+		return sock_recv_errqueue(sk, msg, size, SOL_UNIX,
+					  UNIX_RECVERR);
+
+#ifdef CONFIG_BPF_SYSCALL
 	if (prot != &unix_stream_proto)
 		return prot->recvmsg(sk, msg, size, flags, NULL);
 #endif
@@ -3002,6 +3052,15 @@ static int unix_stream_splice_actor(struct sk_buff *skb,
 				    int skip, int chunk,
 				    struct unix_stream_read_state *state)
 {
+	int err;
+
+	/* Pages in a pipe outlive the skb, don't hand out MSG_ZEROCOPY
+	 * sender pages whose completion is reported when the skb is freed.
+	 */
+	err = skb_orphan_frags_rx(skb, GFP_KERNEL);
+	if (err)
+		return err;
+
 	return skb_splice_bits(skb, state->socket->sk,
 			       UNIXCB(skb).consumed + skip,
 			       state->pipe, chunk, state->splice_flags);
@@ -3220,7 +3279,8 @@ static __poll_t unix_poll(struct file *file, struct socket *sock, poll_table *wa
 	state = READ_ONCE(sk->sk_state);
 
 	/* exceptional events? */
-	if (READ_ONCE(sk->sk_err))
+	if (READ_ONCE(sk->sk_err) ||
+	    !skb_queue_empty_lockless(&sk->sk_error_queue))
 		mask |= EPOLLERR;
 	if (shutdown == SHUTDOWN_MASK)
 		mask |= EPOLLHUP;
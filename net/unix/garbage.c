@@ -191,11 +191,16 @@ void unix_add_edges(struct scm_fp_list *fpl, struct unix_sock *receiver)
 {
 	int i = 0, j = 0;
 
-	spin_lock(&unix_gc_lock);
+	atomic_long_add(fpl->count, &fpl->user->unix_inflight);
 
+	/* Only AF_UNIX sockets are part of the graph, leave the lock
+	 * alone when passing other files.
+	 */
 	if (!fpl->count_unix)
 		goto out;
 
+	spin_lock(&unix_gc_lock);
+
 	do {
 		struct unix_sock *inflight = unix_get_socket(fpl->fp[j++]);
 		struct unix_edge *edge;
@@ -212,11 +217,9 @@ void unix_add_edges(struct scm_fp_list *fpl, struct unix_sock *receiver)
 
 	receiver->scm_stat.nr_unix_fds += fpl->count_unix;
 	WRITE_ONCE(unix_tot_inflight, unix_tot_inflight + fpl->count_unix);
-out:
-	WRITE_ONCE(fpl->user->unix_inflight, fpl->user->unix_inflight + fpl->count);
 
 	spin_unlock(&unix_gc_lock);
-
+out:
 	fpl->inflight = true;
 
 	unix_free_vertices(fpl);
@@ -227,11 +230,13 @@ void unix_del_edges(struct scm_fp_list *fpl)
 	struct unix_sock *receiver;
 	int i = 0;
 
-	spin_lock(&unix_gc_lock);
+	atomic_long_sub(fpl->count, &fpl->user->unix_inflight);
 
 	if (!fpl->count_unix)
 		goto out;
 
+	spin_lock(&unix_gc_lock);
+
 	do {
 		struct unix_edge *edge = fpl->edges + i++;
 
@@ -243,11 +248,9 @@ void unix_del_edges(struct scm_fp_list *fpl)
 		receiver->scm_stat.nr_unix_fds -= fpl->count_unix;
 	}
 	WRITE_ONCE(unix_tot_inflight, unix_tot_inflight - fpl->count_unix);
-out:
-	WRITE_ONCE(fpl->user->unix_inflight, fpl->user->unix_inflight - fpl->count);
 
 	spin_unlock(&unix_gc_lock);
-
+out:
 	fpl->inflight = false;
 }
 
@@ -594,18 +597,20 @@ void wait_for_unix_gc(struct scm_fp_list *fpl)
 	/* If number of inflight sockets is insane,
 	 * force a garbage collect right now.
 	 *
-	 * Paired with the WRITE_ONCE() in unix_inflight(),
-	 * unix_notinflight(), and __unix_gc().
+	 * Paired with the WRITE_ONCE() in unix_add_edges(),
+	 * unix_del_edges(), unix_gc() and __unix_gc().
 	 */
 	if (READ_ONCE(unix_tot_inflight) > UNIX_INFLIGHT_TRIGGER_GC &&
 	    !READ_ONCE(gc_in_progress))
 		unix_gc();
 
 	/* Penalise users who want to send AF_UNIX sockets
-	 * but whose sockets have not been received yet.
+	 * but whose files have not been received yet.
+	 * user->unix_inflight counts every file in flight, not
+	 * only sockets, and is updated without unix_gc_lock.
 	 */
 	if (!fpl || !fpl->count_unix ||
-	    READ_ONCE(fpl->user->unix_inflight) < UNIX_INFLIGHT_SANE_USER)
+	    atomic_long_read(&fpl->user->unix_inflight) < UNIX_INFLIGHT_SANE_USER)
 		return;
 
 	if (READ_ONCE(gc_in_progress))
@@ -305,10 +305,16 @@ virtio_transport_cancel_pkt(struct vsock_sock *vsk)
 	return ret;
 }
 
+/* Number of rx buffers exposed to the device at once */
+#define VIRTIO_VSOCK_RX_BATCH 8
+
 static void virtio_vsock_rx_fill(struct virtio_vsock *vsock)
 {
 	int total_len = VIRTIO_VSOCK_DEFAULT_RX_BUF_SIZE + VIRTIO_VSOCK_SKB_HEADROOM;
-	struct scatterlist pkt, *p;
+	struct scatterlist pkt[VIRTIO_VSOCK_RX_BATCH];
+	struct scatterlist *p[VIRTIO_VSOCK_RX_BATCH];
+	struct virtqueue_buf bufs[VIRTIO_VSOCK_RX_BATCH];
+	unsigned int n, want, added, i;
 	struct virtqueue *vq;
 	struct sk_buff *skb;
 	int ret;
@@ -316,21 +322,31 @@ static void virtio_vsock_rx_fill(struct virtio_vsock *vsock)
 	vq = vsock->vqs[VSOCK_VQ_RX];
 
 	do {
-		skb = virtio_vsock_alloc_skb(total_len, GFP_KERNEL);
-		if (!skb)
-			break;
+		want = min_t(unsigned int, vq->num_free, VIRTIO_VSOCK_RX_BATCH);
+		for (n = 0; n < want; n++) {
+			skb = virtio_vsock_alloc_skb(total_len, GFP_KERNEL);
+			if (!skb)
+				break;
 
-		memset(skb->head, 0, VIRTIO_VSOCK_SKB_HEADROOM);
-		sg_init_one(&pkt, virtio_vsock_hdr(skb), total_len);
-		p = &pkt;
-		ret = virtqueue_add_sgs(vq, &p, 0, 1, skb, GFP_KERNEL);
-		if (ret < 0) {
-			kfree_skb(skb);
-			break;
+			memset(skb->head, 0, VIRTIO_VSOCK_SKB_HEADROOM);
+			sg_init_one(&pkt[n], virtio_vsock_hdr(skb), total_len);
+			p[n] = &pkt[n];
+			bufs[n] = (struct virtqueue_buf) {
+				.sgs = &p[n],
+				.in_sgs = 1,
+				.data = skb,
+			};
 		}
+		if (!n)
+			break;
+
+		ret = virtqueue_add_batch(vq, bufs, n, GFP_KERNEL);
+		added = max(ret, 0);
+		for (i = added; i < n; i++)
+			kfree_skb(bufs[i].data);
 
-		vsock->rx_buf_nr++;
-	} while (vq->num_free);
+		vsock->rx_buf_nr += added;
+	} while (added == want && vq->num_free);
 	if (vsock->rx_buf_nr > vsock->rx_buf_max_nr)
 		vsock->rx_buf_max_nr = vsock->rx_buf_nr;
 	virtqueue_kick(vq);
@@ -771,10 +771,44 @@ static struct sk_buff *xsk_build_skb(struct xdp_sock *xs,
 	return ERR_PTR(err);
 }
 
+/* Hand @skb to the driver. @next is the frame built right behind it, if
+ * any, so the driver may defer its doorbell. @next is given back to
+ * user-space along with @skb should the driver refuse the send.
+ */
+static int xsk_direct_xmit(struct xdp_sock *xs, struct sk_buff *skb,
+			   struct sk_buff *next)
+{
+	int err;
+
+	err = __dev_direct_xmit(skb, xs->queue_id, !!next);
+	if (err == NETDEV_TX_BUSY) {
+		/* Tell user-space to retry the send */
+		xskq_cons_cancel_n(xs->tx, xsk_get_num_desc(skb) +
+					   xsk_get_num_desc(next));
+		xsk_consume_skb(skb);
+		if (next)
+			xsk_consume_skb(next);
+		return -EAGAIN;
+	}
+
+	/* Ignore NET_XMIT_CN as packet might have been sent */
+	if (err == NET_XMIT_DROP) {
+		/* SKB completed but not sent */
+		if (next) {
+			xskq_cons_cancel_n(xs->tx, xsk_get_num_desc(next));
+			xsk_consume_skb(next);
+		}
+		return -EBUSY;
+	}
+
+	return 0;
+}
+
 static int __xsk_generic_xmit(struct sock *sk)
 {
 	struct xdp_sock *xs = xdp_sk(sk);
 	u32 max_batch = TX_BATCH_SIZE;
+	struct sk_buff *pending = NULL;
 	bool sent_frame = false;
 	struct xdp_desc desc;
 	struct sk_buff *skb;
@@ -797,6 +831,18 @@ static int __xsk_generic_xmit(struct sock *sk)
 			goto out;
 		}
 
+		/* A multi-buffer frame can be dropped half way through, which
+		 * would leave consumed descriptors between the pending frame
+		 * and the one following it. Send the pending frame first.
+		 */
+		if (pending && xp_mb_desc(&desc)) {
+			err = xsk_direct_xmit(xs, pending, NULL);
+			pending = NULL;
+			if (err)
+				goto out;
+			sent_frame = true;
+		}
+
 		/* This is the backpressure mechanism for the Tx path.
 		 * Reserve space in the completion queue and only proceed
 		 * if there is space in it. This avoids having to implement
@@ -820,26 +866,29 @@ static int __xsk_generic_xmit(struct sock *sk)
 			xs->skb = skb;
 			continue;
 		}
+		xs->skb = NULL;
 
-		err = __dev_direct_xmit(skb, xs->queue_id);
-		if  (err == NETDEV_TX_BUSY) {
-			/* Tell user-space to retry the send */
-			xskq_cons_cancel_n(xs->tx, xsk_get_num_desc(skb));
-			xsk_consume_skb(skb);
-			err = -EAGAIN;
-			goto out;
+		/* Each frame is held back until the next one is built, so
+		 * that all but the last frame of a batch go out with
+		 * xmit_more set.
+		 */
+		if (pending) {
+			err = xsk_direct_xmit(xs, pending, skb);
+			if (err) {
+				pending = NULL;
+				goto out;
+			}
+			sent_frame = true;
 		}
+		pending = skb;
+	}
 
-		/* Ignore NET_XMIT_CN as packet might have been sent */
-		if (err == NET_XMIT_DROP) {
-			/* SKB completed but not sent */
-			err = -EBUSY;
-			xs->skb = NULL;
+	if (pending) {
+		err = xsk_direct_xmit(xs, pending, NULL);
+		pending = NULL;
+		if (err)
 			goto out;
-		}
-
 		sent_frame = true;
-		xs->skb = NULL;
 	}
 
 	if (xskq_has_descs(xs->tx)) {
@@ -849,6 +898,15 @@ static int __xsk_generic_xmit(struct sock *sk)
 	}
 
 out:
+	if (pending) {
+		int ret = xsk_direct_xmit(xs, pending, NULL);
+
+		if (ret)
+			err = ret;
+		else
+			sent_frame = true;
+	}
+
 	if (sent_frame)
 		if (xsk_tx_writeable(xs))
 			sk->sk_write_space(sk);
@@ -314,20 +314,25 @@ bool xp_put_pool(struct xsk_buff_pool *pool)
 	return false;
 }
 
-static struct xsk_dma_map *xp_find_dma_map(struct xsk_buff_pool *pool)
+/* The mapping of a umem is keyed by the DMA device rather than the netdev,
+ * so that all ports behind one device share it and a frame received on one
+ * of them can be sent out of another straight from the umem.
+ */
+static struct xsk_dma_map *xp_find_dma_map(struct xsk_buff_pool *pool,
+					   struct device *dev)
 {
 	struct xsk_dma_map *dma_map;
 
 	list_for_each_entry(dma_map, &pool->umem->xsk_dma_list, list) {
-		if (dma_map->netdev == pool->netdev)
+		if (dma_map->dev == dev)
 			return dma_map;
 	}
 
 	return NULL;
 }
 
-static struct xsk_dma_map *xp_create_dma_map(struct device *dev, struct net_device *netdev,
-					     u32 nr_pages, struct xdp_umem *umem)
+static struct xsk_dma_map *xp_create_dma_map(struct device *dev, u32 nr_pages,
+					     struct xdp_umem *umem)
 {
 	struct xsk_dma_map *dma_map;
 
@@ -341,7 +346,6 @@ static struct xsk_dma_map *xp_create_dma_map(struct device *dev, struct net_devi
 		return NULL;
 	}
 
-	dma_map->netdev = netdev;
 	dma_map->dev = dev;
 	dma_map->dma_pages_cnt = nr_pages;
 	refcount_set(&dma_map->users, 1);
@@ -381,7 +385,7 @@ void xp_dma_unmap(struct xsk_buff_pool *pool, unsigned long attrs)
 	if (!pool->dma_pages)
 		return;
 
-	dma_map = xp_find_dma_map(pool);
+	dma_map = xp_find_dma_map(pool, pool->dev);
 	if (!dma_map) {
 		WARN(1, "Could not find dma_map for device");
 		return;
@@ -443,7 +447,7 @@ int xp_dma_map(struct xsk_buff_pool *pool, struct device *dev,
 	int err;
 	u32 i;
 
-	dma_map = xp_find_dma_map(pool);
+	dma_map = xp_find_dma_map(pool, dev);
 	if (dma_map) {
 		err = xp_init_dma_info(pool, dma_map);
 		if (err)
@@ -453,7 +457,7 @@ int xp_dma_map(struct xsk_buff_pool *pool, struct device *dev,
 		return 0;
 	}
 
-	dma_map = xp_create_dma_map(dev, pool->netdev, nr_pages, pool->umem);
+	dma_map = xp_create_dma_map(dev, nr_pages, pool->umem);
 	if (!dma_map)
 		return -ENOMEM;
 
@@ -20,6 +20,7 @@
 #include <linux/skbuff.h>
 #include <linux/percpu.h>
 #include <linux/list.h>
+#include <linux/jhash.h>
 #include <net/sock.h>
 #include <linux/un.h>
 #include <net/af_unix.h>
@@ -122,9 +123,14 @@ static struct kmem_cache *avc_xperms_data_cachep __ro_after_init;
 static struct kmem_cache *avc_xperms_decision_cachep __ro_after_init;
 static struct kmem_cache *avc_xperms_cachep __ro_after_init;
 
+/*
+ * SIDs are small, densely allocated integers, so shifting and xoring them
+ * leaves most of the table unused and builds long chains in the rest. Mix
+ * all three words so hot tuples spread over every slot.
+ */
 static inline u32 avc_hash(u32 ssid, u32 tsid, u16 tclass)
 {
-	return (ssid ^ (tsid<<2) ^ (tclass<<4)) & (AVC_CACHE_SLOTS - 1);
+	return jhash_3words(ssid, tsid, tclass, 0) & (AVC_CACHE_SLOTS - 1);
 }
 
 /**
@@ -719,6 +719,18 @@ union bpf_iter_link_info {
  *			Update spin_lock-ed map elements. This must be
  *			specified if the map value contains a spinlock.
  *
+ *		The *flags* argument may be specified as:
+ *
+ *		**BPF_F_BATCH_REPLACE**
+ *			Replace all elements of the map with the *count*
+ *			given elements. Programs see either the old or the
+ *			new set of elements, never a mix of them. On
+ *			error, the map is left unchanged and *count* is
+ *			set to 0. Only supported by
+ *			**BPF_MAP_TYPE_LPM_TRIE**, and *elem_flags* must
+ *			be **BPF_ANY**. Other map types fail with
+ *			**EINVAL** if any *flags* are set.
+ *
  *		On success, *count* elements from the map are updated.
  *
  *		If an error is returned and *errno* is not **EFAULT**, *count*
@@ -1010,6 +1022,7 @@ enum bpf_map_type {
 	BPF_MAP_TYPE_USER_RINGBUF,
 	BPF_MAP_TYPE_CGRP_STORAGE,
 	BPF_MAP_TYPE_ARENA,
+	BPF_MAP_TYPE_PERCPU_RINGBUF,
 	__MAX_BPF_MAP_TYPE
 };
 
@@ -1357,6 +1370,11 @@ enum {
 	BPF_F_LOCK	= 4, /* spin_lock-ed map_lookup/map_update */
 };
 
+/* flags for BPF_MAP_UPDATE_BATCH command */
+enum {
+	BPF_F_BATCH_REPLACE	= (1U << 0), /* replace all map elements */
+};
+
 /* flags for BPF_MAP_CREATE command */
 enum {
 	BPF_F_NO_PREALLOC	= (1U << 0),
@@ -1413,6 +1431,22 @@ enum {
 
 /* Do not translate kernel bpf_arena pointers to user pointers */
 	BPF_F_NO_USER_CONV	= (1U << 18),
+
+/* Grow and shrink the buckets of a hash map with its number of elements */
+	BPF_F_RESIZABLE		= (1U << 19),
+
+/* Evict from an LRU hash map by sweeping its elements instead of rotating
+ * a common LRU list
+ */
+	BPF_F_LRU_SAMPLED	= (1U << 20),
+
+/* Back a BPF arena with 2M huge pages, in the kernel and in user space */
+	BPF_F_ARENA_HUGE_PAGES	= (1U << 21),
+};
+
+/* flags for bpf_arena_alloc_pages() */
+enum {
+	BPF_F_ARENA_INTERLEAVE	= (1U << 0), /* spread pages over memory nodes */
 };
 
 /* Flags for BPF_PROG_QUERY. */
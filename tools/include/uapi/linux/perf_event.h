@@ -460,7 +460,8 @@ struct perf_event_attr {
 				inherit_thread :  1, /* children only inherit if cloned with CLONE_THREAD */
 				remove_on_exec :  1, /* event is removed from task on exec */
 				sigtrap        :  1, /* send synchronous SIGTRAP on event */
-				__reserved_1   : 26;
+				record_seq     :  1, /* prefix records with a sequence number */
+				__reserved_1   : 25;
 
 	union {
 		__u32		wakeup_events;	  /* wakeup every n events */
@@ -750,6 +751,27 @@ struct perf_event_mmap_page {
 	__u64	aux_tail;
 	__u64	aux_offset;
 	__u64	aux_size;
+
+	/*
+	 * Overwrite buffers of write_backward events with attr.record_seq set
+	 * can be read without pausing them.  Every record is preceded by a
+	 * __u64 sequence number that is not included in header.size, which
+	 * identifies it across successive snapshots of the buffer.
+	 *
+	 * @data_reserved is the position up to which the kernel may be
+	 * writing, in the units of @data_head.  It is updated before any
+	 * record data is stored, so a reader can do:
+	 *
+	 *   head = ->data_head
+	 *   smp_rmb()
+	 *   copy the buffer
+	 *   smp_rmb()
+	 *   reserved = ->data_reserved
+	 *
+	 * and use the records within the first data_size - (head - reserved)
+	 * bytes of the copy, starting at head; the others may be torn.
+	 */
+	__u64	data_reserved;
 };
 
 /*
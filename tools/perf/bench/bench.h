@@ -48,7 +48,13 @@ int bench_uprobe_empty(int argc, const char **argv);
 int bench_uprobe_trace_printk(int argc, const char **argv);
 int bench_uprobe_empty_ret(int argc, const char **argv);
 int bench_uprobe_trace_printk_ret(int argc, const char **argv);
+int bench_uprobe_insn_emulated(int argc, const char **argv);
+int bench_uprobe_insn_xol(int argc, const char **argv);
 int bench_pmu_scan(int argc, const char **argv);
+int bench_fs_fsync(int argc, const char **argv);
+int bench_fs_create(int argc, const char **argv);
+int bench_net_connect(int argc, const char **argv);
+int bench_net_rpc(int argc, const char **argv);
 
 #define BENCH_FORMAT_DEFAULT_STR	"default"
 #define BENCH_FORMAT_DEFAULT		0
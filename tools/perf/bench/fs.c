@@ -0,0 +1,197 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * fs: filesystem microbenchmarks
+ *
+ * fsync:  every thread appends a block to its own file and fsync()s it, so
+ *         the threads compete for the filesystem's journal/log commit and
+ *         show how well it batches concurrent commits.
+ * create: every thread creates, closes and unlinks small files in its own
+ *         directory, exercising inode allocation and directory updates.
+ *
+ * Both report the throughput and the latency distribution of one operation.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <subcmd/parse-options.h>
+#include "bench.h"
+#include "latency.h"
+
+struct fs_worker {
+	struct lat_worker lw;
+	char path[PATH_MAX];
+};
+
+static struct {
+	unsigned int nthreads;
+	unsigned int runtime;
+	unsigned int size;
+	const char *dir;
+	bool datasync;
+} params = {
+	.nthreads = 4,
+	.runtime  = 5,
+	.size	  = 4096,
+	.dir	  = ".",
+};
+
+static const struct option fsync_options[] = {
+	OPT_UINTEGER('t', "threads", &params.nthreads, "Specify amount of threads"),
+	OPT_UINTEGER('r', "runtime", &params.runtime, "Specify runtime (in seconds)"),
+	OPT_UINTEGER('s', "size", &params.size, "Bytes appended before each sync"),
+	OPT_STRING('d', "dir", &params.dir, "DIR", "Directory to run in"),
+	OPT_BOOLEAN('D', "datasync", &params.datasync, "Use fdatasync() instead of fsync()"),
+	OPT_END()
+};
+
+static const struct option create_options[] = {
+	OPT_UINTEGER('t', "threads", &params.nthreads, "Specify amount of threads"),
+	OPT_UINTEGER('r', "runtime", &params.runtime, "Specify runtime (in seconds)"),
+	OPT_UINTEGER('s', "size", &params.size, "Bytes written to each file"),
+	OPT_STRING('d', "dir", &params.dir, "DIR", "Directory to run in"),
+	OPT_END()
+};
+
+static const char * const bench_fs_fsync_usage[] = {
+	"perf bench fs fsync <options>",
+	NULL
+};
+
+static const char * const bench_fs_create_usage[] = {
+	"perf bench fs create <options>",
+	NULL
+};
+
+static void *fsync_workerfn(void *arg)
+{
+	struct fs_worker *w = arg;
+	char *buf;
+	int fd;
+
+	buf = calloc(1, params.size);
+	fd = open(w->path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (!buf || fd < 0)
+		w->lw.err = errno;
+
+	lat_bench_wait_for_start();
+
+	while (!w->lw.err && !lat_bench_done) {
+		u64 start = lat_bench_now_ns();
+
+		if (write(fd, buf, params.size) != (ssize_t)params.size ||
+		    (params.datasync ? fdatasync(fd) : fsync(fd))) {
+			w->lw.err = errno;
+			break;
+		}
+		if (lat_bench_record(&w->lw, lat_bench_now_ns() - start))
+			w->lw.err = ENOMEM;
+	}
+
+	if (fd >= 0) {
+		close(fd);
+		unlink(w->path);
+	}
+	free(buf);
+	return NULL;
+}
+
+static void *create_workerfn(void *arg)
+{
+	struct fs_worker *w = arg;
+	char name[PATH_MAX + 32];
+	unsigned long nr = 0;
+	char *buf;
+
+	buf = calloc(1, params.size ?: 1);
+	if (!buf || mkdir(w->path, 0700))
+		w->lw.err = errno;
+
+	lat_bench_wait_for_start();
+
+	while (!w->lw.err && !lat_bench_done) {
+		u64 start = lat_bench_now_ns();
+		int fd;
+
+		snprintf(name, sizeof(name), "%s/f%lu", w->path, nr++);
+		fd = open(name, O_WRONLY | O_CREAT | O_EXCL, 0600);
+		if (fd < 0 ||
+		    (params.size && write(fd, buf, params.size) != (ssize_t)params.size)) {
+			w->lw.err = errno;
+			if (fd >= 0)
+				close(fd);
+			break;
+		}
+		close(fd);
+		if (unlink(name)) {
+			w->lw.err = errno;
+			break;
+		}
+		if (lat_bench_record(&w->lw, lat_bench_now_ns() - start))
+			w->lw.err = ENOMEM;
+	}
+
+	rmdir(w->path);
+	free(buf);
+	return NULL;
+}
+
+static int fs_worker_setup(void *arg)
+{
+	struct fs_worker *w = arg;
+
+	snprintf(w->path, sizeof(w->path), "%s/perf-bench-fs.%d.%u",
+		 params.dir, getpid(), w->lw.tid);
+	w->lw.name = w->path;
+	return 0;
+}
+
+static int run_bench(const char *op, void *(*workerfn)(void *))
+{
+	struct lat_bench b = {
+		.op		= op,
+		.nthreads	= params.nthreads ?: 1,
+		.runtime	= params.runtime,
+		.worker_size	= sizeof(struct fs_worker),
+		.workerfn	= workerfn,
+		.setup		= fs_worker_setup,
+	};
+
+	return lat_bench_run(&b);
+}
+
+int bench_fs_fsync(int argc, const char **argv)
+{
+	argc = parse_options(argc, argv, fsync_options, bench_fs_fsync_usage, 0);
+	if (argc) {
+		usage_with_options(bench_fs_fsync_usage, fsync_options);
+		exit(EXIT_FAILURE);
+	}
+	if (!params.size)
+		params.size = 1;
+
+	printf("# %u threads appending %u bytes and calling %s() in %s for %u secs\n\n",
+	       params.nthreads, params.size,
+	       params.datasync ? "fdatasync" : "fsync", params.dir, params.runtime);
+
+	return run_bench(params.datasync ? "fdatasync" : "fsync", fsync_workerfn);
+}
+
+int bench_fs_create(int argc, const char **argv)
+{
+	argc = parse_options(argc, argv, create_options, bench_fs_create_usage, 0);
+	if (argc) {
+		usage_with_options(bench_fs_create_usage, create_options);
+		exit(EXIT_FAILURE);
+	}
+
+	printf("# %u threads creating and unlinking %u-byte files in %s for %u secs\n\n",
+	       params.nthreads, params.size, params.dir, params.runtime);
+
+	return run_bench("create+unlink", create_workerfn);
+}
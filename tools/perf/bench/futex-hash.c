@@ -21,6 +21,7 @@
 #include <linux/zalloc.h>
 #include <sys/time.h>
 #include <sys/mman.h>
+#include <sys/prctl.h>
 #include <perf/cpumap.h>
 
 #include "../util/mutex.h"
@@ -31,6 +32,12 @@
 
 #include <err.h>
 
+#ifndef PR_FUTEX_HASH
+#define PR_FUTEX_HASH			77
+# define PR_FUTEX_HASH_SET_SLOTS	1
+# define PR_FUTEX_HASH_GET_SLOTS	2
+#endif
+
 static bool done = false;
 static int futex_flag = 0;
 
@@ -59,6 +66,7 @@ static const struct option options[] = {
 	OPT_BOOLEAN( 's', "silent",  &params.silent, "Silent mode: do not display data/details"),
 	OPT_BOOLEAN( 'S', "shared",  &params.fshared, "Use shared futexes instead of private ones"),
 	OPT_BOOLEAN( 'm', "mlockall", &params.mlockall, "Lock all current and future memory"),
+	OPT_UINTEGER('b', "buckets", &params.nbuckets, "Use a private futex hash with this many buckets"),
 	OPT_END()
 };
 
@@ -162,8 +170,19 @@ int bench_futex_hash(int argc, const char **argv)
 	if (!params.fshared)
 		futex_flag = FUTEX_PRIVATE_FLAG;
 
-	printf("Run summary [PID %d]: %d threads, each operating on %d [%s] futexes for %d secs.\n\n",
+	/* must be done while still single threaded */
+	if (params.nbuckets &&
+	    prctl(PR_FUTEX_HASH, PR_FUTEX_HASH_SET_SLOTS, params.nbuckets, 0, 0)) {
+		warn("PR_FUTEX_HASH_SET_SLOTS, using the global futex hash");
+		params.nbuckets = 0;
+	}
+
+	printf("Run summary [PID %d]: %d threads, each operating on %d [%s] futexes for %d secs.\n",
 	       getpid(), params.nthreads, params.nfutexes, params.fshared ? "shared":"private", params.runtime);
+	if (params.nbuckets)
+		printf("Futex hash: private, %d buckets\n\n", params.nbuckets);
+	else
+		printf("Futex hash: global\n\n");
 
 	init_stats(&throughput_stats);
 	mutex_init(&thread_lock);
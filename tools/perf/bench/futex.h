@@ -25,6 +25,7 @@ struct bench_futex_parameters {
 	unsigned int nfutexes;
 	unsigned int nwakes;
 	unsigned int nrequeue;
+	unsigned int nbuckets; /* private futex hash, 0: global */
 };
 
 /**
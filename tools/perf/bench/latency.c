@@ -0,0 +1,211 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Shared harness of the fs and net benchmarks: start all threads at once,
+ * stop them after the runtime or on SIGINT, and print the throughput and the
+ * latency percentiles of the operations they recorded.
+ */
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <linux/compiler.h>
+#include <linux/kernel.h>
+#include <linux/time64.h>
+#include <linux/zalloc.h>
+
+#include "../util/mutex.h"
+#include "bench.h"
+#include "latency.h"
+
+#include <err.h>
+
+bool lat_bench_done;
+static struct mutex thread_lock;
+static unsigned int threads_starting;
+static struct cond thread_parent, thread_worker;
+
+u64 lat_bench_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u64)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+int lat_bench_record(struct lat_worker *w, u64 ns)
+{
+	if (w->nr_lat == w->max_lat) {
+		size_t max = w->max_lat ? w->max_lat * 2 : 4096;
+		u64 *lat = realloc(w->lat, max * sizeof(*lat));
+
+		if (!lat)
+			return -ENOMEM;
+		w->lat = lat;
+		w->max_lat = max;
+	}
+	w->lat[w->nr_lat++] = ns;
+	return 0;
+}
+
+void lat_bench_wait_for_start(void)
+{
+	mutex_lock(&thread_lock);
+	threads_starting--;
+	if (!threads_starting)
+		cond_signal(&thread_parent);
+	cond_wait(&thread_worker, &thread_lock);
+	mutex_unlock(&thread_lock);
+}
+
+static void toggle_done(int sig __maybe_unused,
+			siginfo_t *info __maybe_unused,
+			void *uc __maybe_unused)
+{
+	lat_bench_done = true;
+	gettimeofday(&bench__end, NULL);
+	timersub(&bench__end, &bench__start, &bench__runtime);
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	u64 x = *(const u64 *)a, y = *(const u64 *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static double percentile_us(const u64 *lat, size_t nr, double pct)
+{
+	size_t idx = (size_t)(pct / 100.0 * (nr - 1) + 0.5);
+
+	return lat[idx] / (double)NSEC_PER_USEC;
+}
+
+static struct lat_worker *worker_at(const struct lat_bench *b, void *workers,
+				    unsigned int i)
+{
+	return workers + i * b->worker_size;
+}
+
+static void print_summary(const struct lat_bench *b, void *workers)
+{
+	double secs = bench__runtime.tv_sec + bench__runtime.tv_usec / 1e6;
+	size_t nr = 0, i, pos = 0;
+	struct lat_worker *w;
+	u64 *all;
+
+	for (i = 0; i < b->nthreads; i++)
+		nr += worker_at(b, workers, i)->nr_lat;
+	if (!nr) {
+		printf("No %s operation completed\n", b->op);
+		return;
+	}
+
+	all = malloc(nr * sizeof(*all));
+	if (!all)
+		err(EXIT_FAILURE, "malloc");
+	for (i = 0; i < b->nthreads; i++) {
+		w = worker_at(b, workers, i);
+		memcpy(all + pos, w->lat, w->nr_lat * sizeof(*all));
+		pos += w->nr_lat;
+	}
+	qsort(all, nr, sizeof(*all), cmp_u64);
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %zu %s operations in %.2f secs: %.0f ops/sec\n",
+		       nr, b->op, secs, secs > 0 ? nr / secs : 0);
+		printf(" %14s: %10.2f usecs\n", "min", all[0] / (double)NSEC_PER_USEC);
+		printf(" %14s: %10.2f usecs\n", "p50", percentile_us(all, nr, 50));
+		printf(" %14s: %10.2f usecs\n", "p90", percentile_us(all, nr, 90));
+		printf(" %14s: %10.2f usecs\n", "p99", percentile_us(all, nr, 99));
+		printf(" %14s: %10.2f usecs\n", "p99.9", percentile_us(all, nr, 99.9));
+		printf(" %14s: %10.2f usecs\n", "max", all[nr - 1] / (double)NSEC_PER_USEC);
+		break;
+	case BENCH_FORMAT_SIMPLE:
+		printf("%.0f %.2f %.2f %.2f\n", secs > 0 ? nr / secs : 0,
+		       percentile_us(all, nr, 50), percentile_us(all, nr, 99),
+		       percentile_us(all, nr, 99.9));
+		break;
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+	}
+	free(all);
+}
+
+int lat_bench_run(const struct lat_bench *b)
+{
+	struct sigaction act;
+	struct lat_worker *w;
+	void *workers;
+	unsigned int i;
+	int ret = 0;
+
+	memset(&act, 0, sizeof(act));
+	sigfillset(&act.sa_mask);
+	act.sa_sigaction = toggle_done;
+	sigaction(SIGINT, &act, NULL);
+
+	workers = calloc(b->nthreads, b->worker_size);
+	if (!workers)
+		err(EXIT_FAILURE, "calloc");
+
+	mutex_init(&thread_lock);
+	cond_init(&thread_parent);
+	cond_init(&thread_worker);
+	threads_starting = b->nthreads;
+
+	for (i = 0; i < b->nthreads; i++) {
+		w = worker_at(b, workers, i);
+		w->tid = i;
+		if (b->setup && b->setup(w))
+			err(EXIT_FAILURE, "setup");
+		if (pthread_create(&w->thread, NULL, b->workerfn, w))
+			err(EXIT_FAILURE, "pthread_create");
+	}
+
+	mutex_lock(&thread_lock);
+	while (threads_starting)
+		cond_wait(&thread_parent, &thread_lock);
+	gettimeofday(&bench__start, NULL);
+	cond_broadcast(&thread_worker);
+	mutex_unlock(&thread_lock);
+
+	sleep(b->runtime);
+	toggle_done(0, NULL, NULL);
+
+	for (i = 0; i < b->nthreads; i++) {
+		w = worker_at(b, workers, i);
+		if (pthread_join(w->thread, NULL))
+			err(EXIT_FAILURE, "pthread_join");
+		if (b->teardown)
+			b->teardown(w);
+		if (w->err) {
+			if (w->name)
+				fprintf(stderr, "thread %u: %s: %s\n", i,
+					w->name, strerror(w->err));
+			else
+				fprintf(stderr, "thread %u: %s\n", i,
+					strerror(w->err));
+			ret = -1;
+		}
+	}
+
+	cond_destroy(&thread_parent);
+	cond_destroy(&thread_worker);
+	mutex_destroy(&thread_lock);
+
+	if (!ret)
+		print_summary(b, workers);
+
+	for (i = 0; i < b->nthreads; i++)
+		zfree(&worker_at(b, workers, i)->lat);
+	free(workers);
+	return ret;
+}
@@ -0,0 +1,44 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Harness for benchmarks that run a number of threads for a fixed time and
+ * report the throughput and latency distribution of one operation.
+ */
+#ifndef _BENCH_LATENCY_H
+#define _BENCH_LATENCY_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <linux/types.h>
+
+/* Must be the first member of a benchmark's own per-thread struct */
+struct lat_worker {
+	pthread_t thread;
+	unsigned int tid;
+	const char *name;	/* reported with errors, optional */
+	u64 *lat;		/* per-operation latencies, in nsecs */
+	size_t nr_lat;
+	size_t max_lat;
+	int err;		/* errno that stopped the thread */
+};
+
+struct lat_bench {
+	const char *op;			/* name of the measured operation */
+	unsigned int nthreads;
+	unsigned int runtime;		/* in seconds */
+	size_t worker_size;		/* size of the per-thread struct */
+	void *(*workerfn)(void *worker);
+	/* optional, called for each thread before and after it runs */
+	int (*setup)(void *worker);
+	void (*teardown)(void *worker);
+};
+
+/* Set once the runtime is over or on SIGINT */
+extern bool lat_bench_done;
+
+u64 lat_bench_now_ns(void);
+int lat_bench_record(struct lat_worker *w, u64 ns);
+void lat_bench_wait_for_start(void);
+int lat_bench_run(const struct lat_bench *b);
+
+#endif /* _BENCH_LATENCY_H */
@@ -0,0 +1,286 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * net: loopback network stack microbenchmarks
+ *
+ * connect: every thread owns a listener and loops connect(), accept() and
+ *          close() against it, stressing ephemeral port selection, the
+ *          established hash and socket setup/teardown.
+ * rpc:     every thread exchanges fixed-size request/response messages with
+ *          its own echo thread over a TCP (or, with -u, AF_UNIX) stream,
+ *          measuring the round-trip latency of a small RPC.
+ *
+ * Both report the throughput and the latency distribution of one operation.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include <subcmd/parse-options.h>
+#include "bench.h"
+#include "latency.h"
+
+struct net_worker {
+	struct lat_worker lw;
+	pthread_t echo_thread;
+	int fd[2];		/* rpc: client and server ends */
+};
+
+static struct {
+	unsigned int nthreads;
+	unsigned int runtime;
+	unsigned int size;
+	bool unix_sock;
+} params = {
+	.nthreads = 4,
+	.runtime  = 5,
+	.size	  = 64,
+};
+
+static const struct option connect_options[] = {
+	OPT_UINTEGER('t', "threads", &params.nthreads, "Specify amount of threads"),
+	OPT_UINTEGER('r', "runtime", &params.runtime, "Specify runtime (in seconds)"),
+	OPT_END()
+};
+
+static const struct option rpc_options[] = {
+	OPT_UINTEGER('t', "threads", &params.nthreads, "Specify amount of client/server pairs"),
+	OPT_UINTEGER('r', "runtime", &params.runtime, "Specify runtime (in seconds)"),
+	OPT_UINTEGER('s', "size", &params.size, "Request and response size in bytes"),
+	OPT_BOOLEAN('u', "unix", &params.unix_sock, "Use AF_UNIX instead of loopback TCP"),
+	OPT_END()
+};
+
+static const char * const bench_net_connect_usage[] = {
+	"perf bench net connect <options>",
+	NULL
+};
+
+static const char * const bench_net_rpc_usage[] = {
+	"perf bench net rpc <options>",
+	NULL
+};
+
+static int tcp_listen(struct sockaddr_in *addr)
+{
+	socklen_t len = sizeof(*addr);
+	int fd;
+
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0)
+		return -1;
+
+	memset(addr, 0, sizeof(*addr));
+	addr->sin_family = AF_INET;
+	addr->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(fd, (struct sockaddr *)addr, sizeof(*addr)) ||
+	    listen(fd, 128) ||
+	    getsockname(fd, (struct sockaddr *)addr, &len)) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static void *connect_workerfn(void *arg)
+{
+	struct linger lin = { .l_onoff = 1, .l_linger = 0 };
+	struct net_worker *w = arg;
+	struct sockaddr_in addr;
+	int lfd;
+
+	lfd = tcp_listen(&addr);
+	if (lfd < 0)
+		w->lw.err = errno;
+
+	lat_bench_wait_for_start();
+
+	while (!w->lw.err && !lat_bench_done) {
+		u64 start = lat_bench_now_ns();
+		int cfd, afd = -1;
+
+		cfd = socket(AF_INET, SOCK_STREAM, 0);
+		if (cfd < 0 ||
+		    connect(cfd, (struct sockaddr *)&addr, sizeof(addr)) ||
+		    (afd = accept(lfd, NULL, NULL)) < 0) {
+			w->lw.err = errno;
+			if (cfd >= 0)
+				close(cfd);
+			break;
+		}
+		/*
+		 * Reset rather than FIN the client side so that a long run
+		 * does not exhaust the ephemeral range with TIME_WAIT sockets.
+		 */
+		setsockopt(cfd, SOL_SOCKET, SO_LINGER, &lin, sizeof(lin));
+		close(cfd);
+		close(afd);
+		if (lat_bench_record(&w->lw, lat_bench_now_ns() - start))
+			w->lw.err = ENOMEM;
+	}
+
+	if (lfd >= 0)
+		close(lfd);
+	return NULL;
+}
+
+static int xfer(int fd, char *buf, size_t len, bool send)
+{
+	size_t off = 0;
+
+	while (off < len) {
+		ssize_t ret = send ? write(fd, buf + off, len - off) :
+				     read(fd, buf + off, len - off);
+
+		if (ret <= 0)
+			return ret ? -1 : 0;
+		off += ret;
+	}
+	return 1;
+}
+
+static void *echo_workerfn(void *arg)
+{
+	struct net_worker *w = arg;
+	char *buf;
+
+	buf = calloc(1, params.size);
+	if (!buf)
+		return NULL;
+
+	/* runs until the client shuts down its end */
+	while (xfer(w->fd[1], buf, params.size, false) > 0 &&
+	       xfer(w->fd[1], buf, params.size, true) > 0)
+		;
+
+	free(buf);
+	return NULL;
+}
+
+static int rpc_connect(struct net_worker *w)
+{
+	struct sockaddr_in addr;
+	int one = 1;
+	int lfd;
+
+	if (params.unix_sock)
+		return socketpair(AF_UNIX, SOCK_STREAM, 0, w->fd);
+
+	lfd = tcp_listen(&addr);
+	if (lfd < 0)
+		return -1;
+
+	w->fd[0] = socket(AF_INET, SOCK_STREAM, 0);
+	if (w->fd[0] < 0 ||
+	    connect(w->fd[0], (struct sockaddr *)&addr, sizeof(addr)) ||
+	    (w->fd[1] = accept(lfd, NULL, NULL)) < 0) {
+		close(lfd);
+		return -1;
+	}
+	close(lfd);
+
+	setsockopt(w->fd[0], IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	setsockopt(w->fd[1], IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	return 0;
+}
+
+static void *rpc_workerfn(void *arg)
+{
+	struct net_worker *w = arg;
+	char *buf;
+
+	buf = calloc(1, params.size);
+	if (!buf)
+		w->lw.err = ENOMEM;
+
+	lat_bench_wait_for_start();
+
+	while (!w->lw.err && !lat_bench_done) {
+		u64 start = lat_bench_now_ns();
+
+		if (xfer(w->fd[0], buf, params.size, true) <= 0 ||
+		    xfer(w->fd[0], buf, params.size, false) <= 0) {
+			w->lw.err = errno ?: EPIPE;
+			break;
+		}
+		if (lat_bench_record(&w->lw, lat_bench_now_ns() - start))
+			w->lw.err = ENOMEM;
+	}
+
+	shutdown(w->fd[0], SHUT_WR);
+	free(buf);
+	return NULL;
+}
+
+static int rpc_setup(void *arg)
+{
+	struct net_worker *w = arg;
+
+	if (rpc_connect(w))
+		return -1;
+	return pthread_create(&w->echo_thread, NULL, echo_workerfn, w);
+}
+
+static void rpc_teardown(void *arg)
+{
+	struct net_worker *w = arg;
+
+	pthread_join(w->echo_thread, NULL);
+	close(w->fd[0]);
+	close(w->fd[1]);
+}
+
+static int run_bench(const char *op, void *(*workerfn)(void *), bool rpc)
+{
+	struct lat_bench b = {
+		.op		= op,
+		.nthreads	= params.nthreads ?: 1,
+		.runtime	= params.runtime,
+		.worker_size	= sizeof(struct net_worker),
+		.workerfn	= workerfn,
+		.setup		= rpc ? rpc_setup : NULL,
+		.teardown	= rpc ? rpc_teardown : NULL,
+	};
+
+	signal(SIGPIPE, SIG_IGN);
+	return lat_bench_run(&b);
+}
+
+int bench_net_connect(int argc, const char **argv)
+{
+	argc = parse_options(argc, argv, connect_options, bench_net_connect_usage, 0);
+	if (argc) {
+		usage_with_options(bench_net_connect_usage, connect_options);
+		exit(EXIT_FAILURE);
+	}
+
+	printf("# %u threads connecting to loopback TCP listeners for %u secs\n\n",
+	       params.nthreads, params.runtime);
+
+	return run_bench("connect+accept+close", connect_workerfn, false);
+}
+
+int bench_net_rpc(int argc, const char **argv)
+{
+	argc = parse_options(argc, argv, rpc_options, bench_net_rpc_usage, 0);
+	if (argc) {
+		usage_with_options(bench_net_rpc_usage, rpc_options);
+		exit(EXIT_FAILURE);
+	}
+	if (!params.size)
+		params.size = 1;
+
+	printf("# %u %s pairs exchanging %u-byte messages for %u secs\n\n",
+	       params.nthreads, params.unix_sock ? "AF_UNIX" : "loopback TCP",
+	       params.size, params.runtime);
+
+	return run_bench("round-trip", rpc_workerfn, true);
+}
@@ -31,8 +31,40 @@ enum bench_uprobe {
 	BENCH_UPROBE__TRACE_PRINTK,
 	BENCH_UPROBE__EMPTY_RET,
 	BENCH_UPROBE__TRACE_PRINTK_RET,
+	BENCH_UPROBE__INSN_EMULATED,
+	BENCH_UPROBE__INSN_XOL,
 };
 
+/*
+ * Functions probed by the insn benchmarks.  On x86-64 the first insn of
+ * bench_uprobe__insn_emulated is emulated by the kernel, while the one of
+ * bench_uprobe__insn_xol (a load) has to be single-stepped out of line.
+ */
+void bench_uprobe__insn_emulated(void);
+void bench_uprobe__insn_xol(void);
+
+#ifdef __x86_64__
+asm(
+"	.pushsection .text\n"
+"	.globl bench_uprobe__insn_emulated\n"
+"	.type bench_uprobe__insn_emulated, @function\n"
+"bench_uprobe__insn_emulated:\n"
+"	sub $8, %rsp\n"
+"	add $8, %rsp\n"
+"	ret\n"
+"	.size bench_uprobe__insn_emulated, .-bench_uprobe__insn_emulated\n"
+"	.globl bench_uprobe__insn_xol\n"
+"	.type bench_uprobe__insn_xol, @function\n"
+"bench_uprobe__insn_xol:\n"
+"	mov (%rsp), %rax\n"
+"	ret\n"
+"	.size bench_uprobe__insn_xol, .-bench_uprobe__insn_xol\n"
+"	.popsection\n");
+#else
+noinline void bench_uprobe__insn_emulated(void) { asm volatile(""); }
+noinline void bench_uprobe__insn_xol(void) { asm volatile(""); }
+#endif
+
 static const struct option options[] = {
 	OPT_INTEGER('l', "loop",	&loops,		"Specify number of loops"),
 	OPT_END()
@@ -49,7 +81,7 @@ static const char * const bench_uprobe_usage[] = {
 #define bench_uprobe__attach_uprobe(prog) \
 	skel->links.prog = bpf_program__attach_uprobe_opts(/*prog=*/skel->progs.prog, \
 							   /*pid=*/-1, \
-							   /*binary_path=*/"libc.so.6", \
+							   /*binary_path=*/binary_path, \
 							   /*func_offset=*/0, \
 							   /*opts=*/&uprobe_opts); \
 	if (!skel->links.prog) { \
@@ -63,6 +95,7 @@ struct bench_uprobe_bpf *skel;
 static int bench_uprobe__setup_bpf_skel(enum bench_uprobe bench)
 {
 	DECLARE_LIBBPF_OPTS(bpf_uprobe_opts, uprobe_opts);
+	const char *binary_path = "libc.so.6";
 	int err;
 
 	/* Load and verify BPF application */
@@ -85,6 +118,16 @@ static int bench_uprobe__setup_bpf_skel(enum bench_uprobe bench)
 	case BENCH_UPROBE__TRACE_PRINTK: bench_uprobe__attach_uprobe(trace_printk);	break;
 	case BENCH_UPROBE__EMPTY_RET:	 bench_uprobe__attach_uprobe(empty_ret);	break;
 	case BENCH_UPROBE__TRACE_PRINTK_RET: bench_uprobe__attach_uprobe(trace_printk_ret); break;
+	case BENCH_UPROBE__INSN_EMULATED:
+		binary_path = "/proc/self/exe";
+		uprobe_opts.func_name = "bench_uprobe__insn_emulated";
+		bench_uprobe__attach_uprobe(empty);
+		break;
+	case BENCH_UPROBE__INSN_XOL:
+		binary_path = "/proc/self/exe";
+		uprobe_opts.func_name = "bench_uprobe__insn_xol";
+		bench_uprobe__attach_uprobe(empty);
+		break;
 	default:
 		fprintf(stderr, "Invalid bench: %d\n", bench);
 		goto cleanup;
@@ -146,6 +189,7 @@ static int bench_uprobe_format__default_fprintf(const char *name, const char *un
 static int bench_uprobe(int argc, const char **argv, enum bench_uprobe bench)
 {
 	const char *name = "usleep(1000)", *unit = "usec";
+	void (*insn_fn)(void) = NULL;
 	struct timespec start, end;
 	u64 diff;
 	int i;
@@ -155,10 +199,21 @@ static int bench_uprobe(int argc, const char **argv, enum bench_uprobe bench)
 	if (bench != BENCH_UPROBE__BASELINE && bench_uprobe__setup_bpf_skel(bench) < 0)
 		return 0;
 
+	if (bench == BENCH_UPROBE__INSN_EMULATED) {
+		name = "bench_uprobe__insn_emulated()";
+		insn_fn = bench_uprobe__insn_emulated;
+	} else if (bench == BENCH_UPROBE__INSN_XOL) {
+		name = "bench_uprobe__insn_xol()";
+		insn_fn = bench_uprobe__insn_xol;
+	}
+
         clock_gettime(CLOCK_REALTIME, &start);
 
 	for (i = 0; i < loops; i++) {
-		usleep(USEC_PER_MSEC);
+		if (insn_fn)
+			insn_fn();
+		else
+			usleep(USEC_PER_MSEC);
 	}
 
 	clock_gettime(CLOCK_REALTIME, &end);
@@ -211,3 +266,13 @@ int bench_uprobe_trace_printk_ret(int argc, const char **argv)
 {
 	return bench_uprobe(argc, argv, BENCH_UPROBE__TRACE_PRINTK_RET);
 }
+
+int bench_uprobe_insn_emulated(int argc, const char **argv)
+{
+	return bench_uprobe(argc, argv, BENCH_UPROBE__INSN_EMULATED);
+}
+
+int bench_uprobe_insn_xol(int argc, const char **argv)
+{
+	return bench_uprobe(argc, argv, BENCH_UPROBE__INSN_XOL);
+}
@@ -0,0 +1,76 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+#
+# Sweep the hash map benchmarks over producer count, key/value size, map
+# flags and fill ratio, printing one CSV row per configuration so runs on
+# different kernels can be diffed or plotted directly.
+#
+# Usage: run_bench_map_matrix.sh [max_producers]
+
+source ./benchs/run_common.sh
+
+set -eufo pipefail
+
+nr_cpus=$(nproc)
+max_prod=${1:-$nr_cpus}
+
+producers()
+{
+	local p=1
+
+	while [ $p -lt $max_prod ]; do
+		echo $p
+		p=$((p * 2))
+	done
+	echo $max_prod
+}
+
+# bpf-hashmap-lookup --quiet prints one "M events/sec" value per CPU
+sum_lookup()
+{
+	awk '{ s += $NF } END { printf "%.3f", s }'
+}
+
+per_prod_op()
+{
+	echo "$*" | sed -E "s/.*per-prod-op\s+([0-9]+\.[0-9]+) .*/\1/"
+}
+
+max_entries=1000
+echo "bench,map_flags,key_size,fill_pct,producers,total_Mops"
+for flags in 0 0x1; do		# 0x1 == BPF_F_NO_PREALLOC
+	for key_size in 4 16 64 256; do
+		for fill in 25 50 100; do
+			nr_entries=$((max_entries * fill / 100))
+			for p in $(producers); do
+				res=$($RUN_BENCH --quiet -p $p bpf-hashmap-lookup \
+					--key_size=$key_size --map_flags=$flags \
+					--max_entries=$max_entries \
+					--nr_entries=$nr_entries | sum_lookup)
+				echo "lookup,$flags,$key_size,$fill,$p,$res"
+			done
+		done
+	done
+done
+
+echo
+echo "bench,use_case,prealloc,value_size,producers,per_prod_Kops"
+for use_case in overwrite batch_add_batch_del add_del_on_diff_cpu; do
+	for prealloc in "" "--preallocated"; do
+		for value_size in 8 256 4096; do
+			for p in $(producers); do
+				# add_del_on_diff_cpu pairs producers up
+				if [ $use_case = add_del_on_diff_cpu ] && [ $((p % 2)) -ne 0 ]; then
+					continue
+				fi
+				pa=0
+				if [ -n "$prealloc" ]; then
+					pa=1
+				fi
+				summary=$($RUN_BENCH -p $p htab-mem --use-case $use_case \
+					--value-size $value_size $prealloc | tail -n1)
+				echo "htab-mem,$use_case,$pa,$value_size,$p,$(per_prod_op $summary)"
+			done
+		done
+	done
+done
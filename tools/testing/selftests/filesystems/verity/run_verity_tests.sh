@@ -0,0 +1,89 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+#
+# Check that fs-verity fails reads of the page spanning EOF when data past EOF
+# in that page is not zero.  With 1K Merkle tree blocks in 4K pages, an odd
+# number of blocks before EOF leaves one of them queued for hashing when the
+# bad block past EOF is found, which must not hide the error.
+
+ksft_skip=4
+merkle_block_size=1024
+
+tmpdir=
+loopdev=
+ret=0
+
+cleanup()
+{
+	[ -n "$tmpdir" ] && mountpoint -q "$tmpdir/mnt" && umount "$tmpdir/mnt"
+	[ -n "$loopdev" ] && losetup -d "$loopdev"
+	[ -n "$tmpdir" ] && rm -rf "$tmpdir"
+}
+
+skip()
+{
+	echo "SKIP: $*"
+	cleanup
+	exit $ksft_skip
+}
+
+if [ "$(id -u)" -ne 0 ]; then
+	skip "must be run as root"
+fi
+
+for tool in mkfs.ext4 fsverity filefrag losetup mountpoint; do
+	if ! command -v $tool > /dev/null; then
+		skip "$tool is not installed"
+	fi
+done
+
+page_size=$(getconf PAGE_SIZE)
+if [ "$page_size" -lt $((4 * merkle_block_size)) ]; then
+	skip "page size $page_size is too small"
+fi
+
+tmpdir=$(mktemp -d)
+mkdir "$tmpdir/mnt"
+truncate -s 64M "$tmpdir/img"
+loopdev=$(losetup -f --show "$tmpdir/img") || skip "no loop device"
+mkfs.ext4 -q -b "$page_size" -O verity "$loopdev" || skip "mkfs.ext4 failed"
+mount "$loopdev" "$tmpdir/mnt" || skip "mount failed"
+
+# Write a file of $1 bytes, enable verity and dirty the last byte of its first
+# page on disk.  Reading it back has to fail.
+test_dirty_past_eof()
+{
+	local size=$1
+	local file=$tmpdir/mnt/file_$size
+	local blk
+
+	head -c "$size" /dev/urandom > "$file"
+	if ! fsverity enable --block-size=$merkle_block_size "$file"; then
+		skip "fsverity enable --block-size=$merkle_block_size failed"
+	fi
+	if ! cat "$file" > /dev/null; then
+		echo "FAIL: reading clean $size byte file failed"
+		ret=1
+		return
+	fi
+
+	blk=$(filefrag -v "$file" | awk '$1 == "0:" { print $4 + 0 }')
+	umount "$tmpdir/mnt"
+	printf '\xff' | dd of="$loopdev" bs=1 conv=notrunc status=none \
+		seek=$((blk * page_size + page_size - 1))
+	mount "$loopdev" "$tmpdir/mnt"
+
+	if cat "$file" > /dev/null 2>&1; then
+		echo "FAIL: $size byte file with data past EOF was read"
+		ret=1
+	else
+		echo "PASS: $size byte file with data past EOF was rejected"
+	fi
+}
+
+# One and three Merkle tree blocks before EOF
+test_dirty_past_eof $merkle_block_size
+test_dirty_past_eof $((3 * merkle_block_size))
+
+cleanup
+exit $ret